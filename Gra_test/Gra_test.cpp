@@ -4,6 +4,10 @@
 #include "stdafx.h"
 #include "Gra_test.h"
 #include "window.h"
+#include "platform.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include "memorytracker.h"
 
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_opt_ HINSTANCE hPrevInstance,
@@ -14,7 +18,25 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     UNREFERENCED_PARAMETER(lpCmdLine);
 
     // TODO: Place code here.
-	app::window CurrentWindow(hInstance, 800, 600);
+	core::profiler::SetThreadName("Main");
+
+    // The budgets are set before the window creates the renderer so its first allocations are checked too.
+    // Exceeding one is reported to the debugger output like the hitches are.
+    core::memorytracker::SetBudgetCallback([](const core::memorybudgetwarning& warning)
+    {
+        char line[256];
+        core::memorytracker::FormatWarning(warning, line, sizeof(line));
+        OutputDebugStringA(line);
+        OutputDebugStringA("\n");
+    });
+    core::memorytracker::SetBudget(core::memorytag::meshes, graphics::MESH_MEMORY_BUDGET);
+    core::memorytracker::SetBudget(core::memorytag::shaders, graphics::SHADER_MEMORY_BUDGET);
+    core::memorytracker::SetBudget(core::memorytag::rendertargets, graphics::RENDER_TARGET_MEMORY_BUDGET);
+    core::memorytracker::SetBudget(core::memorytag::frame, graphics::FRAME_MEMORY_BUDGET);
+
+    // The window stamps the input with the clock of the main loop.
+    app::qpcclock timer;
+	app::window CurrentWindow(hInstance, 800, 600, timer);
 
     // Initialize global strings
 	CurrentWindow.MyRegisterClass(hInstance);
@@ -27,18 +49,30 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
     HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_GRATEST));
 
-    MSG msg;
-
     // Main message loop:
-    while (GetMessage(&msg, nullptr, 0, 0))
+    // Messages are drained without blocking, the simulation advances in fixed steps
+    // and a frame is rendered on every iteration of the loop.
+    app::win32messages messages(hAccelTable);
+    app::mainloop loop(timer, messages, app::loopsettings{});
+
+    // Hitches go to the debugger output, the frame history is written to the working directory on exit.
+    core::telemetry frameTelemetry;
+    frameTelemetry.SetHitchCallback([](const core::hitchrecord& hitch)
     {
-        if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
-        {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
-        }
-		CurrentWindow.RenderFrame();
-    }
+        char line[512];
+        core::telemetry::FormatHitch(hitch, line, sizeof(line));
+        OutputDebugStringA(line);
+        OutputDebugStringA("\n");
+    });
+    loop.SetTelemetry(&frameTelemetry);
+
+    int exitCode = loop.Run(CurrentWindow);
+    frameTelemetry.WriteCsv("telemetry.csv");
+
+    char memoryReport[1024];
+    core::memorytracker::FormatReport(memoryReport, sizeof(memoryReport));
+    OutputDebugStringA(memoryReport);
+    OutputDebugStringA("\n");
 
-    return (int) msg.wParam;
+    return exitCode;
 }
@@ -0,0 +1,219 @@
+#include "stdafx.h"
+#include "allocators.h"
+
+namespace core
+{
+	namespace
+	{
+		std::size_t AlignUp(std::size_t value, std::size_t alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	linearallocator::linearallocator(std::size_t size, memorytag tag) :
+		m_memory(new unsigned char[size]), m_capacity(size), m_tag(tag)
+	{
+		if (size == 0)
+		{
+			throw "Incorrect linear allocator size.";
+		}
+
+		memorytracker::Allocated(m_tag, m_capacity);
+	}
+
+	linearallocator::~linearallocator()
+	{
+		memorytracker::Freed(m_tag, m_capacity);
+	}
+
+	// The offset is bumped with a CAS so the aligned start and the end are claimed together.
+	void* linearallocator::Allocate(std::size_t size, std::size_t alignment)
+	{
+		std::uintptr_t base = reinterpret_cast<std::uintptr_t>(m_memory.get());
+		std::size_t offset = m_offset.load(std::memory_order_relaxed);
+		std::size_t start, end;
+
+		do
+		{
+			start = AlignUp(base + offset, alignment) - base;
+			end = start + size;
+			if (end > m_capacity)
+			{
+				m_failed.fetch_add(1, std::memory_order_relaxed);
+				return nullptr;
+			}
+		} while (!m_offset.compare_exchange_weak(offset, end, std::memory_order_relaxed));
+
+		return m_memory.get() + start;
+	}
+
+	// The peak is raised with a CAS, GetPeak may read it from another thread while the arena is reset.
+	void linearallocator::Reset()
+	{
+		std::size_t used = m_offset.exchange(0);
+		std::size_t peak = m_peak.load(std::memory_order_relaxed);
+		while (used > peak and !m_peak.compare_exchange_weak(peak, used, std::memory_order_relaxed))
+		{
+		}
+		m_failed.store(0);
+	}
+
+	std::size_t linearallocator::GetUsed() const
+	{
+		return m_offset.load(std::memory_order_relaxed);
+	}
+
+	std::size_t linearallocator::GetPeak() const
+	{
+		std::size_t used = GetUsed();
+		std::size_t peak = m_peak.load(std::memory_order_relaxed);
+		return used > peak ? used : peak;
+	}
+
+	std::size_t linearallocator::GetCapacity() const
+	{
+		return m_capacity;
+	}
+
+	std::uint32_t linearallocator::GetFailedAllocations() const
+	{
+		return m_failed.load(std::memory_order_relaxed);
+	}
+
+	frameallocator::frameallocator(std::size_t sizePerFrame, std::uint32_t framesInFlight)
+	{
+		if (framesInFlight == 0)
+		{
+			throw "Incorrect frame allocator frame count.";
+		}
+
+		for (std::uint32_t i = 0; i < framesInFlight; i++)
+		{
+			m_arenas.push_back(std::unique_ptr<linearallocator>(new linearallocator(sizePerFrame, memorytag::frame)));
+		}
+	}
+
+	linearallocator& frameallocator::BeginFrame(std::uint32_t slot)
+	{
+		linearallocator& arena = GetArena(slot);
+		arena.Reset();
+		return arena;
+	}
+
+	linearallocator& frameallocator::GetArena(std::uint32_t slot)
+	{
+		return *m_arenas[slot % m_arenas.size()];
+	}
+
+	std::uint32_t frameallocator::GetFramesInFlight() const
+	{
+		return static_cast<std::uint32_t>(m_arenas.size());
+	}
+
+	scratchstack::scratchstack() :
+		m_memory(new unsigned char[SCRATCH_STACK_SIZE])
+	{
+		memorytracker::Allocated(memorytag::scratch, SCRATCH_STACK_SIZE);
+	}
+
+	scratchstack::~scratchstack()
+	{
+		memorytracker::Freed(memorytag::scratch, SCRATCH_STACK_SIZE);
+	}
+
+	scratchstack& scratchstack::ForThread()
+	{
+		thread_local scratchstack stack;
+		return stack;
+	}
+
+	void* scratchstack::Allocate(std::size_t size, std::size_t alignment)
+	{
+		std::uintptr_t base = reinterpret_cast<std::uintptr_t>(m_memory.get());
+		std::size_t start = AlignUp(base + m_top, alignment) - base;
+
+		if (start + size > SCRATCH_STACK_SIZE)
+		{
+			return nullptr;
+		}
+
+		m_top = start + size;
+		return m_memory.get() + start;
+	}
+
+	std::size_t scratchstack::GetMarker() const
+	{
+		return m_top;
+	}
+
+	void scratchstack::FreeToMarker(std::size_t marker)
+	{
+		if (marker < m_top)
+		{
+			m_top = marker;
+		}
+	}
+
+	poolallocator::poolallocator(std::size_t blockSize, std::uint32_t blockCount, std::size_t alignment, memorytag tag) :
+		m_tag(tag)
+	{
+		if (blockCount == 0 or blockSize == 0 or alignment == 0)
+		{
+			throw "Incorrect pool allocator size.";
+		}
+
+		// Every block has to be able to hold the free list link and keep the alignment of the next one.
+		m_blockSize = AlignUp(blockSize > sizeof(void*) ? blockSize : sizeof(void*), alignment);
+		m_blockCount = blockCount;
+		m_size = m_blockSize * blockCount + alignment;
+		m_memory.reset(new unsigned char[m_size]);
+		memorytracker::Allocated(m_tag, m_size);
+
+		std::uintptr_t base = reinterpret_cast<std::uintptr_t>(m_memory.get());
+		m_blocks = m_memory.get() + (AlignUp(base, alignment) - base);
+
+		for (std::uint32_t i = blockCount; i > 0; i--)
+		{
+			Free(m_blocks + (i - 1) * m_blockSize);
+		}
+	}
+
+	poolallocator::~poolallocator()
+	{
+		memorytracker::Freed(m_tag, m_size);
+	}
+
+	void* poolallocator::Allocate()
+	{
+		void *block = m_freeList;
+		if (block)
+		{
+			m_freeList = *static_cast<void**>(block);
+			m_freeCount--;
+		}
+		return block;
+	}
+
+	void poolallocator::Free(void *block)
+	{
+		if (!block)
+		{
+			return;
+		}
+
+		*static_cast<void**>(block) = m_freeList;
+		m_freeList = block;
+		m_freeCount++;
+	}
+
+	std::uint32_t poolallocator::GetFreeCount() const
+	{
+		return m_freeCount;
+	}
+
+	std::uint32_t poolallocator::GetBlockCount() const
+	{
+		return m_blockCount;
+	}
+}
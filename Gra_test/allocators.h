@@ -0,0 +1,241 @@
+// allocators.h : include file for the engine allocators
+// Data that only lives for a frame or for a single function call does not need the general heap.
+//  - linearallocator hands out memory from one block by bumping an offset and frees all of it at once,
+//  - frameallocator keeps one linear allocator per frame in flight and resets the one being reused,
+//  - scratchstack is a per thread stack for temporaries, scratchscope gives back what was taken in a scope,
+//  - poolallocator and objectpool recycle blocks of one size through a free list.
+// Every allocator reports its block to the memory tracker under its tag.
+// The adapters at the end let standard containers use the linear allocators,
+// deallocation is a no-op because the memory goes back all at once.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include "memorytracker.h"
+
+namespace core
+{
+	constexpr std::size_t SCRATCH_STACK_SIZE{ 1024 * 1024 };
+
+	// Allocate is lock-free so several jobs can fill the same arena.
+	// It returns nullptr once the block is used up, the arena never falls back to the heap.
+	class linearallocator
+	{
+	public:
+		linearallocator() = delete;
+		linearallocator(std::size_t size, memorytag tag = memorytag::general);
+		linearallocator(const linearallocator& other) = delete;
+		~linearallocator();
+
+		linearallocator& operator=(const linearallocator& other) = delete;
+
+		void* Allocate(std::size_t size, std::size_t alignment = 16);
+		void Reset();
+
+		std::size_t GetUsed() const;
+		std::size_t GetPeak() const;
+		std::size_t GetCapacity() const;
+		std::uint32_t GetFailedAllocations() const;
+	private:
+		std::unique_ptr<unsigned char[]> m_memory;
+		std::size_t m_capacity{};
+		std::atomic<std::size_t> m_offset{};
+		std::atomic<std::size_t> m_peak{};
+		std::atomic<std::uint32_t> m_failed{};
+		memorytag m_tag;
+	};
+
+	// The frame allocator has one arena per frame in flight.
+	// BeginFrame resets the arena of the slot and returns it, the caller has to make sure
+	// nothing still reads what was allocated from that slot the last time (the frame pipeline does).
+	class frameallocator
+	{
+	public:
+		frameallocator() = delete;
+		frameallocator(std::size_t sizePerFrame, std::uint32_t framesInFlight = 2);
+		frameallocator(const frameallocator& other) = delete;
+		~frameallocator() {};
+
+		frameallocator& operator=(const frameallocator& other) = delete;
+
+		linearallocator& BeginFrame(std::uint32_t slot);
+		linearallocator& GetArena(std::uint32_t slot);
+		std::uint32_t GetFramesInFlight() const;
+	private:
+		std::vector<std::unique_ptr<linearallocator>> m_arenas{};
+	};
+
+	// Every thread has its own scratch stack, created the first time the thread asks for it.
+	// Memory is taken from the top and given back by scratchscope in reverse order.
+	class scratchstack
+	{
+	public:
+		scratchstack();
+		scratchstack(const scratchstack& other) = delete;
+		~scratchstack();
+
+		scratchstack& operator=(const scratchstack& other) = delete;
+
+		static scratchstack& ForThread();
+
+		void* Allocate(std::size_t size, std::size_t alignment = 16);
+		std::size_t GetMarker() const;
+		void FreeToMarker(std::size_t marker);
+	private:
+		std::unique_ptr<unsigned char[]> m_memory;
+		std::size_t m_top{};
+	};
+
+	class scratchscope
+	{
+	public:
+		scratchscope() : m_stack(scratchstack::ForThread()), m_marker(m_stack.GetMarker()) {};
+		scratchscope(const scratchscope& other) = delete;
+		~scratchscope() { m_stack.FreeToMarker(m_marker); };
+
+		scratchscope& operator=(const scratchscope& other) = delete;
+	private:
+		scratchstack& m_stack;
+		std::size_t m_marker;
+	};
+
+	// Fixed number of blocks of one size, the free blocks are linked through their own memory.
+	// The pool is not thread safe, every pool belongs to one thread at a time.
+	class poolallocator
+	{
+	public:
+		poolallocator() = delete;
+		poolallocator(std::size_t blockSize, std::uint32_t blockCount, std::size_t alignment = 16, memorytag tag = memorytag::general);
+		poolallocator(const poolallocator& other) = delete;
+		~poolallocator();
+
+		poolallocator& operator=(const poolallocator& other) = delete;
+
+		void* Allocate();
+		void Free(void *block);
+
+		std::uint32_t GetFreeCount() const;
+		std::uint32_t GetBlockCount() const;
+	private:
+		std::unique_ptr<unsigned char[]> m_memory;
+		unsigned char *m_blocks{};
+		std::size_t m_blockSize{};
+		std::uint32_t m_blockCount{};
+		std::uint32_t m_freeCount{};
+		void *m_freeList{};
+		std::size_t m_size{};
+		memorytag m_tag;
+	};
+
+	template<typename T>
+	class objectpool
+	{
+	public:
+		objectpool() = delete;
+		objectpool(std::uint32_t count) : m_pool(sizeof(T) > sizeof(void*) ? sizeof(T) : sizeof(void*), count, alignof(T)) {};
+		objectpool(const objectpool& other) = delete;
+
+		objectpool& operator=(const objectpool& other) = delete;
+
+		// Create returns nullptr when the pool is exhausted.
+		template<typename... Args>
+		T* Create(Args&&... args)
+		{
+			void *block = m_pool.Allocate();
+			return block ? new (block) T(std::forward<Args>(args)...) : nullptr;
+		}
+
+		void Destroy(T *object)
+		{
+			if (object)
+			{
+				object->~T();
+				m_pool.Free(object);
+			}
+		}
+
+		std::uint32_t GetFreeCount() const { return m_pool.GetFreeCount(); }
+	private:
+		poolallocator m_pool;
+	};
+
+	// Standard allocator over a linear allocator. Containers using it must not outlive the arena's next reset.
+	// A container that runs out of arena memory gets std::bad_alloc like with any other allocator.
+	template<typename T>
+	class linearadapter
+	{
+	public:
+		typedef T value_type;
+		typedef std::true_type propagate_on_container_copy_assignment;
+		typedef std::true_type propagate_on_container_move_assignment;
+		typedef std::true_type propagate_on_container_swap;
+
+		// A default constructed adapter has no arena and fails every allocation,
+		// it only exists so containers can be declared before the arena is known.
+		linearadapter() {};
+		linearadapter(linearallocator& arena) : m_arena(&arena) {};
+		template<typename U>
+		linearadapter(const linearadapter<U>& other) : m_arena(other.GetArena()) {};
+
+		T* allocate(std::size_t count)
+		{
+			void *memory = m_arena ? m_arena->Allocate(count * sizeof(T), alignof(T)) : nullptr;
+			if (!memory)
+			{
+				throw std::bad_alloc();
+			}
+			return static_cast<T*>(memory);
+		}
+
+		void deallocate(T*, std::size_t) {};
+
+		linearallocator* GetArena() const { return m_arena; }
+
+		template<typename U>
+		bool operator==(const linearadapter<U>& other) const { return m_arena == other.GetArena(); }
+		template<typename U>
+		bool operator!=(const linearadapter<U>& other) const { return m_arena != other.GetArena(); }
+	private:
+		linearallocator *m_arena{};
+	};
+
+	// Standard allocator over the calling thread's scratch stack, used inside a scratchscope.
+	template<typename T>
+	class scratchadapter
+	{
+	public:
+		typedef T value_type;
+
+		scratchadapter() {};
+		template<typename U>
+		scratchadapter(const scratchadapter<U>&) {};
+
+		T* allocate(std::size_t count)
+		{
+			void *memory = scratchstack::ForThread().Allocate(count * sizeof(T), alignof(T));
+			if (!memory)
+			{
+				throw std::bad_alloc();
+			}
+			return static_cast<T*>(memory);
+		}
+
+		void deallocate(T*, std::size_t) {};
+
+		template<typename U>
+		bool operator==(const scratchadapter<U>&) const { return true; }
+		template<typename U>
+		bool operator!=(const scratchadapter<U>&) const { return false; }
+	};
+
+	template<typename T>
+	using linearvector = std::vector<T, linearadapter<T>>;
+
+	template<typename T>
+	using scratchvector = std::vector<T, scratchadapter<T>>;
+}
@@ -0,0 +1,351 @@
+#include "stdafx.h"
+#include "animation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr UINT MAX_CLIP_FRAMES{ 65536 };
+		constexpr FLOAT QUANTIZED_MAX{ 65535.0f };
+
+		// The translation and the scale of a pose are read and written as one vector of four floats.
+		static_assert(offsetof(bonepose, scale) == offsetof(bonepose, translation) + 3 * sizeof(FLOAT), "The scale has to follow the translation.");
+
+		FLOAT* TranslationScale(bonepose& pose)
+		{
+			return reinterpret_cast<FLOAT*>(reinterpret_cast<char*>(&pose) + offsetof(bonepose, translation));
+		}
+
+		const FLOAT* TranslationScale(const bonepose& pose)
+		{
+			return reinterpret_cast<const FLOAT*>(reinterpret_cast<const char*>(&pose) + offsetof(bonepose, translation));
+		}
+
+		// A pose has a uniform scale, so the upper 3x3 of its matrices and of their products is a rotation times a scale
+		// and its inverse is the transpose divided by the square of the scale.
+		void InvertSimilarity(const D3DXMATRIX& matrix, D3DXMATRIX& inverse)
+		{
+			FLOAT f = 1.0f / (matrix._11 * matrix._11 + matrix._12 * matrix._12 + matrix._13 * matrix._13);
+
+			inverse = D3DXMATRIX(matrix._11 * f, matrix._21 * f, matrix._31 * f, 0.0f,
+				matrix._12 * f, matrix._22 * f, matrix._32 * f, 0.0f,
+				matrix._13 * f, matrix._23 * f, matrix._33 * f, 0.0f,
+				0.0f, 0.0f, 0.0f, 1.0f);
+			inverse._41 = -(matrix._41 * inverse._11 + matrix._42 * inverse._21 + matrix._43 * inverse._31);
+			inverse._42 = -(matrix._41 * inverse._12 + matrix._42 * inverse._22 + matrix._43 * inverse._32);
+			inverse._43 = -(matrix._41 * inverse._13 + matrix._42 * inverse._23 + matrix._43 * inverse._33);
+		}
+	}
+
+	skeleton::skeleton(const UINT *parents, const bonepose *bindPose, UINT boneCount)
+	{
+		if (!parents or !bindPose or boneCount == 0 or boneCount > ANIMATION_MAX_BONES)
+		{
+			throw "Incorrect skeleton size.";
+		}
+
+		for (UINT bone = 0; bone < boneCount; bone++)
+		{
+			if (parents[bone] != NO_BONE and parents[bone] >= bone)
+			{
+				throw "Skeleton bones have to come after their parents.";
+			}
+		}
+
+		m_parents.assign(parents, parents + boneCount);
+		m_bindPose.assign(bindPose, bindPose + boneCount);
+
+		std::vector<D3DXMATRIX> model(boneCount);
+		LocalToModel(bindPose, model.data());
+
+		m_inverseBind.resize(boneCount);
+		for (UINT bone = 0; bone < boneCount; bone++)
+		{
+			InvertSimilarity(model[bone], m_inverseBind[bone]);
+		}
+	}
+
+	UINT skeleton::GetBoneCount() const
+	{
+		return static_cast<UINT>(m_parents.size());
+	}
+
+	UINT skeleton::GetParent(UINT bone) const
+	{
+		return m_parents[bone];
+	}
+
+	const bonepose* skeleton::GetBindPose() const
+	{
+		return m_bindPose.data();
+	}
+
+	// Parents come first, so the model matrix of the parent is always ready.
+	void skeleton::LocalToModel(const bonepose *local, D3DXMATRIX *model) const
+	{
+		for (UINT bone = 0; bone < m_parents.size(); bone++)
+		{
+			BuildPoseMatrix(local[bone], model[bone]);
+			if (m_parents[bone] != NO_BONE)
+			{
+				core::MultiplyMatrix(model[bone], model[bone], model[m_parents[bone]]);
+			}
+		}
+	}
+
+	void skeleton::BuildPalette(const D3DXMATRIX *model, D3DXMATRIX *palette) const
+	{
+		for (UINT bone = 0; bone < m_parents.size(); bone++)
+		{
+			core::MultiplyMatrix(palette[bone], m_inverseBind[bone], model[bone]);
+		}
+	}
+
+	animationclip::animationclip(const bonepose *frames, UINT frameCount, UINT boneCount, FLOAT framesPerSecond,
+		const clipcompression& compression) :
+		m_boneCount(boneCount), m_frameCount(frameCount), m_framesPerSecond(framesPerSecond)
+	{
+		if (!frames or frameCount == 0 or frameCount > MAX_CLIP_FRAMES or boneCount == 0 or boneCount > ANIMATION_MAX_BONES or !(framesPerSecond > 0.0f))
+		{
+			throw "Incorrect animation clip size.";
+		}
+
+		const FLOAT rotationTolerance[4] = { compression.rotationTolerance, compression.rotationTolerance,
+			compression.rotationTolerance, compression.rotationTolerance };
+		const FLOAT translationTolerance[4] = { compression.translationTolerance, compression.translationTolerance,
+			compression.translationTolerance, compression.scaleTolerance };
+		std::vector<FLOAT> values(frameCount * 4);
+
+		for (UINT bone = 0; bone < boneCount; bone++)
+		{
+			// q and -q are the same rotation. The keys are made to stay on one side so neighbors interpolate the short way.
+			for (UINT frame = 0; frame < frameCount; frame++)
+			{
+				const FLOAT *rotation = frames[frame * boneCount + bone].rotation;
+				FLOAT *value = &values[frame * 4];
+				FLOAT sign = 1.0f;
+
+				if (frame > 0 and value[-4] * rotation[0] + value[-3] * rotation[1] + value[-2] * rotation[2] + value[-1] * rotation[3] < 0.0f)
+				{
+					sign = -1.0f;
+				}
+				for (UINT component = 0; component < 4; component++)
+				{
+					value[component] = rotation[component] * sign;
+				}
+			}
+			CompressTrack(values.data(), rotationTolerance);
+
+			for (UINT frame = 0; frame < frameCount; frame++)
+			{
+				std::copy_n(TranslationScale(frames[frame * boneCount + bone]), 4, &values[frame * 4]);
+			}
+			CompressTrack(values.data(), translationTolerance);
+		}
+	}
+
+	// The frame is wrapped into the clip and every track is sampled at it, so all tracks of a pose
+	// are read front to back once. Interpolation runs on the quantized values, only the result is scaled back.
+	void animationclip::Sample(FLOAT seconds, bonepose *pose) const
+	{
+		FLOAT last = static_cast<FLOAT>(m_frameCount - 1);
+		FLOAT frame = 0.0f;
+
+		if (m_frameCount > 1)
+		{
+			frame = std::fmod(seconds * m_framesPerSecond, last);
+			if (frame < 0.0f)
+			{
+				frame += last;
+			}
+		}
+
+		for (UINT bone = 0; bone < m_boneCount; bone++)
+		{
+			core::Store4(pose[bone].rotation, core::Normalize4(SampleTrack(m_tracks[bone * 2], frame)));
+			core::Store4(TranslationScale(pose[bone]), SampleTrack(m_tracks[bone * 2 + 1], frame));
+		}
+	}
+
+	FLOAT animationclip::GetDuration() const
+	{
+		return static_cast<FLOAT>(m_frameCount - 1) / m_framesPerSecond;
+	}
+
+	UINT animationclip::GetBoneCount() const
+	{
+		return m_boneCount;
+	}
+
+	UINT animationclip::GetKeyCount() const
+	{
+		return static_cast<UINT>(m_keyFrames.size());
+	}
+
+	UINT64 animationclip::GetCompressedSize() const
+	{
+		return m_tracks.size() * sizeof(track) + (m_keyFrames.size() + m_keyValues.size()) * sizeof(std::uint16_t);
+	}
+
+	UINT64 animationclip::GetRawSize() const
+	{
+		return static_cast<UINT64>(m_frameCount) * m_boneCount * sizeof(bonepose);
+	}
+
+	// Key reduction is greedy: a segment starts at the last key kept and grows as long as the line from its start
+	// to its end stays within the tolerance of every frame in between. A track that never leaves the tolerance
+	// of its first frame keeps a single key.
+	void animationclip::CompressTrack(const FLOAT *values, const FLOAT tolerance[4])
+	{
+		auto withinTolerance = [values, tolerance](UINT first, UINT last)
+		{
+			for (UINT frame = first + 1; frame < last; frame++)
+			{
+				FLOAT t = static_cast<FLOAT>(frame - first) / static_cast<FLOAT>(last - first);
+				for (UINT component = 0; component < 4; component++)
+				{
+					FLOAT start = values[first * 4 + component];
+					FLOAT interpolated = start + (values[last * 4 + component] - start) * t;
+					if (std::fabs(interpolated - values[frame * 4 + component]) > tolerance[component])
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		};
+
+		std::vector<UINT> keys{ 0 };
+
+		bool constant = true;
+		for (UINT frame = 1; frame < m_frameCount and constant; frame++)
+		{
+			for (UINT component = 0; component < 4; component++)
+			{
+				constant = constant and std::fabs(values[frame * 4 + component] - values[component]) <= tolerance[component];
+			}
+		}
+
+		for (UINT first = 0; !constant and first + 1 < m_frameCount;)
+		{
+			UINT last = first + 1;
+			while (last + 1 < m_frameCount and withinTolerance(first, last + 1))
+			{
+				last++;
+			}
+			keys.push_back(last);
+			first = last;
+		}
+
+		track compressed{};
+		compressed.firstKey = static_cast<UINT>(m_keyFrames.size());
+		compressed.keyCount = static_cast<UINT>(keys.size());
+
+		for (UINT component = 0; component < 4; component++)
+		{
+			FLOAT minimum = values[component], maximum = values[component];
+			for (UINT key : keys)
+			{
+				minimum = (std::min)(minimum, values[key * 4 + component]);
+				maximum = (std::max)(maximum, values[key * 4 + component]);
+			}
+			compressed.minimum[component] = minimum;
+			compressed.step[component] = (maximum - minimum) / QUANTIZED_MAX;
+		}
+
+		for (UINT key : keys)
+		{
+			m_keyFrames.push_back(static_cast<std::uint16_t>(key));
+			for (UINT component = 0; component < 4; component++)
+			{
+				FLOAT quantized = 0.0f;
+				if (compressed.step[component] > 0.0f)
+				{
+					quantized = (values[key * 4 + component] - compressed.minimum[component]) / compressed.step[component] + 0.5f;
+				}
+				m_keyValues.push_back(static_cast<std::uint16_t>((std::min)(quantized, QUANTIZED_MAX)));
+			}
+		}
+
+		m_tracks.push_back(compressed);
+	}
+
+	core::float4 animationclip::SampleTrack(const track& sampled, FLOAT frame) const
+	{
+		const std::uint16_t *frames = &m_keyFrames[sampled.firstKey];
+		const std::uint16_t *values = &m_keyValues[sampled.firstKey * 4];
+		core::float4 quantized = core::LoadUnsigned16x4(values);
+
+		if (sampled.keyCount > 1)
+		{
+			// The last key at or before the frame, but never the last key of the track so there is one after it.
+			UINT key = static_cast<UINT>(std::upper_bound(frames + 1, frames + sampled.keyCount - 1, frame) - frames) - 1;
+			FLOAT t = (frame - frames[key]) / static_cast<FLOAT>(frames[key + 1] - frames[key]);
+
+			quantized = core::Lerp4(core::LoadUnsigned16x4(values + key * 4), core::LoadUnsigned16x4(values + key * 4 + 4), core::Splat4(t));
+		}
+
+		return core::MulAdd4(quantized, core::Load4(sampled.step), core::Load4(sampled.minimum));
+	}
+
+	void BlendPoses(const bonepose *a, const bonepose *b, FLOAT weight, UINT boneCount, bonepose *out)
+	{
+		core::float4 t = core::Splat4(weight);
+
+		for (UINT bone = 0; bone < boneCount; bone++)
+		{
+			core::float4 from = core::Load4(a[bone].rotation);
+			core::float4 to = core::Load4(b[bone].rotation);
+			core::float4 translationScale = core::Lerp4(core::Load4(TranslationScale(a[bone])), core::Load4(TranslationScale(b[bone])), t);
+
+			to = core::FlipSign4(to, core::Dot4(from, to));
+			core::Store4(out[bone].rotation, core::Normalize4(core::Lerp4(from, to, t)));
+			core::Store4(TranslationScale(out[bone]), translationScale);
+		}
+	}
+
+	// The rotation part is D3DXMatrixRotationQuaternion with every row multiplied by the scale.
+	void BuildPoseMatrix(const bonepose& pose, D3DXMATRIX& matrix)
+	{
+		FLOAT x = pose.rotation[0], y = pose.rotation[1], z = pose.rotation[2], w = pose.rotation[3];
+		FLOAT s = pose.scale;
+		FLOAT xx = x * x, yy = y * y, zz = z * z;
+		FLOAT xy = x * y, xz = x * z, yz = y * z;
+		FLOAT xw = x * w, yw = y * w, zw = z * w;
+
+		matrix = D3DXMATRIX((1.0f - 2.0f * (yy + zz)) * s, 2.0f * (xy + zw) * s, 2.0f * (xz - yw) * s, 0.0f,
+			2.0f * (xy - zw) * s, (1.0f - 2.0f * (xx + zz)) * s, 2.0f * (yz + xw) * s, 0.0f,
+			2.0f * (xz + yw) * s, 2.0f * (yz - xw) * s, (1.0f - 2.0f * (xx + yy)) * s, 0.0f,
+			pose.translation[0], pose.translation[1], pose.translation[2], 1.0f);
+	}
+
+	void BuildChainSkeleton(UINT boneCount, FLOAT boneLength, UINT *parents, bonepose *bindPose)
+	{
+		for (UINT bone = 0; bone < boneCount; bone++)
+		{
+			parents[bone] = bone ? bone - 1 : skeleton::NO_BONE;
+			bindPose[bone] = bonepose{ { 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, bone ? boneLength : 0.0f, 0.0f }, 1.0f };
+		}
+	}
+
+	// Every bone bends around z a little later than the one below it, which sends a wave up the chain.
+	void BuildSwayFrames(UINT boneCount, FLOAT boneLength, UINT frameCount, FLOAT amplitudeDegrees, bonepose *frames)
+	{
+		FLOAT amplitude = amplitudeDegrees * 0.0174532925f;
+
+		for (UINT frame = 0; frame < frameCount; frame++)
+		{
+			FLOAT phase = frameCount > 1 ? 2.0f * D3DX_PI * static_cast<FLOAT>(frame) / static_cast<FLOAT>(frameCount - 1) : 0.0f;
+
+			for (UINT bone = 0; bone < boneCount; bone++)
+			{
+				FLOAT angle = amplitude * std::sin(phase - 0.5f * static_cast<FLOAT>(bone));
+				frames[frame * boneCount + bone] = bonepose{ { 0.0f, 0.0f, std::sin(0.5f * angle), std::cos(0.5f * angle) },
+					{ 0.0f, bone ? boneLength : 0.0f, 0.0f }, 1.0f };
+			}
+		}
+	}
+}
@@ -0,0 +1,112 @@
+// animation.h : include file for skeletal animation
+// A skeleton is a list of bones with parents before their children. A pose gives every bone its rotation,
+// translation and scale relative to its parent, an animation clip stores how the pose changes over time.
+// Clips are compressed when they are built:
+//  - every bone has two tracks of four values, the rotation and the translation together with the scale,
+//  - keys that linear interpolation between the keys kept around them reproduces within the tolerance are dropped,
+//  - the keys left are quantized to 16 bits per value over the range of their track.
+// Sampling dequantizes and interpolates a track as one SIMD vector, blending two poses works the same way.
+// LocalToModel turns a pose into model space matrices and BuildPalette those into the skinning matrices, see skinning.h.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "d3dxmath.h"
+#include "simdmath.h"
+
+namespace graphics
+{
+	// Skinned vertices name their bones with a byte.
+	constexpr UINT ANIMATION_MAX_BONES{ 256 };
+
+	// The rotation is a unit quaternion (x, y, z, w). The matrix of a pose is scale, then rotation, then translation.
+	struct bonepose
+	{
+		FLOAT rotation[4];
+		FLOAT translation[3];
+		FLOAT scale;
+	};
+
+	// Largest error the dropped keys may introduce: in quaternion components for rotations,
+	// in model units for translations and as a factor for scales. Quantization adds at most half a step on top.
+	struct clipcompression
+	{
+		FLOAT rotationTolerance{ 0.0005f };
+		FLOAT translationTolerance{ 0.0005f };
+		FLOAT scaleTolerance{ 0.0005f };
+	};
+
+	class skeleton
+	{
+	public:
+		static constexpr UINT NO_BONE{ 0xffffffff };
+
+		skeleton() = delete;
+		// The parent of every bone has a smaller index than the bone, the roots have NO_BONE.
+		// The bind pose is the pose the skinned meshes of the skeleton were modeled in.
+		skeleton(const UINT *parents, const bonepose *bindPose, UINT boneCount);
+
+		UINT GetBoneCount() const;
+		UINT GetParent(UINT bone) const;
+		const bonepose* GetBindPose() const;
+
+		// LocalToModel computes the model space matrix of every bone of the pose.
+		// BuildPalette multiplies them with the inverse bind pose, the result moves a vertex from the bind pose into the pose.
+		void LocalToModel(const bonepose *local, D3DXMATRIX *model) const;
+		void BuildPalette(const D3DXMATRIX *model, D3DXMATRIX *palette) const;
+	private:
+		std::vector<UINT> m_parents{};
+		std::vector<bonepose> m_bindPose{};
+		std::vector<D3DXMATRIX> m_inverseBind{};
+	};
+
+	class animationclip
+	{
+	public:
+		animationclip() = delete;
+		// The frames are frameCount poses of boneCount bones one after the other, taken framesPerSecond times a second.
+		animationclip(const bonepose *frames, UINT frameCount, UINT boneCount, FLOAT framesPerSecond,
+			const clipcompression& compression = clipcompression{});
+
+		// Sample writes the pose at the time in seconds. The time wraps around, so the clip loops.
+		void Sample(FLOAT seconds, bonepose *pose) const;
+
+		FLOAT GetDuration() const;
+		UINT GetBoneCount() const;
+		UINT GetKeyCount() const;
+
+		// Bytes of the compressed clip and of the frames it was built from.
+		UINT64 GetCompressedSize() const;
+		UINT64 GetRawSize() const;
+	private:
+		// The keys of a track are m_keyFrames and m_keyValues from firstKey on, a value is minimum + quantized * step.
+		struct track
+		{
+			UINT firstKey;
+			UINT keyCount;
+			FLOAT minimum[4];
+			FLOAT step[4];
+		};
+
+		void CompressTrack(const FLOAT *values, const FLOAT tolerance[4]);
+		core::float4 SampleTrack(const track& sampled, FLOAT frame) const;
+
+		std::vector<track> m_tracks{};
+		std::vector<std::uint16_t> m_keyFrames{};
+		std::vector<std::uint16_t> m_keyValues{};
+		UINT m_boneCount{};
+		UINT m_frameCount{};
+		FLOAT m_framesPerSecond{};
+	};
+
+	// out is a blended towards b by the weight, 0 gives a and 1 gives b. Rotations take the shorter way around.
+	// out may be a or b.
+	void BlendPoses(const bonepose *a, const bonepose *b, FLOAT weight, UINT boneCount, bonepose *out);
+	void BuildPoseMatrix(const bonepose& pose, D3DXMATRIX& matrix);
+
+	// Procedural content for the built in character, a chain of bones standing on the y axis like the tube of BuildTube.
+	// BuildChainSkeleton writes the parents and the bind pose of the bones,
+	// BuildSwayFrames frameCount poses of the chain swaying from side to side, the last frame equals the first.
+	void BuildChainSkeleton(UINT boneCount, FLOAT boneLength, UINT *parents, bonepose *bindPose);
+	void BuildSwayFrames(UINT boneCount, FLOAT boneLength, UINT frameCount, FLOAT amplitudeDegrees, bonepose *frames);
+}
@@ -0,0 +1,448 @@
+#include "stdafx.h"
+#include "blockcompression.h"
+#include "simdmath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr UINT BLOCK_PIXELS{ 16 };
+		constexpr UINT POWER_ITERATIONS{ 8 };
+		// Farther from any color than the other palette colors can be.
+		constexpr FLOAT UNREACHABLE_COLOR{ 100000.0f };
+
+		struct colorendpoints
+		{
+			std::uint16_t color0;
+			std::uint16_t color1;
+		};
+
+		std::uint16_t Pack565(const FLOAT *color)
+		{
+			auto quantize = [](FLOAT value, FLOAT scale)
+			{
+				return static_cast<std::uint16_t>((std::min)((std::max)(value, 0.0f), 255.0f) * scale / 255.0f + 0.5f);
+			};
+			return static_cast<std::uint16_t>(quantize(color[0], 31.0f) << 11 | quantize(color[1], 63.0f) << 5 | quantize(color[2], 31.0f));
+		}
+
+		// Expands like the hardware does, by repeating the upper bits in the lower ones.
+		void Unpack565(std::uint16_t packed, std::uint8_t *color)
+		{
+			UINT red = packed >> 11, green = (packed >> 5) & 63, blue = packed & 31;
+			color[0] = static_cast<std::uint8_t>(red << 3 | red >> 2);
+			color[1] = static_cast<std::uint8_t>(green << 2 | green >> 4);
+			color[2] = static_cast<std::uint8_t>(blue << 3 | blue >> 2);
+		}
+
+		// The four palette colors of a BC1 block. With color0 not above color1 the block has three colors
+		// and transparent black, like the decoder reads it.
+		void BuildPalette(std::uint16_t color0, std::uint16_t color1, std::uint8_t palette[4][4])
+		{
+			Unpack565(color0, palette[0]);
+			Unpack565(color1, palette[1]);
+			palette[0][3] = palette[1][3] = 255;
+
+			for (UINT channel = 0; channel < 3; channel++)
+			{
+				UINT a = palette[0][channel], b = palette[1][channel];
+				if (color0 > color1)
+				{
+					palette[2][channel] = static_cast<std::uint8_t>((2 * a + b + 1) / 3);
+					palette[3][channel] = static_cast<std::uint8_t>((a + 2 * b + 1) / 3);
+				}
+				else
+				{
+					palette[2][channel] = static_cast<std::uint8_t>((a + b) / 2);
+					palette[3][channel] = 0;
+				}
+			}
+			palette[2][3] = 255;
+			palette[3][3] = color0 > color1 ? 255 : 0;
+		}
+
+		bool IsTransparent(const std::uint8_t *pixel)
+		{
+			return pixel[3] < 128;
+		}
+
+		// Picks the closest palette color for every pixel, returns the squared error of the block.
+		// The distances to all four palette colors are computed at once, the palette is held channel by channel.
+		// In three color mode transparent pixels take index 3 and the others never do.
+		UINT ChooseIndices(const std::uint8_t *pixels, std::uint16_t color0, std::uint16_t color1, bool transparency, UINT *indices)
+		{
+			std::uint8_t palette[4][4];
+			BuildPalette(color0, color1, palette);
+
+			FLOAT channels[3][4];
+			for (UINT channel = 0; channel < 3; channel++)
+			{
+				for (UINT candidate = 0; candidate < 4; candidate++)
+				{
+					channels[channel][candidate] = palette[candidate][channel];
+				}
+				if (color0 <= color1)
+				{
+					channels[channel][3] = UNREACHABLE_COLOR;
+				}
+			}
+
+			core::float4 red = core::Load4(channels[0]), green = core::Load4(channels[1]), blue = core::Load4(channels[2]);
+			FLOAT total = 0.0f;
+
+			for (UINT i = 0; i < BLOCK_PIXELS; i++)
+			{
+				const std::uint8_t *pixel = pixels + i * 4;
+				if (transparency and IsTransparent(pixel))
+				{
+					indices[i] = 3;
+					continue;
+				}
+
+				core::float4 dr = core::Sub4(core::Splat4(pixel[0]), red);
+				core::float4 dg = core::Sub4(core::Splat4(pixel[1]), green);
+				core::float4 db = core::Sub4(core::Splat4(pixel[2]), blue);
+				FLOAT errors[4];
+				core::Store4(errors, core::MulAdd4(dr, dr, core::MulAdd4(dg, dg, core::Mul4(db, db))));
+
+				UINT best = 0;
+				FLOAT bestError = errors[0];
+				for (UINT candidate = 1; candidate < 4; candidate++)
+				{
+					bool closer = errors[candidate] < bestError;
+					best = closer ? candidate : best;
+					bestError = closer ? errors[candidate] : bestError;
+				}
+				indices[i] = best;
+				total += bestError;
+			}
+
+			// The errors are sums of squares of integers, exact in floats.
+			return static_cast<UINT>(total);
+		}
+
+		// The weight of color0 in the color of every index.
+		FLOAT IndexWeight(UINT index, bool fourColors)
+		{
+			static const FLOAT four[4]{ 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			static const FLOAT three[4]{ 1.0f, 0.0f, 0.5f, 0.0f };
+			return fourColors ? four[index] : three[index];
+		}
+
+		// Solves for the end points that give the smallest squared error with the indices as they are:
+		// the normal equations of x = w * a + (1 - w) * b over the pixels, one 2x2 system for all three channels.
+		bool RefitEndpoints(const std::uint8_t *pixels, const UINT *indices, bool fourColors, bool transparency, FLOAT *a, FLOAT *b)
+		{
+			FLOAT ww = 0.0f, wv = 0.0f, vv = 0.0f;
+			FLOAT wx[3]{}, vx[3]{};
+
+			for (UINT i = 0; i < BLOCK_PIXELS; i++)
+			{
+				const std::uint8_t *pixel = pixels + i * 4;
+				if (transparency and IsTransparent(pixel))
+				{
+					continue;
+				}
+
+				FLOAT w = IndexWeight(indices[i], fourColors), v = 1.0f - w;
+				ww += w * w;
+				wv += w * v;
+				vv += v * v;
+				for (UINT channel = 0; channel < 3; channel++)
+				{
+					wx[channel] += w * pixel[channel];
+					vx[channel] += v * pixel[channel];
+				}
+			}
+
+			FLOAT determinant = ww * vv - wv * wv;
+			if (std::fabs(determinant) < 1e-6f)
+			{
+				return false;
+			}
+
+			FLOAT inverse = 1.0f / determinant;
+			for (UINT channel = 0; channel < 3; channel++)
+			{
+				a[channel] = (vv * wx[channel] - wv * vx[channel]) * inverse;
+				b[channel] = (ww * vx[channel] - wv * wx[channel]) * inverse;
+			}
+			return true;
+		}
+
+		// Orders the end points for the mode and renumbers the indices to match.
+		colorendpoints OrderEndpoints(std::uint16_t color0, std::uint16_t color1, bool fourColors, UINT *indices)
+		{
+			bool swap = fourColors ? color0 < color1 : color0 > color1;
+			if (swap)
+			{
+				// Four colors: 0 <-> 1 and 2 <-> 3. Three colors: 0 <-> 1, the middle and transparent stay.
+				for (UINT i = 0; i < BLOCK_PIXELS; i++)
+				{
+					if (fourColors or indices[i] < 2)
+					{
+						indices[i] ^= 1;
+					}
+				}
+				std::swap(color0, color1);
+			}
+			if (fourColors and color0 == color1)
+			{
+				// Equal end points always decode as three colors, where index 0 is still the end point.
+				std::fill(indices, indices + BLOCK_PIXELS, 0u);
+			}
+			return colorendpoints{ color0, color1 };
+		}
+
+		void WriteColorBlock(colorendpoints endpoints, const UINT *indices, std::uint8_t *block)
+		{
+			block[0] = static_cast<std::uint8_t>(endpoints.color0);
+			block[1] = static_cast<std::uint8_t>(endpoints.color0 >> 8);
+			block[2] = static_cast<std::uint8_t>(endpoints.color1);
+			block[3] = static_cast<std::uint8_t>(endpoints.color1 >> 8);
+			for (UINT row = 0; row < 4; row++)
+			{
+				const UINT *rowIndices = indices + row * 4;
+				block[4 + row] = static_cast<std::uint8_t>(rowIndices[0] | rowIndices[1] << 2 | rowIndices[2] << 4 | rowIndices[3] << 6);
+			}
+		}
+
+		// Encodes the colors of a block. Without transparency the block always has four colors, as BC3 requires.
+		void EncodeColorBlock(const std::uint8_t *pixels, bool allowTransparency, std::uint8_t *block)
+		{
+			bool transparency = false;
+			UINT opaque = 0;
+			FLOAT mean[3]{};
+
+			for (UINT i = 0; i < BLOCK_PIXELS; i++)
+			{
+				const std::uint8_t *pixel = pixels + i * 4;
+				if (allowTransparency and IsTransparent(pixel))
+				{
+					transparency = true;
+					continue;
+				}
+				for (UINT channel = 0; channel < 3; channel++)
+				{
+					mean[channel] += pixel[channel];
+				}
+				opaque++;
+			}
+
+			UINT indices[BLOCK_PIXELS];
+			if (opaque == 0)
+			{
+				std::fill(indices, indices + BLOCK_PIXELS, 3u);
+				WriteColorBlock(colorendpoints{ 0, 0 }, indices, block);
+				return;
+			}
+
+			for (FLOAT& value : mean)
+			{
+				value /= static_cast<FLOAT>(opaque);
+			}
+
+			// The covariance of the colors, its largest eigenvector is the axis the colors spread along the most.
+			FLOAT covariance[6]{};
+			for (UINT i = 0; i < BLOCK_PIXELS; i++)
+			{
+				const std::uint8_t *pixel = pixels + i * 4;
+				if (transparency and IsTransparent(pixel))
+				{
+					continue;
+				}
+				FLOAT r = pixel[0] - mean[0], g = pixel[1] - mean[1], b = pixel[2] - mean[2];
+				covariance[0] += r * r;
+				covariance[1] += r * g;
+				covariance[2] += r * b;
+				covariance[3] += g * g;
+				covariance[4] += g * b;
+				covariance[5] += b * b;
+			}
+
+			FLOAT axis[3]{ 1.0f, 1.0f, 1.0f };
+			for (UINT iteration = 0; iteration < POWER_ITERATIONS; iteration++)
+			{
+				FLOAT next[3]{
+					covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+					covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+					covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+				FLOAT length = (std::max)({ std::fabs(next[0]), std::fabs(next[1]), std::fabs(next[2]) });
+				if (length < 1e-6f)
+				{
+					break;
+				}
+				for (UINT channel = 0; channel < 3; channel++)
+				{
+					axis[channel] = next[channel] / length;
+				}
+			}
+
+			FLOAT lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+			FLOAT lowest = 0.0f, highest = 0.0f;
+			for (UINT i = 0; i < BLOCK_PIXELS; i++)
+			{
+				const std::uint8_t *pixel = pixels + i * 4;
+				if (transparency and IsTransparent(pixel))
+				{
+					continue;
+				}
+				FLOAT t = ((pixel[0] - mean[0]) * axis[0] + (pixel[1] - mean[1]) * axis[1] + (pixel[2] - mean[2]) * axis[2]) / lengthSquared;
+				lowest = (std::min)(lowest, t);
+				highest = (std::max)(highest, t);
+			}
+
+			// The extremes are pulled in by a sixteenth of the range, the palette then covers the bulk of the colors better.
+			FLOAT inset = (highest - lowest) / 16.0f;
+			FLOAT start[3], end[3];
+			for (UINT channel = 0; channel < 3; channel++)
+			{
+				start[channel] = mean[channel] + axis[channel] * (highest - inset);
+				end[channel] = mean[channel] + axis[channel] * (lowest + inset);
+			}
+
+			bool fourColors = !transparency;
+			std::uint16_t color0 = Pack565(start), color1 = Pack565(end);
+			if (fourColors ? color0 < color1 : color0 > color1)
+			{
+				std::swap(color0, color1);
+			}
+			UINT error = ChooseIndices(pixels, color0, color1, transparency, indices);
+
+			FLOAT refitStart[3], refitEnd[3];
+			if (error > 0 and RefitEndpoints(pixels, indices, color0 > color1, transparency, refitStart, refitEnd))
+			{
+				std::uint16_t refit0 = Pack565(refitStart), refit1 = Pack565(refitEnd);
+				if (fourColors ? refit0 < refit1 : refit0 > refit1)
+				{
+					std::swap(refit0, refit1);
+				}
+
+				UINT refitIndices[BLOCK_PIXELS];
+				if (ChooseIndices(pixels, refit0, refit1, transparency, refitIndices) < error)
+				{
+					color0 = refit0;
+					color1 = refit1;
+					std::copy(refitIndices, refitIndices + BLOCK_PIXELS, indices);
+				}
+			}
+
+			WriteColorBlock(OrderEndpoints(color0, color1, fourColors, indices), indices, block);
+		}
+
+		// With alpha0 not above alpha1 the block has six values between them plus 0 and 255.
+		void BuildAlphaPalette(UINT alpha0, UINT alpha1, UINT palette[8])
+		{
+			palette[0] = alpha0;
+			palette[1] = alpha1;
+			if (alpha0 > alpha1)
+			{
+				for (UINT k = 1; k < 7; k++)
+				{
+					palette[k + 1] = ((7 - k) * alpha0 + k * alpha1 + 3) / 7;
+				}
+				return;
+			}
+
+			for (UINT k = 1; k < 5; k++)
+			{
+				palette[k + 1] = ((5 - k) * alpha0 + k * alpha1 + 2) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		// Eight alpha values between the largest and smallest alpha of the block, so both are exact.
+		void EncodeAlphaBlock(const std::uint8_t *pixels, std::uint8_t *block)
+		{
+			UINT alpha0 = 0, alpha1 = 255;
+			for (UINT i = 0; i < BLOCK_PIXELS; i++)
+			{
+				alpha0 = (std::max)(alpha0, static_cast<UINT>(pixels[i * 4 + 3]));
+				alpha1 = (std::min)(alpha1, static_cast<UINT>(pixels[i * 4 + 3]));
+			}
+
+			block[0] = static_cast<std::uint8_t>(alpha0);
+			block[1] = static_cast<std::uint8_t>(alpha1);
+
+			std::uint64_t bits = 0;
+			if (alpha0 > alpha1)
+			{
+				UINT palette[8];
+				BuildAlphaPalette(alpha0, alpha1, palette);
+
+				for (UINT i = 0; i < BLOCK_PIXELS; i++)
+				{
+					int alpha = pixels[i * 4 + 3];
+					UINT best = 0, bestError = 0xffffffff;
+					for (UINT candidate = 0; candidate < 8; candidate++)
+					{
+						UINT error = static_cast<UINT>(std::abs(alpha - static_cast<int>(palette[candidate])));
+						if (error < bestError)
+						{
+							best = candidate;
+							bestError = error;
+						}
+					}
+					bits |= static_cast<std::uint64_t>(best) << (3 * i);
+				}
+			}
+
+			for (UINT i = 0; i < 6; i++)
+			{
+				block[2 + i] = static_cast<std::uint8_t>(bits >> (8 * i));
+			}
+		}
+
+		void DecodeColorBlock(const std::uint8_t *block, std::uint8_t *pixels)
+		{
+			std::uint16_t color0 = static_cast<std::uint16_t>(block[0] | block[1] << 8);
+			std::uint16_t color1 = static_cast<std::uint16_t>(block[2] | block[3] << 8);
+			std::uint8_t palette[4][4];
+			BuildPalette(color0, color1, palette);
+
+			for (UINT i = 0; i < BLOCK_PIXELS; i++)
+			{
+				UINT index = (block[4 + i / 4] >> (2 * (i % 4))) & 3;
+				std::copy(palette[index], palette[index] + 4, pixels + i * 4);
+			}
+		}
+	}
+
+	void EncodeBC1Block(const std::uint8_t *pixels, std::uint8_t *block)
+	{
+		EncodeColorBlock(pixels, true, block);
+	}
+
+	void EncodeBC3Block(const std::uint8_t *pixels, std::uint8_t *block)
+	{
+		EncodeAlphaBlock(pixels, block);
+		EncodeColorBlock(pixels, false, block + 8);
+	}
+
+	void DecodeBC1Block(const std::uint8_t *block, std::uint8_t *pixels)
+	{
+		DecodeColorBlock(block, pixels);
+	}
+
+	void DecodeBC3Block(const std::uint8_t *block, std::uint8_t *pixels)
+	{
+		DecodeColorBlock(block + 8, pixels);
+
+		UINT palette[8];
+		BuildAlphaPalette(block[0], block[1], palette);
+
+		std::uint64_t bits = 0;
+		for (UINT i = 0; i < 6; i++)
+		{
+			bits |= static_cast<std::uint64_t>(block[2 + i]) << (8 * i);
+		}
+		for (UINT i = 0; i < BLOCK_PIXELS; i++)
+		{
+			pixels[i * 4 + 3] = static_cast<std::uint8_t>(palette[(bits >> (3 * i)) & 7]);
+		}
+	}
+}
@@ -0,0 +1,24 @@
+// blockcompression.h : include file for the BC1 and BC3 block encoders
+// Both formats store blocks of 4x4 pixels. A BC1 block is two RGB 565 end points and a 2-bit index per pixel
+// into the palette the end points span, BC3 adds a block of two 8-bit alpha end points and 3-bit indices.
+// The color end points are found along the principal axis of the block's colors, inset a little from the
+// extremes and then refit once by least squares to the chosen indices; the better of both is kept.
+// Blocks are independent, the encoders keep no state and can run on any number of threads.
+#pragma once
+
+#include <cstdint>
+#include "d3dxmath.h"
+
+namespace graphics
+{
+	constexpr UINT BC1_BLOCK_BYTES{ 8 };
+	constexpr UINT BC3_BLOCK_BYTES{ 16 };
+
+	// The pixels of a block are 16 RGBA8 values, row after row.
+	// BC1 stores pixels with an alpha under 128 as transparent black and the others as opaque.
+	void EncodeBC1Block(const std::uint8_t *pixels, std::uint8_t *block);
+	void EncodeBC3Block(const std::uint8_t *pixels, std::uint8_t *block);
+
+	void DecodeBC1Block(const std::uint8_t *block, std::uint8_t *pixels);
+	void DecodeBC3Block(const std::uint8_t *block, std::uint8_t *pixels);
+}
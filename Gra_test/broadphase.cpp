@@ -0,0 +1,566 @@
+#include "stdafx.h"
+#include "broadphase.h"
+#include "profiler.h"
+#include "simdmath.h"
+#include <algorithm>
+#include <cfloat>
+#include <limits>
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr int FULL_MASK{ (1 << core::FLOATV_WIDTH) - 1 };
+		// Runs of pairs of one proxy up to this long are sorted by insertion.
+		constexpr std::size_t SHORT_RUN{ 16 };
+
+		// Index of the lowest set bit, the value must not be zero.
+		std::uint32_t LowestSetBit(std::uint32_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, value);
+			return index;
+#else
+			return __builtin_ctz(value);
+#endif
+		}
+
+		constexpr std::uint16_t UNSET_STRIP{ 0xffff };
+
+		FLOAT Component(const D3DXVECTOR3& vector, UINT axis)
+		{
+			return (&vector.x)[axis];
+		}
+
+		bool PairLess(const broadphasepair& a, const broadphasepair& b)
+		{
+			return a.first < b.first or (a.first == b.first and a.second < b.second);
+		}
+
+		// The piece of count items that starts at index piece of pieces.
+		UINT PieceBegin(UINT piece, UINT pieces, UINT count)
+		{
+			return static_cast<UINT>(static_cast<UINT64>(piece) * count / pieces);
+		}
+	}
+
+	broadphase::proxy broadphase::Add(const aabb& bounds)
+	{
+		proxy added;
+		if (!m_freeProxies.empty())
+		{
+			added = m_freeProxies.back();
+			m_freeProxies.pop_back();
+		}
+		else
+		{
+			added = static_cast<proxy>(m_bounds.size());
+			m_bounds.emplace_back();
+			m_states.emplace_back();
+			m_spans.emplace_back();
+		}
+
+		// A span no box has, so the next Update makes the entries of the box.
+		m_bounds[added] = bounds;
+		m_states[added] = proxystate::live;
+		m_spans[added] = stripspan{ UNSET_STRIP, 0 };
+		return added;
+	}
+
+	void broadphase::Remove(proxy removed)
+	{
+		if (removed < m_states.size() and m_states[removed] == proxystate::live)
+		{
+			m_states[removed] = proxystate::removed;
+			m_removedProxies.push_back(removed);
+		}
+	}
+
+	void broadphase::SetBounds(proxy target, const aabb& bounds)
+	{
+		m_bounds[target] = bounds;
+	}
+
+	const aabb& broadphase::GetBounds(proxy target) const
+	{
+		return m_bounds[target];
+	}
+
+	// The order is repaired when at most a quarter of the entries are new, the first Update builds it.
+	void broadphase::Update(core::jobsystem& jobs)
+	{
+		PROFILE_SCOPE("broadphase::Update");
+
+		m_swaps = 0;
+		RefreshKeys(jobs);
+		RefreshOrder();
+		CollectEntries();
+
+		m_rebuilt = m_stripBounds.empty() or m_newEntries.size() > m_order.size() / 4 or !RepairOrder();
+		if (m_rebuilt)
+		{
+			RebuildOrder(jobs);
+		}
+		else
+		{
+			MergeEntries();
+		}
+
+		CopySorted(jobs);
+		UINT count = static_cast<UINT>(m_order.size());
+		jobs.ParallelFor(BROADPHASE_SWEEP_PIECES, 1, [this, count](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t piece = begin; piece < end; piece++)
+			{
+				m_piecePairs[piece].clear();
+				Sweep(PieceBegin(piece, BROADPHASE_SWEEP_PIECES, count), PieceBegin(piece + 1, BROADPHASE_SWEEP_PIECES, count), m_piecePairs[piece]);
+			}
+		});
+
+		SortPairs();
+		ComparePairs();
+
+		// The ended pairs of the removed proxies were reported, they can be handed out again.
+		for (proxy removed : m_removedProxies)
+		{
+			m_states[removed] = proxystate::free;
+			m_freeProxies.push_back(removed);
+		}
+		m_removedProxies.clear();
+	}
+
+	const std::vector<broadphasepair>& broadphase::GetPairs() const
+	{
+		return m_pairs;
+	}
+
+	const std::vector<broadphasepair>& broadphase::GetStartedPairs() const
+	{
+		return m_startedPairs;
+	}
+
+	const std::vector<broadphasepair>& broadphase::GetEndedPairs() const
+	{
+		return m_endedPairs;
+	}
+
+	broadphasestats broadphase::GetStats() const
+	{
+		broadphasestats stats{};
+		stats.proxies = static_cast<UINT>(m_states.size() - m_freeProxies.size() - m_removedProxies.size());
+		stats.entries = static_cast<UINT>(m_order.size());
+		stats.strips = m_stripBounds.empty() ? 0 : static_cast<UINT>(m_stripBounds.size() - 1);
+		stats.pairs = static_cast<UINT>(m_pairs.size());
+		stats.startedPairs = static_cast<UINT>(m_startedPairs.size());
+		stats.endedPairs = static_cast<UINT>(m_endedPairs.size());
+		stats.swaps = m_swaps;
+		stats.sweepAxis = m_sweepAxis;
+		stats.stripAxis = m_stripAxis;
+		stats.rebuilt = m_rebuilt;
+		return stats;
+	}
+
+	bool broadphase::EntryLess(const sortentry& a, const sortentry& b)
+	{
+		return a.strip < b.strip or (a.strip == b.strip and (a.key < b.key or (a.key == b.key and a.target < b.target)));
+	}
+
+	// The guess from the equal widths is moved to the strip the bounds put the value in, so a value is
+	// always in the same strip as the sweep, which compares with the bounds, thinks it is.
+	UINT broadphase::GetStrip(FLOAT value) const
+	{
+		UINT last = static_cast<UINT>(m_stripBounds.size() - 2);
+		FLOAT guess = (value - m_stripOrigin) * m_stripScale;
+		UINT strip = guess <= 0.0f ? 0 : static_cast<UINT>((std::min)(guess, static_cast<FLOAT>(last)));
+
+		while (strip > 0 and value < m_stripBounds[strip])
+		{
+			strip--;
+		}
+		while (strip < last and value >= m_stripBounds[strip + 1])
+		{
+			strip++;
+		}
+		return strip;
+	}
+
+	// A box is in the strips from the one of its lower bound to the one of its upper bound.
+	broadphase::stripspan broadphase::GetSpan(const aabb& bounds) const
+	{
+		if (m_stripBounds.size() < 3)
+		{
+			return stripspan{ 0, 0 };
+		}
+		return stripspan{ static_cast<std::uint16_t>(GetStrip(Component(bounds.min, m_stripAxis))),
+			static_cast<std::uint16_t>(GetStrip(Component(bounds.max, m_stripAxis))) };
+	}
+
+	void broadphase::RefreshKeys(core::jobsystem& jobs)
+	{
+		m_currentSpans.resize(m_bounds.size());
+		m_keys.resize(m_bounds.size());
+
+		jobs.ParallelFor(static_cast<std::uint32_t>(m_bounds.size()), 4096, [this](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t target = begin; target < end; target++)
+			{
+				if (m_states[target] == proxystate::live)
+				{
+					m_currentSpans[target] = GetSpan(m_bounds[target]);
+					m_keys[target] = Component(m_bounds[target].min, m_sweepAxis);
+				}
+			}
+		});
+	}
+
+	// Drops the entries of removed boxes and of boxes that moved into other strips, and refreshes the keys of the rest.
+	void broadphase::RefreshOrder()
+	{
+		std::size_t kept = 0;
+
+		for (const sortentry& entry : m_order)
+		{
+			const stripspan& span = m_currentSpans[entry.target];
+			const stripspan& made = m_spans[entry.target];
+			if (m_states[entry.target] == proxystate::live and span.first == made.first and span.last == made.last)
+			{
+				m_order[kept++] = sortentry{ m_keys[entry.target], entry.strip, entry.target };
+			}
+		}
+		m_order.resize(kept);
+	}
+
+	// The entries of new boxes and of boxes whose span changed, RefreshOrder dropped their old ones.
+	void broadphase::CollectEntries()
+	{
+		m_newEntries.clear();
+
+		for (proxy target = 0; target < m_states.size(); target++)
+		{
+			if (m_states[target] != proxystate::live)
+			{
+				continue;
+			}
+
+			const stripspan& span = m_currentSpans[target];
+			stripspan& made = m_spans[target];
+			if (span.first == made.first and span.last == made.last)
+			{
+				continue;
+			}
+
+			made = span;
+			for (UINT strip = span.first; strip <= span.last; strip++)
+			{
+				m_newEntries.push_back(sortentry{ m_keys[target], strip, target });
+			}
+		}
+	}
+
+	// Insertion sort, it gives up after BROADPHASE_REBUILD_SWAPS swaps per entry.
+	bool broadphase::RepairOrder()
+	{
+		UINT count = static_cast<UINT>(m_order.size());
+		UINT64 limit = static_cast<UINT64>(BROADPHASE_REBUILD_SWAPS) * count;
+
+		for (UINT i = 1; i < count; i++)
+		{
+			sortentry entry = m_order[i];
+			UINT j = i;
+
+			while (j > 0 and EntryLess(entry, m_order[j - 1]))
+			{
+				m_order[j] = m_order[j - 1];
+				j--;
+			}
+
+			m_order[j] = entry;
+			m_swaps += i - j;
+			if (m_swaps > limit)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void broadphase::MergeEntries()
+	{
+		if (m_newEntries.empty())
+		{
+			return;
+		}
+
+		std::sort(m_newEntries.begin(), m_newEntries.end(), EntryLess);
+		m_spareEntries.resize(m_order.size() + m_newEntries.size());
+		std::merge(m_order.begin(), m_order.end(), m_newEntries.begin(), m_newEntries.end(), m_spareEntries.begin(), EntryLess);
+		m_order.swap(m_spareEntries);
+	}
+
+	// The strips are about four average boxes wide so most boxes are in one strip. The pieces are sorted
+	// by the jobs and merged in pairs, every round halves the pieces.
+	void broadphase::RebuildOrder(core::jobsystem& jobs)
+	{
+		double sums[3]{}, squares[3]{}, sizes[3]{};
+		FLOAT lowest[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, highest[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		UINT live = 0;
+
+		for (proxy target = 0; target < m_states.size(); target++)
+		{
+			if (m_states[target] != proxystate::live)
+			{
+				continue;
+			}
+
+			const aabb& bounds = m_bounds[target];
+			for (UINT axis = 0; axis < 3; axis++)
+			{
+				FLOAT center = 0.5f * (Component(bounds.min, axis) + Component(bounds.max, axis));
+				sums[axis] += center;
+				squares[axis] += static_cast<double>(center) * center;
+				sizes[axis] += Component(bounds.max, axis) - Component(bounds.min, axis);
+				lowest[axis] = (std::min)(lowest[axis], center);
+				highest[axis] = (std::max)(highest[axis], center);
+			}
+			live++;
+		}
+
+		// The spread along an axis is the number of boxes times the variance of the centers along it.
+		UINT axes[3] = { 0, 1, 2 };
+		double spreads[3];
+		for (UINT axis = 0; axis < 3; axis++)
+		{
+			spreads[axis] = live ? squares[axis] - sums[axis] * sums[axis] / live : 0.0;
+		}
+		std::stable_sort(axes, axes + 3, [&spreads](UINT a, UINT b)
+		{
+			return spreads[a] > spreads[b];
+		});
+		m_sweepAxis = axes[0];
+		m_stripAxis = axes[1];
+
+		UINT strips = 1;
+		double range = live ? static_cast<double>(highest[m_stripAxis]) - lowest[m_stripAxis] : 0.0;
+		if (range > 0.0)
+		{
+			double size = sizes[m_stripAxis] / live;
+			double fitting = size > 0.0 ? range / (4.0 * size) : BROADPHASE_STRIPS;
+			strips = static_cast<UINT>((std::min)((std::max)(fitting, 1.0), static_cast<double>(BROADPHASE_STRIPS)));
+		}
+
+		m_stripBounds.clear();
+		m_stripBounds.push_back(-std::numeric_limits<FLOAT>::infinity());
+		for (UINT strip = 1; strip < strips; strip++)
+		{
+			m_stripBounds.push_back(static_cast<FLOAT>(lowest[m_stripAxis] + range * strip / strips));
+		}
+		m_stripBounds.push_back(std::numeric_limits<FLOAT>::infinity());
+		m_stripOrigin = lowest[m_stripAxis];
+		m_stripScale = range > 0.0 ? static_cast<FLOAT>(strips / range) : 0.0f;
+
+		m_entries.clear();
+		for (proxy target = 0; target < m_states.size(); target++)
+		{
+			if (m_states[target] != proxystate::live)
+			{
+				continue;
+			}
+
+			stripspan span = GetSpan(m_bounds[target]);
+			m_spans[target] = span;
+			for (UINT strip = span.first; strip <= span.last; strip++)
+			{
+				m_entries.push_back(sortentry{ Component(m_bounds[target].min, m_sweepAxis), strip, target });
+			}
+		}
+
+		UINT count = static_cast<UINT>(m_entries.size());
+		m_spareEntries.resize(count);
+		jobs.ParallelFor(BROADPHASE_SORT_PIECES, 1, [&](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t piece = begin; piece < end; piece++)
+			{
+				std::sort(m_entries.begin() + PieceBegin(piece, BROADPHASE_SORT_PIECES, count),
+					m_entries.begin() + PieceBegin(piece + 1, BROADPHASE_SORT_PIECES, count), EntryLess);
+			}
+		});
+
+		for (UINT width = 1; width < BROADPHASE_SORT_PIECES; width *= 2)
+		{
+			UINT merges = (BROADPHASE_SORT_PIECES + 2 * width - 1) / (2 * width);
+			jobs.ParallelFor(merges, 1, [&](std::uint32_t begin, std::uint32_t end)
+			{
+				for (std::uint32_t merge = begin; merge < end; merge++)
+				{
+					UINT first = PieceBegin(2 * merge * width, BROADPHASE_SORT_PIECES, count);
+					UINT middle = PieceBegin((std::min)((2 * merge + 1) * width, BROADPHASE_SORT_PIECES), BROADPHASE_SORT_PIECES, count);
+					UINT last = PieceBegin((std::min)((2 * merge + 2) * width, BROADPHASE_SORT_PIECES), BROADPHASE_SORT_PIECES, count);
+					std::merge(m_entries.begin() + first, m_entries.begin() + middle, m_entries.begin() + middle, m_entries.begin() + last,
+						m_spareEntries.begin() + first, EntryLess);
+				}
+			});
+			m_entries.swap(m_spareEntries);
+		}
+
+		m_order.swap(m_entries);
+	}
+
+	// Every strip is followed by FLOATV_WIDTH entries that start at FLT_MAX, after every box.
+	void broadphase::CopySorted(core::jobsystem& jobs)
+	{
+		UINT count = static_cast<UINT>(m_order.size());
+		std::size_t size = count + core::FLOATV_WIDTH * (m_stripBounds.size() - 1);
+		UINT axisA = (m_sweepAxis + 1) % 3, axisB = (m_sweepAxis + 2) % 3;
+
+		m_sorted.resize(size);
+		m_sweepMin.assign(size, FLT_MAX);
+		for (std::vector<FLOAT> *values : { &m_sweepMax, &m_minA, &m_maxA, &m_minB, &m_maxB })
+		{
+			values->resize(size);
+		}
+
+		jobs.ParallelFor(count, 4096, [this, axisA, axisB](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t i = begin; i < end; i++)
+			{
+				const sortentry& entry = m_order[i];
+				const aabb& bounds = m_bounds[entry.target];
+				std::size_t target = i + core::FLOATV_WIDTH * entry.strip;
+
+				m_sorted[target] = entry.target;
+				m_sweepMin[target] = entry.key;
+				m_sweepMax[target] = Component(bounds.max, m_sweepAxis);
+				m_minA[target] = Component(bounds.min, axisA);
+				m_maxA[target] = Component(bounds.max, axisA);
+				m_minB[target] = Component(bounds.min, axisB);
+				m_maxB[target] = Component(bounds.max, axisB);
+			}
+		});
+	}
+
+	// The entries after an entry in its strip are in range of it as long as they start before it ends,
+	// those lanes are a prefix of every vector. The other axes only need to not be apart.
+	void broadphase::Sweep(UINT begin, UINT end, std::vector<broadphasepair>& pairs) const
+	{
+		// The strip axis is a or b, the lower bounds along it decide which strip reports a pair.
+		const std::vector<FLOAT>& stripMin = m_stripAxis == (m_sweepAxis + 1) % 3 ? m_minA : m_minB;
+
+		for (UINT i = begin; i < end; i++)
+		{
+			const sortentry& entry = m_order[i];
+			std::size_t self = i + core::FLOATV_WIDTH * entry.strip;
+			core::floatv sweepMax = core::SplatV(m_sweepMax[self]);
+			core::floatv minA = core::SplatV(m_minA[self]), maxA = core::SplatV(m_maxA[self]);
+			core::floatv minB = core::SplatV(m_minB[self]), maxB = core::SplatV(m_maxB[self]);
+			core::floatv lowerBound = core::SplatV(stripMin[self]);
+			core::floatv stripStart = core::SplatV(m_stripBounds[entry.strip]), stripEnd = core::SplatV(m_stripBounds[entry.strip + 1]);
+
+			for (std::size_t j = self + 1; ; j += core::FLOATV_WIDTH)
+			{
+				int inRange = ~core::LessMaskV(sweepMax, core::LoadV(&m_sweepMin[j])) & FULL_MASK;
+				if (inRange == 0)
+				{
+					break;
+				}
+
+				int apart = core::LessMaskV(maxA, core::LoadV(&m_minA[j])) | core::LessMaskV(core::LoadV(&m_maxA[j]), minA)
+					| core::LessMaskV(maxB, core::LoadV(&m_minB[j])) | core::LessMaskV(core::LoadV(&m_maxB[j]), minB);
+				core::floatv shared = core::MaxV(lowerBound, core::LoadV(&stripMin[j]));
+				int owned = ~core::LessMaskV(shared, stripStart) & core::LessMaskV(shared, stripEnd);
+
+				for (std::uint32_t hits = static_cast<std::uint32_t>(inRange & ~apart & owned); hits; hits &= hits - 1)
+				{
+					proxy other = m_sorted[j + LowestSetBit(hits)];
+					pairs.push_back(entry.target < other ? broadphasepair{ entry.target, other } : broadphasepair{ other, entry.target });
+				}
+
+				if (inRange != FULL_MASK)
+				{
+					break;
+				}
+			}
+		}
+	}
+
+	// A counting sort on the first proxy puts the pairs of every proxy together, each run is then sorted on the second.
+	void broadphase::SortPairs()
+	{
+		m_pairs.swap(m_previousPairs);
+		m_pairOffsets.assign(m_bounds.size() + 1, 0);
+
+		std::size_t total = 0;
+		for (const std::vector<broadphasepair>& pairs : m_piecePairs)
+		{
+			for (const broadphasepair& pair : pairs)
+			{
+				m_pairOffsets[pair.first + 1]++;
+			}
+			total += pairs.size();
+		}
+		for (std::size_t i = 1; i < m_pairOffsets.size(); i++)
+		{
+			m_pairOffsets[i] += m_pairOffsets[i - 1];
+		}
+
+		// Scattering moves every offset to the end of its run, the start of the next.
+		m_pairs.resize(total);
+		for (const std::vector<broadphasepair>& pairs : m_piecePairs)
+		{
+			for (const broadphasepair& pair : pairs)
+			{
+				m_pairs[m_pairOffsets[pair.first]++] = pair;
+			}
+		}
+
+		std::size_t runBegin = 0;
+		for (std::size_t i = 0; i + 1 < m_pairOffsets.size(); i++)
+		{
+			std::size_t runEnd = m_pairOffsets[i];
+			if (runEnd - runBegin > SHORT_RUN)
+			{
+				std::sort(m_pairs.begin() + runBegin, m_pairs.begin() + runEnd, PairLess);
+			}
+			else
+			{
+				for (std::size_t j = runBegin + 1; j < runEnd; j++)
+				{
+					broadphasepair pair = m_pairs[j];
+					std::size_t k = j;
+					for (; k > runBegin and m_pairs[k - 1].second > pair.second; k--)
+					{
+						m_pairs[k] = m_pairs[k - 1];
+					}
+					m_pairs[k] = pair;
+				}
+			}
+			runBegin = runEnd;
+		}
+	}
+
+	// Both lists are sorted, one walk through them finds the pairs only one of them has.
+	void broadphase::ComparePairs()
+	{
+		m_startedPairs.clear();
+		m_endedPairs.clear();
+
+		std::size_t current = 0, previous = 0;
+		while (current < m_pairs.size() or previous < m_previousPairs.size())
+		{
+			if (previous == m_previousPairs.size() or (current < m_pairs.size() and PairLess(m_pairs[current], m_previousPairs[previous])))
+			{
+				m_startedPairs.push_back(m_pairs[current++]);
+			}
+			else if (current == m_pairs.size() or PairLess(m_previousPairs[previous], m_pairs[current]))
+			{
+				m_endedPairs.push_back(m_previousPairs[previous++]);
+			}
+			else
+			{
+				current++;
+				previous++;
+			}
+		}
+	}
+}
@@ -0,0 +1,164 @@
+// broadphase.h : include file for the sweep and prune broadphase
+// The broadphase finds the pairs of axis aligned boxes that overlap. The world is cut into strips along one axis,
+// the strip axis, and every box has an entry in each strip it reaches into. Within a strip the entries are kept
+// sorted by their lower bound along another axis, the sweep axis, so a box can only overlap the boxes after it
+// in its strip that start before it ends. Strips keep the boxes a sweep passes over to those nearby on two axes
+// instead of one, which is what lets wide worlds with many boxes scale.
+// Every Update:
+//  - the sort keys are refreshed and the order is repaired with insertion sort. Objects move little from one
+//    step to the next, only neighbours swap and the repair is close to linear. The entries of new boxes and of
+//    boxes that moved into other strips are sorted on their own and merged in,
+//  - when many entries are new, or the repair runs into too many swaps because boxes jumped, the order is built
+//    again instead: the sweep and strip axes become the two the box centers spread along the most, and the
+//    entries are sorted in pieces by the jobs, which are then merged,
+//  - the bounds are copied in sorted order to one array per axis and side, and every entry is tested against
+//    FLOATV_WIDTH entries after it at once on all three axes (see simdmath.h). Pieces of the order are swept by the jobs.
+//    Two boxes sharing several strips are only reported by the strip that holds the larger of their lower bounds
+//    along the strip axis,
+//  - the pairs are ordered by their first and then their second proxy with a counting sort and compared with the
+//    pairs of the last Update, which gives the pairs that started and stopped overlapping.
+// The pairs and their order only depend on the boxes, not on the number of threads or on how the boxes moved.
+// Boxes that touch overlap.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+#include "d3dxmath.h"
+
+namespace graphics
+{
+	// The order is swept in this many pieces, the unit of parallel work.
+	constexpr UINT BROADPHASE_SWEEP_PIECES{ 64 };
+	// Most strips the world is cut into. There are fewer when the boxes are large next to the world.
+	constexpr UINT BROADPHASE_STRIPS{ 16 };
+	// Pieces of a full sort, merged in pairs afterwards.
+	constexpr UINT BROADPHASE_SORT_PIECES{ 16 };
+	// Swaps per box the insertion sort may take before the order is built again.
+	constexpr UINT BROADPHASE_REBUILD_SWAPS{ 16 };
+
+	struct aabb
+	{
+		D3DXVECTOR3 min;
+		D3DXVECTOR3 max;
+	};
+
+	// The first proxy of a pair is always the smaller one.
+	struct broadphasepair
+	{
+		UINT first;
+		UINT second;
+	};
+
+	struct broadphasestats
+	{
+		UINT proxies{};
+		UINT entries{};
+		UINT strips{};
+		UINT pairs{};
+		UINT startedPairs{};
+		UINT endedPairs{};
+		UINT64 swaps{};
+		UINT sweepAxis{};
+		UINT stripAxis{};
+		bool rebuilt{};
+	};
+
+	class broadphase
+	{
+	public:
+		typedef UINT proxy;
+		static constexpr proxy INVALID_PROXY{ 0xffffffff };
+
+		broadphase() {};
+		broadphase(const broadphase& other) = delete;
+		~broadphase() {};
+
+		broadphase& operator=(const broadphase& other) = delete;
+
+		// Boxes added or removed take part from the next Update on. The proxy of a removed box
+		// is not handed out again before the Update that reports the end of its pairs.
+		proxy Add(const aabb& bounds);
+		void Remove(proxy removed);
+		// SetBounds only stores the box, any number of threads can set the boxes of different proxies.
+		void SetBounds(proxy target, const aabb& bounds);
+		const aabb& GetBounds(proxy target) const;
+
+		void Update(core::jobsystem& jobs);
+
+		// The pairs overlapping at the last Update, those that started overlapping with it
+		// and those that stopped, all ordered by their first and then their second proxy.
+		const std::vector<broadphasepair>& GetPairs() const;
+		const std::vector<broadphasepair>& GetStartedPairs() const;
+		const std::vector<broadphasepair>& GetEndedPairs() const;
+		broadphasestats GetStats() const;
+	private:
+		enum class proxystate : std::uint8_t
+		{
+			free, live, removed
+		};
+
+		// The strips a box reaches into, first to last.
+		struct stripspan
+		{
+			std::uint16_t first;
+			std::uint16_t last;
+		};
+
+		struct sortentry
+		{
+			FLOAT key;
+			UINT strip;
+			proxy target;
+		};
+
+		static bool EntryLess(const sortentry& a, const sortentry& b);
+		UINT GetStrip(FLOAT value) const;
+		stripspan GetSpan(const aabb& bounds) const;
+		void RefreshKeys(core::jobsystem& jobs);
+		void RefreshOrder();
+		void CollectEntries();
+		bool RepairOrder();
+		void MergeEntries();
+		void RebuildOrder(core::jobsystem& jobs);
+		void CopySorted(core::jobsystem& jobs);
+		void Sweep(UINT begin, UINT end, std::vector<broadphasepair>& pairs) const;
+		void SortPairs();
+		void ComparePairs();
+
+		std::vector<aabb> m_bounds{};
+		std::vector<proxystate> m_states{};
+		// The span the entries of every proxy in the order were made for, and the span and sort key
+		// of its box now, refreshed in one pass over the proxies at the start of Update.
+		std::vector<stripspan> m_spans{};
+		std::vector<stripspan> m_currentSpans{};
+		std::vector<FLOAT> m_keys{};
+		std::vector<proxy> m_freeProxies{};
+		std::vector<proxy> m_removedProxies{};
+		UINT m_sweepAxis{};
+		UINT m_stripAxis{ 1 };
+		// Where the strips start along the strip axis, the first starts at minus infinity and one more ends the last.
+		// The strips in between are equally wide, which gives a first guess of the strip of a value.
+		std::vector<FLOAT> m_stripBounds{};
+		FLOAT m_stripOrigin{};
+		FLOAT m_stripScale{};
+
+		// The entries sorted by strip, then by their lower bound along the sweep axis, then by proxy.
+		// The arrays after it hold the same entries with FLOATV_WIDTH more after every strip that end its sweeps,
+		// the axes after the sweep axis are a and b.
+		std::vector<sortentry> m_order{};
+		std::vector<proxy> m_sorted{};
+		std::vector<FLOAT> m_sweepMin{}, m_sweepMax{};
+		std::vector<FLOAT> m_minA{}, m_maxA{}, m_minB{}, m_maxB{};
+
+		std::vector<broadphasepair> m_pairs{}, m_previousPairs{};
+		std::vector<broadphasepair> m_startedPairs{}, m_endedPairs{};
+
+		// Working memory of Update, kept so a step does not allocate.
+		std::vector<sortentry> m_newEntries{}, m_entries{}, m_spareEntries{};
+		std::vector<broadphasepair> m_piecePairs[BROADPHASE_SWEEP_PIECES];
+		std::vector<UINT> m_pairOffsets{};
+		UINT64 m_swaps{};
+		bool m_rebuilt{};
+	};
+}
@@ -4,7 +4,7 @@
 // which will be passed into the HLSL shader for rendering.
 #pragma once
 
-#include <d3dx10math.h>
+#include "d3dxmath.h"
 
 namespace graphics
 {
@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include "cameracontroller.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace graphics
+{
+	namespace
+	{
+		// The virtual key codes of the letters are their upper case characters.
+		const std::uint32_t MOVE_KEYS[6] = { 'W', 'S', 'A', 'D', 'E', 'Q' };
+	}
+
+	cameracontroller::cameracontroller(const cameracontrolsettings& settings) :
+		m_settings(settings)
+	{
+		if (settings.moveSpeed < 0.0f or settings.maxPitch < 0.0f or settings.maxPitch >= 90.0f)
+		{
+			throw "Incorrect camera control settings.";
+		}
+	}
+
+	void cameracontroller::Step(core::inputqueue& queue, std::uint64_t stepBegin, std::uint64_t stepEnd, std::uint64_t ticksPerSecond,
+		scene::camerastate& camera)
+	{
+		core::inputevent event;
+		std::uint64_t time = stepBegin;
+		const FLOAT secondsPerTick = 1.0f / static_cast<FLOAT>(ticksPerSecond);
+		PROFILE_SCOPE("cameracontroller::Step");
+
+		while (queue.Peek(event) and event.time <= stepEnd)
+		{
+			queue.Pop(event);
+
+			if (event.time > time)
+			{
+				Move(static_cast<FLOAT>(event.time - time) * secondsPerTick, camera);
+				time = event.time;
+			}
+			Apply(event, camera);
+
+			if (!m_applied or event.time < m_oldestInput)
+			{
+				m_oldestInput = event.time;
+			}
+			m_applied = true;
+		}
+
+		if (stepEnd > time)
+		{
+			Move(static_cast<FLOAT>(stepEnd - time) * secondsPerTick, camera);
+		}
+	}
+
+	bool cameracontroller::TakeOldestInput(std::uint64_t& time)
+	{
+		if (!m_applied)
+		{
+			return false;
+		}
+
+		time = m_oldestInput;
+		m_applied = false;
+		return true;
+	}
+
+	void cameracontroller::Apply(const core::inputevent& event, scene::camerastate& camera)
+	{
+		switch (event.type)
+		{
+		case core::inputtype::keydown:
+		case core::inputtype::keyup:
+			for (UINT i = 0; i < 6; i++)
+			{
+				if (event.code == MOVE_KEYS[i])
+				{
+					m_held[i] = event.type == core::inputtype::keydown;
+				}
+			}
+			break;
+		case core::inputtype::buttondown:
+			if (event.code == static_cast<std::uint32_t>(core::mousebutton::right))
+			{
+				m_turning = true;
+				m_lastX = event.x;
+				m_lastY = event.y;
+			}
+			break;
+		case core::inputtype::buttonup:
+			if (event.code == static_cast<std::uint32_t>(core::mousebutton::right))
+			{
+				m_turning = false;
+			}
+			break;
+		case core::inputtype::mousemove:
+			// Moving the mouse right turns right, moving it down looks down, see camera::Render.
+			if (m_turning)
+			{
+				camera.rotation.y += static_cast<FLOAT>(event.x - m_lastX) * m_settings.degreesPerPixel;
+				camera.rotation.x += static_cast<FLOAT>(event.y - m_lastY) * m_settings.degreesPerPixel;
+				camera.rotation.x = (std::min)((std::max)(camera.rotation.x, -m_settings.maxPitch), m_settings.maxPitch);
+			}
+			m_lastX = event.x;
+			m_lastY = event.y;
+			break;
+		case core::inputtype::focuslost:
+			std::fill(m_held, m_held + 6, false);
+			m_turning = false;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// The camera looks along z when its yaw is 0, forward and right turn with the yaw but ignore the pitch,
+	// so looking down does not fly into the ground. Moving diagonally is no faster than straight.
+	void cameracontroller::Move(FLOAT seconds, scene::camerastate& camera) const
+	{
+		FLOAT forward = (m_held[0] ? 1.0f : 0.0f) - (m_held[1] ? 1.0f : 0.0f);
+		FLOAT right = (m_held[3] ? 1.0f : 0.0f) - (m_held[2] ? 1.0f : 0.0f);
+		FLOAT up = (m_held[4] ? 1.0f : 0.0f) - (m_held[5] ? 1.0f : 0.0f);
+		FLOAT length = std::sqrt(forward * forward + right * right + up * up);
+		if (length == 0.0f)
+		{
+			return;
+		}
+
+		FLOAT yaw = camera.rotation.y * 0.0174532925f;
+		FLOAT sine = std::sin(yaw), cosine = std::cos(yaw);
+		FLOAT distance = m_settings.moveSpeed * seconds / length;
+
+		camera.position.x += (forward * sine + right * cosine) * distance;
+		camera.position.y += up * distance;
+		camera.position.z += (forward * cosine - right * sine) * distance;
+	}
+}
@@ -0,0 +1,57 @@
+// cameracontroller.h : include file for flying the camera with the keyboard and mouse
+// Every simulation step the controller takes the events of the input queue stamped up to the end of the step
+// and moves the camera through the step event by event: between two events the camera moves with the keys
+// that were held then, so a key held for a third of a step moves it a third of a step's distance,
+// no matter how the presses fall on the steps or how many of them arrive in one frame.
+// Events stamped before the step began, which were late to the queue, take effect at its start,
+// events stamped after its end stay queued for the next step.
+//  - W, S, A and D move forward, back, left and right in the plane the camera faces, E and Q up and down,
+//  - moving the mouse while the right button is held turns the camera.
+// It also remembers the oldest event it applied since it was last asked, which is where the input latency is
+// measured from once the frame showing it is presented.
+// It does not need a window, so synthetic events drive it the same way the window procedure does.
+#pragma once
+
+#include <cstdint>
+#include "inputqueue.h"
+#include "scene.h"
+
+namespace graphics
+{
+	struct cameracontrolsettings
+	{
+		FLOAT moveSpeed{ 10.0f };
+		FLOAT degreesPerPixel{ 0.2f };
+		FLOAT maxPitch{ 89.0f };
+	};
+
+	class cameracontroller
+	{
+	public:
+		cameracontroller() = delete;
+		cameracontroller(const cameracontrolsettings& settings);
+		cameracontroller(const cameracontroller& other) = delete;
+		~cameracontroller() {};
+
+		cameracontroller& operator=(const cameracontroller& other) = delete;
+
+		// Step applies the events up to stepEnd to the camera, which is at its state of stepBegin.
+		// The ticks are the ones the events are stamped with.
+		void Step(core::inputqueue& queue, std::uint64_t stepBegin, std::uint64_t stepEnd, std::uint64_t ticksPerSecond,
+			scene::camerastate& camera);
+
+		// TakeOldestInput returns the time of the oldest event applied since the last call, false when there was none.
+		bool TakeOldestInput(std::uint64_t& time);
+	private:
+		void Apply(const core::inputevent& event, scene::camerastate& camera);
+		void Move(FLOAT seconds, scene::camerastate& camera) const;
+
+		cameracontrolsettings m_settings;
+		// Movement keys held: forward, back, left, right, up, down.
+		bool m_held[6]{};
+		bool m_turning{};
+		std::int32_t m_lastX{}, m_lastY{};
+		bool m_applied{};
+		std::uint64_t m_oldestInput{};
+	};
+}
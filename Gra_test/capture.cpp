@@ -0,0 +1,498 @@
+#include "stdafx.h"
+#include "capture.h"
+#include "nullrenderer.h"
+#include <cstring>
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr char CAPTURE_MAGIC[4]{ 'G', 'R', 'A', 'C' };
+		constexpr std::size_t FLUSH_SIZE{ 64 * 1024 };
+
+		constexpr std::uint8_t DRAWS_LISTED{ 0 };
+		constexpr std::uint8_t DRAWS_REPEATED{ 1 };
+
+		void PutByte(std::vector<std::uint8_t>& buffer, std::uint8_t value)
+		{
+			buffer.push_back(value);
+		}
+
+		// Seven bits per byte, the high bit says another byte follows.
+		void PutVarint(std::vector<std::uint8_t>& buffer, std::uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				buffer.push_back(static_cast<std::uint8_t>(value | 0x80));
+				value >>= 7;
+			}
+			buffer.push_back(static_cast<std::uint8_t>(value));
+		}
+
+		// Differences are zigzag encoded so small negative ones stay short.
+		void PutDelta(std::vector<std::uint8_t>& buffer, UINT value, UINT previous)
+		{
+			std::int64_t delta = static_cast<std::int64_t>(value) - static_cast<std::int64_t>(previous);
+			PutVarint(buffer, (static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63));
+		}
+
+		void PutUint64(std::vector<std::uint8_t>& buffer, std::uint64_t value)
+		{
+			for (std::uint32_t i = 0; i < 8; i++)
+			{
+				buffer.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+			}
+		}
+
+		void PutFloat(std::vector<std::uint8_t>& buffer, FLOAT value)
+		{
+			std::uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			for (std::uint32_t i = 0; i < 4; i++)
+			{
+				buffer.push_back(static_cast<std::uint8_t>(bits >> (i * 8)));
+			}
+		}
+
+		void PutVector(std::vector<std::uint8_t>& buffer, const D3DXVECTOR3& value)
+		{
+			PutFloat(buffer, value.x);
+			PutFloat(buffer, value.y);
+			PutFloat(buffer, value.z);
+		}
+
+		void PutEntity(std::vector<std::uint8_t>& buffer, core::entity value)
+		{
+			PutVarint(buffer, value.index);
+			PutVarint(buffer, value.generation);
+		}
+
+		bool SameDraw(const drawitem& a, const drawitem& b)
+		{
+			return a.page == b.page and a.indexCount == b.indexCount and a.startIndex == b.startIndex and a.baseVertex == b.baseVertex;
+		}
+
+		// Reads past the end of the log set the damaged flag and return zeros,
+		// Next checks the flag once the whole event is read.
+		class bytereader
+		{
+		public:
+			bytereader(const std::vector<std::uint8_t>& bytes, std::size_t& position, bool& damaged) :
+				m_bytes(bytes), m_position(position), m_damaged(damaged) {};
+
+			std::uint8_t Byte()
+			{
+				if (m_position >= m_bytes.size())
+				{
+					m_damaged = true;
+					return 0;
+				}
+				return m_bytes[m_position++];
+			}
+
+			std::uint64_t Varint()
+			{
+				std::uint64_t value = 0;
+				for (std::uint32_t shift = 0; shift < 64; shift += 7)
+				{
+					std::uint8_t current = Byte();
+					value |= static_cast<std::uint64_t>(current & 0x7f) << shift;
+					if (!(current & 0x80))
+					{
+						return value;
+					}
+				}
+				m_damaged = true;
+				return 0;
+			}
+
+			UINT Delta(UINT previous)
+			{
+				std::uint64_t encoded = Varint();
+				std::int64_t delta = static_cast<std::int64_t>(encoded >> 1) ^ -static_cast<std::int64_t>(encoded & 1);
+				return static_cast<UINT>(static_cast<std::int64_t>(previous) + delta);
+			}
+
+			std::uint64_t Uint64()
+			{
+				std::uint64_t value = 0;
+				for (std::uint32_t i = 0; i < 8; i++)
+				{
+					value |= static_cast<std::uint64_t>(Byte()) << (i * 8);
+				}
+				return value;
+			}
+
+			FLOAT Float()
+			{
+				std::uint32_t bits = 0;
+				FLOAT value;
+				for (std::uint32_t i = 0; i < 4; i++)
+				{
+					bits |= static_cast<std::uint32_t>(Byte()) << (i * 8);
+				}
+				std::memcpy(&value, &bits, sizeof(value));
+				return value;
+			}
+
+			D3DXVECTOR3 Vector()
+			{
+				D3DXVECTOR3 value;
+				value.x = Float();
+				value.y = Float();
+				value.z = Float();
+				return value;
+			}
+
+			core::entity Entity()
+			{
+				core::entity value;
+				value.index = static_cast<std::uint32_t>(Varint());
+				value.generation = static_cast<std::uint32_t>(Varint());
+				return value;
+			}
+		private:
+			const std::vector<std::uint8_t>& m_bytes;
+			std::size_t& m_position;
+			bool& m_damaged;
+		};
+	}
+
+	capturewriter::capturewriter()
+	{
+		m_buffer.insert(m_buffer.end(), CAPTURE_MAGIC, CAPTURE_MAGIC + sizeof(CAPTURE_MAGIC));
+		PutVarint(m_buffer, CAPTURE_VERSION);
+	}
+
+	capturewriter::~capturewriter()
+	{
+		Close();
+	}
+
+	bool capturewriter::Open(const char *path)
+	{
+		m_file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (m_file.fail())
+		{
+			return false;
+		}
+
+		Flush(true);
+		return !m_failed;
+	}
+
+	bool capturewriter::Close()
+	{
+		if (m_file.is_open())
+		{
+			Flush(true);
+			m_file.close();
+			m_failed = m_failed or m_file.fail();
+		}
+
+		return !m_failed;
+	}
+
+	const std::vector<std::uint8_t>& capturewriter::GetBuffer() const
+	{
+		return m_buffer;
+	}
+
+	void capturewriter::WindowSize(UINT width, UINT height)
+	{
+		PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::windowsize));
+		PutVarint(m_buffer, width);
+		PutVarint(m_buffer, height);
+		Flush(false);
+	}
+
+	void capturewriter::Camera(const scene::camerastate& previous, const scene::camerastate& current)
+	{
+		PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::camera));
+		PutVector(m_buffer, previous.position);
+		PutVector(m_buffer, previous.rotation);
+		PutVector(m_buffer, current.position);
+		PutVector(m_buffer, current.rotation);
+		Flush(false);
+	}
+
+	void capturewriter::CreateInstance(core::entity instance, const transform& placement, const meshinstance& mesh)
+	{
+		PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::create));
+		PutEntity(m_buffer, instance);
+		PutVector(m_buffer, placement.position);
+		PutVector(m_buffer, placement.rotation);
+		PutFloat(m_buffer, placement.scale);
+		PutVarint(m_buffer, mesh.page);
+		PutVarint(m_buffer, mesh.indexCount);
+		PutVarint(m_buffer, mesh.startIndex);
+		PutVarint(m_buffer, mesh.baseVertex);
+		PutFloat(m_buffer, mesh.boundingRadius);
+		Flush(false);
+	}
+
+	void capturewriter::DestroyInstance(core::entity instance)
+	{
+		PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::destroy));
+		PutEntity(m_buffer, instance);
+		Flush(false);
+	}
+
+	void capturewriter::SetPlacement(core::entity instance, const transform& placement)
+	{
+		PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::place));
+		PutEntity(m_buffer, instance);
+		PutVector(m_buffer, placement.position);
+		PutVector(m_buffer, placement.rotation);
+		PutFloat(m_buffer, placement.scale);
+		Flush(false);
+	}
+
+	// A root is written as the invalid entity.
+	void capturewriter::SetParent(core::entity instance, core::entity parent)
+	{
+		PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::parent));
+		PutEntity(m_buffer, instance);
+		PutEntity(m_buffer, parent);
+		Flush(false);
+	}
+
+	void capturewriter::RelocateMesh(const meshinstance& from, const meshinstance& to)
+	{
+		PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::relocate));
+		PutVarint(m_buffer, from.page);
+		PutVarint(m_buffer, from.startIndex);
+		PutVarint(m_buffer, from.baseVertex);
+		PutVarint(m_buffer, to.page);
+		PutVarint(m_buffer, to.startIndex);
+		PutVarint(m_buffer, to.baseVertex);
+		Flush(false);
+	}
+
+	void capturewriter::Update(FLOAT stepSeconds)
+	{
+		PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::update));
+		PutFloat(m_buffer, stepSeconds);
+		Flush(false);
+	}
+
+	void capturewriter::Frame(FLOAT alpha, const D3DXMATRIX& projectionMatrix, const rendersnapshot& snapshot)
+	{
+		if (!m_hasProjection or projectionMatrix != m_projection)
+		{
+			PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::projection));
+			for (UINT i = 0; i < 16; i++)
+			{
+				PutFloat(m_buffer, projectionMatrix(i / 4, i % 4));
+			}
+			m_projection = projectionMatrix;
+			m_hasProjection = true;
+		}
+
+		PutByte(m_buffer, static_cast<std::uint8_t>(captureeventtype::frame));
+		PutFloat(m_buffer, alpha);
+		PutVarint(m_buffer, snapshot.draws.size());
+
+		bool repeated = snapshot.draws.size() == m_lastDraws.size();
+		for (std::size_t i = 0; repeated and i < m_lastDraws.size(); i++)
+		{
+			repeated = SameDraw(snapshot.draws[i], m_lastDraws[i]);
+		}
+
+		if (repeated)
+		{
+			PutByte(m_buffer, DRAWS_REPEATED);
+		}
+		else
+		{
+			drawitem previous{};
+
+			PutByte(m_buffer, DRAWS_LISTED);
+			for (const drawitem& draw : snapshot.draws)
+			{
+				PutDelta(m_buffer, draw.page, previous.page);
+				PutDelta(m_buffer, draw.indexCount, previous.indexCount);
+				PutDelta(m_buffer, draw.startIndex, previous.startIndex);
+				PutDelta(m_buffer, draw.baseVertex, previous.baseVertex);
+				previous = draw;
+			}
+			m_lastDraws.assign(snapshot.draws.begin(), snapshot.draws.end());
+		}
+
+		PutUint64(m_buffer, nullrenderer::Checksum(snapshot, projectionMatrix));
+		Flush(false);
+	}
+
+	// In memory the buffer just grows, with a file it is written out in blocks.
+	void capturewriter::Flush(bool all)
+	{
+		if (!m_file.is_open() or (m_buffer.size() < FLUSH_SIZE and !all))
+		{
+			return;
+		}
+
+		m_file.write(reinterpret_cast<const char*>(m_buffer.data()), static_cast<std::streamsize>(m_buffer.size()));
+		m_failed = m_failed or m_file.fail();
+		m_buffer.clear();
+	}
+
+	bool capturereader::Load(const char *path)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		if (file.fail())
+		{
+			return false;
+		}
+
+		std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		return Load(bytes);
+	}
+
+	bool capturereader::Load(const std::vector<std::uint8_t>& bytes)
+	{
+		m_bytes = bytes;
+		m_position = 0;
+		m_damaged = false;
+
+		if (m_bytes.size() < sizeof(CAPTURE_MAGIC) or std::memcmp(m_bytes.data(), CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0)
+		{
+			m_damaged = true;
+			return false;
+		}
+
+		Rewind();
+		return !m_damaged;
+	}
+
+	bool capturereader::Next(captureevent& event)
+	{
+		bytereader read(m_bytes, m_position, m_damaged);
+
+		if (m_damaged or m_position >= m_bytes.size())
+		{
+			return false;
+		}
+
+		event.type = static_cast<captureeventtype>(read.Byte());
+		switch (event.type)
+		{
+		case captureeventtype::windowsize:
+			event.width = static_cast<UINT>(read.Varint());
+			event.height = static_cast<UINT>(read.Varint());
+			break;
+		case captureeventtype::projection:
+			for (UINT i = 0; i < 16; i++)
+			{
+				event.projection(i / 4, i % 4) = read.Float();
+			}
+			break;
+		case captureeventtype::camera:
+			event.previousCamera.position = read.Vector();
+			event.previousCamera.rotation = read.Vector();
+			event.currentCamera.position = read.Vector();
+			event.currentCamera.rotation = read.Vector();
+			break;
+		case captureeventtype::create:
+			event.instance = read.Entity();
+			event.placement.position = read.Vector();
+			event.placement.rotation = read.Vector();
+			event.placement.scale = read.Float();
+			event.mesh.page = static_cast<UINT>(read.Varint());
+			event.mesh.indexCount = static_cast<UINT>(read.Varint());
+			event.mesh.startIndex = static_cast<UINT>(read.Varint());
+			event.mesh.baseVertex = static_cast<UINT>(read.Varint());
+			event.mesh.boundingRadius = read.Float();
+			break;
+		case captureeventtype::destroy:
+			event.instance = read.Entity();
+			break;
+		case captureeventtype::place:
+			event.instance = read.Entity();
+			event.placement.position = read.Vector();
+			event.placement.rotation = read.Vector();
+			event.placement.scale = read.Float();
+			break;
+		case captureeventtype::parent:
+			event.instance = read.Entity();
+			event.parent = read.Entity();
+			break;
+		case captureeventtype::relocate:
+			event.relocatedFrom.page = static_cast<UINT>(read.Varint());
+			event.relocatedFrom.startIndex = static_cast<UINT>(read.Varint());
+			event.relocatedFrom.baseVertex = static_cast<UINT>(read.Varint());
+			event.mesh.page = static_cast<UINT>(read.Varint());
+			event.mesh.startIndex = static_cast<UINT>(read.Varint());
+			event.mesh.baseVertex = static_cast<UINT>(read.Varint());
+			break;
+		case captureeventtype::update:
+			event.seconds = read.Float();
+			break;
+		case captureeventtype::frame:
+		{
+			event.alpha = read.Float();
+			std::uint64_t count = read.Varint();
+
+			if (read.Byte() == DRAWS_LISTED)
+			{
+				// Every draw takes at least four bytes, a larger count can only come from a damaged log.
+				if (count > (m_bytes.size() - m_position) / 4)
+				{
+					m_damaged = true;
+					return false;
+				}
+
+				drawitem previous{};
+				m_lastDraws.resize(static_cast<std::size_t>(count));
+				for (std::size_t i = 0; i < m_lastDraws.size(); i++)
+				{
+					drawitem& draw = m_lastDraws[i];
+					draw.page = read.Delta(previous.page);
+					draw.indexCount = read.Delta(previous.indexCount);
+					draw.startIndex = read.Delta(previous.startIndex);
+					draw.baseVertex = read.Delta(previous.baseVertex);
+					draw.transform = static_cast<UINT>(i);
+					previous = draw;
+				}
+			}
+			else if (count != m_lastDraws.size())
+			{
+				m_damaged = true;
+				return false;
+			}
+
+			event.draws = &m_lastDraws;
+			event.checksum = read.Uint64();
+			break;
+		}
+		default:
+			m_damaged = true;
+			return false;
+		}
+
+		return !m_damaged;
+	}
+
+	bool capturereader::IsDamaged() const
+	{
+		return m_damaged;
+	}
+
+	// The version is checked here as well, a log of another version is treated as damaged.
+	void capturereader::Rewind()
+	{
+		bytereader read(m_bytes, m_position, m_damaged);
+
+		m_position = sizeof(CAPTURE_MAGIC);
+		m_damaged = false;
+		m_lastDraws.clear();
+		if (read.Varint() != CAPTURE_VERSION)
+		{
+			m_damaged = true;
+		}
+	}
+
+	std::size_t capturereader::GetSize() const
+	{
+		return m_bytes.size();
+	}
+}
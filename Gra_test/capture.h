@@ -0,0 +1,109 @@
+// capture.h : include file for capturing a session into a binary log and reading it back
+// A capture is everything that went into the scene: the window size, the camera, instances created,
+// destroyed, moved and put under other parents, the meshes the mesh heap moved, every simulation step with its length and every rendered frame with its blend factor.
+// For every frame the draw stream that came out is stored too, the draws themselves plus a checksum
+// of the shader parameters, so a replay can tell whether it produced exactly the same frames.
+//
+// The log is compact: integers are variable length, draws are stored as differences to the draw
+// before them and a frame that issued the same draws as the one before takes a single byte for them.
+// Floats are stored as their bits, little endian.
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+#include "scene.h"
+
+namespace graphics
+{
+	constexpr std::uint32_t CAPTURE_VERSION{ 3 };
+
+	enum class captureeventtype : std::uint8_t
+	{
+		windowsize = 1, projection, camera, create, destroy, update, frame, place, parent, relocate
+	};
+
+	// One entry of the log, only the fields of its type are filled.
+	// The draws of a frame belong to the reader and stay valid until the next event is read. They have
+	// only page, indexCount, startIndex and baseVertex, transform is their position in the list.
+	// A relocation has only page, startIndex and baseVertex of the range moved from in relocatedFrom and of the one moved to in mesh.
+	struct captureevent
+	{
+		captureeventtype type{};
+		UINT width{}, height{};
+		D3DXMATRIX projection{};
+		scene::camerastate previousCamera{}, currentCamera{};
+		core::entity instance{};
+		core::entity parent{};
+		transform placement{};
+		meshinstance mesh{};
+		meshinstance relocatedFrom{};
+		FLOAT seconds{};
+		FLOAT alpha{};
+		const std::vector<drawitem> *draws{};
+		std::uint64_t checksum{};
+	};
+
+	class capturewriter
+	{
+	public:
+		capturewriter();
+		capturewriter(const capturewriter& other) = delete;
+		~capturewriter();
+
+		capturewriter& operator=(const capturewriter& other) = delete;
+
+		// Open sends the log into a file, it has to come before anything is recorded.
+		// Without it the log is kept in memory and can be read with GetBuffer.
+		// Close writes out what is left, it returns false if any write to the file failed.
+		bool Open(const char *path);
+		bool Close();
+		const std::vector<std::uint8_t>& GetBuffer() const;
+
+		void WindowSize(UINT width, UINT height);
+		void Camera(const scene::camerastate& previous, const scene::camerastate& current);
+		void CreateInstance(core::entity instance, const transform& placement, const meshinstance& mesh);
+		void DestroyInstance(core::entity instance);
+		void SetPlacement(core::entity instance, const transform& placement);
+		void SetParent(core::entity instance, core::entity parent);
+		void RelocateMesh(const meshinstance& from, const meshinstance& to);
+		void Update(FLOAT stepSeconds);
+
+		// The projection is written only when it differs from the one of the previous frame.
+		void Frame(FLOAT alpha, const D3DXMATRIX& projectionMatrix, const rendersnapshot& snapshot);
+	private:
+		void Flush(bool all);
+
+		std::vector<std::uint8_t> m_buffer{};
+		std::ofstream m_file{};
+		bool m_failed{};
+		bool m_hasProjection{};
+		D3DXMATRIX m_projection{};
+		std::vector<drawitem> m_lastDraws{};
+	};
+
+	class capturereader
+	{
+	public:
+		capturereader() {};
+		capturereader(const capturereader& other) = delete;
+		~capturereader() {};
+
+		capturereader& operator=(const capturereader& other) = delete;
+
+		// Load takes the whole log into memory and checks its header.
+		bool Load(const char *path);
+		bool Load(const std::vector<std::uint8_t>& bytes);
+
+		// Next reads the following event, it returns false at the end of the log or when the log is damaged.
+		bool Next(captureevent& event);
+		bool IsDamaged() const;
+		void Rewind();
+		std::size_t GetSize() const;
+	private:
+		std::vector<std::uint8_t> m_bytes{};
+		std::size_t m_position{};
+		bool m_damaged{};
+		std::vector<drawitem> m_lastDraws{};
+	};
+}
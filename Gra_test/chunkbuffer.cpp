@@ -0,0 +1,104 @@
+#include "stdafx.h"
+#include "chunkbuffer.h"
+#include "memorytracker.h"
+#include "telemetry.h"
+
+namespace graphics
+{
+	chunkbuffer::chunkbuffer(ID3D11Device *dev, UINT vertexStride, UINT slotVertices, UINT slotCount, const std::uint32_t *indices, UINT indexCount) :
+		m_vertexStride(vertexStride), m_slotVertices(slotVertices), m_slotCount(slotCount), m_indexCount(indexCount)
+	{
+		D3D11_BUFFER_DESC vertexBufferDesc{}, indexBufferDesc{};
+		D3D11_SUBRESOURCE_DATA indexData{};
+		HRESULT result;
+
+		if (!dev or vertexStride == 0 or slotVertices == 0 or slotCount == 0 or !indices or indexCount == 0)
+		{
+			throw "Incorrect chunk buffer parameters.";
+		}
+
+		// The slots are only ever written with UpdateSubresource, like the pages of the mesh heap.
+		vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		vertexBufferDesc.ByteWidth = vertexStride * slotVertices * slotCount;
+		vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		vertexBufferDesc.CPUAccessFlags = 0;
+		vertexBufferDesc.MiscFlags = 0;
+		vertexBufferDesc.StructureByteStride = 0;
+
+		result = dev->CreateBuffer(&vertexBufferDesc, NULL, &m_vertexBuffer);
+		if (FAILED(result))
+		{
+			throw "Unable to create the chunk vertex buffer.";
+		}
+
+		indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		indexBufferDesc.ByteWidth = sizeof(std::uint32_t) * indexCount;
+		indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		indexBufferDesc.CPUAccessFlags = 0;
+		indexBufferDesc.MiscFlags = 0;
+		indexBufferDesc.StructureByteStride = 0;
+		indexData.pSysMem = indices;
+
+		result = dev->CreateBuffer(&indexBufferDesc, &indexData, &m_indexBuffer);
+		if (FAILED(result))
+		{
+			m_vertexBuffer->Release();
+			m_vertexBuffer = nullptr;
+			throw "Unable to create the chunk index buffer.";
+		}
+
+		core::memorytracker::Allocated(core::memorytag::meshes, GetSize());
+	}
+
+	chunkbuffer::~chunkbuffer()
+	{
+		core::memorytracker::Freed(core::memorytag::meshes, GetSize());
+
+		if (m_indexBuffer)
+		{
+			m_indexBuffer->Release();
+			m_indexBuffer = nullptr;
+		}
+
+		if (m_vertexBuffer)
+		{
+			m_vertexBuffer->Release();
+			m_vertexBuffer = nullptr;
+		}
+	}
+
+	void chunkbuffer::Upload(ID3D11DeviceContext *devcon, UINT slot, const void *vertices)
+	{
+		D3D11_BOX box{};
+		box.left = slot * m_slotVertices * m_vertexStride;
+		box.right = box.left + m_slotVertices * m_vertexStride;
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+
+		devcon->UpdateSubresource(m_vertexBuffer, 0, &box, vertices, 0, 0);
+
+		core::telemetry::Count(core::counter::bytesuploaded, static_cast<std::uint64_t>(m_slotVertices) * m_vertexStride);
+	}
+
+	void chunkbuffer::Bind(ID3D11DeviceContext *devcon)
+	{
+		UINT stride{ m_vertexStride }, offset{};
+
+		devcon->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
+		devcon->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+		core::telemetry::Count(core::counter::statechanges, 2);
+	}
+
+	UINT chunkbuffer::GetBaseVertex(UINT slot) const
+	{
+		return slot * m_slotVertices;
+	}
+
+	UINT64 chunkbuffer::GetSize() const
+	{
+		return static_cast<UINT64>(m_vertexStride) * m_slotVertices * m_slotCount + static_cast<UINT64>(sizeof(std::uint32_t)) * m_indexCount;
+	}
+}
@@ -0,0 +1,37 @@
+// chunkbuffer.h : include file for GPU storage of equally sized chunk meshes
+// A chunkbuffer is one static vertex buffer cut into slots of the same number of vertices
+// and one static index buffer that the meshes of all slots are drawn with.
+// Streamed meshes are uploaded into their slot with UpdateSubresource when they arrive and draw
+// with the first vertex of the slot as base vertex. The terrain keeps its chunks in one, see terrain.h.
+#pragma once
+
+#include <d3d11.h>
+#include <cstdint>
+
+namespace graphics
+{
+	class chunkbuffer
+	{
+	public:
+		chunkbuffer() = delete;
+		chunkbuffer(ID3D11Device *dev, UINT vertexStride, UINT slotVertices, UINT slotCount, const std::uint32_t *indices, UINT indexCount);
+		chunkbuffer(const chunkbuffer& other) = delete;
+		~chunkbuffer();
+
+		chunkbuffer& operator=(const chunkbuffer& other) = delete;
+
+		// Upload replaces the slotVertices vertices of the slot.
+		void Upload(ID3D11DeviceContext *devcon, UINT slot, const void *vertices);
+		// Bind puts the vertex and index buffers on the input assembler.
+		void Bind(ID3D11DeviceContext *devcon);
+
+		UINT GetBaseVertex(UINT slot) const;
+	private:
+		UINT64 GetSize() const;
+
+		ID3D11Buffer *m_vertexBuffer{}, *m_indexBuffer{};
+		UINT m_vertexStride{};
+		UINT m_slotVertices{}, m_slotCount{};
+		UINT m_indexCount{};
+	};
+}
@@ -35,10 +35,12 @@ struct VertexInputType
     float4 color : COLOR;
 };
 
+// The view space position is only read by the clustered pixel shader, the color pixel shader takes the first two.
 struct PixelInputType
 {
     float4 position : SV_POSITION;
     float4 color : COLOR;
+    float3 viewPosition : TEXCOORD0;
 };
 
 // The input to the vertex shader must match the data format in the vertex buffer
@@ -64,6 +66,7 @@ PixelInputType ColorVertexShader(VertexInputType input)
     // Calculate the position of the vertex against the world, view, and projection matrices.
     output.position = mul(input.position, worldMatrix);
     output.position = mul(output.position, viewMatrix);
+    output.viewPosition = output.position.xyz;
     output.position = mul(output.position, projectionMatrix);
     
     // Store the input color for the pixel shader to use.
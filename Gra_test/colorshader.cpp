@@ -1,10 +1,14 @@
 #include "stdafx.h"
 #include "colorshader.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include "telemetry.h"
 
 namespace graphics
 {
 	WCHAR psPath[] = L"color.ps";
 	WCHAR vsPath[] = L"color.vs";
+	WCHAR clusteredPsPath[] = L"clustered.ps";
 
 	colorshader::colorshader(ID3D11Device *dev, HWND hWnd)
 	{
@@ -17,6 +21,8 @@ namespace graphics
 
 	colorshader::~colorshader()
 	{
+		core::memorytracker::Freed(core::memorytag::shaders, m_trackedBytes);
+
 		// Release the matrix constant buffer.
 		if (m_matrixBuffer)
 		{
@@ -31,7 +37,13 @@ namespace graphics
 			m_layout = nullptr;
 		}
 
-		// Release the pixel shader.
+		// Release the pixel shaders.
+		if (m_clusteredPixelShader)
+		{
+			m_clusteredPixelShader->Release();
+			m_clusteredPixelShader = nullptr;
+		}
+
 		if (m_pixelShader)
 		{
 			m_pixelShader->Release();
@@ -51,9 +63,11 @@ namespace graphics
 	// using the HLSL shader.
 	bool colorshader::Render(ID3D11DeviceContext *devcon,
 		int indexcnt,
-		D3DXMATRIX wordlmatrix,
-		D3DXMATRIX viewmatrix,
-		D3DXMATRIX projectionmatrix)
+		int startindex,
+		int basevertex,
+		const D3DXMATRIX& wordlmatrix,
+		const D3DXMATRIX& viewmatrix,
+		const D3DXMATRIX& projectionmatrix)
 	{
 		// Set the shader parameters that it will use for rendering.
 		if (!SetShaderParameters(devcon, wordlmatrix, viewmatrix, projectionmatrix))
@@ -62,11 +76,36 @@ namespace graphics
 		}
 
 		// Now render the prepared buffers with the shader.
-		RenderShader(devcon, indexcnt);
+		RenderShader(devcon, indexcnt, startindex, basevertex);
+
+		return true;
+	}
+
+	bool colorshader::RenderVertices(ID3D11DeviceContext *devcon,
+		int vertexcnt,
+		int startvertex,
+		const D3DXMATRIX& wordlmatrix,
+		const D3DXMATRIX& viewmatrix,
+		const D3DXMATRIX& projectionmatrix)
+	{
+		if (!SetShaderParameters(devcon, wordlmatrix, viewmatrix, projectionmatrix))
+		{
+			return false;
+		}
+
+		SetShaders(devcon);
+		devcon->Draw(vertexcnt, startvertex);
+
+		core::telemetry::Count(core::counter::drawcalls, 1);
 
 		return true;
 	}
 
+	void colorshader::SetLighting(bool clustered)
+	{
+		m_clustered = clustered;
+	}
+
 	// NOTE: One of the most important functions
 	// This function is what actually loads the shader files and makes it usable to DirectX and the GPU.
 	// It also does the setup of the layout and how the vertex buffer data is going
@@ -79,6 +118,7 @@ namespace graphics
 		ID3D10Blob* errorMessage;
 		ID3D10Blob* vertexShaderBuffer;
 		ID3D10Blob* pixelShaderBuffer;
+		ID3D10Blob* clusteredShaderBuffer;
 		D3D11_INPUT_ELEMENT_DESC polygonLayout[2];
 		UINT numElements;
 		D3D11_BUFFER_DESC matrixBufferDesc;
@@ -87,6 +127,7 @@ namespace graphics
 		errorMessage = 0;
 		vertexShaderBuffer = 0;
 		pixelShaderBuffer = 0;
+		clusteredShaderBuffer = 0;
 
 		// Here is where the shader programs are compiled into buffers.
 		// The names are given to the shader file, the name of the shader,
@@ -134,6 +175,23 @@ namespace graphics
 			return false;
 		}
 
+		// The clustered pixel shader is compiled the same way.
+		result = D3DX11CompileFromFile(clusteredPsPath, NULL, NULL, "ClusteredPixelShader", "ps_5_0", D3D10_SHADER_ENABLE_STRICTNESS, 0, NULL,
+			&clusteredShaderBuffer, &errorMessage, NULL);
+		if (FAILED(result))
+		{
+			if (errorMessage)
+			{
+				OutputShaderErrorMessage(errorMessage, hWnd, clusteredPsPath);
+			}
+			else
+			{
+				MessageBox(hWnd, clusteredPsPath, L"Missing Shader File", MB_OK);
+			}
+
+			return false;
+		}
+
 		// Once the vertex shader and pixel shader code has successfully compiled into buffers
 		// the buffers can be used to create the shader objects themselves.
 		// Pointers to interface will be used with the vertex and pixel shader.
@@ -152,6 +210,12 @@ namespace graphics
 			return false;
 		}
 
+		result = dev->CreatePixelShader(clusteredShaderBuffer->GetBufferPointer(), clusteredShaderBuffer->GetBufferSize(), NULL, &m_clusteredPixelShader);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
 		// The next step is to create the layout of the vertex data that will be processed by the shader.
 		// As this shader uses a position and color vector we need to create both
 		// in the layout specifying the size of both.
@@ -201,6 +265,10 @@ namespace graphics
 			return false;
 		}
 
+		// The driver keeps its own copy of the byte code for as long as the shaders live,
+		// the blob sizes are what the memory tracker counts for them.
+		Track(vertexShaderBuffer->GetBufferSize() + pixelShaderBuffer->GetBufferSize() + clusteredShaderBuffer->GetBufferSize());
+
 		// Release the vertex shader buffer and pixel shader buffer since they are no longer needed.
 		vertexShaderBuffer->Release();
 		vertexShaderBuffer = 0;
@@ -208,6 +276,9 @@ namespace graphics
 		pixelShaderBuffer->Release();
 		pixelShaderBuffer = 0;
 
+		clusteredShaderBuffer->Release();
+		clusteredShaderBuffer = 0;
+
 		// The final thing that needs to be setup to utilize the shader is the constant buffer.
 		// For now there is just one constant buffer so we only need to setup one here
 		// so we can interface with the shader.
@@ -232,10 +303,17 @@ namespace graphics
 		{
 			return false;
 		}
+		Track(matrixBufferDesc.ByteWidth);
 
 		return true;
 	}
 
+	void colorshader::Track(UINT64 bytes)
+	{
+		core::memorytracker::Allocated(core::memorytag::shaders, bytes);
+		m_trackedBytes += bytes;
+	}
+
 	// The OutputShaderErrorMessage writes out error messages that are generating when compiling
 	// either vertex shaders or pixel shaders.
 	void colorshader::OutputShaderErrorMessage(ID3D10Blob *errorMessage, HWND hWnd, WCHAR *path)
@@ -276,20 +354,15 @@ namespace graphics
 	// after which this function is called to send them from there into the vertex shader
 	// during the Render function call.
 	bool colorshader::SetShaderParameters(ID3D11DeviceContext *devcon,
-		D3DXMATRIX worldMatrix,
-		D3DXMATRIX viewMatrix,
-		D3DXMATRIX projectionMatrix)
+		const D3DXMATRIX& worldMatrix,
+		const D3DXMATRIX& viewMatrix,
+		const D3DXMATRIX& projectionMatrix)
 	{
 		HRESULT result;
 		D3D11_MAPPED_SUBRESOURCE mappedResource;
 		MatrixBufferType* dataPtr;
 		UINT bufferNumber;
-
-		// Make sure to transpose matrices before sending them into the shader, this is a requirement for DirectX 11.
-		// Transpose the matrices to prepare them for the shader.
-		D3DXMatrixTranspose(&worldMatrix, &worldMatrix);
-		D3DXMatrixTranspose(&viewMatrix, &viewMatrix);
-		D3DXMatrixTranspose(&projectionMatrix, &projectionMatrix);
+		PROFILE_SCOPE("colorshader::SetShaderParameters");
 
 		// Lock the m_matrixBuffer, set the new matrices inside it, and then unlock it.
 		// Lock the constant buffer so it can be written to.
@@ -302,10 +375,9 @@ namespace graphics
 		// Get a pointer to the data in the constant buffer.
 		dataPtr = (MatrixBufferType*)mappedResource.pData;
 
-		// Copy the matrices into the constant buffer.
-		dataPtr->world = worldMatrix;
-		dataPtr->view = viewMatrix;
-		dataPtr->projection = projectionMatrix;
+		// Make sure to transpose matrices before sending them into the shader, this is a requirement for DirectX 11.
+		// The transposed matrices are written straight into the constant buffer.
+		PackMatrixBuffer(*dataPtr, worldMatrix, viewMatrix, projectionMatrix);
 
 		// Unlock the constant buffer.
 		devcon->Unmap(m_matrixBuffer, 0);
@@ -317,6 +389,9 @@ namespace graphics
 		// Finanly set the constant buffer in the vertex shader with the updated values.
 		devcon->VSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
 
+		core::telemetry::Count(core::counter::bytesuploaded, sizeof(MatrixBufferType));
+		core::telemetry::Count(core::counter::statechanges, 1);
+
 		return true;
 	}
 
@@ -325,16 +400,27 @@ namespace graphics
 	// The second step is to set the vertex shader and pixel shader to render this vertex buffer.
 	// Once the shaders are set the triangle is rendered by calling the DrawIndexed DirectX 11 function
 	// using the D3D device context. Once this function is called it will render the green triangle.
-	void colorshader::RenderShader(ID3D11DeviceContext *devcon, int indexcnt)
+	// The start index and base vertex offsets select the model's range inside the bound mesh heap page.
+	void colorshader::RenderShader(ID3D11DeviceContext *devcon, int indexcnt, int startindex, int basevertex)
+	{
+		SetShaders(devcon);
+
+		// Render the triangle.
+		devcon->DrawIndexed(indexcnt, startindex, basevertex);
+
+		core::telemetry::Count(core::counter::drawcalls, 1);
+		core::telemetry::Count(core::counter::triangles, static_cast<std::uint64_t>(indexcnt / 3));
+	}
+
+	void colorshader::SetShaders(ID3D11DeviceContext *devcon)
 	{
 		// Set the vertex input layout.
 		devcon->IASetInputLayout(m_layout);
 
 		// Set the vertex and pixel shaders that will be used to render this triangle.
 		devcon->VSSetShader(m_vertexShader, NULL, 0);
-		devcon->PSSetShader(m_pixelShader, NULL, 0);
+		devcon->PSSetShader(m_clustered ? m_clusteredPixelShader : m_pixelShader, NULL, 0);
 
-		// Render the triangle.
-		devcon->DrawIndexed(indexcnt, 0, 0);
+		core::telemetry::Count(core::counter::statechanges, 3);
 	}
-}
\ No newline at end of file
+}
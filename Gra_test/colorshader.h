@@ -8,6 +8,7 @@
 #include <d3dx10math.h>
 #include <d3dx11async.h>
 #include <fstream>
+#include "shaderparameters.h"
 
 namespace graphics
 {
@@ -15,14 +16,8 @@ namespace graphics
 	{
 	private:
 
-		// This typedef must be exactly the same as the one in the vertex shader
-		// as the model data needs to match the typedefs in the shader for proper rendering.
-		struct MatrixBufferType
-		{
-			D3DXMATRIX world;
-			D3DXMATRIX view;
-			D3DXMATRIX projection;
-		};
+		// The layout of the matrix buffer is shared with the headless builds, see shaderparameters.h.
+		typedef matrixbuffer MatrixBufferType;
 	public:
 		colorshader(ID3D11Device *dev, HWND hWnd);
 		colorshader(const colorshader& other) = delete;
@@ -32,25 +27,47 @@ namespace graphics
 		colorshader& operator=(const colorshader& other) = delete;
 
 		// The render function sets the shader parameters and then draws the prepared model vertices using the shader.
+		// The start index and base vertex locate the model inside the shared mesh heap buffers.
 		bool Render(ID3D11DeviceContext *devcon,
 			int indexcnt,
-			D3DXMATRIX wordlmatrix,
-			D3DXMATRIX viewmatrix,
-			D3DXMATRIX projectionmatrix);
+			int startindex,
+			int basevertex,
+			const D3DXMATRIX& wordlmatrix,
+			const D3DXMATRIX& viewmatrix,
+			const D3DXMATRIX& projectionmatrix);
+		// RenderVertices draws vertexcnt vertices of the bound vertex buffer from startvertex on without indices,
+		// in whatever topology is set, like the point list of the particles.
+		bool RenderVertices(ID3D11DeviceContext *devcon,
+			int vertexcnt,
+			int startvertex,
+			const D3DXMATRIX& wordlmatrix,
+			const D3DXMATRIX& viewmatrix,
+			const D3DXMATRIX& projectionmatrix);
+
+		// SetLighting picks the pixel shader of the draws that follow: the clustered one lights the vertex color
+		// with the lights of the light buffer bound to the pixel shader (see lightbuffer.h), the color one does not.
+		// Point lists have no surface to light and are drawn without it.
+		void SetLighting(bool clustered);
 	private:
 		bool InitializeShader(ID3D11Device *dev, HWND hWnd);
 		void OutputShaderErrorMessage(ID3D10Blob *errorMessage, HWND hWnd, WCHAR *path);
 
 		bool SetShaderParameters(ID3D11DeviceContext *devcon,
-			D3DXMATRIX worldMatrix,
-			D3DXMATRIX viewMatrix,
-			D3DXMATRIX projectionMatrix);
-		void RenderShader(ID3D11DeviceContext *devcon, int indexcnt);
+			const D3DXMATRIX& worldMatrix,
+			const D3DXMATRIX& viewMatrix,
+			const D3DXMATRIX& projectionMatrix);
+		void RenderShader(ID3D11DeviceContext *devcon, int indexcnt, int startindex, int basevertex);
+		void SetShaders(ID3D11DeviceContext *devcon);
+		void Track(UINT64 bytes);
 	private:
 		ID3D11VertexShader* m_vertexShader{};
 		ID3D11PixelShader* m_pixelShader{};
+		ID3D11PixelShader* m_clusteredPixelShader{};
+		bool m_clustered{};
 		ID3D11InputLayout* m_layout{};
 		ID3D11Buffer* m_matrixBuffer{};
+		// Bytes reported to the memory tracker, given back when the shader is destroyed.
+		UINT64 m_trackedBytes{};
 	};
 }
 
@@ -1,5 +1,8 @@
 #include "stdafx.h"
 #include "d3d.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include <algorithm>
 #include <exception>
 
 namespace graphics
@@ -30,11 +33,8 @@ namespace graphics
 		DXGI_ADAPTER_DESC adapterDesc{};
 		D3D_FEATURE_LEVEL featureLevel{};
 		ID3D11Texture2D* backBufferPtr{};
-		D3D11_TEXTURE2D_DESC depthBufferDesc{};
 		D3D11_DEPTH_STENCIL_DESC depthStencilDesc{};
-		D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc{};
 		D3D11_RASTERIZER_DESC rasterDesc{};
-		float fieldOfView{}, screenAspect{};
 
 		// Create a DirectX graphics interface factory.
 		result = CreateDXGIFactory(__uuidof(IDXGIFactory), (void**)&factory);
@@ -219,72 +219,25 @@ namespace graphics
 			throw "Swap chain create failure.";
 		}
 
-		// get the address of the back buffer
-		ID3D11Texture2D *pBackBuffer;
-		result = swapchain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&pBackBuffer);
-
-		if (FAILED(result))
-		{
-			cleanup(d3delems::devicecontext);
-			throw "Back buffer init failed.";
-		}
+		screennear = screenNear;
+		screendepth = screenDepth;
+		screenwidth = static_cast<UINT>(screenWidth);
+		screenheight = static_cast<UINT>(screenHeight);
+		renderwidth = screenwidth;
+		renderheight = screenheight;
 
-		// use the back buffer address to create the render target
-		result = dev->CreateRenderTargetView(pBackBuffer, NULL, &backbuffer);
-		if (FAILED(result))
+		// The back buffer is only drawn into by the upscale pass at the end of the frame.
+		if (!CreateBackBufferTarget())
 		{
 			cleanup(d3delems::devicecontext);
 			throw "Render target create failed.";
 		}
 
-		pBackBuffer->Release();
-
-		// set the render target as the back buffer
-		devcon->OMSetRenderTargets(1, &backbuffer, NULL);
-
-		// The viewport also needs to be setup so that Direct3D can map clip space coordinates to the render target space. 
-		// Set this to be the entire size of the window.
-
-		// Set the viewport
-		D3D11_VIEWPORT viewport{};
-		ZeroMemory(&viewport, sizeof(D3D11_VIEWPORT));
-
-		viewport.TopLeftX = 0.0f;
-		viewport.TopLeftY = 0.0f;
-		viewport.MinDepth = 0.0f;
-		viewport.MaxDepth = 1.0f;
-		viewport.Width = static_cast<FLOAT>(screenWidth);
-		viewport.Height = static_cast<FLOAT>(screenHeight);
-
-		devcon->RSSetViewports(1, &viewport);
-
-		// We will also need to set up a depth buffer description.
-		// We'll use this to create a depth buffer so that our polygons can be rendered properly in 3D space.
-		// At the same time we will attach a stencil buffer to our depth buffer.
-		// The stencil buffer can be used to achieve effects such as motion blur, volumetric shadows, and other things.
-		
-		// Initialize the description of the depth buffer.
-		ZeroMemory(&depthBufferDesc, sizeof(depthBufferDesc));
-
-		// Set up the description of the depth buffer.
-		depthBufferDesc.Width = screenWidth;
-		depthBufferDesc.Height = screenHeight;
-		depthBufferDesc.MipLevels = 1;
-		depthBufferDesc.ArraySize = 1;
-		depthBufferDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-		depthBufferDesc.SampleDesc.Count = 1;
-		depthBufferDesc.SampleDesc.Quality = 0;
-		depthBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-		depthBufferDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-		depthBufferDesc.CPUAccessFlags = 0;
-		depthBufferDesc.MiscFlags = 0;
-
-		// Create the texture for the depth buffer using the filled out description.
-		result = dev->CreateTexture2D(&depthBufferDesc, NULL, &depthstencilbuffer);
-		if (FAILED(result))
+		// The scene is drawn into the scene target and its depth buffer, both as large as the window for now.
+		if (!CreateSceneTargets(screenwidth, screenheight))
 		{
-			cleanup(d3delems::backbuffer);
-			throw "Unable to create depth stencil buffer.";
+			cleanup(d3delems::scenetargets);
+			throw "Unable to create the scene targets.";
 		}
 
 		// Now we need to setup the depth stencil description.
@@ -317,38 +270,13 @@ namespace graphics
 		result = dev->CreateDepthStencilState(&depthStencilDesc, &depthstencilstate);
 		if (FAILED(result))
 		{
-			cleanup(d3delems::depthstencilbuffer);
+			cleanup(d3delems::scenetargets);
 			throw "Unable to create depth stencil state.";
 		}
 
 		// Set the depth stencil state.
 		devcon->OMSetDepthStencilState(depthstencilstate, 1);
 
-		// Creating depth stencil description 
-		// so that Direct3D knows to use the depth buffer as a depth stencil texture.
-
-		// Initailze the depth stencil view.
-		ZeroMemory(&depthStencilViewDesc, sizeof(depthStencilViewDesc));
-
-		// Set up the depth stencil view description.
-		depthStencilViewDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-		depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-		depthStencilViewDesc.Texture2D.MipSlice = 0;
-
-		// Create the depth stencil view.
-		result = dev->CreateDepthStencilView(depthstencilbuffer, &depthStencilViewDesc, &depthstencilview);
-		if (FAILED(result))
-		{
-			cleanup(d3delems::depthstencilstate);
-			throw "Unable to create depth stencil view.";
-		}
-
-		// OMSetRenderTargets will bind the render target view and the depth stencil buffer to the output render pipeline.
-		// This way the graphics that the pipeline renders will get drawn to the back buffer.
-
-		// Bind the render target view and depth stencil buffer to the output render pipeline.
-		devcon->OMSetRenderTargets(1, &backbuffer, depthstencilview);
-
 		// Creating rasterizer state.
 		// It will give the control over how polygons are rendered.
 		// We can do things like make our scenes render in wireframe mode or have DirectX draw both the front and back faces of polygons. 
@@ -371,23 +299,14 @@ namespace graphics
 		result = dev->CreateRasterizerState(&rasterDesc, &rasterstate);
 		if (FAILED(result))
 		{
-			cleanup(d3delems::depthstencilview);
+			cleanup(d3delems::depthstencilstate);
 			throw "Unable to create rasterizer state.";
 		}
 
 		// Now set the rasterizer state.
 		devcon->RSSetState(rasterstate);
 
-		// Creating projection matrix.
-		// The projection matrix is used to translate the 3D scene into the 2D viewport space.
-		// Keeping the copy of this matrix so that it can be passed to shaders that will be used to render the scenes.
-	
-		// Setup the projection matrix.
-		fieldOfView = static_cast<FLOAT>(D3DX_PI / 4.0f);
-		screenAspect = static_cast<FLOAT>(screenWidth) / static_cast<FLOAT>(screenHeight);
-
-		// Create the projection matrix for 3D rendering.
-		D3DXMatrixPerspectiveFovLH(&projectionmatrix, fieldOfView, screenAspect, screenNear, screenDepth);
+		CreateMatrices();
 
 		// Creating the world matrix.
 		// This matrix is used to convert the vertices of objects into vertices in the 3D scene.
@@ -397,6 +316,154 @@ namespace graphics
 
 		// Initialize the world matrix to the identity matrix.
 		D3DXMatrixIdentity(&worldmatrix);
+	}
+
+	// get the address of the back buffer and use it to create the render target
+	bool d3d::CreateBackBufferTarget()
+	{
+		ID3D11Texture2D *pBackBuffer;
+		HRESULT result = swapchain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&pBackBuffer);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		result = dev->CreateRenderTargetView(pBackBuffer, NULL, &backbuffer);
+		pBackBuffer->Release();
+		if (FAILED(result))
+		{
+			backbuffer = nullptr;
+			return false;
+		}
+
+		// The memory tracker gets estimated sizes of the render targets: 4 bytes per pixel and sample for every buffer,
+		// there is one back buffer without multisampling.
+		TrackRenderTarget(static_cast<UINT64>(screenwidth) * screenheight * 4);
+		return true;
+	}
+
+	// The scene target is a color texture that is drawn into and then read by the upscale pass.
+	bool d3d::CreateSceneTargets(UINT width, UINT height)
+	{
+		D3D11_TEXTURE2D_DESC sceneBufferDesc{};
+		D3D11_TEXTURE2D_DESC depthBufferDesc{};
+		D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc{};
+		HRESULT result;
+
+		sceneBufferDesc.Width = width;
+		sceneBufferDesc.Height = height;
+		sceneBufferDesc.MipLevels = 1;
+		sceneBufferDesc.ArraySize = 1;
+		sceneBufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		sceneBufferDesc.SampleDesc.Count = 1;
+		sceneBufferDesc.SampleDesc.Quality = 0;
+		sceneBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		sceneBufferDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+		result = dev->CreateTexture2D(&sceneBufferDesc, NULL, &scenebuffer);
+		if (SUCCEEDED(result))
+		{
+			result = dev->CreateRenderTargetView(scenebuffer, NULL, &scenetarget);
+		}
+		if (SUCCEEDED(result))
+		{
+			result = dev->CreateShaderResourceView(scenebuffer, NULL, &sceneview);
+		}
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		// We will also need to set up a depth buffer description.
+		// We'll use this to create a depth buffer so that our polygons can be rendered properly in 3D space.
+		// At the same time we will attach a stencil buffer to our depth buffer.
+		// The stencil buffer can be used to achieve effects such as motion blur, volumetric shadows, and other things.
+
+		// Set up the description of the depth buffer.
+		depthBufferDesc.Width = width;
+		depthBufferDesc.Height = height;
+		depthBufferDesc.MipLevels = 1;
+		depthBufferDesc.ArraySize = 1;
+		depthBufferDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		depthBufferDesc.SampleDesc.Count = 1;
+		depthBufferDesc.SampleDesc.Quality = 0;
+		depthBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		depthBufferDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+		depthBufferDesc.CPUAccessFlags = 0;
+		depthBufferDesc.MiscFlags = 0;
+
+		// Create the texture for the depth buffer using the filled out description.
+		result = dev->CreateTexture2D(&depthBufferDesc, NULL, &depthstencilbuffer);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		// Creating depth stencil description 
+		// so that Direct3D knows to use the depth buffer as a depth stencil texture.
+
+		// Set up the depth stencil view description.
+		depthStencilViewDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+		depthStencilViewDesc.Texture2D.MipSlice = 0;
+
+		// Create the depth stencil view.
+		result = dev->CreateDepthStencilView(depthstencilbuffer, &depthStencilViewDesc, &depthstencilview);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		scenewidth = width;
+		sceneheight = height;
+
+		// The color and the depth buffer, 4 bytes per pixel each.
+		TrackRenderTarget(static_cast<UINT64>(width) * height * 4 * 2);
+		return true;
+	}
+
+	// Releases whatever CreateSceneTargets got to create, so it is also used when it failed half way.
+	void d3d::ReleaseSceneTargets()
+	{
+		if (scenewidth)
+		{
+			UntrackRenderTarget(static_cast<UINT64>(scenewidth) * sceneheight * 4 * 2);
+			scenewidth = 0;
+			sceneheight = 0;
+		}
+
+		IUnknown **resources[] = { reinterpret_cast<IUnknown**>(&depthstencilview), reinterpret_cast<IUnknown**>(&depthstencilbuffer),
+			reinterpret_cast<IUnknown**>(&sceneview), reinterpret_cast<IUnknown**>(&scenetarget), reinterpret_cast<IUnknown**>(&scenebuffer) };
+		for (IUnknown **resource : resources)
+		{
+			if (*resource)
+			{
+				(*resource)->Release();
+				*resource = nullptr;
+			}
+		}
+	}
+
+	// Creating projection matrix.
+	// The projection matrix is used to translate the 3D scene into the 2D viewport space.
+	// Keeping the copy of this matrix so that it can be passed to shaders that will be used to render the scenes.
+	// It only depends on the aspect ratio of the window, not on the render size: the scene fills the same field of view
+	// with fewer pixels.
+	void d3d::CreateProjectionMatrix(D3DXMATRIX& projectionMatrix, UINT width, UINT height, float screenDepth, float screenNear)
+	{
+		float fieldOfView{}, screenAspect{};
+
+		// Setup the projection matrix.
+		fieldOfView = static_cast<FLOAT>(D3DX_PI / 4.0f);
+		screenAspect = static_cast<FLOAT>(width) / static_cast<FLOAT>(height);
+
+		// Create the projection matrix for 3D rendering.
+		D3DXMatrixPerspectiveFovLH(&projectionMatrix, fieldOfView, screenAspect, screenNear, screenDepth);
+	}
+
+	void d3d::CreateMatrices()
+	{
+		CreateProjectionMatrix(projectionmatrix, screenwidth, screenheight, screendepth, screennear);
 
 		// Creating ortographic matrix.
 		// This matrix is used for rendering 2D elements like user interfaces on the screen
@@ -404,10 +471,10 @@ namespace graphics
 
 		// Create an orthographic projection matrix for 2D rendering.
 		D3DXMatrixOrthoLH(&orthomatrix,
-			static_cast<FLOAT>(screenWidth),
-			static_cast<FLOAT>(screenHeight),
-			screenNear,
-			screenDepth);
+			static_cast<FLOAT>(screenwidth),
+			static_cast<FLOAT>(screenheight),
+			screennear,
+			screendepth);
 	}
 
 	void d3d::BeginScene(FLOAT red, FLOAT green, FLOAT blue, FLOAT alpha)
@@ -420,15 +487,56 @@ namespace graphics
 		color[2] = blue;
 		color[3] = alpha;
 
-		// Clear the back buffer.
-		devcon->ClearRenderTargetView(backbuffer, color);
+		// Bind the scene target and depth buffer to the output render pipeline.
+		devcon->OMSetRenderTargets(1, &scenetarget, depthstencilview);
+
+		// The viewport also needs to be setup so that Direct3D can map clip space coordinates to the render target space.
+		// It covers the render size, the top left part of the scene target.
+		D3D11_VIEWPORT viewport{};
+		viewport.TopLeftX = 0.0f;
+		viewport.TopLeftY = 0.0f;
+		viewport.MinDepth = 0.0f;
+		viewport.MaxDepth = 1.0f;
+		viewport.Width = static_cast<FLOAT>(renderwidth);
+		viewport.Height = static_cast<FLOAT>(renderheight);
+		devcon->RSSetViewports(1, &viewport);
+
+		// Clear the scene target. The clears cover the whole target, which costs next to nothing next to the draws.
+		devcon->ClearRenderTargetView(scenetarget, color);
 
 		// Clear the depth buffer.
 		devcon->ClearDepthStencilView(depthstencilview, D3D11_CLEAR_DEPTH, 1.0f, 0);
 	}
 
+	void d3d::SetBackBufferTarget()
+	{
+		devcon->OMSetRenderTargets(1, &backbuffer, NULL);
+
+		D3D11_VIEWPORT viewport{};
+		viewport.MaxDepth = 1.0f;
+		viewport.Width = static_cast<FLOAT>(screenwidth);
+		viewport.Height = static_cast<FLOAT>(screenheight);
+		devcon->RSSetViewports(1, &viewport);
+	}
+
+	ID3D11ShaderResourceView* d3d::GetSceneView()
+	{
+		return sceneview;
+	}
+
+	// The limit is half a texel inside the drawn part, where the bilinear filter stops reaching past it.
+	void d3d::GetSceneRegion(upscalebuffer& region)
+	{
+		region.region[0] = static_cast<FLOAT>(renderwidth) / static_cast<FLOAT>(scenewidth);
+		region.region[1] = static_cast<FLOAT>(renderheight) / static_cast<FLOAT>(sceneheight);
+		region.limit[0] = (static_cast<FLOAT>(renderwidth) - 0.5f) / static_cast<FLOAT>(scenewidth);
+		region.limit[1] = (static_cast<FLOAT>(renderheight) - 0.5f) / static_cast<FLOAT>(sceneheight);
+	}
+
 	void d3d::EndScene()
 	{
+		PROFILE_SCOPE("d3d::Present");
+
 		// Present the back buffer to the screen since rendering is complete.
 		if (vsyncflag)
 		{
@@ -442,6 +550,59 @@ namespace graphics
 		}
 	}
 
+	// Every view of the back buffer has to be released before the swap chain can resize it.
+	// Shrinking keeps the scene target, growing past it creates it again at the new size,
+	// so dragging the window's border does not reallocate it on every step the window gets smaller.
+	bool d3d::Resize(UINT width, UINT height)
+	{
+		if (width == 0 or height == 0)
+		{
+			return false;
+		}
+		if (backbuffer and scenetarget and width == screenwidth and height == screenheight)
+		{
+			return true;
+		}
+
+		devcon->OMSetRenderTargets(0, NULL, NULL);
+		if (backbuffer)
+		{
+			backbuffer->Release();
+			backbuffer = nullptr;
+			UntrackRenderTarget(static_cast<UINT64>(screenwidth) * screenheight * 4);
+		}
+
+		screenwidth = width;
+		screenheight = height;
+		CreateMatrices();
+
+		HRESULT result = swapchain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, 0);
+		if (FAILED(result) or !CreateBackBufferTarget())
+		{
+			return false;
+		}
+
+		if (width > scenewidth or height > sceneheight)
+		{
+			UINT sceneWidth = (std::max)(width, scenewidth), sceneHeight = (std::max)(height, sceneheight);
+			ReleaseSceneTargets();
+			if (!CreateSceneTargets(sceneWidth, sceneHeight))
+			{
+				ReleaseSceneTargets();
+				return false;
+			}
+		}
+
+		SetRenderSize(renderwidth, renderheight);
+		return true;
+	}
+
+	void d3d::SetRenderSize(UINT width, UINT height)
+	{
+		renderwidth = (std::max)((std::min)(width, screenwidth), 1u);
+		renderheight = (std::max)((std::min)(height, screenheight), 1u);
+	}
+
 	ID3D11Device* d3d::getDevice()
 	{
 		return dev;
@@ -478,14 +639,16 @@ namespace graphics
 		case d3delems::all:
 		case d3delems::rasterstate:
 			rasterstate->Release();
-		case d3delems::depthstencilview:
-			depthstencilview->Release();
 		case d3delems::depthstencilstate:
 			depthstencilstate->Release();
-		case d3delems::depthstencilbuffer:
-			depthstencilbuffer->Release();
+		case d3delems::scenetargets:
+			ReleaseSceneTargets();
 		case d3delems::backbuffer:
-			backbuffer->Release();
+			// A failed resize leaves no back buffer behind.
+			if (backbuffer)
+			{
+				backbuffer->Release();
+			}
 		case d3delems::devicecontext:
 			devcon->Release();
 		case d3delems::device:
@@ -493,6 +656,22 @@ namespace graphics
 		case d3delems::swapchain:
 			swapchain->Release();
 		}
+
+		// The scene targets give back their own bytes when they are released, the rest goes here.
+		core::memorytracker::Freed(core::memorytag::rendertargets, rendertargetbytes);
+		rendertargetbytes = 0;
+	}
+
+	void d3d::TrackRenderTarget(UINT64 bytes)
+	{
+		core::memorytracker::Allocated(core::memorytag::rendertargets, bytes);
+		rendertargetbytes += bytes;
+	}
+
+	void d3d::UntrackRenderTarget(UINT64 bytes)
+	{
+		core::memorytracker::Freed(core::memorytag::rendertargets, bytes);
+		rendertargetbytes -= bytes;
 	}
 
 	d3d::~d3d()
@@ -1,4 +1,9 @@
 // d3d.h : include file for directx functionalities
+// The scene is not drawn into the back buffer but into the top left part of a scene target,
+// which is stretched over the back buffer before it is presented (see upscaler.h).
+// The part can be smaller than the window, that is how the dynamic resolution lowers the pixel count.
+// The scene target and its depth buffer are as large as the largest window so far and are only created again
+// when the window grows past them, a smaller render size or window reuses them as they are.
 #pragma once
 
 #include <dxgi.h>
@@ -6,6 +11,7 @@
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <d3dx10.h>
+#include "shaderparameters.h"
 
 // include the Direct3D Library file
 #pragma comment (lib, "dxgi.lib")
@@ -22,8 +28,8 @@ namespace graphics
 	public:
 		enum class d3delems : short
 		{
-			swapchain, device, devicecontext, backbuffer, depthstencilbuffer,
-			depthstencilstate, depthstencilview, rasterstate, all
+			swapchain, device, devicecontext, backbuffer, scenetargets,
+			depthstencilstate, rasterstate, all
 		};
 
 		d3d() = delete;
@@ -38,12 +44,27 @@ namespace graphics
 
 		// BeginScene will be called whenever we are going to draw a new 3D scene
 		// at the beginning of each frame.
-		// All it does is initializes the buffers so they are blank and ready to be drawn to.
+		// It initializes the scene target and the depth buffer so they are blank and ready to be drawn to
+		// and sets the viewport to the render size.
 		void BeginScene(FLOAT red, FLOAT green, FLOAT blue, FLOAT alpha);
 
+		// SetBackBufferTarget binds the back buffer over the whole window for the upscale pass,
+		// the scene target's view and the part of it that was drawn are what the pass reads.
+		void SetBackBufferTarget();
+		ID3D11ShaderResourceView* GetSceneView();
+		void GetSceneRegion(upscalebuffer& region);
+
 		// Endscene tells the swap chain to display the 3D scene
 		// once all the drawing has completed at the end of each frame.
 		void EndScene();
+
+		// Resize resizes the swap chain to the client area of the window after it changed size
+		// and grows the scene target when it is no longer large enough. The projection and ortho matrices
+		// follow the new aspect ratio. It returns false when the buffers could not be resized,
+		// it can be called again for the same size to retry.
+		// SetRenderSize sets the part of the scene target the next scene is drawn into, at most the window size.
+		bool Resize(UINT width, UINT height);
+		void SetRenderSize(UINT width, UINT height);
 		ID3D11Device* getDevice();
 		ID3D11DeviceContext* GetDeviceContext();
 
@@ -52,15 +73,33 @@ namespace graphics
 		void GetProjectionMatrix(D3DXMATRIX& projectionMatrix);
 		void GetWorldMatrix(D3DXMATRIX& worldMatrix);
 		void GetOrthoMatrix(D3DXMATRIX& orthoMatrix);
+
+		// The projection matrix of a window of the given size, for the side that needs it before the render thread
+		// has resized the buffers.
+		static void CreateProjectionMatrix(D3DXMATRIX& projectionMatrix, UINT width, UINT height, float screenDepth, float screenNear);
 	private:
 		void cleanup(d3delems start);
+		bool CreateBackBufferTarget();
+		bool CreateSceneTargets(UINT width, UINT height);
+		void ReleaseSceneTargets();
+		void CreateMatrices();
+		void TrackRenderTarget(UINT64 bytes);
+		void UntrackRenderTarget(UINT64 bytes);
 		bool vsyncflag{};
+		float screennear{}, screendepth{};
+		UINT screenwidth{}, screenheight{};
+		UINT scenewidth{}, sceneheight{};
+		UINT renderwidth{}, renderheight{};
 		int videomemory{};
+		UINT64 rendertargetbytes{};
 		char videocarddesc[MAX_NAMESTRING];
 		IDXGISwapChain *swapchain{};             // the pointer to the swap chain interface
 		ID3D11Device *dev{};                     // the pointer to our Direct3D device interface
 		ID3D11DeviceContext *devcon{};           // the pointer to our Direct3D device context
 		ID3D11RenderTargetView *backbuffer{};    // the pointer to our back buffer
+		ID3D11Texture2D *scenebuffer{};
+		ID3D11RenderTargetView *scenetarget{};
+		ID3D11ShaderResourceView *sceneview{};
 		ID3D11Texture2D *depthstencilbuffer{};
 		ID3D11DepthStencilState *depthstencilstate{};
 		ID3D11DepthStencilView *depthstencilview{};
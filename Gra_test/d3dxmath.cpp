@@ -0,0 +1,245 @@
+#include "stdafx.h"
+#include "d3dxmath.h"
+
+// Only headless builds compile anything here, Windows builds link the D3DX library instead.
+#ifndef _WIN32
+#include <cmath>
+
+D3DXMATRIX& D3DXMATRIX::operator*=(const D3DXMATRIX& other)
+{
+	D3DXMatrixMultiply(this, this, &other);
+	return *this;
+}
+
+D3DXMATRIX D3DXMATRIX::operator*(const D3DXMATRIX& other) const
+{
+	D3DXMATRIX result;
+	D3DXMatrixMultiply(&result, this, &other);
+	return result;
+}
+
+bool D3DXMATRIX::operator==(const D3DXMATRIX& other) const
+{
+	for (UINT i = 0; i < 16; i++)
+	{
+		if (m[i / 4][i % 4] != other.m[i / 4][i % 4])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+FLOAT D3DXVec3Length(const D3DXVECTOR3 *v)
+{
+	return std::sqrt(D3DXVec3LengthSq(v));
+}
+
+FLOAT D3DXVec3LengthSq(const D3DXVECTOR3 *v)
+{
+	return v->x * v->x + v->y * v->y + v->z * v->z;
+}
+
+FLOAT D3DXVec3Dot(const D3DXVECTOR3 *v1, const D3DXVECTOR3 *v2)
+{
+	return v1->x * v2->x + v1->y * v2->y + v1->z * v2->z;
+}
+
+D3DXVECTOR3* D3DXVec3Cross(D3DXVECTOR3 *out, const D3DXVECTOR3 *v1, const D3DXVECTOR3 *v2)
+{
+	D3DXVECTOR3 result(v1->y * v2->z - v1->z * v2->y, v1->z * v2->x - v1->x * v2->z, v1->x * v2->y - v1->y * v2->x);
+	*out = result;
+	return out;
+}
+
+// A zero vector stays zero like it does in D3DX.
+D3DXVECTOR3* D3DXVec3Normalize(D3DXVECTOR3 *out, const D3DXVECTOR3 *v)
+{
+	FLOAT length = D3DXVec3Length(v);
+	*out = length > 0.0f ? *v / length : D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+	return out;
+}
+
+D3DXVECTOR3* D3DXVec3TransformCoord(D3DXVECTOR3 *out, const D3DXVECTOR3 *v, const D3DXMATRIX *m)
+{
+	FLOAT x = v->x * m->_11 + v->y * m->_21 + v->z * m->_31 + m->_41;
+	FLOAT y = v->x * m->_12 + v->y * m->_22 + v->z * m->_32 + m->_42;
+	FLOAT z = v->x * m->_13 + v->y * m->_23 + v->z * m->_33 + m->_43;
+	FLOAT w = v->x * m->_14 + v->y * m->_24 + v->z * m->_34 + m->_44;
+
+	*out = D3DXVECTOR3(x / w, y / w, z / w);
+	return out;
+}
+
+D3DXVECTOR3* D3DXVec3TransformNormal(D3DXVECTOR3 *out, const D3DXVECTOR3 *v, const D3DXMATRIX *m)
+{
+	FLOAT x = v->x * m->_11 + v->y * m->_21 + v->z * m->_31;
+	FLOAT y = v->x * m->_12 + v->y * m->_22 + v->z * m->_32;
+	FLOAT z = v->x * m->_13 + v->y * m->_23 + v->z * m->_33;
+
+	*out = D3DXVECTOR3(x, y, z);
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixIdentity(D3DXMATRIX *out)
+{
+	*out = D3DXMATRIX(1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+	return out;
+}
+
+// The result is built in a local first so out may be one of the inputs.
+D3DXMATRIX* D3DXMatrixMultiply(D3DXMATRIX *out, const D3DXMATRIX *m1, const D3DXMATRIX *m2)
+{
+	D3DXMATRIX result;
+
+	for (UINT row = 0; row < 4; row++)
+	{
+		for (UINT column = 0; column < 4; column++)
+		{
+			result.m[row][column] = m1->m[row][0] * m2->m[0][column] + m1->m[row][1] * m2->m[1][column]
+				+ m1->m[row][2] * m2->m[2][column] + m1->m[row][3] * m2->m[3][column];
+		}
+	}
+
+	*out = result;
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixTranspose(D3DXMATRIX *out, const D3DXMATRIX *m)
+{
+	D3DXMATRIX result;
+
+	for (UINT row = 0; row < 4; row++)
+	{
+		for (UINT column = 0; column < 4; column++)
+		{
+			result.m[row][column] = m->m[column][row];
+		}
+	}
+
+	*out = result;
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixScaling(D3DXMATRIX *out, FLOAT sx, FLOAT sy, FLOAT sz)
+{
+	D3DXMatrixIdentity(out);
+	out->_11 = sx;
+	out->_22 = sy;
+	out->_33 = sz;
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixTranslation(D3DXMATRIX *out, FLOAT x, FLOAT y, FLOAT z)
+{
+	D3DXMatrixIdentity(out);
+	out->_41 = x;
+	out->_42 = y;
+	out->_43 = z;
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixRotationX(D3DXMATRIX *out, FLOAT angle)
+{
+	FLOAT s = std::sin(angle), c = std::cos(angle);
+
+	D3DXMatrixIdentity(out);
+	out->_22 = c;
+	out->_23 = s;
+	out->_32 = -s;
+	out->_33 = c;
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixRotationY(D3DXMATRIX *out, FLOAT angle)
+{
+	FLOAT s = std::sin(angle), c = std::cos(angle);
+
+	D3DXMatrixIdentity(out);
+	out->_11 = c;
+	out->_13 = -s;
+	out->_31 = s;
+	out->_33 = c;
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixRotationZ(D3DXMATRIX *out, FLOAT angle)
+{
+	FLOAT s = std::sin(angle), c = std::cos(angle);
+
+	D3DXMatrixIdentity(out);
+	out->_11 = c;
+	out->_12 = s;
+	out->_21 = -s;
+	out->_22 = c;
+	return out;
+}
+
+// Roll about z first, then pitch about x, then yaw about y.
+D3DXMATRIX* D3DXMatrixRotationYawPitchRoll(D3DXMATRIX *out, FLOAT yaw, FLOAT pitch, FLOAT roll)
+{
+	D3DXMATRIX rotationX, rotationY, rotationZ;
+
+	D3DXMatrixRotationZ(&rotationZ, roll);
+	D3DXMatrixRotationX(&rotationX, pitch);
+	D3DXMatrixRotationY(&rotationY, yaw);
+
+	*out = rotationZ * rotationX * rotationY;
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixLookAtLH(D3DXMATRIX *out, const D3DXVECTOR3 *eye, const D3DXVECTOR3 *at, const D3DXVECTOR3 *up)
+{
+	D3DXVECTOR3 xaxis, yaxis, zaxis;
+
+	zaxis = *at - *eye;
+	D3DXVec3Normalize(&zaxis, &zaxis);
+	D3DXVec3Cross(&xaxis, up, &zaxis);
+	D3DXVec3Normalize(&xaxis, &xaxis);
+	D3DXVec3Cross(&yaxis, &zaxis, &xaxis);
+
+	*out = D3DXMATRIX(xaxis.x, yaxis.x, zaxis.x, 0.0f,
+		xaxis.y, yaxis.y, zaxis.y, 0.0f,
+		xaxis.z, yaxis.z, zaxis.z, 0.0f,
+		-D3DXVec3Dot(&xaxis, eye), -D3DXVec3Dot(&yaxis, eye), -D3DXVec3Dot(&zaxis, eye), 1.0f);
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixPerspectiveFovLH(D3DXMATRIX *out, FLOAT fovy, FLOAT aspect, FLOAT zn, FLOAT zf)
+{
+	FLOAT yScale = 1.0f / std::tan(fovy / 2.0f);
+	FLOAT xScale = yScale / aspect;
+
+	*out = D3DXMATRIX(xScale, 0.0f, 0.0f, 0.0f,
+		0.0f, yScale, 0.0f, 0.0f,
+		0.0f, 0.0f, zf / (zf - zn), 1.0f,
+		0.0f, 0.0f, -zn * zf / (zf - zn), 0.0f);
+	return out;
+}
+
+D3DXMATRIX* D3DXMatrixOrthoLH(D3DXMATRIX *out, FLOAT w, FLOAT h, FLOAT zn, FLOAT zf)
+{
+	*out = D3DXMATRIX(2.0f / w, 0.0f, 0.0f, 0.0f,
+		0.0f, 2.0f / h, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f / (zf - zn), 0.0f,
+		0.0f, 0.0f, zn / (zn - zf), 1.0f);
+	return out;
+}
+
+D3DXPLANE* D3DXPlaneNormalize(D3DXPLANE *out, const D3DXPLANE *p)
+{
+	FLOAT length = std::sqrt(p->a * p->a + p->b * p->b + p->c * p->c);
+	FLOAT scale = length > 0.0f ? 1.0f / length : 0.0f;
+
+	*out = D3DXPLANE(p->a * scale, p->b * scale, p->c * scale, p->d * scale);
+	return out;
+}
+
+FLOAT D3DXPlaneDotCoord(const D3DXPLANE *p, const D3DXVECTOR3 *v)
+{
+	return p->a * v->x + p->b * v->y + p->c * v->z + p->d;
+}
+#endif
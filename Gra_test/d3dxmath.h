@@ -0,0 +1,133 @@
+// d3dxmath.h : include file for the math types used by the device independent code
+// On Windows this is the D3DX math library of the DirectX SDK.
+// Everywhere else the subset of it the engine uses is declared here with the same names,
+// layouts and conventions (row vectors, left handed), so the camera, the scene systems
+// and the shader parameter packing build and give the same results in headless builds.
+#pragma once
+
+#ifdef _WIN32
+#include <d3dx10math.h>
+#else
+#include <cstdint>
+
+typedef float FLOAT;
+typedef int INT;
+typedef unsigned int UINT;
+typedef std::uint64_t UINT64;
+
+#define D3DX_PI 3.141592654f
+
+struct D3DXVECTOR2
+{
+	FLOAT x, y;
+
+	D3DXVECTOR2() {};
+	D3DXVECTOR2(FLOAT fx, FLOAT fy) : x(fx), y(fy) {};
+
+	D3DXVECTOR2 operator+(const D3DXVECTOR2& v) const { return D3DXVECTOR2(x + v.x, y + v.y); }
+	D3DXVECTOR2 operator-(const D3DXVECTOR2& v) const { return D3DXVECTOR2(x - v.x, y - v.y); }
+	D3DXVECTOR2 operator*(FLOAT f) const { return D3DXVECTOR2(x * f, y * f); }
+	bool operator==(const D3DXVECTOR2& v) const { return x == v.x and y == v.y; }
+	bool operator!=(const D3DXVECTOR2& v) const { return !(*this == v); }
+};
+
+struct D3DXVECTOR3
+{
+	FLOAT x, y, z;
+
+	D3DXVECTOR3() {};
+	D3DXVECTOR3(FLOAT fx, FLOAT fy, FLOAT fz) : x(fx), y(fy), z(fz) {};
+
+	D3DXVECTOR3& operator+=(const D3DXVECTOR3& v) { x += v.x; y += v.y; z += v.z; return *this; }
+	D3DXVECTOR3& operator-=(const D3DXVECTOR3& v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+	D3DXVECTOR3& operator*=(FLOAT f) { x *= f; y *= f; z *= f; return *this; }
+	D3DXVECTOR3& operator/=(FLOAT f) { return *this *= 1.0f / f; }
+
+	D3DXVECTOR3 operator-() const { return D3DXVECTOR3(-x, -y, -z); }
+	D3DXVECTOR3 operator+(const D3DXVECTOR3& v) const { return D3DXVECTOR3(x + v.x, y + v.y, z + v.z); }
+	D3DXVECTOR3 operator-(const D3DXVECTOR3& v) const { return D3DXVECTOR3(x - v.x, y - v.y, z - v.z); }
+	D3DXVECTOR3 operator*(FLOAT f) const { return D3DXVECTOR3(x * f, y * f, z * f); }
+	D3DXVECTOR3 operator/(FLOAT f) const { return *this * (1.0f / f); }
+	bool operator==(const D3DXVECTOR3& v) const { return x == v.x and y == v.y and z == v.z; }
+	bool operator!=(const D3DXVECTOR3& v) const { return !(*this == v); }
+};
+
+inline D3DXVECTOR3 operator*(FLOAT f, const D3DXVECTOR3& v) { return v * f; }
+
+struct D3DXVECTOR4
+{
+	FLOAT x, y, z, w;
+
+	D3DXVECTOR4() {};
+	D3DXVECTOR4(FLOAT fx, FLOAT fy, FLOAT fz, FLOAT fw) : x(fx), y(fy), z(fz), w(fw) {};
+
+	D3DXVECTOR4 operator+(const D3DXVECTOR4& v) const { return D3DXVECTOR4(x + v.x, y + v.y, z + v.z, w + v.w); }
+	D3DXVECTOR4 operator-(const D3DXVECTOR4& v) const { return D3DXVECTOR4(x - v.x, y - v.y, z - v.z, w - v.w); }
+	D3DXVECTOR4 operator*(FLOAT f) const { return D3DXVECTOR4(x * f, y * f, z * f, w * f); }
+	bool operator==(const D3DXVECTOR4& v) const { return x == v.x and y == v.y and z == v.z and w == v.w; }
+	bool operator!=(const D3DXVECTOR4& v) const { return !(*this == v); }
+};
+
+struct D3DXMATRIX
+{
+	union
+	{
+		struct
+		{
+			FLOAT _11, _12, _13, _14;
+			FLOAT _21, _22, _23, _24;
+			FLOAT _31, _32, _33, _34;
+			FLOAT _41, _42, _43, _44;
+		};
+		FLOAT m[4][4];
+	};
+
+	D3DXMATRIX() {};
+	D3DXMATRIX(FLOAT f11, FLOAT f12, FLOAT f13, FLOAT f14,
+		FLOAT f21, FLOAT f22, FLOAT f23, FLOAT f24,
+		FLOAT f31, FLOAT f32, FLOAT f33, FLOAT f34,
+		FLOAT f41, FLOAT f42, FLOAT f43, FLOAT f44) :
+		_11(f11), _12(f12), _13(f13), _14(f14), _21(f21), _22(f22), _23(f23), _24(f24),
+		_31(f31), _32(f32), _33(f33), _34(f34), _41(f41), _42(f42), _43(f43), _44(f44) {};
+
+	FLOAT& operator()(UINT row, UINT column) { return m[row][column]; }
+	FLOAT operator()(UINT row, UINT column) const { return m[row][column]; }
+
+	D3DXMATRIX& operator*=(const D3DXMATRIX& other);
+	D3DXMATRIX operator*(const D3DXMATRIX& other) const;
+	bool operator==(const D3DXMATRIX& other) const;
+	bool operator!=(const D3DXMATRIX& other) const { return !(*this == other); }
+};
+
+struct D3DXPLANE
+{
+	FLOAT a, b, c, d;
+
+	D3DXPLANE() {};
+	D3DXPLANE(FLOAT fa, FLOAT fb, FLOAT fc, FLOAT fd) : a(fa), b(fb), c(fc), d(fd) {};
+};
+
+FLOAT D3DXVec3Length(const D3DXVECTOR3 *v);
+FLOAT D3DXVec3LengthSq(const D3DXVECTOR3 *v);
+FLOAT D3DXVec3Dot(const D3DXVECTOR3 *v1, const D3DXVECTOR3 *v2);
+D3DXVECTOR3* D3DXVec3Cross(D3DXVECTOR3 *out, const D3DXVECTOR3 *v1, const D3DXVECTOR3 *v2);
+D3DXVECTOR3* D3DXVec3Normalize(D3DXVECTOR3 *out, const D3DXVECTOR3 *v);
+D3DXVECTOR3* D3DXVec3TransformCoord(D3DXVECTOR3 *out, const D3DXVECTOR3 *v, const D3DXMATRIX *m);
+D3DXVECTOR3* D3DXVec3TransformNormal(D3DXVECTOR3 *out, const D3DXVECTOR3 *v, const D3DXMATRIX *m);
+
+D3DXMATRIX* D3DXMatrixIdentity(D3DXMATRIX *out);
+D3DXMATRIX* D3DXMatrixMultiply(D3DXMATRIX *out, const D3DXMATRIX *m1, const D3DXMATRIX *m2);
+D3DXMATRIX* D3DXMatrixTranspose(D3DXMATRIX *out, const D3DXMATRIX *m);
+D3DXMATRIX* D3DXMatrixScaling(D3DXMATRIX *out, FLOAT sx, FLOAT sy, FLOAT sz);
+D3DXMATRIX* D3DXMatrixTranslation(D3DXMATRIX *out, FLOAT x, FLOAT y, FLOAT z);
+D3DXMATRIX* D3DXMatrixRotationX(D3DXMATRIX *out, FLOAT angle);
+D3DXMATRIX* D3DXMatrixRotationY(D3DXMATRIX *out, FLOAT angle);
+D3DXMATRIX* D3DXMatrixRotationZ(D3DXMATRIX *out, FLOAT angle);
+D3DXMATRIX* D3DXMatrixRotationYawPitchRoll(D3DXMATRIX *out, FLOAT yaw, FLOAT pitch, FLOAT roll);
+D3DXMATRIX* D3DXMatrixLookAtLH(D3DXMATRIX *out, const D3DXVECTOR3 *eye, const D3DXVECTOR3 *at, const D3DXVECTOR3 *up);
+D3DXMATRIX* D3DXMatrixPerspectiveFovLH(D3DXMATRIX *out, FLOAT fovy, FLOAT aspect, FLOAT zn, FLOAT zf);
+D3DXMATRIX* D3DXMatrixOrthoLH(D3DXMATRIX *out, FLOAT w, FLOAT h, FLOAT zn, FLOAT zf);
+
+D3DXPLANE* D3DXPlaneNormalize(D3DXPLANE *out, const D3DXPLANE *p);
+FLOAT D3DXPlaneDotCoord(const D3DXPLANE *p, const D3DXVECTOR3 *v);
+#endif
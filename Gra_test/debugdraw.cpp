@@ -0,0 +1,217 @@
+#include "stdafx.h"
+#include "debugdraw.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace graphics
+{
+	std::atomic<bool> debugdraw::s_enabled{};
+
+	namespace
+	{
+		// Only the owning thread adds to its buffer, the lock is only ever waited on while the buffer is collected.
+		struct threadlines
+		{
+			std::mutex mutex;
+			std::vector<colorvertex> vertices;
+		};
+
+		std::mutex g_threadsMutex;
+		std::vector<std::unique_ptr<threadlines>> g_threads;
+		std::atomic<UINT64> g_dropped{};
+		thread_local threadlines *t_lines{};
+
+		// The buffer of a thread is created the first time it draws and lives until the program ends,
+		// so lines drawn by a job worker are still collected after the worker has finished.
+		threadlines& ThreadLines()
+		{
+			if (!t_lines)
+			{
+				std::unique_ptr<threadlines> created(new threadlines());
+				created->vertices.reserve(1024);
+
+				std::lock_guard<std::mutex> lock(g_threadsMutex);
+				t_lines = created.get();
+				g_threads.push_back(std::move(created));
+			}
+			return *t_lines;
+		}
+
+		// A shape goes in whole or not at all.
+		void Append(const colorvertex *vertices, UINT count)
+		{
+			threadlines& lines = ThreadLines();
+			std::lock_guard<std::mutex> lock(lines.mutex);
+
+			if (lines.vertices.size() + count > DEBUG_DRAW_THREAD_VERTICES)
+			{
+				g_dropped.fetch_add(count / 2, std::memory_order_relaxed);
+				return;
+			}
+			lines.vertices.insert(lines.vertices.end(), vertices, vertices + count);
+		}
+
+		// The point where three planes meet, none of them parallel to another.
+		D3DXVECTOR3 Intersect(const D3DXPLANE& first, const D3DXPLANE& second, const D3DXPLANE& third)
+		{
+			D3DXVECTOR3 n1(first.a, first.b, first.c), n2(second.a, second.b, second.c), n3(third.a, third.b, third.c);
+			D3DXVECTOR3 c23, c31, c12;
+
+			D3DXVec3Cross(&c23, &n2, &n3);
+			D3DXVec3Cross(&c31, &n3, &n1);
+			D3DXVec3Cross(&c12, &n1, &n2);
+			FLOAT denominator = D3DXVec3Dot(&n1, &c23);
+
+			return (c23 * first.d + c31 * second.d + c12 * third.d) * (-1.0f / denominator);
+		}
+	}
+
+	void debugdraw::SetEnabled(bool enabled)
+	{
+		s_enabled.store(enabled);
+	}
+
+	// The planes are those culling uses (see scene::BuildDrawList), left, right, bottom, top, near and far.
+	void debugdraw::FrustumCorners(const D3DXMATRIX& viewProjection, D3DXVECTOR3 (&corners)[8])
+	{
+		const D3DXMATRIX& m = viewProjection;
+		D3DXPLANE planes[6];
+
+		planes[0] = D3DXPLANE(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);
+		planes[1] = D3DXPLANE(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);
+		planes[2] = D3DXPLANE(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);
+		planes[3] = D3DXPLANE(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);
+		planes[4] = D3DXPLANE(m._13, m._23, m._33, m._43);
+		planes[5] = D3DXPLANE(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43);
+
+		for (UINT i = 0; i < 8; i++)
+		{
+			corners[i] = Intersect(planes[i & 1], planes[2 + (i >> 1 & 1)], planes[4 + (i >> 2 & 1)]);
+		}
+	}
+
+	UINT debugdraw::GetVertexCount()
+	{
+		std::lock_guard<std::mutex> lock(g_threadsMutex);
+		size_t count = 0;
+
+		for (auto& lines : g_threads)
+		{
+			std::lock_guard<std::mutex> linesLock(lines->mutex);
+			count += lines->vertices.size();
+		}
+
+		return static_cast<UINT>(count);
+	}
+
+	UINT debugdraw::Collect(colorvertex *vertices, UINT maxVertices)
+	{
+		std::lock_guard<std::mutex> lock(g_threadsMutex);
+		UINT count = 0;
+
+		for (auto& lines : g_threads)
+		{
+			std::lock_guard<std::mutex> linesLock(lines->mutex);
+			UINT available = static_cast<UINT>(lines->vertices.size());
+			// Lines are never split, the room left is rounded down to whole ones.
+			UINT copied = (std::min)(available, (maxVertices - count) & ~1u);
+
+			if (copied)
+			{
+				std::memcpy(vertices + count, lines->vertices.data(), copied * sizeof(colorvertex));
+				count += copied;
+			}
+			if (copied < available)
+			{
+				g_dropped.fetch_add((available - copied) / 2, std::memory_order_relaxed);
+			}
+			lines->vertices.clear();
+		}
+
+		return count;
+	}
+
+	UINT64 debugdraw::GetDropped()
+	{
+		return g_dropped.load(std::memory_order_relaxed);
+	}
+
+	void debugdraw::AddLine(const D3DXVECTOR3& from, const D3DXVECTOR3& to, const D3DXVECTOR4& color)
+	{
+		colorvertex vertices[2] = { { from, color }, { to, color } };
+		Append(vertices, 2);
+	}
+
+	void debugdraw::AddBox(const D3DXVECTOR3& min, const D3DXVECTOR3& max, const D3DXMATRIX *world, const D3DXVECTOR4& color)
+	{
+		D3DXVECTOR3 corners[8];
+
+		for (UINT i = 0; i < 8; i++)
+		{
+			corners[i] = D3DXVECTOR3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+			if (world)
+			{
+				D3DXVec3TransformCoord(&corners[i], &corners[i], world);
+			}
+		}
+
+		AddCorners(corners, color);
+	}
+
+	// Three circles around the axes, enough to see the size of the sphere from any side.
+	void debugdraw::AddSphere(const D3DXVECTOR3& center, FLOAT radius, const D3DXVECTOR4& color)
+	{
+		colorvertex vertices[3 * DEBUG_DRAW_CIRCLE_SEGMENTS * 2];
+		UINT count = 0;
+
+		for (UINT segment = 0; segment < DEBUG_DRAW_CIRCLE_SEGMENTS; segment++)
+		{
+			FLOAT a0 = 6.2831853f * static_cast<FLOAT>(segment) / DEBUG_DRAW_CIRCLE_SEGMENTS;
+			FLOAT a1 = 6.2831853f * static_cast<FLOAT>(segment + 1) / DEBUG_DRAW_CIRCLE_SEGMENTS;
+			FLOAT c0 = radius * std::cos(a0), s0 = radius * std::sin(a0);
+			FLOAT c1 = radius * std::cos(a1), s1 = radius * std::sin(a1);
+
+			vertices[count++] = colorvertex{ center + D3DXVECTOR3(c0, s0, 0.0f), color };
+			vertices[count++] = colorvertex{ center + D3DXVECTOR3(c1, s1, 0.0f), color };
+			vertices[count++] = colorvertex{ center + D3DXVECTOR3(0.0f, c0, s0), color };
+			vertices[count++] = colorvertex{ center + D3DXVECTOR3(0.0f, c1, s1), color };
+			vertices[count++] = colorvertex{ center + D3DXVECTOR3(s0, 0.0f, c0), color };
+			vertices[count++] = colorvertex{ center + D3DXVECTOR3(s1, 0.0f, c1), color };
+		}
+
+		Append(vertices, count);
+	}
+
+	void debugdraw::AddFrustum(const D3DXMATRIX& viewProjection, const D3DXVECTOR4& color)
+	{
+		D3DXVECTOR3 corners[8];
+
+		FrustumCorners(viewProjection, corners);
+		AddCorners(corners, color);
+	}
+
+	// The twelve edges join the corners whose numbers differ in one bit.
+	void debugdraw::AddCorners(const D3DXVECTOR3 (&corners)[8], const D3DXVECTOR4& color)
+	{
+		colorvertex vertices[24];
+		UINT count = 0;
+
+		for (UINT i = 0; i < 8; i++)
+		{
+			for (UINT bit = 1; bit < 8; bit <<= 1)
+			{
+				if (!(i & bit))
+				{
+					vertices[count++] = colorvertex{ corners[i], color };
+					vertices[count++] = colorvertex{ corners[i | bit], color };
+				}
+			}
+		}
+
+		Append(vertices, count);
+	}
+}
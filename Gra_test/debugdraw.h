@@ -0,0 +1,89 @@
+// debugdraw.h : include file for immediate mode debug lines
+// Any thread can draw lines, boxes, spheres and frusta for one frame, to see bounds, BVH nodes or what a camera sees.
+// The lines go into a buffer owned by the calling thread, so threads never wait on each other while drawing.
+// Once per frame Collect moves the lines of all threads into the snapshot, where they are drawn as one line list
+// with the unlit color shader (see rendersnapshot.h). A line is drawn in the frame collected after it was added.
+// Drawing is switched on and off at runtime, while it is off a call costs one relaxed load.
+// Defining DEBUG_DRAW_DISABLED removes the calls from the build altogether.
+#pragma once
+
+#include <atomic>
+#include "meshdata.h"
+
+namespace graphics
+{
+	// The vertices a thread can hold until the next collection, lines past them are dropped.
+	constexpr UINT DEBUG_DRAW_THREAD_VERTICES{ 64 * 1024 };
+	// The segments of each of the three circles of a sphere.
+	constexpr UINT DEBUG_DRAW_CIRCLE_SEGMENTS{ 24 };
+
+	class debugdraw
+	{
+	public:
+		static void SetEnabled(bool enabled);
+#ifdef DEBUG_DRAW_DISABLED
+		static constexpr bool IsEnabled() { return false; }
+#else
+		static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+#endif
+
+		// Corners of boxes and frusta are numbered by their sides: the first bit is set for the right one,
+		// the second for the top and the third for the far one.
+		// The world matrix of Box turns the box into the oriented box of an instance.
+		// Frustum draws the frustum of a view and a projection matrix multiplied together.
+		static void Line(const D3DXVECTOR3& from, const D3DXVECTOR3& to, const D3DXVECTOR4& color)
+		{
+			if (IsEnabled())
+			{
+				AddLine(from, to, color);
+			}
+		}
+		static void Box(const D3DXVECTOR3& min, const D3DXVECTOR3& max, const D3DXVECTOR4& color)
+		{
+			if (IsEnabled())
+			{
+				AddBox(min, max, nullptr, color);
+			}
+		}
+		static void Box(const D3DXMATRIX& world, const D3DXVECTOR3& min, const D3DXVECTOR3& max, const D3DXVECTOR4& color)
+		{
+			if (IsEnabled())
+			{
+				AddBox(min, max, &world, color);
+			}
+		}
+		static void Sphere(const D3DXVECTOR3& center, FLOAT radius, const D3DXVECTOR4& color)
+		{
+			if (IsEnabled())
+			{
+				AddSphere(center, radius, color);
+			}
+		}
+		static void Frustum(const D3DXMATRIX& viewProjection, const D3DXVECTOR4& color)
+		{
+			if (IsEnabled())
+			{
+				AddFrustum(viewProjection, color);
+			}
+		}
+
+		// FrustumCorners finds the corners of a frustum as the points where three of its planes meet.
+		static void FrustumCorners(const D3DXMATRIX& viewProjection, D3DXVECTOR3 (&corners)[8]);
+
+		// GetVertexCount is what all threads hold together, two vertices per line.
+		// Collect copies up to maxVertices of them and empties the buffers of all threads, the lines
+		// that did not fit are dropped. It returns the number of vertices copied.
+		// GetDropped counts the lines dropped since the start.
+		static UINT GetVertexCount();
+		static UINT Collect(colorvertex *vertices, UINT maxVertices);
+		static UINT64 GetDropped();
+	private:
+		static void AddLine(const D3DXVECTOR3& from, const D3DXVECTOR3& to, const D3DXVECTOR4& color);
+		static void AddBox(const D3DXVECTOR3& min, const D3DXVECTOR3& max, const D3DXMATRIX *world, const D3DXVECTOR4& color);
+		static void AddSphere(const D3DXVECTOR3& center, FLOAT radius, const D3DXVECTOR4& color);
+		static void AddFrustum(const D3DXMATRIX& viewProjection, const D3DXVECTOR4& color);
+		static void AddCorners(const D3DXVECTOR3 (&corners)[8], const D3DXVECTOR4& color);
+
+		static std::atomic<bool> s_enabled;
+	};
+}
@@ -0,0 +1,194 @@
+#include "stdafx.h"
+#include "dynamicbuffer.h"
+#include "memorytracker.h"
+#include "telemetry.h"
+
+namespace graphics
+{
+	dynamicbuffer::dynamicbuffer(ID3D11Device *dev, UINT size, UINT bindFlags) :
+		m_ring(size)
+	{
+		D3D11_BUFFER_DESC bufferDesc{};
+		D3D11_QUERY_DESC queryDesc{};
+		HRESULT result;
+
+		// The buffer has to be dynamic with CPU write access so it can be mapped every frame.
+		bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		bufferDesc.ByteWidth = size;
+		bufferDesc.BindFlags = bindFlags;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bufferDesc.MiscFlags = 0;
+		bufferDesc.StructureByteStride = 0;
+
+		result = dev->CreateBuffer(&bufferDesc, NULL, &m_buffer);
+		if (FAILED(result))
+		{
+			throw "Unable to create dynamic buffer.";
+		}
+
+		// An event query is signaled once the GPU has processed every command issued before it,
+		// which is exactly what a per-frame fence needs.
+		queryDesc.Query = D3D11_QUERY_EVENT;
+		queryDesc.MiscFlags = 0;
+
+		for (UINT i = 0; i < DYNAMICBUFFER_FRAMES_IN_FLIGHT; i++)
+		{
+			result = dev->CreateQuery(&queryDesc, &m_fences[i]);
+			if (FAILED(result))
+			{
+				for (UINT j = 0; j < i; j++)
+				{
+					m_fences[j]->Release();
+					m_fences[j] = nullptr;
+				}
+				m_buffer->Release();
+				m_buffer = nullptr;
+				throw "Unable to create dynamic buffer fences.";
+			}
+		}
+
+		// Start with an eighth of the buffer as the expected size of a frame.
+		m_reserve = size / 8;
+		core::memorytracker::Allocated(core::memorytag::dynamicgeometry, size);
+	}
+
+	dynamicbuffer::~dynamicbuffer()
+	{
+		for (UINT i = 0; i < DYNAMICBUFFER_FRAMES_IN_FLIGHT; i++)
+		{
+			if (m_fences[i])
+			{
+				m_fences[i]->Release();
+				m_fences[i] = nullptr;
+			}
+		}
+
+		if (m_buffer)
+		{
+			core::memorytracker::Freed(core::memorytag::dynamicgeometry, m_ring.GetSize());
+			m_buffer->Release();
+			m_buffer = nullptr;
+		}
+	}
+
+	// Fences are checked from the oldest frame on and checking stops at the first one not signaled,
+	// the GPU finishes frames in order so the newer ones cannot be done either.
+	// When all fence slots are taken the oldest frame is waited for, which bounds
+	// how far the CPU can run ahead of the GPU.
+	void dynamicbuffer::PollFences(ID3D11DeviceContext *devcon)
+	{
+		while (m_completedFrame + 1 < m_frame)
+		{
+			UINT64 frame = m_completedFrame + 1;
+			ID3D11Query *fence = m_fences[frame % DYNAMICBUFFER_FRAMES_IN_FLIGHT];
+			bool mustWait = m_frame - frame >= DYNAMICBUFFER_FRAMES_IN_FLIGHT;
+			BOOL done{};
+
+			HRESULT result = devcon->GetData(fence, &done, sizeof(done), mustWait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+			if (result == S_OK and done)
+			{
+				m_completedFrame = frame;
+			}
+			else if (!mustWait)
+			{
+				break;
+			}
+			else if (FAILED(result))
+			{
+				// A lost device will never signal, treat the frame as finished so the loop cannot hang.
+				m_completedFrame = frame;
+			}
+		}
+	}
+
+	bool dynamicbuffer::BeginFrame(ID3D11DeviceContext *devcon)
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT result;
+		bool wrapped;
+
+		// The fence of the previous frame goes in now, after the draw calls that read its data.
+		if (m_frame > 0)
+		{
+			devcon->End(m_fences[m_frame % DYNAMICBUFFER_FRAMES_IN_FLIGHT]);
+		}
+
+		m_frame++;
+		PollFences(devcon);
+
+		// The first map of the buffer and every wrap discard the contents,
+		// otherwise the frame appends behind the data the GPU may still read.
+		wrapped = m_ring.BeginFrame(m_frame, m_completedFrame, m_reserve);
+		if (m_frame == 1)
+		{
+			wrapped = true;
+		}
+
+		result = devcon->Map(m_buffer, 0, wrapped ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mappedResource);
+		if (FAILED(result))
+		{
+			m_mapped = nullptr;
+			return false;
+		}
+
+		m_mapped = static_cast<BYTE*>(mappedResource.pData);
+		return true;
+	}
+
+	dynamicbuffer::allocation dynamicbuffer::Allocate(UINT size, UINT alignment)
+	{
+		allocation alloc{};
+
+		if (!m_mapped)
+		{
+			return alloc;
+		}
+
+		UINT offset = m_ring.Allocate(size, alignment);
+		if (offset == ringallocator::NO_SPACE)
+		{
+			return alloc;
+		}
+
+		alloc.data = m_mapped + offset;
+		alloc.offset = offset;
+		return alloc;
+	}
+
+	void dynamicbuffer::EndFrame(ID3D11DeviceContext *devcon)
+	{
+		if (m_mapped)
+		{
+			devcon->Unmap(m_buffer, 0);
+			m_mapped = nullptr;
+		}
+
+		m_ring.EndFrame();
+		core::telemetry::Count(core::counter::bytesuploaded, m_ring.GetFrameRequested());
+
+		// Expect the next frame to need about as much as this one plus some headroom.
+		m_reserve = m_ring.GetFrameUsage() + m_ring.GetFrameUsage() / 4;
+	}
+
+	void dynamicbuffer::Bind(ID3D11DeviceContext *devcon, UINT slot, UINT stride)
+	{
+		UINT offset{};
+
+		devcon->IASetVertexBuffers(slot, 1, &m_buffer, &stride, &offset);
+	}
+
+	ID3D11Buffer* dynamicbuffer::GetBuffer()
+	{
+		return m_buffer;
+	}
+
+	UINT dynamicbuffer::GetFrameUsage() const
+	{
+		return m_ring.GetFrameUsage();
+	}
+
+	UINT dynamicbuffer::GetFailedAllocations() const
+	{
+		return m_ring.GetFailedAllocations();
+	}
+}
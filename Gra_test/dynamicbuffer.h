@@ -0,0 +1,66 @@
+// dynamicbuffer.h : include file for streaming per-frame geometry to the GPU
+// The dynamicbuffer is a D3D11_USAGE_DYNAMIC buffer used as a ring for geometry that is
+// generated on the CPU every frame (debug lines, particles, user interface).
+// The buffer is mapped once per frame: with WRITE_NO_OVERWRITE while the frame appends
+// behind the previous ones and with WRITE_DISCARD when the write position wraps.
+// Event queries act as per-frame fences so the ring knows which frames the GPU has finished.
+// Between BeginFrame and EndFrame any number of threads can allocate and write at the same time.
+#pragma once
+
+#include <d3d11.h>
+#include "ringallocator.h"
+
+namespace graphics
+{
+	constexpr UINT DYNAMICBUFFER_FRAMES_IN_FLIGHT{ 3 };
+
+	class dynamicbuffer
+	{
+	public:
+		// An allocation is the CPU pointer to write the data to
+		// and the byte offset of the data inside the buffer for the draw call.
+		struct allocation
+		{
+			void *data{};
+			UINT offset{};
+		};
+
+		dynamicbuffer() = delete;
+		dynamicbuffer(ID3D11Device *dev, UINT size, UINT bindFlags = D3D11_BIND_VERTEX_BUFFER);
+		dynamicbuffer(const dynamicbuffer& other) = delete;
+		~dynamicbuffer();
+
+		dynamicbuffer& operator=(const dynamicbuffer& other) = delete;
+
+		// BeginFrame waits until at most DYNAMICBUFFER_FRAMES_IN_FLIGHT frames are queued on the GPU,
+		// releases the space of completed frames and maps the buffer.
+		bool BeginFrame(ID3D11DeviceContext *devcon);
+
+		// Allocate is lock-free and can be called from any thread between BeginFrame and EndFrame.
+		// Vertex data should use the vertex stride as alignment so that offset / stride
+		// can be passed to Draw as the start vertex. The data pointer is null when the frame is full.
+		allocation Allocate(UINT size, UINT alignment);
+
+		// EndFrame unmaps the buffer, it has to be called before any draw call that reads this frame's data.
+		// The fence of the frame is issued by the next BeginFrame so that it follows those draw calls.
+		void EndFrame(ID3D11DeviceContext *devcon);
+
+		// Bind sets the buffer as vertex buffer with offset 0, draws select their data with the start vertex.
+		void Bind(ID3D11DeviceContext *devcon, UINT slot, UINT stride);
+
+		ID3D11Buffer* GetBuffer();
+		UINT GetFrameUsage() const;
+		UINT GetFailedAllocations() const;
+	private:
+		void PollFences(ID3D11DeviceContext *devcon);
+
+		ID3D11Buffer *m_buffer{};
+		ID3D11Query *m_fences[DYNAMICBUFFER_FRAMES_IN_FLIGHT]{};
+		UINT64 m_fenceFrames[DYNAMICBUFFER_FRAMES_IN_FLIGHT]{};
+		UINT64 m_frame{};
+		UINT64 m_completedFrame{};
+		UINT m_reserve{};
+		BYTE *m_mapped{};
+		ringallocator m_ring;
+	};
+}
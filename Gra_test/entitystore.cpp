@@ -0,0 +1,342 @@
+#include "stdafx.h"
+#include "entitystore.h"
+
+namespace core
+{
+	namespace
+	{
+		std::mutex g_componentMutex;
+		componentinfo g_components[MAX_COMPONENT_TYPES];
+		std::atomic<std::uint32_t> g_componentCount{};
+
+		std::uint32_t AlignUp(std::uint32_t value, std::uint32_t alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	std::uint32_t componentregistry::Register(std::uint32_t size, std::uint32_t alignment)
+	{
+		std::lock_guard<std::mutex> lock(g_componentMutex);
+
+		std::uint32_t id = g_componentCount.load();
+		if (id >= MAX_COMPONENT_TYPES)
+		{
+			throw "Too many component types.";
+		}
+		if (alignment > 16)
+		{
+			throw "Component alignment is larger than the chunk alignment.";
+		}
+
+		g_components[id].size = size;
+		g_components[id].alignment = alignment;
+		g_componentCount.store(id + 1);
+
+		return id;
+	}
+
+	const componentinfo& componentregistry::Get(std::uint32_t id)
+	{
+		return g_components[id];
+	}
+
+	void entitystore::Destroy(entity destroyed)
+	{
+		CheckNotIterating();
+		if (!IsAlive(destroyed))
+		{
+			return;
+		}
+
+		entityrecord& record = m_entities[destroyed.index];
+		RemoveRow(*record.owner, record.row);
+
+		record.owner = nullptr;
+		record.generation++;
+		m_freeEntities.push_back(destroyed.index);
+		m_entityCount--;
+	}
+
+	bool entitystore::IsAlive(entity target) const
+	{
+		return target.index < m_entities.size() and m_entities[target.index].owner
+			and m_entities[target.index].generation == target.generation;
+	}
+
+	std::uint32_t entitystore::GetEntityCount() const
+	{
+		return m_entityCount;
+	}
+
+	void entitystore::DeferDestroy(entity destroyed)
+	{
+		std::lock_guard<std::mutex> lock(m_commandMutex);
+		RecordCommand(commandtype::destroy, destroyed, 0, 0, nullptr);
+	}
+
+	// Commands that refer to an entity destroyed earlier in the list are skipped.
+	void entitystore::ApplyDeferred()
+	{
+		std::lock_guard<std::mutex> lock(m_commandMutex);
+		entity created{};
+
+		CheckNotIterating();
+
+		for (const command& current : m_commands)
+		{
+			entity target = current.target.IsValid() ? current.target : created;
+
+			switch (current.type)
+			{
+			case commandtype::create:
+				created = CreateEntity(current.mask);
+				break;
+			case commandtype::destroy:
+				Destroy(target);
+				break;
+			case commandtype::add:
+				if (IsAlive(target))
+				{
+					entityrecord& record = m_entities[target.index];
+					if (!(record.owner->mask & (componentmask(1) << current.componentId)))
+					{
+						MoveEntity(target, record.owner->mask | (componentmask(1) << current.componentId));
+					}
+					std::memcpy(GetComponent(target, current.componentId), &m_commandPayload[current.payload],
+						componentregistry::Get(current.componentId).size);
+				}
+				break;
+			case commandtype::remove:
+				if (IsAlive(target))
+				{
+					MoveEntity(target, m_entities[target.index].owner->mask & ~(componentmask(1) << current.componentId));
+				}
+				break;
+			}
+		}
+
+		m_commands.clear();
+		m_commandPayload.clear();
+	}
+
+	entity entitystore::CreateEntity(componentmask mask)
+	{
+		CheckNotIterating();
+
+		entity created;
+		if (!m_freeEntities.empty())
+		{
+			created.index = m_freeEntities.back();
+			m_freeEntities.pop_back();
+		}
+		else
+		{
+			created.index = static_cast<std::uint32_t>(m_entities.size());
+			m_entities.push_back(entityrecord{});
+		}
+
+		entityrecord& record = m_entities[created.index];
+		created.generation = record.generation;
+
+		archetype *owner = FindArchetype(mask);
+		record.owner = owner;
+		record.row = owner->rows;
+		AppendRow(*owner, created.index);
+		m_entityCount++;
+
+		return created;
+	}
+
+	// The components both archetypes have are copied over, new ones start out zeroed.
+	void entitystore::MoveEntity(entity target, componentmask mask)
+	{
+		CheckNotIterating();
+
+		entityrecord& record = m_entities[target.index];
+		archetype *from = record.owner;
+		if (from->mask == mask)
+		{
+			return;
+		}
+
+		archetype *to = FindArchetype(mask);
+		std::uint32_t fromRow = record.row;
+		std::uint32_t toRow = to->rows;
+		AppendRow(*to, target.index);
+
+		chunk& source = *from->chunks[fromRow / from->capacity];
+		chunk& destination = *to->chunks[toRow / to->capacity];
+		std::uint32_t sourceSlot = fromRow % from->capacity;
+		std::uint32_t destinationSlot = toRow % to->capacity;
+
+		componentmask shared = from->mask & to->mask;
+		for (std::uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++)
+		{
+			if (shared & (componentmask(1) << id))
+			{
+				std::uint32_t size = componentregistry::Get(id).size;
+				std::memcpy(destination.data + to->offsets[id] + destinationSlot * size,
+					source.data + from->offsets[id] + sourceSlot * size, size);
+			}
+		}
+
+		RemoveRow(*from, fromRow);
+
+		record.owner = to;
+		record.row = toRow;
+	}
+
+	void* entitystore::GetComponent(entity target, std::uint32_t componentId)
+	{
+		if (!IsAlive(target))
+		{
+			return nullptr;
+		}
+
+		entityrecord& record = m_entities[target.index];
+		archetype& owner = *record.owner;
+		if (!(owner.mask & (componentmask(1) << componentId)))
+		{
+			return nullptr;
+		}
+
+		chunk& source = *owner.chunks[record.row / owner.capacity];
+		return source.data + owner.offsets[componentId] + (record.row % owner.capacity) * componentregistry::Get(componentId).size;
+	}
+
+	void entitystore::RecordCommand(commandtype type, entity target, std::uint32_t componentId, componentmask mask, const void *component)
+	{
+		command recorded{ type, componentId, mask, target, m_commandPayload.size() };
+
+		if (component)
+		{
+			std::uint32_t size = componentregistry::Get(componentId).size;
+			m_commandPayload.resize(m_commandPayload.size() + size);
+			std::memcpy(&m_commandPayload[recorded.payload], component, size);
+		}
+
+		m_commands.push_back(recorded);
+	}
+
+	// The chunk starts with the entity ids, the component arrays follow in component id order,
+	// each aligned for its type. The capacity is the largest row count for which all of it fits.
+	entitystore::archetype* entitystore::FindArchetype(componentmask mask)
+	{
+		auto found = m_archetypeLookup.find(mask);
+		if (found != m_archetypeLookup.end())
+		{
+			return found->second;
+		}
+
+		std::unique_ptr<archetype> created(new archetype());
+		created->mask = mask;
+
+		std::uint32_t rowSize = static_cast<std::uint32_t>(sizeof(entity));
+		for (std::uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++)
+		{
+			if (mask & (componentmask(1) << id))
+			{
+				rowSize += componentregistry::Get(id).size;
+			}
+		}
+
+		for (std::uint32_t capacity = ENTITY_CHUNK_SIZE / rowSize; capacity > 0; capacity--)
+		{
+			std::uint32_t offset = static_cast<std::uint32_t>(sizeof(entity)) * capacity;
+			for (std::uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++)
+			{
+				if (mask & (componentmask(1) << id))
+				{
+					const componentinfo& info = componentregistry::Get(id);
+					offset = AlignUp(offset, info.alignment);
+					created->offsets[id] = offset;
+					offset += info.size * capacity;
+				}
+			}
+
+			if (offset <= ENTITY_CHUNK_SIZE)
+			{
+				created->capacity = capacity;
+				break;
+			}
+		}
+
+		if (created->capacity == 0)
+		{
+			throw "Components do not fit into an entity chunk.";
+		}
+
+		archetype *result = created.get();
+		m_archetypes.push_back(std::move(created));
+		m_archetypeLookup[mask] = result;
+
+		return result;
+	}
+
+	// Rows are kept dense: every chunk but the last in use is full.
+	// Chunks emptied by removals stay allocated for the next rows.
+	void entitystore::AppendRow(archetype& owner, std::uint32_t entityIndex)
+	{
+		std::uint32_t chunkIndex = owner.rows / owner.capacity;
+		if (chunkIndex == owner.chunks.size())
+		{
+			owner.chunks.push_back(std::unique_ptr<chunk>(new chunk()));
+			owner.chunks.back()->owner = &owner;
+		}
+
+		chunk& destination = *owner.chunks[chunkIndex];
+		std::uint32_t slot = owner.rows % owner.capacity;
+
+		for (std::uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++)
+		{
+			if (owner.mask & (componentmask(1) << id))
+			{
+				std::uint32_t size = componentregistry::Get(id).size;
+				std::memset(destination.data + owner.offsets[id] + slot * size, 0, size);
+			}
+		}
+
+		Entities(destination)[slot] = entity{ entityIndex, m_entities[entityIndex].generation };
+		destination.count++;
+		owner.rows++;
+	}
+
+	// The last row of the archetype is moved into the hole so the rows stay dense.
+	void entitystore::RemoveRow(archetype& owner, std::uint32_t row)
+	{
+		std::uint32_t lastRow = owner.rows - 1;
+		chunk& destination = *owner.chunks[row / owner.capacity];
+		chunk& source = *owner.chunks[lastRow / owner.capacity];
+		std::uint32_t destinationSlot = row % owner.capacity;
+		std::uint32_t sourceSlot = lastRow % owner.capacity;
+
+		if (row != lastRow)
+		{
+			for (std::uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++)
+			{
+				if (owner.mask & (componentmask(1) << id))
+				{
+					std::uint32_t size = componentregistry::Get(id).size;
+					std::memcpy(destination.data + owner.offsets[id] + destinationSlot * size,
+						source.data + owner.offsets[id] + sourceSlot * size, size);
+				}
+			}
+
+			entity moved = Entities(source)[sourceSlot];
+			Entities(destination)[destinationSlot] = moved;
+			m_entities[moved.index].row = row;
+		}
+
+		source.count--;
+		owner.rows--;
+	}
+
+	void entitystore::CheckNotIterating() const
+	{
+		if (m_iterating.load() != 0)
+		{
+			throw "Structural change while iterating, use the deferred functions.";
+		}
+	}
+}
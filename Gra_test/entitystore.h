@@ -0,0 +1,345 @@
+// entitystore.h : include file for the archetype based entity/component store
+// Entities are ids, their data lives in components, plain structs copied with memcpy.
+// All entities with the same set of components belong to one archetype and
+// the archetype keeps their components in fixed size chunks, one array per component type (SoA).
+// A query walks only the chunks of archetypes that have the requested components,
+// so systems read tightly packed arrays instead of following a pointer per object.
+//
+// Adding or removing components moves an entity to another archetype and destroying it
+// moves another entity into the hole, which would break any iteration in progress.
+// During iteration such structural changes are recorded with the Defer functions
+// and carried out by ApplyDeferred at a point where nothing iterates.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "jobsystem.h"
+#include "allocators.h"
+
+namespace core
+{
+	constexpr std::uint32_t ENTITY_CHUNK_SIZE{ 16 * 1024 };
+	constexpr std::uint32_t MAX_COMPONENT_TYPES{ 64 };
+
+	typedef std::uint64_t componentmask;
+
+	struct entity
+	{
+		static constexpr std::uint32_t INVALID_INDEX{ 0xffffffff };
+
+		std::uint32_t index{ INVALID_INDEX };
+		std::uint32_t generation{};
+
+		bool IsValid() const { return index != INVALID_INDEX; }
+		bool operator==(const entity& other) const { return index == other.index and generation == other.generation; }
+		bool operator!=(const entity& other) const { return !(*this == other); }
+	};
+
+	// Every component type gets a small id the first time it is used,
+	// the ids index the per archetype column offsets and the component masks.
+	struct componentinfo
+	{
+		std::uint32_t size{};
+		std::uint32_t alignment{};
+	};
+
+	class componentregistry
+	{
+	public:
+		static std::uint32_t Register(std::uint32_t size, std::uint32_t alignment);
+		static const componentinfo& Get(std::uint32_t id);
+	};
+
+	template<typename T>
+	std::uint32_t ComponentId()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Components are moved with memcpy and must be trivially copyable.");
+		static const std::uint32_t id = componentregistry::Register(static_cast<std::uint32_t>(sizeof(T)), static_cast<std::uint32_t>(alignof(T)));
+		return id;
+	}
+
+	template<typename... T>
+	componentmask ComponentMask()
+	{
+		componentmask mask{};
+		componentmask bits[] = { 0, (componentmask(1) << ComponentId<T>())... };
+		for (componentmask bit : bits)
+		{
+			mask |= bit;
+		}
+		return mask;
+	}
+
+	class entitystore
+	{
+	public:
+		// A chunk holds the entity ids followed by one array per component of its archetype.
+		struct archetype;
+		struct chunk
+		{
+			archetype *owner{};
+			std::uint32_t count{};
+			alignas(16) unsigned char data[ENTITY_CHUNK_SIZE];
+		};
+
+		struct archetype
+		{
+			componentmask mask{};
+			std::uint32_t capacity{};
+			std::uint32_t rows{};
+			std::uint32_t offsets[MAX_COMPONENT_TYPES]{};
+			std::vector<std::unique_ptr<chunk>> chunks{};
+		};
+
+		entitystore() {};
+		entitystore(const entitystore& other) = delete;
+		~entitystore() {};
+
+		entitystore& operator=(const entitystore& other) = delete;
+
+		// Immediate structural changes, they throw when called while a query is running.
+		template<typename... T>
+		entity Create(const T&... components);
+		void Destroy(entity destroyed);
+		template<typename T>
+		void Add(entity target, const T& component);
+		template<typename T>
+		void Remove(entity target);
+
+		bool IsAlive(entity target) const;
+		template<typename T>
+		T* Get(entity target);
+		std::uint32_t GetEntityCount() const;
+
+		// Deferred structural changes can be recorded from any thread, also from inside queries.
+		// ApplyDeferred carries them out in the order they were recorded.
+		template<typename... T>
+		void DeferCreate(const T&... components);
+		void DeferDestroy(entity destroyed);
+		template<typename T>
+		void DeferAdd(entity target, const T& component);
+		template<typename T>
+		void DeferRemove(entity target);
+		void ApplyDeferred();
+
+		// ForEachChunk calls function(count, entities, T*...) once per chunk that has all of T.
+		// ForEach calls function(entity, T&...) for every single entity.
+		// ParallelForEachChunk hands the matching chunks to the job system and returns when all are done,
+		// the function must not touch data of other chunks.
+		template<typename... T, typename F>
+		void ForEachChunk(F&& function);
+		template<typename... T, typename F>
+		void ForEach(F&& function);
+		template<typename... T, typename F>
+		void ParallelForEachChunk(jobsystem& jobs, F&& function);
+	private:
+		struct entityrecord
+		{
+			archetype *owner{};
+			std::uint32_t row{};
+			std::uint32_t generation{};
+		};
+
+		enum class commandtype : std::uint8_t
+		{
+			create, destroy, add, remove
+		};
+
+		// Component values of deferred commands are copied into one byte array.
+		// Create is followed by one add command per component with the entity left invalid,
+		// which stands for the entity created just before.
+		struct command
+		{
+			commandtype type;
+			std::uint32_t componentId;
+			componentmask mask;
+			entity target;
+			std::size_t payload;
+		};
+
+		class iterationscope
+		{
+		public:
+			iterationscope(std::atomic<std::uint32_t>& iterating) : m_iterating(iterating) { m_iterating++; };
+			~iterationscope() { m_iterating--; };
+		private:
+			std::atomic<std::uint32_t>& m_iterating;
+		};
+
+		entity CreateEntity(componentmask mask);
+		void MoveEntity(entity target, componentmask mask);
+		void* GetComponent(entity target, std::uint32_t componentId);
+		void RecordCommand(commandtype type, entity target, std::uint32_t componentId, componentmask mask, const void *component);
+		archetype* FindArchetype(componentmask mask);
+		void AppendRow(archetype& owner, std::uint32_t entityIndex);
+		void RemoveRow(archetype& owner, std::uint32_t row);
+		void CheckNotIterating() const;
+
+		template<typename T>
+		static T* Column(chunk& source)
+		{
+			return reinterpret_cast<T*>(source.data + source.owner->offsets[ComponentId<T>()]);
+		}
+
+		static entity* Entities(chunk& source)
+		{
+			return reinterpret_cast<entity*>(source.data);
+		}
+
+		std::vector<std::unique_ptr<archetype>> m_archetypes{};
+		std::unordered_map<componentmask, archetype*> m_archetypeLookup{};
+		std::vector<entityrecord> m_entities{};
+		std::vector<std::uint32_t> m_freeEntities{};
+		std::uint32_t m_entityCount{};
+		std::atomic<std::uint32_t> m_iterating{};
+
+		std::mutex m_commandMutex{};
+		std::vector<command> m_commands{};
+		std::vector<unsigned char> m_commandPayload{};
+	};
+
+	template<typename... T>
+	entity entitystore::Create(const T&... components)
+	{
+		entity created = CreateEntity(ComponentMask<T...>());
+
+		int unused[] = { 0, (std::memcpy(GetComponent(created, ComponentId<T>()), &components, sizeof(T)), 0)... };
+		(void)unused;
+
+		return created;
+	}
+
+	template<typename T>
+	void entitystore::Add(entity target, const T& component)
+	{
+		CheckNotIterating();
+		if (!IsAlive(target))
+		{
+			return;
+		}
+
+		MoveEntity(target, m_entities[target.index].owner->mask | ComponentMask<T>());
+		std::memcpy(GetComponent(target, ComponentId<T>()), &component, sizeof(T));
+	}
+
+	template<typename T>
+	void entitystore::Remove(entity target)
+	{
+		CheckNotIterating();
+		if (!IsAlive(target))
+		{
+			return;
+		}
+
+		MoveEntity(target, m_entities[target.index].owner->mask & ~ComponentMask<T>());
+	}
+
+	template<typename T>
+	T* entitystore::Get(entity target)
+	{
+		return static_cast<T*>(GetComponent(target, ComponentId<T>()));
+	}
+
+	template<typename... T>
+	void entitystore::DeferCreate(const T&... components)
+	{
+		std::lock_guard<std::mutex> lock(m_commandMutex);
+
+		RecordCommand(commandtype::create, entity{}, 0, ComponentMask<T...>(), nullptr);
+		int unused[] = { 0, (RecordCommand(commandtype::add, entity{}, ComponentId<T>(), 0, &components), 0)... };
+		(void)unused;
+	}
+
+	template<typename T>
+	void entitystore::DeferAdd(entity target, const T& component)
+	{
+		std::lock_guard<std::mutex> lock(m_commandMutex);
+		RecordCommand(commandtype::add, target, ComponentId<T>(), 0, &component);
+	}
+
+	template<typename T>
+	void entitystore::DeferRemove(entity target)
+	{
+		std::lock_guard<std::mutex> lock(m_commandMutex);
+		RecordCommand(commandtype::remove, target, ComponentId<T>(), 0, nullptr);
+	}
+
+	template<typename... T, typename F>
+	void entitystore::ForEachChunk(F&& function)
+	{
+		componentmask required = ComponentMask<T...>();
+		iterationscope scope(m_iterating);
+
+		for (auto& candidate : m_archetypes)
+		{
+			if ((candidate->mask & required) != required)
+			{
+				continue;
+			}
+
+			for (auto& current : candidate->chunks)
+			{
+				if (current->count == 0)
+				{
+					break;
+				}
+				function(current->count, Entities(*current), Column<T>(*current)...);
+			}
+		}
+	}
+
+	template<typename... T, typename F>
+	void entitystore::ForEach(F&& function)
+	{
+		ForEachChunk<T...>([&function](std::uint32_t count, const entity *entities, T*... columns)
+		{
+			for (std::uint32_t i = 0; i < count; i++)
+			{
+				function(entities[i], columns[i]...);
+			}
+		});
+	}
+
+	// The chunks are collected first so every job gets one chunk, which is already a good grain.
+	// The list lives on the scratch stack of the calling thread, which waits until all jobs are done.
+	template<typename... T, typename F>
+	void entitystore::ParallelForEachChunk(jobsystem& jobs, F&& function)
+	{
+		componentmask required = ComponentMask<T...>();
+		scratchscope scratch;
+		scratchvector<chunk*> matching;
+		iterationscope scope(m_iterating);
+
+		for (auto& candidate : m_archetypes)
+		{
+			if ((candidate->mask & required) != required)
+			{
+				continue;
+			}
+
+			matching.reserve(matching.size() + candidate->chunks.size());
+			for (auto& current : candidate->chunks)
+			{
+				if (current->count == 0)
+				{
+					break;
+				}
+				matching.push_back(current.get());
+			}
+		}
+
+		jobs.ParallelFor(static_cast<std::uint32_t>(matching.size()), 1, [&matching, &function](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t i = begin; i < end; i++)
+			{
+				function(matching[i]->count, Entities(*matching[i]), Column<T>(*matching[i])...);
+			}
+		});
+	}
+}
@@ -0,0 +1,112 @@
+#include "stdafx.h"
+#include "fontrasterizer.h"
+
+#pragma comment (lib, "gdi32.lib")
+
+namespace graphics
+{
+	fontrasterizer::fontrasterizer(const WCHAR *face, INT pixelHeight)
+	{
+		TEXTMETRICW metrics{};
+
+		if (!face or pixelHeight <= 0)
+		{
+			throw "Incorrect font parameters.";
+		}
+
+		m_dc = CreateCompatibleDC(NULL);
+		if (!m_dc)
+		{
+			throw "Unable to create the font device context.";
+		}
+
+		// A negative height asks for the character height instead of the cell height, which is what the line height is.
+		m_font = CreateFontW(-pixelHeight, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS,
+			CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH | FF_DONTCARE, face);
+		if (!m_font)
+		{
+			DeleteDC(m_dc);
+			m_dc = NULL;
+			throw "Unable to create the font.";
+		}
+
+		m_previous = SelectObject(m_dc, m_font);
+		GetTextMetricsW(m_dc, &metrics);
+		m_ascent = metrics.tmAscent;
+		m_lineHeight = static_cast<FLOAT>(metrics.tmHeight + metrics.tmExternalLeading);
+	}
+
+	fontrasterizer::~fontrasterizer()
+	{
+		if (m_dc)
+		{
+			SelectObject(m_dc, m_previous);
+			DeleteDC(m_dc);
+			m_dc = NULL;
+		}
+
+		if (m_font)
+		{
+			DeleteObject(m_font);
+			m_font = NULL;
+		}
+	}
+
+	// The bitmap rows GDI returns are padded to four bytes. The glyph origin is the top left of the bitmap
+	// above the baseline, the baseline is the ascent below the top of the line.
+	bool fontrasterizer::Rasterize(std::uint32_t character, glyphbitmap& bitmap)
+	{
+		const MAT2 identity = { { 0, 1 }, { 0, 0 }, { 0, 0 }, { 0, 1 } };
+		GLYPHMETRICS metrics{};
+		WCHAR text = static_cast<WCHAR>(character);
+		WORD index = 0;
+
+		if (character > 0xFFFF or GetGlyphIndicesW(m_dc, &text, 1, &index, GGI_MARK_NONEXISTING_GLYPHS) == GDI_ERROR or index == 0xFFFF)
+		{
+			return false;
+		}
+
+		DWORD size = GetGlyphOutlineW(m_dc, character, GGO_GRAY8_BITMAP, &metrics, 0, NULL, &identity);
+		if (size == GDI_ERROR)
+		{
+			return false;
+		}
+
+		bitmap.advance = static_cast<FLOAT>(metrics.gmCellIncX);
+		bitmap.offsetX = metrics.gmptGlyphOrigin.x;
+		bitmap.offsetY = m_ascent - metrics.gmptGlyphOrigin.y;
+
+		// Glyphs like the space have nothing to draw and report a size of zero.
+		if (size == 0)
+		{
+			bitmap.width = bitmap.height = 0;
+			bitmap.pixels.clear();
+			return true;
+		}
+
+		m_buffer.resize(size);
+		if (GetGlyphOutlineW(m_dc, character, GGO_GRAY8_BITMAP, &metrics, size, m_buffer.data(), &identity) == GDI_ERROR)
+		{
+			return false;
+		}
+
+		UINT pitch = (metrics.gmBlackBoxX + 3) & ~3u;
+		bitmap.width = metrics.gmBlackBoxX;
+		bitmap.height = metrics.gmBlackBoxY;
+		bitmap.pixels.resize(static_cast<size_t>(bitmap.width) * bitmap.height);
+		for (UINT y = 0; y < bitmap.height; y++)
+		{
+			for (UINT x = 0; x < bitmap.width; x++)
+			{
+				bitmap.pixels[static_cast<size_t>(y) * bitmap.width + x] = static_cast<BYTE>(m_buffer[static_cast<size_t>(y) * pitch + x] * 255 / 64);
+			}
+		}
+
+		return true;
+	}
+
+	FLOAT fontrasterizer::GetLineHeight() const
+	{
+		return m_lineHeight;
+	}
+}
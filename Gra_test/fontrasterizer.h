@@ -0,0 +1,37 @@
+// fontrasterizer.h : include file for rasterizing glyphs with GDI
+// The font rasterizer draws the glyphs of a Windows font for the glyph atlas (see glyphatlas.h).
+// GDI hands out antialiased glyph bitmaps with 65 levels of coverage, which are stretched to 0 to 255.
+// The font is selected into a memory device context of its own, so it never touches the window's,
+// but it has to be used from one thread only: the one laying out the text.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "glyphatlas.h"
+
+namespace graphics
+{
+	class fontrasterizer
+	{
+	public:
+		fontrasterizer() = delete;
+		// The height is that of the font's cells in pixels.
+		fontrasterizer(const WCHAR *face, INT pixelHeight);
+		fontrasterizer(const fontrasterizer& other) = delete;
+		~fontrasterizer();
+
+		fontrasterizer& operator=(const fontrasterizer& other) = delete;
+
+		// Rasterize returns false for characters the font has no glyph for and for ones outside of UTF-16's first plane.
+		bool Rasterize(std::uint32_t character, glyphbitmap& bitmap);
+
+		FLOAT GetLineHeight() const;
+	private:
+		HDC m_dc{};
+		HFONT m_font{};
+		HGDIOBJ m_previous{};
+		INT m_ascent{};
+		FLOAT m_lineHeight{};
+		std::vector<BYTE> m_buffer{};
+	};
+}
@@ -0,0 +1,102 @@
+#include "stdafx.h"
+#include "framepipeline.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include <chrono>
+
+namespace core
+{
+	framepipeline::framepipeline(consumecallback consume) :
+		m_consume(consume)
+	{
+		if (!m_consume)
+		{
+			throw "The frame pipeline needs a consume callback.";
+		}
+
+		m_renderThread = std::thread(&framepipeline::RenderMain, this);
+	}
+
+	// Whatever was published is still rendered before the render thread stops.
+	framepipeline::~framepipeline()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_changed.wait(lock, [this] { return m_pendingSlot == NO_SLOT; });
+			m_running = false;
+		}
+		m_changed.notify_all();
+
+		m_renderThread.join();
+	}
+
+	std::uint32_t framepipeline::GetWriteSlot() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_writeSlot;
+	}
+
+	// The previous slot is normally picked up long before the next one is published,
+	// the first wait only blocks when rendering a frame takes longer than simulating one.
+	void framepipeline::Publish()
+	{
+		PROFILE_SCOPE("framepipeline::Publish");
+		auto start = std::chrono::steady_clock::now();
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_changed.wait(lock, [this] { return m_pendingSlot == NO_SLOT; });
+
+			m_pendingSlot = m_writeSlot;
+			m_writeSlot = (m_writeSlot + 1) % SLOT_COUNT;
+		}
+		m_changed.notify_all();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_changed.wait(lock, [this] { return m_renderingSlot != m_writeSlot and m_pendingSlot != m_writeSlot; });
+
+		lock.unlock();
+
+		auto waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		telemetry::Count(counter::publishwaitmicroseconds, static_cast<std::uint64_t>(waited.count()));
+	}
+
+	void framepipeline::Flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_changed.wait(lock, [this] { return m_pendingSlot == NO_SLOT and m_renderingSlot == NO_SLOT; });
+	}
+
+	void framepipeline::RenderMain()
+	{
+		profiler::SetThreadName("Render");
+
+		while (true)
+		{
+			std::uint32_t slot;
+
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_changed.wait(lock, [this] { return m_pendingSlot != NO_SLOT or !m_running; });
+
+				if (m_pendingSlot == NO_SLOT)
+				{
+					return;
+				}
+
+				slot = m_pendingSlot;
+				m_renderingSlot = slot;
+				m_pendingSlot = NO_SLOT;
+			}
+			m_changed.notify_all();
+
+			m_consume(slot);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_renderingSlot = NO_SLOT;
+			}
+			m_changed.notify_all();
+		}
+	}
+}
@@ -0,0 +1,59 @@
+// framepipeline.h : include file for the two stage frame pipeline
+// The simulation builds frame N+1 while a dedicated render thread submits frame N.
+// Both sides work on one of two snapshot slots and hand them over here,
+// the pipeline itself only tracks which slot belongs to whom and never looks inside them.
+//
+// Slot ownership:
+//  - the simulation owns the write slot until it calls Publish,
+//  - a published slot is pending until the render thread picks it up,
+//  - the render thread owns it until its consume callback returns.
+// Publish returns only once the render thread has let go of the other slot,
+// so the simulation is never more than one frame ahead of what is being rendered.
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace core
+{
+	class framepipeline
+	{
+	public:
+		static constexpr std::uint32_t SLOT_COUNT{ 2 };
+		static constexpr std::uint32_t NO_SLOT{ 0xffffffff };
+
+		// The consume callback is called on the render thread with the slot to render.
+		typedef std::function<void(std::uint32_t slot)> consumecallback;
+
+		framepipeline() = delete;
+		framepipeline(consumecallback consume);
+		framepipeline(const framepipeline& other) = delete;
+		~framepipeline();
+
+		framepipeline& operator=(const framepipeline& other) = delete;
+
+		// The slot the simulation may write now.
+		std::uint32_t GetWriteSlot() const;
+
+		// Publish hands the write slot to the render thread and waits until the other slot is free.
+		// The time it waited is counted as publishwaitmicroseconds, it stays near zero while rendering is the shorter stage.
+		void Publish();
+
+		// Flush waits until every published slot has been rendered.
+		void Flush();
+	private:
+		void RenderMain();
+
+		consumecallback m_consume;
+		std::uint32_t m_writeSlot{};
+		std::uint32_t m_pendingSlot{ NO_SLOT };
+		std::uint32_t m_renderingSlot{ NO_SLOT };
+		bool m_running{ true };
+		mutable std::mutex m_mutex{};
+		std::condition_variable m_changed{};
+		std::thread m_renderThread{};
+	};
+}
@@ -0,0 +1,247 @@
+#include "stdafx.h"
+#include "glyphatlas.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstring>
+
+namespace graphics
+{
+	std::uint32_t NextCharacter(const char*& text)
+	{
+		const unsigned char *bytes = reinterpret_cast<const unsigned char*>(text);
+		std::uint32_t first = bytes[0];
+		UINT length = first >= 0xF8 ? 1 : first >= 0xF0 ? 4 : first >= 0xE0 ? 3 : first >= 0xC0 ? 2 : 1;
+		if (first == 0)
+		{
+			return 0;
+		}
+
+		std::uint32_t character = length == 1 ? first : first & (0x7F >> length);
+		for (UINT i = 1; i < length; i++)
+		{
+			if ((bytes[i] & 0xC0) != 0x80)
+			{
+				text++;
+				return first;
+			}
+			character = (character << 6) | (bytes[i] & 0x3F);
+		}
+
+		text += length;
+		return character;
+	}
+
+	// C++14 needs a definition for constants that are bound to references, like the one std::fill takes.
+	constexpr UINT glyphatlas::UNKNOWN;
+
+	glyphatlas::glyphatlas(UINT width, UINT height, FLOAT lineHeight, glyphrasterizer rasterizer, std::uint32_t fallback) :
+		m_width(width), m_height(height), m_lineHeight(lineHeight), m_rasterizer(std::move(rasterizer)), m_fallback(fallback)
+	{
+		if (width < WHITE_SIZE + PADDING or height < WHITE_SIZE + PADDING or lineHeight <= 0.0f or !m_rasterizer)
+		{
+			throw "Incorrect glyph atlas parameters.";
+		}
+
+		m_pixels.resize(static_cast<size_t>(width) * height);
+		std::fill(m_ascii, m_ascii + ASCII_GLYPHS, UNKNOWN);
+
+		// The white texels open the first shelf.
+		for (UINT y = 0; y < WHITE_SIZE; y++)
+		{
+			std::memset(&m_pixels[static_cast<size_t>(y) * width], 0xFF, WHITE_SIZE);
+		}
+		m_shelfX = WHITE_SIZE + PADDING;
+		m_shelfHeight = WHITE_SIZE + PADDING;
+		MarkDirty(0, WHITE_SIZE);
+	}
+
+	const glyph* glyphatlas::Find(std::uint32_t character)
+	{
+		UINT index = Lookup(character);
+		if (index == NO_GLYPH and character != m_fallback)
+		{
+			index = Lookup(m_fallback);
+		}
+
+		return index == NO_GLYPH ? nullptr : &m_glyphs[index];
+	}
+
+	FLOAT glyphatlas::Measure(const char *text)
+	{
+		FLOAT width = 0.0f;
+		std::uint32_t character;
+
+		while ((character = NextCharacter(text)) != 0 and character != '\n')
+		{
+			const glyph *found = Find(character);
+			width += found ? found->advance : 0.0f;
+		}
+
+		return width;
+	}
+
+	UINT glyphatlas::GetDirtyRows() const
+	{
+		return m_dirtyBottom > m_dirtyTop ? m_dirtyBottom - m_dirtyTop : 0;
+	}
+
+	bool glyphatlas::TakeDirtyRows(UINT maxRows, UINT& top, UINT& rows)
+	{
+		if (m_dirtyBottom <= m_dirtyTop or !maxRows)
+		{
+			return false;
+		}
+
+		top = m_dirtyTop;
+		rows = (std::min)(m_dirtyBottom - m_dirtyTop, maxRows);
+		m_dirtyTop += rows;
+		if (m_dirtyTop == m_dirtyBottom)
+		{
+			m_dirtyTop = m_dirtyBottom = 0;
+		}
+		return true;
+	}
+
+	void glyphatlas::GetWhite(FLOAT& u, FLOAT& v) const
+	{
+		u = 0.5f * static_cast<FLOAT>(WHITE_SIZE) / static_cast<FLOAT>(m_width);
+		v = 0.5f * static_cast<FLOAT>(WHITE_SIZE) / static_cast<FLOAT>(m_height);
+	}
+
+	const std::uint8_t* glyphatlas::GetPixels() const
+	{
+		return m_pixels.data();
+	}
+
+	UINT glyphatlas::GetWidth() const
+	{
+		return m_width;
+	}
+
+	UINT glyphatlas::GetHeight() const
+	{
+		return m_height;
+	}
+
+	FLOAT glyphatlas::GetLineHeight() const
+	{
+		return m_lineHeight;
+	}
+
+	glyphatlasstats glyphatlas::GetStats() const
+	{
+		glyphatlasstats stats = m_stats;
+		stats.glyphs = static_cast<UINT>(m_glyphs.size());
+		stats.usedRows = m_shelfY + m_shelfHeight;
+		return stats;
+	}
+
+	// Every character is rasterized at most once, whether it made it into the atlas or not.
+	UINT glyphatlas::Lookup(std::uint32_t character)
+	{
+		if (character < ASCII_GLYPHS)
+		{
+			if (m_ascii[character] == UNKNOWN)
+			{
+				m_ascii[character] = Add(character);
+			}
+			return m_ascii[character];
+		}
+
+		auto found = m_others.find(character);
+		if (found != m_others.end())
+		{
+			return found->second;
+		}
+
+		UINT index = Add(character);
+		m_others.emplace(character, index);
+		return index;
+	}
+
+	UINT glyphatlas::Add(std::uint32_t character)
+	{
+		glyphbitmap bitmap;
+		UINT x = 0, y = 0;
+		PROFILE_SCOPE("glyphatlas::Add");
+
+		m_stats.rasterized++;
+		if (!m_rasterizer(character, bitmap) or bitmap.pixels.size() != static_cast<size_t>(bitmap.width) * bitmap.height)
+		{
+			m_stats.missing++;
+			return NO_GLYPH;
+		}
+
+		// Glyphs without pixels take no room, their texture coordinates are never sampled.
+		if (bitmap.width and bitmap.height)
+		{
+			if (!Pack(bitmap.width, bitmap.height, x, y))
+			{
+				m_stats.full++;
+				return NO_GLYPH;
+			}
+
+			for (UINT row = 0; row < bitmap.height; row++)
+			{
+				std::memcpy(&m_pixels[static_cast<size_t>(y + row) * m_width + x], &bitmap.pixels[static_cast<size_t>(row) * bitmap.width], bitmap.width);
+			}
+			MarkDirty(y, bitmap.height);
+		}
+
+		glyph packed;
+		packed.u0 = static_cast<FLOAT>(x) / static_cast<FLOAT>(m_width);
+		packed.v0 = static_cast<FLOAT>(y) / static_cast<FLOAT>(m_height);
+		packed.u1 = static_cast<FLOAT>(x + bitmap.width) / static_cast<FLOAT>(m_width);
+		packed.v1 = static_cast<FLOAT>(y + bitmap.height) / static_cast<FLOAT>(m_height);
+		packed.width = static_cast<FLOAT>(bitmap.width);
+		packed.height = static_cast<FLOAT>(bitmap.height);
+		packed.offsetX = static_cast<FLOAT>(bitmap.offsetX);
+		packed.offsetY = static_cast<FLOAT>(bitmap.offsetY);
+		packed.advance = bitmap.advance;
+
+		m_glyphs.push_back(packed);
+		return static_cast<UINT>(m_glyphs.size() - 1);
+	}
+
+	// The open shelf is the last one, so it can grow downwards as long as the atlas has rows left.
+	// A glyph that does not fit next to the others closes it and opens the next one below.
+	bool glyphatlas::Pack(UINT width, UINT height, UINT& x, UINT& y)
+	{
+		UINT paddedWidth = width + PADDING, paddedHeight = height + PADDING;
+		if (width > m_width)
+		{
+			return false;
+		}
+
+		if (m_shelfX + width > m_width)
+		{
+			m_shelfY += m_shelfHeight;
+			m_shelfX = 0;
+			m_shelfHeight = 0;
+		}
+
+		if (m_shelfY + height > m_height)
+		{
+			return false;
+		}
+
+		x = m_shelfX;
+		y = m_shelfY;
+		m_shelfX += paddedWidth;
+		m_shelfHeight = (std::max)(m_shelfHeight, paddedHeight);
+		return true;
+	}
+
+	void glyphatlas::MarkDirty(UINT y, UINT height)
+	{
+		if (m_dirtyBottom <= m_dirtyTop)
+		{
+			m_dirtyTop = y;
+			m_dirtyBottom = y + height;
+			return;
+		}
+
+		m_dirtyTop = (std::min)(m_dirtyTop, y);
+		m_dirtyBottom = (std::max)(m_dirtyBottom, y + height);
+	}
+}
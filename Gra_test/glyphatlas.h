@@ -0,0 +1,118 @@
+// glyphatlas.h : include file for the glyph cache of the text rendering
+// The atlas is one single channel texture the glyphs of a font are packed into as text asks for them.
+// A glyph is rasterized and packed the first time it is used and stays for good, so after the first frames
+// laying out text is only table lookups. The rasterizer is handed in, the game uses the one drawing with GDI
+// (see fontrasterizer.h), the headless builds a synthetic one.
+// Glyphs are packed in shelves: rows as high as the tallest glyph placed in them, filled from left to right,
+// each glyph a pixel apart from its neighbours so the bilinear filter never blends two of them.
+// The top left texels are left white for solid sprites, see GetWhite.
+// The pixels changed since the last upload are tracked as a band of rows, the render side only copies that band.
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "d3dxmath.h"
+
+namespace graphics
+{
+	// The coverage of a glyph, one byte per pixel, width by height, the rows top to bottom without padding.
+	// The offset places the bitmap relative to the pen, which is at the left of the glyph on the top of the line.
+	// An empty bitmap is a glyph with nothing to draw, like the space, it only moves the pen by the advance.
+	struct glyphbitmap
+	{
+		UINT width{}, height{};
+		INT offsetX{}, offsetY{};
+		FLOAT advance{};
+		std::vector<std::uint8_t> pixels{};
+	};
+
+	// The rasterizer returns false for characters the font has no glyph for.
+	typedef std::function<bool(std::uint32_t character, glyphbitmap& bitmap)> glyphrasterizer;
+
+	// NextCharacter decodes the UTF-8 character text points to and moves text past it, 0 at the end of the text.
+	// Bytes that do not start a valid sequence come out as themselves.
+	std::uint32_t NextCharacter(const char*& text);
+
+	// A packed glyph: its texture coordinates in the atlas and its size and offset in pixels.
+	struct glyph
+	{
+		FLOAT u0, v0, u1, v1;
+		FLOAT width, height;
+		FLOAT offsetX, offsetY;
+		FLOAT advance;
+	};
+
+	struct glyphatlasstats
+	{
+		UINT glyphs{};
+		UINT rasterized{};
+		UINT missing{};
+		UINT full{};
+		UINT usedRows{};
+	};
+
+	class glyphatlas
+	{
+	public:
+		glyphatlas() = delete;
+		// The line height is how far apart two lines of text are, the fallback is drawn for characters without a glyph.
+		glyphatlas(UINT width, UINT height, FLOAT lineHeight, glyphrasterizer rasterizer, std::uint32_t fallback = '?');
+		glyphatlas(const glyphatlas& other) = delete;
+		~glyphatlas() {};
+
+		glyphatlas& operator=(const glyphatlas& other) = delete;
+
+		// Find returns the glyph of the character, rasterizing and packing it on first use.
+		// Characters the font does not have and ones that no longer fit get the fallback, null when there is none either.
+		// Only the thread laying out the text may call it.
+		const glyph* Find(std::uint32_t character);
+
+		// Measure returns the width of the line the text makes, up to the first new line.
+		FLOAT Measure(const char *text);
+
+		// GetDirtyRows is the height of the band of rows changed since they were last taken.
+		// TakeDirtyRows returns up to maxRows rows of that band from its top, the rows below stay dirty.
+		// It returns false when nothing is taken.
+		UINT GetDirtyRows() const;
+		bool TakeDirtyRows(UINT maxRows, UINT& top, UINT& rows);
+
+		// The texture coordinates of the middle of the white texels.
+		void GetWhite(FLOAT& u, FLOAT& v) const;
+
+		const std::uint8_t* GetPixels() const;
+		UINT GetWidth() const;
+		UINT GetHeight() const;
+		FLOAT GetLineHeight() const;
+		glyphatlasstats GetStats() const;
+	private:
+		static constexpr UINT ASCII_GLYPHS{ 128 };
+		static constexpr UINT NO_GLYPH{ 0xFFFFFFFF };
+		static constexpr UINT UNKNOWN{ 0xFFFFFFFE };
+		static constexpr UINT PADDING{ 1 };
+		static constexpr UINT WHITE_SIZE{ 2 };
+
+		UINT Lookup(std::uint32_t character);
+		UINT Add(std::uint32_t character);
+		bool Pack(UINT width, UINT height, UINT& x, UINT& y);
+		void MarkDirty(UINT y, UINT height);
+
+		std::vector<std::uint8_t> m_pixels;
+		UINT m_width{}, m_height{};
+		FLOAT m_lineHeight{};
+		glyphrasterizer m_rasterizer;
+		std::uint32_t m_fallback{};
+
+		// The glyphs in the order they were added. ASCII is looked up directly, everything else in the map,
+		// both hold NO_GLYPH for characters that were asked for and could not be added. ASCII never asked for is UNKNOWN.
+		std::vector<glyph> m_glyphs;
+		UINT m_ascii[ASCII_GLYPHS];
+		std::unordered_map<std::uint32_t, UINT> m_others;
+
+		// The shelf being filled, everything above it is closed.
+		UINT m_shelfX{}, m_shelfY{}, m_shelfHeight{};
+		UINT m_dirtyTop{}, m_dirtyBottom{};
+		glyphatlasstats m_stats{};
+	};
+}
@@ -1,63 +1,799 @@
 #include "stdafx.h"
 #include "graphics.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
 
 namespace graphics
 {
 	graphics::graphics(HWND hWnd, INT screenWidth, INT screenHeight) :
-		m_d3d(hWnd, screenWidth, screenHeight, VSYNC_ENABLED, FULL_SCREEN, SCREEN_DEPTH, SCREEN_NEAR)
+		m_Jobs(JOB_WORKER_THREADS), m_d3d(hWnd, screenWidth, screenHeight, VSYNC_ENABLED, FULL_SCREEN, SCREEN_DEPTH, SCREEN_NEAR),
+		m_Scene(m_Jobs), m_ScreenWidth(screenWidth), m_ScreenHeight(screenHeight), m_Resolution(resolutionsettings{ RESOLUTION_TARGET_SECONDS, RESOLUTION_MIN_SCALE })
 	{
-		m_Model = std::make_unique<model>(m_d3d.getDevice());
+		// All models share the vertex and index buffers of the mesh heap.
+		m_MeshHeap = std::make_unique<meshheap>(m_d3d.getDevice(), static_cast<UINT>(sizeof(model::VertexType)));
+		m_MeshHeap->SetRelocationCallback([this](meshheap::handle mesh, const meshheap::meshrange& from, const meshheap::meshrange& to)
+		{
+			m_MovedMeshes.push_back(meshrelocation{ mesh, from, to });
+		});
+		m_Model = std::make_unique<model>(*m_MeshHeap, m_Jobs);
+
+		// Geometry generated on the CPU every frame is streamed through the dynamic ring buffer.
+		m_DynamicGeometry = std::make_unique<dynamicbuffer>(m_d3d.getDevice(), DYNAMIC_GEOMETRY_SIZE);
 		m_ColorShader = std::make_unique<colorshader>(m_d3d.getDevice(), hWnd);
+		m_Upscaler = std::make_unique<upscaler>(m_d3d.getDevice(), hWnd);
+		CreateHud(hWnd);
+		m_d3d.GetProjectionMatrix(m_ProjectionMatrix);
+		CreateCharacters();
+		CreateParticles();
+		CreateTerrain();
+		CreateLights();
 
 		// Set the initial position of the camera.
-		m_Camera.SetPosition(0.0f, 0.0f, -10.0f);
+		m_Scene.SetCamera(D3DXVECTOR3(0.0f, 0.0f, -10.0f), D3DXVECTOR3(0.0f, 0.0f, 0.0f));
+
+		// Place one instance of the model at the origin of the world.
+		transform placement{ D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3(0.0f, 0.0f, 0.0f), 1.0f };
+		meshinstance instance{ m_Model->GetPage(), static_cast<UINT>(m_Model->GetIndexCount()),
+			static_cast<UINT>(m_Model->GetStartIndex()), static_cast<UINT>(m_Model->GetBaseVertex()), m_Model->GetBoundingRadius() };
+		core::entity placed = m_Scene.CreateInstance(placement, instance);
+		m_Scene.SetPickMesh(placed, &m_Model->GetBVH());
+
+		// The tick rate is taken once, measuring it again every frame would make the frame times drift with it.
+		m_SecondsPerTick = 1.0 / core::profiler::TicksPerSecond();
+
+		// From here on the device context belongs to the render thread.
+		m_Pipeline = std::make_unique<core::framepipeline>([this](std::uint32_t slot)
+		{
+			RenderSnapshot(m_Snapshots[slot]);
+		});
 	}
 
 	graphics::~graphics()
 	{
+		m_Pipeline.reset();
+		StopCapture();
+
+		if (m_CharacterMesh != meshheap::INVALID_HANDLE)
+		{
+			m_MeshHeap->Free(m_CharacterMesh);
+		}
+	}
+
+	// Update is called a fixed number of times per second by the main loop.
+	void graphics::Update(FLOAT stepSeconds)
+	{
+		m_Scene.Update(stepSeconds);
+
+		m_PreviousAnimationTime = m_AnimationTime;
+		m_AnimationTime += stepSeconds;
+
+		m_Particles->Update(m_Jobs, stepSeconds);
+	}
+
+	bool graphics::StartCapture(const char *path)
+	{
+		StopCapture();
+
+		std::unique_ptr<capturewriter> capture = std::make_unique<capturewriter>();
+		if (!capture->Open(path))
+		{
+			return false;
+		}
+
+		m_Capture = std::move(capture);
+		m_Capture->WindowSize(static_cast<UINT>(m_ScreenWidth), static_cast<UINT>(m_ScreenHeight));
+		m_Scene.SetCapture(m_Capture.get());
+
+		return true;
+	}
+
+	bool graphics::StopCapture()
+	{
+		if (!m_Capture)
+		{
+			return true;
+		}
+
+		m_Scene.SetCapture(nullptr);
+		bool result = m_Capture->Close();
+		m_Capture.reset();
+
+		return result;
+	}
+
+	void graphics::SetPresentCallback(presentcallback callback)
+	{
+		m_PresentCallback = std::move(callback);
+	}
+
+	void graphics::GetCamera(scene::camerastate& camera) const
+	{
+		scene::camerastate previous;
+		m_Scene.GetCamera(previous, camera);
+	}
+
+	// Only a camera that moved is set, so a capture does not get a camera event for every step.
+	void graphics::MoveCamera(const scene::camerastate& camera)
+	{
+		scene::camerastate previous, current;
+		m_Scene.GetCamera(previous, current);
+		if (std::memcmp(&camera, &current, sizeof(camera)) != 0)
+		{
+			m_Scene.RestoreCamera(previous, camera);
+		}
+	}
+
+	bool graphics::IsCapturing() const
+	{
+		return m_Capture != nullptr;
+	}
+
+	core::entity graphics::Pick(INT x, INT y, FLOAT& distance)
+	{
+		ray cast = m_Scene.GetScreenRay(static_cast<FLOAT>(x), static_cast<FLOAT>(y),
+			static_cast<FLOAT>(m_ScreenWidth), static_cast<FLOAT>(m_ScreenHeight), m_ProjectionMatrix);
+		core::entity picked = m_Scene.Pick(cast, distance);
+		m_Scene.Select(picked);
+		return picked;
+	}
+
+	void graphics::DefragmentMeshes()
+	{
+		m_MeshHeap->RequestDefragment();
+	}
+
+	// A minimized window reports a size of zero, it keeps drawing at the last size until it is restored.
+	void graphics::Resize(INT screenWidth, INT screenHeight)
+	{
+		if (screenWidth <= 0 or screenHeight <= 0 or (screenWidth == m_ScreenWidth and screenHeight == m_ScreenHeight))
+		{
+			return;
+		}
+
+		m_ScreenWidth = screenWidth;
+		m_ScreenHeight = screenHeight;
+		d3d::CreateProjectionMatrix(m_ProjectionMatrix, static_cast<UINT>(screenWidth), static_cast<UINT>(screenHeight), SCREEN_DEPTH, SCREEN_NEAR);
+
+		if (m_Capture)
+		{
+			m_Capture->WindowSize(static_cast<UINT>(m_ScreenWidth), static_cast<UINT>(m_ScreenHeight));
+		}
+	}
+
+	// Render builds the snapshot of the frame on the simulation side, see scene::BuildSnapshot.
+	// Publishing the snapshot hands it to the render thread and returns as soon as
+	// the snapshot drawn before it is finished, so the next frame can be simulated
+	// while this one is being submitted.
+	bool graphics::Render(FLOAT alpha, std::uint64_t inputTime)
+	{
+		const D3DXMATRIX& projectionMatrix = m_ProjectionMatrix;
+		PROFILE_SCOPE("graphics::Render");
+
+		// The render thread is done with the write slot, its arena and lists can be reused.
+		std::uint32_t slot = m_Pipeline->GetWriteSlot();
+		rendersnapshot& snapshot = m_Snapshots[slot];
+		// The terrain uploads cannot be dropped, a slot left without its vertices would be drawn with stale ones,
+		// so their room is taken first while the arena is still empty.
+		snapshot.Reset(m_FrameMemory.BeginFrame(slot), m_Scene.GetEntities().GetEntityCount() + CHARACTER_COUNT);
+		snapshot.Fit(snapshot.terrainUploads, TERRAIN_STREAMING_JOBS);
+		snapshot.Fit(snapshot.terrainVertices, TERRAIN_STREAMING_JOBS * TERRAIN_CHUNK_VERTICES);
+		static_assert(TERRAIN_STREAMING_JOBS * TERRAIN_CHUNK_VERTICES * sizeof(colorvertex) < FRAME_MEMORY_SIZE / 2, "The terrain uploads take most of the frame arena.");
+
+		// Each frame the render thread finished since the last call is one sample for the dynamic resolution,
+		// taking it clears it so no frame is counted twice.
+		FLOAT renderSeconds = m_RenderSeconds.exchange(0.0f);
+		if (renderSeconds > 0.0f)
+		{
+			m_Resolution.Update(renderSeconds);
+			m_HudRenderSeconds = renderSeconds;
+		}
+
+		snapshot.projection = projectionMatrix;
+		snapshot.inputTime = inputTime;
+		ApplyRelocations();
+		snapshot.meshGeneration = m_MeshGeneration;
+		snapshot.screenWidth = static_cast<UINT>(m_ScreenWidth);
+		snapshot.screenHeight = static_cast<UINT>(m_ScreenHeight);
+		m_Resolution.GetRenderSize(snapshot.screenWidth, snapshot.screenHeight, snapshot.renderWidth, snapshot.renderHeight);
+
+		m_Scene.BuildSnapshot(alpha, projectionMatrix, snapshot);
+		AnimateCharacters(alpha, snapshot);
+
+		snapshot.particleVertices.resize(snapshot.Fit(snapshot.particleVertices, m_Particles->GetCount()));
+		UINT particleCount = m_Particles->WriteVertices(m_Jobs, snapshot.particleVertices.data(), static_cast<UINT>(snapshot.particleVertices.size()));
+		snapshot.particleVertices.resize(particleCount);
+
+		UpdateTerrain(projectionMatrix, snapshot);
+		UpdateLights(alpha, projectionMatrix, snapshot);
+		BuildHud(snapshot);
+		CollectDebugLines(snapshot);
+		m_FrameMemoryDropped += snapshot.dropped;
+
+		m_Pipeline->Publish();
+
+		return !m_RenderFailed.exchange(false);
 	}
 
-	// Render method begins with clearing the scene to black.
-	// After that it calls the Render function for the camera object to create
-	// a view matrix based on the camera's location that was set in the constructor.
-	// Once the view matrix is created we get a copy of it from the camera class.
-	// We also get copies of the world and projection matrix from the D3DClass object.
-	// Then the ModelClass::Render function is called to put the green triangle model geometry
-	// on the graphics pipeline. 
-	// With the vertices now prepared we call the color shader to draw the vertices
-	// using the model information and the three matrices for positioning each vertex.
-	// The green triangle is now drawn to the back buffer.
-	// With that the scene is complete and we call EndScene to display it to the screen.
-	bool graphics::Render()
+	// RenderSnapshot begins with resizing the buffers to the window size of the snapshot and clearing the scene to black.
+	// Everything it draws comes from the snapshot.
+	// For every draw the mesh heap page is put on the graphics pipeline
+	// and the color shader draws the indices with the three matrices for positioning each vertex.
+	// With that the scene is complete, the upscaler stretches it over the back buffer, the sprites of the display go on top
+	// and we call EndScene to display it.
+	// The time from here until the present returned is what the dynamic resolution is fed. Without vsync the present
+	// blocks once the GPU is a few frames behind, so while the GPU is the slower side it is the GPU's frame time.
+	void graphics::RenderSnapshot(const rendersnapshot& snapshot)
 	{
-		D3DXMATRIX viewMatrix, projectionMatrix, worldMatrix;
+		const D3DXMATRIX& projectionMatrix = snapshot.projection;
+		ID3D11DeviceContext *devcon = m_d3d.GetDeviceContext();
+		std::uint64_t start = core::profiler::Now();
 		bool result;
+		PROFILE_SCOPE("graphics::RenderSnapshot");
+
+		// Without buffers of the window's size there is nothing to draw into, the resize is tried again next frame.
+		if (!m_d3d.Resize(snapshot.screenWidth, snapshot.screenHeight))
+		{
+			m_RenderFailed.store(true);
+			return;
+		}
+		m_d3d.SetRenderSize(snapshot.renderWidth, snapshot.renderHeight);
 
+		// A requested compaction of the mesh heap runs here as it needs the device context. The meshes it moved
+		// are handed over all at once, a snapshot is never drawn with only some of them patched in.
+		m_MeshHeap->Defragment(devcon, snapshot.meshGeneration);
+		if (!m_MovedMeshes.empty())
+		{
+			std::lock_guard<std::mutex> lock(m_RelocationMutex);
+			m_Relocations.insert(m_Relocations.end(), m_MovedMeshes.begin(), m_MovedMeshes.end());
+			m_RelocatedGeneration = m_MeshHeap->GetGeneration();
+			m_MovedMeshes.clear();
+		}
 
 		// Clear the buffers to begin the scene.
 		m_d3d.BeginScene(0.0f, 0.0f, 0.0f, 1.0f);
 
-		// Generate the view matrix based on the camera's position.
-		m_Camera.Render();
+		// Map the dynamic geometry buffer so per-frame geometry can be written into it.
+		m_DynamicGeometry->BeginFrame(devcon);
 
-		// Get the world, view, and projection matrices from the camera and d3d objects.
-		m_Camera.GetViewMatrix(viewMatrix);
-		m_d3d.GetWorldMatrix(worldMatrix);
-		m_d3d.GetProjectionMatrix(projectionMatrix);
+		// The skinned vertices were computed with the snapshot, here they are only copied.
+		UINT stride = static_cast<UINT>(sizeof(model::VertexType));
+		dynamicbuffer::allocation skinned{};
+		if (!snapshot.skinnedVertices.empty())
+		{
+			UINT size = static_cast<UINT>(snapshot.skinnedVertices.size()) * stride;
+			skinned = m_DynamicGeometry->Allocate(size, stride);
+			if (skinned.data)
+			{
+				std::memcpy(skinned.data, snapshot.skinnedVertices.data(), size);
+			}
+		}
 
-		// Put the model vertex and index buffers on the graphics pipeline to prepare them for drawing.
-		m_Model->Render(m_d3d.GetDeviceContext());
+		dynamicbuffer::allocation particles{};
+		if (!snapshot.particleVertices.empty())
+		{
+			UINT size = static_cast<UINT>(snapshot.particleVertices.size()) * stride;
+			particles = m_DynamicGeometry->Allocate(size, stride);
+			if (particles.data)
+			{
+				std::memcpy(particles.data, snapshot.particleVertices.data(), size);
+			}
+		}
 
-		// Render the model using the color shader.
-		result = m_ColorShader->Render(m_d3d.GetDeviceContext(), m_Model->GetIndexCount(), worldMatrix, viewMatrix, projectionMatrix);
-		if (!result)
+		dynamicbuffer::allocation debugLines{};
+		if (!snapshot.debugVertices.empty())
 		{
-			return false;
+			UINT size = static_cast<UINT>(snapshot.debugVertices.size()) * stride;
+			debugLines = m_DynamicGeometry->Allocate(size, stride);
+			if (debugLines.data)
+			{
+				std::memcpy(debugLines.data, snapshot.debugVertices.data(), size);
+			}
+		}
+
+		UINT spriteStride = static_cast<UINT>(sizeof(spritevertex));
+		dynamicbuffer::allocation sprites{};
+		if (!snapshot.spriteVertices.empty())
+		{
+			UINT size = static_cast<UINT>(snapshot.spriteVertices.size()) * spriteStride;
+			sprites = m_DynamicGeometry->Allocate(size, spriteStride);
+			if (sprites.data)
+			{
+				std::memcpy(sprites.data, snapshot.spriteVertices.data(), size);
+			}
+		}
+
+		// All per-frame geometry has been written, unmap the buffer before anything is drawn from it.
+		m_DynamicGeometry->EndFrame(devcon);
+
+		// The lights are the same for every lit draw of the frame.
+		if (!m_LightBuffer->Upload(devcon, snapshot.lights.data(), static_cast<UINT>(snapshot.lights.size()), snapshot.lightClusters.data(),
+			snapshot.clusterLights.data(), static_cast<UINT>(snapshot.clusterLights.size()), snapshot.clusterConstants))
+		{
+			m_RenderFailed.store(true);
+		}
+		m_LightBuffer->Bind(devcon);
+		m_ColorShader->SetLighting(true);
+
+		// Chunks that finished loading go into their slots before anything is drawn from them.
+		for (const terrainupload& upload : snapshot.terrainUploads)
+		{
+			m_TerrainChunks->Upload(devcon, upload.slot, &snapshot.terrainVertices[upload.firstVertex]);
+		}
+
+		// The terrain chunks are in world space and all share the buffers of the chunk buffer.
+		if (!snapshot.terrainDraws.empty())
+		{
+			PROFILE_SCOPE("DrawTerrain");
+			D3DXMATRIX worldMatrix;
+			D3DXMatrixIdentity(&worldMatrix);
+
+			m_TerrainChunks->Bind(devcon);
+			devcon->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			core::telemetry::Count(core::counter::statechanges, 1);
+
+			for (const terraindraw& draw : snapshot.terrainDraws)
+			{
+				result = m_ColorShader->Render(devcon, static_cast<int>(draw.indexCount), static_cast<int>(draw.startIndex),
+					static_cast<int>(m_TerrainChunks->GetBaseVertex(draw.slot)), worldMatrix, snapshot.view, projectionMatrix);
+				if (!result)
+				{
+					m_RenderFailed.store(true);
+				}
+			}
+		}
+
+		for (const drawitem& draw : snapshot.draws)
+		{
+			PROFILE_SCOPE("Draw");
+
+			// Set the vertex and index buffers of the heap page to active in the input assembler.
+			m_MeshHeap->Bind(devcon, draw.page, snapshot.meshGeneration);
+			devcon->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			core::telemetry::Count(core::counter::statechanges, 1);
+
+			result = m_ColorShader->Render(devcon, static_cast<int>(draw.indexCount), static_cast<int>(draw.startIndex),
+				static_cast<int>(draw.baseVertex), snapshot.transforms[draw.transform], snapshot.view, projectionMatrix);
+			if (!result)
+			{
+				m_RenderFailed.store(true);
+			}
+		}
+
+		// Skinned meshes take their indices from the mesh heap page and their vertices from the dynamic buffer,
+		// the base vertex points the indices at the mesh's vertices in this frame's part of the ring.
+		// When the ring had no room the characters are left out of the frame.
+		for (const skinneddraw& draw : snapshot.skinnedDraws)
+		{
+			PROFILE_SCOPE("DrawSkinned");
+
+			if (!skinned.data)
+			{
+				break;
+			}
+
+			m_MeshHeap->Bind(devcon, draw.page, snapshot.meshGeneration);
+			m_DynamicGeometry->Bind(devcon, 0, stride);
+			devcon->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			core::telemetry::Count(core::counter::statechanges, 2);
+
+			result = m_ColorShader->Render(devcon, static_cast<int>(draw.indexCount), static_cast<int>(draw.startIndex),
+				static_cast<int>(skinned.offset / stride + draw.firstVertex), snapshot.transforms[draw.transform], snapshot.view, projectionMatrix);
+			if (!result)
+			{
+				m_RenderFailed.store(true);
+			}
+		}
+
+		// The particles are one draw of points, already in world space.
+		if (particles.data)
+		{
+			PROFILE_SCOPE("DrawParticles");
+			D3DXMATRIX worldMatrix;
+			D3DXMatrixIdentity(&worldMatrix);
+
+			m_DynamicGeometry->Bind(devcon, 0, stride);
+			devcon->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+			core::telemetry::Count(core::counter::statechanges, 2);
+			m_ColorShader->SetLighting(false);
+
+			result = m_ColorShader->RenderVertices(devcon, static_cast<int>(snapshot.particleVertices.size()),
+				static_cast<int>(particles.offset / stride), worldMatrix, snapshot.view, projectionMatrix);
+			if (!result)
+			{
+				m_RenderFailed.store(true);
+			}
+		}
+
+		// The debug lines of all threads are one draw of a line list, in world space like the particles.
+		if (debugLines.data)
+		{
+			PROFILE_SCOPE("DrawDebugLines");
+			D3DXMATRIX worldMatrix;
+			D3DXMatrixIdentity(&worldMatrix);
+
+			m_DynamicGeometry->Bind(devcon, 0, stride);
+			devcon->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
+			core::telemetry::Count(core::counter::statechanges, 2);
+			m_ColorShader->SetLighting(false);
+
+			result = m_ColorShader->RenderVertices(devcon, static_cast<int>(snapshot.debugVertices.size()),
+				static_cast<int>(debugLines.offset / stride), worldMatrix, snapshot.view, projectionMatrix);
+			if (!result)
+			{
+				m_RenderFailed.store(true);
+			}
+		}
+
+		// Stretch the scene over the window and present it to the screen.
+		upscalebuffer region;
+		m_d3d.GetSceneRegion(region);
+		m_d3d.SetBackBufferTarget();
+		if (!m_Upscaler->Render(devcon, m_d3d.GetSceneView(), region))
+		{
+			m_RenderFailed.store(true);
 		}
 
-		// Present the rendered scene to the screen.
+		// The display goes over the upscaled scene. The new glyphs are uploaded even when the ring had no room
+		// for the sprites, the atlas only hands them out once.
+		if (snapshot.atlasRows)
+		{
+			m_SpriteRenderer->UploadAtlas(devcon, snapshot.atlasTop, snapshot.atlasRows, snapshot.atlasPixels.data());
+		}
+		if (sprites.data)
+		{
+			PROFILE_SCOPE("DrawSprites");
+			D3DXMATRIX orthoMatrix;
+			m_d3d.GetOrthoMatrix(orthoMatrix);
+
+			result = m_SpriteRenderer->Render(devcon, *m_DynamicGeometry, sprites.offset / spriteStride, snapshot.spriteDraws.data(),
+				static_cast<UINT>(snapshot.spriteDraws.size()), snapshot.screenWidth, snapshot.screenHeight, orthoMatrix);
+			if (!result)
+			{
+				m_RenderFailed.store(true);
+			}
+		}
 		m_d3d.EndScene();
 
-		return true;
+		if (snapshot.inputTime and m_PresentCallback)
+		{
+			m_PresentCallback(snapshot.inputTime);
+		}
+
+		m_RenderSeconds.store(static_cast<FLOAT>(static_cast<double>(core::profiler::Now() - start) * m_SecondsPerTick));
+	}
+
+	// The characters stand in a row behind the model and play the same clip, each a bit later than the one before.
+	// The indices go into the mesh heap with the vertices of the bind pose, which the draws never read.
+	void graphics::CreateCharacters()
+	{
+		constexpr UINT rings = 4, sides = 12;
+		constexpr UINT vertexCount = TubeVertexCount(CHARACTER_BONES, rings, sides);
+		constexpr UINT indexCount = TubeIndexCount(CHARACTER_BONES, rings, sides);
+		UINT parents[CHARACTER_BONES];
+		bonepose bindPose[CHARACTER_BONES];
+
+		BuildChainSkeleton(CHARACTER_BONES, CHARACTER_BONE_LENGTH, parents, bindPose);
+		m_CharacterSkeleton = std::make_unique<skeleton>(parents, bindPose, CHARACTER_BONES);
+
+		std::vector<bonepose> frames(CHARACTER_BONES * CHARACTER_CLIP_FRAMES);
+		BuildSwayFrames(CHARACTER_BONES, CHARACTER_BONE_LENGTH, CHARACTER_CLIP_FRAMES, 8.0f, frames.data());
+		m_CharacterClip = std::make_unique<animationclip>(frames.data(), CHARACTER_CLIP_FRAMES, CHARACTER_BONES, CHARACTER_CLIP_FPS);
+
+		std::vector<skinnedvertex> vertices(vertexCount);
+		std::vector<std::uint32_t> indices(indexCount);
+		BuildTube(CHARACTER_BONES, rings, sides, CHARACTER_BONE_LENGTH, 0.15f, D3DXVECTOR4(1.0f, 0.5f, 0.0f, 1.0f), vertices.data(), indices.data());
+		m_CharacterSkinner = std::make_unique<characterskinner>(*m_CharacterSkeleton, vertices.data(), vertexCount);
+
+		std::vector<colorvertex> bindVertices(vertexCount);
+		for (UINT i = 0; i < vertexCount; i++)
+		{
+			bindVertices[i].position = vertices[i].position;
+			bindVertices[i].color = vertices[i].color;
+		}
+		std::vector<ULONG> heapIndices(indices.begin(), indices.end());
+		m_CharacterMesh = m_MeshHeap->Allocate(bindVertices.data(), vertexCount, heapIndices.data(), indexCount);
+		if (m_CharacterMesh == meshheap::INVALID_HANDLE)
+		{
+			throw "Unable to store the character mesh.";
+		}
+		m_CharacterRange = m_MeshHeap->GetRange(m_CharacterMesh);
+
+		for (UINT i = 0; i < CHARACTER_COUNT; i++)
+		{
+			m_Characters[i].clip = m_CharacterClip.get();
+		}
+	}
+
+	void graphics::AnimateCharacters(FLOAT alpha, rendersnapshot& snapshot)
+	{
+		PROFILE_SCOPE("graphics::AnimateCharacters");
+		FLOAT time = m_PreviousAnimationTime + (m_AnimationTime - m_PreviousAnimationTime) * alpha;
+		UINT vertexCount = m_CharacterSkinner->GetVertexCount();
+		const meshheap::meshrange& range = m_CharacterRange;
+
+		for (UINT i = 0; i < CHARACTER_COUNT; i++)
+		{
+			m_Characters[i].time = time + 0.3f * static_cast<FLOAT>(i);
+		}
+
+		// Only the characters the frame arena has room for are drawn, each needs its vertices, a draw and a transform.
+		// A character left out counts as one dropped item.
+		UINT64 dropped = snapshot.dropped;
+		UINT characters = static_cast<UINT>(snapshot.Fit(snapshot.skinnedVertices, CHARACTER_COUNT * vertexCount) / vertexCount);
+		characters = static_cast<UINT>(snapshot.Fit(snapshot.skinnedDraws, characters));
+		characters = (std::min)(characters, static_cast<UINT>(snapshot.transforms.capacity() - snapshot.transforms.size()));
+		snapshot.dropped = dropped + CHARACTER_COUNT - characters;
+
+		snapshot.skinnedVertices.resize(characters * vertexCount);
+		m_CharacterSkinner->Animate(m_Jobs, m_Characters, characters, snapshot.skinnedVertices.data());
+
+		for (UINT i = 0; i < characters; i++)
+		{
+			D3DXMATRIX world;
+			D3DXMatrixTranslation(&world, 1.5f * (static_cast<FLOAT>(i) - 0.5f * static_cast<FLOAT>(CHARACTER_COUNT - 1)), -2.0f, 4.0f);
+
+			snapshot.skinnedDraws.push_back(skinneddraw{ range.page, range.indexCount, range.startIndex, i * vertexCount,
+				static_cast<UINT>(snapshot.transforms.size()) });
+			snapshot.transforms.push_back(world);
+		}
+	}
+
+	// The heap belongs to the render thread while it runs, so the characters keep their own copy of their range.
+	void graphics::ApplyRelocations()
+	{
+		std::vector<meshrelocation> relocations;
+		{
+			std::lock_guard<std::mutex> lock(m_RelocationMutex);
+			relocations.swap(m_Relocations);
+			m_MeshGeneration = m_RelocatedGeneration;
+		}
+
+		for (const meshrelocation& moved : relocations)
+		{
+			meshinstance from{ moved.from.page, moved.from.indexCount, moved.from.startIndex, moved.from.baseVertex, 0.0f };
+			meshinstance to{ moved.to.page, moved.to.indexCount, moved.to.startIndex, moved.to.baseVertex, 0.0f };
+			m_Scene.RelocateMesh(from, to);
+			if (moved.mesh == m_CharacterMesh)
+			{
+				m_CharacterRange = moved.to;
+			}
+		}
+	}
+
+	// A fountain between the model and the characters, the sparks fade from yellow to a dark red.
+	void graphics::CreateParticles()
+	{
+		m_Particles = std::make_unique<particlesystem>(PARTICLE_CAPACITY);
+
+		particleemitter fountain{};
+		fountain.position = D3DXVECTOR3(0.0f, -2.0f, 2.0f);
+		fountain.velocity = D3DXVECTOR3(0.0f, 4.0f, 0.0f);
+		fountain.spread = 1.0f;
+		fountain.rate = PARTICLE_RATE;
+		fountain.lifetime = PARTICLE_LIFETIME;
+		fountain.startColor = D3DXVECTOR4(1.0f, 0.9f, 0.3f, 1.0f);
+		fountain.endColor = D3DXVECTOR4(0.4f, 0.0f, 0.0f, 1.0f);
+		m_Particles->AddEmitter(fountain);
+
+		particleforces forces{};
+		forces.gravity = D3DXVECTOR3(0.0f, -3.0f, 0.0f);
+		forces.wind = D3DXVECTOR3(0.5f, 0.0f, 0.0f);
+		forces.drag = 0.2f;
+		m_Particles->SetForces(forces);
+	}
+
+	// The terrain lies below the model and the characters, its centre under the origin.
+	void graphics::CreateTerrain()
+	{
+		std::vector<std::uint16_t> heights(TERRAIN_SIZE * TERRAIN_SIZE);
+		BuildHeightmap(TERRAIN_SIZE, 1, heights.data());
+
+		FLOAT halfExtent = 0.5f * static_cast<FLOAT>(TERRAIN_SIZE - 1) * TERRAIN_SPACING;
+		terrainsettings settings{};
+		settings.origin = D3DXVECTOR3(-halfExtent, -TERRAIN_HEIGHT - 5.0f, -halfExtent);
+		settings.spacing = TERRAIN_SPACING;
+		settings.heightScale = TERRAIN_HEIGHT;
+		settings.pixelError = TERRAIN_PIXEL_ERROR;
+		settings.memoryBudget = TERRAIN_MEMORY_BUDGET;
+		m_Terrain = std::make_unique<terrain>(m_Jobs, heights.data(), TERRAIN_SIZE, settings);
+
+		const std::vector<std::uint32_t>& indices = m_Terrain->GetIndices();
+		m_TerrainChunks = std::make_unique<chunkbuffer>(m_d3d.getDevice(), static_cast<UINT>(sizeof(colorvertex)), TERRAIN_CHUNK_VERTICES,
+			m_Terrain->GetSlotCount(), indices.data(), static_cast<UINT>(indices.size()));
+	}
+
+	// The second row of the projection matrix scales y by the cotangent of half the field of view,
+	// so half the screen height times it is the pixel scale the terrain wants.
+	void graphics::UpdateTerrain(const D3DXMATRIX& projectionMatrix, rendersnapshot& snapshot)
+	{
+		PROFILE_SCOPE("graphics::UpdateTerrain");
+
+		m_Terrain->Update(snapshot.cameraPosition, 0.5f * static_cast<FLOAT>(m_ScreenHeight) * projectionMatrix._22);
+
+		for (const terrain::upload& upload : m_Terrain->GetUploads())
+		{
+			snapshot.terrainUploads.push_back(terrainupload{ upload.slot, static_cast<UINT>(snapshot.terrainVertices.size()) });
+			snapshot.terrainVertices.insert(snapshot.terrainVertices.end(), upload.vertices, upload.vertices + TERRAIN_CHUNK_VERTICES);
+		}
+
+		const std::vector<terrain::draw>& draws = m_Terrain->GetDraws();
+		snapshot.Fit(snapshot.terrainDraws, draws.size());
+		for (const terrain::draw& chunk : draws)
+		{
+			if (snapshot.terrainDraws.size() == snapshot.terrainDraws.capacity())
+			{
+				break;
+			}
+			terrain::indexrange range = m_Terrain->GetStitchRange(chunk.stitch);
+			snapshot.terrainDraws.push_back(terraindraw{ chunk.slot, range.startIndex, range.indexCount });
+		}
+	}
+
+	// The lights are scattered over the terrain in front of the camera from a fixed seed, so every run looks the same.
+	void graphics::CreateLights()
+	{
+		std::uint32_t random = 1;
+		auto next = [&random]()
+		{
+			random ^= random << 13;
+			random ^= random >> 17;
+			random ^= random << 5;
+			return static_cast<FLOAT>(random >> 8) * (1.0f / 16777216.0f);
+		};
+
+		m_Lights.resize(LIGHT_COUNT);
+		m_FrameLights.resize(LIGHT_COUNT);
+		for (UINT i = 0; i < LIGHT_COUNT; i++)
+		{
+			movinglight& moving = m_Lights[i];
+			moving.source.position = D3DXVECTOR3((next() - 0.5f) * LIGHT_AREA, -12.0f + 10.0f * next(), next() * LIGHT_AREA - 20.0f);
+			moving.source.range = 6.0f + 10.0f * next();
+			moving.source.color = D3DXVECTOR3(0.2f + 0.8f * next(), 0.2f + 0.8f * next(), 0.2f + 0.8f * next());
+			moving.source.direction = D3DXVECTOR3(0.0f, -1.0f, 0.0f);
+			moving.source.innerCosine = i % 4 == 0 ? 0.9f : -1.0f;
+			moving.source.outerCosine = i % 4 == 0 ? 0.75f : -1.0f;
+			moving.radius = 2.0f + 8.0f * next();
+			moving.speed = 0.2f + next();
+			moving.phase = 6.2831853f * next();
+		}
+
+		m_LightClusters = std::make_unique<lightclusters>();
+		m_LightBuffer = std::make_unique<lightbuffer>(m_d3d.getDevice());
+	}
+
+	void graphics::UpdateLights(FLOAT alpha, const D3DXMATRIX& projectionMatrix, rendersnapshot& snapshot)
+	{
+		PROFILE_SCOPE("graphics::UpdateLights");
+		FLOAT time = m_PreviousAnimationTime + (m_AnimationTime - m_PreviousAnimationTime) * alpha;
+
+		for (UINT i = 0; i < LIGHT_COUNT; i++)
+		{
+			const movinglight& moving = m_Lights[i];
+			FLOAT angle = moving.phase + moving.speed * time;
+			m_FrameLights[i] = moving.source;
+			m_FrameLights[i].position += D3DXVECTOR3(std::cos(angle), 0.0f, std::sin(angle)) * moving.radius;
+		}
+
+		m_LightClusters->Build(m_Jobs, snapshot.view, projectionMatrix, m_FrameLights.data(), LIGHT_COUNT);
+
+		const std::vector<gpulight>& lights = m_LightClusters->GetLights();
+		const std::vector<clusterrange>& clusters = m_LightClusters->GetClusters();
+		const std::vector<UINT>& indices = m_LightClusters->GetIndices();
+		// The clusters point into the light index list and that into the lights, so either all three fit or no light is sent
+		// and the render thread keeps the ones it has.
+		if (snapshot.Fit(snapshot.lights, lights.size()) == lights.size() and snapshot.Fit(snapshot.lightClusters, clusters.size()) == clusters.size() and
+			snapshot.Fit(snapshot.clusterLights, indices.size()) == indices.size())
+		{
+			snapshot.lights.assign(lights.begin(), lights.end());
+			snapshot.lightClusters.assign(clusters.begin(), clusters.end());
+			snapshot.clusterLights.assign(indices.begin(), indices.end());
+		}
+		// The clustered pixel shader finds its tile from its pixel in the scene target, so the tiles cover the render size.
+		m_LightClusters->GetShaderConstants(static_cast<FLOAT>(snapshot.renderWidth), static_cast<FLOAT>(snapshot.renderHeight),
+			D3DXVECTOR3(LIGHT_AMBIENT, LIGHT_AMBIENT, LIGHT_AMBIENT), snapshot.clusterConstants);
+	}
+
+	// The glyphs are rasterized on the thread that builds the snapshots, which is the only one using the font afterwards.
+	void graphics::CreateHud(HWND hWnd)
+	{
+		m_Font = std::make_unique<fontrasterizer>(HUD_FONT, HUD_FONT_HEIGHT);
+		m_GlyphAtlas = std::make_unique<glyphatlas>(GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, m_Font->GetLineHeight(),
+			[this](std::uint32_t character, glyphbitmap& bitmap) { return m_Font->Rasterize(character, bitmap); });
+		for (std::uint32_t character = ' '; character < 127; character++)
+		{
+			m_GlyphAtlas->Find(character);
+		}
+
+		// The texture is created with the glyphs so far, they do not need to be uploaded again.
+		m_Sprites = std::make_unique<spritebatch>(SPRITE_CAPACITY);
+		m_SpriteRenderer = std::make_unique<spriterenderer>(m_d3d.getDevice(), hWnd, *m_GlyphAtlas);
+		UINT top, rows;
+		m_GlyphAtlas->TakeDirtyRows(GLYPH_ATLAS_SIZE, top, rows);
+	}
+
+	// The display is the text on a translucent panel. The panel is added last but is on the lower layer,
+	// the batch sorts it under the text and both end up in one draw as they share the atlas.
+	void graphics::BuildHud(rendersnapshot& snapshot)
+	{
+		char text[256];
+		PROFILE_SCOPE("graphics::BuildHud");
+
+		std::snprintf(text, sizeof(text), "render %.2f ms\nscale %.0f%% %ux%u\ndraws %u, terrain %u\nparticles %u\nlights %u",
+			1000.0f * m_HudRenderSeconds, 100.0f * m_Resolution.GetScale(), snapshot.renderWidth, snapshot.renderHeight,
+			static_cast<UINT>(snapshot.draws.size()), static_cast<UINT>(snapshot.terrainDraws.size()),
+			static_cast<UINT>(snapshot.particleVertices.size()), static_cast<UINT>(snapshot.lights.size()));
+		core::entity selected = m_Scene.GetSelected();
+		if (selected.IsValid())
+		{
+			size_t length = std::strlen(text);
+			std::snprintf(text + length, sizeof(text) - length, "\npicked entity %u", selected.index);
+		}
+		if (m_FrameMemoryDropped)
+		{
+			size_t length = std::strlen(text);
+			std::snprintf(text + length, sizeof(text) - length, "\ndropped %llu", static_cast<unsigned long long>(m_FrameMemoryDropped));
+		}
+
+		UINT lines = 1;
+		for (const char *c = text; *c; c++)
+		{
+			lines += *c == '\n' ? 1 : 0;
+		}
+
+		m_Sprites->Begin();
+		FLOAT width = m_Sprites->AddText(*m_GlyphAtlas, SPRITE_ATLAS_TEXTURE, text, 16.0f, 16.0f, PackSpriteColor(D3DXVECTOR4(1.0f, 1.0f, 1.0f, 1.0f)), 1);
+		m_Sprites->AddRectangle(*m_GlyphAtlas, SPRITE_ATLAS_TEXTURE, 8.0f, 8.0f, width + 16.0f, static_cast<FLOAT>(lines) * m_GlyphAtlas->GetLineHeight() + 16.0f,
+			PackSpriteColor(D3DXVECTOR4(0.0f, 0.0f, 0.0f, 0.5f)), 0);
+		m_Sprites->End();
+
+		// The draws cover all quads, so the display goes whole or not at all.
+		// Atlas rows without room are left dirty and go with a later frame.
+		const std::vector<spritedraw>& draws = m_Sprites->GetDraws();
+		if (snapshot.Fit(snapshot.spriteVertices, 4 * m_Sprites->GetQuadCount()) == 4 * m_Sprites->GetQuadCount() and
+			snapshot.Fit(snapshot.spriteDraws, draws.size()) == draws.size())
+		{
+			snapshot.spriteVertices.resize(4 * m_Sprites->GetQuadCount());
+			m_Sprites->WriteVertices(snapshot.spriteVertices.data());
+			snapshot.spriteDraws.assign(draws.begin(), draws.end());
+		}
+
+		UINT top, rows;
+		size_t dirtyPixels = static_cast<size_t>(m_GlyphAtlas->GetDirtyRows()) * m_GlyphAtlas->GetWidth();
+		UINT maxRows = static_cast<UINT>(snapshot.Fit(snapshot.atlasPixels, dirtyPixels) / m_GlyphAtlas->GetWidth());
+		if (m_GlyphAtlas->TakeDirtyRows(maxRows, top, rows))
+		{
+			const std::uint8_t *pixels = m_GlyphAtlas->GetPixels() + static_cast<size_t>(top) * m_GlyphAtlas->GetWidth();
+			snapshot.atlasTop = top;
+			snapshot.atlasRows = rows;
+			snapshot.atlasPixels.assign(pixels, pixels + static_cast<size_t>(rows) * m_GlyphAtlas->GetWidth());
+		}
+	}
+
+	// The lines drawn since the last frame are collected even in the frame the debug lines were switched off in,
+	// so none are left over for when they are switched on again. Past that nothing is done while they are off.
+	void graphics::CollectDebugLines(rendersnapshot& snapshot)
+	{
+		bool drawing = debugdraw::IsEnabled();
+		if (!drawing and !m_DebugDrawing)
+		{
+			return;
+		}
+		PROFILE_SCOPE("graphics::CollectDebugLines");
+
+		if (drawing and !m_DebugDrawing)
+		{
+			m_DebugViewProjection = snapshot.view * snapshot.projection;
+		}
+		m_DebugDrawing = drawing;
+		debugdraw::Frustum(m_DebugViewProjection, D3DXVECTOR4(1.0f, 1.0f, 0.0f, 1.0f));
+
+		snapshot.debugVertices.resize(snapshot.Fit(snapshot.debugVertices, (std::min)(debugdraw::GetVertexCount(), DEBUG_DRAW_MAX_VERTICES)));
+		UINT count = debugdraw::Collect(snapshot.debugVertices.data(), static_cast<UINT>(snapshot.debugVertices.size()));
+		snapshot.debugVertices.resize(count);
 	}
-}
\ No newline at end of file
+}
@@ -3,11 +3,34 @@
 // by invoking all the needed class objects for the project.
 #pragma once
 
+#include "jobsystem.h"
 #include "d3d.h"
-#include "camera.h"
+#include "dynamicbuffer.h"
+#include "meshheap.h"
 #include "model.h"
 #include "colorshader.h"
+#include "framepipeline.h"
+#include "rendersnapshot.h"
+#include "scene.h"
+#include "skinning.h"
+#include "particles.h"
+#include "terrain.h"
+#include "chunkbuffer.h"
+#include "capture.h"
+#include "lightclusters.h"
+#include "lightbuffer.h"
+#include "resolutioncontroller.h"
+#include "upscaler.h"
+#include "fontrasterizer.h"
+#include "glyphatlas.h"
+#include "spritebatch.h"
+#include "spriterenderer.h"
+#include "debugdraw.h"
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace graphics
 {
@@ -15,17 +38,211 @@ namespace graphics
 	constexpr BOOL VSYNC_ENABLED = false;
 	constexpr FLOAT SCREEN_DEPTH = 1000.0f;
 	constexpr FLOAT SCREEN_NEAR = 0.1f;
+	constexpr UINT DYNAMIC_GEOMETRY_SIZE = 4 * 1024 * 1024;
+	constexpr UINT JOB_WORKER_THREADS = core::jobsystem::AUTO;
+	// The frame arena of each snapshot slot. What does not fit is dropped and counted on the display,
+	// only the room for the terrain uploads is taken up front.
+	constexpr UINT FRAME_MEMORY_SIZE = 4 * 1024 * 1024;
+
+	// The animated characters standing behind the model: a tube over a chain of bones swaying from side to side.
+	constexpr UINT CHARACTER_COUNT = 8;
+	constexpr UINT CHARACTER_BONES = 16;
+	constexpr FLOAT CHARACTER_BONE_LENGTH = 0.25f;
+	constexpr UINT CHARACTER_CLIP_FRAMES = 121;
+	constexpr FLOAT CHARACTER_CLIP_FPS = 30.0f;
+
+	// The fountain in front of the model. The capacity bounds the points streamed every frame,
+	// the rate and lifetime keep about two thirds of it alive.
+	constexpr UINT PARTICLE_CAPACITY = 32768;
+	constexpr FLOAT PARTICLE_RATE = 8000.0f;
+	constexpr FLOAT PARTICLE_LIFETIME = 2.5f;
+
+	// The terrain under the scene, a square kilometre of generated hills. The budget bounds the chunks kept at once.
+	constexpr UINT TERRAIN_SIZE = 1025;
+	constexpr FLOAT TERRAIN_SPACING = 1.0f;
+	constexpr FLOAT TERRAIN_HEIGHT = 30.0f;
+	constexpr FLOAT TERRAIN_PIXEL_ERROR = 2.0f;
+	constexpr UINT64 TERRAIN_MEMORY_BUDGET = 16 * 1024 * 1024;
+
+	// The lights over the terrain, each circling around its own spot. Every fourth one is a spot light pointing down.
+	// The ambient light is added to all of them and lights what none of them reaches.
+	constexpr UINT LIGHT_COUNT = 1024;
+	constexpr FLOAT LIGHT_AREA = 300.0f;
+	constexpr FLOAT LIGHT_AMBIENT = 0.15f;
+
+	// The dynamic resolution draws the scene at between the minimum scale and the full size of the window,
+	// whatever keeps the frames at the target, see resolutioncontroller.h.
+	constexpr FLOAT RESOLUTION_TARGET_SECONDS = 1.0f / 60.0f;
+	constexpr FLOAT RESOLUTION_MIN_SCALE = 0.5f;
+
+	// The heads-up display in the top left corner of the window. It is drawn over the upscaled scene at the size
+	// of the window, so the text stays sharp whatever size the scene is drawn at.
+	constexpr WCHAR HUD_FONT[] = L"Consolas";
+	constexpr INT HUD_FONT_HEIGHT = 16;
+	constexpr UINT GLYPH_ATLAS_SIZE = 512;
+	constexpr UINT SPRITE_CAPACITY = 16384;
+
+	// The debug lines of a frame, see debugdraw.h. Lines past them are dropped rather than overflowing
+	// the frame memory and the dynamic geometry buffer they are drawn from.
+	constexpr UINT DEBUG_DRAW_MAX_VERTICES = 16384;
+
+	// Budgets for the memory tracker tags the renderer allocates under, see memorytracker.h.
+	constexpr UINT64 MESH_MEMORY_BUDGET = 64 * 1024 * 1024;
+	constexpr UINT64 SHADER_MEMORY_BUDGET = 1 * 1024 * 1024;
+	constexpr UINT64 RENDER_TARGET_MEMORY_BUDGET = 64 * 1024 * 1024;
+	constexpr UINT64 FRAME_MEMORY_BUDGET = 16 * 1024 * 1024;
+
+	// A light and the circle it moves on, around the light's position.
+	struct movinglight
+	{
+		light source;
+		FLOAT radius;
+		FLOAT speed;
+		FLOAT phase;
+	};
+
+	// A mesh the mesh heap moved while it was compacted, and the ranges it moved from and to.
+	struct meshrelocation
+	{
+		meshheap::handle mesh;
+		meshheap::meshrange from;
+		meshheap::meshrange to;
+	};
 
 	class graphics
 	{
 	public:
 		graphics(HWND hWnd, INT screenWidth, INT screenHeight);
 		~graphics();
-		bool Render();
+
+		// The present callback is called on the render thread right after a frame was presented,
+		// with the input time the frame was rendered with. It has to be set before the first Render.
+		typedef std::function<void(std::uint64_t inputTime)> presentcallback;
+
+		// Update advances the scene by one fixed simulation step.
+		// Render captures the scene blended between the previous and the current step by alpha
+		// into a snapshot and hands it to the render thread, which draws it while the next frame is simulated.
+		// The input time is the time of the oldest input that reached the scene since the last Render, 0 when none did.
+		// It returns false when drawing a snapshot failed since the last call, each failure is reported once.
+		void Update(FLOAT stepSeconds);
+		bool Render(FLOAT alpha, std::uint64_t inputTime);
+		void SetPresentCallback(presentcallback callback);
+
+		// GetCamera returns where the camera is at the end of the current step, MoveCamera moves it there.
+		// The camera keeps its state of the step before, frames between the two steps are blended between them.
+		void GetCamera(scene::camerastate& camera) const;
+		void MoveCamera(const scene::camerastate& camera);
+
+		// While a capture runs the window size, the scene changes, the steps and the draw stream
+		// of every frame are written to the file, see capture.h. A capture can be replayed headlessly.
+		bool StartCapture(const char *path);
+		bool StopCapture();
+		bool IsCapturing() const;
+
+		// Pick finds the instance under the point x, y in pixels from the top left of the window
+		// and how far from the camera it was hit, an invalid entity when there is none.
+		// The instance found is selected in the scene and shown on the display, see scene::Select.
+		core::entity Pick(INT x, INT y, FLOAT& distance);
+
+		// DefragmentMeshes asks for the mesh heap to be compacted. The render thread does it before its next frame,
+		// the ranges it moved are patched into the scene before the snapshot after that.
+		void DefragmentMeshes();
+
+		// Resize is called with the new size of the window's client area. The projection changes right away,
+		// the render thread resizes the buffers when it gets the next snapshot.
+		void Resize(INT screenWidth, INT screenHeight);
 	private:
+		// RenderSnapshot runs on the render thread and is the only place that uses the device context
+		// once the constructor is done.
+		void RenderSnapshot(const rendersnapshot& snapshot);
+		// CreateCharacters builds the skeleton, clip and mesh of the characters,
+		// AnimateCharacters skins them into the snapshot at the time blended by alpha.
+		void CreateCharacters();
+		void AnimateCharacters(FLOAT alpha, rendersnapshot& snapshot);
+		// ApplyRelocations patches the ranges the render thread moved into the scene and the characters.
+		void ApplyRelocations();
+		void CreateParticles();
+		// CreateTerrain generates the heightmap, UpdateTerrain streams the chunks around the camera of the snapshot
+		// and records the chunks that arrived and the ones to draw.
+		void CreateTerrain();
+		void UpdateTerrain(const D3DXMATRIX& projectionMatrix, rendersnapshot& snapshot);
+		// CreateLights scatters the lights, UpdateLights moves them to the time blended by alpha,
+		// assigns them to the clusters of the snapshot's view and copies the clusters into the snapshot.
+		void CreateLights();
+		void UpdateLights(FLOAT alpha, const D3DXMATRIX& projectionMatrix, rendersnapshot& snapshot);
+		// CreateHud rasterizes the printable ASCII glyphs into the atlas up front, BuildHud lays out the display
+		// into the sprites of the snapshot along with the atlas rows that got new glyphs since the last frame.
+		void CreateHud(HWND hWnd);
+		void BuildHud(rendersnapshot& snapshot);
+		// CollectDebugLines adds the frustum kept from when the debug lines were switched on and moves the lines
+		// of all threads into the snapshot.
+		void CollectDebugLines(rendersnapshot& snapshot);
+
+		// Work that can be split across cores is run on the job system.
+		// It is created first so the thread constructing graphics becomes worker 0.
+		core::jobsystem m_Jobs;
 		d3d m_d3d;
+		std::unique_ptr<meshheap> m_MeshHeap{};
+		// The render thread collects the meshes it moved while compacting the heap and hands them over together
+		// with the generation they belong to. The simulation side draws with the generation it has patched in.
+		std::vector<meshrelocation> m_MovedMeshes{};
+		std::mutex m_RelocationMutex{};
+		std::vector<meshrelocation> m_Relocations{};
+		UINT64 m_RelocatedGeneration{};
+		UINT64 m_MeshGeneration{};
+		std::unique_ptr<dynamicbuffer> m_DynamicGeometry{};
+		// The model is the mesh asset, the scene is made of entities that refer to its geometry.
 		std::unique_ptr<model> m_Model{};
+		scene m_Scene;
 		std::unique_ptr<colorshader> m_ColorShader{};
-		camera m_Camera{};
+		std::unique_ptr<capturewriter> m_Capture{};
+
+		// The indices of the character mesh are in the mesh heap, the vertices are skinned every frame.
+		std::unique_ptr<skeleton> m_CharacterSkeleton{};
+		std::unique_ptr<animationclip> m_CharacterClip{};
+		std::unique_ptr<characterskinner> m_CharacterSkinner{};
+		meshheap::handle m_CharacterMesh{ meshheap::INVALID_HANDLE };
+		meshheap::meshrange m_CharacterRange{};
+		characterstate m_Characters[CHARACTER_COUNT]{};
+		FLOAT m_PreviousAnimationTime{}, m_AnimationTime{};
+		// The particles move with the simulation steps and are drawn where the last step left them.
+		std::unique_ptr<particlesystem> m_Particles{};
+		// The terrain picks and loads the chunks, the chunk buffer holds the loaded ones on the GPU.
+		std::unique_ptr<terrain> m_Terrain{};
+		std::unique_ptr<chunkbuffer> m_TerrainChunks{};
+		// The lights are clustered on the simulation side, the light buffer holds them on the GPU.
+		std::vector<movinglight> m_Lights{};
+		std::vector<light> m_FrameLights{};
+		std::unique_ptr<lightclusters> m_LightClusters{};
+		std::unique_ptr<lightbuffer> m_LightBuffer{};
+		INT m_ScreenWidth{}, m_ScreenHeight{};
+		D3DXMATRIX m_ProjectionMatrix{};
+		// The controller is fed the time the render thread took for each frame, the upscaler stretches
+		// the scene drawn at the size it picked over the window.
+		resolutioncontroller m_Resolution;
+		std::unique_ptr<upscaler> m_Upscaler{};
+		std::atomic<FLOAT> m_RenderSeconds{};
+		double m_SecondsPerTick{};
+		// The display is laid out with the glyphs of the atlas on the simulation side, the sprite renderer owns
+		// the atlas texture. The render time shown is the last one the render thread reported.
+		std::unique_ptr<fontrasterizer> m_Font{};
+		std::unique_ptr<glyphatlas> m_GlyphAtlas{};
+		std::unique_ptr<spritebatch> m_Sprites{};
+		std::unique_ptr<spriterenderer> m_SpriteRenderer{};
+		FLOAT m_HudRenderSeconds{};
+		// The items dropped since the start because the frame arena of their snapshot was full.
+		UINT64 m_FrameMemoryDropped{};
+		// The view frustum of the frame the debug lines were switched on in, drawn while they stay on
+		// so what the camera culled can be seen from elsewhere.
+		bool m_DebugDrawing{};
+		D3DXMATRIX m_DebugViewProjection{};
+		presentcallback m_PresentCallback{};
+
+		// The pipeline is the last member so its render thread is stopped before anything it draws is destroyed.
+		// Each snapshot slot has its own frame arena, it is reset when the slot is written again.
+		core::frameallocator m_FrameMemory{ FRAME_MEMORY_SIZE, core::framepipeline::SLOT_COUNT };
+		rendersnapshot m_Snapshots[core::framepipeline::SLOT_COUNT];
+		std::atomic<bool> m_RenderFailed{};
+		std::unique_ptr<core::framepipeline> m_Pipeline{};
 	};
 }
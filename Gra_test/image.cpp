@@ -0,0 +1,266 @@
+#include "stdafx.h"
+#include "image.h"
+#include <fstream>
+#include <iterator>
+
+namespace graphics
+{
+	namespace
+	{
+		// Larger images are taken as broken files rather than allocated.
+		constexpr UINT MAX_IMAGE_SIZE{ 16384 };
+
+		std::uint32_t ReadLittle16(const std::uint8_t *data)
+		{
+			return static_cast<std::uint32_t>(data[0]) | static_cast<std::uint32_t>(data[1]) << 8;
+		}
+
+		std::uint32_t ReadLittle32(const std::uint8_t *data)
+		{
+			return ReadLittle16(data) | ReadLittle16(data + 2) << 16;
+		}
+
+		bool Allocate(UINT width, UINT height, imagedata& image)
+		{
+			if (width == 0 or height == 0 or width > MAX_IMAGE_SIZE or height > MAX_IMAGE_SIZE)
+			{
+				return false;
+			}
+
+			image.width = width;
+			image.height = height;
+			image.pixels.assign(static_cast<std::size_t>(width) * height * 4, 0);
+			return true;
+		}
+
+		// Stores one pixel of the file, blue, green, red and alpha for the color formats and one value for grayscale.
+		void StorePixel(const std::uint8_t *source, UINT bytesPerPixel, std::uint8_t *target)
+		{
+			if (bytesPerPixel == 1)
+			{
+				target[0] = target[1] = target[2] = source[0];
+				target[3] = 255;
+				return;
+			}
+
+			target[0] = source[2];
+			target[1] = source[1];
+			target[2] = source[0];
+			target[3] = bytesPerPixel == 4 ? source[3] : 255;
+		}
+
+		// Types 2 and 3 are plain true color and grayscale, 10 and 11 the same run length encoded.
+		// Rows are stored from the bottom up unless bit 5 of the descriptor is set.
+		bool ReadTarga(const std::uint8_t *data, std::size_t size, imagedata& image)
+		{
+			if (size < 18)
+			{
+				return false;
+			}
+
+			UINT type = data[2], bitsPerPixel = data[16];
+			bool encoded = type == 10 or type == 11;
+			bool gray = type == 3 or type == 11;
+			UINT bytesPerPixel = bitsPerPixel / 8;
+
+			if (data[1] != 0 or !(type == 2 or type == 3 or type == 10 or type == 11)
+				or (gray and bitsPerPixel != 8) or (!gray and bitsPerPixel != 24 and bitsPerPixel != 32))
+			{
+				return false;
+			}
+			if (!Allocate(ReadLittle16(data + 12), ReadLittle16(data + 14), image))
+			{
+				return false;
+			}
+
+			bool topDown = (data[17] & 0x20) != 0;
+			std::size_t position = 18 + data[0];
+			std::size_t pixelCount = static_cast<std::size_t>(image.width) * image.height;
+			std::size_t pixel = 0;
+
+			while (pixel < pixelCount)
+			{
+				UINT run = 1;
+				bool repeat = false;
+				if (encoded)
+				{
+					if (position >= size)
+					{
+						return false;
+					}
+					run = (data[position] & 0x7f) + 1u;
+					repeat = (data[position] & 0x80) != 0;
+					position++;
+				}
+
+				for (UINT i = 0; i < run and pixel < pixelCount; i++, pixel++)
+				{
+					if (position + bytesPerPixel > size)
+					{
+						return false;
+					}
+
+					std::size_t x = pixel % image.width, y = pixel / image.width;
+					std::size_t row = topDown ? y : image.height - 1 - y;
+					StorePixel(data + position, bytesPerPixel, &image.pixels[(row * image.width + x) * 4]);
+
+					if (!repeat or i + 1 == run)
+					{
+						position += bytesPerPixel;
+					}
+				}
+			}
+
+			return true;
+		}
+
+		// Only uncompressed bitmaps are read, 32-bit ones with bit fields are taken to be BGRA like nearly all of them are.
+		// A negative height means the rows are stored from the top down.
+		bool ReadBitmap(const std::uint8_t *data, std::size_t size, imagedata& image)
+		{
+			if (size < 54)
+			{
+				return false;
+			}
+
+			std::uint32_t offset = ReadLittle32(data + 10);
+			std::int32_t width = static_cast<std::int32_t>(ReadLittle32(data + 18));
+			std::int32_t height = static_cast<std::int32_t>(ReadLittle32(data + 22));
+			UINT bitsPerPixel = ReadLittle16(data + 28);
+			std::uint32_t compression = ReadLittle32(data + 30);
+
+			if ((bitsPerPixel != 24 and bitsPerPixel != 32) or (compression != 0 and compression != 3) or width <= 0 or height == 0)
+			{
+				return false;
+			}
+
+			bool topDown = height < 0;
+			UINT rows = static_cast<UINT>(topDown ? -height : height);
+			if (!Allocate(static_cast<UINT>(width), rows, image))
+			{
+				return false;
+			}
+
+			UINT bytesPerPixel = bitsPerPixel / 8;
+			std::size_t pitch = (static_cast<std::size_t>(width) * bytesPerPixel + 3) & ~static_cast<std::size_t>(3);
+			if (offset + pitch * rows > size)
+			{
+				return false;
+			}
+
+			for (UINT y = 0; y < rows; y++)
+			{
+				const std::uint8_t *source = data + offset + pitch * (topDown ? y : rows - 1 - y);
+				for (UINT x = 0; x < image.width; x++)
+				{
+					StorePixel(source + x * bytesPerPixel, bytesPerPixel, &image.pixels[(static_cast<std::size_t>(y) * image.width + x) * 4]);
+				}
+			}
+
+			return true;
+		}
+
+		// The header of a PPM or PGM file is numbers separated by white space, with comments from # to the end of the line.
+		bool ReadHeaderNumber(const std::uint8_t *data, std::size_t size, std::size_t& position, UINT& value)
+		{
+			for (;;)
+			{
+				while (position < size and (data[position] == ' ' or data[position] == '\t' or data[position] == '\r' or data[position] == '\n'))
+				{
+					position++;
+				}
+				if (position < size and data[position] == '#')
+				{
+					while (position < size and data[position] != '\n')
+					{
+						position++;
+					}
+					continue;
+				}
+				break;
+			}
+
+			if (position >= size or data[position] < '0' or data[position] > '9')
+			{
+				return false;
+			}
+
+			value = 0;
+			while (position < size and data[position] >= '0' and data[position] <= '9' and value < MAX_IMAGE_SIZE * 16)
+			{
+				value = value * 10 + (data[position++] - '0');
+			}
+			return true;
+		}
+
+		// P6 is RGB, P5 grayscale, both with at most 255 per value. The samples start after one white space character.
+		bool ReadPortablePixmap(const std::uint8_t *data, std::size_t size, imagedata& image)
+		{
+			UINT width, height, maximum;
+			std::size_t position = 2;
+			UINT channels = data[1] == '6' ? 3 : 1;
+
+			if (!ReadHeaderNumber(data, size, position, width) or !ReadHeaderNumber(data, size, position, height)
+				or !ReadHeaderNumber(data, size, position, maximum) or maximum == 0 or maximum > 255)
+			{
+				return false;
+			}
+			if (!Allocate(width, height, image))
+			{
+				return false;
+			}
+
+			position++;
+			std::size_t pixelCount = static_cast<std::size_t>(width) * height;
+			if (position + pixelCount * channels > size)
+			{
+				return false;
+			}
+
+			for (std::size_t pixel = 0; pixel < pixelCount; pixel++)
+			{
+				const std::uint8_t *source = data + position + pixel * channels;
+				std::uint8_t *target = &image.pixels[pixel * 4];
+				for (UINT channel = 0; channel < 3; channel++)
+				{
+					target[channel] = static_cast<std::uint8_t>(source[channels == 3 ? channel : 0] * 255u / maximum);
+				}
+				target[3] = 255;
+			}
+
+			return true;
+		}
+	}
+
+	bool ReadImage(const std::uint8_t *data, std::size_t size, imagedata& image)
+	{
+		if (!data or size < 2)
+		{
+			return false;
+		}
+
+		if (data[0] == 'B' and data[1] == 'M')
+		{
+			return ReadBitmap(data, size, image);
+		}
+		if (data[0] == 'P' and (data[1] == '5' or data[1] == '6'))
+		{
+			return ReadPortablePixmap(data, size, image);
+		}
+
+		// Targa files have no signature, the header is checked instead.
+		return ReadTarga(data, size, image);
+	}
+
+	bool ReadImageFile(const char *path, imagedata& image)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		if (!file)
+		{
+			return false;
+		}
+
+		std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		return ReadImage(data.data(), data.size(), image);
+	}
+}
@@ -0,0 +1,24 @@
+// image.h : include file for reading source images
+// Textures are imported from uncompressed image files: Targa (true color and grayscale, plain or run length encoded),
+// Windows bitmaps with 24 or 32 bits per pixel and binary PPM and PGM. Whatever the file holds,
+// the image comes out as 8-bit RGBA rows from the top down, the color values as they were stored (sRGB for color maps).
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "d3dxmath.h"
+
+namespace graphics
+{
+	struct imagedata
+	{
+		UINT width{};
+		UINT height{};
+		std::vector<std::uint8_t> pixels{};
+	};
+
+	// ReadImage picks the format from the first bytes of the data. It returns false for anything it cannot read.
+	bool ReadImage(const std::uint8_t *data, std::size_t size, imagedata& image);
+	bool ReadImageFile(const char *path, imagedata& image);
+}
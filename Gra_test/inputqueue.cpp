@@ -0,0 +1,69 @@
+#include "stdafx.h"
+#include "inputqueue.h"
+
+namespace core
+{
+	inputqueue::inputqueue(std::uint32_t capacity)
+	{
+		if (capacity < 2 or (capacity & (capacity - 1)) != 0)
+		{
+			throw "Incorrect input queue capacity.";
+		}
+
+		m_events.resize(capacity);
+		m_mask = capacity - 1;
+	}
+
+	// The indices run freely and wrap at 2^32, the difference of the two is the number of queued events.
+	// The release store of the head publishes the event written before it to the consumer.
+	bool inputqueue::Push(const inputevent& event)
+	{
+		std::uint32_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_cachedTail > m_mask)
+		{
+			m_cachedTail = m_tail.load(std::memory_order_acquire);
+			if (head - m_cachedTail > m_mask)
+			{
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+		}
+
+		m_events[head & m_mask] = event;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool inputqueue::Peek(inputevent& event)
+	{
+		std::uint32_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_cachedHead)
+		{
+			m_cachedHead = m_head.load(std::memory_order_acquire);
+			if (tail == m_cachedHead)
+			{
+				return false;
+			}
+		}
+
+		event = m_events[tail & m_mask];
+		return true;
+	}
+
+	// The release store of the tail hands the slot back to the producer only after it was read.
+	bool inputqueue::Pop(inputevent& event)
+	{
+		if (!Peek(event))
+		{
+			return false;
+		}
+
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		return true;
+	}
+
+	std::uint64_t inputqueue::GetDropped() const
+	{
+		return m_dropped.load(std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,70 @@
+// inputqueue.h : include file for the input event queue
+// The window procedure pushes the raw keyboard and mouse events as they arrive, each stamped with the tick of
+// the main loop's time source (see mainloop.h), and the simulation takes them out at the start of every step.
+// The queue is a ring of a fixed power of two capacity with one producer and one consumer and never locks:
+// the producer only writes the head, the consumer only writes the tail, each on its own cache line, and each side
+// keeps a copy of the other one's index so it only reads the shared one when the ring looks full or empty.
+// When the ring is full the newest event is dropped and counted, the ones already queued keep their order.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace core
+{
+	constexpr std::uint32_t INPUT_QUEUE_CAPACITY{ 1024 };
+
+	// Keys carry the virtual key code, buttons one of the mousebutton values.
+	// The mouse position is in pixels from the top left of the client area, a wheel event carries its delta in x,
+	// a notch being 120 (WHEEL_DELTA).
+	// Focus lost means every key and button was let go without the window being told.
+	enum class inputtype : std::uint8_t
+	{
+		keydown, keyup, buttondown, buttonup, mousemove, wheel, focuslost
+	};
+
+	enum class mousebutton : std::uint32_t
+	{
+		left, right, middle
+	};
+
+	struct inputevent
+	{
+		std::uint64_t time;
+		inputtype type;
+		std::uint32_t code;
+		std::int32_t x, y;
+	};
+
+	class inputqueue
+	{
+	public:
+		inputqueue() = delete;
+		inputqueue(std::uint32_t capacity);
+		inputqueue(const inputqueue& other) = delete;
+		~inputqueue() {};
+
+		inputqueue& operator=(const inputqueue& other) = delete;
+
+		// Only the producer calls Push, it returns false when the event was dropped.
+		bool Push(const inputevent& event);
+
+		// Only the consumer calls Peek and Pop. Peek copies the oldest event without taking it,
+		// both return false when the queue is empty.
+		bool Peek(inputevent& event);
+		bool Pop(inputevent& event);
+
+		std::uint64_t GetDropped() const;
+	private:
+		std::vector<inputevent> m_events;
+		std::uint32_t m_mask{};
+
+		alignas(64) std::atomic<std::uint32_t> m_head{};
+		std::uint32_t m_cachedTail{};
+		std::atomic<std::uint64_t> m_dropped{};
+
+		alignas(64) std::atomic<std::uint32_t> m_tail{};
+		std::uint32_t m_cachedHead{};
+	};
+}
@@ -0,0 +1,381 @@
+#include "stdafx.h"
+#include "jobsystem.h"
+#include "profiler.h"
+#include <chrono>
+
+namespace core
+{
+	namespace
+	{
+		// Every thread belongs to at most one job system at a time.
+		thread_local jobsystem *t_system{};
+		thread_local std::uint32_t t_workerIndex{ jobsystem::NOT_A_WORKER };
+
+		constexpr std::uint32_t SPINS_BEFORE_SLEEP{ 64 };
+	}
+
+	bool jobqueue::Push(job *pushed)
+	{
+		std::int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+		std::int64_t top = m_top.load(std::memory_order_acquire);
+
+		if (bottom - top >= static_cast<std::int64_t>(JOB_QUEUE_SIZE))
+		{
+			return false;
+		}
+
+		// Releasing the slot as well as the fence publishes the job's storage to whoever takes it.
+		m_jobs[bottom & (JOB_QUEUE_SIZE - 1)].store(pushed, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// The owner takes the newest job. When only one job is left the owner
+	// races the thieves for it with the same CAS on top that they use.
+	job* jobqueue::Pop()
+	{
+		std::int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		std::int64_t top = m_top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		job *popped = m_jobs[bottom & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+		if (top == bottom)
+		{
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				popped = nullptr;
+			}
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+
+		return popped;
+	}
+
+	job* jobqueue::Steal()
+	{
+		std::int64_t top = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		std::int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom)
+		{
+			return nullptr;
+		}
+
+		job *stolen = m_jobs[top & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_acquire);
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return nullptr;
+		}
+
+		return stolen;
+	}
+
+	jobsystem::jobsystem(std::uint32_t workerThreads)
+	{
+		if (t_system)
+		{
+			throw "The thread already belongs to a job system.";
+		}
+
+		if (workerThreads == AUTO)
+		{
+			std::uint32_t hardwareThreads = std::thread::hardware_concurrency();
+			workerThreads = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+		}
+
+		for (std::uint32_t i = 0; i <= workerThreads; i++)
+		{
+			m_workers.push_back(std::unique_ptr<worker>(new worker()));
+			m_workers.back()->random = 0x9e3779b9u * (i + 1);
+		}
+
+		t_system = this;
+		t_workerIndex = 0;
+
+		for (std::uint32_t i = 1; i <= workerThreads; i++)
+		{
+			m_threads.emplace_back(&jobsystem::WorkerMain, this, i);
+		}
+	}
+
+	// Jobs still queued are dropped, owners wait for their counters before shutting down.
+	jobsystem::~jobsystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_running.store(false);
+		}
+		m_wake.notify_all();
+
+		for (auto& thread : m_threads)
+		{
+			thread.join();
+		}
+
+		t_system = nullptr;
+		t_workerIndex = NOT_A_WORKER;
+	}
+
+	void jobsystem::Wait(jobcounter& counter)
+	{
+		std::uint32_t workerIndex = GetWorkerIndex();
+
+		while (!counter.IsDone())
+		{
+			job *found = workerIndex != NOT_A_WORKER ? FindJob(workerIndex) : nullptr;
+			if (found)
+			{
+				Execute(found);
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	std::uint32_t jobsystem::GetWorkerCount() const
+	{
+		return static_cast<std::uint32_t>(m_workers.size());
+	}
+
+	std::uint32_t jobsystem::GetWorkerIndex() const
+	{
+		return t_system == this ? t_workerIndex : NOT_A_WORKER;
+	}
+
+	job* jobsystem::AllocateJob()
+	{
+		std::uint32_t workerIndex = GetWorkerIndex();
+		if (workerIndex == NOT_A_WORKER)
+		{
+			return nullptr;
+		}
+
+		// Only the owner hands out its slots, the acquire pairs with the release in Execute
+		// so the storage is not overwritten before the job that last used it is done with it.
+		worker& current = *m_workers[workerIndex];
+		job *allocated = &current.jobs[current.nextJob & (JOB_QUEUE_SIZE - 1)];
+		if (allocated->busy.load(std::memory_order_acquire))
+		{
+			return nullptr;
+		}
+		allocated->busy.store(true, std::memory_order_relaxed);
+		current.nextJob++;
+
+		return allocated;
+	}
+
+	void jobsystem::Lock(jobcounter& counter)
+	{
+		while (counter.m_locked.exchange(true, std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	void jobsystem::Unlock(jobcounter& counter)
+	{
+		counter.m_locked.store(false, std::memory_order_release);
+	}
+
+	// A job with an unfinished dependency is parked on the dependency's waiting list.
+	// Signal takes the count to zero and empties the list under the same lock,
+	// so a job is either parked before the list is emptied or sees the count at zero.
+	void jobsystem::Submit(job *submitted, jobcounter *dependency)
+	{
+		if (dependency)
+		{
+			Lock(*dependency);
+
+			if (dependency->m_pending.load(std::memory_order_acquire) != 0)
+			{
+				submitted->nextWaiting = dependency->m_waiting;
+				dependency->m_waiting = submitted;
+				Unlock(*dependency);
+				return;
+			}
+
+			Unlock(*dependency);
+		}
+
+		Push(submitted);
+	}
+
+	// Only the job that may be the last one takes the lock, the others just count down.
+	void jobsystem::Signal(jobcounter& counter)
+	{
+		std::int32_t pending = counter.m_pending.load(std::memory_order_relaxed);
+		while (pending > 1)
+		{
+			if (counter.m_pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+			{
+				return;
+			}
+		}
+
+		job *waiting{};
+
+		Lock(counter);
+		if (counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			waiting = counter.m_waiting;
+			counter.m_waiting = nullptr;
+		}
+		Unlock(counter);
+
+		while (waiting)
+		{
+			job *next = waiting->nextWaiting;
+			waiting->nextWaiting = nullptr;
+			if (GetWorkerIndex() != NOT_A_WORKER)
+			{
+				Push(waiting);
+			}
+			else
+			{
+				Execute(waiting);
+			}
+			waiting = next;
+		}
+	}
+
+	void jobsystem::Push(job *pushed)
+	{
+		std::uint32_t workerIndex = GetWorkerIndex();
+
+		if (!m_workers[workerIndex]->queue.Push(pushed))
+		{
+			// The deque is full, running the job here keeps the program going without growing it.
+			Execute(pushed);
+			return;
+		}
+
+		if (m_sleeping.load(std::memory_order_relaxed) > 0)
+		{
+			m_wake.notify_one();
+		}
+	}
+
+	void jobsystem::Execute(job *executed)
+	{
+		jobcounter *counter = executed->counter;
+
+		{
+			PROFILE_SCOPE("Job");
+			executed->invoke(*executed);
+		}
+		executed->busy.store(false, std::memory_order_release);
+
+		if (counter)
+		{
+			Signal(*counter);
+		}
+	}
+
+	// Own jobs first, newest first, which keeps the data they touch in the cache.
+	// Otherwise steal the oldest job of a randomly picked worker, old jobs tend to be the large ones.
+	job* jobsystem::FindJob(std::uint32_t workerIndex)
+	{
+		worker& current = *m_workers[workerIndex];
+
+		job *found = current.queue.Pop();
+		if (found)
+		{
+			return found;
+		}
+
+		std::uint32_t workerCount = GetWorkerCount();
+		if (workerCount < 2)
+		{
+			return nullptr;
+		}
+
+		current.random ^= current.random << 13;
+		current.random ^= current.random >> 17;
+		current.random ^= current.random << 5;
+
+		std::uint32_t start = current.random % workerCount;
+		for (std::uint32_t i = 0; i < workerCount; i++)
+		{
+			std::uint32_t victim = (start + i) % workerCount;
+			if (victim == workerIndex)
+			{
+				continue;
+			}
+
+			found = m_workers[victim]->queue.Steal();
+			if (found)
+			{
+				return found;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Idle workers spin for a short while, since new jobs usually arrive in bursts, and then sleep.
+	// The sleep has a timeout so a job pushed between the last look and the wait is not stranded.
+	void jobsystem::WorkerMain(std::uint32_t workerIndex)
+	{
+		t_system = this;
+		t_workerIndex = workerIndex;
+		profiler::SetThreadName("Worker");
+
+		std::uint32_t idleSpins{};
+
+		while (m_running.load(std::memory_order_relaxed))
+		{
+			job *found = FindJob(workerIndex);
+			if (found)
+			{
+				Execute(found);
+				idleSpins = 0;
+				continue;
+			}
+
+			if (++idleSpins < SPINS_BEFORE_SLEEP)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			if (!m_running.load(std::memory_order_relaxed))
+			{
+				break;
+			}
+			m_sleeping.fetch_add(1, std::memory_order_relaxed);
+			m_wake.wait_for(lock, std::chrono::milliseconds(1));
+			m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+			idleSpins = 0;
+		}
+
+		t_system = nullptr;
+		t_workerIndex = NOT_A_WORKER;
+	}
+
+	// Four pieces per worker leave room to even out pieces that take longer than others.
+	std::uint32_t jobsystem::PickGrain(std::uint32_t count, std::uint32_t minGrain) const
+	{
+		std::uint32_t pieces = GetWorkerCount() * 4;
+		std::uint32_t grain = (count + pieces - 1) / pieces;
+
+		if (grain < minGrain)
+		{
+			grain = minGrain;
+		}
+
+		return grain > 0 ? grain : 1;
+	}
+}
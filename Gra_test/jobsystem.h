@@ -0,0 +1,258 @@
+// jobsystem.h : include file for the work stealing job system
+// The job system runs small pieces of work (jobs) on a fixed set of worker threads.
+// Every worker has its own Chase-Lev deque: the owner pushes and pops jobs at the bottom
+// without locking while idle workers steal from the top of the other deques.
+// The thread that creates the job system becomes worker 0 and takes part in running jobs
+// whenever it waits for a counter, so the main thread is never just blocked.
+// Jobs signal a jobcounter when they finish and can be made to start only after
+// another counter reached zero, which is how dependencies between jobs are expressed.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace core
+{
+	constexpr std::uint32_t JOB_STORAGE_SIZE{ 80 };
+	constexpr std::uint32_t JOB_QUEUE_SIZE{ 4096 };
+
+	class jobsystem;
+	class jobcounter;
+
+	// A job is a type erased callable stored inline, so scheduling never allocates.
+	// The storage is large enough for a lambda capturing around ten pointers.
+	// Job slots are recycled in order. A slot stays busy from the time it is handed out until its job returned,
+	// a job that would reuse a busy slot is run right away on the scheduling thread instead.
+	struct job
+	{
+		void (*invoke)(job& self){};
+		jobcounter *counter{};
+		job *nextWaiting{};
+		std::atomic<bool> busy{};
+		alignas(16) unsigned char storage[JOB_STORAGE_SIZE];
+	};
+
+	// The counter is incremented for every job that will signal it and decremented when such a job ends.
+	// Jobs that depend on the counter are parked in its waiting list and scheduled when it reaches zero.
+	class jobcounter
+	{
+	public:
+		jobcounter() {};
+		jobcounter(const jobcounter& other) = delete;
+		jobcounter& operator=(const jobcounter& other) = delete;
+
+		// The last job takes the count to zero under the lock and releases the lock last,
+		// so a counter that is done is no longer touched and can go out of scope.
+		bool IsDone() const
+		{
+			return m_pending.load(std::memory_order_acquire) == 0 and !m_locked.load(std::memory_order_acquire);
+		}
+	private:
+		friend class jobsystem;
+
+		std::atomic<std::int32_t> m_pending{};
+		std::atomic<bool> m_locked{};
+		job *m_waiting{};
+	};
+
+	// Lock-free work stealing deque from "Correct and Efficient Work-Stealing for Weak Memory Models".
+	// The capacity is fixed, Push fails when the deque is full and the caller runs the job itself.
+	class jobqueue
+	{
+	public:
+		jobqueue() {};
+		jobqueue(const jobqueue& other) = delete;
+		jobqueue& operator=(const jobqueue& other) = delete;
+
+		bool Push(job *pushed);
+		job* Pop();
+		job* Steal();
+	private:
+		// Thieves write top and the owner writes bottom, the padding keeps them on separate cache lines.
+		std::atomic<std::int64_t> m_top{};
+		char m_topPadding[64 - sizeof(std::atomic<std::int64_t>)];
+		std::atomic<std::int64_t> m_bottom{};
+		char m_bottomPadding[64 - sizeof(std::atomic<std::int64_t>)];
+		std::atomic<job*> m_jobs[JOB_QUEUE_SIZE]{};
+	};
+
+	class jobsystem
+	{
+	public:
+		static constexpr std::uint32_t NOT_A_WORKER{ 0xffffffff };
+		static constexpr std::uint32_t AUTO{ 0xffffffff };
+
+		jobsystem() = delete;
+
+		// The worker thread count does not include the calling thread, AUTO picks one thread per
+		// hardware thread besides the caller. With no worker threads every job runs on the caller.
+		jobsystem(std::uint32_t workerThreads);
+		jobsystem(const jobsystem& other) = delete;
+		~jobsystem();
+
+		jobsystem& operator=(const jobsystem& other) = delete;
+
+		// Run schedules a callable taking no arguments.
+		// The counter, if given, is signaled when the job ends.
+		// The job does not start before the dependency counter, if given, has reached zero.
+		// Called from a thread that is not a worker the job is run right away.
+		template<typename F>
+		void Run(F&& function, jobcounter *counter = nullptr, jobcounter *dependency = nullptr);
+
+		// ParallelFor calls function(begin, end) for consecutive sub ranges of [0, count).
+		// The range is split in halves until the pieces are no larger than the grain,
+		// which is picked so every worker gets several pieces to balance the load,
+		// but never below minGrain so tiny pieces do not drown in scheduling overhead.
+		// The first form returns at once and signals the counter, the second waits for the loop to finish.
+		template<typename F>
+		void ParallelFor(std::uint32_t count, std::uint32_t minGrain, F&& function, jobcounter& counter);
+		template<typename F>
+		void ParallelFor(std::uint32_t count, std::uint32_t minGrain, F&& function);
+
+		// Wait runs jobs until the counter reaches zero.
+		void Wait(jobcounter& counter);
+
+		// Number of threads that run jobs, including the thread that created the system.
+		std::uint32_t GetWorkerCount() const;
+
+		// Index of the calling thread, NOT_A_WORKER for threads that do not belong to this system.
+		std::uint32_t GetWorkerIndex() const;
+	private:
+		struct worker
+		{
+			jobqueue queue;
+			job jobs[JOB_QUEUE_SIZE];
+			std::uint32_t nextJob{};
+			std::uint32_t random{};
+		};
+
+		template<typename F>
+		struct rangejob
+		{
+			F function;
+			jobsystem *system;
+			jobcounter *counter;
+			std::uint32_t begin, end, grain;
+
+			void operator()();
+		};
+
+		static void Lock(jobcounter& counter);
+		static void Unlock(jobcounter& counter);
+		void Signal(jobcounter& counter);
+		job* AllocateJob();
+		void Submit(job *submitted, jobcounter *dependency);
+		void Push(job *pushed);
+		void Execute(job *executed);
+		job* FindJob(std::uint32_t workerIndex);
+		void WorkerMain(std::uint32_t workerIndex);
+		std::uint32_t PickGrain(std::uint32_t count, std::uint32_t minGrain) const;
+
+		std::vector<std::unique_ptr<worker>> m_workers{};
+		std::vector<std::thread> m_threads{};
+		std::atomic<bool> m_running{ true };
+		std::atomic<std::int32_t> m_sleeping{};
+		std::mutex m_sleepMutex{};
+		std::condition_variable m_wake{};
+	};
+
+	template<typename F>
+	void jobsystem::Run(F&& function, jobcounter *counter, jobcounter *dependency)
+	{
+		typedef typename std::decay<F>::type callable;
+		static_assert(sizeof(callable) <= JOB_STORAGE_SIZE, "Job callable does not fit into the job storage.");
+		static_assert(alignof(callable) <= 16, "Job callable needs a larger alignment than the job storage.");
+
+		if (counter)
+		{
+			counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		job *created = AllocateJob();
+		if (!created)
+		{
+			// Not a worker thread or no free slot, the dependency has to be complete before the job may run.
+			if (dependency)
+			{
+				Wait(*dependency);
+			}
+			job inlined{};
+			new (inlined.storage) callable(std::forward<F>(function));
+			inlined.invoke = [](job& self)
+			{
+				callable *stored = reinterpret_cast<callable*>(self.storage);
+				(*stored)();
+				stored->~callable();
+			};
+			inlined.counter = counter;
+			Execute(&inlined);
+			return;
+		}
+
+		new (created->storage) callable(std::forward<F>(function));
+		created->invoke = [](job& self)
+		{
+			callable *stored = reinterpret_cast<callable*>(self.storage);
+			(*stored)();
+			stored->~callable();
+		};
+		created->counter = counter;
+		created->nextWaiting = nullptr;
+
+		Submit(created, dependency);
+	}
+
+	// A range job that is larger than the grain schedules its upper half as a new job
+	// and keeps splitting the lower half itself, so idle workers find big pieces to steal first.
+	template<typename F>
+	void jobsystem::rangejob<F>::operator()()
+	{
+		while (end - begin > grain)
+		{
+			std::uint32_t middle = begin + (end - begin) / 2;
+			rangejob<F> upper{ function, system, counter, middle, end, grain };
+			system->Run(upper, counter);
+			end = middle;
+		}
+
+		function(begin, end);
+	}
+
+	template<typename F>
+	void jobsystem::ParallelFor(std::uint32_t count, std::uint32_t minGrain, F&& function, jobcounter& counter)
+	{
+		typedef typename std::decay<F>::type callable;
+
+		if (count == 0)
+		{
+			return;
+		}
+
+		rangejob<callable> whole{ std::forward<F>(function), this, &counter, 0, count, PickGrain(count, minGrain) };
+		Run(whole, &counter);
+	}
+
+	template<typename F>
+	void jobsystem::ParallelFor(std::uint32_t count, std::uint32_t minGrain, F&& function)
+	{
+		jobcounter counter;
+
+		// The callable is only referenced by the jobs, it lives on this stack until Wait returns.
+		auto forward = [&function](std::uint32_t begin, std::uint32_t end)
+		{
+			function(begin, end);
+		};
+
+		ParallelFor(count, minGrain, forward, counter);
+		Wait(counter);
+	}
+}
@@ -0,0 +1,164 @@
+#include "stdafx.h"
+#include "lightbuffer.h"
+#include "lightclusters.h"
+#include "memorytracker.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <cstring>
+
+namespace graphics
+{
+	// The lights and the cluster ranges are structured buffers, the index list a buffer of 32 bit integers.
+	// All of them are dynamic like the constant buffers of the shaders, they are written with WRITE_DISCARD every frame.
+	lightbuffer::lightbuffer(ID3D11Device *dev)
+	{
+		D3D11_BUFFER_DESC bufferDesc{};
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc{};
+		HRESULT result;
+
+		if (!dev)
+		{
+			throw "Incorrect light buffer parameters.";
+		}
+
+		bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+
+		bufferDesc.ByteWidth = sizeof(gpulight) * MAX_CLUSTERED_LIGHTS;
+		bufferDesc.StructureByteStride = sizeof(gpulight);
+		result = dev->CreateBuffer(&bufferDesc, NULL, &m_lights);
+		if (FAILED(result))
+		{
+			throw "Unable to create the light buffer.";
+		}
+
+		bufferDesc.ByteWidth = sizeof(clusterrange) * CLUSTER_COUNT;
+		bufferDesc.StructureByteStride = sizeof(clusterrange);
+		result = dev->CreateBuffer(&bufferDesc, NULL, &m_clusters);
+		if (FAILED(result))
+		{
+			ReleaseBuffers();
+			throw "Unable to create the light cluster buffer.";
+		}
+
+		bufferDesc.ByteWidth = sizeof(UINT) * MAX_CLUSTER_INDICES;
+		bufferDesc.MiscFlags = 0;
+		bufferDesc.StructureByteStride = 0;
+		result = dev->CreateBuffer(&bufferDesc, NULL, &m_indices);
+		if (FAILED(result))
+		{
+			ReleaseBuffers();
+			throw "Unable to create the light index buffer.";
+		}
+
+		bufferDesc.ByteWidth = sizeof(clusterbuffer);
+		bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		result = dev->CreateBuffer(&bufferDesc, NULL, &m_constants);
+		if (FAILED(result))
+		{
+			ReleaseBuffers();
+			throw "Unable to create the light constant buffer.";
+		}
+
+		// Structured buffers are viewed without a format, the index list as unsigned integers.
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+		viewDesc.Buffer.FirstElement = 0;
+		viewDesc.Buffer.NumElements = MAX_CLUSTERED_LIGHTS;
+		result = dev->CreateShaderResourceView(m_lights, &viewDesc, &m_views[0]);
+		if (SUCCEEDED(result))
+		{
+			viewDesc.Buffer.NumElements = CLUSTER_COUNT;
+			result = dev->CreateShaderResourceView(m_clusters, &viewDesc, &m_views[1]);
+		}
+		if (SUCCEEDED(result))
+		{
+			viewDesc.Format = DXGI_FORMAT_R32_UINT;
+			viewDesc.Buffer.NumElements = MAX_CLUSTER_INDICES;
+			result = dev->CreateShaderResourceView(m_indices, &viewDesc, &m_views[2]);
+		}
+		if (FAILED(result))
+		{
+			ReleaseBuffers();
+			throw "Unable to create the light buffer views.";
+		}
+
+		core::memorytracker::Allocated(core::memorytag::dynamicgeometry, GetSize());
+	}
+
+	lightbuffer::~lightbuffer()
+	{
+		core::memorytracker::Freed(core::memorytag::dynamicgeometry, GetSize());
+		ReleaseBuffers();
+	}
+
+	bool lightbuffer::Upload(ID3D11DeviceContext *devcon, const gpulight *lights, UINT lightCount, const clusterrange *clusters,
+		const UINT *indices, UINT indexCount, const clusterbuffer& constants)
+	{
+		lightCount = (std::min)(lightCount, MAX_CLUSTERED_LIGHTS);
+		indexCount = (std::min)(indexCount, MAX_CLUSTER_INDICES);
+
+		return Write(devcon, m_lights, lights, sizeof(gpulight) * lightCount)
+			and Write(devcon, m_clusters, clusters, sizeof(clusterrange) * CLUSTER_COUNT)
+			and Write(devcon, m_indices, indices, sizeof(UINT) * indexCount)
+			and Write(devcon, m_constants, &constants, sizeof(clusterbuffer));
+	}
+
+	void lightbuffer::Bind(ID3D11DeviceContext *devcon)
+	{
+		devcon->PSSetShaderResources(0, 3, m_views);
+		devcon->PSSetConstantBuffers(0, 1, &m_constants);
+
+		core::telemetry::Count(core::counter::statechanges, 2);
+	}
+
+	// Discarding hands back fresh memory, the part past size is left as it is since nothing reads it.
+	bool lightbuffer::Write(ID3D11DeviceContext *devcon, ID3D11Buffer *buffer, const void *data, UINT size)
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+		HRESULT result = devcon->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		if (FAILED(result))
+		{
+			return false;
+		}
+		if (size)
+		{
+			std::memcpy(mappedResource.pData, data, size);
+		}
+		devcon->Unmap(buffer, 0);
+
+		core::telemetry::Count(core::counter::bytesuploaded, size);
+		return true;
+	}
+
+	void lightbuffer::ReleaseBuffers()
+	{
+		for (ID3D11ShaderResourceView *&view : m_views)
+		{
+			if (view)
+			{
+				view->Release();
+				view = nullptr;
+			}
+		}
+
+		ID3D11Buffer **buffers[] = { &m_lights, &m_clusters, &m_indices, &m_constants };
+		for (ID3D11Buffer **buffer : buffers)
+		{
+			if (*buffer)
+			{
+				(*buffer)->Release();
+				*buffer = nullptr;
+			}
+		}
+	}
+
+	UINT64 lightbuffer::GetSize() const
+	{
+		return static_cast<UINT64>(sizeof(gpulight)) * MAX_CLUSTERED_LIGHTS + sizeof(clusterrange) * CLUSTER_COUNT
+			+ static_cast<UINT64>(sizeof(UINT)) * MAX_CLUSTER_INDICES + sizeof(clusterbuffer);
+	}
+}
@@ -0,0 +1,37 @@
+// lightbuffer.h : include file for the GPU side of the light clusters
+// A lightbuffer holds what the clustered pixel shader reads: the lights, the range of the light index list
+// of every cluster, the index list and the constant buffer that turns pixels into clusters.
+// The buffers are dynamic and sized for the limits of lightclusters.h, they are rewritten once per frame
+// and bound to the pixel shader for all lit draws of it.
+#pragma once
+
+#include <d3d11.h>
+#include "shaderparameters.h"
+
+namespace graphics
+{
+	class lightbuffer
+	{
+	public:
+		lightbuffer() = delete;
+		lightbuffer(ID3D11Device *dev);
+		lightbuffer(const lightbuffer& other) = delete;
+		~lightbuffer();
+
+		lightbuffer& operator=(const lightbuffer& other) = delete;
+
+		// Upload replaces the contents of all buffers, the counts are clamped to the limits of lightclusters.h.
+		// The clusters are always CLUSTER_COUNT ranges. It fails when a buffer could not be mapped.
+		bool Upload(ID3D11DeviceContext *devcon, const gpulight *lights, UINT lightCount, const clusterrange *clusters,
+			const UINT *indices, UINT indexCount, const clusterbuffer& constants);
+		// Bind puts the buffers on the pixel shader, the constant buffer in slot 0 and the others in slots 0 to 2.
+		void Bind(ID3D11DeviceContext *devcon);
+	private:
+		void ReleaseBuffers();
+		bool Write(ID3D11DeviceContext *devcon, ID3D11Buffer *buffer, const void *data, UINT size);
+		UINT64 GetSize() const;
+
+		ID3D11Buffer *m_lights{}, *m_clusters{}, *m_indices{}, *m_constants{};
+		ID3D11ShaderResourceView *m_views[3]{};
+	};
+}
@@ -0,0 +1,320 @@
+#include "stdafx.h"
+#include "lightclusters.h"
+#include "profiler.h"
+#include "simdmath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr UINT SLICE_CLUSTERS{ CLUSTER_COLUMNS * CLUSTER_ROWS };
+		constexpr UINT COLUMN_VECTORS{ CLUSTER_COLUMNS / core::FLOATV_WIDTH };
+		static_assert(CLUSTER_COLUMNS % core::FLOATV_WIDTH == 0, "A row of clusters is tested FLOATV_WIDTH columns at a time.");
+		static_assert(MAX_CLUSTERED_LIGHTS <= 0x10000, "Light indices are kept in 16 bits while they are assigned.");
+
+		// Index of the lowest set bit, the value must not be zero.
+		std::uint32_t LowestSetBit(std::uint32_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, value);
+			return index;
+#else
+			return __builtin_ctz(value);
+#endif
+		}
+
+		// How far a value lies outside a range, zero inside it.
+		FLOAT GetOutside(FLOAT value, FLOAT min, FLOAT max)
+		{
+			return (std::max)((std::max)(min - value, value - max), 0.0f);
+		}
+	}
+
+	lightclusters::lightclusters() :
+		m_columnMin(CLUSTER_SLICES * CLUSTER_COLUMNS), m_columnMax(CLUSTER_SLICES * CLUSTER_COLUMNS),
+		m_rowMin(CLUSTER_SLICES * CLUSTER_ROWS), m_rowMax(CLUSTER_SLICES * CLUSTER_ROWS),
+		m_slots(static_cast<std::size_t>(CLUSTER_COUNT) * MAX_LIGHTS_PER_CLUSTER), m_sliceDropped(CLUSTER_SLICES),
+		m_clusters(CLUSTER_COUNT)
+	{
+		m_lights.reserve(MAX_CLUSTERED_LIGHTS);
+		m_bounds.reserve(MAX_CLUSTERED_LIGHTS);
+	}
+
+	// The lights are moved into view space by the jobs, then every job fills the clusters of its slices.
+	// The lists are packed in cluster order, so the index list is the same for any number of workers.
+	void lightclusters::Build(core::jobsystem& jobs, const D3DXMATRIX& viewMatrix, const D3DXMATRIX& projectionMatrix, const light *lights, UINT lightCount)
+	{
+		PROFILE_SCOPE("lightclusters::Build");
+
+		if (!m_hasFroxels or std::memcmp(&m_projection, &projectionMatrix, sizeof(D3DXMATRIX)) != 0)
+		{
+			UpdateFroxels(projectionMatrix);
+		}
+
+		UINT count = (std::min)(lightCount, MAX_CLUSTERED_LIGHTS);
+		m_lights.resize(count);
+		m_bounds.resize(count);
+		jobs.ParallelFor(count, 256, [&](std::uint32_t begin, std::uint32_t end)
+		{
+			TransformLights(viewMatrix, lights, begin, end);
+		});
+
+		jobs.ParallelFor(CLUSTER_SLICES, 1, [this](std::uint32_t begin, std::uint32_t end)
+		{
+			for (UINT slice = begin; slice < end; slice++)
+			{
+				AssignSlice(slice);
+			}
+		});
+
+		UINT offset = 0;
+		m_stats = lightclusterstats{};
+		for (clusterrange& cluster : m_clusters)
+		{
+			cluster.offset = offset;
+			offset += cluster.count;
+			m_stats.maxClusterLights = (std::max)(m_stats.maxClusterLights, cluster.count);
+		}
+		for (UINT dropped : m_sliceDropped)
+		{
+			m_stats.droppedIndices += dropped;
+		}
+		for (const bounds& reach : m_bounds)
+		{
+			m_stats.visibleLights += reach.firstSlice <= reach.lastSlice ? 1 : 0;
+		}
+		m_stats.lights = count;
+		m_stats.indices = offset;
+
+		m_indices.resize(offset);
+		jobs.ParallelFor(CLUSTER_SLICES, 1, [this](std::uint32_t begin, std::uint32_t end)
+		{
+			for (UINT cluster = begin * SLICE_CLUSTERS; cluster < end * SLICE_CLUSTERS; cluster++)
+			{
+				const std::uint16_t *slots = &m_slots[static_cast<std::size_t>(cluster) * MAX_LIGHTS_PER_CLUSTER];
+				std::copy(slots, slots + m_clusters[cluster].count, m_indices.begin() + m_clusters[cluster].offset);
+			}
+		});
+	}
+
+	const std::vector<gpulight>& lightclusters::GetLights() const
+	{
+		return m_lights;
+	}
+
+	const std::vector<clusterrange>& lightclusters::GetClusters() const
+	{
+		return m_clusters;
+	}
+
+	const std::vector<UINT>& lightclusters::GetIndices() const
+	{
+		return m_indices;
+	}
+
+	const lightclusterstats& lightclusters::GetStats() const
+	{
+		return m_stats;
+	}
+
+	void lightclusters::GetShaderConstants(FLOAT screenWidth, FLOAT screenHeight, const D3DXVECTOR3& ambient, clusterbuffer& constants) const
+	{
+		constants.tileScale[0] = static_cast<FLOAT>(CLUSTER_COLUMNS) / screenWidth;
+		constants.tileScale[1] = static_cast<FLOAT>(CLUSTER_ROWS) / screenHeight;
+		constants.depthScale = m_depthScale;
+		constants.depthBias = m_depthBias;
+		constants.ambient = ambient;
+		constants.padding = 0.0f;
+	}
+
+	UINT lightclusters::GetCluster(FLOAT pixelX, FLOAT pixelY, FLOAT viewDepth, FLOAT screenWidth, FLOAT screenHeight) const
+	{
+		UINT column = (std::min)(static_cast<UINT>((std::max)(pixelX * CLUSTER_COLUMNS / screenWidth, 0.0f)), CLUSTER_COLUMNS - 1);
+		UINT row = (std::min)(static_cast<UINT>((std::max)(pixelY * CLUSTER_ROWS / screenHeight, 0.0f)), CLUSTER_ROWS - 1);
+		return (GetSlice(viewDepth) * CLUSTER_ROWS + row) * CLUSTER_COLUMNS + column;
+	}
+
+	// The near and far plane are read back from the projection: the third column maps the view depth z
+	// to (z * _33 + _43) / z, which is 0 at the near and 1 at the far plane.
+	// The slices divide the logarithm of the depth evenly, slice k starts at near * (far / near) ^ (k / CLUSTER_SLICES).
+	// A column covers the view space x of its part of the screen between the depths of a slice,
+	// x = (ndc - _31) * z / _11 is largest and smallest at one of the two depths. Rows are the same in y,
+	// the first row is at the top of the screen.
+	void lightclusters::UpdateFroxels(const D3DXMATRIX& projectionMatrix)
+	{
+		const D3DXMATRIX& p = projectionMatrix;
+		m_projection = projectionMatrix;
+		m_hasFroxels = true;
+
+		m_near = -p._43 / p._33;
+		m_far = p._43 / (1.0f - p._33);
+		FLOAT logRatio = std::log(m_far / m_near);
+		m_depthScale = static_cast<FLOAT>(CLUSTER_SLICES) / logRatio;
+		m_depthBias = -std::log(m_near) * m_depthScale;
+
+		for (UINT slice = 0; slice <= CLUSTER_SLICES; slice++)
+		{
+			m_sliceDepths[slice] = m_near * std::exp(logRatio * static_cast<FLOAT>(slice) / static_cast<FLOAT>(CLUSTER_SLICES));
+		}
+		m_sliceDepths[CLUSTER_SLICES] = m_far;
+
+		for (UINT slice = 0; slice < CLUSTER_SLICES; slice++)
+		{
+			FLOAT nearDepth = m_sliceDepths[slice], farDepth = m_sliceDepths[slice + 1];
+			for (UINT column = 0; column < CLUSTER_COLUMNS; column++)
+			{
+				FLOAT left = (2.0f * column / CLUSTER_COLUMNS - 1.0f - p._31) / p._11;
+				FLOAT right = (2.0f * (column + 1) / CLUSTER_COLUMNS - 1.0f - p._31) / p._11;
+				m_columnMin[slice * CLUSTER_COLUMNS + column] = (std::min)(left * nearDepth, left * farDepth);
+				m_columnMax[slice * CLUSTER_COLUMNS + column] = (std::max)(right * nearDepth, right * farDepth);
+			}
+			for (UINT row = 0; row < CLUSTER_ROWS; row++)
+			{
+				FLOAT top = (1.0f - 2.0f * row / CLUSTER_ROWS - p._32) / p._22;
+				FLOAT bottom = (1.0f - 2.0f * (row + 1) / CLUSTER_ROWS - p._32) / p._22;
+				m_rowMin[slice * CLUSTER_ROWS + row] = (std::min)(bottom * nearDepth, bottom * farDepth);
+				m_rowMax[slice * CLUSTER_ROWS + row] = (std::max)(top * nearDepth, top * farDepth);
+			}
+		}
+	}
+
+	// A point light reaches a sphere of its range. A spot light reaches a cone capped by that sphere: a narrow cone
+	// fits the sphere through its tip and the rim of its base, a wide one the sphere around the rim of its base.
+	// The slices of the sphere get one more on either side for the rounding of the logarithm, the box test is exact.
+	void lightclusters::TransformLights(const D3DXMATRIX& viewMatrix, const light *lights, UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; i++)
+		{
+			const light& source = lights[i];
+			gpulight& target = m_lights[i];
+			bounds& reach = m_bounds[i];
+
+			D3DXVec3TransformCoord(&target.position, &source.position, &viewMatrix);
+			target.range = source.range;
+			target.color = source.color;
+			reach.center = target.position;
+			reach.radius = source.range;
+
+			if (source.outerCosine <= -1.0f)
+			{
+				target.direction = D3DXVECTOR3(0.0f, 0.0f, 1.0f);
+				target.spotCosine = -2.0f;
+				target.spotScale = 1.0f;
+			}
+			else
+			{
+				D3DXVec3TransformNormal(&target.direction, &source.direction, &viewMatrix);
+				D3DXVec3Normalize(&target.direction, &target.direction);
+				target.spotCosine = source.outerCosine;
+				target.spotScale = 1.0f / (std::max)(source.innerCosine - source.outerCosine, 1e-4f);
+
+				FLOAT cosine = (std::max)(source.outerCosine, 0.0f);
+				if (cosine > 0.70710678f)
+				{
+					reach.radius = source.range / (2.0f * cosine);
+					reach.center = target.position + target.direction * reach.radius;
+				}
+				else if (source.outerCosine >= 0.0f)
+				{
+					reach.radius = source.range * std::sqrt(1.0f - cosine * cosine);
+					reach.center = target.position + target.direction * (source.range * cosine);
+				}
+			}
+
+			FLOAT nearest = reach.center.z - reach.radius, farthest = reach.center.z + reach.radius;
+			if (farthest < m_near or nearest > m_far)
+			{
+				reach.firstSlice = 1;
+				reach.lastSlice = 0;
+				continue;
+			}
+			UINT first = GetSlice((std::max)(nearest, m_near)), last = GetSlice((std::min)(farthest, m_far));
+			reach.firstSlice = first ? first - 1 : 0;
+			reach.lastSlice = (std::min)(last + 1, CLUSTER_SLICES - 1);
+		}
+	}
+
+	// The distance from the center of a light's sphere to the box of a cluster is split into the distances
+	// along the three axes. Along z it is the same for the whole slice and along y for a whole row,
+	// along x it is computed for all columns at once, so testing a row is one comparison per FLOATV_WIDTH columns.
+	void lightclusters::AssignSlice(UINT slice)
+	{
+		const FLOAT nearDepth = m_sliceDepths[slice], farDepth = m_sliceDepths[slice + 1];
+		const FLOAT *columnMin = &m_columnMin[slice * CLUSTER_COLUMNS], *columnMax = &m_columnMax[slice * CLUSTER_COLUMNS];
+		const FLOAT *rowMin = &m_rowMin[slice * CLUSTER_ROWS], *rowMax = &m_rowMax[slice * CLUSTER_ROWS];
+		const UINT firstCluster = slice * SLICE_CLUSTERS;
+		clusterrange *clusters = &m_clusters[firstCluster];
+		std::uint16_t *slots = &m_slots[static_cast<std::size_t>(firstCluster) * MAX_LIGHTS_PER_CLUSTER];
+		const core::floatv zero = core::SplatV(0.0f);
+		UINT dropped = 0;
+
+		for (UINT cluster = 0; cluster < SLICE_CLUSTERS; cluster++)
+		{
+			clusters[cluster].count = 0;
+		}
+
+		for (UINT i = 0; i < static_cast<UINT>(m_bounds.size()); i++)
+		{
+			const bounds& reach = m_bounds[i];
+			if (slice < reach.firstSlice or slice > reach.lastSlice)
+			{
+				continue;
+			}
+
+			FLOAT radiusSq = reach.radius * reach.radius;
+			FLOAT outsideZ = GetOutside(reach.center.z, nearDepth, farDepth);
+			FLOAT leftSq = radiusSq - outsideZ * outsideZ;
+			if (leftSq <= 0.0f)
+			{
+				continue;
+			}
+
+			core::floatv centerX = core::SplatV(reach.center.x);
+			core::floatv outsideXSq[COLUMN_VECTORS];
+			for (UINT v = 0; v < COLUMN_VECTORS; v++)
+			{
+				core::floatv outside = core::MaxV(core::MaxV(core::SubV(core::LoadV(columnMin + v * core::FLOATV_WIDTH), centerX),
+					core::SubV(centerX, core::LoadV(columnMax + v * core::FLOATV_WIDTH))), zero);
+				outsideXSq[v] = core::MulV(outside, outside);
+			}
+
+			for (UINT row = 0; row < CLUSTER_ROWS; row++)
+			{
+				FLOAT outsideY = GetOutside(reach.center.y, rowMin[row], rowMax[row]);
+				FLOAT rowLeftSq = leftSq - outsideY * outsideY;
+				if (rowLeftSq <= 0.0f)
+				{
+					continue;
+				}
+
+				core::floatv limit = core::SplatV(rowLeftSq);
+				for (UINT v = 0; v < COLUMN_VECTORS; v++)
+				{
+					for (std::uint32_t hits = static_cast<std::uint32_t>(core::LessMaskV(outsideXSq[v], limit)); hits; hits &= hits - 1)
+					{
+						UINT cluster = row * CLUSTER_COLUMNS + v * core::FLOATV_WIDTH + LowestSetBit(hits);
+						UINT& count = clusters[cluster].count;
+						if (count == MAX_LIGHTS_PER_CLUSTER)
+						{
+							dropped++;
+							continue;
+						}
+						slots[cluster * MAX_LIGHTS_PER_CLUSTER + count++] = static_cast<std::uint16_t>(i);
+					}
+				}
+			}
+		}
+
+		m_sliceDropped[slice] = dropped;
+	}
+
+	UINT lightclusters::GetSlice(FLOAT viewDepth) const
+	{
+		FLOAT slice = std::log((std::max)(viewDepth, 1e-6f)) * m_depthScale + m_depthBias;
+		return slice <= 0.0f ? 0 : (std::min)(static_cast<UINT>(slice), CLUSTER_SLICES - 1);
+	}
+}
@@ -0,0 +1,113 @@
+// lightclusters.h : include file for the assignment of lights to the clusters of the view frustum
+// The view frustum is cut into CLUSTER_COLUMNS by CLUSTER_ROWS tiles of the screen and CLUSTER_SLICES slices of depth,
+// whose thickness grows with the distance so the clusters stay about as deep as they are wide. Every frame the
+// lights are moved into view space and each one is added to the list of every cluster its bounding sphere touches.
+// The lists are packed into one light index list with an offset and count per cluster, which the clustered pixel
+// shader reads for the cluster of its pixel, so it only evaluates the lights that can reach it.
+// The box around a cluster is separable into a range of x that only depends on its column and slice, a range of y
+// that only depends on its row and slice and the range of z of its slice, so a sphere is tested against a whole
+// row of clusters at once, FLOATV_WIDTH columns per instruction (see simdmath.h). The slices are assigned by the jobs.
+// It does not need a device, the buffers are uploaded by the lightbuffer.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+#include "shaderparameters.h"
+
+namespace graphics
+{
+	// These must be the same as the defines in clustered.ps.
+	constexpr UINT CLUSTER_COLUMNS{ 16 };
+	constexpr UINT CLUSTER_ROWS{ 9 };
+	constexpr UINT CLUSTER_SLICES{ 24 };
+	constexpr UINT CLUSTER_COUNT{ CLUSTER_COLUMNS * CLUSTER_ROWS * CLUSTER_SLICES };
+	// Lights past the first MAX_CLUSTERED_LIGHTS are ignored, lights past the first MAX_LIGHTS_PER_CLUSTER
+	// of a cluster are left out of it. The index list is never longer than the product of the cluster limits.
+	constexpr UINT MAX_CLUSTERED_LIGHTS{ 4096 };
+	constexpr UINT MAX_LIGHTS_PER_CLUSTER{ 128 };
+	constexpr UINT MAX_CLUSTER_INDICES{ CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER };
+
+	// A point or spot light in the world. Its light fades out at range.
+	// Spot lights are full inside the inner cone and fade out towards the outer one, the cones are given as the cosines
+	// of their half angles. A light with an outer cosine of -1 or less is a point light and the direction is unused.
+	struct light
+	{
+		D3DXVECTOR3 position;
+		FLOAT range;
+		D3DXVECTOR3 color;
+		D3DXVECTOR3 direction;
+		FLOAT innerCosine;
+		FLOAT outerCosine;
+	};
+
+	// The lights of the last Build: how many were used and how many reached into the depth of the clusters,
+	// the length of the index list, the most lights in one cluster and the indices left out because a cluster was full.
+	struct lightclusterstats
+	{
+		UINT lights;
+		UINT visibleLights;
+		UINT indices;
+		UINT maxClusterLights;
+		UINT droppedIndices;
+	};
+
+	class lightclusters
+	{
+	public:
+		lightclusters();
+		lightclusters(const lightclusters& other) = delete;
+		~lightclusters() {};
+
+		lightclusters& operator=(const lightclusters& other) = delete;
+
+		// Build assigns the lights to the clusters of the view and projection, which has to be a perspective
+		// projection like the one of d3d. The clusters reach from its near to its far plane.
+		void Build(core::jobsystem& jobs, const D3DXMATRIX& viewMatrix, const D3DXMATRIX& projectionMatrix, const light *lights, UINT lightCount);
+
+		// The lights in view space, the range of the index list of every cluster and the index list itself, as uploaded.
+		const std::vector<gpulight>& GetLights() const;
+		const std::vector<clusterrange>& GetClusters() const;
+		const std::vector<UINT>& GetIndices() const;
+		const lightclusterstats& GetStats() const;
+
+		// GetShaderConstants fills the constant buffer of the clustered pixel shader for a screen of width by height pixels.
+		// GetCluster finds the cluster of a pixel at a view depth the same way the shader does.
+		void GetShaderConstants(FLOAT screenWidth, FLOAT screenHeight, const D3DXVECTOR3& ambient, clusterbuffer& constants) const;
+		UINT GetCluster(FLOAT pixelX, FLOAT pixelY, FLOAT viewDepth, FLOAT screenWidth, FLOAT screenHeight) const;
+	private:
+		// The sphere around everything a light reaches, in view space, and the slices it overlaps.
+		struct bounds
+		{
+			D3DXVECTOR3 center;
+			FLOAT radius;
+			UINT firstSlice;
+			UINT lastSlice;
+		};
+
+		void UpdateFroxels(const D3DXMATRIX& projectionMatrix);
+		void TransformLights(const D3DXMATRIX& viewMatrix, const light *lights, UINT begin, UINT end);
+		void AssignSlice(UINT slice);
+		UINT GetSlice(FLOAT viewDepth) const;
+
+		D3DXMATRIX m_projection{};
+		bool m_hasFroxels{};
+		FLOAT m_near{}, m_far{};
+		FLOAT m_depthScale{}, m_depthBias{};
+		// The view depth where every slice starts, the last one is the far plane.
+		FLOAT m_sliceDepths[CLUSTER_SLICES + 1]{};
+		// The ranges of x of the columns and of y of the rows, slice after slice.
+		std::vector<FLOAT> m_columnMin{}, m_columnMax{};
+		std::vector<FLOAT> m_rowMin{}, m_rowMax{};
+
+		std::vector<bounds> m_bounds{};
+		// MAX_LIGHTS_PER_CLUSTER light indices for every cluster, written by the job of its slice and packed afterwards.
+		std::vector<std::uint16_t> m_slots{};
+		std::vector<UINT> m_sliceDropped{};
+
+		std::vector<gpulight> m_lights{};
+		std::vector<clusterrange> m_clusters{};
+		std::vector<UINT> m_indices{};
+		lightclusterstats m_stats{};
+	};
+}
@@ -0,0 +1,142 @@
+#include "stdafx.h"
+#include "mainloop.h"
+#include "profiler.h"
+
+namespace app
+{
+	mainloop::mainloop(timesource& timeSource, messagesource& messages, const loopsettings& settings) :
+		m_time(timeSource), m_messages(messages), m_settings(settings)
+	{
+		if (settings.tickRate <= 0.0 or settings.maxStepsPerFrame == 0)
+		{
+			throw "Incorrect main loop settings.";
+		}
+
+		// All timing is done in integer clock ticks so that the number of simulation steps
+		// does not drift with floating point rounding over a long session.
+		std::uint64_t frequency = m_time.Frequency();
+		m_stepTicks = static_cast<std::uint64_t>(frequency / settings.tickRate);
+		if (m_stepTicks == 0)
+		{
+			m_stepTicks = 1;
+		}
+
+		if (settings.maxFrameRate > 0.0)
+		{
+			m_minFrameTicks = static_cast<std::uint64_t>(frequency / settings.maxFrameRate);
+		}
+
+		// A frame that took longer than this (a breakpoint, dragging the window) is treated
+		// as if it took this long so the simulation does not try to catch up all at once.
+		m_maxFrameTicks = m_stepTicks * settings.maxStepsPerFrame;
+
+		m_lastTick = m_time.Now();
+	}
+
+	int mainloop::Run(looptarget& target)
+	{
+		m_lastTick = m_time.Now();
+
+		while (Step(target))
+		{
+		}
+
+		return m_messages.GetExitCode();
+	}
+
+	// The time since the previous iteration is added to an accumulator and the simulation
+	// runs as many fixed steps as fit into it. What is left over is less than one step
+	// and becomes the interpolation factor for rendering.
+	// When a frame cap is set the loop waits for the rest of the frame after rendering.
+	bool mainloop::Step(looptarget& target)
+	{
+		PROFILE_SCOPE("mainloop::Step");
+
+		{
+			PROFILE_SCOPE("PumpMessages");
+			if (!m_messages.PumpMessages())
+			{
+				return false;
+			}
+		}
+
+		std::uint64_t frameStart = m_time.Now();
+		std::uint64_t elapsed = frameStart - m_lastTick;
+		m_lastTick = frameStart;
+
+		m_stats.frameTicks = elapsed;
+		m_stats.frameSeconds = static_cast<double>(elapsed) / static_cast<double>(m_time.Frequency());
+
+		// The time since the last iteration is the full frame: messages, updates, render and pacing.
+		// The first iteration measures the time since Run started, which is no frame at all.
+		if (m_telemetry and m_stats.frame > 0)
+		{
+			m_telemetry->RecordFrame(m_stats.frameSeconds);
+		}
+
+		std::uint64_t clampedTicks = 0;
+		if (elapsed > m_maxFrameTicks)
+		{
+			clampedTicks = elapsed - m_maxFrameTicks;
+			elapsed = m_maxFrameTicks;
+		}
+		m_accumulator += elapsed;
+
+		double stepSeconds = static_cast<double>(m_stepTicks) / static_cast<double>(m_time.Frequency());
+		std::uint32_t steps{};
+
+		// The simulation is behind the frame's start by what is in the accumulator, that is where the first step begins.
+		std::uint64_t stepEnd = frameStart - m_accumulator;
+
+		while (m_accumulator >= m_stepTicks and steps < m_settings.maxStepsPerFrame)
+		{
+			PROFILE_SCOPE("Update");
+			stepEnd += m_stepTicks;
+			target.Update(stepSeconds, stepEnd);
+			m_accumulator -= m_stepTicks;
+			steps++;
+			m_stats.step++;
+		}
+
+		// Anything still above one step could not be simulated in time and is dropped,
+		// like the whole steps of the time the clamp cut off.
+		m_stats.droppedSteps = static_cast<std::uint32_t>(clampedTicks / m_stepTicks);
+		if (m_accumulator >= m_stepTicks)
+		{
+			m_stats.droppedSteps += static_cast<std::uint32_t>(m_accumulator / m_stepTicks);
+			m_accumulator %= m_stepTicks;
+		}
+
+		m_stats.stepsThisFrame = steps;
+		m_stats.alpha = static_cast<double>(m_accumulator) / static_cast<double>(m_stepTicks);
+
+		{
+			PROFILE_SCOPE("RenderFrame");
+			target.RenderFrame(m_stats.alpha);
+		}
+		m_stats.frame++;
+
+		if (m_minFrameTicks > 0)
+		{
+			PROFILE_SCOPE("WaitUntil");
+			m_time.WaitUntil(frameStart + m_minFrameTicks);
+		}
+
+		return true;
+	}
+
+	const framestats& mainloop::GetStats() const
+	{
+		return m_stats;
+	}
+
+	std::uint64_t mainloop::GetStepTicks() const
+	{
+		return m_stepTicks;
+	}
+
+	void mainloop::SetTelemetry(core::telemetry *frameTelemetry)
+	{
+		m_telemetry = frameTelemetry;
+	}
+}
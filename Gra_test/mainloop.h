@@ -0,0 +1,109 @@
+// mainloop.h : include file for the platform independent main loop
+// The main loop drains the pending window messages without blocking, advances the simulation
+// in fixed time steps and renders once per iteration with the interpolation factor
+// between the last two simulation steps.
+// Time and messages come through the timesource and messagesource interfaces so the loop itself
+// does not depend on Windows and can be driven by a fake time source and fake messages.
+#pragma once
+
+#include <cstdint>
+#include "telemetry.h"
+
+namespace app
+{
+	// The time source returns time in ticks of its own frequency.
+	// WaitUntil blocks until the given tick, a fake time source can simply jump to it.
+	class timesource
+	{
+	public:
+		virtual ~timesource() {};
+		virtual std::uint64_t Now() = 0;
+		virtual std::uint64_t Frequency() = 0;
+		virtual void WaitUntil(std::uint64_t tick) = 0;
+	};
+
+	// PumpMessages handles every message that is waiting and returns right away.
+	// It returns false once the application was asked to quit.
+	class messagesource
+	{
+	public:
+		virtual ~messagesource() {};
+		virtual bool PumpMessages() = 0;
+		virtual int GetExitCode() = 0;
+	};
+
+	// The loop target is what the main loop drives.
+	// Update advances the simulation by exactly one fixed step, which ends at stepEndTick of the time source.
+	// The steps of a frame run back to back, the tick is where the step lies in real time,
+	// so input stamped with the same time source can be applied at the right moment of the right step.
+	// RenderFrame draws the state blended between the previous and the current step by alpha.
+	class looptarget
+	{
+	public:
+		virtual ~looptarget() {};
+		virtual void Update(double stepSeconds, std::uint64_t stepEndTick) = 0;
+		virtual void RenderFrame(double alpha) = 0;
+	};
+
+	struct loopsettings
+	{
+		// Number of simulation steps per second.
+		double tickRate{ 60.0 };
+
+		// Upper limit of simulation steps run before a frame is rendered.
+		// When the simulation cannot keep up the remaining time is dropped instead
+		// of making every following frame even slower.
+		std::uint32_t maxStepsPerFrame{ 5 };
+
+		// Rendered frames per second, 0 renders as fast as possible.
+		double maxFrameRate{ 0.0 };
+	};
+
+	// The dropped steps are the whole steps of the frame's time that were never simulated,
+	// because the frame took longer than maxStepsPerFrame steps.
+	struct framestats
+	{
+		std::uint64_t frame{};
+		std::uint64_t step{};
+		std::uint64_t frameTicks{};
+		double frameSeconds{};
+		double alpha{};
+		std::uint32_t stepsThisFrame{};
+		std::uint32_t droppedSteps{};
+	};
+
+	class mainloop
+	{
+	public:
+		mainloop() = delete;
+		mainloop(timesource& timeSource, messagesource& messages, const loopsettings& settings);
+		mainloop(const mainloop& other) = delete;
+		~mainloop() {};
+
+		mainloop& operator=(const mainloop& other) = delete;
+
+		// Run calls Step until the message source asks to quit and returns its exit code.
+		int Run(looptarget& target);
+
+		// Step is a single iteration of the loop: messages, simulation steps, render and pacing.
+		// It returns false when the application should quit.
+		bool Step(looptarget& target);
+
+		const framestats& GetStats() const;
+		std::uint64_t GetStepTicks() const;
+
+		// The telemetry, if set, gets the duration of every frame once the next one starts.
+		void SetTelemetry(core::telemetry *frameTelemetry);
+	private:
+		timesource& m_time;
+		messagesource& m_messages;
+		loopsettings m_settings;
+		std::uint64_t m_stepTicks{};
+		std::uint64_t m_minFrameTicks{};
+		std::uint64_t m_maxFrameTicks{};
+		std::uint64_t m_lastTick{};
+		std::uint64_t m_accumulator{};
+		framestats m_stats{};
+		core::telemetry *m_telemetry{};
+	};
+}
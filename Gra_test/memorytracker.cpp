@@ -0,0 +1,139 @@
+#include "stdafx.h"
+#include "memorytracker.h"
+#include <cstdio>
+#include <mutex>
+
+namespace core
+{
+	memorytracker::tagcounters memorytracker::s_tags[static_cast<std::uint32_t>(memorytag::count)]{};
+
+	namespace
+	{
+		const char *const g_tagNames[] = { "general", "frame", "scratch", "meshes", "dynamic_geometry", "shaders", "render_targets", "textures", "profiler" };
+
+		std::mutex g_callbackMutex;
+		memorytracker::budgetcallback g_budgetCallback;
+
+		double Megabytes(std::uint64_t bytes)
+		{
+			return static_cast<double>(bytes) / (1024.0 * 1024.0);
+		}
+	}
+
+	// Only the allocation that takes the tag from within its budget to over it raises the warning,
+	// the ones after it find the tag already over the budget.
+	void memorytracker::Allocated(memorytag tag, std::uint64_t bytes)
+	{
+		tagcounters& counters = s_tags[static_cast<std::uint32_t>(tag)];
+
+		std::uint64_t before = counters.current.fetch_add(bytes, std::memory_order_relaxed);
+		std::uint64_t after = before + bytes;
+		counters.allocations.fetch_add(1, std::memory_order_relaxed);
+
+		std::uint64_t peak = counters.peak.load(std::memory_order_relaxed);
+		while (after > peak and !counters.peak.compare_exchange_weak(peak, after, std::memory_order_relaxed))
+		{
+		}
+
+		std::uint64_t budget = counters.budget.load(std::memory_order_relaxed);
+		if (budget and before <= budget and after > budget)
+		{
+			RaiseWarning(tag, after, budget);
+		}
+	}
+
+	void memorytracker::Freed(memorytag tag, std::uint64_t bytes)
+	{
+		s_tags[static_cast<std::uint32_t>(tag)].current.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	// A budget set below what the tag already uses warns right away.
+	void memorytracker::SetBudget(memorytag tag, std::uint64_t bytes)
+	{
+		tagcounters& counters = s_tags[static_cast<std::uint32_t>(tag)];
+		counters.budget.store(bytes, std::memory_order_relaxed);
+
+		std::uint64_t current = counters.current.load(std::memory_order_relaxed);
+		if (bytes and current > bytes)
+		{
+			RaiseWarning(tag, current, bytes);
+		}
+	}
+
+	void memorytracker::SetBudgetCallback(budgetcallback callback)
+	{
+		std::lock_guard<std::mutex> lock(g_callbackMutex);
+		g_budgetCallback = callback;
+	}
+
+	memorystats memorytracker::GetStats(memorytag tag)
+	{
+		const tagcounters& counters = s_tags[static_cast<std::uint32_t>(tag)];
+		memorystats stats;
+
+		stats.current = counters.current.load(std::memory_order_relaxed);
+		stats.peak = counters.peak.load(std::memory_order_relaxed);
+		stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+		stats.budget = counters.budget.load(std::memory_order_relaxed);
+
+		return stats;
+	}
+
+	std::uint64_t memorytracker::GetTotal()
+	{
+		std::uint64_t total = 0;
+		for (const tagcounters& counters : s_tags)
+		{
+			total += counters.current.load(std::memory_order_relaxed);
+		}
+		return total;
+	}
+
+	void memorytracker::ResetPeaks()
+	{
+		for (tagcounters& counters : s_tags)
+		{
+			counters.peak.store(counters.current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	}
+
+	const char* memorytracker::GetName(memorytag tag)
+	{
+		return tag < memorytag::count ? g_tagNames[static_cast<std::uint32_t>(tag)] : "unknown";
+	}
+
+	int memorytracker::FormatWarning(const memorybudgetwarning& warning, char *buffer, std::size_t size)
+	{
+		return std::snprintf(buffer, size, "Memory budget exceeded for %s: %.2f MB of %.2f MB",
+			GetName(warning.tag), Megabytes(warning.current), Megabytes(warning.budget));
+	}
+
+	int memorytracker::FormatReport(char *buffer, std::size_t size)
+	{
+		int written = std::snprintf(buffer, size, "Memory: %.2f MB", Megabytes(GetTotal()));
+
+		for (std::uint32_t i = 0; i < static_cast<std::uint32_t>(memorytag::count) and written >= 0 and static_cast<std::size_t>(written) < size; i++)
+		{
+			memorystats stats = GetStats(static_cast<memorytag>(i));
+			written += std::snprintf(buffer + written, size - written, "%s %s %.2f MB (peak %.2f MB)", i ? "," : ";",
+				g_tagNames[i], Megabytes(stats.current), Megabytes(stats.peak));
+		}
+
+		return written;
+	}
+
+	// The callback is copied out of the lock so it may change the budgets or the callback itself.
+	void memorytracker::RaiseWarning(memorytag tag, std::uint64_t current, std::uint64_t budget)
+	{
+		budgetcallback callback;
+		{
+			std::lock_guard<std::mutex> lock(g_callbackMutex);
+			callback = g_budgetCallback;
+		}
+
+		if (callback)
+		{
+			callback(memorybudgetwarning{ tag, current, budget });
+		}
+	}
+}
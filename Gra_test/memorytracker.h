@@ -0,0 +1,80 @@
+// memorytracker.h : include file for per subsystem memory accounting
+// Every long lived block of memory the engine allocates is reported under a tag:
+//  - the CPU blocks of the allocators (general arenas and pools, the frame arenas, the scratch stacks),
+//  - the GPU buffers of the mesh heap and the dynamic geometry ring,
+//  - the shader byte code and constant buffers of the shaders,
+//  - the render targets of the device (back buffer and depth buffer),
+//  - the textures created from cooked data,
+//  - the event rings of the profiler.
+// GPU sizes are estimates computed from the resource descriptions, drivers add padding and alignment.
+// The counters are relaxed atomics, reporting is cheap enough for any allocation that is not per item.
+// A tag can have a budget; when the tag grows over it the budget callback is invoked once,
+// and again only after the tag went back under the budget and over it another time.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace core
+{
+	enum class memorytag : std::uint32_t
+	{
+		general, frame, scratch, meshes, dynamicgeometry, shaders, rendertargets, textures, profiler, count
+	};
+
+	struct memorystats
+	{
+		std::uint64_t current{};
+		std::uint64_t peak{};
+		std::uint64_t allocations{};
+		std::uint64_t budget{};
+	};
+
+	struct memorybudgetwarning
+	{
+		memorytag tag{};
+		std::uint64_t current{};
+		std::uint64_t budget{};
+	};
+
+	class memorytracker
+	{
+	public:
+		typedef std::function<void(const memorybudgetwarning& warning)> budgetcallback;
+
+		memorytracker() = delete;
+
+		static void Allocated(memorytag tag, std::uint64_t bytes);
+		static void Freed(memorytag tag, std::uint64_t bytes);
+
+		// A budget of zero means the tag has none.
+		static void SetBudget(memorytag tag, std::uint64_t bytes);
+		// The callback runs on the thread that reported the allocation.
+		static void SetBudgetCallback(budgetcallback callback);
+
+		static memorystats GetStats(memorytag tag);
+		static std::uint64_t GetTotal();
+		// ResetPeaks lowers the high-water marks to the current sizes, e.g. when a level is loaded.
+		static void ResetPeaks();
+
+		static const char* GetName(memorytag tag);
+
+		// The format functions write one line each and return the number of characters written.
+		static int FormatWarning(const memorybudgetwarning& warning, char *buffer, std::size_t size);
+		static int FormatReport(char *buffer, std::size_t size);
+	private:
+		struct tagcounters
+		{
+			std::atomic<std::uint64_t> current{};
+			std::atomic<std::uint64_t> peak{};
+			std::atomic<std::uint64_t> allocations{};
+			std::atomic<std::uint64_t> budget{};
+		};
+
+		static void RaiseWarning(memorytag tag, std::uint64_t current, std::uint64_t budget);
+
+		static tagcounters s_tags[static_cast<std::uint32_t>(memorytag::count)];
+	};
+}
@@ -0,0 +1,661 @@
+#include "stdafx.h"
+#include "meshbvh.h"
+#include "debugdraw.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr UINT LEAF_TRIANGLES{ 4 };
+		// Blocks the triangles of a large node are cut into for binning.
+		constexpr UINT BIN_BLOCKS{ 64 };
+		// Nodes with fewer triangles are only binned along the axis their centers spread widest along.
+		// They make up most of the levels of the tree, the other two axes rarely win there.
+		constexpr UINT SINGLE_AXIS_TRIANGLES{ 1024 };
+		// Four wide nodes are at most as deep as the binary tree, which BVH_MAX_SAH_DEPTH bounds to well under 100.
+		// Every node visited leaves at most three more on the stack.
+		constexpr UINT STACK_SIZE{ 320 };
+
+		const FLOAT INFINITE_DISTANCE{ std::numeric_limits<FLOAT>::infinity() };
+
+		// Triangle centers are compared as the sum of the minimum and maximum of their box, twice the center.
+		UINT GetBin(FLOAT center, FLOAT origin, FLOAT scale, UINT binCount)
+		{
+			FLOAT bin = (center - origin) * scale;
+			return bin <= 0.0f ? 0 : (std::min)(static_cast<UINT>(bin), binCount - 1);
+		}
+
+		// Half the surface area, all the heuristic needs is to compare them.
+		FLOAT GetArea(const FLOAT *min, const FLOAT *max)
+		{
+			FLOAT x = max[0] - min[0], y = max[1] - min[1], z = max[2] - min[2];
+			return x * y + y * z + z * x;
+		}
+
+		core::float4 Cross4(core::float4 ay, core::float4 az, core::float4 by, core::float4 bz)
+		{
+			return core::Sub4(core::Mul4(ay, bz), core::Mul4(az, by));
+		}
+	}
+
+	// The inverse of the view matrix is the transposed rotation, the camera sits where the translation came from.
+	// A perspective projection scales x and y over the distance, the direction in view space is undone from that.
+	ray ScreenRay(FLOAT x, FLOAT y, FLOAT width, FLOAT height, const D3DXMATRIX& viewMatrix, const D3DXMATRIX& projectionMatrix)
+	{
+		const D3DXMATRIX& m = viewMatrix;
+		FLOAT screenX = 2.0f * x / width - 1.0f;
+		FLOAT screenY = 1.0f - 2.0f * y / height;
+		D3DXVECTOR3 direction((screenX - projectionMatrix._31) / projectionMatrix._11, (screenY - projectionMatrix._32) / projectionMatrix._22, 1.0f);
+		D3DXVECTOR3 translation(m._41, m._42, m._43);
+		D3DXVECTOR3 rows[3] = { D3DXVECTOR3(m._11, m._12, m._13), D3DXVECTOR3(m._21, m._22, m._23), D3DXVECTOR3(m._31, m._32, m._33) };
+		ray cast;
+
+		cast.origin = D3DXVECTOR3(-D3DXVec3Dot(&translation, &rows[0]), -D3DXVec3Dot(&translation, &rows[1]), -D3DXVec3Dot(&translation, &rows[2]));
+		cast.direction = D3DXVECTOR3(D3DXVec3Dot(&direction, &rows[0]), D3DXVec3Dot(&direction, &rows[1]), D3DXVec3Dot(&direction, &rows[2]));
+		D3DXVec3Normalize(&cast.direction, &cast.direction);
+		return cast;
+	}
+
+	meshbvh::meshbvh(core::jobsystem& jobs, const colorvertex *vertices, UINT vertexCount, const std::uint32_t *indices, UINT indexCount) :
+		m_triangleCount(indexCount / 3), m_vertices(vertices), m_indices(indices)
+	{
+		PROFILE_SCOPE("meshbvh::Build");
+
+		if (indexCount % 3 != 0)
+		{
+			throw "Incorrect mesh BVH index count.";
+		}
+		for (UINT i = 0; i < indexCount; i++)
+		{
+			if (indices[i] >= vertexCount)
+			{
+				throw "Incorrect mesh BVH index.";
+			}
+		}
+		if (m_triangleCount == 0)
+		{
+			return;
+		}
+
+		m_references.resize(m_triangleCount);
+		jobs.ParallelFor(m_triangleCount, 4096, [this](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t triangle = begin; triangle < end; triangle++)
+			{
+				box& bounds = m_references[triangle].bounds;
+				bounds.min[3] = bounds.max[3] = 0.0f;
+				for (UINT axis = 0; axis < 3; axis++)
+				{
+					FLOAT a = (&m_vertices[m_indices[3 * triangle]].position.x)[axis];
+					FLOAT b = (&m_vertices[m_indices[3 * triangle + 1]].position.x)[axis];
+					FLOAT c = (&m_vertices[m_indices[3 * triangle + 2]].position.x)[axis];
+					bounds.min[axis] = (std::min)((std::min)(a, b), c);
+					bounds.max[axis] = (std::max)((std::max)(a, b), c);
+				}
+				m_references[triangle].triangle = triangle;
+			}
+		});
+
+		// A binary tree over n triangles has at most 2n - 1 nodes, the children of a node are allocated together.
+		m_buildNodes.resize(2 * static_cast<std::size_t>(m_triangleCount) - 1);
+		m_usedBuildNodes = 1;
+		BuildNode(jobs, 0, 0, m_triangleCount, 0);
+		m_bounds = m_buildNodes[0].bounds;
+
+		m_nodes.reserve(m_usedBuildNodes / 3 + 1);
+		m_leaves.reserve(m_triangleCount / 2 + 1);
+		std::int32_t root = Collapse(0);
+		if (root < 0)
+		{
+			// A mesh of a single leaf still gets a node, every cast starts at node 0.
+			node single{};
+			for (UINT lane = 0; lane < 4; lane++)
+			{
+				for (UINT axis = 0; axis < 3; axis++)
+				{
+					single.bounds[axis][lane] = lane ? INFINITE_DISTANCE : m_bounds.min[axis];
+					single.bounds[axis + 3][lane] = lane ? -INFINITE_DISTANCE : m_bounds.max[axis];
+				}
+				single.children[lane] = lane ? EMPTY_CHILD : root;
+			}
+			m_nodes.push_back(single);
+		}
+
+		m_vertices = nullptr;
+		m_indices = nullptr;
+		std::vector<reference>().swap(m_references);
+		std::vector<buildnode>().swap(m_buildNodes);
+	}
+
+	// The children are visited nearest first, leaves are tested as soon as their box is hit
+	// since every hit shortens the ray for the boxes still to come.
+	bool meshbvh::Intersect(const ray& cast, FLOAT maxDistance, rayhit& hit) const
+	{
+		struct pending
+		{
+			std::int32_t child;
+			FLOAT distance;
+		};
+
+		if (m_nodes.empty())
+		{
+			return false;
+		}
+
+		// A direction of zero along an axis is nudged off it, so the boxes are never at zero times infinity.
+		const FLOAT *direction = &cast.direction.x, *origin = &cast.origin.x;
+		core::float4 origins[3], directions[3], inverses[3];
+		UINT nearSide[3], farSide[3];
+		for (UINT axis = 0; axis < 3; axis++)
+		{
+			FLOAT along = std::fabs(direction[axis]) < 1e-20f ? std::copysign(1e-20f, direction[axis]) : direction[axis];
+			origins[axis] = core::Splat4(origin[axis]);
+			directions[axis] = core::Splat4(direction[axis]);
+			inverses[axis] = core::Splat4(1.0f / along);
+			nearSide[axis] = along < 0.0f ? axis + 3 : axis;
+			farSide[axis] = along < 0.0f ? axis : axis + 3;
+		}
+
+		pending stack[STACK_SIZE];
+		UINT stackSize = 0;
+		FLOAT closest = maxDistance;
+		bool found = false;
+		core::float4 zero = core::Splat4(0.0f);
+
+		stack[stackSize++] = pending{ 0, 0.0f };
+		while (stackSize)
+		{
+			pending visited = stack[--stackSize];
+			if (visited.distance > closest)
+			{
+				continue;
+			}
+
+			const node& tested = m_nodes[visited.child];
+			core::float4 enter = zero, leave = core::Splat4(closest);
+			for (UINT axis = 0; axis < 3; axis++)
+			{
+				enter = core::Max4(enter, core::Mul4(core::Sub4(core::Load4(tested.bounds[nearSide[axis]]), origins[axis]), inverses[axis]));
+				leave = core::Min4(leave, core::Mul4(core::Sub4(core::Load4(tested.bounds[farSide[axis]]), origins[axis]), inverses[axis]));
+			}
+
+			FLOAT distances[4];
+			core::Store4(distances, enter);
+			pending children[4];
+			UINT childCount = 0;
+
+			for (int hits = ~core::LessMask4(leave, enter) & 15; hits; hits &= hits - 1)
+			{
+				UINT lane = 0;
+				while (!(hits & (1 << lane)))
+				{
+					lane++;
+				}
+
+				std::int32_t child = tested.children[lane];
+				if (child >= 0)
+				{
+					children[childCount++] = pending{ child, distances[lane] };
+				}
+				else
+				{
+					found |= IntersectLeaf(m_leaves[~child], origins, directions, closest, hit);
+				}
+			}
+
+			// Farthest first, so the nearest is popped next.
+			for (UINT i = 1; i < childCount; i++)
+			{
+				pending moved = children[i];
+				UINT j = i;
+				for (; j > 0 and children[j - 1].distance < moved.distance; j--)
+				{
+					children[j] = children[j - 1];
+				}
+				children[j] = moved;
+			}
+			for (UINT i = 0; i < childCount; i++)
+			{
+				stack[stackSize++] = children[i];
+			}
+		}
+
+		return found;
+	}
+
+	UINT meshbvh::GetTriangleCount() const
+	{
+		return m_triangleCount;
+	}
+
+	UINT meshbvh::GetNodeCount() const
+	{
+		return static_cast<UINT>(m_nodes.size());
+	}
+
+	void meshbvh::GetBounds(D3DXVECTOR3& min, D3DXVECTOR3& max) const
+	{
+		min = D3DXVECTOR3(m_bounds.min[0], m_bounds.min[1], m_bounds.min[2]);
+		max = D3DXVECTOR3(m_bounds.max[0], m_bounds.max[1], m_bounds.max[2]);
+	}
+
+	void meshbvh::DebugDraw(const D3DXMATRIX& world, UINT maxDepth, const D3DXVECTOR4& color) const
+	{
+		if (!debugdraw::IsEnabled() or m_nodes.empty())
+		{
+			return;
+		}
+
+		D3DXVECTOR3 min, max;
+		GetBounds(min, max);
+		debugdraw::Box(world, min, max, color);
+		if (maxDepth > 0)
+		{
+			DebugDrawNode(world, 0, 1, maxDepth, color);
+		}
+	}
+
+	// The boxes of a node are those of its children, leaves included. Empty lanes are skipped.
+	void meshbvh::DebugDrawNode(const D3DXMATRIX& world, UINT index, UINT depth, UINT maxDepth, const D3DXVECTOR4& color) const
+	{
+		const node& drawn = m_nodes[index];
+
+		for (UINT lane = 0; lane < 4; lane++)
+		{
+			std::int32_t child = drawn.children[lane];
+			if (child == EMPTY_CHILD)
+			{
+				continue;
+			}
+
+			debugdraw::Box(world, D3DXVECTOR3(drawn.bounds[0][lane], drawn.bounds[1][lane], drawn.bounds[2][lane]),
+				D3DXVECTOR3(drawn.bounds[3][lane], drawn.bounds[4][lane], drawn.bounds[5][lane]), color);
+			if (child >= 0 and depth < maxDepth)
+			{
+				DebugDrawNode(world, static_cast<UINT>(child), depth + 1, maxDepth, color);
+			}
+		}
+	}
+
+	// For every axis the split between two bins with the lowest area weighted triangle counts on both sides wins.
+	void meshbvh::BuildNode(core::jobsystem& jobs, UINT index, UINT first, UINT count, UINT depth)
+	{
+		struct bin
+		{
+			box bounds;
+			UINT count;
+		};
+
+		// The bins of every axis and the box around the triangles and around their centers, of a block of triangles.
+		struct blockbins
+		{
+			bin bins[3][BVH_BINS];
+			box bounds;
+			box centers;
+		};
+
+		auto emptyBox = []()
+		{
+			return box{ { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+		};
+		auto grow = [](box& target, const box& added)
+		{
+			core::Store4(target.min, core::Min4(core::Load4(target.min), core::Load4(added.min)));
+			core::Store4(target.max, core::Max4(core::Load4(target.max), core::Load4(added.max)));
+		};
+
+		bool parallel = count > BVH_PARALLEL_TRIANGLES;
+		UINT blocks = parallel ? BIN_BLOCKS : 1;
+		std::vector<blockbins> blockBins(parallel ? BIN_BLOCKS : 0);
+		blockbins serialBins;
+		blockbins *results = parallel ? blockBins.data() : &serialBins;
+
+		// The boxes first, the bins need the box around the centers.
+		auto boundBlocks = [&](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t block = begin; block < end; block++)
+			{
+				core::float4 boundsMin = core::Splat4(FLT_MAX), boundsMax = core::Splat4(-FLT_MAX);
+				core::float4 centersMin = boundsMin, centersMax = boundsMax;
+				for (UINT i = first + static_cast<UINT>(static_cast<UINT64>(count) * block / blocks), last = first + static_cast<UINT>(static_cast<UINT64>(count) * (block + 1) / blocks); i < last; i++)
+				{
+					const box& triangle = m_references[i].bounds;
+					core::float4 min = core::Load4(triangle.min), max = core::Load4(triangle.max), center = core::Add4(min, max);
+					boundsMin = core::Min4(boundsMin, min);
+					boundsMax = core::Max4(boundsMax, max);
+					centersMin = core::Min4(centersMin, center);
+					centersMax = core::Max4(centersMax, center);
+				}
+				core::Store4(results[block].bounds.min, boundsMin);
+				core::Store4(results[block].bounds.max, boundsMax);
+				core::Store4(results[block].centers.min, centersMin);
+				core::Store4(results[block].centers.max, centersMax);
+			}
+		};
+		if (parallel)
+		{
+			jobs.ParallelFor(blocks, 1, boundBlocks);
+		}
+		else
+		{
+			boundBlocks(0, 1);
+		}
+
+		buildnode& built = m_buildNodes[index];
+		box centers = emptyBox();
+		built.bounds = emptyBox();
+		built.first = first;
+		built.count = count;
+		for (UINT block = 0; block < blocks; block++)
+		{
+			grow(built.bounds, results[block].bounds);
+			grow(centers, results[block].centers);
+		}
+		if (count <= LEAF_TRIANGLES)
+		{
+			return;
+		}
+
+		// Small nodes get fewer bins, there are millions of them and the bins would cost more than the triangles.
+		UINT binCount = (std::min)(BVH_BINS, count);
+		FLOAT scales[4]{};
+		for (UINT axis = 0; axis < 3; axis++)
+		{
+			FLOAT extent = centers.max[axis] - centers.min[axis];
+			scales[axis] = extent > 0.0f ? binCount / extent : 0.0f;
+		}
+
+		if (count < SINGLE_AXIS_TRIANGLES)
+		{
+			UINT widest = scales[1] > 0.0f and centers.max[1] - centers.min[1] > centers.max[0] - centers.min[0] ? 1 : 0;
+			widest = scales[2] > 0.0f and centers.max[2] - centers.min[2] > centers.max[widest] - centers.min[widest] ? 2 : widest;
+			for (UINT axis = 0; axis < 3; axis++)
+			{
+				scales[axis] = axis == widest ? scales[axis] : 0.0f;
+			}
+		}
+
+		UINT middle = first + count / 2;
+		bool binned = depth < BVH_MAX_SAH_DEPTH and (scales[0] > 0.0f or scales[1] > 0.0f or scales[2] > 0.0f);
+		UINT bestAxis = 0, bestSplit = 0;
+
+		if (binned)
+		{
+			auto binBlocks = [&](std::uint32_t begin, std::uint32_t end)
+			{
+				for (std::uint32_t block = begin; block < end; block++)
+				{
+					blockbins& target = results[block];
+					for (UINT axis = 0; axis < 3; axis++)
+					{
+						for (UINT b = 0; b < binCount; b++)
+						{
+							target.bins[axis][b] = bin{ emptyBox(), 0 };
+						}
+					}
+					// The bins of all three axes are found with one subtraction and multiplication.
+					core::float4 origin = core::Load4(centers.min), scale = core::Load4(scales);
+					for (UINT i = first + static_cast<UINT>(static_cast<UINT64>(count) * block / blocks), last = first + static_cast<UINT>(static_cast<UINT64>(count) * (block + 1) / blocks); i < last; i++)
+					{
+						const box& triangle = m_references[i].bounds;
+						core::float4 min = core::Load4(triangle.min), max = core::Load4(triangle.max);
+						FLOAT positions[4];
+						core::Store4(positions, core::Mul4(core::Sub4(core::Add4(min, max), origin), scale));
+
+						for (UINT axis = 0; axis < 3; axis++)
+						{
+							if (scales[axis] == 0.0f)
+							{
+								continue;
+							}
+							bin& counted = target.bins[axis][positions[axis] <= 0.0f ? 0 : (std::min)(static_cast<UINT>(positions[axis]), binCount - 1)];
+							core::Store4(counted.bounds.min, core::Min4(core::Load4(counted.bounds.min), min));
+							core::Store4(counted.bounds.max, core::Max4(core::Load4(counted.bounds.max), max));
+							counted.count++;
+						}
+					}
+				}
+			};
+			if (parallel)
+			{
+				jobs.ParallelFor(blocks, 1, binBlocks);
+			}
+			else
+			{
+				binBlocks(0, 1);
+			}
+
+			FLOAT bestCost = FLT_MAX;
+			for (UINT axis = 0; axis < 3; axis++)
+			{
+				if (scales[axis] == 0.0f)
+				{
+					continue;
+				}
+
+				// The bins of the blocks are added up into those of the first.
+				bin *bins = results[0].bins[axis];
+				for (UINT block = 1; block < blocks; block++)
+				{
+					for (UINT b = 0; b < binCount; b++)
+					{
+						grow(bins[b].bounds, results[block].bins[axis][b].bounds);
+						bins[b].count += results[block].bins[axis][b].count;
+					}
+				}
+
+				// The cost of the right side of every split, swept from the right.
+				FLOAT rightCosts[BVH_BINS];
+				box right = emptyBox();
+				UINT rightCount = 0;
+				for (UINT split = binCount - 1; split > 0; split--)
+				{
+					grow(right, bins[split].bounds);
+					rightCount += bins[split].count;
+					rightCosts[split] = rightCount ? GetArea(right.min, right.max) * rightCount : 0.0f;
+				}
+
+				box left = emptyBox();
+				UINT leftCount = 0;
+				for (UINT split = 1; split < binCount; split++)
+				{
+					grow(left, bins[split - 1].bounds);
+					leftCount += bins[split - 1].count;
+					if (leftCount == 0 or leftCount == count)
+					{
+						continue;
+					}
+
+					FLOAT cost = GetArea(left.min, left.max) * leftCount + rightCosts[split];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = split;
+					}
+				}
+			}
+			binned = bestSplit != 0;
+		}
+
+		if (binned)
+		{
+			FLOAT origin = centers.min[bestAxis], scale = scales[bestAxis];
+			middle = static_cast<UINT>(std::partition(m_references.begin() + first, m_references.begin() + first + count, [&](const reference& triangle)
+			{
+				const box& bounds = triangle.bounds;
+				return GetBin(bounds.min[bestAxis] + bounds.max[bestAxis], origin, scale, binCount) < bestSplit;
+			}) - m_references.begin());
+			binned = middle != first and middle != first + count;
+		}
+		if (!binned)
+		{
+			middle = first + count / 2;
+
+			// The centers along the widest axis are split at the middle triangle.
+			UINT axis = 0;
+			for (UINT other = 1; other < 3; other++)
+			{
+				if (centers.max[other] - centers.min[other] > centers.max[axis] - centers.min[axis])
+				{
+					axis = other;
+				}
+			}
+			std::nth_element(m_references.begin() + first, m_references.begin() + middle, m_references.begin() + first + count, [&](const reference& a, const reference& b)
+			{
+				return a.bounds.min[axis] + a.bounds.max[axis] < b.bounds.min[axis] + b.bounds.max[axis];
+			});
+		}
+
+		UINT left = m_usedBuildNodes.fetch_add(2);
+		built.left = left;
+
+		if (parallel)
+		{
+			core::jobcounter done;
+			jobs.Run([this, &jobs, left, first, middle, depth]()
+			{
+				BuildNode(jobs, left, first, middle - first, depth + 1);
+			}, &done);
+			BuildNode(jobs, left + 1, middle, first + count - middle, depth + 1);
+			jobs.Wait(done);
+		}
+		else
+		{
+			BuildNode(jobs, left, first, middle - first, depth + 1);
+			BuildNode(jobs, left + 1, middle, first + count - middle, depth + 1);
+		}
+	}
+
+	// The node takes the two children of the binary node and keeps opening the largest child that is
+	// not a leaf until it has four. Nodes are written before their children, the root is node 0.
+	std::int32_t meshbvh::Collapse(UINT index)
+	{
+		const buildnode& source = m_buildNodes[index];
+		if (source.count <= LEAF_TRIANGLES)
+		{
+			return AddLeaf(source);
+		}
+
+		UINT created = static_cast<UINT>(m_nodes.size());
+		m_nodes.emplace_back();
+
+		UINT open[4] = { source.left, source.left + 1 };
+		UINT openCount = 2;
+		while (openCount < 4)
+		{
+			UINT widest = openCount;
+			FLOAT widestArea = -1.0f;
+			for (UINT i = 0; i < openCount; i++)
+			{
+				const buildnode& child = m_buildNodes[open[i]];
+				FLOAT area = GetArea(child.bounds.min, child.bounds.max);
+				if (child.count > LEAF_TRIANGLES and area > widestArea)
+				{
+					widest = i;
+					widestArea = area;
+				}
+			}
+			if (widest == openCount)
+			{
+				break;
+			}
+
+			UINT opened = m_buildNodes[open[widest]].left;
+			open[widest] = opened;
+			open[openCount++] = opened + 1;
+		}
+
+		node filled{};
+		for (UINT lane = 0; lane < 4; lane++)
+		{
+			for (UINT axis = 0; axis < 3; axis++)
+			{
+				filled.bounds[axis][lane] = lane < openCount ? m_buildNodes[open[lane]].bounds.min[axis] : INFINITE_DISTANCE;
+				filled.bounds[axis + 3][lane] = lane < openCount ? m_buildNodes[open[lane]].bounds.max[axis] : -INFINITE_DISTANCE;
+			}
+			filled.children[lane] = lane < openCount ? Collapse(open[lane]) : EMPTY_CHILD;
+		}
+
+		// The nodes may have moved while the children were added.
+		m_nodes[created] = filled;
+		return static_cast<std::int32_t>(created);
+	}
+
+	std::int32_t meshbvh::AddLeaf(const buildnode& source)
+	{
+		leaf added{};
+
+		for (UINT lane = 0; lane < 4; lane++)
+		{
+			UINT triangle = m_references[source.first + (std::min)(lane, source.count - 1)].triangle;
+			const D3DXVECTOR3& v0 = m_vertices[m_indices[3 * triangle]].position;
+			D3DXVECTOR3 edge1 = m_vertices[m_indices[3 * triangle + 1]].position - v0;
+			D3DXVECTOR3 edge2 = m_vertices[m_indices[3 * triangle + 2]].position - v0;
+
+			for (UINT axis = 0; axis < 3; axis++)
+			{
+				added.v0[axis][lane] = (&v0.x)[axis];
+				added.edge1[axis][lane] = (&edge1.x)[axis];
+				added.edge2[axis][lane] = (&edge2.x)[axis];
+			}
+			added.triangles[lane] = triangle;
+		}
+
+		m_leaves.push_back(added);
+		return ~static_cast<std::int32_t>(m_leaves.size() - 1);
+	}
+
+	// Moller and Trumbore: the hit is solved for its distance and the weights of the second and third vertex
+	// with Cramer's rule, for four triangles at once. Nearly parallel triangles are missed.
+	bool meshbvh::IntersectLeaf(const leaf& tested, const core::float4 (&origin)[3], const core::float4 (&direction)[3], FLOAT& closest, rayhit& hit) const
+	{
+		core::float4 e1x = core::Load4(tested.edge1[0]), e1y = core::Load4(tested.edge1[1]), e1z = core::Load4(tested.edge1[2]);
+		core::float4 e2x = core::Load4(tested.edge2[0]), e2y = core::Load4(tested.edge2[1]), e2z = core::Load4(tested.edge2[2]);
+
+		core::float4 px = Cross4(direction[1], direction[2], e2y, e2z);
+		core::float4 py = Cross4(direction[2], direction[0], e2z, e2x);
+		core::float4 pz = Cross4(direction[0], direction[1], e2x, e2y);
+		core::float4 determinant = core::MulAdd4(e1x, px, core::MulAdd4(e1y, py, core::Mul4(e1z, pz)));
+		core::float4 inverse = core::Div4(core::Splat4(1.0f), determinant);
+
+		core::float4 tx = core::Sub4(origin[0], core::Load4(tested.v0[0]));
+		core::float4 ty = core::Sub4(origin[1], core::Load4(tested.v0[1]));
+		core::float4 tz = core::Sub4(origin[2], core::Load4(tested.v0[2]));
+		core::float4 u = core::Mul4(core::MulAdd4(tx, px, core::MulAdd4(ty, py, core::Mul4(tz, pz))), inverse);
+
+		core::float4 qx = Cross4(ty, tz, e1y, e1z);
+		core::float4 qy = Cross4(tz, tx, e1z, e1x);
+		core::float4 qz = Cross4(tx, ty, e1x, e1y);
+		core::float4 v = core::Mul4(core::MulAdd4(direction[0], qx, core::MulAdd4(direction[1], qy, core::Mul4(direction[2], qz))), inverse);
+		core::float4 distance = core::Mul4(core::MulAdd4(e2x, qx, core::MulAdd4(e2y, qy, core::Mul4(e2z, qz))), inverse);
+
+		core::float4 zero = core::Splat4(0.0f);
+		int hits = core::LessMask4(core::Splat4(1e-12f), core::Mul4(determinant, determinant))
+			& ~core::LessMask4(u, zero) & ~core::LessMask4(v, zero) & ~core::LessMask4(core::Splat4(1.0f), core::Add4(u, v))
+			& core::LessMask4(zero, distance) & core::LessMask4(distance, core::Splat4(closest));
+		if (!hits)
+		{
+			return false;
+		}
+
+		FLOAT distances[4], us[4], vs[4];
+		core::Store4(distances, distance);
+		core::Store4(us, u);
+		core::Store4(vs, v);
+		for (UINT lane = 0; lane < 4; lane++)
+		{
+			if ((hits & (1 << lane)) and distances[lane] < closest)
+			{
+				closest = distances[lane];
+				hit = rayhit{ distances[lane], tested.triangles[lane], us[lane], vs[lane] };
+			}
+		}
+		return true;
+	}
+}
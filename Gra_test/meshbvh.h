@@ -0,0 +1,134 @@
+// meshbvh.h : include file for ray casts against the triangles of a mesh
+// A meshbvh is a bounding volume hierarchy over the triangles of one mesh, in the space of the mesh.
+// It is built as a binary tree: every node is split where the surface area heuristic says a ray is least
+// likely to have to visit both halves, found by sorting the triangle centers into BVH_BINS bins along each axis.
+// Large nodes are binned by the jobs and the two halves of a node are built in parallel.
+// The binary tree is then collapsed into a tree of four wide nodes whose child boxes are stored axis by axis,
+// so a ray is tested against the four boxes at once (see simdmath.h). The leaves hold up to four triangles
+// stored the same way, also tested at once. Children are visited nearest first and skipped once a hit is closer.
+// ScreenRay turns a point on the screen into the ray through it, which is how picking starts.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+#include "meshdata.h"
+#include "simdmath.h"
+
+namespace graphics
+{
+	// Bins the triangle centers are sorted into along every axis when a node is split.
+	constexpr UINT BVH_BINS{ 16 };
+	// Nodes with more triangles than this are binned by the jobs and their halves built in parallel.
+	constexpr UINT BVH_PARALLEL_TRIANGLES{ 32768 };
+	// Nodes deeper than this in the binary tree are split at their middle triangle instead, which bounds
+	// the depth for meshes the heuristic splits badly and so the stack of a ray cast.
+	constexpr UINT BVH_MAX_SAH_DEPTH{ 48 };
+
+	// The direction does not have to be normalized, distances are measured in multiples of it.
+	struct ray
+	{
+		D3DXVECTOR3 origin;
+		D3DXVECTOR3 direction;
+	};
+
+	// The triangle is the index of its first index divided by three, u and v weigh its second and third vertex.
+	struct rayhit
+	{
+		FLOAT distance;
+		UINT triangle;
+		FLOAT u, v;
+	};
+
+	// ScreenRay is the ray from the camera through the point x, y in pixels from the top left of a screen
+	// of width by height pixels, with a normalized direction. The view matrix has to be a rotation and a translation
+	// like the one of the camera, the projection a perspective projection like the one of d3d.
+	ray ScreenRay(FLOAT x, FLOAT y, FLOAT width, FLOAT height, const D3DXMATRIX& viewMatrix, const D3DXMATRIX& projectionMatrix);
+
+	class meshbvh
+	{
+	public:
+		meshbvh() = delete;
+		// The indices are a triangle list, an index past the vertices throws.
+		meshbvh(core::jobsystem& jobs, const colorvertex *vertices, UINT vertexCount, const std::uint32_t *indices, UINT indexCount);
+		meshbvh(const meshbvh& other) = delete;
+		~meshbvh() {};
+
+		meshbvh& operator=(const meshbvh& other) = delete;
+
+		// Intersect finds the closest triangle the ray hits closer than maxDistance, from both sides.
+		// It only reads the tree, any number of threads can cast rays at once.
+		bool Intersect(const ray& cast, FLOAT maxDistance, rayhit& hit) const;
+
+		UINT GetTriangleCount() const;
+		UINT GetNodeCount() const;
+		// The box around all triangles, min and max.
+		void GetBounds(D3DXVECTOR3& min, D3DXVECTOR3& max) const;
+
+		// DebugDraw draws the boxes of the nodes down to maxDepth levels below the root with the debug lines
+		// (see debugdraw.h), moved into the world by the matrix. The root box is depth 0.
+		void DebugDraw(const D3DXMATRIX& world, UINT maxDepth, const D3DXVECTOR4& color) const;
+	private:
+		// The boxes of the four children as minimum x, y, z then maximum x, y, z, four floats each.
+		// A child is a node index, the inverted index of a leaf or EMPTY_CHILD, whose box is inverted so no ray hits it.
+		struct node
+		{
+			FLOAT bounds[6][4];
+			std::int32_t children[4];
+		};
+
+		// Up to four triangles as their first vertex and the two edges from it, axis by axis.
+		// Leaves with fewer triangles repeat their first one.
+		struct leaf
+		{
+			FLOAT v0[3][4];
+			FLOAT edge1[3][4];
+			FLOAT edge2[3][4];
+			UINT triangles[4];
+		};
+
+		// The fourth float of both corners is only there so a corner loads as one float4.
+		struct box
+		{
+			FLOAT min[4];
+			FLOAT max[4];
+		};
+
+		// The triangles are partitioned with their boxes, so building reads them in order.
+		struct reference
+		{
+			box bounds;
+			UINT triangle;
+		};
+
+		// A node of the binary tree built first, a leaf when count is at most four.
+		struct buildnode
+		{
+			box bounds;
+			UINT first;
+			UINT count;
+			UINT left;
+		};
+
+		static constexpr std::int32_t EMPTY_CHILD{ -0x7fffffff - 1 };
+
+		void BuildNode(core::jobsystem& jobs, UINT index, UINT first, UINT count, UINT depth);
+		std::int32_t Collapse(UINT index);
+		std::int32_t AddLeaf(const buildnode& source);
+		void DebugDrawNode(const D3DXMATRIX& world, UINT index, UINT depth, UINT maxDepth, const D3DXVECTOR4& color) const;
+		bool IntersectLeaf(const leaf& tested, const core::float4 (&origin)[3], const core::float4 (&direction)[3], FLOAT& closest, rayhit& hit) const;
+
+		std::vector<node> m_nodes{};
+		std::vector<leaf> m_leaves{};
+		box m_bounds{};
+		UINT m_triangleCount{};
+
+		// Only used while building.
+		const colorvertex *m_vertices{};
+		const std::uint32_t *m_indices{};
+		std::vector<reference> m_references{};
+		std::vector<buildnode> m_buildNodes{};
+		std::atomic<UINT> m_usedBuildNodes{};
+	};
+}
@@ -0,0 +1,117 @@
+#include "stdafx.h"
+#include "meshdata.h"
+#include <algorithm>
+#include <cmath>
+
+namespace graphics
+{
+	FLOAT ComputeBoundingRadius(const colorvertex *vertices, UINT vertexCount)
+	{
+		FLOAT radiusSquared = 0.0f;
+
+		for (UINT i = 0; i < vertexCount; i++)
+		{
+			FLOAT lengthSquared = D3DXVec3LengthSq(&vertices[i].position);
+			if (lengthSquared > radiusSquared)
+			{
+				radiusSquared = lengthSquared;
+			}
+		}
+
+		return std::sqrt(radiusSquared);
+	}
+
+	// Every quad is split into two triangles along the same diagonal, clockwise seen from above.
+	void BuildGrid(UINT columns, UINT rows, FLOAT spacing, const D3DXVECTOR4& color,
+		colorvertex *vertices, std::uint32_t *indices)
+	{
+		FLOAT left = -0.5f * spacing * static_cast<FLOAT>(columns);
+		FLOAT back = -0.5f * spacing * static_cast<FLOAT>(rows);
+		UINT stride = columns + 1;
+
+		for (UINT z = 0; z <= rows; z++)
+		{
+			for (UINT x = 0; x <= columns; x++)
+			{
+				colorvertex& vertex = vertices[z * stride + x];
+				vertex.position = D3DXVECTOR3(left + spacing * static_cast<FLOAT>(x), 0.0f, back + spacing * static_cast<FLOAT>(z));
+				vertex.color = color;
+			}
+		}
+
+		for (UINT z = 0; z < rows; z++)
+		{
+			for (UINT x = 0; x < columns; x++)
+			{
+				std::uint32_t corner = z * stride + x;
+
+				*indices++ = corner;
+				*indices++ = corner + stride;
+				*indices++ = corner + stride + 1;
+				*indices++ = corner;
+				*indices++ = corner + stride + 1;
+				*indices++ = corner + 1;
+			}
+		}
+	}
+
+	// The rings are laid out like the rows of BuildGrid with the first column repeated at the end,
+	// so the quads use the same indices and are clockwise seen from outside.
+	// Halfway along a bone the weight is all its own, towards a joint it fades to half and half with the bone there.
+	void BuildTube(UINT bones, UINT ringsPerBone, UINT sides, FLOAT boneLength, FLOAT radius, const D3DXVECTOR4& color,
+		skinnedvertex *vertices, std::uint32_t *indices)
+	{
+		UINT rings = bones * ringsPerBone + 1;
+		UINT stride = sides + 1;
+
+		for (UINT ring = 0; ring < rings; ring++)
+		{
+			FLOAT along = static_cast<FLOAT>(ring) / static_cast<FLOAT>(ringsPerBone);
+			UINT bone = (std::min)(static_cast<UINT>(along), bones - 1);
+			FLOAT fraction = along - static_cast<FLOAT>(bone);
+			UINT neighbor = bone;
+			FLOAT weight = 1.0f;
+
+			if (fraction < 0.5f and bone > 0)
+			{
+				neighbor = bone - 1;
+				weight = 0.5f + fraction;
+			}
+			else if (fraction > 0.5f and bone + 1 < bones)
+			{
+				neighbor = bone + 1;
+				weight = 1.5f - fraction;
+			}
+
+			for (UINT side = 0; side <= sides; side++)
+			{
+				FLOAT angle = 2.0f * D3DX_PI * static_cast<FLOAT>(side % sides) / static_cast<FLOAT>(sides);
+				skinnedvertex& vertex = vertices[ring * stride + side];
+
+				vertex.position = D3DXVECTOR3(radius * std::cos(angle), boneLength * along, radius * std::sin(angle));
+				vertex.color = color;
+				vertex.bones[0] = static_cast<std::uint8_t>(bone);
+				vertex.bones[1] = static_cast<std::uint8_t>(neighbor);
+				vertex.bones[2] = vertex.bones[3] = 0;
+				vertex.weights[0] = weight;
+				vertex.weights[1] = 1.0f - weight;
+				vertex.weights[2] = vertex.weights[3] = 0.0f;
+			}
+		}
+
+		for (UINT ring = 0; ring + 1 < rings; ring++)
+		{
+			for (UINT side = 0; side < sides; side++)
+			{
+				std::uint32_t corner = ring * stride + side;
+
+				*indices++ = corner;
+				*indices++ = corner + stride;
+				*indices++ = corner + stride + 1;
+				*indices++ = corner;
+				*indices++ = corner + stride + 1;
+				*indices++ = corner + 1;
+			}
+		}
+	}
+}
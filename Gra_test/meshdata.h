@@ -0,0 +1,45 @@
+// meshdata.h : include file for the device independent mesh processing
+// Geometry is built and processed on the CPU before it is copied into the mesh heap.
+// Nothing here touches the device, so the same code runs in the headless builds.
+#pragma once
+
+#include <cstdint>
+#include "d3dxmath.h"
+
+namespace graphics
+{
+	// The vertex layout of the color shader, it must match the input layout in colorshader.cpp and color.vs.
+	struct colorvertex
+	{
+		D3DXVECTOR3 position;
+		D3DXVECTOR4 color;
+	};
+
+	// A vertex of a skinned mesh in the bind pose, moved by up to four bones whose weights add up to one.
+	// Skinning turns it into a colorvertex on the CPU, see skinning.h.
+	struct skinnedvertex
+	{
+		D3DXVECTOR3 position;
+		D3DXVECTOR4 color;
+		std::uint8_t bones[4];
+		FLOAT weights[4];
+	};
+
+	// Radius of the sphere around the origin of the mesh that contains all of its vertices.
+	FLOAT ComputeBoundingRadius(const colorvertex *vertices, UINT vertexCount);
+
+	// BuildGrid writes a flat grid of columns by rows quads on the xz plane, centered on the origin,
+	// as an indexed triangle list. The arrays must hold GridVertexCount and GridIndexCount elements.
+	constexpr UINT GridVertexCount(UINT columns, UINT rows) { return (columns + 1) * (rows + 1); }
+	constexpr UINT GridIndexCount(UINT columns, UINT rows) { return columns * rows * 6; }
+	void BuildGrid(UINT columns, UINT rows, FLOAT spacing, const D3DXVECTOR4& color,
+		colorvertex *vertices, std::uint32_t *indices);
+
+	// BuildTube writes an open tube around the y axis over a chain of bones of the given length, the first one
+	// at the origin, as an indexed triangle list with ringsPerBone rings of sides quads along every bone.
+	// Every ring is skinned to the bone it lies on and, near a joint, to the bone on the other side of it.
+	constexpr UINT TubeVertexCount(UINT bones, UINT ringsPerBone, UINT sides) { return (bones * ringsPerBone + 1) * (sides + 1); }
+	constexpr UINT TubeIndexCount(UINT bones, UINT ringsPerBone, UINT sides) { return bones * ringsPerBone * sides * 6; }
+	void BuildTube(UINT bones, UINT ringsPerBone, UINT sides, FLOAT boneLength, FLOAT radius, const D3DXVECTOR4& color,
+		skinnedvertex *vertices, std::uint32_t *indices);
+}
@@ -0,0 +1,407 @@
+#include "stdafx.h"
+#include "meshheap.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include <algorithm>
+
+namespace graphics
+{
+	meshheap::meshheap(ID3D11Device *dev, UINT vertexStride, UINT pageVertices, UINT pageIndices) :
+		m_device(dev), m_vertexStride(vertexStride), m_pageVertices(pageVertices), m_pageIndices(pageIndices)
+	{
+		if (!dev or vertexStride == 0 or pageVertices == 0 or pageIndices == 0)
+		{
+			throw "Incorrect mesh heap parameters.";
+		}
+
+		// The heap uploads through the immediate context so models only need the heap itself.
+		m_device->AddRef();
+		m_device->GetImmediateContext(&m_devcon);
+
+		try
+		{
+			AddPage();
+		}
+		catch (...)
+		{
+			m_devcon->Release();
+			m_device->Release();
+			throw;
+		}
+	}
+
+	meshheap::~meshheap()
+	{
+		for (auto& current : m_pages)
+		{
+			if (current->retiredVertexbuff)
+			{
+				ReleaseRetired(*current);
+			}
+			core::memorytracker::Freed(core::memorytag::meshes, GetPageSize());
+
+			if (current->indexbuff)
+			{
+				current->indexbuff->Release();
+				current->indexbuff = nullptr;
+			}
+
+			if (current->vertexbuff)
+			{
+				current->vertexbuff->Release();
+				current->vertexbuff = nullptr;
+			}
+		}
+
+		if (m_devcon)
+		{
+			m_devcon->Release();
+			m_devcon = nullptr;
+		}
+
+		if (m_device)
+		{
+			m_device->Release();
+			m_device = nullptr;
+		}
+	}
+
+	// The page buffers are plain static buffers, the same as the ones models used to create for themselves.
+	// They are only written with UpdateSubresource when a mesh is added and with CopySubresourceRegion
+	// when the page is compacted.
+	bool meshheap::CreatePageBuffers(ID3D11Buffer **vertexbuff, ID3D11Buffer **indexbuff)
+	{
+		D3D11_BUFFER_DESC vertexBufferDesc{}, indexBufferDesc{};
+		HRESULT result;
+
+		vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		vertexBufferDesc.ByteWidth = m_vertexStride * m_pageVertices;
+		vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		vertexBufferDesc.CPUAccessFlags = 0;
+		vertexBufferDesc.MiscFlags = 0;
+		vertexBufferDesc.StructureByteStride = 0;
+
+		result = m_device->CreateBuffer(&vertexBufferDesc, NULL, vertexbuff);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		indexBufferDesc.ByteWidth = sizeof(ULONG) * m_pageIndices;
+		indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		indexBufferDesc.CPUAccessFlags = 0;
+		indexBufferDesc.MiscFlags = 0;
+		indexBufferDesc.StructureByteStride = 0;
+
+		result = m_device->CreateBuffer(&indexBufferDesc, NULL, indexbuff);
+		if (FAILED(result))
+		{
+			(*vertexbuff)->Release();
+			*vertexbuff = nullptr;
+			return false;
+		}
+
+		return true;
+	}
+
+	UINT meshheap::AddPage()
+	{
+		auto created = std::make_unique<page>(m_pageVertices, m_pageIndices);
+
+		if (!CreatePageBuffers(&created->vertexbuff, &created->indexbuff))
+		{
+			throw "Unable to create mesh heap buffers.";
+		}
+
+		m_pages.push_back(std::move(created));
+		core::memorytracker::Allocated(core::memorytag::meshes, GetPageSize());
+		return static_cast<UINT>(m_pages.size() - 1);
+	}
+
+	// Every buffer pair of a page has this size, the pages and the previous buffers of compacted pages count once each.
+	UINT64 meshheap::GetPageSize() const
+	{
+		return static_cast<UINT64>(m_vertexStride) * m_pageVertices + static_cast<UINT64>(sizeof(ULONG)) * m_pageIndices;
+	}
+
+	meshheap::handle meshheap::Allocate(const void *vertices, UINT vertexCount, const ULONG *indices, UINT indexCount)
+	{
+		if (!vertices or !indices or vertexCount == 0 or indexCount == 0
+			or vertexCount > m_pageVertices or indexCount > m_pageIndices)
+		{
+			return INVALID_HANDLE;
+		}
+
+		entry created{};
+		UINT pageIndex{ INVALID_HANDLE };
+
+		// Try the existing pages first, a mesh needs room in both allocators of the same page.
+		for (UINT i = 0; i < m_pages.size(); i++)
+		{
+			page& current = *m_pages[i];
+
+			created.vertexalloc = current.vertexalloc.Allocate(vertexCount);
+			if (!created.vertexalloc.IsValid())
+			{
+				continue;
+			}
+
+			created.indexalloc = current.indexalloc.Allocate(indexCount);
+			if (!created.indexalloc.IsValid())
+			{
+				current.vertexalloc.Free(created.vertexalloc);
+				continue;
+			}
+
+			pageIndex = i;
+			break;
+		}
+
+		// The size bins round requests up, so a mesh close to the page size can fail even on an empty page.
+		// The new page stays for the meshes after it.
+		if (pageIndex == INVALID_HANDLE)
+		{
+			pageIndex = AddPage();
+			page& added = *m_pages[pageIndex];
+
+			created.vertexalloc = added.vertexalloc.Allocate(vertexCount);
+			created.indexalloc = added.indexalloc.Allocate(indexCount);
+			if (!created.vertexalloc.IsValid() or !created.indexalloc.IsValid())
+			{
+				if (created.vertexalloc.IsValid())
+				{
+					added.vertexalloc.Free(created.vertexalloc);
+				}
+				if (created.indexalloc.IsValid())
+				{
+					added.indexalloc.Free(created.indexalloc);
+				}
+				return INVALID_HANDLE;
+			}
+		}
+
+		created.range.page = pageIndex;
+		created.range.baseVertex = created.vertexalloc.offset;
+		created.range.startIndex = created.indexalloc.offset;
+		created.range.vertexCount = vertexCount;
+		created.range.indexCount = indexCount;
+		created.live = true;
+
+		// Upload the data into its part of the page buffers.
+		D3D11_BOX box{};
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+
+		box.left = created.range.baseVertex * m_vertexStride;
+		box.right = box.left + vertexCount * m_vertexStride;
+		m_devcon->UpdateSubresource(m_pages[pageIndex]->vertexbuff, 0, &box, vertices, 0, 0);
+
+		box.left = created.range.startIndex * sizeof(ULONG);
+		box.right = box.left + indexCount * sizeof(ULONG);
+		m_devcon->UpdateSubresource(m_pages[pageIndex]->indexbuff, 0, &box, indices, 0, 0);
+
+		core::telemetry::Count(core::counter::bytesuploaded, vertexCount * m_vertexStride + indexCount * sizeof(ULONG));
+
+		// Reuse a released handle if there is one so the entry table does not grow forever.
+		handle mesh{};
+		if (!m_freeHandles.empty())
+		{
+			mesh = m_freeHandles.back();
+			m_freeHandles.pop_back();
+			m_entries[mesh] = created;
+		}
+		else
+		{
+			mesh = static_cast<handle>(m_entries.size());
+			m_entries.push_back(created);
+		}
+
+		return mesh;
+	}
+
+	void meshheap::Free(handle mesh)
+	{
+		if (mesh >= m_entries.size() or !m_entries[mesh].live)
+		{
+			return;
+		}
+
+		entry& freed = m_entries[mesh];
+		page& current = *m_pages[freed.range.page];
+
+		current.vertexalloc.Free(freed.vertexalloc);
+		current.indexalloc.Free(freed.indexalloc);
+
+		freed = entry{};
+		m_freeHandles.push_back(mesh);
+	}
+
+	const meshheap::meshrange& meshheap::GetRange(handle mesh) const
+	{
+		return m_entries[mesh].range;
+	}
+
+	void meshheap::Bind(ID3D11DeviceContext *devcon, UINT pageIndex, UINT64 generation)
+	{
+		UINT stride{ m_vertexStride }, offset{};
+		page& current = *m_pages[pageIndex];
+		bool retired = generation < current.compacted and current.retiredVertexbuff;
+		ID3D11Buffer *vertexbuff = retired ? current.retiredVertexbuff : current.vertexbuff;
+
+		devcon->IASetVertexBuffers(0, 1, &vertexbuff, &stride, &offset);
+		devcon->IASetIndexBuffer(retired ? current.retiredIndexbuff : current.indexbuff, DXGI_FORMAT_R32_UINT, 0);
+
+		core::telemetry::Count(core::counter::statechanges, 2);
+	}
+
+	// A page is worth compacting when less than half of its free space
+	// is available as a single region in either of the buffers.
+	bool meshheap::IsFragmented(const page& current) const
+	{
+		offsetallocator::storagereport vertexReport = current.vertexalloc.StorageReport();
+		offsetallocator::storagereport indexReport = current.indexalloc.StorageReport();
+
+		return vertexReport.largestFreeRegion < vertexReport.totalFreeSpace / 2
+			or indexReport.largestFreeRegion < indexReport.totalFreeSpace / 2;
+	}
+
+	void meshheap::RequestDefragment()
+	{
+		m_defragmentRequested.store(true);
+	}
+
+	// Frames are drawn in the order they were built, once one of the generation a page was compacted at
+	// is drawn no frame needs the page's previous buffers anymore.
+	void meshheap::Defragment(ID3D11DeviceContext *devcon, UINT64 drawnGeneration)
+	{
+		bool retired = false;
+		for (auto& current : m_pages)
+		{
+			if (current->retiredVertexbuff and drawnGeneration >= current->compacted)
+			{
+				ReleaseRetired(*current);
+			}
+			retired = retired or current->retiredVertexbuff;
+		}
+
+		if (retired or !m_defragmentRequested.exchange(false))
+		{
+			return;
+		}
+		PROFILE_SCOPE("meshheap::Defragment");
+
+		m_generation++;
+		for (UINT pageIndex = 0; pageIndex < m_pages.size(); pageIndex++)
+		{
+			if (IsFragmented(*m_pages[pageIndex]))
+			{
+				CompactPage(devcon, pageIndex);
+			}
+		}
+	}
+
+	// Compacting allocates every live mesh again, in order of its current position,
+	// from a reset allocator which hands out consecutive ranges from the start of the page.
+	// The data is copied on the GPU into a new buffer pair because copies
+	// within one buffer must not overlap. The previous pair is kept for the frames built before, see Bind.
+	void meshheap::CompactPage(ID3D11DeviceContext *devcon, UINT pageIndex)
+	{
+		page& current = *m_pages[pageIndex];
+		ID3D11Buffer *vertexbuff{}, *indexbuff{};
+		std::vector<handle> meshes;
+
+		if (!CreatePageBuffers(&vertexbuff, &indexbuff))
+		{
+			// Not being able to compact is not an error, the page just stays as it is.
+			return;
+		}
+		core::memorytracker::Allocated(core::memorytag::meshes, GetPageSize());
+
+		for (handle mesh = 0; mesh < m_entries.size(); mesh++)
+		{
+			if (m_entries[mesh].live and m_entries[mesh].range.page == pageIndex)
+			{
+				meshes.push_back(mesh);
+			}
+		}
+
+		std::sort(meshes.begin(), meshes.end(), [this](handle a, handle b)
+		{
+			return m_entries[a].range.baseVertex < m_entries[b].range.baseVertex;
+		});
+
+		current.vertexalloc.Reset();
+		current.indexalloc.Reset();
+
+		D3D11_BOX box{};
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+
+		for (handle mesh : meshes)
+		{
+			entry& moved = m_entries[mesh];
+			meshrange from = moved.range;
+
+			moved.vertexalloc = current.vertexalloc.Allocate(from.vertexCount);
+			moved.indexalloc = current.indexalloc.Allocate(from.indexCount);
+			moved.range.baseVertex = moved.vertexalloc.offset;
+			moved.range.startIndex = moved.indexalloc.offset;
+
+			box.left = from.baseVertex * m_vertexStride;
+			box.right = box.left + from.vertexCount * m_vertexStride;
+			devcon->CopySubresourceRegion(vertexbuff, 0, moved.range.baseVertex * m_vertexStride, 0, 0,
+				current.vertexbuff, 0, &box);
+
+			box.left = from.startIndex * sizeof(ULONG);
+			box.right = box.left + from.indexCount * sizeof(ULONG);
+			devcon->CopySubresourceRegion(indexbuff, 0, moved.range.startIndex * sizeof(ULONG), 0, 0,
+				current.indexbuff, 0, &box);
+
+			if (m_onRelocate)
+			{
+				m_onRelocate(mesh, from, moved.range);
+			}
+		}
+
+		current.retiredVertexbuff = current.vertexbuff;
+		current.retiredIndexbuff = current.indexbuff;
+		current.vertexbuff = vertexbuff;
+		current.indexbuff = indexbuff;
+		current.compacted = m_generation;
+	}
+
+	void meshheap::ReleaseRetired(page& current)
+	{
+		current.retiredVertexbuff->Release();
+		current.retiredIndexbuff->Release();
+		current.retiredVertexbuff = nullptr;
+		current.retiredIndexbuff = nullptr;
+		core::memorytracker::Freed(core::memorytag::meshes, GetPageSize());
+	}
+
+	void meshheap::SetRelocationCallback(relocationcallback callback)
+	{
+		m_onRelocate = callback;
+	}
+
+	UINT64 meshheap::GetGeneration() const
+	{
+		return m_generation;
+	}
+
+	UINT meshheap::GetPageCount() const
+	{
+		return static_cast<UINT>(m_pages.size());
+	}
+
+	UINT meshheap::GetVertexStride() const
+	{
+		return m_vertexStride;
+	}
+}
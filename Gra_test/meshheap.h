@@ -0,0 +1,112 @@
+// meshheap.h : include file for shared mesh geometry storage
+// The meshheap keeps the geometry of many models inside a few large vertex and index buffers
+// (pages) instead of one buffer pair per model.
+// Ranges inside the pages are carved out with the offsetallocator and the models
+// draw with a base vertex and start index so the buffers only need to be bound once per page.
+#pragma once
+
+#include <d3d11.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "offsetallocator.h"
+
+namespace graphics
+{
+	constexpr UINT MESHHEAP_PAGE_VERTICES{ 256 * 1024 };
+	constexpr UINT MESHHEAP_PAGE_INDICES{ 768 * 1024 };
+
+	class meshheap
+	{
+	public:
+		typedef UINT handle;
+		static constexpr handle INVALID_HANDLE{ 0xffffffff };
+
+		// Location of a mesh inside the heap, this is everything DrawIndexed needs.
+		struct meshrange
+		{
+			UINT page{};
+			UINT baseVertex{};
+			UINT startIndex{};
+			UINT vertexCount{};
+			UINT indexCount{};
+		};
+
+		// The relocation callback is invoked for every mesh moved by Defragment, on the thread that runs it,
+		// so that anything caching the range (draw lists, bounds trees) can patch it.
+		typedef std::function<void(handle mesh, const meshrange& from, const meshrange& to)> relocationcallback;
+
+		meshheap() = delete;
+		meshheap(ID3D11Device *dev,
+			UINT vertexStride,
+			UINT pageVertices = MESHHEAP_PAGE_VERTICES,
+			UINT pageIndices = MESHHEAP_PAGE_INDICES);
+		meshheap(const meshheap& other) = delete;
+		~meshheap();
+
+		meshheap& operator=(const meshheap& other) = delete;
+
+		// Allocate copies the vertex and index data into the first page that has room for it,
+		// a new page is created when none has. Indices are relative to the mesh's first vertex.
+		handle Allocate(const void *vertices, UINT vertexCount, const ULONG *indices, UINT indexCount);
+		void Free(handle mesh);
+		const meshrange& GetRange(handle mesh) const;
+
+		// Bind puts the vertex and index buffers of the page on the input assembler.
+		// The generation is the one the ranges that are drawn were taken at. A page compacted since
+		// binds the buffers it had before, where those ranges still point.
+		void Bind(ID3D11DeviceContext *devcon, UINT page, UINT64 generation);
+
+		// RequestDefragment can be called from any thread, the next Defragment compacts the pages
+		// whose free space is split into small regions. Defragment runs on the thread that owns devcon.
+		// Live meshes are copied on the GPU into fresh buffers and their ranges are updated in place,
+		// so models that look their range up by handle keep working without any changes.
+		// Every compaction starts a new generation. The buffers a page had before stay until a frame
+		// drawn with ranges of the new generation passes it as drawnGeneration, a request waits until then.
+		void RequestDefragment();
+		void Defragment(ID3D11DeviceContext *devcon, UINT64 drawnGeneration);
+		void SetRelocationCallback(relocationcallback callback);
+		UINT64 GetGeneration() const;
+
+		UINT GetPageCount() const;
+		UINT GetVertexStride() const;
+	private:
+		struct page
+		{
+			page(UINT vertices, UINT indices) : vertexalloc(vertices), indexalloc(indices) {};
+
+			ID3D11Buffer *vertexbuff{}, *indexbuff{};
+			ID3D11Buffer *retiredVertexbuff{}, *retiredIndexbuff{};
+			UINT64 compacted{};
+			offsetallocator vertexalloc;
+			offsetallocator indexalloc;
+		};
+
+		struct entry
+		{
+			meshrange range{};
+			offsetallocator::allocation vertexalloc{};
+			offsetallocator::allocation indexalloc{};
+			bool live{};
+		};
+
+		bool CreatePageBuffers(ID3D11Buffer **vertexbuff, ID3D11Buffer **indexbuff);
+		UINT AddPage();
+		UINT64 GetPageSize() const;
+		bool IsFragmented(const page& current) const;
+		void CompactPage(ID3D11DeviceContext *devcon, UINT pageIndex);
+		void ReleaseRetired(page& current);
+
+		ID3D11Device *m_device{};
+		ID3D11DeviceContext *m_devcon{};
+		UINT m_vertexStride{};
+		UINT m_pageVertices{}, m_pageIndices{};
+		std::vector<std::unique_ptr<page>> m_pages{};
+		std::vector<entry> m_entries{};
+		std::vector<handle> m_freeHandles{};
+		relocationcallback m_onRelocate{};
+		std::atomic<bool> m_defragmentRequested{};
+		UINT64 m_generation{};
+	};
+}
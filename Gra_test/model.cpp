@@ -1,12 +1,14 @@
 #include "stdafx.h"
 #include "model.h"
+#include "telemetry.h"
+#include <vector>
 
 namespace graphics
 {
-	model::model(ID3D11Device *device)
+	model::model(meshheap& sharedHeap, core::jobsystem& jobs)
 	{
 		// Initialize the vertex and index buffer that hold the geometry for the triangle.
-		if (!InitializeBuffers(device))
+		if (!InitializeBuffers(sharedHeap, jobs))
 		{
 			throw "Unable to initialize buffers.";
 		}
@@ -18,17 +20,17 @@ namespace graphics
 		ShutdownBuffers();
 	}
 
-	// The InitializeBuffers function is where vertex and index buffers are created.
+	// The InitializeBuffers function is where the vertex and index data is created and stored in the mesh heap.
 	// Usually you would read in a model and create the buffers from that data file.
-	bool model::InitializeBuffers(ID3D11Device *dev)
+	bool model::InitializeBuffers(meshheap& sharedHeap, core::jobsystem& jobs)
 	{
 		VertexType *vertices;
 		ULONG *indices;
-		D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
-		D3D11_SUBRESOURCE_DATA vertexData, indexData;
-		HRESULT result;
 		// First create two temporary arrays to hold the vertex and index data 
 		// that we will use later to populate the final buffers with.
+		// They are only needed until the data is in the mesh heap so they are taken from
+		// the thread's scratch stack, which gets them back on every return path when the scope ends.
+		core::scratchscope scratch;
 
 		// Set the number of vertices in the vertex array.
 		vertexcnt = 3;
@@ -37,14 +39,14 @@ namespace graphics
 		indexcnt = 3;
 
 		// Create the vertex array.
-		vertices = new VertexType[vertexcnt];
+		vertices = static_cast<VertexType*>(core::scratchstack::ForThread().Allocate(sizeof(VertexType) * vertexcnt));
 		if (!vertices)
 		{
 			return false;
 		}
 
 		// Create the index array.
-		indices = new ULONG[indexcnt];
+		indices = static_cast<ULONG*>(core::scratchstack::ForThread().Allocate(sizeof(ULONG) * indexcnt));
 		if (!indices)
 		{
 			return false;
@@ -70,61 +72,23 @@ namespace graphics
 		indices[1] = 1;  // Top middle.
 		indices[2] = 2;  // Bottom right.
 
-		// First fill out a description of the buffer.
-		// In the description the ByteWidth (size of the buffer) and the BindFlags (type of buffer) 
-		// are what you need to ensure are filled out correctly.
-		// After the description is filled out you need to also fill out a subresource pointer
-		// which will point to either your vertex or index array you previously created. 
-		// With the description and subresource pointer you can call CreateBuffer using the D3D device
-		// and it will return a pointer to the new buffer.
-
-		// Set up the description of the static vertex buffer.
-		vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-		vertexBufferDesc.ByteWidth = sizeof(VertexType) * vertexcnt;
-		vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-		vertexBufferDesc.CPUAccessFlags = 0;
-		vertexBufferDesc.MiscFlags = 0;
-		vertexBufferDesc.StructureByteStride = 0;
-
-		// Give the subresource structure a pointer to the vertex data.
-		vertexData.pSysMem = vertices;
-		vertexData.SysMemPitch = 0;
-		vertexData.SysMemSlicePitch = 0;
-
-		// Now create the vertex buffer.
-		result = dev->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexbuff);
-		if (FAILED(result))
-		{
-			return false;
-		}
+		// The bounding sphere is centered on the origin of the model and reaches the farthest vertex.
+		radius = ComputeBoundingRadius(vertices, static_cast<UINT>(vertexcnt));
+
+		// The BVH keeps its own copy of the triangles, the arrays are gone once the data is in the heap.
+		std::vector<std::uint32_t> bvhIndices(indices, indices + indexcnt);
+		bvh = std::make_unique<meshbvh>(jobs, vertices, static_cast<UINT>(vertexcnt), bvhIndices.data(), static_cast<UINT>(indexcnt));
 
-		// Set up the description of the static index buffer.
-		indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-		indexBufferDesc.ByteWidth = sizeof(unsigned long) * indexcnt;
-		indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		indexBufferDesc.CPUAccessFlags = 0;
-		indexBufferDesc.MiscFlags = 0;
-		indexBufferDesc.StructureByteStride = 0;
-
-		// Give the subresource structure a pointer to the index data.
-		indexData.pSysMem = indices;
-		indexData.SysMemPitch = 0;
-		indexData.SysMemSlicePitch = 0;
-
-		// Create the index buffer.
-		result = dev->CreateBuffer(&indexBufferDesc, &indexData, &indexbuff);
-		if (FAILED(result))
+		// Instead of creating a vertex and index buffer of its own the model copies the arrays
+		// into ranges of the shared mesh heap buffers.
+		// The heap returns a handle which is later used to find where the data ended up.
+		heap = &sharedHeap;
+		mesh = heap->Allocate(vertices, vertexcnt, indices, indexcnt);
+		if (mesh == meshheap::INVALID_HANDLE)
 		{
 			return false;
 		}
 
-		// Release the arrays now that the vertex and index buffers have been created and loaded.
-		delete[] vertices;
-		vertices = nullptr;
-
-		delete[] indices;
-		indices = nullptr;
-
 		return true;
 	}
 
@@ -133,41 +97,27 @@ namespace graphics
 	// Once the GPU has an active vertex buffer it can then use the shader to render that buffer.
 	// This function also defines how those buffers should be drawn such as
 	// triangles, lines, fans, and so forth.
-	// For now we set the vertex buffer and index buffer as active on the input assembler
+	// For now we set the mesh heap page holding the model as active on the input assembler
 	// and tell the GPU that the buffers should be drawn as triangles 
 	// using the IASetPrimitiveTopology DirectX function.
 	void model::Render(ID3D11DeviceContext *devcon)
 	{
-		UINT stride{}, offset{};
-
-		// Set vertex buffer stride and offset.
-		stride = sizeof(VertexType);
-		offset = 0;
-
-		// Set the vertex buffer to active in the input assembler so it can be rendered.
-		devcon->IASetVertexBuffers(0, 1, &vertexbuff, &stride, &offset);
-
-		// Set the index buffer to active in the input assembler so it can be rendered.
-		devcon->IASetIndexBuffer(indexbuff, DXGI_FORMAT_R32_UINT, 0);
+		// Set the vertex and index buffers of the heap page to active in the input assembler so they can be rendered.
+		// The range is looked up now, so it is one of the current generation.
+		heap->Bind(devcon, heap->GetRange(mesh).page, heap->GetGeneration());
 
 		// Set the type of primitive that should be rendered from this vertex buffer, in this case triangles.
 		devcon->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		core::telemetry::Count(core::counter::statechanges, 1);
 	}
 
 	void model::ShutdownBuffers()
 	{
-		// Release the index buffer.
-		if (indexbuff)
+		// Give the ranges of the mesh back to the heap.
+		if (heap and mesh != meshheap::INVALID_HANDLE)
 		{
-			indexbuff->Release();
-			indexbuff = nullptr;
-		}
-
-		// Release the vertex buffer.
-		if (vertexbuff)
-		{
-			vertexbuff->Release();
-			vertexbuff = nullptr;
+			heap->Free(mesh);
+			mesh = meshheap::INVALID_HANDLE;
 		}
 
 		return;
@@ -177,4 +127,29 @@ namespace graphics
 	{
 		return indexcnt;
 	}
+
+	int model::GetStartIndex()
+	{
+		return static_cast<int>(heap->GetRange(mesh).startIndex);
+	}
+
+	int model::GetBaseVertex()
+	{
+		return static_cast<int>(heap->GetRange(mesh).baseVertex);
+	}
+
+	UINT model::GetPage()
+	{
+		return heap->GetRange(mesh).page;
+	}
+
+	FLOAT model::GetBoundingRadius()
+	{
+		return radius;
+	}
+
+	const meshbvh& model::GetBVH()
+	{
+		return *bvh;
+	}
 }
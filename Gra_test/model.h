@@ -4,21 +4,25 @@
 
 #include <d3d11.h>
 #include <d3dx10math.h>
+#include "meshheap.h"
+#include "allocators.h"
+#include "meshdata.h"
+#include "meshbvh.h"
+#include "jobsystem.h"
+#include <memory>
 
 namespace graphics
 {
 	class model
 	{
-	private:
-		// Take note that this typedef must match the layout in the ColorShaderClass.
-		struct VertexType
-		{
-			D3DXVECTOR3 position;
-			D3DXVECTOR4 color;
-		};
 	public:
+		// Take note that this typedef must match the layout in the ColorShaderClass.
+		// It is public because the mesh heap that stores the vertices is created with its size.
+		typedef colorvertex VertexType;
+
 		model() = delete;
-		model(ID3D11Device *device);
+		// The BVH picking uses is built on the jobs.
+		model(meshheap& sharedHeap, core::jobsystem& jobs);
 		model(const model& other);
 		~model();
 
@@ -26,15 +30,30 @@ namespace graphics
 		// to prepare it for drawing by the color shader.
 		void Render(ID3D11DeviceContext *devcon);
 		int GetIndexCount();
+
+		// The geometry lives somewhere inside the shared mesh heap buffers
+		// so the draw call needs to know where the model's indices and vertices start.
+		int GetStartIndex();
+		int GetBaseVertex();
+		UINT GetPage();
+
+		// Radius of the sphere around the model's origin that contains all of its vertices.
+		FLOAT GetBoundingRadius();
+
+		// The BVH over the triangles of the model, which its instances are picked by.
+		const meshbvh& GetBVH();
 	private:
-		bool InitializeBuffers(ID3D11Device *dev);
+		bool InitializeBuffers(meshheap& sharedHeap, core::jobsystem& jobs);
 		void ShutdownBuffers();
 	
-		// The private variables in the model class are the vertex and index buffer
-		// as well as two integers to keep track of the size of each buffer.
-		// Note that all DirectX 11 buffers generally use the generic ID3D11Buffer type
-		// and are more clearly identified by a buffer description when they are first created.
-		ID3D11Buffer *vertexbuff{}, *indexbuff{};
+		// The model does not own any buffers, its vertices and indices are stored
+		// in the mesh heap and the handle is used to look up where they are.
+		// The lookup is done on every use because the heap can move the mesh when it is defragmented, see meshheap::Defragment.
+		// The two integers keep track of the size of the geometry.
+		meshheap *heap{};
+		meshheap::handle mesh{ meshheap::INVALID_HANDLE };
 		INT vertexcnt{}, indexcnt{};
+		FLOAT radius{};
+		std::unique_ptr<meshbvh> bvh{};
 	};
 }
@@ -0,0 +1,103 @@
+#include "stdafx.h"
+#include "nullrenderer.h"
+#include "profiler.h"
+#include "telemetry.h"
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr std::uint64_t FNV_OFFSET{ 14695981039346656037ull };
+		constexpr std::uint64_t FNV_PRIME{ 1099511628211ull };
+
+		std::uint64_t Hash(std::uint64_t hash, const void *data, std::size_t size)
+		{
+			const unsigned char *bytes = static_cast<const unsigned char*>(data);
+
+			for (std::size_t i = 0; i < size; i++)
+			{
+				hash = (hash ^ bytes[i]) * FNV_PRIME;
+			}
+
+			return hash;
+		}
+	}
+
+	// The counters match graphics::RenderSnapshot: binding the heap page, the topology,
+	// the constant buffer upload and the three states and the draw of colorshader::Render.
+	void nullrenderer::Render(const rendersnapshot& snapshot, const D3DXMATRIX& projectionMatrix)
+	{
+		PROFILE_SCOPE("nullrenderer::Render");
+
+		std::uint64_t triangles = 0;
+		for (const drawitem& draw : snapshot.draws)
+		{
+			triangles += draw.indexCount / 3;
+		}
+
+		core::telemetry::Count(core::counter::statechanges, (2 + 1 + 1 + 3) * snapshot.draws.size());
+		core::telemetry::Count(core::counter::bytesuploaded, sizeof(matrixbuffer) * snapshot.draws.size());
+		core::telemetry::Count(core::counter::drawcalls, snapshot.draws.size());
+		core::telemetry::Count(core::counter::triangles, triangles);
+
+		m_frameChecksum = Checksum(snapshot, projectionMatrix);
+		m_totalChecksum = Hash(m_totalChecksum ? m_totalChecksum : FNV_OFFSET, &m_frameChecksum, sizeof(m_frameChecksum));
+		m_draws += snapshot.draws.size();
+		m_triangles += triangles;
+		m_frames++;
+	}
+
+	// The packed buffer stands in for the mapped constant buffer.
+	std::uint64_t nullrenderer::Checksum(const rendersnapshot& snapshot, const D3DXMATRIX& projectionMatrix)
+	{
+		matrixbuffer constants;
+		std::uint64_t hash = FNV_OFFSET;
+
+		for (const drawitem& draw : snapshot.draws)
+		{
+			PackMatrixBuffer(constants, snapshot.transforms[draw.transform], snapshot.view, projectionMatrix);
+
+			hash = Hash(hash, &constants, sizeof(constants));
+			hash = Hash(hash, &draw.page, sizeof(draw.page));
+			hash = Hash(hash, &draw.indexCount, sizeof(draw.indexCount));
+			hash = Hash(hash, &draw.startIndex, sizeof(draw.startIndex));
+			hash = Hash(hash, &draw.baseVertex, sizeof(draw.baseVertex));
+		}
+
+		return hash;
+	}
+
+	std::uint64_t nullrenderer::GetFrameChecksum() const
+	{
+		return m_frameChecksum;
+	}
+
+	std::uint64_t nullrenderer::GetTotalChecksum() const
+	{
+		return m_totalChecksum;
+	}
+
+	std::uint64_t nullrenderer::GetFrameCount() const
+	{
+		return m_frames;
+	}
+
+	std::uint64_t nullrenderer::GetDrawCount() const
+	{
+		return m_draws;
+	}
+
+	std::uint64_t nullrenderer::GetTriangleCount() const
+	{
+		return m_triangles;
+	}
+
+	void nullrenderer::Reset()
+	{
+		m_frameChecksum = 0;
+		m_totalChecksum = 0;
+		m_frames = 0;
+		m_draws = 0;
+		m_triangles = 0;
+	}
+}
@@ -0,0 +1,44 @@
+// nullrenderer.h : include file for the renderer without a device
+// The null renderer consumes snapshots the way graphics::RenderSnapshot does: it walks the draws,
+// packs the shader parameters like the color shader and counts the telemetry counters
+// of every call the real renderer makes, but nothing is submitted anywhere.
+// Headless builds use it to run the CPU side of a frame. The checksum over everything that would
+// have reached the GPU tells whether two runs rendered exactly the same thing.
+#pragma once
+
+#include <cstdint>
+#include "rendersnapshot.h"
+#include "shaderparameters.h"
+
+namespace graphics
+{
+	class nullrenderer
+	{
+	public:
+		nullrenderer() {};
+		nullrenderer(const nullrenderer& other) = delete;
+		~nullrenderer() {};
+
+		nullrenderer& operator=(const nullrenderer& other) = delete;
+
+		void Render(const rendersnapshot& snapshot, const D3DXMATRIX& projectionMatrix);
+
+		// Checksum of the draw stream of a snapshot: the draws and the shader parameters packed for each of them.
+		// Render keeps the same value as the frame checksum, captures store it to check replays against.
+		static std::uint64_t Checksum(const rendersnapshot& snapshot, const D3DXMATRIX& projectionMatrix);
+
+		// The frame checksum covers the last rendered snapshot, the total one every snapshot so far.
+		std::uint64_t GetFrameChecksum() const;
+		std::uint64_t GetTotalChecksum() const;
+		std::uint64_t GetFrameCount() const;
+		std::uint64_t GetDrawCount() const;
+		std::uint64_t GetTriangleCount() const;
+		void Reset();
+	private:
+		std::uint64_t m_frameChecksum{};
+		std::uint64_t m_totalChecksum{};
+		std::uint64_t m_frames{};
+		std::uint64_t m_draws{};
+		std::uint64_t m_triangles{};
+	};
+}
@@ -0,0 +1,404 @@
+#include "stdafx.h"
+#include "offsetallocator.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr std::uint32_t MANTISSA_BITS{ 3 };
+		constexpr std::uint32_t MANTISSA_VALUE{ 1 << MANTISSA_BITS };
+		constexpr std::uint32_t MANTISSA_MASK{ MANTISSA_VALUE - 1 };
+
+		// Index of the highest set bit, the value must not be zero.
+		std::uint32_t HighestSetBit(std::uint32_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanReverse(&index, value);
+			return index;
+#else
+			return 31 - __builtin_clz(value);
+#endif
+		}
+
+		// Index of the lowest set bit, the value must not be zero.
+		std::uint32_t LowestSetBit(std::uint32_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, value);
+			return index;
+#else
+			return __builtin_ctz(value);
+#endif
+		}
+
+		std::uint32_t LowestSetBitAfter(std::uint32_t bitMask, std::uint32_t startBitIndex)
+		{
+			if (startBitIndex >= 32)
+			{
+				return offsetallocator::NO_SPACE;
+			}
+
+			std::uint32_t bitsAfter = bitMask & ~((1u << startBitIndex) - 1);
+			if (bitsAfter == 0)
+			{
+				return offsetallocator::NO_SPACE;
+			}
+
+			return LowestSetBit(bitsAfter);
+		}
+	}
+
+	offsetallocator::offsetallocator(std::uint32_t size, std::uint32_t maxAllocs) :
+		m_size(size), m_maxAllocs(maxAllocs)
+	{
+		if (size == 0 or maxAllocs < 2)
+		{
+			throw "Incorrect offset allocator size.";
+		}
+
+		Reset();
+	}
+
+	// The size is stored as a small float with a 3 bit mantissa.
+	// Sizes below 8 are denormals and map to themselves, above that every power of two
+	// is split into 8 evenly spaced bins.
+	// If any of the bits below the mantissa are set the size is bumped to the next bin.
+	std::uint32_t offsetallocator::SizeToBinRoundUp(std::uint32_t size)
+	{
+		std::uint32_t exp{}, mantissa{};
+
+		if (size < MANTISSA_VALUE)
+		{
+			mantissa = size;
+		}
+		else
+		{
+			std::uint32_t mantissaStartBit = HighestSetBit(size) - MANTISSA_BITS;
+			exp = mantissaStartBit + 1;
+			mantissa = (size >> mantissaStartBit) & MANTISSA_MASK;
+
+			std::uint32_t lowBitsMask = (1u << mantissaStartBit) - 1;
+			if ((size & lowBitsMask) != 0)
+			{
+				mantissa++;
+			}
+		}
+
+		// Adding instead of or-ing lets a mantissa overflow carry into the exponent.
+		return (exp << MANTISSA_BITS) + mantissa;
+	}
+
+	std::uint32_t offsetallocator::SizeToBinRoundDown(std::uint32_t size)
+	{
+		std::uint32_t exp{}, mantissa{};
+
+		if (size < MANTISSA_VALUE)
+		{
+			mantissa = size;
+		}
+		else
+		{
+			std::uint32_t mantissaStartBit = HighestSetBit(size) - MANTISSA_BITS;
+			exp = mantissaStartBit + 1;
+			mantissa = (size >> mantissaStartBit) & MANTISSA_MASK;
+		}
+
+		return (exp << MANTISSA_BITS) | mantissa;
+	}
+
+	std::uint32_t offsetallocator::BinToSize(std::uint32_t bin)
+	{
+		std::uint32_t exponent = bin >> MANTISSA_BITS;
+		std::uint32_t mantissa = bin & MANTISSA_MASK;
+
+		if (exponent == 0)
+		{
+			return mantissa;
+		}
+
+		return (mantissa | MANTISSA_VALUE) << (exponent - 1);
+	}
+
+	void offsetallocator::Reset()
+	{
+		m_freeStorage = 0;
+		m_usedBinsTop = 0;
+
+		for (std::uint32_t i = 0; i < NUM_TOP_BINS; i++)
+		{
+			m_usedBins[i] = 0;
+		}
+
+		for (std::uint32_t i = 0; i < NUM_LEAF_BINS; i++)
+		{
+			m_binIndices[i] = UNUSED;
+		}
+
+		m_nodes.assign(m_maxAllocs, node{});
+		m_freeNodes.resize(m_maxAllocs);
+
+		// The free node stack is filled in reverse so that node 0 is handed out first.
+		for (std::uint32_t i = 0; i < m_maxAllocs; i++)
+		{
+			m_freeNodes[i] = m_maxAllocs - i - 1;
+		}
+		m_freeNodeCount = m_maxAllocs;
+
+		// Start with a single free region covering the whole range.
+		InsertNodeIntoBin(m_size, 0);
+	}
+
+	// Allocate first looks for a non empty leaf bin in the top bin of the rounded up size,
+	// and if there is none it takes the first non empty leaf of the next used top bin.
+	// Both searches are a single bit scan so the cost does not depend on the number of allocations.
+	// The found region is split and the remainder goes back into the bins as a new free node.
+	offsetallocator::allocation offsetallocator::Allocate(std::uint32_t size)
+	{
+		allocation alloc{};
+
+		// A node may be needed for the remainder of the split.
+		if (size == 0 or m_freeNodeCount == 0)
+		{
+			return alloc;
+		}
+
+		std::uint32_t minBinIndex = SizeToBinRoundUp(size);
+		std::uint32_t minTopBinIndex = minBinIndex >> MANTISSA_BITS;
+		std::uint32_t minLeafBinIndex = minBinIndex & MANTISSA_MASK;
+
+		std::uint32_t topBinIndex = minTopBinIndex;
+		std::uint32_t leafBinIndex = NO_SPACE;
+
+		if (topBinIndex < NUM_TOP_BINS and (m_usedBinsTop & (1u << topBinIndex)))
+		{
+			leafBinIndex = LowestSetBitAfter(m_usedBins[topBinIndex], minLeafBinIndex);
+		}
+
+		if (leafBinIndex == NO_SPACE)
+		{
+			topBinIndex = LowestSetBitAfter(m_usedBinsTop, minTopBinIndex + 1);
+			if (topBinIndex == NO_SPACE)
+			{
+				return alloc;
+			}
+
+			leafBinIndex = LowestSetBit(m_usedBins[topBinIndex]);
+		}
+
+		std::uint32_t binIndex = (topBinIndex << MANTISSA_BITS) | leafBinIndex;
+
+		// Pop the first node of the bin list.
+		std::uint32_t nodeIndex = m_binIndices[binIndex];
+		node& found = m_nodes[nodeIndex];
+		std::uint32_t nodeTotalSize = found.dataSize;
+		found.dataSize = size;
+		found.used = true;
+		m_binIndices[binIndex] = found.binListNext;
+		if (found.binListNext != UNUSED)
+		{
+			m_nodes[found.binListNext].binListPrev = UNUSED;
+		}
+		m_freeStorage -= nodeTotalSize;
+
+		// Clear the bin masks when the bin became empty.
+		if (m_binIndices[binIndex] == UNUSED)
+		{
+			m_usedBins[topBinIndex] &= ~(1u << leafBinIndex);
+			if (m_usedBins[topBinIndex] == 0)
+			{
+				m_usedBinsTop &= ~(1u << topBinIndex);
+			}
+		}
+
+		// Put the remainder back as a free region right after the allocation.
+		std::uint32_t remainderSize = nodeTotalSize - size;
+		if (remainderSize > 0)
+		{
+			std::uint32_t newNodeIndex = InsertNodeIntoBin(remainderSize, m_nodes[nodeIndex].dataOffset + size);
+
+			node& current = m_nodes[nodeIndex];
+			if (current.neighborNext != UNUSED)
+			{
+				m_nodes[current.neighborNext].neighborPrev = newNodeIndex;
+			}
+			m_nodes[newNodeIndex].neighborPrev = nodeIndex;
+			m_nodes[newNodeIndex].neighborNext = current.neighborNext;
+			current.neighborNext = newNodeIndex;
+		}
+
+		alloc.offset = m_nodes[nodeIndex].dataOffset;
+		alloc.metadata = nodeIndex;
+		return alloc;
+	}
+
+	// Free merges the region with its free neighbours so the range never holds
+	// two adjacent free regions, then puts the merged region back into its bin.
+	void offsetallocator::Free(allocation alloc)
+	{
+		if (alloc.metadata == NO_SPACE or alloc.metadata >= m_maxAllocs)
+		{
+			return;
+		}
+
+		std::uint32_t nodeIndex = alloc.metadata;
+		node& freed = m_nodes[nodeIndex];
+		if (!freed.used)
+		{
+			return;
+		}
+
+		std::uint32_t offset = freed.dataOffset;
+		std::uint32_t size = freed.dataSize;
+
+		if (freed.neighborPrev != UNUSED and !m_nodes[freed.neighborPrev].used)
+		{
+			node& prev = m_nodes[freed.neighborPrev];
+			offset = prev.dataOffset;
+			size += prev.dataSize;
+
+			std::uint32_t prevIndex = freed.neighborPrev;
+			freed.neighborPrev = prev.neighborPrev;
+			RemoveNodeFromBin(prevIndex);
+		}
+
+		if (freed.neighborNext != UNUSED and !m_nodes[freed.neighborNext].used)
+		{
+			node& next = m_nodes[freed.neighborNext];
+			size += next.dataSize;
+
+			std::uint32_t nextIndex = freed.neighborNext;
+			freed.neighborNext = next.neighborNext;
+			RemoveNodeFromBin(nextIndex);
+		}
+
+		std::uint32_t neighborNext = freed.neighborNext;
+		std::uint32_t neighborPrev = freed.neighborPrev;
+
+		// Return the node of the allocation and insert the combined region as a fresh node.
+		freed = node{};
+		m_freeNodes[m_freeNodeCount++] = nodeIndex;
+
+		std::uint32_t combinedNodeIndex = InsertNodeIntoBin(size, offset);
+
+		if (neighborNext != UNUSED)
+		{
+			m_nodes[combinedNodeIndex].neighborNext = neighborNext;
+			m_nodes[neighborNext].neighborPrev = combinedNodeIndex;
+		}
+		if (neighborPrev != UNUSED)
+		{
+			m_nodes[combinedNodeIndex].neighborPrev = neighborPrev;
+			m_nodes[neighborPrev].neighborNext = combinedNodeIndex;
+		}
+	}
+
+	std::uint32_t offsetallocator::InsertNodeIntoBin(std::uint32_t size, std::uint32_t dataOffset)
+	{
+		std::uint32_t binIndex = SizeToBinRoundDown(size);
+		std::uint32_t topBinIndex = binIndex >> MANTISSA_BITS;
+		std::uint32_t leafBinIndex = binIndex & MANTISSA_MASK;
+
+		// Mark the bin as used if it was empty.
+		if (m_binIndices[binIndex] == UNUSED)
+		{
+			m_usedBins[topBinIndex] |= 1u << leafBinIndex;
+			m_usedBinsTop |= 1u << topBinIndex;
+		}
+
+		// Take a node from the free stack and push it at the front of the bin list.
+		std::uint32_t topNodeIndex = m_binIndices[binIndex];
+		std::uint32_t nodeIndex = m_freeNodes[--m_freeNodeCount];
+
+		node& inserted = m_nodes[nodeIndex];
+		inserted = node{};
+		inserted.dataOffset = dataOffset;
+		inserted.dataSize = size;
+		inserted.binListNext = topNodeIndex;
+		if (topNodeIndex != UNUSED)
+		{
+			m_nodes[topNodeIndex].binListPrev = nodeIndex;
+		}
+		m_binIndices[binIndex] = nodeIndex;
+
+		m_freeStorage += size;
+
+		return nodeIndex;
+	}
+
+	void offsetallocator::RemoveNodeFromBin(std::uint32_t nodeIndex)
+	{
+		node& removed = m_nodes[nodeIndex];
+
+		if (removed.binListPrev != UNUSED)
+		{
+			// Easy case: the node is in the middle of the list, just unlink it.
+			m_nodes[removed.binListPrev].binListNext = removed.binListNext;
+			if (removed.binListNext != UNUSED)
+			{
+				m_nodes[removed.binListNext].binListPrev = removed.binListPrev;
+			}
+		}
+		else
+		{
+			// The node is the head of the list so the bin itself has to be updated.
+			std::uint32_t binIndex = SizeToBinRoundDown(removed.dataSize);
+			std::uint32_t topBinIndex = binIndex >> MANTISSA_BITS;
+			std::uint32_t leafBinIndex = binIndex & MANTISSA_MASK;
+
+			m_binIndices[binIndex] = removed.binListNext;
+			if (removed.binListNext != UNUSED)
+			{
+				m_nodes[removed.binListNext].binListPrev = UNUSED;
+			}
+
+			if (m_binIndices[binIndex] == UNUSED)
+			{
+				m_usedBins[topBinIndex] &= ~(1u << leafBinIndex);
+				if (m_usedBins[topBinIndex] == 0)
+				{
+					m_usedBinsTop &= ~(1u << topBinIndex);
+				}
+			}
+		}
+
+		m_freeStorage -= removed.dataSize;
+		removed = node{};
+		m_freeNodes[m_freeNodeCount++] = nodeIndex;
+	}
+
+	std::uint32_t offsetallocator::AllocationSize(allocation alloc) const
+	{
+		if (alloc.metadata == NO_SPACE or alloc.metadata >= m_maxAllocs)
+		{
+			return 0;
+		}
+
+		return m_nodes[alloc.metadata].dataSize;
+	}
+
+	// The largest free region is reported from the highest used bin so it is rounded down
+	// to the bin size, which is what an allocation request would be able to get anyway.
+	offsetallocator::storagereport offsetallocator::StorageReport() const
+	{
+		storagereport report{};
+
+		if (m_freeNodeCount > 0)
+		{
+			report.totalFreeSpace = m_freeStorage;
+			if (m_usedBinsTop)
+			{
+				std::uint32_t topBinIndex = HighestSetBit(m_usedBinsTop);
+				std::uint32_t leafBinIndex = HighestSetBit(m_usedBins[topBinIndex]);
+				report.largestFreeRegion = BinToSize((topBinIndex << MANTISSA_BITS) | leafBinIndex);
+			}
+		}
+
+		return report;
+	}
+}
@@ -0,0 +1,98 @@
+// offsetallocator.h : include file for the device independent range allocator
+// The offsetallocator hands out offsets into a linear range (for example a large
+// vertex or index buffer) without touching the memory itself.
+// It is a two level segregated fit allocator: free regions are kept in 256 bins
+// whose sizes follow a tiny floating point format (5 bit exponent, 3 bit mantissa),
+// and two levels of bitmasks let both Allocate and Free run in constant time.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace graphics
+{
+	class offsetallocator
+	{
+	public:
+		static constexpr std::uint32_t NO_SPACE{ 0xffffffff };
+		static constexpr std::uint32_t NUM_TOP_BINS{ 32 };
+		static constexpr std::uint32_t BINS_PER_LEAF{ 8 };
+		static constexpr std::uint32_t NUM_LEAF_BINS{ NUM_TOP_BINS * BINS_PER_LEAF };
+
+		// An allocation is the offset of the range plus the internal node that tracks it.
+		// The metadata has to be passed back to Free, the offset is what the caller uses.
+		struct allocation
+		{
+			std::uint32_t offset{ NO_SPACE };
+			std::uint32_t metadata{ NO_SPACE };
+
+			bool IsValid() const { return offset != NO_SPACE; }
+		};
+
+		// The storage report is what defragmentation heuristics look at.
+		// When the total free space is much larger than the largest free region
+		// the range is fragmented and it is worth compacting it.
+		// While every tracking node is in use nothing can be allocated, and the report is empty.
+		struct storagereport
+		{
+			std::uint32_t totalFreeSpace{};
+			std::uint32_t largestFreeRegion{};
+		};
+
+		offsetallocator() = delete;
+		offsetallocator(std::uint32_t size, std::uint32_t maxAllocs = 128 * 1024);
+		offsetallocator(const offsetallocator& other) = delete;
+		offsetallocator(offsetallocator&& other) = default;
+		~offsetallocator() {};
+
+		offsetallocator& operator=(const offsetallocator& other) = delete;
+		offsetallocator& operator=(offsetallocator&& other) = default;
+
+		// Allocate returns an invalid allocation when there is no free region
+		// large enough or when the allocator ran out of tracking nodes.
+		allocation Allocate(std::uint32_t size);
+		void Free(allocation alloc);
+
+		// Reset drops every allocation at once and starts over with a single free region.
+		void Reset();
+
+		std::uint32_t AllocationSize(allocation alloc) const;
+		storagereport StorageReport() const;
+		std::uint32_t GetSize() const { return m_size; }
+
+		// Conversions between byte sizes and bin indices.
+		// Round up is used when searching so that any region in the found bin is large enough,
+		// round down is used when inserting so that a region never claims more than it has.
+		static std::uint32_t SizeToBinRoundUp(std::uint32_t size);
+		static std::uint32_t SizeToBinRoundDown(std::uint32_t size);
+		static std::uint32_t BinToSize(std::uint32_t bin);
+	private:
+		static constexpr std::uint32_t UNUSED{ 0xffffffff };
+
+		struct node
+		{
+			std::uint32_t dataOffset{};
+			std::uint32_t dataSize{};
+			std::uint32_t binListPrev{ UNUSED };
+			std::uint32_t binListNext{ UNUSED };
+			std::uint32_t neighborPrev{ UNUSED };
+			std::uint32_t neighborNext{ UNUSED };
+			bool used{};
+		};
+
+		std::uint32_t InsertNodeIntoBin(std::uint32_t size, std::uint32_t dataOffset);
+		void RemoveNodeFromBin(std::uint32_t nodeIndex);
+
+		std::uint32_t m_size{};
+		std::uint32_t m_maxAllocs{};
+		std::uint32_t m_freeStorage{};
+
+		std::uint32_t m_usedBinsTop{};
+		std::uint8_t m_usedBins[NUM_TOP_BINS]{};
+		std::uint32_t m_binIndices[NUM_LEAF_BINS]{};
+
+		std::vector<node> m_nodes{};
+		std::vector<std::uint32_t> m_freeNodes{};
+		std::uint32_t m_freeNodeCount{};
+	};
+}
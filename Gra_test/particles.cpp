@@ -0,0 +1,286 @@
+#include "stdafx.h"
+#include "particles.h"
+#include "profiler.h"
+#include "simdmath.h"
+#include <algorithm>
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr UINT FULL_MASK{ (1u << core::FLOATV_WIDTH) - 1 };
+
+		static_assert(PARTICLE_CHUNK_SIZE % core::FLOATV_WIDTH == 0, "Chunks have to hold whole vectors.");
+
+#if defined(__AVX2__)
+		// For every alive mask of eight particles the lanes of the alive ones in order and how many there are.
+		// Permuting a vector with the lanes moves the alive particles to its front.
+		struct packtable
+		{
+			std::uint64_t lanes[256];
+			std::uint8_t alive[256];
+
+			packtable()
+			{
+				for (UINT mask = 0; mask < 256; mask++)
+				{
+					std::uint64_t packed = 0;
+					UINT count = 0;
+					for (UINT lane = 0; lane < 8; lane++)
+					{
+						if (mask & (1u << lane))
+						{
+							packed |= static_cast<std::uint64_t>(lane) << (8 * count++);
+						}
+					}
+					lanes[mask] = packed;
+					alive[mask] = static_cast<std::uint8_t>(count);
+				}
+			}
+		};
+
+		const packtable g_pack;
+#endif
+	}
+
+	particlesystem::particlesystem(UINT capacity, std::uint32_t seed) :
+		m_random(seed ? seed : 1)
+	{
+		if (capacity == 0)
+		{
+			throw "Incorrect particle system capacity.";
+		}
+
+		UINT chunks = (capacity + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+		m_capacity = chunks * PARTICLE_CHUNK_SIZE;
+		for (std::vector<FLOAT>& values : m_streams)
+		{
+			values.resize(m_capacity);
+		}
+		m_chunkCounts.resize(chunks);
+		m_vertexOffsets.resize(chunks + 1);
+	}
+
+	particlesystem::emitterid particlesystem::AddEmitter(const particleemitter& emitter)
+	{
+		m_emitters.push_back(emitterstate{ emitter, 0.0f });
+		return static_cast<emitterid>(m_emitters.size() - 1);
+	}
+
+	void particlesystem::SetEmitter(emitterid id, const particleemitter& emitter)
+	{
+		m_emitters[id].settings = emitter;
+	}
+
+	void particlesystem::SetForces(const particleforces& forces)
+	{
+		m_forces = forces;
+	}
+
+	void particlesystem::Update(core::jobsystem& jobs, FLOAT stepSeconds)
+	{
+		PROFILE_SCOPE("particlesystem::Update");
+
+		jobs.ParallelFor(static_cast<std::uint32_t>(m_chunkCounts.size()), 1, [this, stepSeconds](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t chunk = begin; chunk < end; chunk++)
+			{
+				UpdateChunk(chunk, stepSeconds);
+			}
+		});
+
+		Emit(stepSeconds);
+	}
+
+	// The chunks are written at the offsets of a prefix sum over their counts, so the points come out packed.
+	UINT particlesystem::WriteVertices(core::jobsystem& jobs, colorvertex *vertices, UINT maxVertices)
+	{
+		PROFILE_SCOPE("particlesystem::WriteVertices");
+		UINT chunks = static_cast<UINT>(m_chunkCounts.size());
+
+		m_vertexOffsets[0] = 0;
+		for (UINT chunk = 0; chunk < chunks; chunk++)
+		{
+			m_vertexOffsets[chunk + 1] = (std::min)(m_vertexOffsets[chunk] + m_chunkCounts[chunk], maxVertices);
+		}
+
+		jobs.ParallelFor(chunks, 1, [this, vertices](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t chunk = begin; chunk < end; chunk++)
+			{
+				UINT first = chunk * PARTICLE_CHUNK_SIZE;
+				colorvertex *out = vertices + m_vertexOffsets[chunk];
+				UINT written = m_vertexOffsets[chunk + 1] - m_vertexOffsets[chunk];
+
+				for (UINT i = 0; i < written; i++)
+				{
+					UINT particle = first + i;
+					const particleemitter& source = m_emitters[static_cast<UINT>(m_streams[emitter][particle])].settings;
+					core::float4 t = core::Splat4(m_streams[age][particle] / m_streams[lifetime][particle]);
+
+					out[i].position = D3DXVECTOR3(m_streams[positionX][particle], m_streams[positionY][particle], m_streams[positionZ][particle]);
+					core::Store4(&out[i].color.x, core::Lerp4(core::Load4(&source.startColor.x), core::Load4(&source.endColor.x), t));
+				}
+			}
+		});
+
+		return m_vertexOffsets[chunks];
+	}
+
+	UINT particlesystem::GetCount() const
+	{
+		UINT total = 0;
+		for (UINT count : m_chunkCounts)
+		{
+			total += count;
+		}
+		return total;
+	}
+
+	UINT particlesystem::GetCapacity() const
+	{
+		return m_capacity;
+	}
+
+	UINT64 particlesystem::GetDropped() const
+	{
+		return m_dropped;
+	}
+
+	FLOAT* particlesystem::Stream(stream which)
+	{
+		return m_streams[which].data();
+	}
+
+	// v' = v + (gravity + drag * (wind - v)) * step is folded into v' = v * (1 - drag * step) + (gravity + drag * wind) * step.
+	// The write position only moves on by the number of particles still alive, so the dead ones are overwritten
+	// by those after them. Writing never gets ahead of reading, the update works in place.
+	void particlesystem::UpdateChunk(UINT chunk, FLOAT stepSeconds)
+	{
+		UINT first = chunk * PARTICLE_CHUNK_SIZE;
+		UINT live = m_chunkCounts[chunk];
+		FLOAT *streams[count];
+
+		for (UINT which = 0; which < count; which++)
+		{
+			streams[which] = Stream(static_cast<stream>(which)) + first;
+		}
+
+		core::floatv step = core::SplatV(stepSeconds);
+		core::floatv keep = core::SplatV(1.0f - m_forces.drag * stepSeconds);
+		core::floatv pullX = core::SplatV((m_forces.gravity.x + m_forces.drag * m_forces.wind.x) * stepSeconds);
+		core::floatv pullY = core::SplatV((m_forces.gravity.y + m_forces.drag * m_forces.wind.y) * stepSeconds);
+		core::floatv pullZ = core::SplatV((m_forces.gravity.z + m_forces.drag * m_forces.wind.z) * stepSeconds);
+		UINT written = 0;
+
+		for (UINT i = 0; i < live; i += core::FLOATV_WIDTH)
+		{
+			core::floatv values[count];
+
+			values[velocityX] = core::MulAddV(core::LoadV(streams[velocityX] + i), keep, pullX);
+			values[velocityY] = core::MulAddV(core::LoadV(streams[velocityY] + i), keep, pullY);
+			values[velocityZ] = core::MulAddV(core::LoadV(streams[velocityZ] + i), keep, pullZ);
+			values[positionX] = core::MulAddV(values[velocityX], step, core::LoadV(streams[positionX] + i));
+			values[positionY] = core::MulAddV(values[velocityY], step, core::LoadV(streams[positionY] + i));
+			values[positionZ] = core::MulAddV(values[velocityZ], step, core::LoadV(streams[positionZ] + i));
+			values[age] = core::AddV(core::LoadV(streams[age] + i), step);
+			values[lifetime] = core::LoadV(streams[lifetime] + i);
+			values[emitter] = core::LoadV(streams[emitter] + i);
+
+			// Lanes past the live particles of the chunk count as dead.
+			UINT valid = live - i >= core::FLOATV_WIDTH ? FULL_MASK : (1u << (live - i)) - 1;
+			UINT alive = static_cast<UINT>(core::LessMaskV(values[age], values[lifetime])) & valid;
+
+			if (alive == FULL_MASK)
+			{
+				for (UINT which = 0; which < count; which++)
+				{
+					core::StoreV(streams[which] + written, values[which]);
+				}
+				written += core::FLOATV_WIDTH;
+				continue;
+			}
+
+#if defined(__AVX2__)
+			// The full vector is stored, the lanes after the alive ones land on particles that were already read.
+			__m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&g_pack.lanes[alive])));
+			for (UINT which = 0; which < count; which++)
+			{
+				core::StoreV(streams[which] + written, _mm256_permutevar8x32_ps(values[which], lanes));
+			}
+			written += g_pack.alive[alive];
+#else
+			FLOAT lanes[count][core::FLOATV_WIDTH];
+			for (UINT which = 0; which < count; which++)
+			{
+				core::StoreV(lanes[which], values[which]);
+			}
+			for (UINT lane = 0; lane < core::FLOATV_WIDTH; lane++)
+			{
+				for (UINT which = 0; which < count; which++)
+				{
+					streams[which][written] = lanes[which][lane];
+				}
+				written += (alive >> lane) & 1;
+			}
+#endif
+		}
+
+		m_chunkCounts[chunk] = written;
+	}
+
+	// The new particles are spread over the step: each starts a random part of the step after its emitter
+	// fired it, so a fast emitter makes a stream instead of clumps.
+	void particlesystem::Emit(FLOAT stepSeconds)
+	{
+		UINT chunks = static_cast<UINT>(m_chunkCounts.size());
+		UINT openChunk = 0;
+
+		for (UINT id = 0; id < m_emitters.size(); id++)
+		{
+			emitterstate& state = m_emitters[id];
+			const particleemitter& settings = state.settings;
+
+			state.pending += settings.rate * stepSeconds;
+			UINT emitted = static_cast<UINT>(state.pending);
+			state.pending -= static_cast<FLOAT>(emitted);
+
+			for (UINT i = 0; i < emitted; i++)
+			{
+				while (openChunk < chunks and m_chunkCounts[openChunk] == PARTICLE_CHUNK_SIZE)
+				{
+					openChunk++;
+				}
+				if (openChunk == chunks)
+				{
+					m_dropped += emitted - i;
+					break;
+				}
+
+				UINT particle = openChunk * PARTICLE_CHUNK_SIZE + m_chunkCounts[openChunk]++;
+				FLOAT elapsed = Random() * stepSeconds;
+				D3DXVECTOR3 velocity = settings.velocity + D3DXVECTOR3(Random() * 2.0f - 1.0f, Random() * 2.0f - 1.0f, Random() * 2.0f - 1.0f) * settings.spread;
+				D3DXVECTOR3 position = settings.position + velocity * elapsed;
+
+				m_streams[positionX][particle] = position.x;
+				m_streams[positionY][particle] = position.y;
+				m_streams[positionZ][particle] = position.z;
+				m_streams[velocityX][particle] = velocity.x;
+				m_streams[velocityY][particle] = velocity.y;
+				m_streams[velocityZ][particle] = velocity.z;
+				m_streams[age][particle] = elapsed;
+				m_streams[lifetime][particle] = settings.lifetime * (0.75f + 0.5f * Random());
+				m_streams[emitter][particle] = static_cast<FLOAT>(id);
+			}
+		}
+	}
+
+	// xorshift32, the upper 24 bits give a float in [0, 1).
+	FLOAT particlesystem::Random()
+	{
+		m_random ^= m_random << 13;
+		m_random ^= m_random >> 17;
+		m_random ^= m_random << 5;
+		return static_cast<FLOAT>(m_random >> 8) * (1.0f / 16777216.0f);
+	}
+}
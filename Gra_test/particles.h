@@ -0,0 +1,96 @@
+// particles.h : include file for the particle system
+// Particles are stored as structure of arrays: one stream of floats per attribute, so the update
+// loads and stores FLOATV_WIDTH particles per instruction (see simdmath.h).
+// The streams are cut into chunks of PARTICLE_CHUNK_SIZE particles. Every chunk keeps its live particles
+// packed at its start and is updated by one job:
+//  - velocities are pulled by gravity and by drag towards the wind, positions follow, ages grow,
+//  - in the same pass the particles still alive are written back packed, dead ones are skipped
+//    by advancing the write position by the alive bit instead of branching on it.
+// New particles are emitted after the update into the first chunks with room.
+// WriteVertices turns the particles into a point list for the color shader, the color fades
+// from the emitter's start color to its end color over the life of the particle.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+#include "meshdata.h"
+
+namespace graphics
+{
+	constexpr UINT PARTICLE_CHUNK_SIZE{ 16384 };
+
+	// An emitter sends rate particles per second from its position with its velocity plus a random one
+	// of up to spread in every direction. Particles live between 0.75 and 1.25 times the lifetime.
+	struct particleemitter
+	{
+		D3DXVECTOR3 position;
+		D3DXVECTOR3 velocity;
+		FLOAT spread;
+		FLOAT rate;
+		FLOAT lifetime;
+		D3DXVECTOR4 startColor;
+		D3DXVECTOR4 endColor;
+	};
+
+	// Drag is the fraction of the difference to the wind velocity a particle loses per second.
+	struct particleforces
+	{
+		D3DXVECTOR3 gravity;
+		D3DXVECTOR3 wind;
+		FLOAT drag;
+	};
+
+	class particlesystem
+	{
+	public:
+		typedef UINT emitterid;
+
+		particlesystem() = delete;
+		// The capacity is rounded up to whole chunks. Particles emitted while the system is full are dropped.
+		particlesystem(UINT capacity, std::uint32_t seed = 1);
+		particlesystem(const particlesystem& other) = delete;
+
+		particlesystem& operator=(const particlesystem& other) = delete;
+
+		// An emitter with a rate of zero stops emitting, its particles live on.
+		emitterid AddEmitter(const particleemitter& emitter);
+		void SetEmitter(emitterid id, const particleemitter& emitter);
+		void SetForces(const particleforces& forces);
+
+		void Update(core::jobsystem& jobs, FLOAT stepSeconds);
+
+		// WriteVertices writes a point for every live particle, at most maxVertices, and returns how many it wrote.
+		UINT WriteVertices(core::jobsystem& jobs, colorvertex *vertices, UINT maxVertices);
+
+		UINT GetCount() const;
+		UINT GetCapacity() const;
+		UINT64 GetDropped() const;
+	private:
+		enum stream : UINT
+		{
+			positionX, positionY, positionZ, velocityX, velocityY, velocityZ, age, lifetime, emitter, count
+		};
+
+		struct emitterstate
+		{
+			particleemitter settings;
+			FLOAT pending;
+		};
+
+		FLOAT* Stream(stream which);
+		void UpdateChunk(UINT chunk, FLOAT stepSeconds);
+		void Emit(FLOAT stepSeconds);
+		FLOAT Random();
+
+		// The emitter stream holds the index of the particle's emitter as a float, exact for any realistic count.
+		std::vector<FLOAT> m_streams[count];
+		std::vector<UINT> m_chunkCounts{};
+		std::vector<UINT> m_vertexOffsets{};
+		std::vector<emitterstate> m_emitters{};
+		particleforces m_forces{};
+		UINT m_capacity{};
+		UINT64 m_dropped{};
+		std::uint32_t m_random{};
+	};
+}
@@ -0,0 +1,156 @@
+#include "stdafx.h"
+#include "platform.h"
+#include <chrono>
+#include <thread>
+
+namespace app
+{
+	std::uint64_t steadyclock::Now()
+	{
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	std::uint64_t steadyclock::Frequency()
+	{
+		return 1000000000ull;
+	}
+
+	void steadyclock::WaitUntil(std::uint64_t tick)
+	{
+		while (Now() < tick)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	manualclock::manualclock(std::uint64_t frequency) :
+		m_frequency(frequency)
+	{
+		if (frequency == 0)
+		{
+			throw "Incorrect clock frequency.";
+		}
+	}
+
+	std::uint64_t manualclock::Now()
+	{
+		return m_now;
+	}
+
+	std::uint64_t manualclock::Frequency()
+	{
+		return m_frequency;
+	}
+
+	void manualclock::WaitUntil(std::uint64_t tick)
+	{
+		if (tick > m_now)
+		{
+			m_now = tick;
+		}
+	}
+
+	void manualclock::Advance(std::uint64_t ticks)
+	{
+		m_now += ticks;
+	}
+
+	scriptedmessages::scriptedmessages(std::uint64_t quitPump, int exitCode) :
+		m_quitPump(quitPump), m_exitCode(exitCode)
+	{
+	}
+
+	bool scriptedmessages::PumpMessages()
+	{
+		m_pumps++;
+		return m_quitPump == 0 or m_pumps < m_quitPump;
+	}
+
+	int scriptedmessages::GetExitCode()
+	{
+		return m_exitCode;
+	}
+
+	std::uint64_t scriptedmessages::GetPumpCount() const
+	{
+		return m_pumps;
+	}
+
+#ifdef _WIN32
+	qpcclock::qpcclock()
+	{
+		LARGE_INTEGER frequency;
+
+		QueryPerformanceFrequency(&frequency);
+		m_frequency = static_cast<std::uint64_t>(frequency.QuadPart);
+	}
+
+	std::uint64_t qpcclock::Now()
+	{
+		LARGE_INTEGER counter;
+
+		QueryPerformanceCounter(&counter);
+		return static_cast<std::uint64_t>(counter.QuadPart);
+	}
+
+	std::uint64_t qpcclock::Frequency()
+	{
+		return m_frequency;
+	}
+
+	void qpcclock::WaitUntil(std::uint64_t tick)
+	{
+		std::uint64_t now = Now();
+		std::uint64_t spinTicks = m_frequency / 500;
+
+		// Sleep can oversleep by a whole scheduler quantum, so it is only used
+		// while more than 2 ms are left and the last part is a busy wait.
+		while (now + spinTicks < tick)
+		{
+			Sleep(static_cast<DWORD>((tick - now - spinTicks) * 1000 / m_frequency));
+			now = Now();
+		}
+
+		while (now < tick)
+		{
+			std::this_thread::yield();
+			now = Now();
+		}
+	}
+
+	win32messages::win32messages(HACCEL accelerators) :
+		m_accelerators(accelerators)
+	{
+	}
+
+	// Unlike GetMessage, PeekMessage returns immediately when the queue is empty
+	// so frames are no longer tied to the arrival of input.
+	bool win32messages::PumpMessages()
+	{
+		MSG msg;
+
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+		{
+			if (msg.message == WM_QUIT)
+			{
+				m_exitCode = static_cast<int>(msg.wParam);
+				return false;
+			}
+
+			if (!TranslateAccelerator(msg.hwnd, m_accelerators, &msg))
+			{
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+			}
+		}
+
+		return true;
+	}
+
+	int win32messages::GetExitCode()
+	{
+		return m_exitCode;
+	}
+#endif
+}
@@ -0,0 +1,84 @@
+// platform.h : include file for the platform specific implementations of the main loop interfaces
+// steadyclock works everywhere and is what headless builds use,
+// qpcclock and win32messages are the Windows implementations used by the game.
+// manualclock and scriptedmessages are fakes that let a test drive the loop frame by frame.
+#pragma once
+
+#include "stdafx.h"
+#include "mainloop.h"
+
+namespace app
+{
+	// Time source based on std::chrono::steady_clock, ticks are nanoseconds.
+	class steadyclock : public timesource
+	{
+	public:
+		std::uint64_t Now() override;
+		std::uint64_t Frequency() override;
+		void WaitUntil(std::uint64_t tick) override;
+	};
+
+	// Time source that only moves when it is advanced. WaitUntil jumps straight to the tick,
+	// so a frame cap paces the loop without taking any real time.
+	class manualclock : public timesource
+	{
+	public:
+		manualclock() = delete;
+		manualclock(std::uint64_t frequency);
+		std::uint64_t Now() override;
+		std::uint64_t Frequency() override;
+		void WaitUntil(std::uint64_t tick) override;
+
+		void Advance(std::uint64_t ticks);
+	private:
+		std::uint64_t m_frequency{};
+		std::uint64_t m_now{};
+	};
+
+	// Message source that asks to quit with the exit code on the given pump, counted from 1.
+	// A quit pump of 0 never quits.
+	class scriptedmessages : public messagesource
+	{
+	public:
+		scriptedmessages() = delete;
+		scriptedmessages(std::uint64_t quitPump, int exitCode);
+		bool PumpMessages() override;
+		int GetExitCode() override;
+
+		std::uint64_t GetPumpCount() const;
+	private:
+		std::uint64_t m_quitPump{};
+		std::uint64_t m_pumps{};
+		int m_exitCode{};
+	};
+
+#ifdef _WIN32
+	// Time source based on the performance counter.
+	// WaitUntil sleeps while there is more than a couple of milliseconds left
+	// and spins for the rest, Sleep alone is far too coarse to pace frames.
+	class qpcclock : public timesource
+	{
+	public:
+		qpcclock();
+		std::uint64_t Now() override;
+		std::uint64_t Frequency() override;
+		void WaitUntil(std::uint64_t tick) override;
+	private:
+		std::uint64_t m_frequency{};
+	};
+
+	// Message source that drains the thread's message queue with PeekMessage
+	// and remembers the exit code carried by WM_QUIT.
+	class win32messages : public messagesource
+	{
+	public:
+		win32messages() = delete;
+		win32messages(HACCEL accelerators);
+		bool PumpMessages() override;
+		int GetExitCode() override;
+	private:
+		HACCEL m_accelerators{};
+		int m_exitCode{};
+	};
+#endif
+}
@@ -0,0 +1,305 @@
+#include "stdafx.h"
+#include "profiler.h"
+#include "memorytracker.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace core
+{
+	std::atomic<bool> profiler::s_enabled{};
+
+	namespace
+	{
+		constexpr std::uint32_t MAX_SCOPE_DEPTH{ 64 };
+		constexpr std::uint32_t MAX_THREAD_NAME{ 32 };
+
+		// Only the owning thread writes its ring. The count of written events is published
+		// with release so readers on other threads see the events before the count.
+		struct threadprofile
+		{
+			profilerevent events[PROFILER_RING_SIZE];
+			std::atomic<std::uint64_t> written{};
+			const char *scopes[MAX_SCOPE_DEPTH];
+			std::uint64_t beginnings[MAX_SCOPE_DEPTH];
+			std::uint32_t depth{};
+			std::uint32_t id{};
+			char name[MAX_THREAD_NAME]{};
+		};
+
+		// The ring of a thread goes back to the free list when the thread ends and is handed to the next thread
+		// that records anything. Its events stay readable until the new owner overwrites them.
+		struct threadslot
+		{
+			threadprofile *profile{};
+
+			~threadslot();
+		};
+
+		std::mutex g_threadsMutex;
+		std::vector<std::unique_ptr<threadprofile>> g_threads;
+		std::vector<threadprofile*> g_free;
+		std::uint32_t g_nextId{};
+		thread_local threadslot t_slot;
+
+		struct calibration
+		{
+			std::uint64_t ticks;
+			std::chrono::steady_clock::time_point time;
+		};
+		const calibration g_start{ profiler::Now(), std::chrono::steady_clock::now() };
+
+		// A ring is created only when no ended thread left one behind, so there are never more rings than
+		// threads that recorded at the same time. They are reported to the memory tracker as they are created.
+		// A reused ring gets a new id, the events left from its last owner keep the old one.
+		threadprofile& ThreadProfile()
+		{
+			if (!t_slot.profile)
+			{
+				bool created = false;
+				{
+					std::lock_guard<std::mutex> lock(g_threadsMutex);
+
+					if (g_free.empty())
+					{
+						g_threads.emplace_back(new threadprofile());
+						g_free.push_back(g_threads.back().get());
+						created = true;
+					}
+					threadprofile *profile = g_free.back();
+					g_free.pop_back();
+
+					profile->depth = 0;
+					profile->id = g_nextId++;
+					profile->name[0] = 0;
+					t_slot.profile = profile;
+				}
+
+				// Outside the lock, a budget callback may record scopes itself.
+				if (created)
+				{
+					memorytracker::Allocated(memorytag::profiler, sizeof(threadprofile));
+				}
+			}
+			return *t_slot.profile;
+		}
+
+		threadslot::~threadslot()
+		{
+			if (profile)
+			{
+				std::lock_guard<std::mutex> lock(g_threadsMutex);
+				g_free.push_back(profile);
+			}
+		}
+
+		void WriteEscaped(std::ofstream& file, const char *text)
+		{
+			for (; *text; text++)
+			{
+				if (*text == '"' or *text == '\\')
+				{
+					file << '\\';
+				}
+				file << *text;
+			}
+		}
+	}
+
+	void profiler::SetEnabled(bool enabled)
+	{
+		s_enabled.store(enabled);
+	}
+
+	void profiler::SetThreadName(const char *name)
+	{
+		threadprofile& profile = ThreadProfile();
+		std::uint32_t i = 0;
+
+		for (; name[i] and i < MAX_THREAD_NAME - 1; i++)
+		{
+			profile.name[i] = name[i];
+		}
+		profile.name[i] = 0;
+	}
+
+	std::uint64_t profiler::Now()
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	// The counter runs at a constant rate on every processor this targets, its frequency is
+	// not reported anywhere portable though, so it is measured over the time since start up.
+	// Shortly after start up the measurement waits until at least 50 ms have passed.
+	double profiler::TicksPerSecond()
+	{
+		static std::atomic<double> s_ticksPerSecond{};
+
+		double cached = s_ticksPerSecond.load(std::memory_order_relaxed);
+		if (cached > 0.0)
+		{
+			return cached;
+		}
+
+		std::chrono::duration<double> elapsed;
+		std::uint64_t ticks;
+		do
+		{
+			ticks = Now();
+			elapsed = std::chrono::steady_clock::now() - g_start.time;
+		} while (elapsed.count() < 0.05);
+
+		double measured = static_cast<double>(ticks - g_start.ticks) / elapsed.count();
+		if (elapsed.count() > 1.0)
+		{
+			s_ticksPerSecond.store(measured, std::memory_order_relaxed);
+		}
+
+		return measured;
+	}
+
+	void profiler::BeginScope(const char *name, std::uint64_t begin)
+	{
+		threadprofile& profile = ThreadProfile();
+
+		if (profile.depth < MAX_SCOPE_DEPTH)
+		{
+			profile.scopes[profile.depth] = name;
+			profile.beginnings[profile.depth] = begin;
+		}
+		profile.depth++;
+	}
+
+	void profiler::EndScope(std::uint64_t end)
+	{
+		threadprofile& profile = ThreadProfile();
+
+		profile.depth--;
+		if (profile.depth >= MAX_SCOPE_DEPTH)
+		{
+			return;
+		}
+
+		std::uint64_t written = profile.written.load(std::memory_order_relaxed);
+		profilerevent& event = profile.events[written % PROFILER_RING_SIZE];
+		event.name = profile.scopes[profile.depth];
+		event.begin = profile.beginnings[profile.depth];
+		event.end = end;
+		event.depth = profile.depth;
+		event.thread = profile.id;
+		profile.written.store(written + 1, std::memory_order_release);
+	}
+
+	std::uint32_t profiler::GetActiveScopes(const char **names, std::uint32_t maxNames)
+	{
+		threadprofile& profile = ThreadProfile();
+		std::uint32_t count = profile.depth < MAX_SCOPE_DEPTH ? profile.depth : MAX_SCOPE_DEPTH;
+
+		if (count > maxNames)
+		{
+			count = maxNames;
+		}
+		for (std::uint32_t i = 0; i < count; i++)
+		{
+			names[i] = profile.scopes[i];
+		}
+
+		return count;
+	}
+
+	// The rings keep being written while they are read. An event is only passed on if the writer has not
+	// started on its slot again by the time it was copied, which it does once written reaches i + PROFILER_RING_SIZE.
+	// Rings are never freed, so the lock is only held to copy the list and the function may record scopes itself.
+	void profiler::ForEachEvent(std::uint64_t begin, std::uint64_t end, const std::function<void(const profilerevent&)>& function)
+	{
+		std::vector<threadprofile*> profiles;
+		{
+			std::lock_guard<std::mutex> lock(g_threadsMutex);
+			profiles.reserve(g_threads.size());
+			for (auto& profile : g_threads)
+			{
+				profiles.push_back(profile.get());
+			}
+		}
+
+		for (threadprofile *profile : profiles)
+		{
+			std::uint64_t written = profile->written.load(std::memory_order_acquire);
+			std::uint64_t first = written > PROFILER_RING_SIZE ? written - PROFILER_RING_SIZE : 0;
+
+			for (std::uint64_t i = first; i < written; i++)
+			{
+				profilerevent event = profile->events[i % PROFILER_RING_SIZE];
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (profile->written.load(std::memory_order_relaxed) - i >= PROFILER_RING_SIZE)
+				{
+					continue;
+				}
+
+				if (event.end >= begin and event.end < end)
+				{
+					function(event);
+				}
+			}
+		}
+	}
+
+	// Events become complete ("X") events with microsecond timestamps relative to start up,
+	// every thread with a name gets a thread_name metadata event.
+	bool profiler::ExportChromeTrace(const char *path)
+	{
+		std::ofstream file(path, std::ios::out | std::ios::trunc);
+		if (file.fail())
+		{
+			return false;
+		}
+
+		double microsecondsPerTick = 1000000.0 / TicksPerSecond();
+		bool first = true;
+
+		file << "{\"traceEvents\":[\n";
+
+		{
+			std::lock_guard<std::mutex> lock(g_threadsMutex);
+			for (auto& profile : g_threads)
+			{
+				if (profile->name[0])
+				{
+					file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << profile->id
+						<< ",\"args\":{\"name\":\"";
+					WriteEscaped(file, profile->name);
+					file << "\"}}";
+					first = false;
+				}
+			}
+		}
+
+		ForEachEvent(0, ~0ull, [&](const profilerevent& event)
+		{
+			file << (first ? "" : ",\n") << "{\"name\":\"";
+			WriteEscaped(file, event.name);
+			file << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread
+				<< ",\"ts\":" << static_cast<double>(event.begin - g_start.ticks) * microsecondsPerTick
+				<< ",\"dur\":" << static_cast<double>(event.end - event.begin) * microsecondsPerTick << "}";
+			first = false;
+		});
+
+		file << "\n]}\n";
+		file.close();
+
+		return !file.fail();
+	}
+}
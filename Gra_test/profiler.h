@@ -0,0 +1,90 @@
+// profiler.h : include file for the CPU scope profiler
+// PROFILE_SCOPE("name") measures the enclosing block. When the block ends the scope is written
+// as one event (name, start, end, nesting depth) into a ring buffer owned by the calling thread,
+// so recording takes no locks and older events are simply overwritten. The ring of a thread that ended is handed
+// to the next new thread, the rings are reported to the memory tracker under memorytag::profiler.
+// Timestamps come from the time stamp counter and are converted to microseconds on export only.
+// Recording is switched on and off at runtime, while it is off a scope costs one relaxed load.
+// Defining PROFILER_DISABLED removes the scopes from the build altogether.
+//
+// ExportChromeTrace writes what the rings currently hold in the Chrome trace event format,
+// the file can be opened with chrome://tracing or https://ui.perfetto.dev.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+namespace core
+{
+	constexpr std::uint32_t PROFILER_RING_SIZE{ 64 * 1024 };
+
+	struct profilerevent
+	{
+		const char *name;
+		std::uint64_t begin;
+		std::uint64_t end;
+		std::uint32_t depth;
+		std::uint32_t thread;
+	};
+
+	class profiler
+	{
+	public:
+		static void SetEnabled(bool enabled);
+		static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+		// Names the calling thread in exported traces.
+		static void SetThreadName(const char *name);
+
+		// Now reads the time stamp counter, TicksPerSecond is measured against the steady clock.
+		static std::uint64_t Now();
+		static double TicksPerSecond();
+
+		// Scopes push their name on entry and record the event on exit.
+		// GetActiveScopes copies the names of the scopes the calling thread is inside of, outermost first.
+		static void BeginScope(const char *name, std::uint64_t begin);
+		static void EndScope(std::uint64_t end);
+		static std::uint32_t GetActiveScopes(const char **names, std::uint32_t maxNames);
+
+		// ForEachEvent calls the function for every recorded event that ended in [begin, end) on any thread.
+		static void ForEachEvent(std::uint64_t begin, std::uint64_t end, const std::function<void(const profilerevent&)>& function);
+
+		static bool ExportChromeTrace(const char *path);
+	private:
+		static std::atomic<bool> s_enabled;
+	};
+
+	class profilerscope
+	{
+	public:
+		profilerscope(const char *name) : m_active(profiler::IsEnabled())
+		{
+			if (m_active)
+			{
+				profiler::BeginScope(name, profiler::Now());
+			}
+		};
+		profilerscope(const profilerscope& other) = delete;
+		~profilerscope()
+		{
+			if (m_active)
+			{
+				profiler::EndScope(profiler::Now());
+			}
+		};
+
+		profilerscope& operator=(const profilerscope& other) = delete;
+	private:
+		bool m_active;
+	};
+}
+
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) core::profilerscope PROFILER_CONCAT(profilerScope, __LINE__)(name)
+#endif
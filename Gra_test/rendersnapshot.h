@@ -0,0 +1,142 @@
+// rendersnapshot.h : include file for the data handed from the simulation to the render thread
+// A snapshot is everything the render thread needs to draw one frame.
+// It is filled by the simulation and only read by the render thread afterwards,
+// so neither side ever looks at the other's live objects.
+#pragma once
+
+#include <algorithm>
+#include "d3dxmath.h"
+#include "allocators.h"
+#include "meshdata.h"
+#include "shaderparameters.h"
+#include "spritebatch.h"
+
+namespace graphics
+{
+	// One indexed draw out of the mesh heap with the world matrix at transforms[transform].
+	struct drawitem
+	{
+		UINT page{};
+		UINT indexCount{};
+		UINT startIndex{};
+		UINT baseVertex{};
+		UINT transform{};
+	};
+
+	// A skinned mesh: the indices of a mesh heap range drawn over the vertices of skinnedVertices from firstVertex on,
+	// which the render thread streams through the dynamic geometry buffer.
+	struct skinneddraw
+	{
+		UINT page{};
+		UINT indexCount{};
+		UINT startIndex{};
+		UINT firstVertex{};
+		UINT transform{};
+	};
+
+	// A terrain chunk: the vertices of its slot in the terrain chunk buffer drawn with the indices of its stitch variant.
+	struct terraindraw
+	{
+		UINT slot{};
+		UINT startIndex{};
+		UINT indexCount{};
+	};
+
+	// A terrain chunk that finished loading, the vertices of terrainVertices from firstVertex on go into its slot
+	// before anything is drawn.
+	struct terrainupload
+	{
+		UINT slot{};
+		UINT firstVertex{};
+	};
+
+	// The window size, the size the scene is drawn at and the projection matrix are the simulation's,
+	// the render thread resizes its buffers to them when the window changed.
+	// The input time is that of the oldest input the frame shows for the first time, 0 when there is none.
+	// The mesh generation is the one of the mesh heap ranges in the draws, see meshheap::Bind.
+	// The particles are written as a point list in world space, see particles.h.
+	// The lights are in view space with their clusters and light index list as the light buffer takes them, see lightclusters.h.
+	// The sprites are the quads of the sprite batch in the order of their draws. The glyph atlas rows the batch
+	// put new glyphs into are copied along, atlasRows rows from atlasTop on, the render thread uploads them before drawing.
+	// The debug lines are a line list in world space collected from all threads, see debugdraw.h.
+	// Dropped counts what the frame arena had no room for, see Fit.
+	struct rendersnapshot
+	{
+		UINT64 frame{};
+		D3DXMATRIX view{};
+		D3DXVECTOR3 cameraPosition{};
+		D3DXMATRIX projection{};
+		UINT screenWidth{}, screenHeight{};
+		UINT renderWidth{}, renderHeight{};
+		std::uint64_t inputTime{};
+		UINT64 meshGeneration{};
+		core::linearvector<D3DXMATRIX> transforms{};
+		core::linearvector<drawitem> draws{};
+		core::linearvector<colorvertex> skinnedVertices{};
+		core::linearvector<skinneddraw> skinnedDraws{};
+		core::linearvector<colorvertex> particleVertices{};
+		core::linearvector<colorvertex> terrainVertices{};
+		core::linearvector<terrainupload> terrainUploads{};
+		core::linearvector<terraindraw> terrainDraws{};
+		core::linearvector<gpulight> lights{};
+		core::linearvector<clusterrange> lightClusters{};
+		core::linearvector<UINT> clusterLights{};
+		clusterbuffer clusterConstants{};
+		core::linearvector<spritevertex> spriteVertices{};
+		core::linearvector<spritedraw> spriteDraws{};
+		core::linearvector<std::uint8_t> atlasPixels{};
+		UINT atlasTop{}, atlasRows{};
+		core::linearvector<colorvertex> debugVertices{};
+		UINT64 dropped{};
+
+		// Reset empties the lists and moves them into the frame arena of the snapshot's slot.
+		// The arena is reset right before, so whatever the lists held last time is already gone.
+		void Reset(core::linearallocator& arena, size_t expectedDraws)
+		{
+			transforms = core::linearvector<D3DXMATRIX>(core::linearadapter<D3DXMATRIX>(arena));
+			draws = core::linearvector<drawitem>(core::linearadapter<drawitem>(arena));
+			skinnedVertices = core::linearvector<colorvertex>(core::linearadapter<colorvertex>(arena));
+			skinnedDraws = core::linearvector<skinneddraw>(core::linearadapter<skinneddraw>(arena));
+			particleVertices = core::linearvector<colorvertex>(core::linearadapter<colorvertex>(arena));
+			terrainVertices = core::linearvector<colorvertex>(core::linearadapter<colorvertex>(arena));
+			terrainUploads = core::linearvector<terrainupload>(core::linearadapter<terrainupload>(arena));
+			terrainDraws = core::linearvector<terraindraw>(core::linearadapter<terraindraw>(arena));
+			lights = core::linearvector<gpulight>(core::linearadapter<gpulight>(arena));
+			lightClusters = core::linearvector<clusterrange>(core::linearadapter<clusterrange>(arena));
+			clusterLights = core::linearvector<UINT>(core::linearadapter<UINT>(arena));
+			spriteVertices = core::linearvector<spritevertex>(core::linearadapter<spritevertex>(arena));
+			spriteDraws = core::linearvector<spritedraw>(core::linearadapter<spritedraw>(arena));
+			atlasPixels = core::linearvector<std::uint8_t>(core::linearadapter<std::uint8_t>(arena));
+			atlasTop = atlasRows = 0;
+			debugVertices = core::linearvector<colorvertex>(core::linearadapter<colorvertex>(arena));
+			// The draws expected are only a guess, the ones past the room are counted as they are dropped.
+			Fit(transforms, expectedDraws);
+			Fit(draws, expectedDraws);
+			dropped = 0;
+		}
+
+		// Fit makes room in the list for count elements, or for as many as the frame arena still has room for,
+		// and returns how many that is. The rest is added to dropped: the lists are filled up to their capacity
+		// and never grown past it, so a full arena drops items instead of throwing std::bad_alloc.
+		template<typename T>
+		size_t Fit(core::linearvector<T>& list, size_t count)
+		{
+			if (count <= list.capacity())
+			{
+				return count;
+			}
+
+			const core::linearallocator *arena = list.get_allocator().GetArena();
+			size_t room = arena ? arena->GetCapacity() - (std::min)(arena->GetUsed(), arena->GetCapacity()) : 0;
+			size_t fits = (std::max)(list.capacity(), room > alignof(T) ? (room - alignof(T)) / sizeof(T) : 0);
+			if (count > fits)
+			{
+				dropped += count - fits;
+				count = fits;
+			}
+
+			list.reserve(count);
+			return count;
+		}
+	};
+}
@@ -0,0 +1,116 @@
+#include "stdafx.h"
+#include "replay.h"
+#include "profiler.h"
+
+namespace graphics
+{
+	bool replayer::Run(capturereader& capture, replayresult& result)
+	{
+		scene world(m_jobs);
+		captureevent event;
+		D3DXMATRIX projectionMatrix;
+		PROFILE_SCOPE("replayer::Run");
+
+		D3DXMatrixIdentity(&projectionMatrix);
+		m_instances.clear();
+		capture.Rewind();
+
+		while (capture.Next(event))
+		{
+			switch (event.type)
+			{
+			case captureeventtype::windowsize:
+				result.width = event.width;
+				result.height = event.height;
+				break;
+			case captureeventtype::projection:
+				projectionMatrix = event.projection;
+				break;
+			case captureeventtype::camera:
+				world.RestoreCamera(event.previousCamera, event.currentCamera);
+				break;
+			case captureeventtype::create:
+				if (event.instance.index >= m_instances.size())
+				{
+					m_instances.resize(event.instance.index + 1);
+				}
+				m_instances[event.instance.index] = mappedinstance{ event.instance, world.CreateInstance(event.placement, event.mesh) };
+				break;
+			case captureeventtype::destroy:
+				if (event.instance.index < m_instances.size() and m_instances[event.instance.index].captured == event.instance)
+				{
+					world.DestroyInstance(m_instances[event.instance.index].replayed);
+					m_instances[event.instance.index] = mappedinstance{};
+				}
+				break;
+			case captureeventtype::place:
+				world.SetPlacement(Replayed(event.instance), event.placement);
+				break;
+			case captureeventtype::parent:
+				world.SetParent(Replayed(event.instance), Replayed(event.parent));
+				break;
+			case captureeventtype::relocate:
+				world.RelocateMesh(event.relocatedFrom, event.mesh);
+				break;
+			case captureeventtype::update:
+				world.Update(event.seconds);
+				result.steps++;
+				break;
+			case captureeventtype::frame:
+			{
+				std::uint32_t entityCount = world.GetEntities().GetEntityCount();
+				PrepareFrameMemory(entityCount);
+				m_snapshot.Reset(*m_frameMemory, entityCount);
+				world.BuildSnapshot(event.alpha, projectionMatrix, m_snapshot);
+				m_renderer.Render(m_snapshot, projectionMatrix);
+
+				const std::vector<drawitem>& captured = *event.draws;
+				bool drawsMatch = captured.size() == m_snapshot.draws.size();
+				for (std::size_t i = 0; drawsMatch and i < captured.size(); i++)
+				{
+					const drawitem& replayed = m_snapshot.draws[i];
+					drawsMatch = captured[i].page == replayed.page and captured[i].indexCount == replayed.indexCount
+						and captured[i].startIndex == replayed.startIndex and captured[i].baseVertex == replayed.baseVertex;
+				}
+				bool checksumMatches = m_renderer.GetFrameChecksum() == event.checksum;
+
+				result.drawMismatches += drawsMatch ? 0 : 1;
+				result.checksumMismatches += checksumMatches ? 0 : 1;
+				if ((!drawsMatch or !checksumMatches) and result.firstMismatch == replayresult::NO_FRAME)
+				{
+					result.firstMismatch = result.frames;
+				}
+				result.draws += m_snapshot.draws.size();
+				result.frames++;
+				break;
+			}
+			}
+		}
+
+		return !capture.IsDamaged();
+	}
+
+	core::entity replayer::Replayed(core::entity captured) const
+	{
+		bool known = captured.IsValid() and captured.index < m_instances.size() and m_instances[captured.index].captured == captured;
+		return known ? m_instances[captured.index].replayed : core::entity{};
+	}
+
+	const nullrenderer& replayer::GetRenderer() const
+	{
+		return m_renderer;
+	}
+
+	// The snapshot reserves room for a draw of every entity, the arena is made large enough
+	// for that with some headroom and only grows when the scene does.
+	void replayer::PrepareFrameMemory(std::uint32_t entityCount)
+	{
+		std::size_t needed = static_cast<std::size_t>(entityCount) * (sizeof(D3DXMATRIX) + sizeof(drawitem)) + 1024;
+
+		if (!m_frameMemory or m_frameMemory->GetCapacity() < needed)
+		{
+			m_frameMemory.reset(new core::linearallocator(needed * 2));
+		}
+		m_frameMemory->Reset();
+	}
+}
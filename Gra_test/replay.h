@@ -0,0 +1,66 @@
+// replay.h : include file for replaying captured sessions without a device
+// The replayer feeds a capture into a fresh scene as fast as it can, renders every frame
+// with the null renderer and compares what comes out with what the capture recorded.
+// A replay built from the same code as the capture matches it exactly. Replays built
+// against another math library (the D3DX one on Windows, d3dxmath.cpp elsewhere) can differ
+// in the last bits of the matrices, then only the checksums differ while the draws still match.
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "capture.h"
+#include "nullrenderer.h"
+
+namespace graphics
+{
+	struct replayresult
+	{
+		static constexpr std::uint64_t NO_FRAME{ ~0ull };
+
+		UINT width{}, height{};
+		std::uint64_t steps{};
+		std::uint64_t frames{};
+		std::uint64_t draws{};
+		// Frames whose draws differ from the captured ones and frames whose checksum does.
+		std::uint64_t drawMismatches{};
+		std::uint64_t checksumMismatches{};
+		std::uint64_t firstMismatch{ NO_FRAME };
+
+		bool IsIdentical() const { return drawMismatches == 0 and checksumMismatches == 0; }
+	};
+
+	class replayer
+	{
+	public:
+		replayer() = delete;
+		replayer(core::jobsystem& jobs) : m_jobs(jobs) {};
+		replayer(const replayer& other) = delete;
+		~replayer() {};
+
+		replayer& operator=(const replayer& other) = delete;
+
+		// Run replays the capture from its start, it returns false when the capture turns out to be damaged.
+		bool Run(capturereader& capture, replayresult& result);
+
+		// The renderer keeps the counts and the checksum over all frames replayed so far.
+		const nullrenderer& GetRenderer() const;
+	private:
+		void PrepareFrameMemory(std::uint32_t entityCount);
+		// The instance the replay created for a captured one, the invalid entity for unknown instances.
+		core::entity Replayed(core::entity captured) const;
+
+		// Captured entities are looked up by their index, the generation tells stale references apart.
+		struct mappedinstance
+		{
+			core::entity captured{};
+			core::entity replayed{};
+		};
+
+		core::jobsystem& m_jobs;
+		nullrenderer m_renderer{};
+		std::unique_ptr<core::linearallocator> m_frameMemory{};
+		rendersnapshot m_snapshot{};
+		std::vector<mappedinstance> m_instances{};
+	};
+}
@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "resolutioncontroller.h"
+#include <algorithm>
+#include <cmath>
+
+namespace graphics
+{
+	resolutioncontroller::resolutioncontroller(const resolutionsettings& settings) :
+		m_settings(settings)
+	{
+		if (settings.targetSeconds <= 0.0f or settings.minScale <= 0.0f or settings.maxScale < settings.minScale
+			or settings.scaleStep <= 0.0f or settings.overBudget < 1.0f or settings.underBudget > 1.0f
+			or settings.smoothing <= 0.0f or settings.smoothing > 1.0f or settings.hitchRatio < 1.0f)
+		{
+			throw "Incorrect resolution settings.";
+		}
+
+		m_scale = Quantize(settings.maxScale);
+	}
+
+	// The time of a frame is taken to grow with the pixel count, the square of the scale.
+	// Part of it does not depend on the pixels at all, so the scale picked when lowering is a bit lower than needed
+	// and the time predicted for the next step a bit higher than it will be, both err on the side of staying fast.
+	bool resolutioncontroller::Update(FLOAT frameSeconds)
+	{
+		const FLOAT target = m_settings.targetSeconds;
+
+		m_stats.frames++;
+		if (frameSeconds > target)
+		{
+			m_stats.overBudgetFrames++;
+		}
+
+		if (m_stats.frames == 1)
+		{
+			m_average = frameSeconds;
+		}
+		else
+		{
+			FLOAT sample = (std::min)(frameSeconds, m_average * m_settings.hitchRatio);
+			m_average += m_settings.smoothing * (sample - m_average);
+		}
+		m_stats.averageSeconds = m_average;
+
+		if (m_settleFrames)
+		{
+			m_settleFrames--;
+			return false;
+		}
+
+		if (m_average > target * m_settings.overBudget)
+		{
+			m_underFrames = 0;
+			if (++m_overFrames < m_settings.lowerFrames or m_scale <= m_settings.minScale)
+			{
+				return false;
+			}
+
+			// Aim under the target by the same margin raising asks for, at least one step down.
+			FLOAT scale = Quantize(m_scale * std::sqrt(target * m_settings.underBudget / m_average));
+			scale = (std::max)((std::min)(scale, m_scale - m_settings.scaleStep), m_settings.minScale);
+			ChangeScale(scale);
+			m_stats.lowered++;
+			return true;
+		}
+
+		m_overFrames = 0;
+		if (m_scale >= m_settings.maxScale)
+		{
+			return false;
+		}
+
+		FLOAT next = (std::min)(m_scale + m_settings.scaleStep, m_settings.maxScale);
+		FLOAT growth = next / m_scale;
+		if (m_average * growth * growth >= target * m_settings.underBudget)
+		{
+			m_underFrames = 0;
+			return false;
+		}
+
+		if (++m_underFrames < m_settings.raiseFrames)
+		{
+			return false;
+		}
+
+		ChangeScale(next);
+		m_stats.raised++;
+		return true;
+	}
+
+	FLOAT resolutioncontroller::GetScale() const
+	{
+		return m_scale;
+	}
+
+	void resolutioncontroller::GetRenderSize(UINT width, UINT height, UINT& renderWidth, UINT& renderHeight) const
+	{
+		renderWidth = (std::max)(static_cast<UINT>(static_cast<FLOAT>(width) * m_scale + 0.5f), 1u);
+		renderHeight = (std::max)(static_cast<UINT>(static_cast<FLOAT>(height) * m_scale + 0.5f), 1u);
+	}
+
+	const resolutionstats& resolutioncontroller::GetStats() const
+	{
+		return m_stats;
+	}
+
+	// Rounded down to a multiple of the step, the small bias keeps exact multiples from falling to the one below.
+	FLOAT resolutioncontroller::Quantize(FLOAT scale) const
+	{
+		FLOAT steps = std::floor(scale / m_settings.scaleStep + 1e-3f);
+		return (std::min)((std::max)(steps * m_settings.scaleStep, m_settings.minScale), m_settings.maxScale);
+	}
+
+	void resolutioncontroller::ChangeScale(FLOAT scale)
+	{
+		FLOAT growth = scale / m_scale;
+		m_average *= growth * growth;
+		m_scale = scale;
+		m_overFrames = 0;
+		m_underFrames = 0;
+		m_settleFrames = m_settings.settleFrames;
+	}
+}
@@ -0,0 +1,83 @@
+// resolutioncontroller.h : include file for the dynamic resolution controller
+// The scene is drawn into a part of a render target as large as the window and stretched over the window,
+// the controller picks how large that part is from how long the frames take against a target.
+// It is fed one measured frame time per frame and keeps an exponential average of them, with hitches cut down:
+//  - the scale is lowered when the average stays over the target for a few frames in a row,
+//    straight to the scale whose pixel count would bring it back under the target,
+//  - it is raised by one step only after the average stayed low for a long while and
+//    the average grown by the pixels of the next step would still be under the target.
+// Lowering fast and raising slow with a gap between the two keeps it from going back and forth every frame.
+// After every change the average is scaled by the change of the pixel count and
+// a few frames are let through without a decision, the frames in flight were drawn at the old scale.
+// Scales are multiples of the step so the render size only changes in coarse steps.
+// It does not need a device, so it runs the same in the headless builds and the benchmarks.
+#pragma once
+
+#include <cstdint>
+#include "d3dxmath.h"
+
+namespace graphics
+{
+	struct resolutionsettings
+	{
+		FLOAT targetSeconds{ 1.0f / 60.0f };
+		FLOAT minScale{ 0.5f };
+		FLOAT maxScale{ 1.0f };
+		FLOAT scaleStep{ 0.05f };
+		// The average is over the target when above target * overBudget and under it when the next step would stay
+		// below target * underBudget.
+		FLOAT overBudget{ 1.05f };
+		FLOAT underBudget{ 0.9f };
+		// Frames in a row the average has to be over or under before the scale changes,
+		// and frames after a change before the next decision.
+		UINT lowerFrames{ 3 };
+		UINT raiseFrames{ 60 };
+		UINT settleFrames{ 4 };
+		// Weight of the newest frame in the average. A frame counts as at most hitchRatio times the average,
+		// so a single hitch does not look like a heavier load.
+		FLOAT smoothing{ 0.2f };
+		FLOAT hitchRatio{ 1.5f };
+	};
+
+	// How the controller did since it was created: frames fed, frames over the target,
+	// how often the scale went down and up and the current average.
+	struct resolutionstats
+	{
+		std::uint64_t frames;
+		std::uint64_t overBudgetFrames;
+		UINT lowered;
+		UINT raised;
+		FLOAT averageSeconds;
+	};
+
+	class resolutioncontroller
+	{
+	public:
+		resolutioncontroller() = delete;
+		resolutioncontroller(const resolutionsettings& settings);
+		resolutioncontroller(const resolutioncontroller& other) = delete;
+		~resolutioncontroller() {};
+
+		resolutioncontroller& operator=(const resolutioncontroller& other) = delete;
+
+		// Update takes the time the last frame took and returns true when the scale changed.
+		bool Update(FLOAT frameSeconds);
+
+		// GetScale is the fraction of the window's width and height to draw at,
+		// GetRenderSize the size in pixels it gives for a window, never smaller than one pixel.
+		FLOAT GetScale() const;
+		void GetRenderSize(UINT width, UINT height, UINT& renderWidth, UINT& renderHeight) const;
+		const resolutionstats& GetStats() const;
+	private:
+		FLOAT Quantize(FLOAT scale) const;
+		void ChangeScale(FLOAT scale);
+
+		resolutionsettings m_settings;
+		FLOAT m_scale{};
+		FLOAT m_average{};
+		UINT m_overFrames{};
+		UINT m_underFrames{};
+		UINT m_settleFrames{};
+		resolutionstats m_stats{};
+	};
+}
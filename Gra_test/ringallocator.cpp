@@ -0,0 +1,154 @@
+#include "stdafx.h"
+#include "ringallocator.h"
+
+namespace graphics
+{
+	ringallocator::ringallocator(std::uint32_t size) :
+		m_size(size)
+	{
+		if (size == 0)
+		{
+			throw "Incorrect ring allocator size.";
+		}
+
+		// Until the first frame begins there is no room at all.
+		m_limit.store(0, std::memory_order_release);
+	}
+
+	void ringallocator::RetireFrames(std::uint64_t completedFrame)
+	{
+		while (m_inflightCount > 0 and m_inflight[m_inflightFirst].frame <= completedFrame)
+		{
+			m_inflightFirst = (m_inflightFirst + 1) % MAX_TRACKED_FRAMES;
+			m_inflightCount--;
+		}
+
+		// The oldest frame still in flight marks where the writes have to stop.
+		if (m_inflightCount > 0)
+		{
+			m_tail = m_inflight[m_inflightFirst].start;
+		}
+		else
+		{
+			m_tail = m_head.load(std::memory_order_relaxed);
+		}
+	}
+
+	// A frame never straddles the end of the buffer, so when the space left before the end
+	// is smaller than the reserve the write position jumps to the start of the next lap.
+	// The skipped bytes are counted as part of the frame and are released together with it.
+	// The frame may then write up to the end of the lap, but never further than one full lap
+	// ahead of the oldest frame that is still in flight.
+	bool ringallocator::BeginFrame(std::uint64_t frame, std::uint64_t completedFrame, std::uint32_t reserve)
+	{
+		bool wrapped{};
+
+		RetireFrames(completedFrame);
+
+		std::uint64_t head = m_head.load(std::memory_order_relaxed);
+		m_frame = frame;
+		m_frameStart = head;
+		m_base = head - head % m_size;
+
+		if (head - m_base + reserve > m_size and head != m_base)
+		{
+			m_base += m_size;
+			head = m_base;
+			wrapped = true;
+		}
+
+		std::uint64_t limit = m_base + m_size;
+		if (m_tail + m_size < limit)
+		{
+			limit = m_tail + m_size;
+		}
+
+		// With no free slot to remember the frame in there is no way to tell when its data is done,
+		// so nothing can be written until a frame retires.
+		if (m_inflightCount == MAX_TRACKED_FRAMES)
+		{
+			limit = head;
+		}
+
+		m_failed.store(0, std::memory_order_relaxed);
+		m_requested.store(0, std::memory_order_relaxed);
+		m_head.store(head, std::memory_order_relaxed);
+		m_limit.store(limit, std::memory_order_release);
+
+		return wrapped;
+	}
+
+	// The allocation is a compare and swap loop on the write position.
+	// Every thread computes the aligned offset from the position it saw
+	// and only one of the racing threads can move the position past it.
+	std::uint32_t ringallocator::Allocate(std::uint32_t size, std::uint32_t alignment)
+	{
+		if (alignment == 0)
+		{
+			alignment = 1;
+		}
+
+		std::uint64_t limit = m_limit.load(std::memory_order_acquire);
+		std::uint64_t current = m_head.load(std::memory_order_relaxed);
+
+		for (;;)
+		{
+			std::uint64_t offset = current - m_base;
+			std::uint64_t aligned = (offset + alignment - 1) / alignment * alignment;
+			std::uint64_t end = m_base + aligned + size;
+
+			if (end > limit)
+			{
+				m_failed.fetch_add(1, std::memory_order_relaxed);
+				return NO_SPACE;
+			}
+
+			if (m_head.compare_exchange_weak(current, end, std::memory_order_relaxed))
+			{
+				m_requested.fetch_add(size, std::memory_order_relaxed);
+				return static_cast<std::uint32_t>(aligned);
+			}
+		}
+	}
+
+	void ringallocator::EndFrame()
+	{
+		std::uint64_t head = m_head.load(std::memory_order_acquire);
+
+		// Stop any late allocation from sneaking into the closed frame.
+		m_limit.store(0, std::memory_order_release);
+
+		if (m_inflightCount == MAX_TRACKED_FRAMES)
+		{
+			// Nothing was written, but the frame id still has to be remembered.
+			m_inflight[(m_inflightFirst + m_inflightCount - 1) % MAX_TRACKED_FRAMES].frame = m_frame;
+			return;
+		}
+
+		inflight& closed = m_inflight[(m_inflightFirst + m_inflightCount) % MAX_TRACKED_FRAMES];
+		closed.frame = m_frame;
+		closed.start = m_frameStart;
+		closed.end = head;
+		m_inflightCount++;
+	}
+
+	std::uint32_t ringallocator::GetFrameUsage() const
+	{
+		return static_cast<std::uint32_t>(m_head.load(std::memory_order_relaxed) - m_frameStart);
+	}
+
+	std::uint32_t ringallocator::GetFrameRequested() const
+	{
+		return m_requested.load(std::memory_order_relaxed);
+	}
+
+	std::uint32_t ringallocator::GetFailedAllocations() const
+	{
+		return m_failed.load(std::memory_order_relaxed);
+	}
+
+	std::uint32_t ringallocator::GetFramesInFlight() const
+	{
+		return m_inflightCount;
+	}
+}
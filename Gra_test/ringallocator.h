@@ -0,0 +1,84 @@
+// ringallocator.h : include file for the device independent per-frame ring allocator
+// The ringallocator hands out offsets into a fixed size buffer that is refilled every frame,
+// for example with debug lines, particles or user interface vertices.
+// Each frame appends after the previous one and the write position wraps to the start
+// once the end of the buffer is reached.
+// Frames are tagged with a frame counter and their space is only reused after the owner
+// reports them as completed, so data the GPU may still be reading is never overwritten.
+// Allocate is lock-free and may be called from many threads at once between BeginFrame and EndFrame.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace graphics
+{
+	class ringallocator
+	{
+	public:
+		static constexpr std::uint32_t NO_SPACE{ 0xffffffff };
+		static constexpr std::uint32_t MAX_TRACKED_FRAMES{ 16 };
+
+		ringallocator() = delete;
+		ringallocator(std::uint32_t size);
+		ringallocator(const ringallocator& other) = delete;
+		~ringallocator() {};
+
+		ringallocator& operator=(const ringallocator& other) = delete;
+
+		// BeginFrame releases the space of every frame up to and including completedFrame
+		// and prepares the range the new frame can append to.
+		// The reserve is the amount of space the frame is expected to need, when the part
+		// left before the end of the buffer is smaller than that the frame starts at offset 0 instead.
+		// The return value tells if the write position wrapped, which for a D3D buffer
+		// means the frame has to map with discard instead of no overwrite.
+		bool BeginFrame(std::uint64_t frame, std::uint64_t completedFrame, std::uint32_t reserve);
+
+		// Allocate returns the offset of size bytes aligned to the alignment
+		// or NO_SPACE when the frame ran out of room. The alignment does not need to be a power of two
+		// so the vertex stride can be used directly.
+		std::uint32_t Allocate(std::uint32_t size, std::uint32_t alignment = 16);
+
+		// EndFrame closes the frame, no thread may allocate between EndFrame and the next BeginFrame.
+		// Allocations still running when EndFrame is called are not covered by the frame, the owner has to wait
+		// for them first (graphics allocates on the render thread only); an Allocate that starts after it fails.
+		void EndFrame();
+
+		// Number of bytes used by the current (or last closed) frame, including the space skipped
+		// when it wrapped, the bytes its allocations asked for, without that space and the alignment padding,
+		// and number of allocations that failed in it.
+		std::uint32_t GetFrameUsage() const;
+		std::uint32_t GetFrameRequested() const;
+		std::uint32_t GetFailedAllocations() const;
+		std::uint32_t GetFramesInFlight() const;
+		std::uint32_t GetSize() const { return m_size; }
+	private:
+		// Positions are kept as 64 bit counters that only ever grow,
+		// the offset in the buffer is the position modulo the size.
+		// This way a full ring and an empty ring can never be confused.
+		struct inflight
+		{
+			std::uint64_t frame{};
+			std::uint64_t start{};
+			std::uint64_t end{};
+		};
+
+		void RetireFrames(std::uint64_t completedFrame);
+
+		std::uint32_t m_size{};
+		std::uint64_t m_frame{};
+		std::uint64_t m_frameStart{};
+		std::uint64_t m_base{};
+		// The limit is stored last with release by BeginFrame and EndFrame and loaded first with acquire by Allocate,
+		// so an allocating thread sees the base of the frame the limit belongs to.
+		std::atomic<std::uint64_t> m_limit{};
+		std::uint64_t m_tail{};
+		std::atomic<std::uint64_t> m_head{};
+		std::atomic<std::uint32_t> m_failed{};
+		std::atomic<std::uint32_t> m_requested{};
+
+		inflight m_inflight[MAX_TRACKED_FRAMES]{};
+		std::uint32_t m_inflightFirst{};
+		std::uint32_t m_inflightCount{};
+	};
+}
@@ -0,0 +1,565 @@
+#include "stdafx.h"
+#include "scene.h"
+#include "capture.h"
+#include "debugdraw.h"
+#include "profiler.h"
+#include "simdmath.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace graphics
+{
+	scene::scene(core::jobsystem& jobs) : m_jobs(jobs)
+	{
+		m_currentCamera.position = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+		m_currentCamera.rotation = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+		m_previousCamera = m_currentCamera;
+	}
+
+	core::entity scene::CreateInstance(const transform& placement, const meshinstance& mesh, core::entity parent)
+	{
+		transformhierarchy::node parentNode = GetNode(parent);
+		transformhierarchy::node node = m_hierarchy.Create(placement, parentNode);
+
+		if (node >= m_nodeEntities.size())
+		{
+			m_nodeEntities.resize(node + 1);
+			m_nodeProxies.resize(node + 1);
+		}
+		core::entity created = m_entities.Create(placement, worldtransform{}, mesh, hierarchynode{ node });
+		m_nodeEntities[node] = created;
+		m_nodeProxies[node] = broadphase::INVALID_PROXY;
+		BuildWorldTransforms(node);
+
+		// A replay creates the instance as a root and moves it under its parent, which ends up the same.
+		if (m_capture)
+		{
+			m_capture->CreateInstance(created, placement, mesh);
+			if (parentNode != transformhierarchy::INVALID_NODE)
+			{
+				m_capture->SetParent(created, parent);
+			}
+		}
+
+		return created;
+	}
+
+	void scene::DestroyInstance(core::entity instance)
+	{
+		transformhierarchy::node node = GetNode(instance);
+
+		if (node == transformhierarchy::INVALID_NODE)
+		{
+			m_entities.Destroy(instance);
+		}
+		else
+		{
+			m_subtree.clear();
+			m_hierarchy.GetSubtree(node, m_subtree);
+			for (transformhierarchy::node destroyed : m_subtree)
+			{
+				m_entities.Destroy(m_nodeEntities[destroyed]);
+				if (m_nodeProxies[destroyed] != broadphase::INVALID_PROXY)
+				{
+					m_broadphase.Remove(m_nodeProxies[destroyed]);
+				}
+			}
+			m_hierarchy.Destroy(node);
+		}
+
+		if (m_capture)
+		{
+			m_capture->DestroyInstance(instance);
+		}
+	}
+
+	void scene::SetPlacement(core::entity instance, const transform& placement)
+	{
+		transformhierarchy::node node = GetNode(instance);
+		if (node == transformhierarchy::INVALID_NODE)
+		{
+			return;
+		}
+
+		*m_entities.Get<transform>(instance) = placement;
+		m_hierarchy.SetLocal(node, placement);
+
+		if (m_capture)
+		{
+			m_capture->SetPlacement(instance, placement);
+		}
+	}
+
+	bool scene::SetParent(core::entity instance, core::entity parent)
+	{
+		transformhierarchy::node node = GetNode(instance);
+		transformhierarchy::node parentNode = GetNode(parent);
+
+		if (node == transformhierarchy::INVALID_NODE or (parent.IsValid() and parentNode == transformhierarchy::INVALID_NODE)
+			or !m_hierarchy.SetParent(node, parentNode))
+		{
+			return false;
+		}
+		BuildWorldTransforms(node);
+
+		if (m_capture)
+		{
+			m_capture->SetParent(instance, parent);
+		}
+
+		return true;
+	}
+
+	void scene::RelocateMesh(const meshinstance& from, const meshinstance& to)
+	{
+		m_entities.ForEachChunk<meshinstance>([&](std::uint32_t count, const core::entity *, meshinstance *meshes)
+		{
+			for (std::uint32_t i = 0; i < count; i++)
+			{
+				if (meshes[i].page == from.page and meshes[i].startIndex == from.startIndex and meshes[i].baseVertex == from.baseVertex)
+				{
+					meshes[i].page = to.page;
+					meshes[i].startIndex = to.startIndex;
+					meshes[i].baseVertex = to.baseVertex;
+				}
+			}
+		});
+
+		if (m_capture)
+		{
+			m_capture->RelocateMesh(from, to);
+		}
+	}
+
+	// Both states are set so the camera does not glide in from where it was before.
+	void scene::SetCamera(const D3DXVECTOR3& position, const D3DXVECTOR3& rotation)
+	{
+		camerastate placed{ position, rotation };
+
+		RestoreCamera(placed, placed);
+	}
+
+	void scene::RestoreCamera(const camerastate& previous, const camerastate& current)
+	{
+		m_previousCamera = previous;
+		m_currentCamera = current;
+
+		if (m_capture)
+		{
+			m_capture->Camera(m_previousCamera, m_currentCamera);
+		}
+	}
+
+	void scene::GetCamera(camerastate& previous, camerastate& current) const
+	{
+		previous = m_previousCamera;
+		current = m_currentCamera;
+	}
+
+	// The state of the previous step is kept before anything moves so BuildSnapshot can blend the two.
+	void scene::Update(FLOAT stepSeconds)
+	{
+		if (m_capture)
+		{
+			m_capture->Update(stepSeconds);
+		}
+
+		m_previousCamera = m_currentCamera;
+
+		// Entities created or destroyed while the systems ran last step join or leave the scene now.
+		m_entities.ApplyDeferred();
+		UpdateTransforms();
+		m_broadphase.Update(m_jobs);
+	}
+
+	// The camera is placed between its previous and current simulation state using alpha
+	// so the motion stays smooth when more frames are rendered than simulation steps are run.
+	// After that it calls the Render function for the camera object to create
+	// a view matrix based on the camera's location and stores a copy of it in the snapshot
+	// together with the world matrix and the draw of every visible entity.
+	void scene::BuildSnapshot(FLOAT alpha, const D3DXMATRIX& projectionMatrix, rendersnapshot& snapshot)
+	{
+		D3DXVECTOR3 position, rotation;
+
+		snapshot.frame = m_frame++;
+
+		{
+			PROFILE_SCOPE("Camera");
+
+			// Interpolate the camera between the last two simulation steps.
+			position = m_previousCamera.position + (m_currentCamera.position - m_previousCamera.position) * alpha;
+			rotation = m_previousCamera.rotation + (m_currentCamera.rotation - m_previousCamera.rotation) * alpha;
+			m_camera.SetPosition(position.x, position.y, position.z);
+			m_camera.SetRotation(rotation.x, rotation.y, rotation.z);
+
+			// Generate the view matrix based on the camera's position.
+			m_camera.Render();
+			m_camera.GetViewMatrix(snapshot.view);
+			snapshot.cameraPosition = position;
+		}
+
+		// Record every visible entity with its world matrix and its location in the mesh heap.
+		BuildDrawList(snapshot.view * projectionMatrix, snapshot);
+
+		// While debug lines are drawn the top two levels below the root of every pick mesh's BVH are shown.
+		if (debugdraw::IsEnabled())
+		{
+			m_entities.ForEachChunk<worldtransform, pickmesh>(
+				[&](std::uint32_t count, const core::entity *, worldtransform *worlds, pickmesh *picks)
+			{
+				for (std::uint32_t i = 0; i < count; i++)
+				{
+					if (picks[i].bvh)
+					{
+						picks[i].bvh->DebugDraw(worlds[i].world, 2, D3DXVECTOR4(1.0f, 0.5f, 0.0f, 1.0f));
+					}
+				}
+			});
+
+			core::entity selected = GetSelected();
+			const pickmesh *pick = selected.IsValid() ? m_entities.Get<pickmesh>(selected) : nullptr;
+			if (pick and pick->bvh)
+			{
+				D3DXVECTOR3 min, max;
+				pick->bvh->GetBounds(min, max);
+				debugdraw::Box(m_entities.Get<worldtransform>(selected)->world, min, max, D3DXVECTOR4(1.0f, 1.0f, 1.0f, 1.0f));
+			}
+		}
+
+		if (m_capture)
+		{
+			m_capture->Frame(alpha, projectionMatrix, snapshot);
+		}
+	}
+
+	core::entitystore& scene::GetEntities()
+	{
+		return m_entities;
+	}
+
+	const transformhierarchy& scene::GetHierarchy() const
+	{
+		return m_hierarchy;
+	}
+
+	void scene::SetCollider(core::entity instance, bool collides)
+	{
+		transformhierarchy::node node = GetNode(instance);
+		if (node == transformhierarchy::INVALID_NODE or (m_nodeProxies[node] != broadphase::INVALID_PROXY) == collides)
+		{
+			return;
+		}
+
+		if (!collides)
+		{
+			m_broadphase.Remove(m_nodeProxies[node]);
+			m_nodeProxies[node] = broadphase::INVALID_PROXY;
+			return;
+		}
+
+		broadphase::proxy proxy = m_broadphase.Add(GetColliderBounds(node));
+		if (proxy >= m_proxyEntities.size())
+		{
+			m_proxyEntities.resize(proxy + 1);
+		}
+		m_nodeProxies[node] = proxy;
+		m_proxyEntities[proxy] = instance;
+	}
+
+	const broadphase& scene::GetBroadphase() const
+	{
+		return m_broadphase;
+	}
+
+	core::entity scene::GetProxyEntity(broadphase::proxy target) const
+	{
+		return m_proxyEntities[target];
+	}
+
+	void scene::SetPickMesh(core::entity instance, const meshbvh *bvh)
+	{
+		if (!bvh)
+		{
+			m_entities.Remove<pickmesh>(instance);
+			return;
+		}
+		m_entities.Add(instance, pickmesh{ bvh });
+	}
+
+	// The camera used for the ray is a separate one, the camera of the scene belongs to the snapshots.
+	ray scene::GetScreenRay(FLOAT x, FLOAT y, FLOAT width, FLOAT height, const D3DXMATRIX& projectionMatrix)
+	{
+		camera viewer;
+		D3DXMATRIX view;
+
+		viewer.SetPosition(m_currentCamera.position.x, m_currentCamera.position.y, m_currentCamera.position.z);
+		viewer.SetRotation(m_currentCamera.rotation.x, m_currentCamera.rotation.y, m_currentCamera.rotation.z);
+		viewer.Render();
+		viewer.GetViewMatrix(view);
+		return ScreenRay(x, y, width, height, view, projectionMatrix);
+	}
+
+	// Instances whose bounding sphere the ray misses, or only enters past the closest hit so far, are skipped.
+	// The others get the ray in the space of their mesh: the world matrices are a uniform scale s, a rotation
+	// and a translation, so the inverse of the upper rows is their transpose over s squared. The direction is
+	// transformed the same way without normalizing it, which keeps the distances along it those of the world.
+	core::entity scene::Pick(const ray& cast, FLOAT& distance)
+	{
+		PROFILE_SCOPE("scene::Pick");
+		core::entity picked{};
+		FLOAT closest = FLT_MAX;
+		FLOAT lengthSq = D3DXVec3LengthSq(&cast.direction);
+
+		if (lengthSq <= 0.0f)
+		{
+			return picked;
+		}
+
+		m_entities.ForEachChunk<worldtransform, meshinstance, pickmesh>(
+			[&](std::uint32_t count, const core::entity *entities, worldtransform *worlds, meshinstance *meshes, pickmesh *picks)
+		{
+			for (std::uint32_t i = 0; i < count; i++)
+			{
+				const D3DXMATRIX& world = worlds[i].world;
+				D3DXVECTOR3 translation(world._41, world._42, world._43);
+				D3DXVECTOR3 toCenter = translation - cast.origin;
+				FLOAT radius = meshes[i].boundingRadius * worlds[i].scale;
+				FLOAT along = D3DXVec3Dot(&toCenter, &cast.direction) / lengthSq;
+				FLOAT missSq = D3DXVec3LengthSq(&toCenter) - along * along * lengthSq;
+				if (!picks[i].bvh or missSq > radius * radius or worlds[i].scale <= 0.0f)
+				{
+					continue;
+				}
+				FLOAT halfChord = std::sqrt((radius * radius - missSq) / lengthSq);
+				if (along + halfChord < 0.0f or along - halfChord > closest)
+				{
+					continue;
+				}
+
+				FLOAT inverseScaleSq = 1.0f / (worlds[i].scale * worlds[i].scale);
+				D3DXVECTOR3 offset = cast.origin - translation;
+				D3DXVECTOR3 rows[3] = { D3DXVECTOR3(world._11, world._12, world._13),
+					D3DXVECTOR3(world._21, world._22, world._23), D3DXVECTOR3(world._31, world._32, world._33) };
+				ray local;
+				local.origin = D3DXVECTOR3(D3DXVec3Dot(&offset, &rows[0]), D3DXVec3Dot(&offset, &rows[1]), D3DXVec3Dot(&offset, &rows[2])) * inverseScaleSq;
+				local.direction = D3DXVECTOR3(D3DXVec3Dot(&cast.direction, &rows[0]), D3DXVec3Dot(&cast.direction, &rows[1]), D3DXVec3Dot(&cast.direction, &rows[2])) * inverseScaleSq;
+
+				rayhit hit;
+				if (picks[i].bvh->Intersect(local, closest, hit))
+				{
+					closest = hit.distance;
+					picked = entities[i];
+				}
+			}
+		});
+
+		distance = closest;
+		return picked;
+	}
+
+	void scene::Select(core::entity instance)
+	{
+		m_selected = instance;
+	}
+
+	core::entity scene::GetSelected() const
+	{
+		return m_entities.IsAlive(m_selected) ? m_selected : core::entity{};
+	}
+
+	// The instances are written in the order of their rows, a replay creating them in that order
+	// ends up with the same rows and draws them in the same order. They are created as roots,
+	// the parents follow sorted by depth so every instance is moved under a parent that is already in place.
+	void scene::SetCapture(capturewriter *writer)
+	{
+		struct parented
+		{
+			UINT depth;
+			core::entity instance;
+			core::entity parent;
+		};
+		std::vector<parented> children;
+
+		m_capture = writer;
+		if (!m_capture)
+		{
+			return;
+		}
+
+		m_capture->Camera(m_previousCamera, m_currentCamera);
+		m_entities.ForEachChunk<transform, meshinstance, hierarchynode>(
+			[&](std::uint32_t count, const core::entity *entities, transform *transforms, meshinstance *meshes, hierarchynode *nodes)
+		{
+			for (std::uint32_t i = 0; i < count; i++)
+			{
+				m_capture->CreateInstance(entities[i], transforms[i], meshes[i]);
+
+				transformhierarchy::node parent = m_hierarchy.GetParent(nodes[i].node);
+				if (parent != transformhierarchy::INVALID_NODE)
+				{
+					UINT depth = 0;
+					for (transformhierarchy::node ancestor = parent; ancestor != transformhierarchy::INVALID_NODE; ancestor = m_hierarchy.GetParent(ancestor))
+					{
+						depth++;
+					}
+					children.push_back(parented{ depth, entities[i], m_nodeEntities[parent] });
+				}
+			}
+		});
+
+		std::stable_sort(children.begin(), children.end(), [](const parented& a, const parented& b) { return a.depth < b.depth; });
+		for (const parented& child : children)
+		{
+			m_capture->SetParent(child.instance, child.parent);
+		}
+	}
+
+	// Only the nodes the hierarchy computed are copied, the entities that did not move keep their world matrices.
+	void scene::UpdateTransforms()
+	{
+		PROFILE_SCOPE("scene::UpdateTransforms");
+
+		m_hierarchy.Update(m_jobs);
+
+		const std::vector<transformhierarchy::noderange>& ranges = m_hierarchy.GetUpdatedRanges();
+		m_jobs.ParallelFor(static_cast<std::uint32_t>(ranges.size()), 16, [this, &ranges](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t i = begin; i < end; i++)
+			{
+				for (UINT slot = ranges[i].begin; slot < ranges[i].end; slot++)
+				{
+					transformhierarchy::node node = m_hierarchy.GetSlotNode(slot);
+					CopyWorldTransform(node, m_hierarchy.GetWorld(node));
+				}
+			}
+		});
+	}
+
+	// Used where the world matrices are needed before the next Update. The parents come before
+	// their children in the subtree, so every parent's world matrix is done when a child needs it.
+	void scene::BuildWorldTransforms(transformhierarchy::node root)
+	{
+		m_subtree.clear();
+		m_hierarchy.GetSubtree(root, m_subtree);
+
+		for (transformhierarchy::node node : m_subtree)
+		{
+			D3DXMATRIX local, world;
+			transformhierarchy::node parent = m_hierarchy.GetParent(node);
+
+			transformhierarchy::BuildMatrix(m_hierarchy.GetLocal(node), local);
+			if (parent == transformhierarchy::INVALID_NODE)
+			{
+				world = local;
+			}
+			else
+			{
+				core::MultiplyMatrix(world, local, m_entities.Get<worldtransform>(m_nodeEntities[parent])->world);
+			}
+			CopyWorldTransform(node, world);
+		}
+	}
+
+	void scene::CopyWorldTransform(transformhierarchy::node source, const D3DXMATRIX& world)
+	{
+		worldtransform& target = *m_entities.Get<worldtransform>(m_nodeEntities[source]);
+		D3DXVECTOR3 axes[3] = { D3DXVECTOR3(world._11, world._12, world._13),
+			D3DXVECTOR3(world._21, world._22, world._23), D3DXVECTOR3(world._31, world._32, world._33) };
+
+		target.world = world;
+		target.scale = std::sqrt((std::max)((std::max)(D3DXVec3LengthSq(&axes[0]), D3DXVec3LengthSq(&axes[1])), D3DXVec3LengthSq(&axes[2])));
+
+		// Called by many jobs at once, each for other nodes, which is what SetBounds allows.
+		if (m_nodeProxies[source] != broadphase::INVALID_PROXY)
+		{
+			m_broadphase.SetBounds(m_nodeProxies[source], GetColliderBounds(source));
+		}
+	}
+
+	aabb scene::GetColliderBounds(transformhierarchy::node source)
+	{
+		core::entity instance = m_nodeEntities[source];
+		const worldtransform& world = *m_entities.Get<worldtransform>(instance);
+		FLOAT radius = m_entities.Get<meshinstance>(instance)->boundingRadius * world.scale;
+		D3DXVECTOR3 center(world.world._41, world.world._42, world.world._43), extent(radius, radius, radius);
+
+		return aabb{ center - extent, center + extent };
+	}
+
+	transformhierarchy::node scene::GetNode(core::entity instance)
+	{
+		hierarchynode *node = instance.IsValid() ? m_entities.Get<hierarchynode>(instance) : nullptr;
+		return node ? node->node : transformhierarchy::INVALID_NODE;
+	}
+
+	// The six frustum planes are taken from the combined view and projection matrix
+	// (left, right, bottom, top from the sums and differences of its columns with the fourth,
+	// near is the third column alone since depth starts at 0 in Direct3D).
+	// A sphere is culled when its center lies further than its radius behind any plane.
+	// While debug lines are drawn the boxes around the spheres that were not culled are shown.
+	void scene::BuildDrawList(const D3DXMATRIX& viewProjection, rendersnapshot& snapshot)
+	{
+		D3DXPLANE planes[6];
+		const D3DXMATRIX& m = viewProjection;
+		bool drawBounds = debugdraw::IsEnabled();
+		PROFILE_SCOPE("scene::BuildDrawList");
+
+		planes[0] = D3DXPLANE(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);
+		planes[1] = D3DXPLANE(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);
+		planes[2] = D3DXPLANE(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);
+		planes[3] = D3DXPLANE(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);
+		planes[4] = D3DXPLANE(m._13, m._23, m._33, m._43);
+		planes[5] = D3DXPLANE(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43);
+		for (D3DXPLANE& plane : planes)
+		{
+			D3DXPlaneNormalize(&plane, &plane);
+		}
+
+		m_entities.ForEachChunk<worldtransform, meshinstance>(
+			[&](std::uint32_t count, const core::entity *, worldtransform *worlds, meshinstance *meshes)
+		{
+			for (std::uint32_t i = 0; i < count; i++)
+			{
+				D3DXVECTOR3 center(worlds[i].world._41, worlds[i].world._42, worlds[i].world._43);
+				FLOAT radius = meshes[i].boundingRadius * worlds[i].scale;
+				bool visible = true;
+
+				for (const D3DXPLANE& plane : planes)
+				{
+					if (D3DXPlaneDotCoord(&plane, &center) < -radius)
+					{
+						visible = false;
+						break;
+					}
+				}
+
+				if (!visible)
+				{
+					continue;
+				}
+				// The lists were sized by rendersnapshot::Fit, what is past them is dropped.
+				if (snapshot.draws.size() == snapshot.draws.capacity() or snapshot.transforms.size() == snapshot.transforms.capacity())
+				{
+					snapshot.dropped++;
+					continue;
+				}
+				if (drawBounds)
+				{
+					D3DXVECTOR3 extent(radius, radius, radius);
+					debugdraw::Box(center - extent, center + extent, D3DXVECTOR4(0.0f, 1.0f, 0.0f, 1.0f));
+				}
+
+				snapshot.transforms.push_back(worlds[i].world);
+
+				drawitem draw;
+				draw.page = meshes[i].page;
+				draw.indexCount = meshes[i].indexCount;
+				draw.startIndex = meshes[i].startIndex;
+				draw.baseVertex = meshes[i].baseVertex;
+				draw.transform = static_cast<UINT>(snapshot.transforms.size() - 1);
+				snapshot.draws.push_back(draw);
+			}
+		});
+	}
+}
@@ -0,0 +1,124 @@
+// scene.h : include file for the simulated scene
+// The scene is everything the simulation steps: the entities with their components, the transform hierarchy
+// that places them relative to each other, the broadphase that finds the colliders whose bounds overlap, and the camera.
+// Instances with a pick mesh can be picked with rays, usually the one through the mouse cursor.
+// It never touches the device. Graphics hands it the projection and a snapshot to fill
+// for every frame, headless builds drive it the same way without a window.
+#pragma once
+
+#include "jobsystem.h"
+#include "broadphase.h"
+#include "entitystore.h"
+#include "camera.h"
+#include "meshbvh.h"
+#include "rendersnapshot.h"
+#include "scenecomponents.h"
+#include "transformhierarchy.h"
+#include <vector>
+
+namespace graphics
+{
+	class capturewriter;
+
+	class scene
+	{
+	public:
+		// The camera state at the end of a simulation step.
+		// Two of them are kept so that frames rendered between steps can be interpolated.
+		struct camerastate
+		{
+			D3DXVECTOR3 position;
+			D3DXVECTOR3 rotation;
+		};
+
+		scene() = delete;
+		scene(core::jobsystem& jobs);
+		scene(const scene& other) = delete;
+		~scene() {};
+
+		scene& operator=(const scene& other) = delete;
+
+		// CreateInstance places a mesh in the world, relative to the parent instance if one is given.
+		// Its world matrix is built right away. DestroyInstance destroys the instances below it as well.
+		core::entity CreateInstance(const transform& placement, const meshinstance& mesh, core::entity parent = core::entity{});
+		void DestroyInstance(core::entity instance);
+
+		// SetPlacement moves an instance, it and everything below it get their world matrices in the next Update.
+		// SetParent moves an instance with its subtree under another parent, or to the root with an invalid entity,
+		// their world matrices are built right away. It fails when the parent is the instance itself or below it.
+		void SetPlacement(core::entity instance, const transform& placement);
+		bool SetParent(core::entity instance, core::entity parent);
+
+		// RelocateMesh points the instances drawn from the range at from to the range at to,
+		// for a mesh the mesh heap moved, see meshheap::Defragment. Only page, startIndex and baseVertex are used.
+		void RelocateMesh(const meshinstance& from, const meshinstance& to);
+
+		// SetCamera places the camera for the current simulation step, the rotation is in degrees.
+		// RestoreCamera sets both kept states at once, it is how a replay picks up a captured camera.
+		void SetCamera(const D3DXVECTOR3& position, const D3DXVECTOR3& rotation);
+		void RestoreCamera(const camerastate& previous, const camerastate& current);
+		void GetCamera(camerastate& previous, camerastate& current) const;
+
+		// Update advances the scene by one fixed simulation step.
+		// BuildSnapshot captures the scene blended between the previous and the current step by alpha.
+		// The snapshot has to be reset into its frame arena before.
+		void Update(FLOAT stepSeconds);
+		void BuildSnapshot(FLOAT alpha, const D3DXMATRIX& projectionMatrix, rendersnapshot& snapshot);
+
+		core::entitystore& GetEntities();
+
+		// While a capture writer is set every change made through the functions above,
+		// every step and every snapshot is written to it. Setting it first writes the camera
+		// and all instances, so a capture can start at any point of a session.
+		// Changes made to the entity store directly are not captured.
+		void SetCapture(capturewriter *writer);
+
+		const transformhierarchy& GetHierarchy() const;
+
+		// A collider has a box around its bounding sphere in the broadphase, the pairs are those of the last Update.
+		// Instances are not colliders until they are made one. Colliders are not captured, nothing a replay
+		// shows depends on the pairs.
+		void SetCollider(core::entity instance, bool collides);
+		const broadphase& GetBroadphase() const;
+		core::entity GetProxyEntity(broadphase::proxy target) const;
+
+		// SetPickMesh makes an instance pickable by the triangles of the BVH of its mesh, null makes it unpickable.
+		// Pick meshes are not captured, a replay never picks.
+		// GetScreenRay is the ray through a point on the screen from the camera of the current step,
+		// Pick finds the closest pickable instance the ray hits and the distance along it in multiples of its direction.
+		// It returns an invalid entity when the ray hits nothing.
+		void SetPickMesh(core::entity instance, const meshbvh *bvh);
+		ray GetScreenRay(FLOAT x, FLOAT y, FLOAT width, FLOAT height, const D3DXMATRIX& projectionMatrix);
+		core::entity Pick(const ray& cast, FLOAT& distance);
+
+		// Select marks an instance, usually the one picked last, an invalid entity clears the mark.
+		// While debug lines are drawn the box around the pick mesh of the selected instance is shown.
+		// GetSelected returns an invalid entity once the selected instance was destroyed.
+		void Select(core::entity instance);
+		core::entity GetSelected() const;
+	private:
+		// The scene systems, they run over the entity store with linear memory access.
+		// UpdateTransforms updates the hierarchy and copies the world matrices it computed to the entities.
+		// BuildDrawList culls the bounding spheres against the view frustum and records the draws that are left.
+		void UpdateTransforms();
+		void BuildDrawList(const D3DXMATRIX& viewProjection, rendersnapshot& snapshot);
+		void BuildWorldTransforms(transformhierarchy::node root);
+		void CopyWorldTransform(transformhierarchy::node source, const D3DXMATRIX& world);
+		aabb GetColliderBounds(transformhierarchy::node source);
+		transformhierarchy::node GetNode(core::entity instance);
+
+		core::jobsystem& m_jobs;
+		core::entitystore m_entities{};
+		transformhierarchy m_hierarchy{};
+		std::vector<core::entity> m_nodeEntities{};
+		std::vector<transformhierarchy::node> m_subtree{};
+		broadphase m_broadphase{};
+		std::vector<broadphase::proxy> m_nodeProxies{};
+		std::vector<core::entity> m_proxyEntities{};
+		camera m_camera{};
+		camerastate m_previousCamera{}, m_currentCamera{};
+		core::entity m_selected{};
+		UINT64 m_frame{};
+		capturewriter *m_capture{};
+	};
+}
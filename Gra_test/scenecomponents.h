@@ -0,0 +1,51 @@
+// scenecomponents.h : include file for the components that make up the rendered scene
+// Scene objects are entities in the entity store with these components
+// instead of objects of their own, the systems of the scene run over them chunk by chunk.
+#pragma once
+
+#include "d3dxmath.h"
+
+namespace graphics
+{
+	class meshbvh;
+
+	// Placement of the entity as it is edited, relative to its parent, rotation in degrees like the camera.
+	struct transform
+	{
+		D3DXVECTOR3 position;
+		D3DXVECTOR3 rotation;
+		FLOAT scale;
+	};
+
+	// World matrix of the entity, copied from the transform hierarchy whenever the entity
+	// or one of its parents moved. The scale is the largest one along any axis, it grows the bounding sphere.
+	struct worldtransform
+	{
+		D3DXMATRIX world;
+		FLOAT scale;
+	};
+
+	// The node of the entity in the scene's transform hierarchy.
+	struct hierarchynode
+	{
+		UINT node;
+	};
+
+	// What to draw: the location of the mesh in the mesh heap and the radius
+	// of the sphere around its origin that contains it, used for culling.
+	struct meshinstance
+	{
+		UINT page;
+		UINT indexCount;
+		UINT startIndex;
+		UINT baseVertex;
+		FLOAT boundingRadius;
+	};
+
+	// The triangles a ray is tested against when the entity is picked, in the space of its mesh.
+	// The BVH belongs to the mesh asset, it is shared by all its instances and has to outlive them.
+	struct pickmesh
+	{
+		const meshbvh *bvh;
+	};
+}
@@ -0,0 +1,69 @@
+// shaderparameters.h : include file for the constant buffer layouts shared with the HLSL shaders
+// The layouts and the packing into them do not need a device, so the shaders
+// and the headless builds (the null renderer, the benchmarks) use the same code.
+#pragma once
+
+#include "d3dxmath.h"
+
+namespace graphics
+{
+	// This struct must be exactly the same as the cbuffer MatrixBuffer in the vertex shader.
+	struct matrixbuffer
+	{
+		D3DXMATRIX world;
+		D3DXMATRIX view;
+		D3DXMATRIX projection;
+	};
+
+	// A light of the clustered pixel shader in view space, this struct must be exactly the same as Light in clustered.ps.
+	// The spot factor is the cosine of the angle to the direction minus spotCosine times spotScale, clamped to [0, 1].
+	// Point lights have a spotCosine of -2 and a spotScale of 1, which is 1 in every direction.
+	struct gpulight
+	{
+		D3DXVECTOR3 position;
+		FLOAT range;
+		D3DXVECTOR3 color;
+		FLOAT spotCosine;
+		D3DXVECTOR3 direction;
+		FLOAT spotScale;
+	};
+
+	// The lights of a cluster are the count indices of the light index list from offset on.
+	struct clusterrange
+	{
+		UINT offset;
+		UINT count;
+	};
+
+	// This struct must be exactly the same as the cbuffer ClusterBuffer in the clustered pixel shader.
+	// The tile scale turns pixels into cluster columns and rows, the depth scale and bias turn the logarithm
+	// of the view depth into a slice, see lightclusters.h.
+	struct clusterbuffer
+	{
+		FLOAT tileScale[2];
+		FLOAT depthScale;
+		FLOAT depthBias;
+		D3DXVECTOR3 ambient;
+		FLOAT padding;
+	};
+
+	// This struct must be exactly the same as the cbuffer UpscaleBuffer in the upscale pixel shader.
+	// The region is the part of the scene texture the scene was drawn into, the limit the farthest texture coordinate
+	// the filter can sample at without reaching past it, both in texture coordinates.
+	struct upscalebuffer
+	{
+		FLOAT region[2];
+		FLOAT limit[2];
+	};
+
+	// The shaders expect column major matrices, D3DX builds row major ones,
+	// so every matrix is transposed on its way into the buffer.
+	// The destination is usually mapped GPU memory, it is only written, never read.
+	inline void PackMatrixBuffer(matrixbuffer& destination, const D3DXMATRIX& worldMatrix,
+		const D3DXMATRIX& viewMatrix, const D3DXMATRIX& projectionMatrix)
+	{
+		D3DXMatrixTranspose(&destination.world, &worldMatrix);
+		D3DXMatrixTranspose(&destination.view, &viewMatrix);
+		D3DXMatrixTranspose(&destination.projection, &projectionMatrix);
+	}
+}
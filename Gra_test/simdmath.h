@@ -0,0 +1,153 @@
+// simdmath.h : include file for the SIMD versions of the hot math functions
+// SSE is used wherever the compiler targets it (every x64 build, x86 with /arch:SSE2 or higher),
+// other targets get plain loops. Both give the same results as the D3DX functions up to rounding.
+// float4 is four floats in one register, the functions on it are thin wrappers over the intrinsics
+// so code written against them builds on every target. Loads and stores are unaligned.
+// floatv is the widest register the build targets: eight floats when the compiler generates AVX
+// (/arch:AVX2, -mavx2, see ENGINE_AVX2 in CMakeLists.txt), float4 otherwise. Streams of floats are
+// processed FLOATV_WIDTH at a time with it, FMA is used when the target has it.
+#pragma once
+
+#include <cstdint>
+#include "d3dxmath.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CORE_SIMD_SSE 1
+#include <emmintrin.h>
+#else
+#define CORE_SIMD_SSE 0
+#include <cmath>
+#endif
+
+#if defined(__AVX__)
+#define CORE_SIMD_AVX 1
+#include <immintrin.h>
+#else
+#define CORE_SIMD_AVX 0
+#endif
+
+namespace core
+{
+#if CORE_SIMD_SSE
+	typedef __m128 float4;
+
+	inline float4 Load4(const FLOAT *source) { return _mm_loadu_ps(source); }
+	inline void Store4(FLOAT *destination, float4 value) { _mm_storeu_ps(destination, value); }
+	inline float4 Splat4(FLOAT value) { return _mm_set1_ps(value); }
+	inline float4 Add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+	inline float4 Sub4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+	inline float4 Mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+	inline float4 Div4(float4 a, float4 b) { return _mm_div_ps(a, b); }
+	inline float4 Min4(float4 a, float4 b) { return _mm_min_ps(a, b); }
+	inline float4 Max4(float4 a, float4 b) { return _mm_max_ps(a, b); }
+	// Bit i is set when component i of a is less than that of b.
+	inline int LessMask4(float4 a, float4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+	// a * b + c
+	inline float4 MulAdd4(float4 a, float4 b, float4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+	// The dot product of all four components in every component.
+	inline float4 Dot4(float4 a, float4 b)
+	{
+		float4 products = _mm_mul_ps(a, b);
+		float4 pairs = _mm_add_ps(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_add_ps(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 0, 3, 2)));
+	}
+
+	inline float4 Normalize4(float4 value) { return _mm_div_ps(value, _mm_sqrt_ps(Dot4(value, value))); }
+
+	// value with its sign flipped wherever sign is negative.
+	inline float4 FlipSign4(float4 value, float4 sign)
+	{
+		return _mm_xor_ps(value, _mm_and_ps(sign, _mm_set1_ps(-0.0f)));
+	}
+
+	// Four unsigned 16 bit integers converted to floats.
+	inline float4 LoadUnsigned16x4(const std::uint16_t *source)
+	{
+		__m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source));
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, _mm_setzero_si128()));
+	}
+#else
+	struct float4
+	{
+		FLOAT v[4];
+	};
+
+	inline float4 Load4(const FLOAT *source) { return float4{ { source[0], source[1], source[2], source[3] } }; }
+	inline void Store4(FLOAT *destination, float4 value) { for (int i = 0; i < 4; i++) destination[i] = value.v[i]; }
+	inline float4 Splat4(FLOAT value) { return float4{ { value, value, value, value } }; }
+	inline float4 Add4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+	inline float4 Sub4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+	inline float4 Mul4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+	inline float4 Div4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+	inline float4 MulAdd4(float4 a, float4 b, float4 c) { return Add4(Mul4(a, b), c); }
+	inline float4 Min4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]; return a; }
+	inline float4 Max4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? b.v[i] : a.v[i]; return a; }
+	inline int LessMask4(float4 a, float4 b) { int mask = 0; for (int i = 0; i < 4; i++) mask |= (a.v[i] < b.v[i]) << i; return mask; }
+	inline float4 Dot4(float4 a, float4 b) { return Splat4(a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] + a.v[3] * b.v[3]); }
+	inline float4 Normalize4(float4 value) { return Mul4(value, Splat4(1.0f / std::sqrt(Dot4(value, value).v[0]))); }
+	inline float4 FlipSign4(float4 value, float4 sign) { for (int i = 0; i < 4; i++) value.v[i] = std::signbit(sign.v[i]) ? -value.v[i] : value.v[i]; return value; }
+	inline float4 LoadUnsigned16x4(const std::uint16_t *source) { return float4{ { static_cast<FLOAT>(source[0]), static_cast<FLOAT>(source[1]), static_cast<FLOAT>(source[2]), static_cast<FLOAT>(source[3]) } }; }
+#endif
+
+	// a + (b - a) * t
+	inline float4 Lerp4(float4 a, float4 b, float4 t) { return MulAdd4(Sub4(b, a), t, a); }
+
+#if CORE_SIMD_AVX
+	typedef __m256 floatv;
+	constexpr std::uint32_t FLOATV_WIDTH{ 8 };
+
+	inline floatv LoadV(const FLOAT *source) { return _mm256_loadu_ps(source); }
+	inline void StoreV(FLOAT *destination, floatv value) { _mm256_storeu_ps(destination, value); }
+	inline floatv SplatV(FLOAT value) { return _mm256_set1_ps(value); }
+	inline floatv AddV(floatv a, floatv b) { return _mm256_add_ps(a, b); }
+	inline floatv SubV(floatv a, floatv b) { return _mm256_sub_ps(a, b); }
+	inline floatv MulV(floatv a, floatv b) { return _mm256_mul_ps(a, b); }
+	inline floatv MinV(floatv a, floatv b) { return _mm256_min_ps(a, b); }
+	inline floatv MaxV(floatv a, floatv b) { return _mm256_max_ps(a, b); }
+#if defined(__FMA__)
+	inline floatv MulAddV(floatv a, floatv b, floatv c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+	inline floatv MulAddV(floatv a, floatv b, floatv c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+	inline int LessMaskV(floatv a, floatv b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+#else
+	typedef float4 floatv;
+	constexpr std::uint32_t FLOATV_WIDTH{ 4 };
+
+	inline floatv LoadV(const FLOAT *source) { return Load4(source); }
+	inline void StoreV(FLOAT *destination, floatv value) { Store4(destination, value); }
+	inline floatv SplatV(FLOAT value) { return Splat4(value); }
+	inline floatv AddV(floatv a, floatv b) { return Add4(a, b); }
+	inline floatv SubV(floatv a, floatv b) { return Sub4(a, b); }
+	inline floatv MulV(floatv a, floatv b) { return Mul4(a, b); }
+	inline floatv MinV(floatv a, floatv b) { return Min4(a, b); }
+	inline floatv MaxV(floatv a, floatv b) { return Max4(a, b); }
+	inline floatv MulAddV(floatv a, floatv b, floatv c) { return MulAdd4(a, b, c); }
+	inline int LessMaskV(floatv a, floatv b) { return LessMask4(a, b); }
+#endif
+
+	// out = a * b for row vectors, like D3DXMatrixMultiply. The rows of b are loaded before anything
+	// is stored and every row of a is read before its row of out is written, so out may be a or b.
+	inline void MultiplyMatrix(D3DXMATRIX& out, const D3DXMATRIX& a, const D3DXMATRIX& b)
+	{
+#if CORE_SIMD_SSE
+		__m128 b0 = _mm_loadu_ps(b.m[0]);
+		__m128 b1 = _mm_loadu_ps(b.m[1]);
+		__m128 b2 = _mm_loadu_ps(b.m[2]);
+		__m128 b3 = _mm_loadu_ps(b.m[3]);
+
+		for (int row = 0; row < 4; row++)
+		{
+			__m128 r = _mm_loadu_ps(a.m[row]);
+			__m128 result = _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+			result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+			result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+			result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+			_mm_storeu_ps(out.m[row], result);
+		}
+#else
+		D3DXMatrixMultiply(&out, &a, &b);
+#endif
+	}
+}
@@ -0,0 +1,133 @@
+#include "stdafx.h"
+#include "skinning.h"
+#include "allocators.h"
+#include "profiler.h"
+#include "simdmath.h"
+#include <algorithm>
+
+namespace graphics
+{
+	// The position is moved by every bone with a weight and the results are summed with the weights,
+	// which is the same as moving it by the weighted sum of the matrices. Bones without weight are skipped,
+	// most vertices only have one or two.
+	void SkinVertices(const D3DXMATRIX *palette, const skinnedvertex *vertices, UINT count, colorvertex *out)
+	{
+		for (UINT i = 0; i < count; i++)
+		{
+			const skinnedvertex& vertex = vertices[i];
+			core::float4 x = core::Splat4(vertex.position.x);
+			core::float4 y = core::Splat4(vertex.position.y);
+			core::float4 z = core::Splat4(vertex.position.z);
+			core::float4 result = core::Splat4(0.0f);
+
+			for (UINT influence = 0; influence < 4; influence++)
+			{
+				if (vertex.weights[influence] == 0.0f)
+				{
+					continue;
+				}
+
+				const D3DXMATRIX& bone = palette[vertex.bones[influence]];
+				core::float4 moved = core::MulAdd4(x, core::Load4(bone.m[0]),
+					core::MulAdd4(y, core::Load4(bone.m[1]), core::MulAdd4(z, core::Load4(bone.m[2]), core::Load4(bone.m[3]))));
+				result = core::MulAdd4(core::Splat4(vertex.weights[influence]), moved, result);
+			}
+
+			FLOAT position[4];
+			core::Store4(position, result);
+			out[i].position = D3DXVECTOR3(position[0], position[1], position[2]);
+			out[i].color = vertex.color;
+		}
+	}
+
+	characterskinner::characterskinner(const skeleton& rig, const skinnedvertex *vertices, UINT vertexCount) :
+		m_skeleton(rig)
+	{
+		if (!vertices or vertexCount == 0)
+		{
+			throw "Incorrect skinned mesh.";
+		}
+
+		for (UINT i = 0; i < vertexCount; i++)
+		{
+			for (UINT influence = 0; influence < 4; influence++)
+			{
+				if (vertices[i].weights[influence] != 0.0f and vertices[i].bones[influence] >= rig.GetBoneCount())
+				{
+					throw "Skinned mesh uses bones the skeleton does not have.";
+				}
+			}
+		}
+
+		m_vertices.assign(vertices, vertices + vertexCount);
+	}
+
+	// The palettes are all built before the first vertex is moved, a vertex block can span several characters.
+	void characterskinner::Animate(core::jobsystem& jobs, const characterstate *characters, UINT count, colorvertex *out)
+	{
+		PROFILE_SCOPE("characterskinner::Animate");
+		UINT boneCount = m_skeleton.GetBoneCount();
+		UINT vertexCount = GetVertexCount();
+
+		m_palettes.resize(static_cast<std::size_t>(count) * boneCount);
+		jobs.ParallelFor(count, SKINNING_CHARACTER_GRAIN, [this, characters](std::uint32_t begin, std::uint32_t end)
+		{
+			BuildPalettes(characters, begin, end);
+		});
+
+		jobs.ParallelFor(count * vertexCount, SKINNING_VERTEX_GRAIN, [this, boneCount, vertexCount, out](std::uint32_t begin, std::uint32_t end)
+		{
+			while (begin < end)
+			{
+				UINT character = begin / vertexCount;
+				UINT first = begin - character * vertexCount;
+				UINT skinned = (std::min)(vertexCount - first, end - begin);
+
+				SkinVertices(&m_palettes[static_cast<std::size_t>(character) * boneCount], &m_vertices[first], skinned, out + begin);
+				begin += skinned;
+			}
+		});
+	}
+
+	UINT characterskinner::GetVertexCount() const
+	{
+		return static_cast<UINT>(m_vertices.size());
+	}
+
+	// The poses and model matrices are only needed until the palette is built, they live on the scratch stack.
+	void characterskinner::BuildPalettes(const characterstate *characters, UINT begin, UINT end)
+	{
+		core::scratchscope scratch;
+		UINT boneCount = m_skeleton.GetBoneCount();
+		bonepose *pose = static_cast<bonepose*>(core::scratchstack::ForThread().Allocate(sizeof(bonepose) * boneCount * 2));
+		D3DXMATRIX *model = static_cast<D3DXMATRIX*>(core::scratchstack::ForThread().Allocate(sizeof(D3DXMATRIX) * boneCount));
+		if (!pose or !model)
+		{
+			return;
+		}
+		bonepose *blendPose = pose + boneCount;
+
+		for (UINT character = begin; character < end; character++)
+		{
+			const characterstate& state = characters[character];
+
+			if (state.clip)
+			{
+				state.clip->Sample(state.time, pose);
+			}
+			else
+			{
+				std::copy_n(m_skeleton.GetBindPose(), boneCount, pose);
+			}
+
+			if (state.blendClip and state.blendWeight > 0.0f)
+			{
+				state.blendClip->Sample(state.blendTime, blendPose);
+				BlendPoses(pose, blendPose, state.blendWeight, boneCount, pose);
+			}
+
+			m_skeleton.LocalToModel(pose, model);
+			m_skeleton.BuildPalette(model, &m_palettes[static_cast<std::size_t>(character) * boneCount]);
+		}
+	}
+}
@@ -0,0 +1,58 @@
+// skinning.h : include file for CPU skinning
+// Skinned meshes keep the vertex layout of the color shader on the GPU: their vertices are moved by the bones
+// on the CPU every frame and streamed with the dynamic geometry, so color.vs and the input layout stay as they are.
+// The characterskinner animates any number of characters that share a skeleton and a mesh in two parallel passes:
+//  - per character: sample and blend the clips, convert the pose to model space and build the palette,
+//  - per block of vertices across all characters: move every vertex by the palette matrices of its bones with SIMD.
+// The second pass does most of the work and splits evenly however few characters there are.
+#pragma once
+
+#include <vector>
+#include "animation.h"
+#include "jobsystem.h"
+#include "meshdata.h"
+
+namespace graphics
+{
+	// Characters whose palettes one job builds, and vertices one skinning job moves.
+	constexpr UINT SKINNING_CHARACTER_GRAIN{ 8 };
+	constexpr UINT SKINNING_VERTEX_GRAIN{ 2048 };
+
+	// The animation state of one character: the clip playing, and while a transition runs the clip
+	// it blends towards with the weight of that clip.
+	struct characterstate
+	{
+		const animationclip *clip{};
+		FLOAT time{};
+		const animationclip *blendClip{};
+		FLOAT blendTime{};
+		FLOAT blendWeight{};
+	};
+
+	// SkinVertices moves the vertices by the palette, the weighted sum of every bone's matrix applied to the position.
+	void SkinVertices(const D3DXMATRIX *palette, const skinnedvertex *vertices, UINT count, colorvertex *out);
+
+	class characterskinner
+	{
+	public:
+		characterskinner() = delete;
+		// The skeleton has to outlive the skinner, the vertices are copied.
+		characterskinner(const skeleton& rig, const skinnedvertex *vertices, UINT vertexCount);
+		characterskinner(const characterskinner& other) = delete;
+
+		characterskinner& operator=(const characterskinner& other) = delete;
+
+		// Animate writes GetVertexCount vertices for every character to out, character after character.
+		// The clips have to be made for the skeleton of the skinner.
+		void Animate(core::jobsystem& jobs, const characterstate *characters, UINT count, colorvertex *out);
+
+		UINT GetVertexCount() const;
+	private:
+		void BuildPalettes(const characterstate *characters, UINT begin, UINT end);
+
+		const skeleton& m_skeleton;
+		std::vector<skinnedvertex> m_vertices{};
+		// Bone count matrices per character, kept so a frame does not allocate.
+		std::vector<D3DXMATRIX> m_palettes{};
+	};
+}
@@ -0,0 +1,46 @@
+//
+// sprite.vs : Code of the sprite vertex shader in HSLS language.
+//
+// The sprite vertices are in pixels from the top left of the window. The world matrix moves the origin
+// to the middle of the window and turns y upwards, the orthographic projection of d3d maps the window
+// to the screen. The sprites are put at a depth of 1, between the near and far plane of the projection.
+//
+
+// Globals
+cbuffer MatrixBuffer
+{
+    matrix worldMatrix;
+    matrix viewMatrix;
+    matrix projectionMatrix;
+};
+
+// Typedefs
+// The color comes in as 8 bits per channel and reaches the shader between 0 and 1.
+struct VertexInputType
+{
+    float2 position : POSITION;
+    float2 uv : TEXCOORD0;
+    float4 color : COLOR;
+};
+
+struct PixelInputType
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+    float4 color : COLOR;
+};
+
+// Vertex shader
+PixelInputType SpriteVertexShader(VertexInputType input)
+{
+    PixelInputType output;
+
+    output.position = mul(float4(input.position, 1.0f, 1.0f), worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    output.uv = input.uv;
+    output.color = input.color;
+
+    return output;
+}
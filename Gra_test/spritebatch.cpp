@@ -0,0 +1,155 @@
+#include "stdafx.h"
+#include "spritebatch.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace graphics
+{
+	namespace
+	{
+		std::uint8_t PackUnorm(FLOAT value)
+		{
+			return static_cast<std::uint8_t>((std::min)((std::max)(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+		}
+	}
+
+	UINT PackSpriteColor(const D3DXVECTOR4& color)
+	{
+		return static_cast<UINT>(PackUnorm(color.x)) | static_cast<UINT>(PackUnorm(color.y)) << 8 |
+			static_cast<UINT>(PackUnorm(color.z)) << 16 | static_cast<UINT>(PackUnorm(color.w)) << 24;
+	}
+
+	spritebatch::spritebatch(UINT capacity) :
+		m_capacity(capacity)
+	{
+		if (capacity == 0)
+		{
+			throw "Incorrect sprite batch capacity.";
+		}
+
+		m_sprites.reserve(capacity);
+		m_order.reserve(capacity);
+	}
+
+	void spritebatch::Begin()
+	{
+		m_sprites.clear();
+		m_order.clear();
+		m_draws.clear();
+		m_dropped = 0;
+	}
+
+	// The layer is biased into 16 bits so negative layers sort below positive ones.
+	bool spritebatch::Add(const sprite& quad)
+	{
+		if (m_sprites.size() >= m_capacity or quad.texture > SPRITE_MAX_TEXTURE)
+		{
+			m_dropped++;
+			return false;
+		}
+
+		std::uint64_t layer = static_cast<std::uint64_t>((std::min)((std::max)(quad.layer, -32768), 32767) + 32768);
+		m_order.push_back(layer << 48 | static_cast<std::uint64_t>(quad.texture) << 32 | m_sprites.size());
+		m_sprites.push_back(quad);
+		return true;
+	}
+
+	bool spritebatch::AddRectangle(const glyphatlas& atlas, UINT texture, FLOAT x, FLOAT y, FLOAT width, FLOAT height, UINT color, INT layer)
+	{
+		FLOAT u, v;
+		atlas.GetWhite(u, v);
+
+		return Add(sprite{ x, y, width, height, u, v, u, v, color, texture, layer });
+	}
+
+	FLOAT spritebatch::AddText(glyphatlas& atlas, UINT texture, const char *text, FLOAT x, FLOAT y, UINT color, INT layer, FLOAT scale)
+	{
+		FLOAT penX = x, penY = y, widest = 0.0f;
+		FLOAT lineHeight = atlas.GetLineHeight() * scale;
+		std::uint32_t character;
+		PROFILE_SCOPE("spritebatch::AddText");
+
+		while ((character = NextCharacter(text)) != 0)
+		{
+			if (character == '\n')
+			{
+				widest = (std::max)(widest, penX - x);
+				penX = x;
+				penY += lineHeight;
+				continue;
+			}
+
+			// The glyph is only valid until the atlas adds the next one.
+			const glyph *found = atlas.Find(character);
+			if (!found)
+			{
+				continue;
+			}
+
+			if (found->width > 0.0f)
+			{
+				Add(sprite{ std::floor(penX + found->offsetX * scale + 0.5f), std::floor(penY + found->offsetY * scale + 0.5f),
+					found->width * scale, found->height * scale, found->u0, found->v0, found->u1, found->v1, color, texture, layer });
+			}
+			penX += found->advance * scale;
+		}
+
+		return (std::max)(widest, penX - x);
+	}
+
+	// Sprites are mostly added in the order they are drawn in, a batch that is already sorted is not sorted again.
+	void spritebatch::End()
+	{
+		PROFILE_SCOPE("spritebatch::End");
+
+		if (!std::is_sorted(m_order.begin(), m_order.end()))
+		{
+			std::sort(m_order.begin(), m_order.end());
+		}
+
+		m_draws.clear();
+		for (UINT i = 0; i < static_cast<UINT>(m_order.size()); i++)
+		{
+			UINT texture = m_sprites[static_cast<UINT>(m_order[i])].texture;
+			if (m_draws.empty() or m_draws.back().texture != texture or m_draws.back().quadCount == SPRITE_QUADS_PER_DRAW)
+			{
+				m_draws.push_back(spritedraw{ texture, i, 0 });
+			}
+			m_draws.back().quadCount++;
+		}
+	}
+
+	// The corners go top left, top right, bottom left, bottom right, see spriterenderer.h for the triangles.
+	void spritebatch::WriteVertices(spritevertex *vertices) const
+	{
+		PROFILE_SCOPE("spritebatch::WriteVertices");
+
+		for (std::uint64_t key : m_order)
+		{
+			const sprite& quad = m_sprites[static_cast<UINT>(key)];
+			FLOAT right = quad.x + quad.width, bottom = quad.y + quad.height;
+
+			vertices[0] = spritevertex{ quad.x, quad.y, quad.u0, quad.v0, quad.color };
+			vertices[1] = spritevertex{ right, quad.y, quad.u1, quad.v0, quad.color };
+			vertices[2] = spritevertex{ quad.x, bottom, quad.u0, quad.v1, quad.color };
+			vertices[3] = spritevertex{ right, bottom, quad.u1, quad.v1, quad.color };
+			vertices += 4;
+		}
+	}
+
+	UINT spritebatch::GetQuadCount() const
+	{
+		return static_cast<UINT>(m_order.size());
+	}
+
+	const std::vector<spritedraw>& spritebatch::GetDraws() const
+	{
+		return m_draws;
+	}
+
+	spritebatchstats spritebatch::GetStats() const
+	{
+		return spritebatchstats{ static_cast<UINT>(m_sprites.size()), static_cast<UINT>(m_draws.size()), m_dropped };
+	}
+}
@@ -0,0 +1,99 @@
+// spritebatch.h : include file for batching 2D sprites and text
+// The batch collects the sprites of a frame, rectangles in pixels from the top left of the window with a part of
+// a texture on them, and turns them into one vertex stream of quads and a short list of draws.
+// The sprites are sorted by layer and, within a layer, by texture, so every run of sprites on the same texture
+// is one draw no matter in which order they were added. Sprites of the same layer and texture keep their order,
+// ones that overlap and use different textures should be put on different layers.
+// Text is laid out into sprites with the glyphs of a glyph atlas (see glyphatlas.h).
+// Four vertices make a quad, the render side draws them with an index buffer repeating the two triangles of a quad,
+// a draw covers at most SPRITE_QUADS_PER_DRAW quads so the indices fit 16 bits.
+// The batch does not need a device, the render side takes the vertices and draws as they are.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "d3dxmath.h"
+#include "glyphatlas.h"
+
+namespace graphics
+{
+	constexpr UINT SPRITE_QUADS_PER_DRAW{ 16384 };
+	constexpr UINT SPRITE_MAX_TEXTURE{ 0xFFFF };
+
+	// The color is RGBA with 8 bits each and red in the lowest byte, like DXGI_FORMAT_R8G8B8A8_UNORM.
+	struct spritevertex
+	{
+		FLOAT x, y;
+		FLOAT u, v;
+		UINT color;
+	};
+
+	struct sprite
+	{
+		FLOAT x, y, width, height;
+		FLOAT u0, v0, u1, v1;
+		UINT color;
+		UINT texture;
+		INT layer;
+	};
+
+	// The quads of a draw follow each other in the vertex stream.
+	struct spritedraw
+	{
+		UINT texture;
+		UINT firstQuad;
+		UINT quadCount;
+	};
+
+	struct spritebatchstats
+	{
+		UINT sprites{};
+		UINT draws{};
+		UINT dropped{};
+	};
+
+	// PackSpriteColor turns a color with components from 0 to 1 into the color of the sprite vertices.
+	UINT PackSpriteColor(const D3DXVECTOR4& color);
+
+	class spritebatch
+	{
+	public:
+		spritebatch() = delete;
+		// Sprites added past the capacity are dropped.
+		spritebatch(UINT capacity);
+		spritebatch(const spritebatch& other) = delete;
+		~spritebatch() {};
+
+		spritebatch& operator=(const spritebatch& other) = delete;
+
+		// Begin empties the batch for the next frame.
+		void Begin();
+
+		// Add returns false when the sprite was dropped, because the batch is full or its texture is past SPRITE_MAX_TEXTURE.
+		bool Add(const sprite& quad);
+
+		// AddRectangle adds a solid rectangle with the white texels of the atlas.
+		bool AddRectangle(const glyphatlas& atlas, UINT texture, FLOAT x, FLOAT y, FLOAT width, FLOAT height, UINT color, INT layer);
+
+		// AddText lays out the UTF-8 text with its first line's top left at x, y, a new line goes down by the line height.
+		// The glyphs are placed on whole pixels so text drawn at its size stays sharp.
+		// It returns the width of the widest line.
+		FLOAT AddText(glyphatlas& atlas, UINT texture, const char *text, FLOAT x, FLOAT y, UINT color, INT layer, FLOAT scale = 1.0f);
+
+		// End sorts the sprites and cuts them into draws. WriteVertices then writes four vertices for each quad,
+		// in the order of the draws, so there has to be room for 4 * GetQuadCount vertices.
+		void End();
+		void WriteVertices(spritevertex *vertices) const;
+
+		UINT GetQuadCount() const;
+		const std::vector<spritedraw>& GetDraws() const;
+		spritebatchstats GetStats() const;
+	private:
+		std::vector<sprite> m_sprites;
+		// The sort keys: the layer, the texture and the index of the sprite from the highest bits down.
+		std::vector<std::uint64_t> m_order;
+		std::vector<spritedraw> m_draws;
+		UINT m_capacity{};
+		UINT m_dropped{};
+	};
+}
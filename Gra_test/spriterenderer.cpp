@@ -0,0 +1,405 @@
+#include "stdafx.h"
+#include "spriterenderer.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include <cstdint>
+
+namespace graphics
+{
+	WCHAR spriteVsPath[] = L"sprite.vs";
+	WCHAR spritePsPath[] = L"sprite.ps";
+
+	spriterenderer::spriterenderer(ID3D11Device *dev, HWND hWnd, const glyphatlas& atlas) :
+		m_atlasWidth(atlas.GetWidth())
+	{
+		if (!InitializeShader(dev, hWnd))
+		{
+			throw "Unable to initialize the sprite shaders.";
+		}
+
+		if (!InitializeBuffers(dev, atlas))
+		{
+			throw "Unable to create the sprite buffers.";
+		}
+
+		m_textures.push_back(m_atlasView);
+	}
+
+	spriterenderer::~spriterenderer()
+	{
+		core::memorytracker::Freed(core::memorytag::shaders, m_shaderBytes);
+		core::memorytracker::Freed(core::memorytag::meshes, m_indexBytes);
+		core::memorytracker::Freed(core::memorytag::textures, m_textureBytes);
+
+		if (m_atlasView)
+		{
+			m_atlasView->Release();
+			m_atlasView = nullptr;
+		}
+
+		if (m_atlas)
+		{
+			m_atlas->Release();
+			m_atlas = nullptr;
+		}
+
+		if (m_blendState)
+		{
+			m_blendState->Release();
+			m_blendState = nullptr;
+		}
+
+		if (m_sampler)
+		{
+			m_sampler->Release();
+			m_sampler = nullptr;
+		}
+
+		if (m_indexBuffer)
+		{
+			m_indexBuffer->Release();
+			m_indexBuffer = nullptr;
+		}
+
+		if (m_matrixBuffer)
+		{
+			m_matrixBuffer->Release();
+			m_matrixBuffer = nullptr;
+		}
+
+		if (m_layout)
+		{
+			m_layout->Release();
+			m_layout = nullptr;
+		}
+
+		if (m_pixelShader)
+		{
+			m_pixelShader->Release();
+			m_pixelShader = nullptr;
+		}
+
+		if (m_vertexShader)
+		{
+			m_vertexShader->Release();
+			m_vertexShader = nullptr;
+		}
+	}
+
+	void spriterenderer::UploadAtlas(ID3D11DeviceContext *devcon, UINT top, UINT rows, const std::uint8_t *pixels)
+	{
+		D3D11_BOX box{};
+		PROFILE_SCOPE("spriterenderer::UploadAtlas");
+
+		m_atlasRows.resize(static_cast<size_t>(m_atlasWidth) * rows);
+		for (size_t i = 0; i < m_atlasRows.size(); i++)
+		{
+			m_atlasRows[i] = 0x00FFFFFFu | static_cast<UINT>(pixels[i]) << 24;
+		}
+
+		box.left = 0;
+		box.right = m_atlasWidth;
+		box.top = top;
+		box.bottom = top + rows;
+		box.front = 0;
+		box.back = 1;
+
+		devcon->UpdateSubresource(m_atlas, 0, &box, m_atlasRows.data(), m_atlasWidth * sizeof(UINT), 0);
+
+		core::telemetry::Count(core::counter::bytesuploaded, static_cast<std::uint64_t>(m_atlasRows.size()) * sizeof(UINT));
+	}
+
+	void spriterenderer::SetTexture(UINT texture, ID3D11ShaderResourceView *view)
+	{
+		if (texture >= m_textures.size())
+		{
+			m_textures.resize(texture + 1);
+		}
+		m_textures[texture] = view;
+	}
+
+	// The vertices are in pixels with y down, the world matrix moves them into the space of the orthographic matrix,
+	// which has its origin in the middle of the window and y up.
+	bool spriterenderer::Render(ID3D11DeviceContext *devcon, dynamicbuffer& vertices, UINT firstVertex, const spritedraw *draws, UINT drawCount,
+		UINT screenWidth, UINT screenHeight, const D3DXMATRIX& orthoMatrix)
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		D3DXMATRIX worldMatrix, viewMatrix;
+		ID3D11ShaderResourceView *bound = nullptr;
+		const FLOAT blendFactor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		PROFILE_SCOPE("spriterenderer::Render");
+
+		if (drawCount == 0)
+		{
+			return true;
+		}
+
+		D3DXMatrixIdentity(&worldMatrix);
+		D3DXMatrixIdentity(&viewMatrix);
+		worldMatrix._22 = -1.0f;
+		worldMatrix._41 = -0.5f * static_cast<FLOAT>(screenWidth);
+		worldMatrix._42 = 0.5f * static_cast<FLOAT>(screenHeight);
+
+		HRESULT result = devcon->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		if (FAILED(result))
+		{
+			return false;
+		}
+		PackMatrixBuffer(*static_cast<matrixbuffer*>(mappedResource.pData), worldMatrix, viewMatrix, orthoMatrix);
+		devcon->Unmap(m_matrixBuffer, 0);
+
+		vertices.Bind(devcon, 0, sizeof(spritevertex));
+		devcon->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		devcon->IASetInputLayout(m_layout);
+		devcon->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		devcon->VSSetShader(m_vertexShader, NULL, 0);
+		devcon->VSSetConstantBuffers(0, 1, &m_matrixBuffer);
+		devcon->PSSetShader(m_pixelShader, NULL, 0);
+		devcon->PSSetSamplers(0, 1, &m_sampler);
+		devcon->OMSetBlendState(m_blendState, blendFactor, 0xFFFFFFFF);
+		core::telemetry::Count(core::counter::bytesuploaded, sizeof(matrixbuffer));
+		core::telemetry::Count(core::counter::statechanges, 10);
+
+		for (UINT i = 0; i < drawCount; i++)
+		{
+			const spritedraw& draw = draws[i];
+			ID3D11ShaderResourceView *view = draw.texture < m_textures.size() ? m_textures[draw.texture] : nullptr;
+			if (!view)
+			{
+				continue;
+			}
+
+			if (view != bound)
+			{
+				devcon->PSSetShaderResources(0, 1, &view);
+				bound = view;
+				core::telemetry::Count(core::counter::statechanges, 1);
+			}
+
+			devcon->DrawIndexed(draw.quadCount * 6, 0, static_cast<INT>(firstVertex + draw.firstQuad * 4));
+
+			core::telemetry::Count(core::counter::drawcalls, 1);
+			core::telemetry::Count(core::counter::triangles, static_cast<std::uint64_t>(draw.quadCount) * 2);
+		}
+
+		// The draws after this one are not blended.
+		devcon->OMSetBlendState(NULL, blendFactor, 0xFFFFFFFF);
+		core::telemetry::Count(core::counter::statechanges, 1);
+
+		return true;
+	}
+
+	// The shaders are compiled like the ones of the color shader, see colorshader::InitializeShader.
+	// The layout must match spritevertex: two floats of position, two of texture coordinates and the color in 8 bits a channel.
+	bool spriterenderer::InitializeShader(ID3D11Device *dev, HWND hWnd)
+	{
+		HRESULT result;
+		ID3D10Blob* errorMessage{};
+		ID3D10Blob* vertexShaderBuffer{};
+		ID3D10Blob* pixelShaderBuffer{};
+		D3D11_INPUT_ELEMENT_DESC polygonLayout[3]{};
+		D3D11_BUFFER_DESC matrixBufferDesc{};
+
+		result = D3DX11CompileFromFile(spriteVsPath, NULL, NULL, "SpriteVertexShader", "vs_5_0", D3D10_SHADER_ENABLE_STRICTNESS, 0, NULL,
+			&vertexShaderBuffer, &errorMessage, NULL);
+		if (FAILED(result))
+		{
+			if (errorMessage)
+			{
+				OutputShaderErrorMessage(errorMessage, hWnd, spriteVsPath);
+			}
+			else
+			{
+				MessageBox(hWnd, spriteVsPath, L"Missing Shader File", MB_OK);
+			}
+
+			return false;
+		}
+
+		result = D3DX11CompileFromFile(spritePsPath, NULL, NULL, "SpritePixelShader", "ps_5_0", D3D10_SHADER_ENABLE_STRICTNESS, 0, NULL,
+			&pixelShaderBuffer, &errorMessage, NULL);
+		if (FAILED(result))
+		{
+			vertexShaderBuffer->Release();
+			if (errorMessage)
+			{
+				OutputShaderErrorMessage(errorMessage, hWnd, spritePsPath);
+			}
+			else
+			{
+				MessageBox(hWnd, spritePsPath, L"Missing Shader File", MB_OK);
+			}
+
+			return false;
+		}
+
+		result = dev->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &m_vertexShader);
+		if (SUCCEEDED(result))
+		{
+			result = dev->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &m_pixelShader);
+		}
+
+		polygonLayout[0].SemanticName = "POSITION";
+		polygonLayout[0].Format = DXGI_FORMAT_R32G32_FLOAT;
+		polygonLayout[0].AlignedByteOffset = 0;
+		polygonLayout[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+
+		polygonLayout[1].SemanticName = "TEXCOORD";
+		polygonLayout[1].Format = DXGI_FORMAT_R32G32_FLOAT;
+		polygonLayout[1].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+		polygonLayout[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+
+		polygonLayout[2].SemanticName = "COLOR";
+		polygonLayout[2].Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		polygonLayout[2].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+		polygonLayout[2].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+
+		if (SUCCEEDED(result))
+		{
+			result = dev->CreateInputLayout(polygonLayout, sizeof(polygonLayout) / sizeof(polygonLayout[0]), vertexShaderBuffer->GetBufferPointer(),
+				vertexShaderBuffer->GetBufferSize(), &m_layout);
+		}
+		if (SUCCEEDED(result))
+		{
+			m_shaderBytes += vertexShaderBuffer->GetBufferSize() + pixelShaderBuffer->GetBufferSize();
+		}
+
+		vertexShaderBuffer->Release();
+		pixelShaderBuffer->Release();
+
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		matrixBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		matrixBufferDesc.ByteWidth = sizeof(matrixbuffer);
+		matrixBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		matrixBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		result = dev->CreateBuffer(&matrixBufferDesc, NULL, &m_matrixBuffer);
+		if (FAILED(result))
+		{
+			return false;
+		}
+		m_shaderBytes += matrixBufferDesc.ByteWidth;
+		core::memorytracker::Allocated(core::memorytag::shaders, m_shaderBytes);
+
+		return true;
+	}
+
+	// Text is drawn at its size, the bilinear filter only comes into play for scaled sprites.
+	// The blend puts the sprites over the window by their alpha and keeps the window's alpha.
+	bool spriterenderer::InitializeBuffers(ID3D11Device *dev, const glyphatlas& atlas)
+	{
+		D3D11_BUFFER_DESC indexBufferDesc{};
+		D3D11_SUBRESOURCE_DATA indexData{}, atlasData{};
+		D3D11_SAMPLER_DESC samplerDesc{};
+		D3D11_BLEND_DESC blendDesc{};
+		D3D11_TEXTURE2D_DESC atlasDesc{};
+		HRESULT result;
+
+		std::vector<std::uint16_t> indices(SPRITE_QUADS_PER_DRAW * 6);
+		for (UINT quad = 0; quad < SPRITE_QUADS_PER_DRAW; quad++)
+		{
+			std::uint16_t first = static_cast<std::uint16_t>(quad * 4);
+			std::uint16_t *corners = &indices[quad * 6];
+			corners[0] = first;
+			corners[1] = static_cast<std::uint16_t>(first + 1);
+			corners[2] = static_cast<std::uint16_t>(first + 2);
+			corners[3] = static_cast<std::uint16_t>(first + 2);
+			corners[4] = static_cast<std::uint16_t>(first + 1);
+			corners[5] = static_cast<std::uint16_t>(first + 3);
+		}
+
+		indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		indexBufferDesc.ByteWidth = static_cast<UINT>(indices.size() * sizeof(std::uint16_t));
+		indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		indexData.pSysMem = indices.data();
+
+		result = dev->CreateBuffer(&indexBufferDesc, &indexData, &m_indexBuffer);
+		if (FAILED(result))
+		{
+			return false;
+		}
+		m_indexBytes = indexBufferDesc.ByteWidth;
+		core::memorytracker::Allocated(core::memorytag::meshes, m_indexBytes);
+
+		samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+		samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+		samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+		samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+		samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+		samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+		result = dev->CreateSamplerState(&samplerDesc, &m_sampler);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		blendDesc.RenderTarget[0].BlendEnable = TRUE;
+		blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+		blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+		blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+		blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ZERO;
+		blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+		blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+		blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+
+		result = dev->CreateBlendState(&blendDesc, &m_blendState);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		// The atlas starts out with the pixels it has now, later glyphs arrive through UploadAtlas.
+		m_atlasRows.resize(static_cast<size_t>(atlas.GetWidth()) * atlas.GetHeight());
+		for (size_t i = 0; i < m_atlasRows.size(); i++)
+		{
+			m_atlasRows[i] = 0x00FFFFFFu | static_cast<UINT>(atlas.GetPixels()[i]) << 24;
+		}
+
+		atlasDesc.Width = atlas.GetWidth();
+		atlasDesc.Height = atlas.GetHeight();
+		atlasDesc.MipLevels = 1;
+		atlasDesc.ArraySize = 1;
+		atlasDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		atlasDesc.SampleDesc.Count = 1;
+		atlasDesc.Usage = D3D11_USAGE_DEFAULT;
+		atlasDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		atlasData.pSysMem = m_atlasRows.data();
+		atlasData.SysMemPitch = atlas.GetWidth() * sizeof(UINT);
+
+		result = dev->CreateTexture2D(&atlasDesc, &atlasData, &m_atlas);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		result = dev->CreateShaderResourceView(m_atlas, NULL, &m_atlasView);
+		if (FAILED(result))
+		{
+			return false;
+		}
+		m_textureBytes = static_cast<UINT64>(m_atlasRows.size()) * sizeof(UINT);
+		core::memorytracker::Allocated(core::memorytag::textures, m_textureBytes);
+
+		return true;
+	}
+
+	// The compile errors go to the same file as the ones of the color shader.
+	void spriterenderer::OutputShaderErrorMessage(ID3D10Blob *errorMessage, HWND hWnd, WCHAR *path)
+	{
+		std::ofstream fout;
+
+		fout.open("shader-error.txt");
+		fout.write(static_cast<const char*>(errorMessage->GetBufferPointer()), errorMessage->GetBufferSize());
+		fout.close();
+
+		errorMessage->Release();
+
+		MessageBox(hWnd, L"Error compiling shader.  Check shader-error.txt for message.", path, MB_OK);
+	}
+}
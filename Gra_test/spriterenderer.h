@@ -0,0 +1,68 @@
+// spriterenderer.h : include file for drawing sprite batches
+// The sprite renderer draws the quads of a sprite batch (see spritebatch.h) from the dynamic geometry buffer
+// over whatever render target is bound, blended by alpha, with the orthographic matrix of d3d.
+// One static index buffer holds the two triangles of SPRITE_QUADS_PER_DRAW quads, (0, 1, 2) and (2, 1, 3) for every
+// four vertices, which is clockwise once y points up. Each draw is one DrawIndexed with its first quad's vertex
+// as the base vertex, the texture only changes between draws.
+// The renderer owns the texture of the glyph atlas, it is texture 0 of the batches, other textures can be put
+// on higher numbers. The atlas keeps its pixels on the CPU and only the rows that changed are copied.
+#pragma once
+
+#include <d3d11.h>
+#include <d3dx10math.h>
+#include <d3dx11async.h>
+#include <fstream>
+#include <vector>
+#include "dynamicbuffer.h"
+#include "shaderparameters.h"
+#include "spritebatch.h"
+
+namespace graphics
+{
+	constexpr UINT SPRITE_ATLAS_TEXTURE{ 0 };
+
+	class spriterenderer
+	{
+	public:
+		spriterenderer() = delete;
+		// The atlas texture is created with the pixels of the atlas as they are now.
+		spriterenderer(ID3D11Device *dev, HWND hWnd, const glyphatlas& atlas);
+		spriterenderer(const spriterenderer& other) = delete;
+		~spriterenderer();
+
+		spriterenderer& operator=(const spriterenderer& other) = delete;
+
+		// UploadAtlas copies rows of the atlas from top on, pixels points at the first of them.
+		void UploadAtlas(ID3D11DeviceContext *devcon, UINT top, UINT rows, const std::uint8_t *pixels);
+
+		// SetTexture puts a texture on a texture number of the batches, the renderer does not take a reference.
+		void SetTexture(UINT texture, ID3D11ShaderResourceView *view);
+
+		// Render draws the sprite draws, the quads of the batch begin at firstVertex in the dynamic buffer.
+		// The window size turns the pixels of the sprites into the coordinates of the orthographic matrix.
+		bool Render(ID3D11DeviceContext *devcon, dynamicbuffer& vertices, UINT firstVertex, const spritedraw *draws, UINT drawCount,
+			UINT screenWidth, UINT screenHeight, const D3DXMATRIX& orthoMatrix);
+	private:
+		bool InitializeShader(ID3D11Device *dev, HWND hWnd);
+		bool InitializeBuffers(ID3D11Device *dev, const glyphatlas& atlas);
+		void OutputShaderErrorMessage(ID3D10Blob *errorMessage, HWND hWnd, WCHAR *path);
+	private:
+		ID3D11VertexShader* m_vertexShader{};
+		ID3D11PixelShader* m_pixelShader{};
+		ID3D11InputLayout* m_layout{};
+		ID3D11Buffer* m_matrixBuffer{};
+		ID3D11Buffer* m_indexBuffer{};
+		ID3D11SamplerState* m_sampler{};
+		ID3D11BlendState* m_blendState{};
+		ID3D11Texture2D* m_atlas{};
+		ID3D11ShaderResourceView* m_atlasView{};
+		UINT m_atlasWidth{};
+		// The atlas rows widened to RGBA before they are copied, white with the coverage as alpha.
+		std::vector<UINT> m_atlasRows{};
+		std::vector<ID3D11ShaderResourceView*> m_textures{};
+		// Bytes reported to the memory tracker, given back when the renderer is destroyed.
+		UINT64 m_shaderBytes{};
+		UINT64 m_indexBytes{};
+		UINT64 m_textureBytes{};
+	};
+}
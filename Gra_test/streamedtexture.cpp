@@ -0,0 +1,172 @@
+#include "stdafx.h"
+#include "streamedtexture.h"
+#include "memorytracker.h"
+#include "telemetry.h"
+#include "texture.h"
+#include <algorithm>
+
+namespace graphics
+{
+	streamedtexture::streamedtexture(const cookedtexture& header) :
+		m_residentMip(static_cast<UINT>(header.mips.size()))
+	{
+		if (header.mips.empty())
+		{
+			throw "Incorrect streamed texture parameters.";
+		}
+
+		m_header.format = header.format;
+		m_header.srgb = header.srgb;
+		m_header.width = header.width;
+		m_header.height = header.height;
+		m_header.mips = header.mips;
+	}
+
+	streamedtexture::~streamedtexture()
+	{
+		Release();
+	}
+
+	bool streamedtexture::Upload(ID3D11Device *dev, ID3D11DeviceContext *devcon, UINT mip, UINT mipCount, const std::uint8_t *data)
+	{
+		if (mipCount == 0 or mip + mipCount != m_residentMip or !Recreate(dev, devcon, mip))
+		{
+			return false;
+		}
+
+		const cookedmip& first = m_header.mips[mip];
+		for (UINT level = mip; level < mip + mipCount; level++)
+		{
+			const cookedmip& source = m_header.mips[level];
+			devcon->UpdateSubresource(m_texture, level - mip, NULL, data + (source.offset - first.offset), source.rowPitch, source.size);
+			core::telemetry::Count(core::counter::bytesuploaded, source.size);
+		}
+
+		return true;
+	}
+
+	bool streamedtexture::Evict(ID3D11Device *dev, ID3D11DeviceContext *devcon, UINT mip)
+	{
+		if (!m_texture or mip <= m_residentMip or mip >= m_header.mips.size())
+		{
+			return false;
+		}
+
+		return Recreate(dev, devcon, mip);
+	}
+
+	void streamedtexture::Bind(ID3D11DeviceContext *devcon, UINT slot)
+	{
+		if (!m_view)
+		{
+			return;
+		}
+
+		devcon->PSSetShaderResources(slot, 1, &m_view);
+
+		core::telemetry::Count(core::counter::statechanges, 1);
+	}
+
+	bool streamedtexture::IsResident() const
+	{
+		return m_texture != nullptr;
+	}
+
+	UINT streamedtexture::GetResidentMip() const
+	{
+		return m_residentMip;
+	}
+
+	// Block compressed textures need a top mip that is a multiple of 4 along both axes, as for the texture class.
+	bool streamedtexture::Recreate(ID3D11Device *dev, ID3D11DeviceContext *devcon, UINT mip)
+	{
+		D3D11_TEXTURE2D_DESC textureDesc{};
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc{};
+		ID3D11Texture2D *created{};
+		ID3D11ShaderResourceView *createdView{};
+		const cookedmip& top = m_header.mips[mip];
+		UINT mipCount = static_cast<UINT>(m_header.mips.size());
+		HRESULT result;
+
+		if (m_header.format != textureformat::rgba8 and (top.width % 4 != 0 or top.height % 4 != 0))
+		{
+			return false;
+		}
+
+		textureDesc.Width = top.width;
+		textureDesc.Height = top.height;
+		textureDesc.MipLevels = mipCount - mip;
+		textureDesc.ArraySize = 1;
+		textureDesc.Format = GetTextureFormat(m_header.format, m_header.srgb);
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.SampleDesc.Quality = 0;
+		textureDesc.Usage = D3D11_USAGE_DEFAULT;
+		textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		textureDesc.CPUAccessFlags = 0;
+		textureDesc.MiscFlags = 0;
+
+		result = dev->CreateTexture2D(&textureDesc, NULL, &created);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		viewDesc.Format = textureDesc.Format;
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		viewDesc.Texture2D.MostDetailedMip = 0;
+		viewDesc.Texture2D.MipLevels = textureDesc.MipLevels;
+
+		result = dev->CreateShaderResourceView(created, &viewDesc, &createdView);
+		if (FAILED(result))
+		{
+			created->Release();
+			return false;
+		}
+
+		// The mips both textures have, the others are either new and uploaded by the caller or dropped.
+		if (m_texture)
+		{
+			for (UINT level = (std::max)(mip, m_residentMip); level < mipCount; level++)
+			{
+				devcon->CopySubresourceRegion(created, level - mip, 0, 0, 0, m_texture, level - m_residentMip, NULL);
+			}
+		}
+
+		Release();
+		m_texture = created;
+		m_view = createdView;
+		m_residentMip = mip;
+		core::memorytracker::Allocated(core::memorytag::textures, GetSize(mip));
+		return true;
+	}
+
+	void streamedtexture::Release()
+	{
+		if (m_texture)
+		{
+			core::memorytracker::Freed(core::memorytag::textures, GetSize(m_residentMip));
+		}
+
+		if (m_view)
+		{
+			m_view->Release();
+			m_view = nullptr;
+		}
+
+		if (m_texture)
+		{
+			m_texture->Release();
+			m_texture = nullptr;
+		}
+	}
+
+	UINT64 streamedtexture::GetSize(UINT mip) const
+	{
+		UINT64 size = 0;
+		for (UINT level = mip; level < m_header.mips.size(); level++)
+		{
+			size += m_header.mips[level].size;
+		}
+		return size;
+	}
+}
@@ -0,0 +1,44 @@
+// streamedtexture.h : include file for the GPU side of a streamed texture
+// A Direct3D 11 texture cannot gain or lose mips, so a streamed texture is created again whenever its resident
+// mips change: the new texture reaches from the new most detailed mip, the mips both have are copied over on the GPU
+// and the new mips are written with UpdateSubresource. Only the resident mips take memory.
+// The texture exists from the first upload on, which is the tail of mips the streamer loads with the texture.
+// Uploads and evictions come from the texture streamer (see texturestreamer.h) and are applied on the render thread.
+#pragma once
+
+#include <d3d11.h>
+#include "texturecook.h"
+
+namespace graphics
+{
+	class streamedtexture
+	{
+	public:
+		streamedtexture() = delete;
+		// The header is the format and mip table of the cooked texture, the data is not needed.
+		streamedtexture(const cookedtexture& header);
+		streamedtexture(const streamedtexture& other) = delete;
+		~streamedtexture();
+
+		streamedtexture& operator=(const streamedtexture& other) = delete;
+
+		// Upload adds mipCount mips from mip on, they have to reach down to the mips already resident.
+		bool Upload(ID3D11Device *dev, ID3D11DeviceContext *devcon, UINT mip, UINT mipCount, const std::uint8_t *data);
+		// Evict drops the mips more detailed than mip.
+		bool Evict(ID3D11Device *dev, ID3D11DeviceContext *devcon, UINT mip);
+		// Bind puts the texture on a pixel shader slot, nothing before the first upload.
+		void Bind(ID3D11DeviceContext *devcon, UINT slot);
+
+		bool IsResident() const;
+		UINT GetResidentMip() const;
+	private:
+		bool Recreate(ID3D11Device *dev, ID3D11DeviceContext *devcon, UINT mip);
+		void Release();
+		UINT64 GetSize(UINT mip) const;
+
+		cookedtexture m_header{};
+		ID3D11Texture2D *m_texture{};
+		ID3D11ShaderResourceView *m_view{};
+		UINT m_residentMip{};
+	};
+}
@@ -0,0 +1,342 @@
+#include "stdafx.h"
+#include "telemetry.h"
+#include "profiler.h"
+#include <cstdio>
+#include <fstream>
+
+namespace core
+{
+	std::atomic<std::uint64_t> telemetry::s_counters[static_cast<std::uint32_t>(counter::count)]{};
+
+	namespace
+	{
+		constexpr std::uint32_t MIN_FRAMES_FOR_HITCHES{ 60 };
+
+		const char *const g_counterNames[] = { "draw_calls", "triangles", "state_changes", "bytes_uploaded", "publish_wait_us" };
+	}
+
+	void frametimehistogram::Record(double seconds)
+	{
+		double microseconds = seconds * 1000000.0;
+		std::uint64_t value = microseconds < 1.0 ? 1 : static_cast<std::uint64_t>(microseconds);
+
+		m_buckets[BucketIndex(value)]++;
+		m_count++;
+		m_totalSeconds += seconds;
+		if (value > m_maxMicroseconds)
+		{
+			m_maxMicroseconds = value;
+		}
+	}
+
+	void frametimehistogram::Add(const frametimehistogram& other)
+	{
+		for (std::uint32_t i = 0; i < BUCKET_COUNT; i++)
+		{
+			m_buckets[i] += other.m_buckets[i];
+		}
+		m_count += other.m_count;
+		m_totalSeconds += other.m_totalSeconds;
+		if (other.m_maxMicroseconds > m_maxMicroseconds)
+		{
+			m_maxMicroseconds = other.m_maxMicroseconds;
+		}
+	}
+
+	void frametimehistogram::Reset()
+	{
+		*this = frametimehistogram();
+	}
+
+	// The value reported for a bucket is its upper edge, a percentile never looks better than it was.
+	double frametimehistogram::Percentile(double fraction) const
+	{
+		if (m_count == 0)
+		{
+			return 0.0;
+		}
+
+		std::uint64_t rank = static_cast<std::uint64_t>(fraction * static_cast<double>(m_count) + 0.5);
+		if (rank < 1)
+		{
+			rank = 1;
+		}
+
+		std::uint64_t seen = 0;
+		for (std::uint32_t i = 0; i < BUCKET_COUNT; i++)
+		{
+			seen += m_buckets[i];
+			if (seen >= rank)
+			{
+				std::uint64_t value = BucketValue(i);
+				return static_cast<double>(value < m_maxMicroseconds ? value : m_maxMicroseconds) / 1000000.0;
+			}
+		}
+
+		return Max();
+	}
+
+	double frametimehistogram::Max() const
+	{
+		return static_cast<double>(m_maxMicroseconds) / 1000000.0;
+	}
+
+	double frametimehistogram::Mean() const
+	{
+		return m_count ? m_totalSeconds / static_cast<double>(m_count) : 0.0;
+	}
+
+	std::uint64_t frametimehistogram::Count() const
+	{
+		return m_count;
+	}
+
+	// Values below SUB_BUCKETS have a bucket each. Above that every power of two
+	// [2^e, 2^(e+1)) is split into SUB_BUCKETS buckets of equal width.
+	std::uint32_t frametimehistogram::BucketIndex(std::uint64_t microseconds)
+	{
+		if (microseconds < SUB_BUCKETS)
+		{
+			return static_cast<std::uint32_t>(microseconds);
+		}
+
+		std::uint32_t exponent = 0;
+		for (std::uint64_t value = microseconds; value > 1; value >>= 1)
+		{
+			exponent++;
+		}
+		if (exponent > MAX_EXPONENT)
+		{
+			return BUCKET_COUNT - 1;
+		}
+
+		std::uint32_t shift = exponent - SUB_BUCKET_BITS;
+		std::uint32_t sub = static_cast<std::uint32_t>(microseconds >> shift) - SUB_BUCKETS;
+		return (shift + 1) * SUB_BUCKETS + sub;
+	}
+
+	std::uint64_t frametimehistogram::BucketValue(std::uint32_t index)
+	{
+		if (index < SUB_BUCKETS)
+		{
+			return index;
+		}
+
+		std::uint32_t shift = index / SUB_BUCKETS - 1;
+		std::uint64_t sub = index % SUB_BUCKETS;
+		return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+	}
+
+	telemetry::telemetry(double hitchFactor, double minHitchSeconds) :
+		m_hitchFactor(hitchFactor), m_minHitchSeconds(minHitchSeconds), m_history(TELEMETRY_HISTORY_FRAMES)
+	{
+		if (hitchFactor <= 1.0)
+		{
+			throw "Incorrect hitch factor.";
+		}
+
+		m_hitches.reserve(TELEMETRY_MAX_HITCHES);
+		m_lastTick = profiler::Now();
+	}
+
+	void telemetry::Count(counter counted, std::uint64_t value)
+	{
+		s_counters[static_cast<std::uint32_t>(counted)].fetch_add(value, std::memory_order_relaxed);
+	}
+
+	// The hitch check runs before the frame is added, so the median it is compared to is not raised by the hitch itself.
+	void telemetry::RecordFrame(double seconds)
+	{
+		std::uint64_t frameBegin = m_lastTick;
+		std::uint64_t frameEnd = profiler::Now();
+		m_lastTick = frameEnd;
+
+		framerecord& record = m_history[m_frames % TELEMETRY_HISTORY_FRAMES];
+		record.frame = m_frames;
+		record.seconds = seconds;
+		for (std::uint32_t i = 0; i < static_cast<std::uint32_t>(counter::count); i++)
+		{
+			record.counters[i] = s_counters[i].exchange(0, std::memory_order_relaxed);
+		}
+
+		DetectHitch(record, frameBegin, frameEnd);
+
+		if (m_windows[m_currentWindow].Count() >= TELEMETRY_WINDOW_FRAMES)
+		{
+			m_currentWindow ^= 1;
+			m_windows[m_currentWindow].Reset();
+		}
+		m_windows[m_currentWindow].Record(seconds);
+		m_total.Record(seconds);
+		m_frames++;
+	}
+
+	framesummary telemetry::GetRollingSummary() const
+	{
+		frametimehistogram rolling = m_windows[0];
+		rolling.Add(m_windows[1]);
+		return Summarize(rolling);
+	}
+
+	framesummary telemetry::GetTotalSummary() const
+	{
+		return Summarize(m_total);
+	}
+
+	const framerecord* telemetry::GetLastFrame() const
+	{
+		return m_frames ? &m_history[(m_frames - 1) % TELEMETRY_HISTORY_FRAMES] : nullptr;
+	}
+
+	const std::vector<hitchrecord>& telemetry::GetHitches() const
+	{
+		return m_hitches;
+	}
+
+	void telemetry::SetHitchCallback(hitchcallback callback)
+	{
+		m_hitchCallback = callback;
+	}
+
+	int telemetry::FormatHitch(const hitchrecord& hitch, char *buffer, std::size_t size)
+	{
+		int written = std::snprintf(buffer, size, "Hitch in frame %llu: %.2f ms (median %.2f ms)",
+			static_cast<unsigned long long>(hitch.frame), hitch.seconds * 1000.0, hitch.medianSeconds * 1000.0);
+
+		for (std::uint32_t i = 0; i < hitch.scopeCount and written >= 0 and static_cast<std::size_t>(written) < size; i++)
+		{
+			written += std::snprintf(buffer + written, size - written, "%s %s %.2f ms", i ? "," : ":",
+				hitch.scopes[i].name, hitch.scopes[i].seconds * 1000.0);
+		}
+
+		// snprintf counts what it would have written, a line cut off at the end of the buffer counts only what is in it.
+		if (written > 0 and static_cast<std::size_t>(written) >= size)
+		{
+			written = size ? static_cast<int>(size - 1) : 0;
+		}
+		return written;
+	}
+
+	bool telemetry::WriteCsv(const char *path) const
+	{
+		std::ofstream file(path, std::ios::out | std::ios::trunc);
+		if (file.fail())
+		{
+			return false;
+		}
+
+		file << "frame,milliseconds";
+		for (const char *name : g_counterNames)
+		{
+			file << ',' << name;
+		}
+		file << '\n';
+
+		std::uint64_t first = m_frames > TELEMETRY_HISTORY_FRAMES ? m_frames - TELEMETRY_HISTORY_FRAMES : 0;
+		for (std::uint64_t i = first; i < m_frames; i++)
+		{
+			const framerecord& record = m_history[i % TELEMETRY_HISTORY_FRAMES];
+
+			file << record.frame << ',' << record.seconds * 1000.0;
+			for (std::uint64_t value : record.counters)
+			{
+				file << ',' << value;
+			}
+			file << '\n';
+		}
+
+		file.close();
+		return !file.fail();
+	}
+
+	framesummary telemetry::Summarize(const frametimehistogram& histogram)
+	{
+		framesummary summary;
+
+		summary.frames = histogram.Count();
+		summary.p50 = histogram.Percentile(0.50);
+		summary.p95 = histogram.Percentile(0.95);
+		summary.p99 = histogram.Percentile(0.99);
+		summary.max = histogram.Max();
+		summary.mean = histogram.Mean();
+
+		return summary;
+	}
+
+	// The scopes are taken from the profiler events of all threads that ended during the frame,
+	// time is summed up per scope name and the longest ones are kept.
+	// Nothing is found while the profiler is switched off, the hitch is still logged.
+	void telemetry::DetectHitch(const framerecord& record, std::uint64_t frameBegin, std::uint64_t frameEnd)
+	{
+		frametimehistogram rolling = m_windows[0];
+		rolling.Add(m_windows[1]);
+		if (rolling.Count() < MIN_FRAMES_FOR_HITCHES)
+		{
+			return;
+		}
+
+		double median = rolling.Percentile(0.5);
+		if (record.seconds < median * m_hitchFactor or record.seconds < m_minHitchSeconds)
+		{
+			return;
+		}
+
+		hitchrecord hitch;
+		hitch.frame = record.frame;
+		hitch.seconds = record.seconds;
+		hitch.medianSeconds = median;
+
+		struct total
+		{
+			const char *name;
+			std::uint64_t ticks;
+		};
+		total totals[32];
+		std::uint32_t totalCount = 0;
+
+		profiler::ForEachEvent(frameBegin, frameEnd, [&](const profilerevent& event)
+		{
+			std::uint32_t i = 0;
+			while (i < totalCount and totals[i].name != event.name)
+			{
+				i++;
+			}
+			if (i == totalCount)
+			{
+				if (totalCount == 32)
+				{
+					return;
+				}
+				totals[totalCount++] = total{ event.name, 0 };
+			}
+			totals[i].ticks += event.end - event.begin;
+		});
+
+		double secondsPerTick = 1.0 / profiler::TicksPerSecond();
+		while (hitch.scopeCount < TELEMETRY_HITCH_SCOPES and totalCount > 0)
+		{
+			std::uint32_t longest = 0;
+			for (std::uint32_t i = 1; i < totalCount; i++)
+			{
+				if (totals[i].ticks > totals[longest].ticks)
+				{
+					longest = i;
+				}
+			}
+
+			hitch.scopes[hitch.scopeCount++] = hitchrecord::scope{ totals[longest].name, static_cast<double>(totals[longest].ticks) * secondsPerTick };
+			totals[longest] = totals[--totalCount];
+		}
+
+		if (m_hitches.size() == TELEMETRY_MAX_HITCHES)
+		{
+			m_hitches.erase(m_hitches.begin());
+		}
+		m_hitches.push_back(hitch);
+
+		if (m_hitchCallback)
+		{
+			m_hitchCallback(hitch);
+		}
+	}
+}
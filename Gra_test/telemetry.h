@@ -0,0 +1,132 @@
+// telemetry.h : include file for frame time telemetry
+// The main loop reports the duration of every frame. The telemetry keeps
+//  - log-linear histograms of the frame times (like HdrHistogram: 32 linear buckets per power of two,
+//    so any reported value is within about 3% of the measured one) for the rolling window and since start,
+//  - the last frames with the counters that were counted during them,
+//  - a log of hitches, frames much longer than the median, with the profiler scopes that took the most time in them.
+// Counters are counted from anywhere (the draw code, the buffer uploads, the frame pipeline) through the static Count function
+// and are collected into the frame record when the frame ends.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace core
+{
+	constexpr std::uint32_t TELEMETRY_WINDOW_FRAMES{ 600 };
+	constexpr std::uint32_t TELEMETRY_HISTORY_FRAMES{ 4096 };
+	constexpr std::uint32_t TELEMETRY_MAX_HITCHES{ 64 };
+	constexpr std::uint32_t TELEMETRY_HITCH_SCOPES{ 5 };
+
+	enum class counter : std::uint32_t
+	{
+		drawcalls, triangles, statechanges, bytesuploaded, publishwaitmicroseconds, count
+	};
+
+	// Histogram of durations in microseconds from 1 us to a bit over a minute.
+	class frametimehistogram
+	{
+	public:
+		static constexpr std::uint32_t SUB_BUCKET_BITS{ 5 };
+		static constexpr std::uint32_t SUB_BUCKETS{ 1 << SUB_BUCKET_BITS };
+		static constexpr std::uint32_t MAX_EXPONENT{ 36 };
+		static constexpr std::uint32_t BUCKET_COUNT{ (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS };
+
+		void Record(double seconds);
+		void Add(const frametimehistogram& other);
+		void Reset();
+
+		// Percentile takes a fraction, 0.99 is the 99th percentile.
+		double Percentile(double fraction) const;
+		double Max() const;
+		double Mean() const;
+		std::uint64_t Count() const;
+	private:
+		static std::uint32_t BucketIndex(std::uint64_t microseconds);
+		static std::uint64_t BucketValue(std::uint32_t index);
+
+		std::uint64_t m_buckets[BUCKET_COUNT]{};
+		std::uint64_t m_count{};
+		std::uint64_t m_maxMicroseconds{};
+		double m_totalSeconds{};
+	};
+
+	struct framesummary
+	{
+		std::uint64_t frames{};
+		double p50{}, p95{}, p99{}, max{}, mean{};
+	};
+
+	struct framerecord
+	{
+		std::uint64_t frame{};
+		double seconds{};
+		std::uint64_t counters[static_cast<std::uint32_t>(counter::count)]{};
+	};
+
+	struct hitchrecord
+	{
+		struct scope
+		{
+			const char *name;
+			double seconds;
+		};
+
+		std::uint64_t frame{};
+		double seconds{};
+		double medianSeconds{};
+		std::uint32_t scopeCount{};
+		scope scopes[TELEMETRY_HITCH_SCOPES]{};
+	};
+
+	class telemetry
+	{
+	public:
+		typedef std::function<void(const hitchrecord& hitch)> hitchcallback;
+
+		// A frame is a hitch when it takes longer than hitchFactor times the rolling median
+		// and longer than minHitchSeconds, so tiny frames that vary a lot are not reported.
+		telemetry(double hitchFactor = 2.0, double minHitchSeconds = 0.02);
+		telemetry(const telemetry& other) = delete;
+		~telemetry() {};
+
+		telemetry& operator=(const telemetry& other) = delete;
+
+		static void Count(counter counted, std::uint64_t value);
+
+		// RecordFrame ends a frame, the counters are collected and reset for the next one.
+		void RecordFrame(double seconds);
+
+		// The rolling summary covers the current and the previous window of frames.
+		framesummary GetRollingSummary() const;
+		framesummary GetTotalSummary() const;
+		const framerecord* GetLastFrame() const;
+		const std::vector<hitchrecord>& GetHitches() const;
+		void SetHitchCallback(hitchcallback callback);
+
+		// FormatHitch writes a one line description of the hitch, it returns the number of characters written
+		// without the terminating zero, at most size - 1 when the line was cut off, negative on an encoding error.
+		static int FormatHitch(const hitchrecord& hitch, char *buffer, std::size_t size);
+
+		// WriteCsv writes the frames kept in the history, oldest first.
+		bool WriteCsv(const char *path) const;
+	private:
+		static framesummary Summarize(const frametimehistogram& histogram);
+		void DetectHitch(const framerecord& record, std::uint64_t frameBegin, std::uint64_t frameEnd);
+
+		static std::atomic<std::uint64_t> s_counters[static_cast<std::uint32_t>(counter::count)];
+
+		double m_hitchFactor;
+		double m_minHitchSeconds;
+		frametimehistogram m_windows[2]{};
+		frametimehistogram m_total{};
+		std::uint32_t m_currentWindow{};
+		std::vector<framerecord> m_history;
+		std::uint64_t m_frames{};
+		std::uint64_t m_lastTick{};
+		std::vector<hitchrecord> m_hitches{};
+		hitchcallback m_hitchCallback{};
+	};
+}
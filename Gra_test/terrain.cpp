@@ -0,0 +1,614 @@
+#include "stdafx.h"
+#include "terrain.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace graphics
+{
+	namespace
+	{
+		// Value noise: random values on the integer lattice, blended with a smooth step in between.
+		FLOAT LatticeValue(std::int32_t x, std::int32_t y, std::uint32_t seed)
+		{
+			std::uint32_t hash = static_cast<std::uint32_t>(x) * 0x8da6b343u ^ static_cast<std::uint32_t>(y) * 0xd8163841u ^ seed * 0xcb1ab31fu;
+			hash ^= hash >> 13;
+			hash *= 0x5bd1e995u;
+			hash ^= hash >> 15;
+			return static_cast<FLOAT>(hash >> 8) * (1.0f / 16777216.0f);
+		}
+
+		FLOAT ValueNoise(FLOAT x, FLOAT y, std::uint32_t seed)
+		{
+			FLOAT cellX = std::floor(x), cellY = std::floor(y);
+			FLOAT fx = x - cellX, fy = y - cellY;
+			std::int32_t ix = static_cast<std::int32_t>(cellX), iy = static_cast<std::int32_t>(cellY);
+
+			fx = fx * fx * (3.0f - 2.0f * fx);
+			fy = fy * fy * (3.0f - 2.0f * fy);
+
+			FLOAT bottom = LatticeValue(ix, iy, seed) + (LatticeValue(ix + 1, iy, seed) - LatticeValue(ix, iy, seed)) * fx;
+			FLOAT top = LatticeValue(ix, iy + 1, seed) + (LatticeValue(ix + 1, iy + 1, seed) - LatticeValue(ix, iy + 1, seed)) * fx;
+			return bottom + (top - bottom) * fy;
+		}
+
+		// Grass in the valleys, rock on the slopes of the hills and snow on the tops.
+		D3DXVECTOR4 TerrainColor(FLOAT height)
+		{
+			const FLOAT bands[3][3]{ { 0.22f, 0.42f, 0.16f }, { 0.45f, 0.38f, 0.30f }, { 0.92f, 0.92f, 0.95f } };
+			FLOAT position = (std::min)((std::max)(height, 0.0f), 1.0f) * 2.0f;
+			UINT band = (std::min)(static_cast<UINT>(position), 1u);
+			FLOAT t = position - static_cast<FLOAT>(band);
+
+			return D3DXVECTOR4(bands[band][0] + (bands[band + 1][0] - bands[band][0]) * t,
+				bands[band][1] + (bands[band + 1][1] - bands[band][1]) * t,
+				bands[band][2] + (bands[band + 1][2] - bands[band][2]) * t, 1.0f);
+		}
+	}
+
+	void BuildHeightmap(UINT size, std::uint32_t seed, std::uint16_t *heights)
+	{
+		constexpr UINT octaves = 6;
+		FLOAT baseFrequency = 4.0f / static_cast<FLOAT>(size);
+
+		for (UINT y = 0; y < size; y++)
+		{
+			for (UINT x = 0; x < size; x++)
+			{
+				FLOAT value = 0.0f, amplitude = 0.5f, total = 0.0f, frequency = baseFrequency;
+				for (UINT octave = 0; octave < octaves; octave++)
+				{
+					value += amplitude * ValueNoise(static_cast<FLOAT>(x) * frequency, static_cast<FLOAT>(y) * frequency, seed + octave);
+					total += amplitude;
+					amplitude *= 0.5f;
+					frequency *= 2.0f;
+				}
+
+				// The sum of the octaves gathers around one half, it is stretched back over the whole range.
+				value = (std::min)((std::max)((value / total - 0.5f) * 2.0f + 0.5f, 0.0f), 1.0f);
+				heights[y * size + x] = static_cast<std::uint16_t>(value * 65535.0f + 0.5f);
+			}
+		}
+	}
+
+	// C++14 needs a definition for constants that are bound to references, like the one assign takes.
+	constexpr UINT terrain::INVALID_SLOT;
+	constexpr UINT terrain::INVALID_NODE;
+
+	terrain::terrain(core::jobsystem& jobs, const std::uint16_t *heights, UINT size, const terrainsettings& settings) :
+		m_jobs(jobs), m_size(size), m_settings(settings)
+	{
+		UINT rootChunks = size > 1 and (size - 1) % TERRAIN_CHUNK_QUADS == 0 ? (size - 1) / TERRAIN_CHUNK_QUADS : 0;
+		if (!heights or rootChunks == 0 or (rootChunks & (rootChunks - 1)) != 0 or settings.spacing <= 0.0f)
+		{
+			throw "Incorrect terrain heightmap.";
+		}
+
+		UINT slotCount = static_cast<UINT>(settings.memoryBudget / (TERRAIN_CHUNK_VERTICES * sizeof(colorvertex)));
+		if (slotCount == 0)
+		{
+			throw "Terrain memory budget too small.";
+		}
+
+		m_heights.assign(heights, heights + static_cast<size_t>(size) * size);
+
+		for (m_levels = 1; (1u << (m_levels - 1)) < rootChunks; m_levels++)
+		{
+		}
+
+		UINT nodeCount = 0;
+		for (UINT level = 0; level < m_levels; level++)
+		{
+			m_levelOffsets.push_back(nodeCount);
+			nodeCount += 1u << (2 * level);
+		}
+		m_nodes.resize(nodeCount);
+		m_slots.assign(slotCount, INVALID_NODE);
+
+		for (streamjob& job : m_streaming)
+		{
+			job.vertices.resize(TERRAIN_CHUNK_VERTICES);
+		}
+
+		ComputeBounds();
+		BuildIndices();
+
+		// The root is built right away, the first Update hands it over like any chunk that finished loading.
+		BuildChunk(0, 0, 0, m_streaming[0].vertices.data());
+		m_streaming[0].node = 0;
+		m_nodes[0].state = chunkstate::loading;
+	}
+
+	terrain::~terrain()
+	{
+		Flush();
+	}
+
+	void terrain::Update(const D3DXVECTOR3& cameraPosition, FLOAT pixelScale)
+	{
+		PROFILE_SCOPE("terrain::Update");
+
+		m_frame++;
+		m_uploads.clear();
+
+		SelectWanted(cameraPosition, pixelScale);
+		GatherRequests(cameraPosition);
+		CollectLoads();
+		StartLoads();
+		BuildDraws();
+	}
+
+	void terrain::Flush()
+	{
+		for (streamjob& job : m_streaming)
+		{
+			if (job.node != INVALID_NODE and !job.handedOver)
+			{
+				m_jobs.Wait(job.done);
+			}
+		}
+	}
+
+	const std::vector<terrain::upload>& terrain::GetUploads() const
+	{
+		return m_uploads;
+	}
+
+	const std::vector<terrain::draw>& terrain::GetDraws() const
+	{
+		return m_draws;
+	}
+
+	const std::vector<std::uint32_t>& terrain::GetIndices() const
+	{
+		return m_indices;
+	}
+
+	terrain::indexrange terrain::GetStitchRange(UINT stitch) const
+	{
+		return m_stitchRanges[stitch];
+	}
+
+	UINT terrain::GetSlotCount() const
+	{
+		return static_cast<UINT>(m_slots.size());
+	}
+
+	UINT terrain::GetLevelCount() const
+	{
+		return m_levels;
+	}
+
+	terrainstats terrain::GetStats() const
+	{
+		terrainstats stats{};
+
+		for (UINT node : m_slots)
+		{
+			stats.residentChunks += node != INVALID_NODE;
+		}
+		for (const streamjob& job : m_streaming)
+		{
+			stats.loadingChunks += job.node != INVALID_NODE and !job.handedOver;
+		}
+		stats.drawnChunks = static_cast<UINT>(m_draws.size());
+		stats.loadedChunks = m_loaded;
+		stats.evictedChunks = m_evicted;
+
+		return stats;
+	}
+
+	// The shading comes from the slope of the full heightmap, not of the chunk,
+	// so neighbouring chunks of different levels have the same colors along their edges.
+	void terrain::BuildChunk(UINT level, UINT x, UINT y, colorvertex *vertices) const
+	{
+		const FLOAT light[3]{ 0.42f, 0.82f, 0.38f };
+		UINT step = ((m_size - 1) >> level) / TERRAIN_CHUNK_QUADS;
+		UINT firstX = x * step * TERRAIN_CHUNK_QUADS, firstY = y * step * TERRAIN_CHUNK_QUADS;
+
+		for (UINT row = 0; row <= TERRAIN_CHUNK_QUADS; row++)
+		{
+			for (UINT column = 0; column <= TERRAIN_CHUNK_QUADS; column++)
+			{
+				UINT sampleX = firstX + column * step, sampleY = firstY + row * step;
+				FLOAT height = GetSampleHeight(sampleX, sampleY);
+				FLOAT slopeX = GetSampleHeight(sampleX > 0 ? sampleX - 1 : sampleX, sampleY) - GetSampleHeight((std::min)(sampleX + 1, m_size - 1), sampleY);
+				FLOAT slopeZ = GetSampleHeight(sampleX, sampleY > 0 ? sampleY - 1 : sampleY) - GetSampleHeight(sampleX, (std::min)(sampleY + 1, m_size - 1));
+				FLOAT normalY = 2.0f * m_settings.spacing;
+				FLOAT length = std::sqrt(slopeX * slopeX + normalY * normalY + slopeZ * slopeZ);
+				FLOAT lit = (std::max)((slopeX * light[0] + normalY * light[1] + slopeZ * light[2]) / length, 0.0f);
+				FLOAT shade = 0.35f + 0.65f * lit;
+
+				colorvertex& vertex = vertices[row * (TERRAIN_CHUNK_QUADS + 1) + column];
+				vertex.position = D3DXVECTOR3(m_settings.origin.x + static_cast<FLOAT>(sampleX) * m_settings.spacing, height,
+					m_settings.origin.z + static_cast<FLOAT>(sampleY) * m_settings.spacing);
+				vertex.color = TerrainColor((height - m_settings.origin.y) / m_settings.heightScale);
+				vertex.color.x *= shade;
+				vertex.color.y *= shade;
+				vertex.color.z *= shade;
+			}
+		}
+	}
+
+	UINT terrain::GetNode(UINT level, UINT x, UINT y) const
+	{
+		return m_levelOffsets[level] + (y << level) + x;
+	}
+
+	FLOAT terrain::GetSampleHeight(UINT x, UINT y) const
+	{
+		return m_settings.origin.y + static_cast<FLOAT>(m_heights[y * m_size + x]) * (m_settings.heightScale / 65535.0f);
+	}
+
+	// Distance from the camera to the box around the node, zero inside it.
+	FLOAT terrain::GetDistance(UINT level, UINT x, UINT y, const D3DXVECTOR3& cameraPosition) const
+	{
+		const node& current = m_nodes[GetNode(level, x, y)];
+		FLOAT extent = static_cast<FLOAT>((m_size - 1) >> level) * m_settings.spacing;
+		FLOAT minX = m_settings.origin.x + static_cast<FLOAT>(x) * extent, minZ = m_settings.origin.z + static_cast<FLOAT>(y) * extent;
+
+		FLOAT dx = (std::max)((std::max)(minX - cameraPosition.x, cameraPosition.x - minX - extent), 0.0f);
+		FLOAT dy = (std::max)((std::max)(current.minHeight - cameraPosition.y, cameraPosition.y - current.maxHeight), 0.0f);
+		FLOAT dz = (std::max)((std::max)(minZ - cameraPosition.z, cameraPosition.z - minZ - extent), 0.0f);
+		return std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
+
+	// The error of a node is the largest difference between a heightmap sample and the node's mesh at that point,
+	// taken as the bilinear blend of the four mesh vertices around it. A node's error is at least that of its children,
+	// so the error only ever grows towards the root and splitting stops at the same place from every side.
+	void terrain::ComputeBounds()
+	{
+		PROFILE_SCOPE("terrain::ComputeBounds");
+
+		for (UINT level = 0; level < m_levels; level++)
+		{
+			UINT side = 1u << level;
+			UINT step = ((m_size - 1) >> level) / TERRAIN_CHUNK_QUADS;
+
+			m_jobs.ParallelFor(side * side, 1, [this, level, side, step](std::uint32_t begin, std::uint32_t end)
+			{
+				for (std::uint32_t index = begin; index < end; index++)
+				{
+					UINT firstX = (index % side) * step * TERRAIN_CHUNK_QUADS, firstY = (index / side) * step * TERRAIN_CHUNK_QUADS;
+					node& current = m_nodes[m_levelOffsets[level] + index];
+					FLOAT error = 0.0f, lowest = GetSampleHeight(firstX, firstY), highest = lowest;
+
+					for (UINT y = 0; y <= step * TERRAIN_CHUNK_QUADS; y++)
+					{
+						UINT cellY = (std::min)(y / step, TERRAIN_CHUNK_QUADS - 1);
+						FLOAT fy = static_cast<FLOAT>(y - cellY * step) / static_cast<FLOAT>(step);
+
+						for (UINT x = 0; x <= step * TERRAIN_CHUNK_QUADS; x++)
+						{
+							UINT cellX = (std::min)(x / step, TERRAIN_CHUNK_QUADS - 1);
+							FLOAT fx = static_cast<FLOAT>(x - cellX * step) / static_cast<FLOAT>(step);
+							UINT left = firstX + cellX * step, bottom = firstY + cellY * step;
+
+							FLOAT lower = GetSampleHeight(left, bottom) + (GetSampleHeight(left + step, bottom) - GetSampleHeight(left, bottom)) * fx;
+							FLOAT upper = GetSampleHeight(left, bottom + step) + (GetSampleHeight(left + step, bottom + step) - GetSampleHeight(left, bottom + step)) * fx;
+							FLOAT height = GetSampleHeight(firstX + x, firstY + y);
+
+							error = (std::max)(error, std::fabs(height - (lower + (upper - lower) * fy)));
+							lowest = (std::min)(lowest, height);
+							highest = (std::max)(highest, height);
+						}
+					}
+
+					current.error = error;
+					current.minHeight = lowest;
+					current.maxHeight = highest;
+				}
+			});
+		}
+
+		for (UINT level = m_levels - 1; level > 0; level--)
+		{
+			UINT side = 1u << level;
+			for (UINT y = 0; y < side; y++)
+			{
+				for (UINT x = 0; x < side; x++)
+				{
+					node& parent = m_nodes[GetNode(level - 1, x / 2, y / 2)];
+					parent.error = (std::max)(parent.error, m_nodes[GetNode(level, x, y)].error);
+				}
+			}
+		}
+	}
+
+	// A vertex at an odd position on an edge next to a coarser node has no partner on the other side,
+	// it is replaced by the vertex before it. The two quads along the edge then collapse into a fan
+	// over the coarse edge, the triangles that became degenerate are left out.
+	void terrain::BuildIndices()
+	{
+		constexpr UINT row = TERRAIN_CHUNK_QUADS + 1;
+
+		for (UINT stitch = 0; stitch < TERRAIN_STITCH_VARIANTS; stitch++)
+		{
+			auto vertex = [stitch](UINT column, UINT line) -> std::uint32_t
+			{
+				if (((stitch & westedge and column == 0) or (stitch & eastedge and column == TERRAIN_CHUNK_QUADS)) and (line & 1))
+				{
+					line--;
+				}
+				if (((stitch & southedge and line == 0) or (stitch & northedge and line == TERRAIN_CHUNK_QUADS)) and (column & 1))
+				{
+					column--;
+				}
+				return static_cast<std::uint32_t>(line * row + column);
+			};
+
+			m_stitchRanges[stitch].startIndex = static_cast<UINT>(m_indices.size());
+
+			for (UINT line = 0; line < TERRAIN_CHUNK_QUADS; line++)
+			{
+				for (UINT column = 0; column < TERRAIN_CHUNK_QUADS; column++)
+				{
+					// Clockwise seen from above like the rest of the geometry.
+					std::uint32_t corners[4]{ vertex(column, line), vertex(column, line + 1), vertex(column + 1, line + 1), vertex(column + 1, line) };
+					const UINT triangles[2][3]{ { 0, 1, 2 }, { 0, 2, 3 } };
+
+					for (const UINT (&triangle)[3] : triangles)
+					{
+						std::uint32_t a = corners[triangle[0]], b = corners[triangle[1]], c = corners[triangle[2]];
+						if (a != b and b != c and a != c)
+						{
+							m_indices.push_back(a);
+							m_indices.push_back(b);
+							m_indices.push_back(c);
+						}
+					}
+				}
+			}
+
+			m_stitchRanges[stitch].indexCount = static_cast<UINT>(m_indices.size()) - m_stitchRanges[stitch].startIndex;
+		}
+	}
+
+	// Top down the nodes whose error is too large are marked, only below marked nodes.
+	// Bottom up a marked node then marks its parent and the parents of its neighbours,
+	// so every node next to a marked one exists in the tree and no two leaves next to each other
+	// are more than one level apart.
+	void terrain::SelectWanted(const D3DXVECTOR3& cameraPosition, FLOAT pixelScale)
+	{
+		for (UINT level = 0; level < m_levels; level++)
+		{
+			UINT side = 1u << level;
+			for (UINT y = 0; y < side; y++)
+			{
+				for (UINT x = 0; x < side; x++)
+				{
+					node& current = m_nodes[GetNode(level, x, y)];
+					bool inTree = level == 0 or m_nodes[GetNode(level - 1, x / 2, y / 2)].wanted;
+
+					current.wanted = inTree and level + 1 < m_levels and
+						current.error * pixelScale > m_settings.pixelError * (std::max)(GetDistance(level, x, y, cameraPosition), m_settings.spacing);
+				}
+			}
+		}
+
+		for (UINT level = m_levels - 1; level > 0; level--)
+		{
+			UINT side = 1u << level;
+			for (UINT y = 0; y < side; y++)
+			{
+				for (UINT x = 0; x < side; x++)
+				{
+					if (!m_nodes[GetNode(level, x, y)].wanted)
+					{
+						continue;
+					}
+
+					m_nodes[GetNode(level - 1, x / 2, y / 2)].wanted = true;
+					if (x > 0) m_nodes[GetNode(level - 1, (x - 1) / 2, y / 2)].wanted = true;
+					if (x + 1 < side) m_nodes[GetNode(level - 1, (x + 1) / 2, y / 2)].wanted = true;
+					if (y > 0) m_nodes[GetNode(level - 1, x / 2, (y - 1) / 2)].wanted = true;
+					if (y + 1 < side) m_nodes[GetNode(level - 1, x / 2, (y + 1) / 2)].wanted = true;
+				}
+			}
+		}
+	}
+
+	// Every node of the wanted tree is kept, the split ones as well: they are drawn while
+	// their children load and when the camera moves away again.
+	// Missing chunks load coarse first and near first within a level.
+	void terrain::GatherRequests(const D3DXVECTOR3& cameraPosition)
+	{
+		m_requests.clear();
+
+		for (UINT level = 0; level < m_levels; level++)
+		{
+			UINT side = 1u << level;
+			for (UINT y = 0; y < side; y++)
+			{
+				for (UINT x = 0; x < side; x++)
+				{
+					UINT index = GetNode(level, x, y);
+					node& current = m_nodes[index];
+
+					if (level > 0 and !m_nodes[GetNode(level - 1, x / 2, y / 2)].wanted)
+					{
+						continue;
+					}
+
+					current.lastUsed = m_frame;
+					if (current.state == chunkstate::unloaded)
+					{
+						m_requests.push_back(request{ level, GetDistance(level, x, y, cameraPosition), index });
+					}
+				}
+			}
+		}
+
+		std::sort(m_requests.begin(), m_requests.end(), [](const request& a, const request& b)
+		{
+			return a.level < b.level or (a.level == b.level and a.distance < b.distance);
+		});
+	}
+
+	// The vertices of the chunks handed over last time are no longer needed, their jobs are free again.
+	// A finished chunk waits in its job until a slot can be found for it.
+	void terrain::CollectLoads()
+	{
+		for (streamjob& job : m_streaming)
+		{
+			if (job.handedOver)
+			{
+				job.node = INVALID_NODE;
+				job.handedOver = false;
+			}
+		}
+
+		for (streamjob& job : m_streaming)
+		{
+			if (job.node == INVALID_NODE or !job.done.IsDone())
+			{
+				continue;
+			}
+
+			UINT slot = AcquireSlot();
+			if (slot == INVALID_SLOT)
+			{
+				break;
+			}
+
+			node& loaded = m_nodes[job.node];
+			loaded.state = chunkstate::resident;
+			loaded.slot = slot;
+			m_slots[slot] = job.node;
+			m_uploads.push_back(upload{ slot, job.vertices.data() });
+			job.handedOver = true;
+			m_loaded++;
+		}
+	}
+
+	void terrain::StartLoads()
+	{
+		UINT next = 0;
+
+		for (streamjob& job : m_streaming)
+		{
+			if (job.node != INVALID_NODE)
+			{
+				continue;
+			}
+			if (next == m_requests.size())
+			{
+				break;
+			}
+
+			UINT index = m_requests[next].node;
+			UINT level = m_requests[next++].level;
+			UINT side = 1u << level;
+			UINT x = (index - m_levelOffsets[level]) % side, y = (index - m_levelOffsets[level]) / side;
+			streamjob *target = &job;
+
+			m_nodes[index].state = chunkstate::loading;
+			job.node = index;
+			m_jobs.Run([this, target, level, x, y]()
+			{
+				BuildChunk(level, x, y, target->vertices.data());
+			}, &job.done);
+		}
+	}
+
+	// Top down a wanted node is split when all its children are loaded and the neighbours it has on its level exist,
+	// a node that is not loaded is split whenever it can be so its children stand in for it.
+	// A leaf borders a coarser node where the parent of its neighbour is not split.
+	void terrain::BuildDraws()
+	{
+		m_draws.clear();
+
+		for (UINT level = 0; level < m_levels; level++)
+		{
+			UINT side = 1u << level;
+			for (UINT y = 0; y < side; y++)
+			{
+				for (UINT x = 0; x < side; x++)
+				{
+					node& current = m_nodes[GetNode(level, x, y)];
+					current.split = false;
+
+					if (level > 0 and !m_nodes[GetNode(level - 1, x / 2, y / 2)].split)
+					{
+						continue;
+					}
+
+					auto neighbourExists = [this, level, x, y](INT dx, INT dy)
+					{
+						UINT neighbourX = static_cast<UINT>(static_cast<INT>(x) + dx), neighbourY = static_cast<UINT>(static_cast<INT>(y) + dy);
+						return level == 0 or m_nodes[GetNode(level - 1, neighbourX / 2, neighbourY / 2)].split;
+					};
+
+					bool split = level + 1 < m_levels and (current.wanted or current.state != chunkstate::resident);
+					for (UINT child = 0; split and child < 4; child++)
+					{
+						split = m_nodes[GetNode(level + 1, 2 * x + (child & 1), 2 * y + (child >> 1))].state == chunkstate::resident;
+					}
+					split = split and (x == 0 or neighbourExists(-1, 0)) and (x + 1 == side or neighbourExists(1, 0))
+						and (y == 0 or neighbourExists(0, -1)) and (y + 1 == side or neighbourExists(0, 1));
+					current.split = split;
+
+					if (split or current.state != chunkstate::resident)
+					{
+						continue;
+					}
+
+					UINT stitch = 0;
+					if (x > 0 and !neighbourExists(-1, 0))
+					{
+						stitch |= westedge;
+					}
+					if (x + 1 < side and !neighbourExists(1, 0))
+					{
+						stitch |= eastedge;
+					}
+					if (y > 0 and !neighbourExists(0, -1))
+					{
+						stitch |= southedge;
+					}
+					if (y + 1 < side and !neighbourExists(0, 1))
+					{
+						stitch |= northedge;
+					}
+
+					current.lastUsed = m_frame;
+					m_draws.push_back(draw{ current.slot, stitch });
+				}
+			}
+		}
+	}
+
+	// A free slot, or the one of the chunk used the longest time ago. The root is never taken, and neither are
+	// chunks used this frame or the one before: the draws of this frame are only picked after the loads
+	// are collected, a chunk drawn last frame may still have to stand in for one that is missing.
+	UINT terrain::AcquireSlot()
+	{
+		UINT oldest = INVALID_SLOT;
+
+		for (UINT slot = 0; slot < m_slots.size(); slot++)
+		{
+			if (m_slots[slot] == INVALID_NODE)
+			{
+				return slot;
+			}
+
+			const node& candidate = m_nodes[m_slots[slot]];
+			if (m_slots[slot] != 0 and candidate.lastUsed + 1 < m_frame
+				and (oldest == INVALID_SLOT or candidate.lastUsed < m_nodes[m_slots[oldest]].lastUsed))
+			{
+				oldest = slot;
+			}
+		}
+
+		if (oldest != INVALID_SLOT)
+		{
+			node& evicted = m_nodes[m_slots[oldest]];
+			evicted.state = chunkstate::unloaded;
+			evicted.slot = INVALID_SLOT;
+			m_slots[oldest] = INVALID_NODE;
+			m_evicted++;
+		}
+
+		return oldest;
+	}
+}
@@ -0,0 +1,180 @@
+// terrain.h : include file for the streamed heightmap terrain
+// The heightmap is split by a quadtree: the root covers the whole map, every level halves the nodes along both axes.
+// Every node has a mesh of the same TERRAIN_CHUNK_QUADS squared quads, so nodes deeper in the tree are finer.
+// Once per frame the terrain picks the nodes to draw:
+//  - a node is split when the largest height error of its mesh, projected to the screen at its distance
+//    from the camera, is over the tolerated number of pixels,
+//  - the split nodes are then grown until neighbouring nodes are at most one level apart,
+//  - a node is only split when its children are loaded, until then it is drawn itself.
+// Where a node borders a coarser one, its mesh is drawn with indices that skip every other vertex
+// along that edge, so both sides of the edge are the same line and there are no cracks.
+// Chunk meshes are built from the 16-bit heightmap by jobs in the background and handed to the renderer
+// through GetUploads. They live in a fixed number of slots given by the memory budget; when all are taken
+// the chunk used the longest time ago is evicted. The root is never evicted, so there is always something to draw.
+// The terrain never touches the device, see chunkbuffer.h for the GPU side.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+#include "meshdata.h"
+
+namespace graphics
+{
+	constexpr UINT TERRAIN_CHUNK_QUADS{ 32 };
+	constexpr UINT TERRAIN_CHUNK_VERTICES{ (TERRAIN_CHUNK_QUADS + 1) * (TERRAIN_CHUNK_QUADS + 1) };
+	// Chunk meshes built at the same time, also the most chunks handed to the renderer per frame.
+	constexpr UINT TERRAIN_STREAMING_JOBS{ 4 };
+	// One index variant for every combination of the edges that border a coarser node.
+	constexpr UINT TERRAIN_STITCH_VARIANTS{ 16 };
+
+	// Edges of a node along the x and z axes, the bits of a stitch variant.
+	enum terrainedge : UINT
+	{
+		westedge = 1, eastedge = 2, southedge = 4, northedge = 8
+	};
+
+	// The heightmap sample (0, 0) is at the origin, the samples are spacing apart along x and z.
+	// A sample of 65535 is heightScale above the origin.
+	struct terrainsettings
+	{
+		D3DXVECTOR3 origin;
+		FLOAT spacing;
+		FLOAT heightScale;
+		FLOAT pixelError;
+		UINT64 memoryBudget;
+	};
+
+	struct terrainstats
+	{
+		UINT residentChunks{};
+		UINT loadingChunks{};
+		UINT drawnChunks{};
+		UINT64 loadedChunks{};
+		UINT64 evictedChunks{};
+	};
+
+	// BuildHeightmap fills size * size samples with rolling hills of a few octaves of value noise.
+	void BuildHeightmap(UINT size, std::uint32_t seed, std::uint16_t *heights);
+
+	class terrain
+	{
+	public:
+		static constexpr UINT INVALID_SLOT{ 0xffffffff };
+
+		// A chunk mesh that finished loading, the vertices stay valid until the next Update.
+		struct upload
+		{
+			UINT slot;
+			const colorvertex *vertices;
+		};
+
+		// A chunk to draw: the vertices of the slot with the indices of the stitch variant.
+		struct draw
+		{
+			UINT slot;
+			UINT stitch;
+		};
+
+		struct indexrange
+		{
+			UINT startIndex;
+			UINT indexCount;
+		};
+
+		terrain() = delete;
+		// The heightmap has size * size samples, size - 1 has to be TERRAIN_CHUNK_QUADS times a power of two.
+		// The budget has to hold at least the root chunk.
+		terrain(core::jobsystem& jobs, const std::uint16_t *heights, UINT size, const terrainsettings& settings);
+		terrain(const terrain& other) = delete;
+		~terrain();
+
+		terrain& operator=(const terrain& other) = delete;
+
+		// Update hands over the chunks that finished loading, picks the chunks to draw from the camera position
+		// and starts loading the ones that are missing. The pixel scale is the number of pixels an error of one
+		// unit covers at a distance of one unit, the viewport height divided by twice the tangent of half the field of view.
+		void Update(const D3DXVECTOR3& cameraPosition, FLOAT pixelScale);
+		// Flush waits for the chunks being loaded, the next Update hands them over.
+		void Flush();
+
+		const std::vector<upload>& GetUploads() const;
+		const std::vector<draw>& GetDraws() const;
+
+		// The indices of all stitch variants, drawn with the first vertex of a slot as base vertex.
+		const std::vector<std::uint32_t>& GetIndices() const;
+		indexrange GetStitchRange(UINT stitch) const;
+		UINT GetSlotCount() const;
+		UINT GetLevelCount() const;
+		terrainstats GetStats() const;
+
+		// BuildChunk writes the TERRAIN_CHUNK_VERTICES vertices of the node at x, y of the level in world space.
+		// It only reads the heightmap and can run on any thread.
+		void BuildChunk(UINT level, UINT x, UINT y, colorvertex *vertices) const;
+	private:
+		static constexpr UINT INVALID_NODE{ 0xffffffff };
+
+		enum class chunkstate : std::uint8_t
+		{
+			unloaded, loading, resident
+		};
+
+		struct node
+		{
+			FLOAT error{};
+			FLOAT minHeight{}, maxHeight{};
+			UINT slot{ INVALID_SLOT };
+			UINT64 lastUsed{};
+			chunkstate state{};
+			bool wanted{};
+			bool split{};
+		};
+
+		struct request
+		{
+			UINT level;
+			FLOAT distance;
+			UINT node;
+		};
+
+		struct streamjob
+		{
+			core::jobcounter done;
+			UINT node{ INVALID_NODE };
+			bool handedOver{};
+			std::vector<colorvertex> vertices;
+		};
+
+		UINT GetNode(UINT level, UINT x, UINT y) const;
+		FLOAT GetSampleHeight(UINT x, UINT y) const;
+		FLOAT GetDistance(UINT level, UINT x, UINT y, const D3DXVECTOR3& cameraPosition) const;
+		void ComputeBounds();
+		void BuildIndices();
+		void SelectWanted(const D3DXVECTOR3& cameraPosition, FLOAT pixelScale);
+		void GatherRequests(const D3DXVECTOR3& cameraPosition);
+		void CollectLoads();
+		void StartLoads();
+		void BuildDraws();
+		UINT AcquireSlot();
+
+		core::jobsystem& m_jobs;
+		std::vector<std::uint16_t> m_heights{};
+		UINT m_size{};
+		UINT m_levels{};
+		terrainsettings m_settings{};
+		// The nodes level after level, x changing fastest.
+		std::vector<node> m_nodes{};
+		std::vector<UINT> m_levelOffsets{};
+		std::vector<std::uint32_t> m_indices{};
+		indexrange m_stitchRanges[TERRAIN_STITCH_VARIANTS]{};
+		// The node in every slot, INVALID_NODE for slots that are free.
+		std::vector<UINT> m_slots{};
+		streamjob m_streaming[TERRAIN_STREAMING_JOBS];
+		// Working lists kept so a frame does not allocate.
+		std::vector<upload> m_uploads{};
+		std::vector<draw> m_draws{};
+		std::vector<request> m_requests{};
+		UINT64 m_frame{};
+		UINT64 m_loaded{}, m_evicted{};
+	};
+}
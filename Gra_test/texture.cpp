@@ -0,0 +1,114 @@
+#include "stdafx.h"
+#include "texture.h"
+#include "memorytracker.h"
+#include "telemetry.h"
+#include <vector>
+
+namespace graphics
+{
+	DXGI_FORMAT GetTextureFormat(textureformat format, bool srgb)
+	{
+		switch (format)
+		{
+		case textureformat::bc1:
+			return srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+		case textureformat::bc3:
+			return srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+		default:
+			return srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+		}
+	}
+
+	texture::texture(ID3D11Device *dev, const cookedtexture& cooked) :
+		m_width(cooked.width), m_height(cooked.height), m_size(cooked.data.size())
+	{
+		D3D11_TEXTURE2D_DESC textureDesc{};
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc{};
+		std::vector<D3D11_SUBRESOURCE_DATA> mipData(cooked.mips.size());
+		HRESULT result;
+
+		if (!dev or cooked.mips.empty() or cooked.width == 0 or cooked.height == 0)
+		{
+			throw "Incorrect texture parameters.";
+		}
+		if (cooked.format != textureformat::rgba8 and (cooked.width % 4 != 0 or cooked.height % 4 != 0))
+		{
+			throw "Block compressed textures need sizes that are multiples of 4.";
+		}
+
+		for (std::size_t i = 0; i < cooked.mips.size(); i++)
+		{
+			mipData[i].pSysMem = &cooked.data[cooked.mips[i].offset];
+			mipData[i].SysMemPitch = cooked.mips[i].rowPitch;
+			mipData[i].SysMemSlicePitch = cooked.mips[i].size;
+		}
+
+		textureDesc.Width = cooked.width;
+		textureDesc.Height = cooked.height;
+		textureDesc.MipLevels = static_cast<UINT>(cooked.mips.size());
+		textureDesc.ArraySize = 1;
+		textureDesc.Format = GetTextureFormat(cooked.format, cooked.srgb);
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.SampleDesc.Quality = 0;
+		textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		textureDesc.CPUAccessFlags = 0;
+		textureDesc.MiscFlags = 0;
+
+		result = dev->CreateTexture2D(&textureDesc, mipData.data(), &m_texture);
+		if (FAILED(result))
+		{
+			throw "Unable to create the texture.";
+		}
+
+		viewDesc.Format = textureDesc.Format;
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		viewDesc.Texture2D.MostDetailedMip = 0;
+		viewDesc.Texture2D.MipLevels = textureDesc.MipLevels;
+
+		result = dev->CreateShaderResourceView(m_texture, &viewDesc, &m_view);
+		if (FAILED(result))
+		{
+			m_texture->Release();
+			m_texture = nullptr;
+			throw "Unable to create the texture view.";
+		}
+
+		core::memorytracker::Allocated(core::memorytag::textures, m_size);
+		core::telemetry::Count(core::counter::bytesuploaded, m_size);
+	}
+
+	texture::~texture()
+	{
+		core::memorytracker::Freed(core::memorytag::textures, m_size);
+
+		if (m_view)
+		{
+			m_view->Release();
+			m_view = nullptr;
+		}
+
+		if (m_texture)
+		{
+			m_texture->Release();
+			m_texture = nullptr;
+		}
+	}
+
+	void texture::Bind(ID3D11DeviceContext *devcon, UINT slot)
+	{
+		devcon->PSSetShaderResources(slot, 1, &m_view);
+
+		core::telemetry::Count(core::counter::statechanges, 1);
+	}
+
+	UINT texture::GetWidth() const
+	{
+		return m_width;
+	}
+
+	UINT texture::GetHeight() const
+	{
+		return m_height;
+	}
+}
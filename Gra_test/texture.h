@@ -0,0 +1,37 @@
+// texture.h : include file for textures created from cooked data
+// A texture is immutable: all mips of the cooked texture (see texturecook.h) are handed to the device
+// as the initial data when it is created, straight from the cooked buffer with the cooked row pitches.
+// sRGB textures are created with an sRGB format so sampling returns linear values.
+#pragma once
+
+#include <d3d11.h>
+#include "texturecook.h"
+
+namespace graphics
+{
+	// The format a cooked texture is created with, sRGB ones are sampled as linear values.
+	DXGI_FORMAT GetTextureFormat(textureformat format, bool srgb);
+
+	class texture
+	{
+	public:
+		texture() = delete;
+		// Block compressed textures need a width and height that are multiples of 4.
+		texture(ID3D11Device *dev, const cookedtexture& cooked);
+		texture(const texture& other) = delete;
+		~texture();
+
+		texture& operator=(const texture& other) = delete;
+
+		// Bind puts the texture on a pixel shader slot.
+		void Bind(ID3D11DeviceContext *devcon, UINT slot);
+
+		UINT GetWidth() const;
+		UINT GetHeight() const;
+	private:
+		ID3D11Texture2D *m_texture{};
+		ID3D11ShaderResourceView *m_view{};
+		UINT m_width{}, m_height{};
+		UINT64 m_size{};
+	};
+}
@@ -0,0 +1,458 @@
+#include "stdafx.h"
+#include "texturecook.h"
+#include "blockcompression.h"
+#include "profiler.h"
+#include "simdmath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+
+namespace graphics
+{
+	namespace
+	{
+		constexpr char TEXTURE_MAGIC[4]{ 'G', 'R', 'A', 'T' };
+		// Linear values are looked up with 12 bits, enough that every sRGB value has its own entries.
+		constexpr UINT LINEAR_STEPS{ 4096 };
+		constexpr UINT MAX_MIPS{ 32 };
+		constexpr UINT HEADER_VALUES{ 7 };
+		constexpr UINT MIP_VALUES{ 5 };
+
+		struct gammatables
+		{
+			FLOAT toLinear[256];
+			std::uint8_t toSRGB[LINEAR_STEPS];
+
+			gammatables()
+			{
+				for (UINT i = 0; i < 256; i++)
+				{
+					FLOAT value = i / 255.0f;
+					toLinear[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+				}
+				for (UINT i = 0; i < LINEAR_STEPS; i++)
+				{
+					FLOAT value = i / static_cast<FLOAT>(LINEAR_STEPS - 1);
+					FLOAT encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+					toSRGB[i] = static_cast<std::uint8_t>(encoded * 255.0f + 0.5f);
+				}
+			}
+		};
+
+		const gammatables g_gamma;
+
+		UINT GetMipCount(UINT width, UINT height)
+		{
+			UINT count = 1;
+			for (UINT size = (std::max)(width, height); size > 1; size /= 2)
+			{
+				count++;
+			}
+			return count;
+		}
+
+		// Alpha is never gamma encoded.
+		void ToFloat(const std::uint8_t *pixel, bool srgb, FLOAT *value)
+		{
+			for (UINT channel = 0; channel < 3; channel++)
+			{
+				value[channel] = srgb ? g_gamma.toLinear[pixel[channel]] : pixel[channel] / 255.0f;
+			}
+			value[3] = pixel[3] / 255.0f;
+		}
+
+		void ToBytes(const FLOAT *value, bool srgb, std::uint8_t *pixel)
+		{
+			for (UINT channel = 0; channel < 4; channel++)
+			{
+				FLOAT clamped = (std::min)((std::max)(value[channel], 0.0f), 1.0f);
+				pixel[channel] = srgb and channel < 3
+					? g_gamma.toSRGB[static_cast<UINT>(clamped * (LINEAR_STEPS - 1) + 0.5f)]
+					: static_cast<std::uint8_t>(clamped * 255.0f + 0.5f);
+			}
+		}
+
+		void PutUint32(std::vector<std::uint8_t>& bytes, std::uint32_t value)
+		{
+			for (UINT i = 0; i < 4; i++)
+			{
+				bytes.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+			}
+		}
+
+		std::uint32_t GetUint32(const std::uint8_t *data)
+		{
+			return static_cast<std::uint32_t>(data[0]) | static_cast<std::uint32_t>(data[1]) << 8
+				| static_cast<std::uint32_t>(data[2]) << 16 | static_cast<std::uint32_t>(data[3]) << 24;
+		}
+
+		UINT GetBlockBytes(textureformat format)
+		{
+			return format == textureformat::bc1 ? BC1_BLOCK_BYTES : BC3_BLOCK_BYTES;
+		}
+
+		std::size_t GetDataOffset(UINT mipCount)
+		{
+			return sizeof(TEXTURE_MAGIC) + (HEADER_VALUES + static_cast<std::size_t>(mipCount) * MIP_VALUES) * 4;
+		}
+
+		// Reads the header and the mip table, the data may follow or not. Everything that would make
+		// the renderer read past the data is rejected, the mips have to follow each other.
+		bool ReadHeader(const std::uint8_t *bytes, std::size_t size, cookedtexture& cooked, std::uint32_t& dataSize)
+		{
+			if (size < GetDataOffset(0) or std::memcmp(bytes, TEXTURE_MAGIC, sizeof(TEXTURE_MAGIC)) != 0)
+			{
+				return false;
+			}
+
+			const std::uint8_t *header = bytes + sizeof(TEXTURE_MAGIC);
+			std::uint32_t version = GetUint32(header), format = GetUint32(header + 4), flags = GetUint32(header + 8);
+			std::uint32_t mipCount = GetUint32(header + 20);
+			dataSize = GetUint32(header + 24);
+
+			if (version != TEXTURE_VERSION or format > static_cast<std::uint32_t>(textureformat::bc3) or mipCount == 0 or mipCount > MAX_MIPS
+				or size < GetDataOffset(mipCount))
+			{
+				return false;
+			}
+
+			cooked.format = static_cast<textureformat>(format);
+			cooked.srgb = (flags & 1) != 0;
+			cooked.width = GetUint32(header + 12);
+			cooked.height = GetUint32(header + 16);
+			cooked.mips.resize(mipCount);
+			cooked.data.clear();
+
+			const std::uint8_t *table = bytes + GetDataOffset(0);
+			for (UINT i = 0; i < mipCount; i++)
+			{
+				const std::uint8_t *values = table + i * MIP_VALUES * 4;
+				cookedmip& mip = cooked.mips[i];
+				mip = cookedmip{ GetUint32(values), GetUint32(values + 4), GetUint32(values + 8), GetUint32(values + 12), GetUint32(values + 16) };
+
+				UINT minimumPitch = mip.width * 4, rows = mip.height;
+				if (cooked.format != textureformat::rgba8)
+				{
+					minimumPitch = (mip.width + 3) / 4 * GetBlockBytes(cooked.format);
+					rows = (mip.height + 3) / 4;
+				}
+				if (mip.width == 0 or mip.height == 0 or mip.rowPitch < minimumPitch or static_cast<UINT64>(mip.rowPitch) * rows > mip.size
+					or static_cast<UINT64>(mip.offset) + mip.size > dataSize
+					or (i > 0 and mip.offset < cooked.mips[i - 1].offset + cooked.mips[i - 1].size))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		// Blocks over the edge of a mip smaller than a block, or not a multiple of it, repeat the last row and column.
+		void EncodeBlockRow(const imagedata& mip, UINT blockRow, textureformat format, std::uint8_t *target)
+		{
+			UINT blockBytes = GetBlockBytes(format);
+			UINT blocksWide = (mip.width + 3) / 4;
+			std::uint8_t pixels[16 * 4];
+
+			for (UINT blockColumn = 0; blockColumn < blocksWide; blockColumn++)
+			{
+				for (UINT i = 0; i < 16; i++)
+				{
+					UINT x = (std::min)(blockColumn * 4 + i % 4, mip.width - 1);
+					UINT y = (std::min)(blockRow * 4 + i / 4, mip.height - 1);
+					std::memcpy(pixels + i * 4, &mip.pixels[(static_cast<std::size_t>(y) * mip.width + x) * 4], 4);
+				}
+
+				if (format == textureformat::bc1)
+				{
+					EncodeBC1Block(pixels, target + blockColumn * blockBytes);
+				}
+				else
+				{
+					EncodeBC3Block(pixels, target + blockColumn * blockBytes);
+				}
+			}
+		}
+	}
+
+	void BuildMipChain(core::jobsystem& jobs, const imagedata& image, bool srgb, std::vector<imagedata>& mips)
+	{
+		PROFILE_SCOPE("BuildMipChain");
+		UINT count = GetMipCount(image.width, image.height);
+		mips.resize(count);
+		mips[0] = image;
+
+		std::vector<FLOAT> source(image.pixels.size()), target;
+		jobs.ParallelFor(image.height, 16, [&](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::size_t i = static_cast<std::size_t>(begin) * image.width; i < static_cast<std::size_t>(end) * image.width; i++)
+			{
+				ToFloat(&image.pixels[i * 4], srgb, &source[i * 4]);
+			}
+		});
+
+		for (UINT level = 1; level < count; level++)
+		{
+			const imagedata& larger = mips[level - 1];
+			imagedata& mip = mips[level];
+			mip.width = (std::max)(larger.width / 2, 1u);
+			mip.height = (std::max)(larger.height / 2, 1u);
+			mip.pixels.resize(static_cast<std::size_t>(mip.width) * mip.height * 4);
+			target.resize(mip.pixels.size());
+
+			jobs.ParallelFor(mip.height, 8, [&](std::uint32_t begin, std::uint32_t end)
+			{
+				core::float4 quarter = core::Splat4(0.25f);
+				for (UINT y = begin; y < end; y++)
+				{
+					const FLOAT *row0 = &source[static_cast<std::size_t>((std::min)(2 * y, larger.height - 1)) * larger.width * 4];
+					const FLOAT *row1 = &source[static_cast<std::size_t>((std::min)(2 * y + 1, larger.height - 1)) * larger.width * 4];
+					for (UINT x = 0; x < mip.width; x++)
+					{
+						UINT x0 = (std::min)(2 * x, larger.width - 1) * 4, x1 = (std::min)(2 * x + 1, larger.width - 1) * 4;
+						core::float4 sum = core::Add4(core::Add4(core::Load4(row0 + x0), core::Load4(row0 + x1)),
+							core::Add4(core::Load4(row1 + x0), core::Load4(row1 + x1)));
+
+						std::size_t pixel = (static_cast<std::size_t>(y) * mip.width + x) * 4;
+						core::Store4(&target[pixel], core::Mul4(sum, quarter));
+						ToBytes(&target[pixel], srgb, &mip.pixels[pixel]);
+					}
+				}
+			});
+
+			source.swap(target);
+		}
+	}
+
+	bool CookTexture(core::jobsystem& jobs, const imagedata& image, textureformat format, bool srgb, cookedtexture& cooked)
+	{
+		PROFILE_SCOPE("CookTexture");
+		if (image.width == 0 or image.height == 0 or image.pixels.size() != static_cast<std::size_t>(image.width) * image.height * 4)
+		{
+			return false;
+		}
+
+		std::vector<imagedata> mips;
+		BuildMipChain(jobs, image, srgb, mips);
+
+		cooked.format = format;
+		cooked.srgb = srgb;
+		cooked.width = image.width;
+		cooked.height = image.height;
+		cooked.mips.clear();
+
+		// The block rows of all mips are numbered one after the other, so the small mips share jobs.
+		std::vector<UINT> firstBlockRows{ 0 };
+		UINT offset = 0;
+		for (const imagedata& mip : mips)
+		{
+			UINT rowPitch = mip.width * 4, rows = mip.height;
+			if (format != textureformat::rgba8)
+			{
+				rowPitch = (mip.width + 3) / 4 * GetBlockBytes(format);
+				rows = (mip.height + 3) / 4;
+			}
+			cooked.mips.push_back(cookedmip{ mip.width, mip.height, rowPitch, offset, rowPitch * rows });
+			firstBlockRows.push_back(firstBlockRows.back() + rows);
+			offset += rowPitch * rows;
+		}
+		cooked.data.resize(offset);
+
+		if (format == textureformat::rgba8)
+		{
+			for (UINT level = 0; level < mips.size(); level++)
+			{
+				std::copy(mips[level].pixels.begin(), mips[level].pixels.end(), cooked.data.begin() + cooked.mips[level].offset);
+			}
+			return true;
+		}
+
+		jobs.ParallelFor(firstBlockRows.back(), 1, [&](std::uint32_t begin, std::uint32_t end)
+		{
+			UINT level = 0;
+			for (UINT row = begin; row < end; row++)
+			{
+				while (firstBlockRows[level + 1] <= row)
+				{
+					level++;
+				}
+				const cookedmip& mip = cooked.mips[level];
+				UINT blockRow = row - firstBlockRows[level];
+				EncodeBlockRow(mips[level], blockRow, format, &cooked.data[mip.offset + blockRow * mip.rowPitch]);
+			}
+		});
+
+		return true;
+	}
+
+	bool DecodeCookedMip(const cookedtexture& cooked, UINT mip, imagedata& image)
+	{
+		if (mip >= cooked.mips.size())
+		{
+			return false;
+		}
+
+		const cookedmip& source = cooked.mips[mip];
+		const std::uint8_t *data = &cooked.data[source.offset];
+		image.width = source.width;
+		image.height = source.height;
+		image.pixels.resize(static_cast<std::size_t>(source.width) * source.height * 4);
+
+		if (cooked.format == textureformat::rgba8)
+		{
+			std::copy(data, data + source.size, image.pixels.begin());
+			return true;
+		}
+
+		UINT blockBytes = GetBlockBytes(cooked.format);
+		std::uint8_t pixels[16 * 4];
+		for (UINT blockRow = 0; blockRow * 4 < source.height; blockRow++)
+		{
+			for (UINT blockColumn = 0; blockColumn * 4 < source.width; blockColumn++)
+			{
+				const std::uint8_t *block = data + blockRow * source.rowPitch + blockColumn * blockBytes;
+				if (cooked.format == textureformat::bc1)
+				{
+					DecodeBC1Block(block, pixels);
+				}
+				else
+				{
+					DecodeBC3Block(block, pixels);
+				}
+
+				for (UINT i = 0; i < 16; i++)
+				{
+					UINT x = blockColumn * 4 + i % 4, y = blockRow * 4 + i / 4;
+					if (x < source.width and y < source.height)
+					{
+						std::memcpy(&image.pixels[(static_cast<std::size_t>(y) * source.width + x) * 4], pixels + i * 4, 4);
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	FLOAT ComputePSNR(const imagedata& reference, const imagedata& image)
+	{
+		if (reference.width != image.width or reference.height != image.height or reference.pixels.size() != image.pixels.size()
+			or image.pixels.empty())
+		{
+			return 0.0f;
+		}
+
+		double squares = 0.0;
+		for (std::size_t i = 0; i < image.pixels.size(); i++)
+		{
+			double difference = static_cast<double>(reference.pixels[i]) - image.pixels[i];
+			squares += difference * difference;
+		}
+
+		if (squares == 0.0)
+		{
+			return std::numeric_limits<FLOAT>::infinity();
+		}
+
+		double meanSquare = squares / static_cast<double>(image.pixels.size());
+		return static_cast<FLOAT>(10.0 * std::log10(255.0 * 255.0 / meanSquare));
+	}
+
+	void WriteCookedTexture(const cookedtexture& cooked, std::vector<std::uint8_t>& bytes)
+	{
+		bytes.assign(TEXTURE_MAGIC, TEXTURE_MAGIC + sizeof(TEXTURE_MAGIC));
+		bytes.reserve(sizeof(TEXTURE_MAGIC) + (HEADER_VALUES + cooked.mips.size() * MIP_VALUES) * 4 + cooked.data.size());
+		PutUint32(bytes, TEXTURE_VERSION);
+		PutUint32(bytes, static_cast<std::uint32_t>(cooked.format));
+		PutUint32(bytes, cooked.srgb ? 1 : 0);
+		PutUint32(bytes, cooked.width);
+		PutUint32(bytes, cooked.height);
+		PutUint32(bytes, static_cast<std::uint32_t>(cooked.mips.size()));
+		PutUint32(bytes, static_cast<std::uint32_t>(cooked.data.size()));
+
+		for (const cookedmip& mip : cooked.mips)
+		{
+			PutUint32(bytes, mip.width);
+			PutUint32(bytes, mip.height);
+			PutUint32(bytes, mip.rowPitch);
+			PutUint32(bytes, mip.offset);
+			PutUint32(bytes, mip.size);
+		}
+
+		bytes.insert(bytes.end(), cooked.data.begin(), cooked.data.end());
+	}
+
+	bool ReadCookedTexture(const std::vector<std::uint8_t>& bytes, cookedtexture& cooked)
+	{
+		std::uint32_t dataSize;
+		if (!ReadHeader(bytes.data(), bytes.size(), cooked, dataSize)
+			or bytes.size() != GetDataOffset(static_cast<UINT>(cooked.mips.size())) + static_cast<std::size_t>(dataSize))
+		{
+			return false;
+		}
+
+		const std::uint8_t *data = bytes.data() + GetDataOffset(static_cast<UINT>(cooked.mips.size()));
+		cooked.data.assign(data, data + dataSize);
+		return true;
+	}
+
+	bool SaveCookedTexture(const char *path, const cookedtexture& cooked)
+	{
+		std::vector<std::uint8_t> bytes;
+		WriteCookedTexture(cooked, bytes);
+
+		std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+		return static_cast<bool>(file);
+	}
+
+	bool LoadCookedTexture(const char *path, cookedtexture& cooked)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		if (!file)
+		{
+			return false;
+		}
+
+		std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		return ReadCookedTexture(bytes, cooked);
+	}
+
+	bool LoadCookedTextureHeader(const char *path, cookedtexture& cooked)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		std::vector<std::uint8_t> bytes(GetDataOffset(0));
+		if (!file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())))
+		{
+			return false;
+		}
+
+		// The mip count is checked by ReadHeader, the table is read with any count up to the limit.
+		UINT mipCount = (std::min)(GetUint32(bytes.data() + sizeof(TEXTURE_MAGIC) + 20), MAX_MIPS);
+		bytes.resize(GetDataOffset(mipCount));
+		file.read(reinterpret_cast<char*>(bytes.data()) + GetDataOffset(0), static_cast<std::streamsize>(bytes.size() - GetDataOffset(0)));
+
+		std::uint32_t dataSize;
+		return file and ReadHeader(bytes.data(), bytes.size(), cooked, dataSize);
+	}
+
+	bool LoadCookedMips(const char *path, const cookedtexture& header, UINT firstMip, UINT mipCount, std::vector<std::uint8_t>& bytes)
+	{
+		if (mipCount == 0 or firstMip + mipCount > header.mips.size())
+		{
+			return false;
+		}
+
+		const cookedmip& first = header.mips[firstMip];
+		const cookedmip& last = header.mips[firstMip + mipCount - 1];
+		bytes.resize(last.offset + last.size - first.offset);
+
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		file.seekg(static_cast<std::streamoff>(GetDataOffset(static_cast<UINT>(header.mips.size())) + first.offset));
+		file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+		return static_cast<bool>(file);
+	}
+}
@@ -0,0 +1,65 @@
+// texturecook.h : include file for the texture cook pipeline
+// Cooking turns a source image (see image.h) into the mip chain the renderer uploads as it is:
+//  - mips are filtered with a 2x2 box on linear values: color maps are stored in sRGB, so their colors are
+//    converted to linear first and back to sRGB after filtering, averaging the sRGB values would darken them,
+//  - the filter works on one float4 per pixel and the rows of a mip are spread over the jobs,
+//  - every mip is then block compressed to BC1 or BC3 (see blockcompression.h) by the jobs, a row of blocks
+//    per job, or kept as RGBA8.
+// The data of all mips is in one buffer with the offset and row pitch of every mip, as the initial data of a texture takes it.
+// The container file is a small header, the mip table and the data, all values 32-bit little endian.
+// The mips can be read from it one by one, see texturestreamer.h.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "image.h"
+#include "jobsystem.h"
+
+namespace graphics
+{
+	constexpr std::uint32_t TEXTURE_VERSION{ 1 };
+
+	enum class textureformat : std::uint32_t
+	{
+		rgba8, bc1, bc3
+	};
+
+	// The row pitch of block compressed mips is the size of a row of blocks.
+	struct cookedmip
+	{
+		UINT width;
+		UINT height;
+		UINT rowPitch;
+		UINT offset;
+		UINT size;
+	};
+
+	struct cookedtexture
+	{
+		textureformat format{};
+		bool srgb{};
+		UINT width{};
+		UINT height{};
+		std::vector<cookedmip> mips{};
+		std::vector<std::uint8_t> data{};
+	};
+
+	// BuildMipChain writes the image and all its smaller mips down to 1x1. Odd sizes are rounded down,
+	// the last row or column of the larger mip is then filtered with itself.
+	void BuildMipChain(core::jobsystem& jobs, const imagedata& image, bool srgb, std::vector<imagedata>& mips);
+	bool CookTexture(core::jobsystem& jobs, const imagedata& image, textureformat format, bool srgb, cookedtexture& cooked);
+
+	// DecodeCookedMip turns a mip back into RGBA8, to check what the compression did to it.
+	bool DecodeCookedMip(const cookedtexture& cooked, UINT mip, imagedata& image);
+	// The peak signal to noise ratio over all four channels in decibels, infinite for equal images.
+	FLOAT ComputePSNR(const imagedata& reference, const imagedata& image);
+
+	void WriteCookedTexture(const cookedtexture& cooked, std::vector<std::uint8_t>& bytes);
+	bool ReadCookedTexture(const std::vector<std::uint8_t>& bytes, cookedtexture& cooked);
+	bool SaveCookedTexture(const char *path, const cookedtexture& cooked);
+	bool LoadCookedTexture(const char *path, cookedtexture& cooked);
+	// For streaming: LoadCookedTextureHeader reads everything but the data, LoadCookedMips reads the data of
+	// mipCount mips from firstMip on, which lie one after the other, as they are in the cooked data.
+	bool LoadCookedTextureHeader(const char *path, cookedtexture& cooked);
+	bool LoadCookedMips(const char *path, const cookedtexture& header, UINT firstMip, UINT mipCount, std::vector<std::uint8_t>& bytes);
+}
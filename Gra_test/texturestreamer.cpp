@@ -0,0 +1,359 @@
+#include "stdafx.h"
+#include "texturestreamer.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace graphics
+{
+	namespace
+	{
+		// Closer than this the camera counts as touching the object.
+		constexpr FLOAT MIN_DISTANCE{ 0.001f };
+	}
+
+	texturestreamer::texturestreamer(core::jobsystem& jobs, const texturestreamsettings& settings) :
+		m_jobs(jobs), m_settings(settings)
+	{
+		if (settings.memoryBudget == 0 or settings.uploadBudget == 0)
+		{
+			throw "Incorrect texture streaming parameters.";
+		}
+	}
+
+	texturestreamer::~texturestreamer()
+	{
+		Flush();
+	}
+
+	texturestreamer::textureid texturestreamer::Add(const char *path)
+	{
+		texturestate state;
+		state.path = path;
+		if (!LoadCookedTextureHeader(path, state.header))
+		{
+			return INVALID_TEXTURE;
+		}
+		return AddTexture(state);
+	}
+
+	texturestreamer::textureid texturestreamer::Add(const cookedtexture *cooked)
+	{
+		if (!cooked or cooked->mips.empty() or cooked->data.size() < cooked->mips.back().offset + static_cast<std::size_t>(cooked->mips.back().size))
+		{
+			return INVALID_TEXTURE;
+		}
+
+		texturestate state;
+		state.source = cooked;
+		state.header.format = cooked->format;
+		state.header.srgb = cooked->srgb;
+		state.header.width = cooked->width;
+		state.header.height = cooked->height;
+		state.header.mips = cooked->mips;
+		return AddTexture(state);
+	}
+
+	void texturestreamer::SetView(const D3DXVECTOR3& cameraPosition, FLOAT pixelScale)
+	{
+		m_cameraPosition = cameraPosition;
+		m_pixelScale = pixelScale;
+	}
+
+	// On the object a world unit holds size / worldPerUV texels of the top mip, on the screen it covers
+	// pixelScale / distance pixels. Every mip halves the texels, the mip needed is the log2 of the ratio.
+	void texturestreamer::Use(textureid texture, const D3DXVECTOR3& center, FLOAT radius, FLOAT worldPerUV)
+	{
+		texturestate& state = m_textures[texture];
+		D3DXVECTOR3 offset = center - m_cameraPosition;
+		FLOAT distance = (std::max)(D3DXVec3Length(&offset) - radius, MIN_DISTANCE);
+		FLOAT texels = static_cast<FLOAT>((std::max)(state.header.width, state.header.height)) / worldPerUV;
+		FLOAT mip = std::log2(texels * distance / m_pixelScale) + m_settings.mipBias;
+
+		UINT needed = mip > 0.0f ? (std::min)(static_cast<UINT>(mip), state.tailMip) : 0;
+		state.usedMip = (std::min)(state.usedMip, needed);
+		state.distance = (std::min)(state.distance, distance);
+		state.lastUsed = m_frame;
+	}
+
+	void texturestreamer::Update()
+	{
+		PROFILE_SCOPE("texturestreamer::Update");
+
+		m_uploads.clear();
+		m_evictions.clear();
+		m_uploadedBytes = 0;
+
+		for (texturestate& state : m_textures)
+		{
+			state.wantedMip = state.usedMip;
+			state.usedMip = state.tailMip;
+		}
+
+		HandOverTails();
+		CollectLoads();
+		GatherRequests();
+		StartLoads();
+
+		for (texturestate& state : m_textures)
+		{
+			state.distance = FLT_MAX;
+		}
+		m_frame++;
+	}
+
+	void texturestreamer::Flush()
+	{
+		for (streamjob& job : m_streaming)
+		{
+			if (job.texture != INVALID_TEXTURE and !job.handedOver)
+			{
+				m_jobs.Wait(job.done);
+			}
+		}
+	}
+
+	const std::vector<texturestreamer::upload>& texturestreamer::GetUploads() const
+	{
+		return m_uploads;
+	}
+
+	const std::vector<texturestreamer::eviction>& texturestreamer::GetEvictions() const
+	{
+		return m_evictions;
+	}
+
+	const cookedtexture& texturestreamer::GetHeader(textureid texture) const
+	{
+		return m_textures[texture].header;
+	}
+
+	UINT texturestreamer::GetResidentMip(textureid texture) const
+	{
+		return m_textures[texture].residentMip;
+	}
+
+	UINT texturestreamer::GetWantedMip(textureid texture) const
+	{
+		return m_textures[texture].wantedMip;
+	}
+
+	texturestreamstats texturestreamer::GetStats() const
+	{
+		texturestreamstats stats{};
+		stats.residentBytes = m_residentBytes;
+		stats.loadingBytes = m_loadingBytes;
+		stats.uploadedBytes = m_uploadedBytes;
+		stats.loadedMips = m_loaded;
+		stats.evictedMips = m_evicted;
+		stats.failedLoads = m_failed;
+
+		for (const texturestate& state : m_textures)
+		{
+			stats.missingMips += state.residentMip > state.wantedMip ? state.residentMip - state.wantedMip : 0;
+		}
+		return stats;
+	}
+
+	// The tail starts at the first mip of at most tailSize texels along both axes, or the last mip.
+	texturestreamer::textureid texturestreamer::AddTexture(texturestate& state)
+	{
+		UINT mipCount = static_cast<UINT>(state.header.mips.size());
+		state.tailMip = mipCount - 1;
+		for (UINT mip = 0; mip < mipCount; mip++)
+		{
+			if ((std::max)(state.header.mips[mip].width, state.header.mips[mip].height) <= m_settings.tailSize)
+			{
+				state.tailMip = mip;
+				break;
+			}
+		}
+
+		if (!LoadMips(state, state.tailMip, mipCount - state.tailMip, state.tail))
+		{
+			return INVALID_TEXTURE;
+		}
+
+		state.residentMip = state.usedMip = state.wantedMip = state.tailMip;
+		state.distance = FLT_MAX;
+		m_residentBytes += state.tail.size();
+		m_textures.push_back(std::move(state));
+
+		textureid id = static_cast<textureid>(m_textures.size() - 1);
+		m_newTails.push_back(id);
+		return id;
+	}
+
+	bool texturestreamer::LoadMips(const texturestate& state, UINT firstMip, UINT mipCount, std::vector<std::uint8_t>& bytes)
+	{
+		if (!state.source)
+		{
+			return LoadCookedMips(state.path.c_str(), state.header, firstMip, mipCount, bytes);
+		}
+
+		const cookedmip& first = state.header.mips[firstMip];
+		const cookedmip& last = state.header.mips[firstMip + mipCount - 1];
+		bytes.assign(state.source->data.begin() + first.offset, state.source->data.begin() + last.offset + last.size);
+		return true;
+	}
+
+	// Tails are needed before a texture can be drawn at all and are small, the upload budget does not hold them back.
+	void texturestreamer::HandOverTails()
+	{
+		for (textureid texture : m_handedTails)
+		{
+			std::vector<std::uint8_t>().swap(m_textures[texture].tail);
+		}
+		m_handedTails.clear();
+
+		for (textureid texture : m_newTails)
+		{
+			texturestate& state = m_textures[texture];
+			m_uploads.push_back(upload{ texture, state.tailMip, static_cast<UINT>(state.header.mips.size()) - state.tailMip, state.tail.data() });
+			m_uploadedBytes += state.tail.size();
+		}
+		m_newTails.swap(m_handedTails);
+	}
+
+	// The first mip handed over in a frame always goes, even when it is larger than the upload budget.
+	void texturestreamer::CollectLoads()
+	{
+		for (streamjob& job : m_streaming)
+		{
+			if (job.handedOver)
+			{
+				job.texture = INVALID_TEXTURE;
+				job.handedOver = false;
+			}
+		}
+
+		UINT64 uploaded = 0;
+		for (streamjob& job : m_streaming)
+		{
+			if (job.texture == INVALID_TEXTURE or !job.done.IsDone())
+			{
+				continue;
+			}
+
+			texturestate& state = m_textures[job.texture];
+			UINT64 size = state.header.mips[job.mip].size;
+			if (!job.succeeded)
+			{
+				state.loading = false;
+				state.failed = true;
+				m_loadingBytes -= size;
+				m_failed++;
+				job.texture = INVALID_TEXTURE;
+				continue;
+			}
+			if (uploaded > 0 and uploaded + size > m_settings.uploadBudget)
+			{
+				continue;
+			}
+
+			state.loading = false;
+			state.residentMip = job.mip;
+			m_loadingBytes -= size;
+			m_residentBytes += size;
+			m_uploads.push_back(upload{ job.texture, job.mip, 1, job.data.data() });
+			job.handedOver = true;
+			uploaded += size;
+			m_loaded++;
+		}
+		m_uploadedBytes += uploaded;
+	}
+
+	// A texture loads one mip at a time, the next finer one, so it always reaches down to 1x1.
+	void texturestreamer::GatherRequests()
+	{
+		m_requests.clear();
+
+		for (UINT texture = 0; texture < m_textures.size(); texture++)
+		{
+			const texturestate& state = m_textures[texture];
+			if (!state.loading and !state.failed and state.residentMip > state.wantedMip)
+			{
+				m_requests.push_back(request{ state.residentMip - state.wantedMip, state.distance, texture });
+			}
+		}
+
+		std::sort(m_requests.begin(), m_requests.end(), [](const request& a, const request& b)
+		{
+			return a.missing != b.missing ? a.missing > b.missing : a.distance < b.distance;
+		});
+	}
+
+	// Loads start in the order of the requests, one without room stops the rest so smaller ones do not overtake it.
+	void texturestreamer::StartLoads()
+	{
+		UINT next = 0;
+
+		for (streamjob& job : m_streaming)
+		{
+			if (job.texture != INVALID_TEXTURE)
+			{
+				continue;
+			}
+			if (next == m_requests.size())
+			{
+				break;
+			}
+
+			textureid texture = m_requests[next++].texture;
+			texturestate *state = &m_textures[texture];
+			UINT mip = state->residentMip - 1;
+			UINT64 size = state->header.mips[mip].size;
+			if (!MakeRoom(size))
+			{
+				break;
+			}
+
+			streamjob *target = &job;
+			state->loading = true;
+			m_loadingBytes += size;
+			job.texture = texture;
+			job.mip = mip;
+			m_jobs.Run([state, target, mip]()
+			{
+				target->succeeded = LoadMips(*state, mip, 1, target->data);
+			}, &job.done);
+		}
+	}
+
+	bool texturestreamer::MakeRoom(UINT64 bytes)
+	{
+		while (m_residentBytes + m_loadingBytes + bytes > m_settings.memoryBudget)
+		{
+			textureid victim = INVALID_TEXTURE;
+			for (UINT texture = 0; texture < m_textures.size(); texture++)
+			{
+				const texturestate& state = m_textures[texture];
+				if (state.loading or state.residentMip >= state.wantedMip)
+				{
+					continue;
+				}
+
+				const texturestate *current = victim != INVALID_TEXTURE ? &m_textures[victim] : nullptr;
+				if (!current or state.lastUsed < current->lastUsed
+					or (state.lastUsed == current->lastUsed and state.wantedMip - state.residentMip > current->wantedMip - current->residentMip))
+				{
+					victim = texture;
+				}
+			}
+
+			if (victim == INVALID_TEXTURE)
+			{
+				return false;
+			}
+
+			texturestate& state = m_textures[victim];
+			m_residentBytes -= state.header.mips[state.residentMip].size;
+			state.residentMip++;
+			m_evictions.push_back(eviction{ victim, state.residentMip });
+			m_evicted++;
+		}
+
+		return true;
+	}
+}
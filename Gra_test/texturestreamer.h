@@ -0,0 +1,163 @@
+// texturestreamer.h : include file for streaming texture mips
+// Only the mips a texture is seen with are kept in memory. Every frame:
+//  - Use reports a texture drawn on an object with the object's bounding sphere and the world size one unit
+//    of UV covers on it. The texture needs the mip whose texels are about a pixel on the screen at the nearest
+//    point of the sphere, the finest mip over all uses of the frame counts,
+//  - Update hands the mips that finished loading to the renderer, at most uploadBudget bytes of them per frame,
+//    the rest wait for the next frames. It then starts loading the next finer mip of the textures that need
+//    more detail, those furthest from their mip first,
+//  - mips are only dropped when a load needs room in the memory budget, from textures that have more detail
+//    than they need, those unused the longest first. A load that finds no room waits.
+// A texture is resident from its most detailed loaded mip down to 1x1. The mips of at most tailSize texels
+// are loaded when the texture is added and never dropped, so every texture can always be drawn.
+// Mips are read from cooked texture files (see texturecook.h) by jobs in the background. The streamer never
+// touches the device, see streamedtexture.h for the GPU side.
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "jobsystem.h"
+#include "texturecook.h"
+
+namespace graphics
+{
+	// Mips loaded at the same time.
+	constexpr UINT TEXTURE_STREAMING_JOBS{ 4 };
+
+	// The mip bias is added to the computed mip, above zero loads less detail.
+	struct texturestreamsettings
+	{
+		UINT64 memoryBudget;
+		UINT64 uploadBudget;
+		UINT tailSize;
+		FLOAT mipBias;
+	};
+
+	struct texturestreamstats
+	{
+		UINT64 residentBytes{};
+		UINT64 loadingBytes{};
+		UINT64 uploadedBytes{};
+		UINT missingMips{};
+		UINT64 loadedMips{};
+		UINT64 evictedMips{};
+		UINT64 failedLoads{};
+	};
+
+	class texturestreamer
+	{
+	public:
+		typedef UINT textureid;
+
+		static constexpr textureid INVALID_TEXTURE{ 0xffffffff };
+
+		// Mips that finished loading, the data stays valid until the next Update. The texture now reaches from mip
+		// down to 1x1. The data holds mipCount mips one after the other like the cooked data; the first upload
+		// of a texture is its tail, later ones are a single mip.
+		struct upload
+		{
+			textureid texture;
+			UINT mip;
+			UINT mipCount;
+			const std::uint8_t *data;
+		};
+
+		// The texture was cut down to reach from mip.
+		struct eviction
+		{
+			textureid texture;
+			UINT mip;
+		};
+
+		texturestreamer() = delete;
+		texturestreamer(core::jobsystem& jobs, const texturestreamsettings& settings);
+		texturestreamer(const texturestreamer& other) = delete;
+		~texturestreamer();
+
+		texturestreamer& operator=(const texturestreamer& other) = delete;
+
+		// Add reads the mip table and the tail of a cooked texture file, it returns INVALID_TEXTURE when it cannot.
+		textureid Add(const char *path);
+		// The mips of a texture cooked in memory are copied from it, it has to live as long as the streamer.
+		textureid Add(const cookedtexture *cooked);
+
+		// The pixel scale is the number of pixels a unit covers at a distance of one unit, like for the terrain.
+		void SetView(const D3DXVECTOR3& cameraPosition, FLOAT pixelScale);
+		void Use(textureid texture, const D3DXVECTOR3& center, FLOAT radius, FLOAT worldPerUV);
+		// The renderer applies the uploads before the evictions, a mip uploaded in a frame can be dropped again in it.
+		void Update();
+		// Flush waits for the mips being loaded, the next Update hands them over.
+		void Flush();
+
+		const std::vector<upload>& GetUploads() const;
+		const std::vector<eviction>& GetEvictions() const;
+
+		// The format and the mip table of the texture, without the data.
+		const cookedtexture& GetHeader(textureid texture) const;
+		UINT GetResidentMip(textureid texture) const;
+		// The mip the last Update aimed for.
+		UINT GetWantedMip(textureid texture) const;
+		texturestreamstats GetStats() const;
+	private:
+		struct texturestate
+		{
+			cookedtexture header{};
+			std::string path{};
+			const cookedtexture *source{};
+			UINT tailMip{};
+			UINT residentMip{};
+			// The mip the uses since the last Update need and the one that Update aimed for.
+			UINT usedMip{};
+			UINT wantedMip{};
+			FLOAT distance{};
+			UINT64 lastUsed{};
+			bool loading{};
+			bool failed{};
+			// Held from Add until the Update after the one that handed it over.
+			std::vector<std::uint8_t> tail{};
+		};
+
+		struct request
+		{
+			UINT missing;
+			FLOAT distance;
+			textureid texture;
+		};
+
+		struct streamjob
+		{
+			core::jobcounter done;
+			textureid texture{ INVALID_TEXTURE };
+			UINT mip{};
+			bool succeeded{};
+			bool handedOver{};
+			std::vector<std::uint8_t> data;
+		};
+
+		textureid AddTexture(texturestate& state);
+		static bool LoadMips(const texturestate& state, UINT firstMip, UINT mipCount, std::vector<std::uint8_t>& bytes);
+		void HandOverTails();
+		void CollectLoads();
+		void GatherRequests();
+		void StartLoads();
+		bool MakeRoom(UINT64 bytes);
+
+		core::jobsystem& m_jobs;
+		texturestreamsettings m_settings{};
+		// A deque so the jobs can hold on to a texture while more are added.
+		std::deque<texturestate> m_textures{};
+		streamjob m_streaming[TEXTURE_STREAMING_JOBS];
+		D3DXVECTOR3 m_cameraPosition{};
+		FLOAT m_pixelScale{ 1.0f };
+		// Working lists kept so a frame does not allocate.
+		std::vector<textureid> m_newTails{}, m_handedTails{};
+		std::vector<upload> m_uploads{};
+		std::vector<eviction> m_evictions{};
+		std::vector<request> m_requests{};
+		UINT64 m_frame{};
+		UINT64 m_residentBytes{}, m_loadingBytes{}, m_uploadedBytes{};
+		UINT64 m_loaded{}, m_evicted{}, m_failed{};
+	};
+}
@@ -0,0 +1,469 @@
+#include "stdafx.h"
+#include "transformhierarchy.h"
+#include "profiler.h"
+#include "simdmath.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace graphics
+{
+	transformhierarchy::node transformhierarchy::Create(const transform& local, node parent)
+	{
+		node created;
+
+		if (!m_freeNodes.empty())
+		{
+			created = m_freeNodes.back();
+			m_freeNodes.pop_back();
+		}
+		else
+		{
+			created = static_cast<node>(m_links.size());
+			m_links.push_back(links{});
+			m_locals.push_back(transform{});
+		}
+
+		// A destroyed node can still be in the marked list, the flag is kept so it is not added twice.
+		bool marked = m_links[created].marked;
+		m_links[created] = links{};
+		m_links[created].marked = marked;
+		m_links[created].live = true;
+		m_locals[created] = local;
+
+		Link(created, IsValid(parent) ? parent : INVALID_NODE);
+		Mark(created);
+		m_orderChanged = true;
+		m_nodeCount++;
+
+		return created;
+	}
+
+	void transformhierarchy::Destroy(node destroyed)
+	{
+		if (!IsValid(destroyed))
+		{
+			return;
+		}
+
+		std::vector<node> removed;
+		GetSubtree(destroyed, removed);
+		Unlink(destroyed);
+
+		for (node current : removed)
+		{
+			bool marked = m_links[current].marked;
+			m_links[current] = links{};
+			m_links[current].marked = marked;
+			m_freeNodes.push_back(current);
+		}
+
+		m_nodeCount -= static_cast<UINT>(removed.size());
+		m_orderChanged = true;
+	}
+
+	bool transformhierarchy::SetParent(node child, node parent)
+	{
+		if (!IsValid(child) or (parent != INVALID_NODE and !IsValid(parent)))
+		{
+			return false;
+		}
+
+		for (node ancestor = parent; ancestor != INVALID_NODE; ancestor = m_links[ancestor].parent)
+		{
+			if (ancestor == child)
+			{
+				return false;
+			}
+		}
+
+		if (m_links[child].parent != parent)
+		{
+			Unlink(child);
+			Link(child, parent);
+			Mark(child);
+			m_orderChanged = true;
+		}
+
+		return true;
+	}
+
+	void transformhierarchy::SetLocal(node target, const transform& local)
+	{
+		m_locals[target] = local;
+		Mark(target);
+	}
+
+	const transform& transformhierarchy::GetLocal(node target) const
+	{
+		return m_locals[target];
+	}
+
+	transformhierarchy::node transformhierarchy::GetParent(node target) const
+	{
+		return m_links[target].parent;
+	}
+
+	const D3DXMATRIX& transformhierarchy::GetWorld(node target) const
+	{
+		return m_worldMatrices[m_links[target].slot];
+	}
+
+	void transformhierarchy::GetSubtree(node root, std::vector<node>& nodes) const
+	{
+		std::size_t next = nodes.size();
+
+		nodes.push_back(root);
+		for (; next < nodes.size(); next++)
+		{
+			for (node child = m_links[nodes[next]].firstChild; child != INVALID_NODE; child = m_links[child].nextSibling)
+			{
+				nodes.push_back(child);
+			}
+		}
+	}
+
+	bool transformhierarchy::IsValid(node target) const
+	{
+		return target < m_links.size() and m_links[target].live;
+	}
+
+	UINT transformhierarchy::GetNodeCount() const
+	{
+		return m_nodeCount;
+	}
+
+	namespace
+	{
+		// Index of the lowest set bit, the value must not be zero.
+		std::uint32_t LowestSetBit(std::uint32_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, value);
+			return index;
+#else
+			return __builtin_ctz(value);
+#endif
+		}
+	}
+
+	void transformhierarchy::Update(core::jobsystem& jobs)
+	{
+		PROFILE_SCOPE("transformhierarchy::Update");
+
+		m_updated.clear();
+		if (m_orderChanged)
+		{
+			RebuildOrder();
+		}
+
+		// The seeds are wanted in slot order, which is also level order for the walk below. A bit per slot
+		// sorts them in one pass over the set, a few words per thousand nodes instead of a comparison sort.
+		m_seedBits.resize((m_nodeCount + 31) / 32);
+		for (node current : m_marked)
+		{
+			m_links[current].marked = false;
+			if (m_links[current].live)
+			{
+				UINT slot = m_links[current].slot;
+				m_seedBits[slot / 32] |= 1u << (slot % 32);
+			}
+		}
+		m_marked.clear();
+
+		m_seeds.clear();
+		for (UINT word = 0; word < m_seedBits.size(); word++)
+		{
+			for (std::uint32_t bits = m_seedBits[word]; bits; bits &= bits - 1)
+			{
+				m_seeds.push_back(word * 32 + LowestSetBit(bits));
+			}
+			m_seedBits[word] = 0;
+		}
+
+		auto buildLocals = [this](std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t i = begin; i < end; i++)
+			{
+				BuildMatrix(m_locals[m_slotNodes[m_seeds[i]]], m_localMatrices[m_seeds[i]]);
+			}
+		};
+
+		UINT seedCount = static_cast<UINT>(m_seeds.size());
+		if (seedCount >= TRANSFORM_PARALLEL_NODES)
+		{
+			jobs.ParallelFor(seedCount, TRANSFORM_RANGE_NODES, buildLocals);
+		}
+		else
+		{
+			buildLocals(0, seedCount);
+		}
+
+		std::size_t nextSeed = 0;
+		UINT previousBegin = 0, previousEnd = 0;
+		for (UINT level = 0; level + 1 < m_levelBegin.size(); level++)
+		{
+			if (previousBegin == previousEnd and nextSeed == m_seeds.size())
+			{
+				break;
+			}
+
+			UINT begin = static_cast<UINT>(m_updated.size());
+			CollectRanges(level, previousBegin, previousEnd, nextSeed);
+			UINT end = static_cast<UINT>(m_updated.size());
+
+			ComputeRanges(jobs, begin, end);
+			previousBegin = begin;
+			previousEnd = end;
+		}
+	}
+
+	const std::vector<transformhierarchy::noderange>& transformhierarchy::GetUpdatedRanges() const
+	{
+		return m_updated;
+	}
+
+	transformhierarchy::node transformhierarchy::GetSlotNode(UINT slot) const
+	{
+		return m_slotNodes[slot];
+	}
+
+	// The rows of the rotation are those of D3DXMatrixRotationYawPitchRoll written out,
+	// which saves the three rotation matrices and the products of the general path.
+	void transformhierarchy::BuildMatrix(const transform& local, D3DXMATRIX& matrix)
+	{
+		FLOAT yaw = local.rotation.y * 0.0174532925f;
+		FLOAT pitch = local.rotation.x * 0.0174532925f;
+		FLOAT roll = local.rotation.z * 0.0174532925f;
+		FLOAT sy = std::sin(yaw), cy = std::cos(yaw);
+		FLOAT sp = std::sin(pitch), cp = std::cos(pitch);
+		FLOAT sr = std::sin(roll), cr = std::cos(roll);
+		FLOAT s = local.scale;
+
+		matrix = D3DXMATRIX((cr * cy + sr * sp * sy) * s, sr * cp * s, (sr * sp * cy - cr * sy) * s, 0.0f,
+			(cr * sp * sy - sr * cy) * s, cr * cp * s, (sr * sy + cr * sp * cy) * s, 0.0f,
+			cp * sy * s, -sp * s, cp * cy * s, 0.0f,
+			local.position.x, local.position.y, local.position.z, 1.0f);
+	}
+
+	void transformhierarchy::Link(node child, node parent)
+	{
+		node& first = parent == INVALID_NODE ? m_firstRoot : m_links[parent].firstChild;
+		links& linked = m_links[child];
+
+		linked.parent = parent;
+		linked.previousSibling = INVALID_NODE;
+		linked.nextSibling = first;
+		if (first != INVALID_NODE)
+		{
+			m_links[first].previousSibling = child;
+		}
+		first = child;
+	}
+
+	void transformhierarchy::Unlink(node child)
+	{
+		links& unlinked = m_links[child];
+
+		if (unlinked.previousSibling != INVALID_NODE)
+		{
+			m_links[unlinked.previousSibling].nextSibling = unlinked.nextSibling;
+		}
+		else
+		{
+			(unlinked.parent == INVALID_NODE ? m_firstRoot : m_links[unlinked.parent].firstChild) = unlinked.nextSibling;
+		}
+
+		if (unlinked.nextSibling != INVALID_NODE)
+		{
+			m_links[unlinked.nextSibling].previousSibling = unlinked.previousSibling;
+		}
+
+		unlinked.parent = unlinked.previousSibling = unlinked.nextSibling = INVALID_NODE;
+	}
+
+	void transformhierarchy::Mark(node target)
+	{
+		if (!m_links[target].marked)
+		{
+			m_links[target].marked = true;
+			m_marked.push_back(target);
+		}
+	}
+
+	// A breadth first walk over the linked tree gives the new order. The matrices move to the new slots,
+	// so nodes that only changed place in the arrays do not have to be computed again.
+	void transformhierarchy::RebuildOrder()
+	{
+		PROFILE_SCOPE("transformhierarchy::RebuildOrder");
+		std::vector<node>& order = m_spareNodes;
+
+		order.clear();
+		order.reserve(m_nodeCount);
+		m_parentSlots.resize(m_nodeCount);
+		m_childBegin.resize(m_nodeCount + 1);
+		m_levelBegin.clear();
+
+		for (node root = m_firstRoot; root != INVALID_NODE; root = m_links[root].nextSibling)
+		{
+			m_parentSlots[order.size()] = NO_SLOT;
+			order.push_back(root);
+		}
+
+		for (UINT levelStart = 0; levelStart < order.size();)
+		{
+			UINT levelEnd = static_cast<UINT>(order.size());
+
+			m_levelBegin.push_back(levelStart);
+			for (UINT slot = levelStart; slot < levelEnd; slot++)
+			{
+				m_childBegin[slot] = static_cast<UINT>(order.size());
+				for (node child = m_links[order[slot]].firstChild; child != INVALID_NODE; child = m_links[child].nextSibling)
+				{
+					m_parentSlots[order.size()] = slot;
+					order.push_back(child);
+				}
+			}
+			levelStart = levelEnd;
+		}
+		m_levelBegin.push_back(m_nodeCount);
+		m_childBegin[m_nodeCount] = m_nodeCount;
+
+		m_spareMatrices.resize(m_nodeCount);
+		for (UINT slot = 0; slot < m_nodeCount; slot++)
+		{
+			UINT previous = m_links[order[slot]].slot;
+			if (previous != NO_SLOT)
+			{
+				m_spareMatrices[slot] = m_localMatrices[previous];
+			}
+		}
+		m_localMatrices.swap(m_spareMatrices);
+
+		m_spareMatrices.resize(m_nodeCount);
+		for (UINT slot = 0; slot < m_nodeCount; slot++)
+		{
+			UINT previous = m_links[order[slot]].slot;
+			if (previous != NO_SLOT)
+			{
+				m_spareMatrices[slot] = m_worldMatrices[previous];
+			}
+		}
+		m_worldMatrices.swap(m_spareMatrices);
+
+		for (UINT slot = 0; slot < m_nodeCount; slot++)
+		{
+			m_links[order[slot]].slot = slot;
+		}
+		m_slotNodes.swap(order);
+		m_orderChanged = false;
+	}
+
+	// The ranges of the level are the children of the ranges updated on the level above together with
+	// the marked nodes of this level. Both come in slot order, so they are merged like two sorted lists
+	// and overlapping or touching ranges are joined before they are cut into pieces.
+	void transformhierarchy::CollectRanges(UINT level, UINT previousBegin, UINT previousEnd, std::size_t& nextSeed)
+	{
+		UINT levelEnd = m_levelBegin[level + 1];
+		UINT previous = previousBegin;
+
+		m_merged.clear();
+		for (;;)
+		{
+			noderange children{};
+			bool hasChildren = false;
+			while (previous < previousEnd)
+			{
+				children = noderange{ m_childBegin[m_updated[previous].begin], m_childBegin[m_updated[previous].end] };
+				if (children.begin < children.end)
+				{
+					hasChildren = true;
+					break;
+				}
+				previous++;
+			}
+			bool hasSeed = nextSeed < m_seeds.size() and m_seeds[nextSeed] < levelEnd;
+
+			noderange next;
+			if (hasChildren and (!hasSeed or children.begin <= m_seeds[nextSeed]))
+			{
+				next = children;
+				previous++;
+			}
+			else if (hasSeed)
+			{
+				next = noderange{ m_seeds[nextSeed], m_seeds[nextSeed] + 1 };
+				nextSeed++;
+			}
+			else
+			{
+				break;
+			}
+
+			if (!m_merged.empty() and next.begin <= m_merged.back().end)
+			{
+				m_merged.back().end = (std::max)(m_merged.back().end, next.end);
+			}
+			else
+			{
+				m_merged.push_back(next);
+			}
+		}
+
+		for (const noderange& merged : m_merged)
+		{
+			for (UINT begin = merged.begin; begin < merged.end; begin += TRANSFORM_RANGE_NODES)
+			{
+				m_updated.push_back(noderange{ begin, (std::min)(begin + TRANSFORM_RANGE_NODES, merged.end) });
+			}
+		}
+	}
+
+	// The parents of a level were all finished on the level before, so the pieces of one level are independent.
+	void transformhierarchy::ComputeRanges(core::jobsystem& jobs, UINT begin, UINT end)
+	{
+		UINT nodes = 0;
+		for (UINT i = begin; i < end; i++)
+		{
+			nodes += m_updated[i].end - m_updated[i].begin;
+		}
+
+		if (nodes >= TRANSFORM_PARALLEL_NODES)
+		{
+			jobs.ParallelFor(end - begin, 1, [this, begin](std::uint32_t first, std::uint32_t last)
+			{
+				for (std::uint32_t i = first; i < last; i++)
+				{
+					ComputeRange(m_updated[begin + i]);
+				}
+			});
+		}
+		else
+		{
+			for (UINT i = begin; i < end; i++)
+			{
+				ComputeRange(m_updated[i]);
+			}
+		}
+	}
+
+	void transformhierarchy::ComputeRange(const noderange& range)
+	{
+		for (UINT slot = range.begin; slot < range.end; slot++)
+		{
+			UINT parent = m_parentSlots[slot];
+			if (parent == NO_SLOT)
+			{
+				m_worldMatrices[slot] = m_localMatrices[slot];
+			}
+			else
+			{
+				core::MultiplyMatrix(m_worldMatrices[slot], m_localMatrices[slot], m_worldMatrices[parent]);
+			}
+		}
+	}
+}
@@ -0,0 +1,121 @@
+// transformhierarchy.h : include file for the parent/child transform hierarchy
+// The nodes are kept in flat arrays sorted by depth in breadth first order: the roots first,
+// then all of their children, then the grandchildren and so on, where the children of a node
+// sit next to each other and in the order of their parents. The nodes below any node therefore
+// take one contiguous range on every level, so a moved subtree is updated with linear memory access.
+//
+// Changing a local transform only marks the node. Update then
+//  - puts the arrays back in order once if nodes were created, destroyed or moved to another parent,
+//  - builds the local matrices of the marked nodes,
+//  - walks the levels top down: the marked nodes of a level and the children of the ranges updated
+//    on the level above are merged into ranges, and world = local * parent world is computed
+//    for those with SIMD, large levels spread over the job system.
+// Nodes that did not move and are not below one that did keep their world matrix and cost nothing.
+#pragma once
+
+#include <vector>
+#include "jobsystem.h"
+#include "scenecomponents.h"
+
+namespace graphics
+{
+	// Ranges are split into pieces of at most this many nodes, a piece is the unit of parallel work.
+	constexpr UINT TRANSFORM_RANGE_NODES{ 256 };
+	// Levels with fewer nodes to update are computed on the calling thread.
+	constexpr UINT TRANSFORM_PARALLEL_NODES{ 4096 };
+
+	class transformhierarchy
+	{
+	public:
+		typedef UINT node;
+		static constexpr node INVALID_NODE{ 0xffffffff };
+
+		// Slots [begin, end) in the flat order.
+		struct noderange
+		{
+			UINT begin;
+			UINT end;
+		};
+
+		transformhierarchy() {};
+		transformhierarchy(const transformhierarchy& other) = delete;
+		~transformhierarchy() {};
+
+		transformhierarchy& operator=(const transformhierarchy& other) = delete;
+
+		// The local transform is relative to the parent, a node without a parent is a root.
+		node Create(const transform& local, node parent = INVALID_NODE);
+		// Destroy removes the node together with every node below it.
+		void Destroy(node destroyed);
+		// SetParent moves the node and its subtree under another parent, INVALID_NODE makes it a root.
+		// It returns false and changes nothing when the parent is the node itself or below it.
+		bool SetParent(node child, node parent);
+		void SetLocal(node target, const transform& local);
+
+		const transform& GetLocal(node target) const;
+		node GetParent(node target) const;
+		// The world matrix is up to date for every node that existed at the last Update.
+		const D3DXMATRIX& GetWorld(node target) const;
+		// GetSubtree appends the node and every node below it to nodes, parents before their children.
+		void GetSubtree(node root, std::vector<node>& nodes) const;
+		bool IsValid(node target) const;
+		UINT GetNodeCount() const;
+
+		void Update(core::jobsystem& jobs);
+
+		// The slots whose world matrix the last Update computed, level by level, and the node in a slot.
+		const std::vector<noderange>& GetUpdatedRanges() const;
+		node GetSlotNode(UINT slot) const;
+
+		// The matrix of a transform is scale, then rotation, then translation.
+		// The rotation is in degrees, applied like D3DXMatrixRotationYawPitchRoll (roll, pitch, then yaw).
+		static void BuildMatrix(const transform& local, D3DXMATRIX& matrix);
+	private:
+		static constexpr UINT NO_SLOT{ 0xffffffff };
+
+		// The tree itself, indexed by node. Children and roots are linked lists through their siblings.
+		struct links
+		{
+			node parent{ INVALID_NODE };
+			node firstChild{ INVALID_NODE };
+			node previousSibling{ INVALID_NODE };
+			node nextSibling{ INVALID_NODE };
+			UINT slot{ NO_SLOT };
+			bool live{};
+			bool marked{};
+		};
+
+		void Link(node child, node parent);
+		void Unlink(node child);
+		void Mark(node target);
+		void RebuildOrder();
+		void CollectRanges(UINT level, UINT previousBegin, UINT previousEnd, std::size_t& nextSeed);
+		void ComputeRanges(core::jobsystem& jobs, UINT begin, UINT end);
+		void ComputeRange(const noderange& range);
+
+		std::vector<links> m_links{};
+		std::vector<transform> m_locals{};
+		std::vector<node> m_freeNodes{};
+		std::vector<node> m_marked{};
+		node m_firstRoot{ INVALID_NODE };
+		UINT m_nodeCount{};
+		bool m_orderChanged{};
+
+		// The flat arrays, indexed by slot. The children of slot i are the slots [m_childBegin[i], m_childBegin[i + 1]),
+		// the nodes of level d are the slots [m_levelBegin[d], m_levelBegin[d + 1]).
+		std::vector<node> m_slotNodes{};
+		std::vector<UINT> m_parentSlots{};
+		std::vector<UINT> m_childBegin{};
+		std::vector<UINT> m_levelBegin{};
+		std::vector<D3DXMATRIX> m_localMatrices{};
+		std::vector<D3DXMATRIX> m_worldMatrices{};
+
+		// Working memory of Update, kept so a frame does not allocate.
+		std::vector<std::uint32_t> m_seedBits{};
+		std::vector<UINT> m_seeds{};
+		std::vector<noderange> m_merged{};
+		std::vector<noderange> m_updated{};
+		std::vector<D3DXMATRIX> m_spareMatrices{};
+		std::vector<node> m_spareNodes{};
+	};
+}
@@ -0,0 +1,25 @@
+//
+// upscale.vs : Code of the upscale vertex shader in HSLS language.
+//
+// The upscale pass draws one triangle over the whole window without any vertex buffer,
+// the corners are made from the vertex id: (0, 0), (2, 0) and (0, 2) in texture coordinates,
+// so the part of the triangle inside the window covers the texture coordinates from 0 to 1.
+//
+
+// Typedefs
+struct PixelInputType
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+// Vertex shader
+PixelInputType UpscaleVertexShader(uint id : SV_VertexID)
+{
+    PixelInputType output;
+
+    output.uv = float2((id << 1) & 2, id & 2);
+    output.position = float4(output.uv * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+
+    return output;
+}
@@ -0,0 +1,193 @@
+#include "stdafx.h"
+#include "upscaler.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include "telemetry.h"
+
+namespace graphics
+{
+	WCHAR upscaleVsPath[] = L"upscale.vs";
+	WCHAR upscalePsPath[] = L"upscale.ps";
+
+	upscaler::upscaler(ID3D11Device *dev, HWND hWnd)
+	{
+		if (!InitializeShader(dev, hWnd))
+		{
+			throw "Unable to initialize the upscale shaders.";
+		}
+	}
+
+	upscaler::~upscaler()
+	{
+		core::memorytracker::Freed(core::memorytag::shaders, m_trackedBytes);
+
+		if (m_regionBuffer)
+		{
+			m_regionBuffer->Release();
+			m_regionBuffer = nullptr;
+		}
+
+		if (m_sampler)
+		{
+			m_sampler->Release();
+			m_sampler = nullptr;
+		}
+
+		if (m_pixelShader)
+		{
+			m_pixelShader->Release();
+			m_pixelShader = nullptr;
+		}
+
+		if (m_vertexShader)
+		{
+			m_vertexShader->Release();
+			m_vertexShader = nullptr;
+		}
+	}
+
+	bool upscaler::Render(ID3D11DeviceContext *devcon, ID3D11ShaderResourceView *scene, const upscalebuffer& region)
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		ID3D11ShaderResourceView *unbound = nullptr;
+		PROFILE_SCOPE("upscaler::Render");
+
+		HRESULT result = devcon->Map(m_regionBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		if (FAILED(result))
+		{
+			return false;
+		}
+		*static_cast<upscalebuffer*>(mappedResource.pData) = region;
+		devcon->Unmap(m_regionBuffer, 0);
+
+		// The triangle is made up from the vertex ids, nothing is read from the input assembler.
+		devcon->IASetInputLayout(NULL);
+		devcon->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		devcon->VSSetShader(m_vertexShader, NULL, 0);
+		devcon->PSSetShader(m_pixelShader, NULL, 0);
+		devcon->PSSetConstantBuffers(0, 1, &m_regionBuffer);
+		devcon->PSSetSamplers(0, 1, &m_sampler);
+		devcon->PSSetShaderResources(0, 1, &scene);
+
+		devcon->Draw(3, 0);
+
+		devcon->PSSetShaderResources(0, 1, &unbound);
+
+		core::telemetry::Count(core::counter::bytesuploaded, sizeof(upscalebuffer));
+		core::telemetry::Count(core::counter::statechanges, 7);
+		core::telemetry::Count(core::counter::drawcalls, 1);
+		core::telemetry::Count(core::counter::triangles, 1);
+
+		return true;
+	}
+
+	// The shaders are compiled like the ones of the color shader, see colorshader::InitializeShader.
+	bool upscaler::InitializeShader(ID3D11Device *dev, HWND hWnd)
+	{
+		HRESULT result;
+		ID3D10Blob* errorMessage{};
+		ID3D10Blob* vertexShaderBuffer{};
+		ID3D10Blob* pixelShaderBuffer{};
+		D3D11_SAMPLER_DESC samplerDesc{};
+		D3D11_BUFFER_DESC regionBufferDesc{};
+
+		result = D3DX11CompileFromFile(upscaleVsPath, NULL, NULL, "UpscaleVertexShader", "vs_5_0", D3D10_SHADER_ENABLE_STRICTNESS, 0, NULL,
+			&vertexShaderBuffer, &errorMessage, NULL);
+		if (FAILED(result))
+		{
+			if (errorMessage)
+			{
+				OutputShaderErrorMessage(errorMessage, hWnd, upscaleVsPath);
+			}
+			else
+			{
+				MessageBox(hWnd, upscaleVsPath, L"Missing Shader File", MB_OK);
+			}
+
+			return false;
+		}
+
+		result = D3DX11CompileFromFile(upscalePsPath, NULL, NULL, "UpscalePixelShader", "ps_5_0", D3D10_SHADER_ENABLE_STRICTNESS, 0, NULL,
+			&pixelShaderBuffer, &errorMessage, NULL);
+		if (FAILED(result))
+		{
+			vertexShaderBuffer->Release();
+			if (errorMessage)
+			{
+				OutputShaderErrorMessage(errorMessage, hWnd, upscalePsPath);
+			}
+			else
+			{
+				MessageBox(hWnd, upscalePsPath, L"Missing Shader File", MB_OK);
+			}
+
+			return false;
+		}
+
+		result = dev->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &m_vertexShader);
+		if (SUCCEEDED(result))
+		{
+			result = dev->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &m_pixelShader);
+		}
+		if (SUCCEEDED(result))
+		{
+			Track(vertexShaderBuffer->GetBufferSize() + pixelShaderBuffer->GetBufferSize());
+		}
+
+		vertexShaderBuffer->Release();
+		pixelShaderBuffer->Release();
+
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		// Bilinear filtering is what stretches the scene, clamping keeps the window's edges from wrapping around.
+		samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+		samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+		samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+		samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+		samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+		samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+		result = dev->CreateSamplerState(&samplerDesc, &m_sampler);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		regionBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		regionBufferDesc.ByteWidth = sizeof(upscalebuffer);
+		regionBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		regionBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		result = dev->CreateBuffer(&regionBufferDesc, NULL, &m_regionBuffer);
+		if (FAILED(result))
+		{
+			return false;
+		}
+		Track(regionBufferDesc.ByteWidth);
+
+		return true;
+	}
+
+	void upscaler::Track(UINT64 bytes)
+	{
+		core::memorytracker::Allocated(core::memorytag::shaders, bytes);
+		m_trackedBytes += bytes;
+	}
+
+	// The compile errors go to the same file as the ones of the color shader.
+	void upscaler::OutputShaderErrorMessage(ID3D10Blob *errorMessage, HWND hWnd, WCHAR *path)
+	{
+		std::ofstream fout;
+
+		fout.open("shader-error.txt");
+		fout.write(static_cast<const char*>(errorMessage->GetBufferPointer()), errorMessage->GetBufferSize());
+		fout.close();
+
+		errorMessage->Release();
+
+		MessageBox(hWnd, L"Error compiling shader.  Check shader-error.txt for message.", path, MB_OK);
+	}
+}
@@ -0,0 +1,40 @@
+// upscaler.h : include file for the upscale pass
+// The upscaler stretches the scene, drawn at the size the dynamic resolution picked (see resolutioncontroller.h),
+// over the back buffer with a bilinear filter. It draws one triangle covering the window, made up in the vertex shader,
+// so it needs neither a vertex buffer nor an input layout.
+#pragma once
+
+#include <d3d11.h>
+#include <d3dx10math.h>
+#include <d3dx11async.h>
+#include <fstream>
+#include "shaderparameters.h"
+
+namespace graphics
+{
+	class upscaler
+	{
+	public:
+		upscaler(ID3D11Device *dev, HWND hWnd);
+		upscaler(const upscaler& other) = delete;
+		upscaler(upscaler&& other) = delete;
+		~upscaler();
+
+		upscaler& operator=(const upscaler& other) = delete;
+
+		// Render draws the region of the scene texture into the bound render target, see d3d::GetSceneRegion.
+		// The scene texture is unbound again afterwards so it can be drawn into in the next frame.
+		bool Render(ID3D11DeviceContext *devcon, ID3D11ShaderResourceView *scene, const upscalebuffer& region);
+	private:
+		bool InitializeShader(ID3D11Device *dev, HWND hWnd);
+		void OutputShaderErrorMessage(ID3D10Blob *errorMessage, HWND hWnd, WCHAR *path);
+		void Track(UINT64 bytes);
+	private:
+		ID3D11VertexShader* m_vertexShader{};
+		ID3D11PixelShader* m_pixelShader{};
+		ID3D11SamplerState* m_sampler{};
+		ID3D11Buffer* m_regionBuffer{};
+		// Bytes reported to the memory tracker, given back when the shader is destroyed.
+		UINT64 m_trackedBytes{};
+	};
+}
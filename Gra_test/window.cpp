@@ -1,17 +1,54 @@
 // window.cpp : definitions for windows.h file
 #include "stdafx.h"
 #include "window.h"
+#include "profiler.h"
+#include <cstdio>
 
+namespace
+{
+	// Set by the window procedure, the window and its graphics pick it up with the next step.
+	bool g_toggleCapture{};
+	bool g_defragment{};
+	// The point clicked last, picked with the next step.
+	bool g_pick{};
+	INT g_pickX{}, g_pickY{};
+	// The last size of the client area, the graphics follow it with the next step.
+	bool g_resize{};
+	INT g_resizeWidth{}, g_resizeHeight{};
+	// The keyboard and mouse input for the camera, stamped with the main loop's clock, see inputqueue.h.
+	core::inputqueue g_input{ core::INPUT_QUEUE_CAPACITY };
+	app::timesource *g_inputClock{};
+
+	// The time is taken when the message is handled, the time it waited in the message queue before is not seen.
+	void PushInput(core::inputtype type, std::uint32_t code, LPARAM lParam)
+	{
+		core::inputevent event{ g_inputClock->Now(), type, code, static_cast<short>(LOWORD(lParam)), static_cast<short>(HIWORD(lParam)) };
+		g_input.Push(event);
+	}
+}
 
-app::window::window(HINSTANCE hInstance, int windowHeight, int windowWidth) :
-	height(windowHeight), width(windowWidth)
+app::window::window(HINSTANCE hInstance, int windowHeight, int windowWidth, timesource& clock) :
+	height(windowHeight), width(windowWidth), m_clock(clock), m_cameraControl(graphics::cameracontrolsettings{})
 {
 	LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
 	LoadStringW(hInstance, IDC_GRATEST, szWindowClass, MAX_LOADSTRING);
+	g_inputClock = &clock;
 }
 
+// The renderer goes first so nothing is presented anymore while the latencies are read.
 app::window::~window()
 {
+	m_graphics.reset();
+
+	if (m_inputLatency.Count())
+	{
+		char line[160];
+		std::snprintf(line, sizeof(line), "Input latency over %llu frames: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms, %llu events dropped\n",
+			static_cast<unsigned long long>(m_inputLatency.Count()), 1000.0 * m_inputLatency.Percentile(0.5),
+			1000.0 * m_inputLatency.Percentile(0.95), 1000.0 * m_inputLatency.Percentile(0.99), 1000.0 * m_inputLatency.Max(),
+			static_cast<unsigned long long>(g_input.GetDropped()));
+		OutputDebugStringA(line);
+	}
 }
 
 //
@@ -68,14 +105,73 @@ BOOL app::window::InitInstance(HINSTANCE hInstance, int nCmdShow)
 
 	ShowWindow(hWnd, nCmdShow);
 	m_graphics = std::make_unique<graphics::graphics>(hWnd, width, height);
+
+	// Called on the render thread, which is the only one touching the latencies until the renderer is gone.
+	m_graphics->SetPresentCallback([this](std::uint64_t inputTime)
+	{
+		m_inputLatency.Record(static_cast<double>(m_clock.Now() - inputTime) / static_cast<double>(m_clock.Frequency()));
+	});
 	UpdateWindow(hWnd);
 
 	return TRUE;
 }
 
-void app::window::RenderFrame()
+void app::window::Update(double stepSeconds, std::uint64_t stepEndTick)
 {
-	m_graphics->Render();
+	// Captures start and stop between steps so a capture always holds whole steps.
+	if (g_toggleCapture)
+	{
+		g_toggleCapture = false;
+		if (m_graphics->IsCapturing())
+		{
+			m_graphics->StopCapture();
+		}
+		else
+		{
+			m_graphics->StartCapture("capture.grc");
+		}
+	}
+
+	if (g_defragment)
+	{
+		g_defragment = false;
+		m_graphics->DefragmentMeshes();
+	}
+
+	if (g_resize)
+	{
+		g_resize = false;
+		m_graphics->Resize(g_resizeWidth, g_resizeHeight);
+	}
+
+	if (g_pick)
+	{
+		g_pick = false;
+		FLOAT distance;
+		m_graphics->Pick(g_pickX, g_pickY, distance);
+	}
+
+	m_graphics->Update(static_cast<FLOAT>(stepSeconds));
+
+	// The camera is moved after the scene's step began, the step's movement ends up between its two states.
+	graphics::scene::camerastate camera;
+	std::uint64_t inputTime;
+	std::uint64_t stepTicks = static_cast<std::uint64_t>(stepSeconds * static_cast<double>(m_clock.Frequency()) + 0.5);
+
+	m_graphics->GetCamera(camera);
+	m_cameraControl.Step(g_input, stepEndTick - stepTicks, stepEndTick, m_clock.Frequency(), camera);
+	m_graphics->MoveCamera(camera);
+
+	if (m_cameraControl.TakeOldestInput(inputTime) and (m_pendingInput == 0 or inputTime < m_pendingInput))
+	{
+		m_pendingInput = inputTime;
+	}
+}
+
+void app::window::RenderFrame(double alpha)
+{
+	m_graphics->Render(static_cast<FLOAT>(alpha), m_pendingInput);
+	m_pendingInput = 0;
 }
 
 //
@@ -85,6 +181,10 @@ void app::window::RenderFrame()
 //
 //  WM_COMMAND  - process the application menu
 //  WM_PAINT    - Paint the main window
+//  WM_SIZE     - resize the graphics to the client area
+//  WM_LBUTTONDOWN - pick the instance under the cursor
+//  WM_KEYDOWN, WM_KEYUP, mouse buttons, moves and the wheel - queue the input for the camera
+//  WM_KILLFOCUS - let go of every key and button
 //  WM_DESTROY  - post a quit message and return
 //
 //
@@ -117,6 +217,83 @@ LRESULT CALLBACK app::WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPa
 		EndPaint(hWnd, &ps);
 	}
 	break;
+	case WM_SIZE:
+		// Minimizing reports a client area of nothing, the graphics keep their size until the window is restored.
+		if (wParam != SIZE_MINIMIZED)
+		{
+			g_resize = true;
+			g_resizeWidth = LOWORD(lParam);
+			g_resizeHeight = HIWORD(lParam);
+		}
+		break;
+	case WM_LBUTTONDOWN:
+		// The client coordinates are signed, they are negative on a second monitor left or above.
+		g_pick = true;
+		g_pickX = static_cast<short>(LOWORD(lParam));
+		g_pickY = static_cast<short>(HIWORD(lParam));
+		PushInput(core::inputtype::buttondown, static_cast<std::uint32_t>(core::mousebutton::left), lParam);
+		break;
+	case WM_LBUTTONUP:
+		PushInput(core::inputtype::buttonup, static_cast<std::uint32_t>(core::mousebutton::left), lParam);
+		break;
+	case WM_RBUTTONDOWN:
+		// The mouse stays captured while the camera is turned, so dragging out of the window keeps turning it.
+		SetCapture(hWnd);
+		PushInput(core::inputtype::buttondown, static_cast<std::uint32_t>(core::mousebutton::right), lParam);
+		break;
+	case WM_RBUTTONUP:
+		ReleaseCapture();
+		PushInput(core::inputtype::buttonup, static_cast<std::uint32_t>(core::mousebutton::right), lParam);
+		break;
+	case WM_MBUTTONDOWN:
+		PushInput(core::inputtype::buttondown, static_cast<std::uint32_t>(core::mousebutton::middle), lParam);
+		break;
+	case WM_MBUTTONUP:
+		PushInput(core::inputtype::buttonup, static_cast<std::uint32_t>(core::mousebutton::middle), lParam);
+		break;
+	case WM_MOUSEMOVE:
+		PushInput(core::inputtype::mousemove, 0, lParam);
+		break;
+	case WM_MOUSEWHEEL:
+		// The position of the wheel message is in screen coordinates and of no use, the x carries the wheel's delta.
+		PushInput(core::inputtype::wheel, 0, static_cast<LPARAM>(static_cast<std::uint16_t>(GET_WHEEL_DELTA_WPARAM(wParam))));
+		break;
+	case WM_KILLFOCUS:
+		PushInput(core::inputtype::focuslost, 0, 0);
+		break;
+	case WM_KEYUP:
+		PushInput(core::inputtype::keyup, static_cast<std::uint32_t>(wParam), 0);
+		break;
+	case WM_KEYDOWN:
+		// Keys held down repeat, only the first press goes into the queue.
+		if ((lParam & (1 << 30)) == 0)
+		{
+			PushInput(core::inputtype::keydown, static_cast<std::uint32_t>(wParam), 0);
+		}
+
+		// F5 compacts the mesh heap. F6 switches the debug lines on and off, F7 the profiler.
+		// F8 saves what the profiler recorded for chrome://tracing. F9 starts and stops capturing the session into capture.grc.
+		if (wParam == VK_F5)
+		{
+			g_defragment = true;
+		}
+		else if (wParam == VK_F6)
+		{
+			graphics::debugdraw::SetEnabled(!graphics::debugdraw::IsEnabled());
+		}
+		else if (wParam == VK_F7)
+		{
+			core::profiler::SetEnabled(!core::profiler::IsEnabled());
+		}
+		else if (wParam == VK_F8)
+		{
+			core::profiler::ExportChromeTrace("profile.json");
+		}
+		else if (wParam == VK_F9)
+		{
+			g_toggleCapture = true;
+		}
+		break;
 	case WM_DESTROY:
 		PostQuitMessage(0);
 		break;
@@ -5,6 +5,9 @@
 #include "stdafx.h"
 #include "resource.h"
 #include "graphics.h"
+#include "mainloop.h"
+#include "cameracontroller.h"
+#include "telemetry.h"
 #include <memory>
 
 namespace app
@@ -14,20 +17,31 @@ namespace app
 	LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 	INT_PTR CALLBACK About(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam);
 
-	class window
+	class window : public looptarget
 	{
 	public:
 		window() = delete;
-		window(HINSTANCE hInstance, int windowHeight, int windowWidth);
+		// The input is stamped with the clock, it has to be the time source of the main loop.
+		window(HINSTANCE hInstance, int windowHeight, int windowWidth, timesource& clock);
 		~window();
 		ATOM MyRegisterClass(HINSTANCE hInstance);
 		BOOL InitInstance(HINSTANCE hInstance, int nCmdShow);
-		void RenderFrame(void);
+		// Update and RenderFrame are called by the main loop,
+		// once per simulation step and once per rendered frame.
+		void Update(double stepSeconds, std::uint64_t stepEndTick) override;
+		void RenderFrame(double alpha) override;
 	private:
 		HINSTANCE hInst{};                              // current instance
 		WCHAR szTitle[MAX_LOADSTRING];                  // The title bar text
 		WCHAR szWindowClass[MAX_LOADSTRING];            // the main window class name
 		std::unique_ptr<graphics::graphics> m_graphics;
 		INT height{}, width{};
+		// The camera is flown with the input of the queue the window procedure fills.
+		// The time of the oldest input since the last frame goes with the next frame to the renderer,
+		// the time from it to the present of that frame is recorded as the input latency.
+		timesource& m_clock;
+		graphics::cameracontroller m_cameraControl;
+		std::uint64_t m_pendingInput{};
+		core::frametimehistogram m_inputLatency{};
 	};
 }
\ No newline at end of file
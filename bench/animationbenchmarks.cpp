@@ -0,0 +1,136 @@
+#include "enginebenchmarks.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "animation.h"
+#include "jobsystem.h"
+#include "meshdata.h"
+#include "skinning.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr std::uint32_t CHARACTER_BONES{ 32 };
+		constexpr FLOAT BONE_LENGTH{ 0.25f };
+		constexpr std::uint32_t CLIP_FRAMES{ 241 };
+		constexpr FLOAT CLIP_FPS{ 30.0f };
+		constexpr std::uint32_t TUBE_RINGS{ 4 };
+		constexpr std::uint32_t TUBE_SIDES{ 12 };
+
+		// A chain of bones with two clips of the same sway at different amplitudes, and a tube skinned to it.
+		struct characterassets
+		{
+			std::vector<UINT> parents;
+			std::vector<graphics::bonepose> bindPose;
+			std::vector<graphics::skinnedvertex> vertices;
+			std::vector<std::uint32_t> indices;
+			std::unique_ptr<graphics::skeleton> rig;
+			std::unique_ptr<graphics::animationclip> walk;
+			std::unique_ptr<graphics::animationclip> run;
+
+			characterassets() :
+				parents(CHARACTER_BONES), bindPose(CHARACTER_BONES),
+				vertices(graphics::TubeVertexCount(CHARACTER_BONES, TUBE_RINGS, TUBE_SIDES)),
+				indices(graphics::TubeIndexCount(CHARACTER_BONES, TUBE_RINGS, TUBE_SIDES))
+			{
+				std::vector<graphics::bonepose> frames(CHARACTER_BONES * CLIP_FRAMES);
+
+				graphics::BuildChainSkeleton(CHARACTER_BONES, BONE_LENGTH, parents.data(), bindPose.data());
+				rig = std::make_unique<graphics::skeleton>(parents.data(), bindPose.data(), CHARACTER_BONES);
+
+				graphics::BuildSwayFrames(CHARACTER_BONES, BONE_LENGTH, CLIP_FRAMES, 6.0f, frames.data());
+				walk = std::make_unique<graphics::animationclip>(frames.data(), CLIP_FRAMES, CHARACTER_BONES, CLIP_FPS);
+				graphics::BuildSwayFrames(CHARACTER_BONES, BONE_LENGTH, CLIP_FRAMES, 15.0f, frames.data());
+				run = std::make_unique<graphics::animationclip>(frames.data(), CLIP_FRAMES, CHARACTER_BONES, CLIP_FPS);
+
+				graphics::BuildTube(CHARACTER_BONES, TUBE_RINGS, TUBE_SIDES, BONE_LENGTH, 0.15f, D3DXVECTOR4(1.0f, 0.5f, 0.0f, 1.0f),
+					vertices.data(), indices.data());
+			}
+		};
+
+		// Every character plays the walk at its own time, every fourth one is blending over into the run.
+		std::vector<graphics::characterstate> Characters(const characterassets& assets, std::uint32_t count)
+		{
+			std::vector<graphics::characterstate> characters(count);
+
+			for (std::uint32_t i = 0; i < count; i++)
+			{
+				characters[i].clip = assets.walk.get();
+				characters[i].time = 0.37f * static_cast<FLOAT>(i);
+				if (i % 4 == 0)
+				{
+					characters[i].blendClip = assets.run.get();
+					characters[i].blendTime = characters[i].time;
+					characters[i].blendWeight = 0.5f;
+				}
+			}
+
+			return characters;
+		}
+
+		void CompressClip(runner& measure)
+		{
+			std::vector<graphics::bonepose> frames(CHARACTER_BONES * CLIP_FRAMES);
+			graphics::BuildSwayFrames(CHARACTER_BONES, BONE_LENGTH, CLIP_FRAMES, 15.0f, frames.data());
+
+			measure.SetItemsPerIteration(CHARACTER_BONES * CLIP_FRAMES);
+			measure.Run(10, [&]()
+			{
+				graphics::animationclip clip(frames.data(), CLIP_FRAMES, CHARACTER_BONES, CLIP_FPS);
+				Consume(clip.GetCompressedSize());
+			});
+		}
+
+		// Sampling two clips and blending them, the pose work of a character without the skinning.
+		void SampleBlend(runner& measure)
+		{
+			characterassets assets;
+			std::vector<graphics::bonepose> pose(CHARACTER_BONES), blendPose(CHARACTER_BONES);
+			std::vector<D3DXMATRIX> model(CHARACTER_BONES), palette(CHARACTER_BONES);
+			FLOAT time = 0.0f;
+
+			measure.SetItemsPerIteration(CHARACTER_BONES);
+			measure.Run(10000, [&]()
+			{
+				time += 0.013f;
+				assets.walk->Sample(time, pose.data());
+				assets.run->Sample(time, blendPose.data());
+				graphics::BlendPoses(pose.data(), blendPose.data(), 0.5f, CHARACTER_BONES, pose.data());
+				assets.rig->LocalToModel(pose.data(), model.data());
+				assets.rig->BuildPalette(model.data(), palette.data());
+				Consume(palette[CHARACTER_BONES - 1]._41);
+			});
+		}
+
+		// The whole frame of the characters: poses, palettes and skinning on all workers.
+		void AnimateCharacters(runner& measure, std::uint32_t count)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			characterassets assets;
+			graphics::characterskinner skinner(*assets.rig, assets.vertices.data(), static_cast<UINT>(assets.vertices.size()));
+			std::vector<graphics::characterstate> characters = Characters(assets, count);
+			std::vector<graphics::colorvertex> out(static_cast<std::size_t>(count) * skinner.GetVertexCount());
+
+			measure.SetItemsPerIteration(count);
+			measure.Run(5, [&]()
+			{
+				for (graphics::characterstate& character : characters)
+				{
+					character.time += 1.0f / 60.0f;
+					character.blendTime += 1.0f / 60.0f;
+				}
+				skinner.Animate(jobs, characters.data(), count, out.data());
+				Consume(out.back().position.y);
+			});
+		}
+	}
+
+	void RegisterAnimationBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("animation/compress_clip/bones:32", CompressClip);
+		benchmarks.Add("animation/sample_blend/bones:32", SampleBlend);
+		benchmarks.Add("animation/characters:100", [](runner& measure) { AnimateCharacters(measure, 100); });
+		benchmarks.Add("animation/characters:1000", [](runner& measure) { AnimateCharacters(measure, 1000); });
+	}
+}
@@ -0,0 +1,289 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace bench
+{
+	namespace
+	{
+		const char* CompilerName()
+		{
+#if defined(__clang__)
+			return "clang " __clang_version__;
+#elif defined(__GNUC__)
+			return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+			return "msvc";
+#else
+			return "unknown";
+#endif
+		}
+
+		void WriteEscaped(std::ofstream& file, const std::string& text)
+		{
+			for (char c : text)
+			{
+				if (c == '"' or c == '\\')
+				{
+					file << '\\';
+				}
+				file << c;
+			}
+		}
+	}
+
+	void runner::SetItemsPerIteration(double items)
+	{
+		m_result.itemsPerIteration = items;
+	}
+
+	void runner::SetMetric(const std::string& name, double value)
+	{
+		m_result.metrics.emplace_back(name, value);
+	}
+
+	void runner::Fail(const std::string& error)
+	{
+		m_result.error = error;
+	}
+
+	// The standard deviation is the sample one, the median of an even count is the mean of the middle two.
+	void runner::Record(std::vector<double>& samples)
+	{
+		benchmarkstats& stats = m_result.nanoseconds;
+
+		m_result.samples = static_cast<std::uint32_t>(samples.size());
+		if (samples.empty())
+		{
+			return;
+		}
+
+		std::sort(samples.begin(), samples.end());
+		std::size_t count = samples.size();
+
+		double sum = 0.0;
+		for (double sample : samples)
+		{
+			sum += sample;
+		}
+		stats.mean = sum / static_cast<double>(count);
+
+		double squares = 0.0;
+		for (double sample : samples)
+		{
+			squares += (sample - stats.mean) * (sample - stats.mean);
+		}
+		stats.stddev = count > 1 ? std::sqrt(squares / static_cast<double>(count - 1)) : 0.0;
+
+		stats.median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2.0;
+		stats.min = samples.front();
+		stats.max = samples.back();
+	}
+
+	void suite::Add(const std::string& name, benchmarkfunction function)
+	{
+		m_entries.push_back(entry{ name, function });
+	}
+
+	std::vector<benchmarkresult> suite::Run(const benchmarksettings& settings) const
+	{
+		std::vector<benchmarkresult> results;
+
+		for (const entry& current : m_entries)
+		{
+			if (current.name.find(settings.filter) == std::string::npos)
+			{
+				continue;
+			}
+
+			benchmarkresult result;
+			result.name = current.name;
+
+			runner measure(settings, result);
+			current.function(measure);
+
+			double itemsPerSecond = result.itemsPerIteration > 0.0 and result.nanoseconds.median > 0.0 ?
+				result.itemsPerIteration * 1000000000.0 / result.nanoseconds.median : 0.0;
+			std::printf("%-40s %14.1f ns  +-%5.1f%%  (min %.1f, max %.1f)", result.name.c_str(), result.nanoseconds.median,
+				result.nanoseconds.mean > 0.0 ? 100.0 * result.nanoseconds.stddev / result.nanoseconds.mean : 0.0,
+				result.nanoseconds.min, result.nanoseconds.max);
+			if (itemsPerSecond > 0.0)
+			{
+				std::printf("  %.3g items/s", itemsPerSecond);
+			}
+			for (const std::pair<std::string, double>& metric : result.metrics)
+			{
+				std::printf("  %s %.4g", metric.first.c_str(), metric.second);
+			}
+			if (!result.error.empty())
+			{
+				std::printf("  FAILED: %s", result.error.c_str());
+			}
+			std::printf("\n");
+			std::fflush(stdout);
+
+			results.push_back(result);
+		}
+
+		return results;
+	}
+
+	void suite::List() const
+	{
+		for (const entry& current : m_entries)
+		{
+			std::printf("%s\n", current.name.c_str());
+		}
+	}
+
+	std::uint32_t Failed(const std::vector<benchmarkresult>& results)
+	{
+		std::uint32_t failed = 0;
+		for (const benchmarkresult& result : results)
+		{
+			failed += result.error.empty() ? 0 : 1;
+		}
+		return failed;
+	}
+
+	bool PinThread(int cpu)
+	{
+#if defined(_WIN32)
+		return cpu >= 0 and cpu < 64 and SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+		if (cpu < 0 or cpu >= CPU_SETSIZE)
+		{
+			return false;
+		}
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		(void)cpu;
+		return false;
+#endif
+	}
+
+	bool WriteJson(const char *path, const benchmarksettings& settings, const std::vector<benchmarkresult>& results)
+	{
+		std::ofstream file(path, std::ios::out | std::ios::trunc);
+		if (file.fail())
+		{
+			return false;
+		}
+
+		file.precision(17);
+		file << "{\n\"context\": {\"time\": " << static_cast<long long>(std::time(nullptr))
+			<< ", \"compiler\": \"";
+		WriteEscaped(file, CompilerName());
+		file << "\", \"build\": \""
+#ifdef NDEBUG
+			"release"
+#else
+			"debug"
+#endif
+			<< "\", \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"samples\": " << settings.samples << ", \"warmup_samples\": " << settings.warmupSamples
+			<< ", \"cpu\": " << settings.cpu << "},\n\"benchmarks\": [";
+
+		for (std::size_t i = 0; i < results.size(); i++)
+		{
+			const benchmarkresult& result = results[i];
+			const benchmarkstats& stats = result.nanoseconds;
+
+			file << (i ? ",\n" : "\n") << "{\"name\": \"";
+			WriteEscaped(file, result.name);
+			file << "\", \"iterations\": " << result.iterations << ", \"samples\": " << result.samples
+				<< ", \"ns_per_iteration\": {\"mean\": " << stats.mean << ", \"median\": " << stats.median
+				<< ", \"stddev\": " << stats.stddev << ", \"min\": " << stats.min << ", \"max\": " << stats.max << "}"
+				<< ", \"items_per_iteration\": " << result.itemsPerIteration;
+			if (!result.metrics.empty())
+			{
+				file << ", \"metrics\": {";
+				for (std::size_t j = 0; j < result.metrics.size(); j++)
+				{
+					file << (j ? ", \"" : "\"");
+					WriteEscaped(file, result.metrics[j].first);
+					file << "\": " << result.metrics[j].second;
+				}
+				file << "}";
+			}
+			if (!result.error.empty())
+			{
+				file << ", \"error\": \"";
+				WriteEscaped(file, result.error);
+				file << "\"";
+			}
+			file << "}";
+		}
+
+		file << "\n]\n}\n";
+		file.close();
+
+		return !file.fail();
+	}
+
+	// Only files written by WriteJson are read, so the names and medians are simply searched for
+	// instead of parsing the JSON properly.
+	int Compare(const char *baselinePath, const std::vector<benchmarkresult>& results, double threshold)
+	{
+		std::ifstream file(baselinePath);
+		if (file.fail())
+		{
+			return -1;
+		}
+
+		std::stringstream contents;
+		contents << file.rdbuf();
+		const std::string text = contents.str();
+		const std::string nameKey = "{\"name\": \"";
+		const std::string medianKey = "\"median\": ";
+		int regressions = 0;
+
+		for (std::size_t at = text.find(nameKey); at != std::string::npos; at = text.find(nameKey, at))
+		{
+			at += nameKey.size();
+			std::size_t nameEnd = text.find('"', at);
+			std::size_t median = text.find(medianKey, at);
+			if (nameEnd == std::string::npos or median == std::string::npos)
+			{
+				break;
+			}
+
+			std::string name = text.substr(at, nameEnd - at);
+			double baseline = std::strtod(text.c_str() + median + medianKey.size(), nullptr);
+
+			for (const benchmarkresult& result : results)
+			{
+				if (result.name != name or baseline <= 0.0)
+				{
+					continue;
+				}
+
+				double change = result.nanoseconds.median / baseline - 1.0;
+				bool regressed = change > threshold;
+				regressions += regressed ? 1 : 0;
+				std::printf("%-40s %14.1f -> %14.1f ns  %+6.1f%%%s\n", name.c_str(), baseline, result.nanoseconds.median,
+					change * 100.0, regressed ? "  REGRESSION" : "");
+			}
+		}
+
+		return regressions;
+	}
+}
@@ -0,0 +1,141 @@
+// benchmark.h : include file for the benchmark harness
+// A benchmark sets up what it needs and hands the code to measure to runner::Run.
+// The body runs a fixed number of iterations per sample, set by the benchmark itself
+// and never tuned at runtime, so the same benchmark does the same work on every run and every commit.
+// Some samples are run and thrown away first to warm up caches, branch predictors and the allocator,
+// the measured ones are reported as mean, median, standard deviation, minimum and maximum time per iteration.
+// Results are written as JSON and can be compared against the JSON of an earlier run.
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+	struct benchmarkstats
+	{
+		double mean{}, median{}, stddev{}, min{}, max{};
+	};
+
+	struct benchmarkresult
+	{
+		std::string name;
+		std::uint64_t iterations{};
+		std::uint32_t samples{};
+		// Nanoseconds per iteration.
+		benchmarkstats nanoseconds{};
+		// Work items per iteration (vertices, entities, jobs), 0 when the benchmark does not report any.
+		double itemsPerIteration{};
+		// Values measured besides the time, like the quality of a compression, by name.
+		std::vector<std::pair<std::string, double>> metrics{};
+		// Set when the benchmark found its results to be wrong, the timings are reported anyway.
+		std::string error{};
+	};
+
+	struct benchmarksettings
+	{
+		std::uint32_t samples{ 15 };
+		std::uint32_t warmupSamples{ 3 };
+		std::string filter{};
+		// The CPU the measuring thread is pinned to, -1 leaves it to the scheduler.
+		int cpu{ -1 };
+	};
+
+	class runner
+	{
+	public:
+		runner() = delete;
+		runner(const benchmarksettings& settings, benchmarkresult& result) : m_settings(settings), m_result(result) {};
+		runner(const runner& other) = delete;
+
+		runner& operator=(const runner& other) = delete;
+
+		// Run calls body() iterations times per sample. Benchmarks call it once.
+		template<typename F>
+		void Run(std::uint64_t iterations, F&& body);
+
+		void SetItemsPerIteration(double items);
+		void SetMetric(const std::string& name, double value);
+		void Fail(const std::string& error);
+	private:
+		void Record(std::vector<double>& samples);
+
+		const benchmarksettings& m_settings;
+		benchmarkresult& m_result;
+	};
+
+	typedef std::function<void(runner& measure)> benchmarkfunction;
+
+	class suite
+	{
+	public:
+		void Add(const std::string& name, benchmarkfunction function);
+
+		// Run runs every benchmark whose name contains the filter, in the order they were added.
+		std::vector<benchmarkresult> Run(const benchmarksettings& settings) const;
+		void List() const;
+	private:
+		struct entry
+		{
+			std::string name;
+			benchmarkfunction function;
+		};
+
+		std::vector<entry> m_entries{};
+	};
+
+	// Keeps the compiler from throwing away the computation of a value that is not used otherwise.
+	template<typename T>
+	inline void Consume(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const void *s_sink;
+		s_sink = &value;
+#endif
+	}
+
+	// Pins the calling thread to one CPU, returns false when the platform refuses.
+	bool PinThread(int cpu);
+
+	// Failed counts the results with an error.
+	std::uint32_t Failed(const std::vector<benchmarkresult>& results);
+
+	bool WriteJson(const char *path, const benchmarksettings& settings, const std::vector<benchmarkresult>& results);
+
+	// Compare prints the change of the median of every benchmark found in the baseline JSON.
+	// It returns the number of benchmarks that got slower by more than the threshold (0.05 is 5%), -1 when the file cannot be read.
+	int Compare(const char *baselinePath, const std::vector<benchmarkresult>& results, double threshold);
+
+	template<typename F>
+	void runner::Run(std::uint64_t iterations, F&& body)
+	{
+		std::vector<double> samples;
+		samples.reserve(m_settings.samples);
+
+		m_result.iterations = iterations;
+
+		for (std::uint32_t sample = 0; sample < m_settings.warmupSamples + m_settings.samples; sample++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			for (std::uint64_t i = 0; i < iterations; i++)
+			{
+				body();
+			}
+			auto end = std::chrono::steady_clock::now();
+
+			if (sample >= m_settings.warmupSamples)
+			{
+				std::chrono::duration<double, std::nano> elapsed = end - start;
+				samples.push_back(elapsed.count() / static_cast<double>(iterations));
+			}
+		}
+
+		Record(samples);
+	}
+}
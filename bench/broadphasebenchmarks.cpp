@@ -0,0 +1,126 @@
+#include "enginebenchmarks.h"
+#include <cstdint>
+#include <vector>
+#include "broadphase.h"
+#include "jobsystem.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr UINT BODY_COUNT{ 50000 };
+		constexpr FLOAT STEP_SECONDS{ 1.0f / 60.0f };
+		constexpr FLOAT RADIUS{ 1.0f };
+		// The bodies fly around a flat box, a few overlaps per body like a crowded level.
+		const D3DXVECTOR3 WORLD_SIZE(400.0f, 40.0f, 400.0f);
+
+		struct body
+		{
+			D3DXVECTOR3 position;
+			D3DXVECTOR3 velocity;
+		};
+
+		std::vector<body> BuildBodies()
+		{
+			std::vector<body> bodies(BODY_COUNT);
+			std::uint32_t random = 1;
+			auto next = [&random]()
+			{
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				return static_cast<FLOAT>(random >> 8) * (1.0f / 16777216.0f);
+			};
+
+			for (body& moving : bodies)
+			{
+				moving.position = D3DXVECTOR3(next() * WORLD_SIZE.x, next() * WORLD_SIZE.y, next() * WORLD_SIZE.z);
+				moving.velocity = D3DXVECTOR3(next() - 0.5f, next() - 0.5f, next() - 0.5f) * 20.0f;
+			}
+			return bodies;
+		}
+
+		graphics::aabb GetBounds(const body& moving)
+		{
+			D3DXVECTOR3 extent(RADIUS, RADIUS, RADIUS);
+			return graphics::aabb{ moving.position - extent, moving.position + extent };
+		}
+
+		// The bodies bounce off the walls of the world.
+		void Move(std::vector<body>& bodies)
+		{
+			for (body& moving : bodies)
+			{
+				moving.position += moving.velocity * STEP_SECONDS;
+				FLOAT *position = &moving.position.x, *velocity = &moving.velocity.x;
+				const FLOAT *size = &WORLD_SIZE.x;
+				for (UINT axis = 0; axis < 3; axis++)
+				{
+					if (position[axis] < 0.0f or position[axis] > size[axis])
+					{
+						velocity[axis] = -velocity[axis];
+					}
+				}
+			}
+		}
+
+		// A step of moving bodies: the order is repaired, the boxes swept and the pairs compared with the last step.
+		// Moving the bodies is part of the loop but small next to the update.
+		void Update(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			std::vector<body> bodies = BuildBodies();
+			graphics::broadphase pairs;
+			std::vector<graphics::broadphase::proxy> proxies;
+
+			for (const body& moving : bodies)
+			{
+				proxies.push_back(pairs.Add(GetBounds(moving)));
+			}
+			pairs.Update(jobs);
+
+			UINT64 swaps = 0, steps = 0;
+			measure.SetItemsPerIteration(BODY_COUNT);
+			measure.Run(10, [&]()
+			{
+				Move(bodies);
+				for (UINT i = 0; i < BODY_COUNT; i++)
+				{
+					pairs.SetBounds(proxies[i], GetBounds(bodies[i]));
+				}
+				pairs.Update(jobs);
+				swaps += pairs.GetStats().swaps;
+				steps++;
+				Consume(pairs.GetPairs().size());
+			});
+
+			measure.SetMetric("pairs", static_cast<double>(pairs.GetStats().pairs));
+			measure.SetMetric("swaps_per_step", static_cast<double>(swaps) / static_cast<double>(steps ? steps : 1));
+		}
+
+		// Building the broadphase from nothing, what loading a level costs: a full sort in pieces and the sweep.
+		void Build(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			std::vector<body> bodies = BuildBodies();
+
+			measure.SetItemsPerIteration(BODY_COUNT);
+			measure.Run(5, [&]()
+			{
+				graphics::broadphase pairs;
+				for (const body& moving : bodies)
+				{
+					pairs.Add(GetBounds(moving));
+				}
+				pairs.Update(jobs);
+				Consume(pairs.GetPairs().size());
+			});
+		}
+	}
+
+	void RegisterBroadphaseBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("broadphase/update/bodies:50000", Update);
+		benchmarks.Add("broadphase/build/bodies:50000", Build);
+	}
+}
@@ -0,0 +1,357 @@
+#include "enginebenchmarks.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "allocators.h"
+#include "entitystore.h"
+#include "jobsystem.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include "ringallocator.h"
+#include "scenecomponents.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr std::uint32_t PARALLEL_ELEMENTS{ 1 << 20 };
+		constexpr std::uint32_t ALLOCATIONS{ 1024 };
+
+		void Transform(const float *input, float *output, std::uint32_t begin, std::uint32_t end)
+		{
+			for (std::uint32_t i = begin; i < end; i++)
+			{
+				output[i] = std::sqrt(input[i]) * 0.5f + 1.0f;
+			}
+		}
+
+		// The baseline the parallel versions are compared against, no job system at all.
+		void SerialFor(runner& measure)
+		{
+			std::vector<float> input(PARALLEL_ELEMENTS, 2.0f), output(PARALLEL_ELEMENTS);
+
+			measure.SetItemsPerIteration(PARALLEL_ELEMENTS);
+			measure.Run(20, [&]()
+			{
+				Transform(input.data(), output.data(), 0, PARALLEL_ELEMENTS);
+				Consume(output[PARALLEL_ELEMENTS - 1]);
+			});
+		}
+
+		void ParallelFor(runner& measure, std::uint32_t threads)
+		{
+			core::jobsystem jobs(threads - 1);
+			std::vector<float> input(PARALLEL_ELEMENTS, 2.0f), output(PARALLEL_ELEMENTS);
+
+			measure.SetItemsPerIteration(PARALLEL_ELEMENTS);
+			measure.Run(20, [&]()
+			{
+				jobs.ParallelFor(PARALLEL_ELEMENTS, 4096, [&](std::uint32_t begin, std::uint32_t end)
+				{
+					Transform(input.data(), output.data(), begin, end);
+				});
+				Consume(output[PARALLEL_ELEMENTS - 1]);
+			});
+		}
+
+		// Scheduling overhead: jobs that do nothing, spread over every worker.
+		void EmptyJobs(runner& measure)
+		{
+			constexpr std::uint32_t JOBS{ 1000 };
+			core::jobsystem jobs(core::jobsystem::AUTO);
+
+			measure.SetItemsPerIteration(JOBS);
+			measure.Run(100, [&]()
+			{
+				core::jobcounter counter;
+				for (std::uint32_t i = 0; i < JOBS; i++)
+				{
+					jobs.Run([]() {}, &counter);
+				}
+				jobs.Wait(counter);
+			});
+		}
+
+		// More jobs at once than a worker has slots, every one of them has to run exactly once.
+		void SlotReuse(runner& measure)
+		{
+			constexpr std::uint32_t JOBS{ 3 * core::JOB_QUEUE_SIZE };
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			std::vector<std::atomic<std::uint32_t>> runs(JOBS);
+			std::string failure;
+
+			measure.SetItemsPerIteration(JOBS);
+			measure.Run(20, [&]()
+			{
+				core::jobcounter counter;
+				for (auto& count : runs)
+				{
+					count.store(0, std::memory_order_relaxed);
+				}
+				for (std::uint32_t i = 0; i < JOBS; i++)
+				{
+					std::atomic<std::uint32_t> *count = &runs[i];
+					jobs.Run([count]() { count->fetch_add(1, std::memory_order_relaxed); }, &counter);
+				}
+				jobs.Wait(counter);
+
+				for (std::uint32_t i = 0; i < JOBS and failure.empty(); i++)
+				{
+					if (runs[i].load(std::memory_order_relaxed) != 1)
+					{
+						failure = "Job " + std::to_string(i) + " ran " + std::to_string(runs[i].load()) + " times.";
+					}
+				}
+			});
+
+			if (!failure.empty())
+			{
+				measure.Fail(failure);
+			}
+		}
+
+		void EntityIteration(runner& measure)
+		{
+			constexpr std::uint32_t ENTITIES{ 100000 };
+			core::entitystore entities;
+			graphics::transform placement{ D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3(0.0f, 0.0f, 0.0f), 1.0f };
+
+			for (std::uint32_t i = 0; i < ENTITIES; i++)
+			{
+				entities.Create(placement);
+			}
+
+			measure.SetItemsPerIteration(ENTITIES);
+			measure.Run(50, [&]()
+			{
+				entities.ForEachChunk<graphics::transform>([](std::uint32_t count, const core::entity *, graphics::transform *transforms)
+				{
+					for (std::uint32_t i = 0; i < count; i++)
+					{
+						transforms[i].position.x += 0.01f;
+					}
+				});
+			});
+		}
+
+		// Creating and destroying moves rows between chunks and recycles the entity slots.
+		void EntityChurn(runner& measure)
+		{
+			constexpr std::uint32_t ENTITIES{ 10000 };
+			core::entitystore entities;
+			std::vector<core::entity> created(ENTITIES);
+			graphics::transform placement{ D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3(0.0f, 0.0f, 0.0f), 1.0f };
+			graphics::worldtransform world{};
+
+			measure.SetItemsPerIteration(ENTITIES);
+			measure.Run(20, [&]()
+			{
+				for (std::uint32_t i = 0; i < ENTITIES; i++)
+				{
+					created[i] = entities.Create(placement, world);
+				}
+				for (std::uint32_t i = 0; i < ENTITIES; i++)
+				{
+					entities.Destroy(created[(i * 7919) % ENTITIES]);
+				}
+			});
+		}
+
+		void LinearAllocations(runner& measure)
+		{
+			core::linearallocator arena(ALLOCATIONS * 64);
+
+			measure.SetItemsPerIteration(ALLOCATIONS);
+			measure.Run(1000, [&]()
+			{
+				for (std::uint32_t i = 0; i < ALLOCATIONS; i++)
+				{
+					Consume(arena.Allocate(48));
+				}
+				arena.Reset();
+			});
+		}
+
+		// A frame of allocations of 1 to 61 bytes at the 12 byte stride of a vertex, made by jobs on all threads.
+		// None may fail or overlap another, and the bytes asked for have to be counted without the padding.
+		void RingAllocations(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::ringallocator ring(ALLOCATIONS * 128);
+			std::vector<std::uint32_t> offsets(ALLOCATIONS);
+			std::uint64_t frame = 0, requested = 0;
+			std::string failure;
+
+			for (std::uint32_t i = 0; i < ALLOCATIONS; i++)
+			{
+				requested += 1 + i % 61;
+			}
+
+			measure.SetItemsPerIteration(ALLOCATIONS);
+			measure.Run(1000, [&]()
+			{
+				frame++;
+				ring.BeginFrame(frame, frame > 2 ? frame - 2 : 0, ALLOCATIONS * 48);
+				jobs.ParallelFor(ALLOCATIONS, 64, [&](std::uint32_t begin, std::uint32_t end)
+				{
+					for (std::uint32_t i = begin; i < end; i++)
+					{
+						offsets[i] = ring.Allocate(1 + i % 61, 12);
+					}
+				});
+				ring.EndFrame();
+
+				std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges;
+				for (std::uint32_t i = 0; i < ALLOCATIONS; i++)
+				{
+					ranges.emplace_back(offsets[i], offsets[i] + 1 + i % 61);
+				}
+				std::sort(ranges.begin(), ranges.end());
+
+				if (ring.GetFailedAllocations() or ring.GetFrameRequested() != requested or ring.GetFrameUsage() < requested)
+				{
+					failure = "Frame " + std::to_string(frame) + " counted " + std::to_string(ring.GetFrameRequested()) + " bytes instead of " +
+						std::to_string(requested) + " with " + std::to_string(ring.GetFailedAllocations()) + " failed allocations.";
+				}
+				for (std::uint32_t i = 1; i < ALLOCATIONS and failure.empty(); i++)
+				{
+					if (ranges[i].first < ranges[i - 1].second or ranges[i].first % 12)
+					{
+						failure = "Frame " + std::to_string(frame) + " handed out overlapping or unaligned offsets.";
+					}
+				}
+				Consume(ranges.back().second);
+			});
+
+			if (!failure.empty())
+			{
+				measure.Fail(failure);
+			}
+		}
+
+		void PoolAllocations(runner& measure)
+		{
+			core::poolallocator pool(48, ALLOCATIONS);
+			std::vector<void*> blocks(ALLOCATIONS);
+
+			measure.SetItemsPerIteration(ALLOCATIONS);
+			measure.Run(1000, [&]()
+			{
+				for (std::uint32_t i = 0; i < ALLOCATIONS; i++)
+				{
+					blocks[i] = pool.Allocate();
+				}
+				for (std::uint32_t i = 0; i < ALLOCATIONS; i++)
+				{
+					pool.Free(blocks[i]);
+				}
+			});
+		}
+
+		// What the engine allocators replace.
+		void HeapAllocations(runner& measure)
+		{
+			std::vector<void*> blocks(ALLOCATIONS);
+
+			measure.SetItemsPerIteration(ALLOCATIONS);
+			measure.Run(1000, [&]()
+			{
+				for (std::uint32_t i = 0; i < ALLOCATIONS; i++)
+				{
+					blocks[i] = std::malloc(48);
+					Consume(blocks[i]);
+				}
+				for (std::uint32_t i = 0; i < ALLOCATIONS; i++)
+				{
+					std::free(blocks[i]);
+				}
+			});
+		}
+
+		// The cost every tracked allocation pays on top of the allocation itself.
+		void TrackedAllocations(runner& measure)
+		{
+			measure.SetItemsPerIteration(ALLOCATIONS);
+			measure.Run(1000, []()
+			{
+				for (std::uint32_t i = 0; i < ALLOCATIONS; i++)
+				{
+					core::memorytracker::Allocated(core::memorytag::general, 48);
+				}
+				for (std::uint32_t i = 0; i < ALLOCATIONS; i++)
+				{
+					core::memorytracker::Freed(core::memorytag::general, 48);
+				}
+			});
+		}
+
+		void ProfilerScope(runner& measure, bool enabled)
+		{
+			bool wasEnabled = core::profiler::IsEnabled();
+
+			core::profiler::SetEnabled(enabled);
+			measure.Run(1000000, []()
+			{
+				PROFILE_SCOPE("benchmark");
+			});
+			core::profiler::SetEnabled(wasEnabled);
+		}
+
+		// Threads that record a scope and end one after the other. The ring the first one leaves behind
+		// is handed to all the others, so at most one ring may be created.
+		void ProfilerThreads(runner& measure)
+		{
+			bool wasEnabled = core::profiler::IsEnabled();
+			std::uint64_t rings = core::memorytracker::GetStats(core::memorytag::profiler).allocations;
+
+			core::profiler::SetEnabled(true);
+			measure.Run(100, []()
+			{
+				std::thread recording([]()
+				{
+					PROFILE_SCOPE("benchmark");
+				});
+				recording.join();
+			});
+			core::profiler::SetEnabled(wasEnabled);
+
+			rings = core::memorytracker::GetStats(core::memorytag::profiler).allocations - rings;
+			if (rings > 1)
+			{
+				measure.Fail(std::to_string(rings) + " rings were created for threads that never ran at the same time.");
+			}
+		}
+	}
+
+	void RegisterCoreBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("jobs/parallel_for/serial", SerialFor);
+
+		// Thread counts double up to the hardware threads, which are always included.
+		std::uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		for (std::uint32_t threads = 1; threads == 1 or threads / 2 < hardwareThreads; threads *= 2)
+		{
+			std::uint32_t count = threads < hardwareThreads ? threads : hardwareThreads;
+			benchmarks.Add("jobs/parallel_for/threads:" + std::to_string(count),
+				[count](runner& measure) { ParallelFor(measure, count); });
+		}
+
+		benchmarks.Add("jobs/empty_jobs", EmptyJobs);
+		benchmarks.Add("jobs/slot_reuse", SlotReuse);
+		benchmarks.Add("entities/for_each_chunk", EntityIteration);
+		benchmarks.Add("entities/create_destroy", EntityChurn);
+		benchmarks.Add("allocators/linear", LinearAllocations);
+		benchmarks.Add("allocators/ring", RingAllocations);
+		benchmarks.Add("allocators/pool", PoolAllocations);
+		benchmarks.Add("allocators/heap", HeapAllocations);
+		benchmarks.Add("allocators/memory_tracking", TrackedAllocations);
+		benchmarks.Add("profiler/scope_disabled", [](runner& measure) { ProfilerScope(measure, false); });
+		benchmarks.Add("profiler/scope_enabled", [](runner& measure) { ProfilerScope(measure, true); });
+		benchmarks.Add("profiler/thread_rings", ProfilerThreads);
+	}
+}
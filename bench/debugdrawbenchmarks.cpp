@@ -0,0 +1,129 @@
+#include "enginebenchmarks.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "debugdraw.h"
+#include "jobsystem.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr UINT DISABLED_CALLS{ 1000000 };
+		constexpr UINT JOB_BOXES{ 2000 };
+		constexpr UINT BOX_VERTICES{ 24 };
+
+		// Empties the buffers of all threads so a benchmark starts without the lines of another one.
+		void Discard()
+		{
+			std::vector<graphics::colorvertex> vertices(graphics::debugdraw::GetVertexCount());
+			graphics::debugdraw::Collect(vertices.data(), static_cast<UINT>(vertices.size()));
+		}
+
+		// Boxes drawn while the debug lines are off, which is what every draw costs in a build that keeps them.
+		void Disabled(runner& measure)
+		{
+			D3DXVECTOR4 color(1.0f, 1.0f, 1.0f, 1.0f);
+			graphics::debugdraw::SetEnabled(false);
+			Discard();
+
+			measure.SetItemsPerIteration(DISABLED_CALLS);
+			measure.Run(20, [&]()
+			{
+				for (UINT i = 0; i < DISABLED_CALLS; i++)
+				{
+					FLOAT x = static_cast<FLOAT>(i);
+					graphics::debugdraw::Box(D3DXVECTOR3(x, 0.0f, 0.0f), D3DXVECTOR3(x + 1.0f, 1.0f, 1.0f), color);
+				}
+				Consume(color.x);
+			});
+
+			if (graphics::debugdraw::GetVertexCount())
+			{
+				measure.Fail("Lines were added while drawing was off.");
+			}
+		}
+
+		// Every job draws boxes into the buffer of its thread, then all of them are collected into one line list.
+		// No line may be lost or dropped on the way.
+		void Jobs(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			std::vector<graphics::colorvertex> vertices;
+			D3DXVECTOR4 color(0.0f, 1.0f, 0.0f, 1.0f);
+			UINT collected = 0;
+			UINT64 dropped = graphics::debugdraw::GetDropped();
+			graphics::debugdraw::SetEnabled(true);
+			Discard();
+
+			measure.SetItemsPerIteration(JOB_BOXES);
+			measure.Run(50, [&]()
+			{
+				jobs.ParallelFor(JOB_BOXES, 64, [&](std::uint32_t begin, std::uint32_t end)
+				{
+					for (std::uint32_t i = begin; i < end; i++)
+					{
+						FLOAT x = static_cast<FLOAT>(i);
+						graphics::debugdraw::Box(D3DXVECTOR3(x, 0.0f, 0.0f), D3DXVECTOR3(x + 1.0f, 1.0f, 1.0f), color);
+					}
+				});
+
+				vertices.resize(graphics::debugdraw::GetVertexCount());
+				collected = graphics::debugdraw::Collect(vertices.data(), static_cast<UINT>(vertices.size()));
+				Consume(collected);
+			});
+
+			graphics::debugdraw::SetEnabled(false);
+			measure.SetMetric("vertices", collected);
+			if (collected != JOB_BOXES * BOX_VERTICES)
+			{
+				measure.Fail(std::to_string(collected) + " vertices were collected instead of " + std::to_string(JOB_BOXES * BOX_VERTICES) + ".");
+			}
+			else if (graphics::debugdraw::GetDropped() != dropped)
+			{
+				measure.Fail("Lines were dropped.");
+			}
+		}
+
+		// The corners of a camera's frustum have to land on the corners of the clip space cube when projected.
+		void Frustum(runner& measure)
+		{
+			D3DXMATRIX view, projection;
+			D3DXVECTOR3 eye(3.0f, 4.0f, -10.0f), at(0.0f, 0.0f, 0.0f), up(0.0f, 1.0f, 0.0f);
+			D3DXMatrixLookAtLH(&view, &eye, &at, &up);
+			D3DXMatrixPerspectiveFovLH(&projection, 0.785f, 16.0f / 9.0f, 0.1f, 1000.0f);
+			D3DXMATRIX viewProjection = view * projection;
+			D3DXVECTOR3 corners[8];
+
+			measure.Run(100000, [&]()
+			{
+				graphics::debugdraw::FrustumCorners(viewProjection, corners);
+				Consume(corners[7].z);
+			});
+
+			FLOAT error = 0.0f;
+			for (UINT i = 0; i < 8; i++)
+			{
+				D3DXVECTOR3 projected;
+				D3DXVec3TransformCoord(&projected, &corners[i], &viewProjection);
+				error = (std::max)(error, std::fabs(projected.x - (i & 1 ? 1.0f : -1.0f)));
+				error = (std::max)(error, std::fabs(projected.y - (i & 2 ? 1.0f : -1.0f)));
+				error = (std::max)(error, std::fabs(projected.z - (i & 4 ? 1.0f : 0.0f)));
+			}
+
+			measure.SetMetric("max_error", error);
+			if (error > 1e-3f)
+			{
+				measure.Fail("A frustum corner is off by " + std::to_string(error) + ".");
+			}
+		}
+	}
+
+	void RegisterDebugDrawBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("debugdraw/disabled", Disabled);
+		benchmarks.Add("debugdraw/jobs", Jobs);
+		benchmarks.Add("debugdraw/frustum", Frustum);
+	}
+}
@@ -0,0 +1,62 @@
+// enginebenchmarks.h : include file for the benchmarks of the engine code
+// The render benchmarks cover the device independent half of drawing a frame:
+// the camera, the shader parameter packing, mesh processing and whole CPU frames on the null renderer.
+// The lighting benchmarks cover assigning hundreds to thousands of lights to the clusters of the view frustum.
+// The resolution benchmarks run the dynamic resolution controller over synthetic frame time traces and check where it ends up.
+// The loop benchmarks drive the main loop with a manual clock and scripted messages and check its steps, stalls and quitting.
+// The input benchmarks cover the input queue with and without a producer thread and fly the camera over synthetic events.
+// The sprite benchmarks cover batching ten thousand sprites, laying out text and packing the glyph atlas.
+// The debug draw benchmarks cover drawing while switched off, collecting the lines jobs drew and frustum corners.
+// The animation benchmarks cover clip compression, pose sampling and blending and skinning whole crowds of characters.
+// The broadphase benchmarks cover updating and building the pairs of fifty thousand moving bodies.
+// The picking benchmarks cover casting rays against and building the BVH of a mesh of a million triangles.
+// The particle benchmarks cover the update and the vertex output of a million particles.
+// The terrain benchmarks cover building chunk meshes and picking and streaming chunks for a moving camera.
+// The texture benchmarks cover filtering mip chains and cooking them to BC1 and BC3, with the PSNR of the result,
+// and streaming the mips of a few hundred textures for a moving camera.
+// The core benchmarks cover the job system, the entity store, the allocators and the profiler, and check the ring allocator
+// and that the profiler reuses the rings of threads that ended.
+// The replay benchmarks replay a synthetic capture and any capture files given on the command line.
+#pragma once
+
+#include <string>
+#include <vector>
+#include "benchmark.h"
+
+namespace bench
+{
+	void RegisterRenderBenchmarks(suite& benchmarks);
+	void RegisterLightingBenchmarks(suite& benchmarks);
+	void RegisterResolutionBenchmarks(suite& benchmarks);
+	void RegisterLoopBenchmarks(suite& benchmarks);
+	void RegisterInputBenchmarks(suite& benchmarks);
+	void RegisterSpriteBenchmarks(suite& benchmarks);
+	void RegisterDebugDrawBenchmarks(suite& benchmarks);
+	void RegisterAnimationBenchmarks(suite& benchmarks);
+	void RegisterBroadphaseBenchmarks(suite& benchmarks);
+	void RegisterPickingBenchmarks(suite& benchmarks);
+	void RegisterParticleBenchmarks(suite& benchmarks);
+	void RegisterTerrainBenchmarks(suite& benchmarks);
+	void RegisterTextureBenchmarks(suite& benchmarks);
+	void RegisterCoreBenchmarks(suite& benchmarks);
+	void RegisterReplayBenchmarks(suite& benchmarks, const std::vector<std::string>& captures);
+
+	inline void RegisterEngineBenchmarks(suite& benchmarks, const std::vector<std::string>& captures)
+	{
+		RegisterRenderBenchmarks(benchmarks);
+		RegisterLightingBenchmarks(benchmarks);
+		RegisterResolutionBenchmarks(benchmarks);
+		RegisterLoopBenchmarks(benchmarks);
+		RegisterInputBenchmarks(benchmarks);
+		RegisterSpriteBenchmarks(benchmarks);
+		RegisterDebugDrawBenchmarks(benchmarks);
+		RegisterAnimationBenchmarks(benchmarks);
+		RegisterBroadphaseBenchmarks(benchmarks);
+		RegisterPickingBenchmarks(benchmarks);
+		RegisterParticleBenchmarks(benchmarks);
+		RegisterTerrainBenchmarks(benchmarks);
+		RegisterTextureBenchmarks(benchmarks);
+		RegisterCoreBenchmarks(benchmarks);
+		RegisterReplayBenchmarks(benchmarks, captures);
+	}
+}
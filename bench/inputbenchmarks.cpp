@@ -0,0 +1,225 @@
+#include "enginebenchmarks.h"
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include "cameracontroller.h"
+#include "inputqueue.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr std::uint32_t QUEUE_EVENTS{ 1 << 16 };
+		// The synthetic clock runs at a million ticks a second, so the event times below read as microseconds.
+		constexpr std::uint64_t TICKS_PER_SECOND{ 1000000 };
+
+		core::inputevent Event(std::uint64_t time, core::inputtype type, std::uint32_t code, std::int32_t x = 0, std::int32_t y = 0)
+		{
+			return core::inputevent{ time, type, code, x, y };
+		}
+
+		// One thread pushes and pops in batches of a quarter of the queue, the cost of the queue without any sharing.
+		void QueueSingleThread(runner& measure)
+		{
+			core::inputqueue queue(core::INPUT_QUEUE_CAPACITY);
+			const std::uint32_t batch = core::INPUT_QUEUE_CAPACITY / 4;
+			std::uint64_t total = 0;
+
+			measure.SetItemsPerIteration(QUEUE_EVENTS);
+			measure.Run(20, [&]()
+			{
+				core::inputevent event;
+				for (std::uint32_t i = 0; i < QUEUE_EVENTS; i += batch)
+				{
+					for (std::uint32_t j = 0; j < batch; j++)
+					{
+						queue.Push(Event(i + j, core::inputtype::mousemove, 0, static_cast<std::int32_t>(j), 0));
+					}
+					while (queue.Pop(event))
+					{
+						total += static_cast<std::uint64_t>(event.x);
+					}
+				}
+				Consume(total);
+			});
+		}
+
+		// A producer thread pushes numbered events while this one pops them, like the window procedure and the simulation.
+		// The producer waits when the queue is full instead of dropping, so every event has to come out once and in order.
+		void QueueProducerThread(runner& measure)
+		{
+			bool ordered = true;
+			std::uint64_t dropped = 0;
+
+			measure.SetItemsPerIteration(QUEUE_EVENTS);
+			measure.Run(10, [&]()
+			{
+				core::inputqueue queue(core::INPUT_QUEUE_CAPACITY);
+				std::thread producer([&queue]()
+				{
+					for (std::uint32_t i = 0; i < QUEUE_EVENTS; i++)
+					{
+						while (!queue.Push(Event(i, core::inputtype::mousemove, 0)))
+						{
+							std::this_thread::yield();
+						}
+					}
+				});
+
+				core::inputevent event;
+				std::uint64_t expected = 0;
+				while (expected < QUEUE_EVENTS)
+				{
+					if (!queue.Pop(event))
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					ordered = ordered and event.time == expected;
+					expected++;
+				}
+				producer.join();
+
+				// Waiting producers retry, only their first attempts were counted as dropped.
+				dropped += queue.GetDropped();
+				Consume(expected);
+			});
+
+			measure.SetMetric("full_retries", static_cast<double>(dropped));
+			if (!ordered)
+			{
+				measure.Fail("The events came out of the queue out of order.");
+			}
+		}
+
+		// The vectors have a constructor doing nothing, so the camera has to be set explicitly.
+		graphics::scene::camerastate Origin()
+		{
+			return graphics::scene::camerastate{ D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3(0.0f, 0.0f, 0.0f) };
+		}
+
+		// Runs the controller over fixed steps up to the end time, the camera starts at the origin looking along z.
+		graphics::scene::camerastate RunSteps(graphics::cameracontroller& controller, core::inputqueue& queue, std::uint64_t stepTicks, std::uint64_t endTick)
+		{
+			graphics::scene::camerastate camera = Origin();
+			for (std::uint64_t begin = 0; begin < endTick; begin += stepTicks)
+			{
+				controller.Step(queue, begin, begin + stepTicks, TICKS_PER_SECOND, camera);
+			}
+			return camera;
+		}
+
+		// W is held from 0.1013 s to exactly 0.6013 s, pressed and let go in the middle of steps. At 10 units a second
+		// the camera has to end 5 units forward with every step length, as if the key had been sampled continuously.
+		void HoldKey(runner& measure)
+		{
+			const std::uint64_t stepLengths[3] = { TICKS_PER_SECOND / 30, TICKS_PER_SECOND / 60, TICKS_PER_SECOND / 144 };
+			FLOAT worst = 0.0f;
+
+			measure.SetItemsPerIteration(3);
+			measure.Run(100, [&]()
+			{
+				worst = 0.0f;
+				for (std::uint64_t stepTicks : stepLengths)
+				{
+					core::inputqueue queue(core::INPUT_QUEUE_CAPACITY);
+					graphics::cameracontroller controller(graphics::cameracontrolsettings{});
+					queue.Push(Event(101300, core::inputtype::keydown, 'W'));
+					queue.Push(Event(601300, core::inputtype::keyup, 'W'));
+
+					graphics::scene::camerastate camera = RunSteps(controller, queue, stepTicks, TICKS_PER_SECOND);
+					FLOAT error = std::fabs(camera.position.z - 5.0f) + std::fabs(camera.position.x) + std::fabs(camera.position.y);
+					worst = error > worst ? error : worst;
+				}
+				Consume(worst);
+			});
+
+			measure.SetMetric("worst_error", worst);
+			if (worst > 1e-3f)
+			{
+				measure.Fail("The camera ended " + std::to_string(worst) + " units off the distance the key was held for.");
+			}
+		}
+
+		// Events stamped after the end of a step stay queued for the next one, events stamped before its start apply at the start.
+		void StepWindow(runner& measure)
+		{
+			std::string failure;
+
+			measure.SetItemsPerIteration(1);
+			measure.Run(100, [&]()
+			{
+				core::inputqueue queue(core::INPUT_QUEUE_CAPACITY);
+				graphics::cameracontroller controller(graphics::cameracontrolsettings{});
+				graphics::scene::camerastate camera = Origin();
+				core::inputevent event;
+				std::uint64_t oldest = 0;
+
+				// Pressed late, before the step began, it moves the camera for the whole step of 0.1 s.
+				queue.Push(Event(50000, core::inputtype::keydown, 'D'));
+				queue.Push(Event(250000, core::inputtype::keyup, 'D'));
+				controller.Step(queue, 100000, 200000, TICKS_PER_SECOND, camera);
+
+				if (std::fabs(camera.position.x - 1.0f) > 1e-4f)
+				{
+					failure = "A late event did not apply from the start of the step.";
+				}
+				else if (!queue.Peek(event) or event.type != core::inputtype::keyup)
+				{
+					failure = "An event after the end of the step was taken.";
+				}
+				else if (!controller.TakeOldestInput(oldest) or oldest != 50000 or controller.TakeOldestInput(oldest))
+				{
+					failure = "The oldest applied input was not reported once.";
+				}
+				Consume(camera.position.x);
+			});
+
+			if (!failure.empty())
+			{
+				measure.Fail(failure);
+			}
+		}
+
+		// Turning with the right button held, a move with the button up only moves the cursor and the pitch is clamped.
+		void MouseLook(runner& measure)
+		{
+			graphics::scene::camerastate camera = Origin();
+
+			measure.SetItemsPerIteration(6);
+			measure.Run(100, [&]()
+			{
+				core::inputqueue queue(core::INPUT_QUEUE_CAPACITY);
+				graphics::cameracontroller controller(graphics::cameracontrolsettings{});
+				queue.Push(Event(1000, core::inputtype::mousemove, 0, 400, 300));
+				queue.Push(Event(2000, core::inputtype::buttondown, static_cast<std::uint32_t>(core::mousebutton::right), 400, 300));
+				queue.Push(Event(3000, core::inputtype::mousemove, 0, 500, 300));
+				queue.Push(Event(4000, core::inputtype::mousemove, 0, 500, 1000));
+				queue.Push(Event(5000, core::inputtype::buttonup, static_cast<std::uint32_t>(core::mousebutton::right), 500, 1000));
+				queue.Push(Event(6000, core::inputtype::mousemove, 0, 0, 0));
+
+				camera = Origin();
+				controller.Step(queue, 0, 10000, TICKS_PER_SECOND, camera);
+				Consume(camera.rotation.y);
+			});
+
+			measure.SetMetric("yaw", camera.rotation.y);
+			measure.SetMetric("pitch", camera.rotation.x);
+			if (std::fabs(camera.rotation.y - 20.0f) > 1e-4f or camera.rotation.x != 89.0f)
+			{
+				measure.Fail("The camera turned to " + std::to_string(camera.rotation.y) + " by " + std::to_string(camera.rotation.x) +
+					" degrees instead of 20 by 89.");
+			}
+		}
+	}
+
+	void RegisterInputBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("input/queue/single_thread", QueueSingleThread);
+		benchmarks.Add("input/queue/producer_thread", QueueProducerThread);
+		benchmarks.Add("input/camera/hold_key", HoldKey);
+		benchmarks.Add("input/camera/step_window", StepWindow);
+		benchmarks.Add("input/camera/mouse_look", MouseLook);
+	}
+}
@@ -0,0 +1,73 @@
+#include "enginebenchmarks.h"
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+#include "lightclusters.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr FLOAT AREA{ 300.0f };
+		constexpr FLOAT ASPECT{ 16.0f / 9.0f };
+
+		// Lights scattered over a field in front of the camera like the ones of the renderer, every fourth a spot light.
+		std::vector<graphics::light> BuildLights(UINT count)
+		{
+			std::vector<graphics::light> lights(count);
+			std::uint32_t random = 1;
+			auto next = [&random]()
+			{
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				return static_cast<FLOAT>(random >> 8) * (1.0f / 16777216.0f);
+			};
+
+			for (UINT i = 0; i < count; i++)
+			{
+				graphics::light& placed = lights[i];
+				placed.position = D3DXVECTOR3((next() - 0.5f) * AREA, -12.0f + 10.0f * next(), next() * AREA - 20.0f);
+				placed.range = 6.0f + 10.0f * next();
+				placed.color = D3DXVECTOR3(1.0f, 1.0f, 1.0f);
+				placed.direction = D3DXVECTOR3(0.0f, -1.0f, 0.0f);
+				placed.innerCosine = i % 4 == 0 ? 0.9f : -1.0f;
+				placed.outerCosine = i % 4 == 0 ? 0.75f : -1.0f;
+			}
+			return lights;
+		}
+
+		// Assigning the lights to the clusters of a camera looking over them, what every frame pays before it draws.
+		void Assign(runner& measure, UINT count)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			std::vector<graphics::light> lights = BuildLights(count);
+			graphics::lightclusters clusters;
+
+			D3DXMATRIX view, projection;
+			D3DXVECTOR3 eye(0.0f, 0.0f, -10.0f), at(0.0f, -5.0f, 10.0f), up(0.0f, 1.0f, 0.0f);
+			D3DXMatrixLookAtLH(&view, &eye, &at, &up);
+			D3DXMatrixPerspectiveFovLH(&projection, 3.14159265f / 4.0f, ASPECT, 0.1f, 1000.0f);
+
+			measure.SetItemsPerIteration(count);
+			measure.Run(100, [&]()
+			{
+				clusters.Build(jobs, view, projection, lights.data(), count);
+				Consume(clusters.GetStats().indices);
+			});
+
+			const graphics::lightclusterstats& stats = clusters.GetStats();
+			measure.SetMetric("visible_lights", stats.visibleLights);
+			measure.SetMetric("indices", stats.indices);
+			measure.SetMetric("max_cluster_lights", stats.maxClusterLights);
+			measure.SetMetric("dropped", stats.droppedIndices);
+		}
+	}
+
+	void RegisterLightingBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("lighting/assign/lights:256", [](runner& measure) { Assign(measure, 256); });
+		benchmarks.Add("lighting/assign/lights:1024", [](runner& measure) { Assign(measure, 1024); });
+		benchmarks.Add("lighting/assign/lights:4096", [](runner& measure) { Assign(measure, 4096); });
+	}
+}
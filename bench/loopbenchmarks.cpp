@@ -0,0 +1,188 @@
+#include "enginebenchmarks.h"
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include "platform.h"
+
+namespace bench
+{
+	namespace
+	{
+		// A clock of 600 ticks per second makes a step of the 60 Hz simulation exactly 10 ticks.
+		constexpr std::uint64_t CLOCK_FREQUENCY{ 600 };
+		constexpr std::uint64_t STEP_TICKS{ 10 };
+		constexpr std::uint32_t MAX_STEPS{ 5 };
+		constexpr std::uint32_t SCRIPT_FRAMES{ 10000 };
+
+		// Counts what the loop asked for and remembers the last alpha and step end.
+		class countingtarget : public app::looptarget
+		{
+		public:
+			void Update(double, std::uint64_t stepEndTick) override
+			{
+				updates++;
+				lastStepEnd = stepEndTick;
+			}
+			void RenderFrame(double alpha) override
+			{
+				renders++;
+				lastAlpha = alpha;
+			}
+
+			std::uint64_t updates{};
+			std::uint64_t renders{};
+			std::uint64_t lastStepEnd{};
+			double lastAlpha{};
+		};
+
+		app::loopsettings Settings(double maxFrameRate)
+		{
+			app::loopsettings settings{};
+			settings.tickRate = 60.0;
+			settings.maxStepsPerFrame = MAX_STEPS;
+			settings.maxFrameRate = maxFrameRate;
+			return settings;
+		}
+
+		// Frames of 5 to 30 ticks, never long enough for the clamp. After every frame the steps taken and the alpha
+		// have to be what an accumulator kept alongside says, and the last step has to end at or before the frame.
+		void Steps(runner& measure)
+		{
+			std::string failure;
+
+			measure.SetItemsPerIteration(SCRIPT_FRAMES);
+			measure.Run(20, [&]()
+			{
+				app::manualclock clock(CLOCK_FREQUENCY);
+				app::scriptedmessages messages(0, 0);
+				app::mainloop loop(clock, messages, Settings(0.0));
+				countingtarget target;
+				std::uint32_t random = 1;
+				std::uint64_t accumulator = 0, expectedSteps = 0;
+
+				for (std::uint32_t frame = 0; frame < SCRIPT_FRAMES; frame++)
+				{
+					random ^= random << 13;
+					random ^= random >> 17;
+					random ^= random << 5;
+					std::uint64_t ticks = 5 + random % 26;
+
+					clock.Advance(ticks);
+					loop.Step(target);
+
+					accumulator += ticks;
+					std::uint64_t steps = accumulator / STEP_TICKS;
+					accumulator %= STEP_TICKS;
+					expectedSteps += steps;
+
+					const app::framestats& stats = loop.GetStats();
+					if (stats.stepsThisFrame != steps or stats.droppedSteps != 0 or target.updates != expectedSteps)
+					{
+						failure = "Frame " + std::to_string(frame) + " took " + std::to_string(stats.stepsThisFrame) +
+							" steps instead of " + std::to_string(steps) + ".";
+					}
+					else if (std::fabs(stats.alpha - static_cast<double>(accumulator) / STEP_TICKS) > 1e-9 or stats.alpha != target.lastAlpha)
+					{
+						failure = "Frame " + std::to_string(frame) + " was rendered with alpha " + std::to_string(stats.alpha) + ".";
+					}
+					else if (steps and target.lastStepEnd != clock.Now() - accumulator)
+					{
+						failure = "The last step of frame " + std::to_string(frame) + " does not end where the accumulator starts.";
+					}
+				}
+				Consume(target.updates);
+			});
+
+			if (!failure.empty())
+			{
+				measure.Fail(failure);
+			}
+		}
+
+		// A stall of a hundred steps with three ticks left over from before: the clamp lets five steps run,
+		// the other 95 are dropped and the leftover ticks, and so the alpha, are kept.
+		void Stall(runner& measure)
+		{
+			std::string failure;
+
+			measure.Run(1000, [&]()
+			{
+				app::manualclock clock(CLOCK_FREQUENCY);
+				app::scriptedmessages messages(0, 0);
+				app::mainloop loop(clock, messages, Settings(0.0));
+				countingtarget target;
+
+				clock.Advance(3);
+				loop.Step(target);
+				clock.Advance(100 * STEP_TICKS);
+				loop.Step(target);
+
+				const app::framestats& stats = loop.GetStats();
+				if (stats.stepsThisFrame != MAX_STEPS or target.updates != MAX_STEPS)
+				{
+					failure = "The stall took " + std::to_string(stats.stepsThisFrame) + " steps.";
+				}
+				else if (stats.droppedSteps != 100 - MAX_STEPS)
+				{
+					failure = std::to_string(stats.droppedSteps) + " steps were dropped.";
+				}
+				else if (std::fabs(stats.alpha - 0.3) > 1e-9)
+				{
+					failure = "The stall was rendered with alpha " + std::to_string(stats.alpha) + ".";
+				}
+
+				// The frame after is back to normal.
+				clock.Advance(STEP_TICKS);
+				loop.Step(target);
+				if (loop.GetStats().stepsThisFrame != 1 or loop.GetStats().droppedSteps != 0)
+				{
+					failure = "The frame after the stall did not recover.";
+				}
+				Consume(target.updates);
+			});
+
+			if (!failure.empty())
+			{
+				measure.Fail(failure);
+			}
+		}
+
+		// Run with a 30 Hz frame cap and a message source that quits on its tenth pump. The clock only moves
+		// by the waits of the cap, so the first frame takes no steps and each of the eight after it two.
+		void Quit(runner& measure)
+		{
+			std::string failure;
+
+			measure.Run(1000, [&]()
+			{
+				app::manualclock clock(CLOCK_FREQUENCY);
+				app::scriptedmessages messages(10, 7);
+				app::mainloop loop(clock, messages, Settings(30.0));
+				countingtarget target;
+
+				int exitCode = loop.Run(target);
+				if (exitCode != 7 or messages.GetPumpCount() != 10)
+				{
+					failure = "Run returned " + std::to_string(exitCode) + " after " + std::to_string(messages.GetPumpCount()) + " pumps.";
+				}
+				else if (target.renders != 9 or target.updates != 16)
+				{
+					failure = "Run rendered " + std::to_string(target.renders) + " frames with " + std::to_string(target.updates) + " steps.";
+				}
+				Consume(target.renders);
+			});
+
+			if (!failure.empty())
+			{
+				measure.Fail(failure);
+			}
+		}
+	}
+
+	void RegisterLoopBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("loop/steps", Steps);
+		benchmarks.Add("loop/stall", Stall);
+		benchmarks.Add("loop/quit", Quit);
+	}
+}
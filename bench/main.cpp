@@ -0,0 +1,129 @@
+// The benchmark executable.
+// Usage: benchmarks [--filter text] [--samples n] [--warmup n] [--cpu n] [--json path]
+//                   [--baseline path] [--threshold fraction] [--replay capture] [--list]
+// Without --json the results are written to benchmarks.json. With --baseline the medians are compared
+// to an earlier run and the exit code is 1 when anything got slower by more than the threshold.
+// Every --replay adds a benchmark replaying that capture, it fails when the replay does not match the capture.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "enginebenchmarks.h"
+#include "memorytracker.h"
+
+int main(int argc, char **argv)
+{
+	bench::benchmarksettings settings;
+	std::string jsonPath = "benchmarks.json";
+	std::string baselinePath;
+	std::vector<std::string> captures;
+	double threshold = 0.05;
+	bool list = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *argument = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (std::strcmp(argument, "--list") == 0)
+		{
+			list = true;
+			continue;
+		}
+		if (!value)
+		{
+			std::fprintf(stderr, "Unknown or incomplete argument %s\n", argument);
+			return 2;
+		}
+
+		if (std::strcmp(argument, "--filter") == 0)
+		{
+			settings.filter = value;
+		}
+		else if (std::strcmp(argument, "--samples") == 0)
+		{
+			settings.samples = static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+		}
+		else if (std::strcmp(argument, "--warmup") == 0)
+		{
+			settings.warmupSamples = static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+		}
+		else if (std::strcmp(argument, "--cpu") == 0)
+		{
+			settings.cpu = std::atoi(value);
+		}
+		else if (std::strcmp(argument, "--json") == 0)
+		{
+			jsonPath = value;
+		}
+		else if (std::strcmp(argument, "--baseline") == 0)
+		{
+			baselinePath = value;
+		}
+		else if (std::strcmp(argument, "--replay") == 0)
+		{
+			captures.push_back(value);
+		}
+		else if (std::strcmp(argument, "--threshold") == 0)
+		{
+			threshold = std::strtod(value, nullptr);
+		}
+		else
+		{
+			std::fprintf(stderr, "Unknown argument %s\n", argument);
+			return 2;
+		}
+		i++;
+	}
+
+	bench::suite benchmarks;
+	bench::RegisterEngineBenchmarks(benchmarks, captures);
+
+	if (list)
+	{
+		benchmarks.List();
+		return 0;
+	}
+
+	if (settings.samples == 0)
+	{
+		std::fprintf(stderr, "At least one sample is needed\n");
+		return 2;
+	}
+
+	// Pinning keeps the measuring thread from migrating between cores in the middle of a sample.
+	// Worker threads of the job system are not pinned, the benchmarks using them measure scaling.
+	if (settings.cpu >= 0 and !bench::PinThread(settings.cpu))
+	{
+		std::fprintf(stderr, "Unable to pin the thread to CPU %d\n", settings.cpu);
+		return 2;
+	}
+
+	std::vector<bench::benchmarkresult> results = benchmarks.Run(settings);
+
+	// The high-water marks show what the benchmarked systems allocated at most while they ran.
+	char memoryReport[1024];
+	core::memorytracker::FormatReport(memoryReport, sizeof(memoryReport));
+	std::printf("%s\n", memoryReport);
+
+	if (!bench::WriteJson(jsonPath.c_str(), settings, results))
+	{
+		std::fprintf(stderr, "Unable to write %s\n", jsonPath.c_str());
+		return 2;
+	}
+
+	int regressions = 0;
+	if (!baselinePath.empty())
+	{
+		regressions = bench::Compare(baselinePath.c_str(), results, threshold);
+		if (regressions < 0)
+		{
+			std::fprintf(stderr, "Unable to read %s\n", baselinePath.c_str());
+			return 2;
+		}
+	}
+
+	return regressions > 0 or bench::Failed(results) > 0 ? 1 : 0;
+}
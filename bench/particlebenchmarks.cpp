@@ -0,0 +1,76 @@
+#include "enginebenchmarks.h"
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+#include "particles.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr UINT PARTICLE_COUNT{ 1024 * 1024 };
+		constexpr FLOAT STEP_SECONDS{ 1.0f / 60.0f };
+		constexpr FLOAT LIFETIME{ 2.5f };
+
+		// One emitter filling the system to about nine tenths, run for longer than the longest life
+		// so the chunks hold the mix of young and old particles of a running system.
+		void Populate(core::jobsystem& jobs, graphics::particlesystem& particles)
+		{
+			graphics::particleemitter emitter{};
+			emitter.velocity = D3DXVECTOR3(0.0f, 5.0f, 0.0f);
+			emitter.spread = 2.0f;
+			emitter.rate = 0.9f * static_cast<FLOAT>(PARTICLE_COUNT) / LIFETIME;
+			emitter.lifetime = LIFETIME;
+			emitter.startColor = D3DXVECTOR4(1.0f, 1.0f, 1.0f, 1.0f);
+			particles.AddEmitter(emitter);
+
+			graphics::particleforces forces{};
+			forces.gravity = D3DXVECTOR3(0.0f, -9.81f, 0.0f);
+			forces.wind = D3DXVECTOR3(1.0f, 0.0f, 0.0f);
+			forces.drag = 0.1f;
+			particles.SetForces(forces);
+
+			for (FLOAT time = 0.0f; time < 1.5f * LIFETIME; time += STEP_SECONDS)
+			{
+				particles.Update(jobs, STEP_SECONDS);
+			}
+		}
+
+		// A step of the simulation: integration, compaction of the dead and emission on all workers.
+		void Update(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::particlesystem particles(PARTICLE_COUNT);
+			Populate(jobs, particles);
+
+			measure.SetItemsPerIteration(particles.GetCount());
+			measure.Run(10, [&]()
+			{
+				particles.Update(jobs, STEP_SECONDS);
+				Consume(particles.GetCount());
+			});
+		}
+
+		// Writing the point list of every live particle, what a frame streams to the GPU.
+		void WriteVertices(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::particlesystem particles(PARTICLE_COUNT);
+			Populate(jobs, particles);
+			std::vector<graphics::colorvertex> vertices(PARTICLE_COUNT);
+
+			measure.SetItemsPerIteration(particles.GetCount());
+			measure.Run(10, [&]()
+			{
+				UINT written = particles.WriteVertices(jobs, vertices.data(), PARTICLE_COUNT);
+				Consume(vertices[written - 1].position.y);
+			});
+		}
+	}
+
+	void RegisterParticleBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("particles/update/count:1048576", Update);
+		benchmarks.Add("particles/write_vertices/count:1048576", WriteVertices);
+	}
+}
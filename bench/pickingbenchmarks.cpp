@@ -0,0 +1,109 @@
+#include "enginebenchmarks.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+#include "meshbvh.h"
+
+namespace bench
+{
+	namespace
+	{
+		// A grid of a million triangles bent into hills, so the triangles are not all in one plane.
+		constexpr UINT GRID_COLUMNS{ 1024 };
+		constexpr UINT GRID_ROWS{ 512 };
+		constexpr FLOAT GRID_SPACING{ 0.1f };
+		constexpr UINT RAY_COUNT{ 1024 };
+
+		struct mesh
+		{
+			std::vector<graphics::colorvertex> vertices;
+			std::vector<std::uint32_t> indices;
+		};
+
+		mesh BuildMesh()
+		{
+			mesh built;
+			built.vertices.resize(graphics::GridVertexCount(GRID_COLUMNS, GRID_ROWS));
+			built.indices.resize(graphics::GridIndexCount(GRID_COLUMNS, GRID_ROWS));
+			graphics::BuildGrid(GRID_COLUMNS, GRID_ROWS, GRID_SPACING, D3DXVECTOR4(1.0f, 1.0f, 1.0f, 1.0f), built.vertices.data(), built.indices.data());
+
+			for (graphics::colorvertex& vertex : built.vertices)
+			{
+				vertex.position.y = std::sin(vertex.position.x * 3.0f) * std::cos(vertex.position.z * 2.0f) * 0.5f;
+			}
+			return built;
+		}
+
+		// Rays from above the grid in all directions down to the horizon, like a camera looking at it from
+		// random places. A few of them leave the grid at its edges.
+		std::vector<graphics::ray> BuildRays()
+		{
+			std::vector<graphics::ray> rays(RAY_COUNT);
+			std::uint32_t random = 1;
+			auto next = [&random]()
+			{
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				return static_cast<FLOAT>(random >> 8) * (1.0f / 16777216.0f) * 2.0f - 1.0f;
+			};
+
+			FLOAT halfWidth = 0.5f * GRID_COLUMNS * GRID_SPACING, halfDepth = 0.5f * GRID_ROWS * GRID_SPACING;
+			for (graphics::ray& cast : rays)
+			{
+				cast.origin = D3DXVECTOR3(next() * halfWidth, 3.0f + next(), next() * halfDepth);
+				cast.direction = D3DXVECTOR3(next(), -0.5f * (next() + 1.0f) - 0.05f, next());
+				D3DXVec3Normalize(&cast.direction, &cast.direction);
+			}
+			return rays;
+		}
+
+		// Casting the rays one after the other, what a pick costs.
+		void Ray(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			mesh picked = BuildMesh();
+			graphics::meshbvh bvh(jobs, picked.vertices.data(), static_cast<UINT>(picked.vertices.size()),
+				picked.indices.data(), static_cast<UINT>(picked.indices.size()));
+			std::vector<graphics::ray> rays = BuildRays();
+
+			UINT hits = 0;
+			measure.SetItemsPerIteration(RAY_COUNT);
+			measure.Run(10, [&]()
+			{
+				hits = 0;
+				for (const graphics::ray& cast : rays)
+				{
+					graphics::rayhit hit;
+					hits += bvh.Intersect(cast, 1e30f, hit) ? 1 : 0;
+				}
+				Consume(hits);
+			});
+
+			measure.SetMetric("hit_rate", static_cast<double>(hits) / RAY_COUNT);
+			measure.SetMetric("nodes", static_cast<double>(bvh.GetNodeCount()));
+		}
+
+		// Building the BVH of the grid, what loading a mesh that can be picked costs.
+		void Build(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			mesh picked = BuildMesh();
+
+			measure.SetItemsPerIteration(static_cast<double>(picked.indices.size() / 3));
+			measure.Run(3, [&]()
+			{
+				graphics::meshbvh bvh(jobs, picked.vertices.data(), static_cast<UINT>(picked.vertices.size()),
+					picked.indices.data(), static_cast<UINT>(picked.indices.size()));
+				Consume(bvh.GetNodeCount());
+			});
+		}
+	}
+
+	void RegisterPickingBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("picking/ray/triangles:1048576", Ray);
+		benchmarks.Add("picking/build/triangles:1048576", Build);
+	}
+}
@@ -0,0 +1,424 @@
+#include "enginebenchmarks.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "camera.h"
+#include "framepipeline.h"
+#include "jobsystem.h"
+#include "meshdata.h"
+#include "nullrenderer.h"
+#include "offsetallocator.h"
+#include "scene.h"
+#include "shaderparameters.h"
+#include "transformhierarchy.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr FLOAT STEP_SECONDS{ 1.0f / 60.0f };
+
+		D3DXMATRIX Projection()
+		{
+			D3DXMATRIX projectionMatrix;
+			D3DXMatrixPerspectiveFovLH(&projectionMatrix, D3DX_PI / 4.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+			return projectionMatrix;
+		}
+
+		// A square grid of instances three units apart seen from above and behind,
+		// so part of it is culled and part of it is drawn.
+		void PopulateScene(graphics::scene& world, std::uint32_t instances)
+		{
+			std::uint32_t side = 1;
+			while (side * side < instances)
+			{
+				side++;
+			}
+
+			graphics::meshinstance mesh{ 0, 3, 0, 0, 1.0f };
+			for (std::uint32_t i = 0; i < instances; i++)
+			{
+				FLOAT x = 3.0f * (static_cast<FLOAT>(i % side) - 0.5f * static_cast<FLOAT>(side));
+				FLOAT z = 3.0f * static_cast<FLOAT>(i / side);
+				graphics::transform placement{ D3DXVECTOR3(x, 0.0f, z), D3DXVECTOR3(0.0f, static_cast<FLOAT>(i % 360), 0.0f), 1.0f };
+				world.CreateInstance(placement, mesh);
+			}
+
+			world.SetCamera(D3DXVECTOR3(0.0f, 40.0f, -60.0f), D3DXVECTOR3(25.0f, 0.0f, 0.0f));
+		}
+
+		void CameraRender(runner& measure)
+		{
+			graphics::camera view;
+			D3DXMATRIX viewMatrix;
+			FLOAT angle = 0.0f;
+
+			measure.Run(100000, [&]()
+			{
+				angle += 0.25f;
+				view.SetPosition(0.0f, 1.0f, -10.0f);
+				view.SetRotation(angle * 0.1f, angle, 0.0f);
+				view.Render();
+				view.GetViewMatrix(viewMatrix);
+				Consume(viewMatrix);
+			});
+		}
+
+		void PackMatrixBuffer(runner& measure)
+		{
+			graphics::camera view;
+			graphics::matrixbuffer constants;
+			D3DXMATRIX worldMatrix, viewMatrix, projectionMatrix = Projection();
+
+			D3DXMatrixIdentity(&worldMatrix);
+			view.SetPosition(0.0f, 0.0f, -10.0f);
+			view.Render();
+			view.GetViewMatrix(viewMatrix);
+
+			measure.Run(100000, [&]()
+			{
+				worldMatrix._41 += 0.001f;
+				graphics::PackMatrixBuffer(constants, worldMatrix, viewMatrix, projectionMatrix);
+				Consume(constants);
+			});
+		}
+
+		// What loading a mesh does before anything reaches the device: building the vertices and indices
+		// and finding the bounding sphere.
+		void BuildMesh(runner& measure, UINT quads)
+		{
+			std::vector<graphics::colorvertex> vertices(graphics::GridVertexCount(quads, quads));
+			std::vector<std::uint32_t> indices(graphics::GridIndexCount(quads, quads));
+			D3DXVECTOR4 color(0.0f, 1.0f, 0.0f, 1.0f);
+
+			measure.SetItemsPerIteration(static_cast<double>(vertices.size()));
+			measure.Run(20, [&]()
+			{
+				graphics::BuildGrid(quads, quads, 1.0f, color, vertices.data(), indices.data());
+				FLOAT radius = graphics::ComputeBoundingRadius(vertices.data(), static_cast<UINT>(vertices.size()));
+				Consume(radius);
+			});
+		}
+
+		// The range bookkeeping of the mesh heap: every mesh takes a vertex and an index range of a page.
+		// Half of the meshes are freed and loaded again, which is what streaming levels in and out looks like.
+		void SuballocateMeshes(runner& measure)
+		{
+			constexpr std::uint32_t MESHES{ 1024 };
+			graphics::offsetallocator vertexRanges(1 << 22), indexRanges(1 << 24);
+			std::vector<graphics::offsetallocator::allocation> vertexAllocations(MESHES), indexAllocations(MESHES);
+
+			for (std::uint32_t i = 0; i < MESHES; i++)
+			{
+				vertexAllocations[i] = vertexRanges.Allocate(64 + (i * 37) % 2048);
+				indexAllocations[i] = indexRanges.Allocate(3 * (64 + (i * 53) % 4096));
+			}
+
+			measure.SetItemsPerIteration(MESHES);
+			measure.Run(100, [&]()
+			{
+				for (std::uint32_t i = 0; i < MESHES; i += 2)
+				{
+					vertexRanges.Free(vertexAllocations[i]);
+					indexRanges.Free(indexAllocations[i]);
+				}
+				for (std::uint32_t i = 0; i < MESHES; i += 2)
+				{
+					vertexAllocations[i] = vertexRanges.Allocate(64 + (i * 37) % 2048);
+					indexAllocations[i] = indexRanges.Allocate(3 * (64 + (i * 53) % 4096));
+				}
+			});
+		}
+
+		// Random allocations and frees of one to 4096 units against a shadow map of which unit belongs to which range.
+		// A range that is out of bounds or overlaps a live one fails the run, and so does any space that is not
+		// free again, as one region, once everything has been freed.
+		void FuzzSuballocation(runner& measure)
+		{
+			constexpr std::uint32_t SIZE{ 1 << 16 };
+			constexpr std::uint32_t OPERATIONS{ 100000 };
+			struct liverange
+			{
+				graphics::offsetallocator::allocation allocation;
+				std::uint32_t size;
+			};
+			std::string failure;
+
+			measure.SetItemsPerIteration(OPERATIONS);
+			measure.Run(5, [&]()
+			{
+				graphics::offsetallocator ranges(SIZE);
+				std::vector<liverange> live;
+				std::vector<std::uint8_t> used(SIZE);
+				std::uint64_t usedUnits = 0;
+				std::uint32_t random = 1;
+				auto next = [&random]()
+				{
+					random ^= random << 13;
+					random ^= random >> 17;
+					random ^= random << 5;
+					return random;
+				};
+				auto release = [&](std::uint32_t index)
+				{
+					liverange freed = live[index];
+					live[index] = live.back();
+					live.pop_back();
+					ranges.Free(freed.allocation);
+					std::fill(used.begin() + freed.allocation.offset, used.begin() + freed.allocation.offset + freed.size, 0);
+					usedUnits -= freed.size;
+				};
+
+				for (std::uint32_t operation = 0; operation < OPERATIONS and failure.empty(); operation++)
+				{
+					if (live.empty() or next() % 100 < 55)
+					{
+						std::uint32_t size = 1 + next() % (1u << (next() % 13));
+						graphics::offsetallocator::allocation allocated = ranges.Allocate(size);
+						if (!allocated.IsValid())
+						{
+							continue;
+						}
+						if (allocated.offset > SIZE - size or ranges.AllocationSize(allocated) != size)
+						{
+							failure = "A range of " + std::to_string(size) + " was handed out at " + std::to_string(allocated.offset) + ".";
+							break;
+						}
+						if (std::find(used.begin() + allocated.offset, used.begin() + allocated.offset + size, 1) != used.begin() + allocated.offset + size)
+						{
+							failure = "A range at " + std::to_string(allocated.offset) + " overlaps a live one.";
+							break;
+						}
+						std::fill(used.begin() + allocated.offset, used.begin() + allocated.offset + size, 1);
+						usedUnits += size;
+						live.push_back(liverange{ allocated, size });
+					}
+					else
+					{
+						release(next() % static_cast<std::uint32_t>(live.size()));
+					}
+
+					if (ranges.StorageReport().totalFreeSpace != SIZE - usedUnits)
+					{
+						failure = "The free space does not match the live ranges after operation " + std::to_string(operation) + ".";
+					}
+				}
+
+				while (!live.empty())
+				{
+					release(static_cast<std::uint32_t>(live.size() - 1));
+				}
+				graphics::offsetallocator::storagereport report = ranges.StorageReport();
+				if (failure.empty() and (report.totalFreeSpace != SIZE or report.largestFreeRegion != SIZE))
+				{
+					failure = "Freeing everything left " + std::to_string(report.largestFreeRegion) + " of " +
+						std::to_string(report.totalFreeSpace) + " free in one region.";
+				}
+				Consume(report.totalFreeSpace);
+			});
+
+			if (!failure.empty())
+			{
+				measure.Fail(failure);
+			}
+		}
+
+		// 1000 roots with 10 children each with 9 children of their own, 100000 nodes on three levels.
+		constexpr std::uint32_t HIERARCHY_ROOTS{ 1000 };
+		constexpr std::uint32_t HIERARCHY_NODES{ HIERARCHY_ROOTS * (1 + 10 + 10 * 9) - HIERARCHY_ROOTS };
+
+		std::vector<graphics::transformhierarchy::node> BuildHierarchy(graphics::transformhierarchy& hierarchy)
+		{
+			std::vector<graphics::transformhierarchy::node> nodes;
+			graphics::transform local{ D3DXVECTOR3(1.0f, 0.0f, 2.0f), D3DXVECTOR3(0.0f, 15.0f, 0.0f), 1.0f };
+
+			for (std::uint32_t i = 0; i < HIERARCHY_ROOTS; i++)
+			{
+				nodes.push_back(hierarchy.Create(local));
+			}
+			for (std::uint32_t i = 0; nodes.size() < HIERARCHY_ROOTS * 11; i++)
+			{
+				nodes.push_back(hierarchy.Create(local, nodes[i % HIERARCHY_ROOTS]));
+			}
+			for (std::uint32_t i = 0; nodes.size() < HIERARCHY_NODES; i++)
+			{
+				nodes.push_back(hierarchy.Create(local, nodes[HIERARCHY_ROOTS + i % (HIERARCHY_ROOTS * 10)]));
+			}
+
+			return nodes;
+		}
+
+		// Every step another spread out set of nodes on all levels moves, the nodes below them follow.
+		void HierarchyUpdate(runner& measure, std::uint32_t movingPercent)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::transformhierarchy hierarchy;
+			std::vector<graphics::transformhierarchy::node> nodes = BuildHierarchy(hierarchy);
+			std::uint32_t moving = HIERARCHY_NODES / 100 * movingPercent;
+			std::uint32_t step = 0;
+
+			hierarchy.Update(jobs);
+
+			measure.SetItemsPerIteration(moving);
+			measure.Run(10, [&]()
+			{
+				FLOAT angle = static_cast<FLOAT>(step++);
+				for (std::uint32_t i = 0; i < moving; i++)
+				{
+					std::uint32_t index = static_cast<std::uint32_t>((static_cast<std::uint64_t>(i + step * moving) * 7919) % HIERARCHY_NODES);
+					hierarchy.SetLocal(nodes[index], graphics::transform{ D3DXVECTOR3(1.0f, 0.0f, 2.0f), D3DXVECTOR3(0.0f, angle, 0.0f), 1.0f });
+				}
+				hierarchy.Update(jobs);
+			});
+
+			Consume(hierarchy.GetWorld(nodes.back())._41);
+		}
+
+		// The same through the scene, which also copies the new world matrices to the entities.
+		void SceneTransforms(runner& measure, std::uint32_t movingPercent)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::scene world(jobs);
+			graphics::meshinstance mesh{ 0, 3, 0, 0, 1.0f };
+			graphics::transform local{ D3DXVECTOR3(1.0f, 0.0f, 2.0f), D3DXVECTOR3(0.0f, 15.0f, 0.0f), 1.0f };
+			std::vector<core::entity> instances;
+			std::uint32_t moving = HIERARCHY_NODES / 100 * movingPercent;
+			std::uint32_t step = 0;
+
+			for (std::uint32_t i = 0; i < HIERARCHY_NODES; i++)
+			{
+				core::entity parent = i < HIERARCHY_ROOTS ? core::entity{} : instances[i < HIERARCHY_ROOTS * 11 ? i % HIERARCHY_ROOTS : HIERARCHY_ROOTS + i % (HIERARCHY_ROOTS * 10)];
+				instances.push_back(world.CreateInstance(local, mesh, parent));
+			}
+			world.Update(STEP_SECONDS);
+
+			measure.SetItemsPerIteration(moving);
+			measure.Run(10, [&]()
+			{
+				FLOAT angle = static_cast<FLOAT>(step++);
+				for (std::uint32_t i = 0; i < moving; i++)
+				{
+					std::uint32_t index = static_cast<std::uint32_t>((static_cast<std::uint64_t>(i + step * moving) * 7919) % HIERARCHY_NODES);
+					world.SetPlacement(instances[index], graphics::transform{ D3DXVECTOR3(1.0f, 0.0f, 2.0f), D3DXVECTOR3(0.0f, angle, 0.0f), 1.0f });
+				}
+				world.Update(STEP_SECONDS);
+			});
+		}
+
+		// One simulation step and one frame as graphics runs them, with the null renderer
+		// in place of the device: transforms, camera, culling, draw list, shader parameters.
+		void CpuFrame(runner& measure, std::uint32_t instances)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::scene world(jobs);
+			core::frameallocator frameMemory(8 * 1024 * 1024, 1);
+			graphics::rendersnapshot snapshot;
+			graphics::nullrenderer renderer;
+			D3DXMATRIX projectionMatrix = Projection();
+
+			PopulateScene(world, instances);
+
+			measure.SetItemsPerIteration(instances);
+			measure.Run(50, [&]()
+			{
+				world.Update(STEP_SECONDS);
+				snapshot.Reset(frameMemory.BeginFrame(0), instances);
+				world.BuildSnapshot(0.5f, projectionMatrix, snapshot);
+				renderer.Render(snapshot, projectionMatrix);
+			});
+
+			Consume(renderer.GetTotalChecksum());
+		}
+
+		// The same frame with a frame arena too small for the draw list. Building it must not throw,
+		// and every draw that is missing from the list has to be counted as dropped.
+		void OverflowFrame(runner& measure)
+		{
+			constexpr std::uint32_t INSTANCES{ 20000 };
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::scene world(jobs);
+			core::frameallocator frameMemory(8 * 1024 * 1024, 2);
+			graphics::rendersnapshot full, overflowing;
+			core::linearallocator smallMemory(256 * 1024, core::memorytag::frame);
+			D3DXMATRIX projectionMatrix = Projection();
+			std::string failure;
+
+			PopulateScene(world, INSTANCES);
+			world.Update(STEP_SECONDS);
+
+			measure.SetItemsPerIteration(INSTANCES);
+			measure.Run(50, [&]()
+			{
+				full.Reset(frameMemory.BeginFrame(0), INSTANCES);
+				world.BuildSnapshot(0.5f, projectionMatrix, full);
+				smallMemory.Reset();
+				overflowing.Reset(smallMemory, INSTANCES);
+				world.BuildSnapshot(0.5f, projectionMatrix, overflowing);
+
+				if (!overflowing.dropped or overflowing.draws.size() + overflowing.dropped != full.draws.size())
+				{
+					failure = std::to_string(overflowing.draws.size()) + " draws with " + std::to_string(overflowing.dropped) +
+						" dropped instead of " + std::to_string(full.draws.size()) + ".";
+				}
+				Consume(overflowing.draws.size());
+			});
+
+			if (!failure.empty())
+			{
+				measure.Fail(failure);
+			}
+		}
+
+		// The same frame with the null renderer on the render thread of the frame pipeline,
+		// the time per frame is that of the longer of the two stages.
+		void PipelinedFrame(runner& measure, std::uint32_t instances)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::scene world(jobs);
+			core::frameallocator frameMemory(8 * 1024 * 1024, core::framepipeline::SLOT_COUNT);
+			graphics::rendersnapshot snapshots[core::framepipeline::SLOT_COUNT];
+			graphics::nullrenderer renderer;
+			D3DXMATRIX projectionMatrix = Projection();
+
+			PopulateScene(world, instances);
+
+			core::framepipeline pipeline([&](std::uint32_t slot)
+			{
+				renderer.Render(snapshots[slot], projectionMatrix);
+			});
+
+			measure.SetItemsPerIteration(instances);
+			measure.Run(50, [&]()
+			{
+				std::uint32_t slot = pipeline.GetWriteSlot();
+
+				world.Update(STEP_SECONDS);
+				snapshots[slot].Reset(frameMemory.BeginFrame(slot), instances);
+				world.BuildSnapshot(0.5f, projectionMatrix, snapshots[slot]);
+				pipeline.Publish();
+			});
+
+			pipeline.Flush();
+		}
+	}
+
+	void RegisterRenderBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("camera/render", CameraRender);
+		benchmarks.Add("colorshader/pack_matrix_buffer", PackMatrixBuffer);
+		benchmarks.Add("mesh/build_grid/quads:64", [](runner& measure) { BuildMesh(measure, 64); });
+		benchmarks.Add("mesh/build_grid/quads:256", [](runner& measure) { BuildMesh(measure, 256); });
+		benchmarks.Add("mesh/suballocate", SuballocateMeshes);
+		benchmarks.Add("mesh/suballocate_fuzz", FuzzSuballocation);
+		benchmarks.Add("transforms/hierarchy/nodes:100000/moving:1%", [](runner& measure) { HierarchyUpdate(measure, 1); });
+		benchmarks.Add("transforms/hierarchy/nodes:100000/moving:3%", [](runner& measure) { HierarchyUpdate(measure, 3); });
+		benchmarks.Add("transforms/hierarchy/nodes:100000/moving:100%", [](runner& measure) { HierarchyUpdate(measure, 100); });
+		benchmarks.Add("transforms/scene/instances:100000/moving:3%", [](runner& measure) { SceneTransforms(measure, 3); });
+		benchmarks.Add("frame/cpu/entities:1000", [](runner& measure) { CpuFrame(measure, 1000); });
+		benchmarks.Add("frame/cpu/entities:20000", [](runner& measure) { CpuFrame(measure, 20000); });
+		benchmarks.Add("frame/cpu/overflow", OverflowFrame);
+		benchmarks.Add("frame/pipelined/entities:1000", [](runner& measure) { PipelinedFrame(measure, 1000); });
+		benchmarks.Add("frame/pipelined/entities:20000", [](runner& measure) { PipelinedFrame(measure, 20000); });
+	}
+}
@@ -0,0 +1,125 @@
+#include "enginebenchmarks.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "capture.h"
+#include "jobsystem.h"
+#include "replay.h"
+#include "scene.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr std::uint32_t SYNTHETIC_INSTANCES{ 2000 };
+		constexpr std::uint32_t SYNTHETIC_STEPS{ 240 };
+
+		// A session like one the game records: a flying camera, instances coming and going
+		// every few steps and a frame rendered after every step with changing blend factors.
+		// Halfway through the mesh is moved like a compaction of the mesh heap moves it.
+		void RecordSyntheticSession(core::jobsystem& jobs, graphics::capturewriter& writer)
+		{
+			graphics::scene world(jobs);
+			core::frameallocator frameMemory(4 * 1024 * 1024, 1);
+			graphics::rendersnapshot snapshot;
+			graphics::meshinstance mesh{ 0, 3, 0, 0, 1.0f };
+			std::vector<core::entity> instances;
+			D3DXMATRIX projectionMatrix;
+
+			D3DXMatrixPerspectiveFovLH(&projectionMatrix, D3DX_PI / 4.0f, 800.0f / 600.0f, 0.1f, 1000.0f);
+
+			for (std::uint32_t i = 0; i < SYNTHETIC_INSTANCES; i++)
+			{
+				graphics::transform placement{ D3DXVECTOR3(3.0f * static_cast<FLOAT>(i % 50) - 75.0f, 0.0f, 3.0f * static_cast<FLOAT>(i / 50)),
+					D3DXVECTOR3(0.0f, static_cast<FLOAT>(i % 360), 0.0f), 1.0f };
+				instances.push_back(world.CreateInstance(placement, mesh));
+			}
+
+			writer.WindowSize(800, 600);
+			world.SetCapture(&writer);
+
+			for (std::uint32_t step = 0; step < SYNTHETIC_STEPS; step++)
+			{
+				FLOAT t = static_cast<FLOAT>(step);
+				world.SetCamera(D3DXVECTOR3(0.5f * t - 60.0f, 30.0f, -40.0f + 0.5f * t), D3DXVECTOR3(20.0f, 0.25f * t, 0.0f));
+
+				if (step % 8 == 0)
+				{
+					world.DestroyInstance(instances[(step * 37) % instances.size()]);
+					graphics::transform placement{ D3DXVECTOR3(t - 120.0f, 0.0f, 0.5f * t), D3DXVECTOR3(0.0f, t, 0.0f), 2.0f };
+					instances[(step * 37) % instances.size()] = world.CreateInstance(placement, mesh);
+				}
+
+				if (step == SYNTHETIC_STEPS / 2)
+				{
+					graphics::meshinstance moved{ 1, 3, 6, 4, 1.0f };
+					world.RelocateMesh(mesh, moved);
+					mesh = moved;
+				}
+
+				world.Update(1.0f / 60.0f);
+				snapshot.Reset(frameMemory.BeginFrame(0), world.GetEntities().GetEntityCount());
+				world.BuildSnapshot(static_cast<FLOAT>(step % 4) * 0.25f, projectionMatrix, snapshot);
+			}
+
+			world.SetCapture(nullptr);
+		}
+
+		void Replay(runner& measure, graphics::capturereader& capture, core::jobsystem& jobs)
+		{
+			graphics::replayer replay(jobs);
+			graphics::replayresult result;
+			bool complete = replay.Run(capture, result);
+
+			if (!complete or !result.IsIdentical())
+			{
+				char error[128];
+				std::snprintf(error, sizeof(error), "replay differs from the capture: %llu draw and %llu checksum mismatches%s",
+					static_cast<unsigned long long>(result.drawMismatches), static_cast<unsigned long long>(result.checksumMismatches),
+					complete ? "" : ", the capture is damaged");
+				measure.Fail(error);
+			}
+
+			measure.SetItemsPerIteration(static_cast<double>(result.frames));
+			measure.Run(1, [&]()
+			{
+				graphics::replayresult repeated;
+				replay.Run(capture, repeated);
+			});
+		}
+
+		void ReplaySynthetic(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::capturewriter writer;
+			graphics::capturereader capture;
+
+			RecordSyntheticSession(jobs, writer);
+			capture.Load(writer.GetBuffer());
+			Replay(measure, capture, jobs);
+		}
+
+		void ReplayFile(runner& measure, const std::string& path)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::capturereader capture;
+
+			if (!capture.Load(path.c_str()))
+			{
+				measure.Fail("unable to load " + path);
+				return;
+			}
+			Replay(measure, capture, jobs);
+		}
+	}
+
+	void RegisterReplayBenchmarks(suite& benchmarks, const std::vector<std::string>& captures)
+	{
+		benchmarks.Add("replay/synthetic", ReplaySynthetic);
+
+		for (const std::string& path : captures)
+		{
+			benchmarks.Add("replay/file:" + path, [path](runner& measure) { ReplayFile(measure, path); });
+		}
+	}
+}
@@ -0,0 +1,132 @@
+#include "enginebenchmarks.h"
+#include <cstdint>
+#include <string>
+#include "resolutioncontroller.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr UINT TRACE_FRAMES{ 3600 };
+		constexpr FLOAT FIXED_SECONDS{ 0.002f };
+		constexpr FLOAT JITTER{ 0.1f };
+
+		// A synthetic GPU: a frame takes a fixed time plus the time of its pixels, which is given for the full window
+		// and shrinks with the square of the scale, with some jitter on top. The load function gives the time
+		// of the pixels at full size and of an extra hitch for every frame of the trace.
+		struct traceframe
+		{
+			FLOAT pixelSeconds;
+			FLOAT hitchSeconds;
+		};
+
+		struct traceresult
+		{
+			UINT lateChanges;
+			FLOAT finalScale;
+			FLOAT lateAverage;
+		};
+
+		template<typename L>
+		traceresult RunTrace(graphics::resolutioncontroller& controller, L load)
+		{
+			traceresult result{};
+			std::uint32_t random = 1;
+			FLOAT lateTotal = 0.0f;
+
+			for (UINT frame = 0; frame < TRACE_FRAMES; frame++)
+			{
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				FLOAT noise = 1.0f + JITTER * (static_cast<FLOAT>(random >> 8) * (2.0f / 16777216.0f) - 1.0f);
+
+				traceframe cost = load(frame);
+				FLOAT scale = controller.GetScale();
+				FLOAT seconds = (FIXED_SECONDS + cost.pixelSeconds * scale * scale) * noise + cost.hitchSeconds;
+
+				// The last quarter of the trace has a constant load, by then the scale should have come to rest.
+				bool changed = controller.Update(seconds);
+				if (frame >= TRACE_FRAMES * 3 / 4)
+				{
+					result.lateChanges += changed ? 1 : 0;
+					lateTotal += seconds;
+				}
+			}
+
+			result.finalScale = controller.GetScale();
+			result.lateAverage = lateTotal / static_cast<FLOAT>(TRACE_FRAMES / 4);
+			return result;
+		}
+
+		// Every trace is checked against what the controller is for: the scale comes to rest,
+		// frames end up within the over budget margin of the target where the minimum scale allows it and nothing is lowered for hitches alone.
+		template<typename L>
+		void Trace(runner& measure, L load, FLOAT expectedScale)
+		{
+			graphics::resolutionsettings settings;
+			traceresult result{};
+			graphics::resolutionstats stats{};
+
+			measure.SetItemsPerIteration(TRACE_FRAMES);
+			measure.Run(10, [&]()
+			{
+				graphics::resolutioncontroller controller(settings);
+				result = RunTrace(controller, load);
+				stats = controller.GetStats();
+				Consume(result.finalScale);
+			});
+
+			measure.SetMetric("final_scale", result.finalScale);
+			measure.SetMetric("lowered", stats.lowered);
+			measure.SetMetric("raised", stats.raised);
+			measure.SetMetric("over_budget_percent", 100.0 * static_cast<double>(stats.overBudgetFrames) / static_cast<double>(stats.frames));
+			measure.SetMetric("late_average_ms", 1000.0 * result.lateAverage);
+
+			if (result.lateChanges)
+			{
+				measure.Fail("The scale still changed " + std::to_string(result.lateChanges) + " times at the end of the trace.");
+			}
+			else if (expectedScale > 0.0f and result.finalScale != expectedScale)
+			{
+				measure.Fail("The scale ended at " + std::to_string(result.finalScale) + " instead of " + std::to_string(expectedScale) + ".");
+			}
+			else if (result.finalScale > settings.minScale and result.lateAverage > settings.targetSeconds * settings.overBudget)
+			{
+				measure.Fail("The frames ended over the target at a scale above the minimum.");
+			}
+		}
+	}
+
+	void RegisterResolutionBenchmarks(suite& benchmarks)
+	{
+		// Fits the target at full size and has to stay there.
+		benchmarks.Add("resolution/trace:light", [](runner& measure)
+		{
+			Trace(measure, [](UINT) { return traceframe{ 0.011f, 0.0f }; }, 1.0f);
+		});
+		// Twice the target at full size, has to settle on a smaller scale.
+		benchmarks.Add("resolution/trace:heavy", [](runner& measure)
+		{
+			Trace(measure, [](UINT) { return traceframe{ 0.03f, 0.0f }; }, 0.0f);
+		});
+		// The load jumps up for the middle of the trace and drops again, the scale has to follow it down and back up.
+		benchmarks.Add("resolution/trace:step", [](runner& measure)
+		{
+			Trace(measure, [](UINT frame)
+			{
+				return traceframe{ frame >= TRACE_FRAMES / 4 and frame < TRACE_FRAMES / 2 ? 0.03f : 0.011f, 0.0f };
+			}, 1.0f);
+		});
+		// A light load with a hitch of several frames' time every two seconds, which no scale would fix.
+		benchmarks.Add("resolution/trace:hitches", [](runner& measure)
+		{
+			Trace(measure, [](UINT frame) { return traceframe{ 0.011f, frame % 120 == 60 ? 0.05f : 0.0f }; }, 1.0f);
+		});
+		// Too heavy even for the minimum scale, has to stop there instead of going back and forth.
+		benchmarks.Add("resolution/trace:overload", [](runner& measure)
+		{
+			Trace(measure, [](UINT) { return traceframe{ 0.08f, 0.0f }; }, 0.5f);
+		});
+	}
+}
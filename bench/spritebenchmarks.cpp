@@ -0,0 +1,197 @@
+#include "enginebenchmarks.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "glyphatlas.h"
+#include "spritebatch.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr UINT SPRITE_COUNT{ 10000 };
+		constexpr UINT SPRITE_TEXTURES{ 8 };
+		constexpr INT SPRITE_LAYERS{ 4 };
+		constexpr UINT ATLAS_SIZE{ 512 };
+		constexpr UINT TEXT_LINES{ 100 };
+
+		// A synthetic font: every glyph is a box of its own size filled with a value made from the character,
+		// so a glyph that another one was packed over is found by its pixels. The space has no pixels.
+		bool SyntheticGlyph(std::uint32_t character, graphics::glyphbitmap& bitmap)
+		{
+			if (character == ' ')
+			{
+				bitmap.width = bitmap.height = 0;
+				bitmap.advance = 4.0f;
+				return true;
+			}
+
+			bitmap.width = 5 + character % 7;
+			bitmap.height = 8 + character % 9;
+			bitmap.offsetX = 1;
+			bitmap.offsetY = 16 - static_cast<INT>(bitmap.height);
+			bitmap.advance = static_cast<FLOAT>(bitmap.width + 2);
+			bitmap.pixels.assign(static_cast<size_t>(bitmap.width) * bitmap.height, static_cast<std::uint8_t>(character | 1));
+			return true;
+		}
+
+		std::uint32_t Random(std::uint32_t& state)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		// Sprites on eight textures and four layers, added shuffled or already in drawing order.
+		// However they were added, they have to come out as at most one draw for every layer and texture.
+		void Batch(runner& measure, bool shuffled)
+		{
+			graphics::spritebatch batch(SPRITE_COUNT);
+			std::vector<graphics::spritevertex> vertices(4 * SPRITE_COUNT);
+			std::vector<graphics::sprite> sprites(SPRITE_COUNT);
+			std::uint32_t state = 7;
+
+			for (UINT i = 0; i < SPRITE_COUNT; i++)
+			{
+				UINT group = shuffled ? Random(state) % (SPRITE_TEXTURES * SPRITE_LAYERS) : i * SPRITE_TEXTURES * SPRITE_LAYERS / SPRITE_COUNT;
+				FLOAT x = static_cast<FLOAT>(Random(state) % 1920), y = static_cast<FLOAT>(Random(state) % 1080);
+				sprites[i] = graphics::sprite{ x, y, 16.0f, 16.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0xFFFFFFFF, group % SPRITE_TEXTURES,
+					static_cast<INT>(group / SPRITE_TEXTURES) };
+			}
+
+			measure.SetItemsPerIteration(SPRITE_COUNT);
+			measure.Run(50, [&]()
+			{
+				batch.Begin();
+				for (const graphics::sprite& quad : sprites)
+				{
+					batch.Add(quad);
+				}
+				batch.End();
+				batch.WriteVertices(vertices.data());
+				Consume(vertices[0].x);
+			});
+
+			const std::vector<graphics::spritedraw>& draws = batch.GetDraws();
+			measure.SetMetric("draws", static_cast<double>(draws.size()));
+			if (draws.size() > SPRITE_TEXTURES * SPRITE_LAYERS)
+			{
+				measure.Fail("The sprites took " + std::to_string(draws.size()) + " draws.");
+			}
+			else if (batch.GetQuadCount() != SPRITE_COUNT)
+			{
+				measure.Fail("Sprites were dropped.");
+			}
+		}
+
+		// Lays out a screen of text every iteration. The glyphs are rasterized in the first one,
+		// after that the atlas has to hand out the cached ones without rasterizing anything.
+		void Text(runner& measure)
+		{
+			graphics::glyphatlas atlas(ATLAS_SIZE, ATLAS_SIZE, 18.0f, SyntheticGlyph);
+			graphics::spritebatch batch(TEXT_LINES * 64);
+			std::vector<std::string> lines(TEXT_LINES);
+			UINT characters = 0;
+			UINT rasterizedAfterFirst = 0;
+			bool first = true;
+
+			for (UINT i = 0; i < TEXT_LINES; i++)
+			{
+				lines[i] = "frame " + std::to_string(i * 7919) + ": the quick brown fox jumps over the lazy dog";
+				characters += static_cast<UINT>(lines[i].size());
+			}
+
+			measure.SetItemsPerIteration(characters);
+			measure.Run(50, [&]()
+			{
+				UINT before = atlas.GetStats().rasterized;
+				batch.Begin();
+				for (UINT i = 0; i < TEXT_LINES; i++)
+				{
+					batch.AddText(atlas, 0, lines[i].c_str(), 8.0f, 8.0f + 18.0f * static_cast<FLOAT>(i), 0xFFFFFFFF, 0);
+				}
+				batch.End();
+
+				if (!first)
+				{
+					rasterizedAfterFirst += atlas.GetStats().rasterized - before;
+				}
+				first = false;
+				Consume(batch.GetQuadCount());
+			});
+
+			graphics::glyphatlasstats stats = atlas.GetStats();
+			measure.SetMetric("glyphs", stats.glyphs);
+			measure.SetMetric("draws", static_cast<double>(batch.GetDraws().size()));
+			if (rasterizedAfterFirst)
+			{
+				measure.Fail(std::to_string(rasterizedAfterFirst) + " glyphs were rasterized again.");
+			}
+			else if (batch.GetDraws().size() != 1)
+			{
+				measure.Fail("The text took more than one draw.");
+			}
+		}
+
+		// Packs glyphs until the atlas is full and checks that none was packed over another one.
+		void AtlasFill(runner& measure)
+		{
+			std::string failure;
+			FLOAT fill = 0.0f;
+			UINT glyphs = 0;
+
+			measure.Run(10, [&]()
+			{
+				graphics::glyphatlas atlas(ATLAS_SIZE, ATLAS_SIZE, 18.0f, SyntheticGlyph);
+				std::vector<std::uint32_t> packed;
+				FLOAT area = 0.0f;
+
+				// The glyph that did not fit gets the fallback, it is not one of the packed ones.
+				for (std::uint32_t character = 0x100; atlas.GetStats().full == 0; character++)
+				{
+					if (atlas.Find(character) and atlas.GetStats().full == 0)
+					{
+						packed.push_back(character);
+					}
+				}
+
+				for (std::uint32_t character : packed)
+				{
+					const graphics::glyph *found = atlas.Find(character);
+					UINT x = static_cast<UINT>(found->u0 * ATLAS_SIZE + 0.5f), y = static_cast<UINT>(found->v0 * ATLAS_SIZE + 0.5f);
+					for (UINT row = 0; row < static_cast<UINT>(found->height); row++)
+					{
+						for (UINT column = 0; column < static_cast<UINT>(found->width); column++)
+						{
+							if (atlas.GetPixels()[(y + row) * ATLAS_SIZE + x + column] != static_cast<std::uint8_t>(character | 1))
+							{
+								failure = "A glyph was packed over another one.";
+							}
+						}
+					}
+					area += found->width * found->height;
+				}
+
+				glyphs = static_cast<UINT>(packed.size());
+				fill = area / static_cast<FLOAT>(ATLAS_SIZE * ATLAS_SIZE);
+				Consume(glyphs);
+			});
+
+			measure.SetMetric("glyphs", glyphs);
+			measure.SetMetric("fill_percent", 100.0 * fill);
+			if (!failure.empty())
+			{
+				measure.Fail(failure);
+			}
+		}
+	}
+
+	void RegisterSpriteBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("sprites/batch:shuffled", [](runner& measure) { Batch(measure, true); });
+		benchmarks.Add("sprites/batch:sorted", [](runner& measure) { Batch(measure, false); });
+		benchmarks.Add("sprites/text", Text);
+		benchmarks.Add("sprites/atlas_fill", AtlasFill);
+	}
+}
@@ -0,0 +1,70 @@
+#include "enginebenchmarks.h"
+#include <cstdint>
+#include <vector>
+#include "jobsystem.h"
+#include "terrain.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr UINT TERRAIN_SIZE{ 1025 };
+		// A 1080 pixel high viewport with a field of view of 45 degrees.
+		constexpr FLOAT PIXEL_SCALE{ 1303.0f };
+
+		graphics::terrainsettings Settings()
+		{
+			graphics::terrainsettings settings{};
+			settings.origin = D3DXVECTOR3(-512.0f, -35.0f, -512.0f);
+			settings.spacing = 1.0f;
+			settings.heightScale = 30.0f;
+			settings.pixelError = 2.0f;
+			settings.memoryBudget = 16 * 1024 * 1024;
+			return settings;
+		}
+
+		// Decoding the heightmap samples of a chunk into its vertices, the work of one streaming job.
+		void BuildChunk(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			std::vector<std::uint16_t> heights(TERRAIN_SIZE * TERRAIN_SIZE);
+			graphics::BuildHeightmap(TERRAIN_SIZE, 1, heights.data());
+			graphics::terrain land(jobs, heights.data(), TERRAIN_SIZE, Settings());
+			std::vector<graphics::colorvertex> vertices(graphics::TERRAIN_CHUNK_VERTICES);
+			UINT chunk = 0;
+
+			measure.SetItemsPerIteration(graphics::TERRAIN_CHUNK_VERTICES);
+			measure.Run(100, [&]()
+			{
+				chunk = (chunk + 1) % 1024;
+				land.BuildChunk(5, chunk % 32, chunk / 32, vertices.data());
+				Consume(vertices.back().position.y);
+			});
+		}
+
+		// Picking the chunks for a camera flying low over the terrain, loading the ones it reaches on the way.
+		void FlyOver(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			std::vector<std::uint16_t> heights(TERRAIN_SIZE * TERRAIN_SIZE);
+			graphics::BuildHeightmap(TERRAIN_SIZE, 1, heights.data());
+			graphics::terrain land(jobs, heights.data(), TERRAIN_SIZE, Settings());
+			D3DXVECTOR3 camera(-400.0f, 0.0f, -400.0f);
+
+			measure.Run(10, [&]()
+			{
+				camera.x = camera.x < 400.0f ? camera.x + 0.5f : -400.0f;
+				camera.z = camera.x;
+				land.Update(camera, PIXEL_SCALE);
+				land.Flush();
+				Consume(land.GetDraws().size());
+			});
+		}
+	}
+
+	void RegisterTerrainBenchmarks(suite& benchmarks)
+	{
+		benchmarks.Add("terrain/build_chunk", BuildChunk);
+		benchmarks.Add("terrain/fly_over:1025", FlyOver);
+	}
+}
@@ -0,0 +1,149 @@
+#include "enginebenchmarks.h"
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "jobsystem.h"
+#include "texturecook.h"
+#include "texturestreamer.h"
+
+namespace bench
+{
+	namespace
+	{
+		constexpr UINT TEXTURE_SIZE{ 1024 };
+		// Anything under this is a broken encoder rather than a poor one, the test image is smooth enough for 35 dB and more.
+		constexpr double MINIMUM_PSNR{ 30.0 };
+		// A grid of objects with a texture each, GRID_SIZE apart, for the camera to fly over.
+		constexpr UINT GRID_SIZE{ 16 };
+		constexpr FLOAT GRID_SPACING{ 16.0f };
+		// A 1080 pixel high viewport with a field of view of 45 degrees.
+		constexpr FLOAT PIXEL_SCALE{ 1303.0f };
+
+		// Smooth color waves with a finer pattern over them, closer to painted textures than noise, and optionally an alpha ramp.
+		graphics::imagedata BuildTestImage(UINT size, bool alpha)
+		{
+			graphics::imagedata image{ size, size, std::vector<std::uint8_t>(static_cast<std::size_t>(size) * size * 4) };
+			for (UINT y = 0; y < size; y++)
+			{
+				for (UINT x = 0; x < size; x++)
+				{
+					FLOAT u = static_cast<FLOAT>(x) / size, v = static_cast<FLOAT>(y) / size;
+					FLOAT detail = 0.1f * std::sin(u * 160.0f) * std::sin(v * 140.0f);
+					std::uint8_t *pixel = &image.pixels[(static_cast<std::size_t>(y) * size + x) * 4];
+					pixel[0] = static_cast<std::uint8_t>(255.0f * (0.5f + 0.35f * std::sin(u * 9.0f + v * 3.0f) + detail));
+					pixel[1] = static_cast<std::uint8_t>(255.0f * (0.5f + 0.35f * std::sin(v * 7.0f - u * 2.0f) + detail));
+					pixel[2] = static_cast<std::uint8_t>(255.0f * (0.5f + 0.35f * std::cos((u + v) * 5.0f) - detail));
+					pixel[3] = alpha ? static_cast<std::uint8_t>(255.0f * u) : 255;
+				}
+			}
+			return image;
+		}
+
+		// Filtering the whole mip chain of the image, the first step of every cook.
+		void MipChain(runner& measure, std::uint32_t threads)
+		{
+			core::jobsystem jobs(threads - 1);
+			graphics::imagedata image = BuildTestImage(TEXTURE_SIZE, true);
+			std::vector<graphics::imagedata> mips;
+
+			measure.SetItemsPerIteration(static_cast<double>(TEXTURE_SIZE) * TEXTURE_SIZE);
+			measure.Run(5, [&]()
+			{
+				graphics::BuildMipChain(jobs, image, true, mips);
+				Consume(mips.back().pixels[0]);
+			});
+		}
+
+		// A whole cook, mips and block compression, in source pixels per second.
+		// The quality is the PSNR of the top mip decoded again against the image.
+		void Cook(runner& measure, graphics::textureformat format, std::uint32_t threads)
+		{
+			core::jobsystem jobs(threads - 1);
+			// BC1 only keeps whether a pixel is transparent, it is measured on an opaque image.
+			graphics::imagedata image = BuildTestImage(TEXTURE_SIZE, format != graphics::textureformat::bc1), decoded;
+			graphics::cookedtexture cooked;
+
+			measure.SetItemsPerIteration(static_cast<double>(TEXTURE_SIZE) * TEXTURE_SIZE);
+			measure.Run(2, [&]()
+			{
+				graphics::CookTexture(jobs, image, format, true, cooked);
+				Consume(cooked.data.back());
+			});
+
+			graphics::DecodeCookedMip(cooked, 0, decoded);
+			double psnr = graphics::ComputePSNR(image, decoded);
+			measure.SetMetric("psnr_db", psnr);
+			if (psnr < MINIMUM_PSNR)
+			{
+				measure.Fail("PSNR of " + std::to_string(psnr) + " dB is too low.");
+			}
+		}
+
+		// Picking and loading the mips of 256 textures of 1024x1024 for a camera flying low over them.
+		// All the textures fully resident take 170 MB, the budget holds 24 MB.
+		void StreamFlyThrough(runner& measure)
+		{
+			core::jobsystem jobs(core::jobsystem::AUTO);
+			graphics::cookedtexture cooked;
+			graphics::CookTexture(jobs, BuildTestImage(TEXTURE_SIZE, false), graphics::textureformat::bc1, true, cooked);
+
+			graphics::texturestreamsettings settings{};
+			settings.memoryBudget = 24 * 1024 * 1024;
+			settings.uploadBudget = 2 * 1024 * 1024;
+			settings.tailSize = 64;
+			settings.mipBias = 0.0f;
+
+			graphics::texturestreamer streamer(jobs, settings);
+			std::vector<graphics::texturestreamer::textureid> textures;
+			for (UINT i = 0; i < GRID_SIZE * GRID_SIZE; i++)
+			{
+				textures.push_back(streamer.Add(&cooked));
+			}
+
+			FLOAT extent = GRID_SIZE * GRID_SPACING * 0.5f;
+			D3DXVECTOR3 camera(-extent, 2.0f, -extent);
+
+			measure.Run(10, [&]()
+			{
+				camera.x = camera.x < extent ? camera.x + 0.5f : -extent;
+				camera.z = camera.x;
+				streamer.SetView(camera, PIXEL_SCALE);
+				for (UINT i = 0; i < textures.size(); i++)
+				{
+					D3DXVECTOR3 center((i % GRID_SIZE) * GRID_SPACING - extent, 0.0f, (i / GRID_SIZE) * GRID_SPACING - extent);
+					streamer.Use(textures[i], center, 4.0f, 8.0f);
+				}
+				streamer.Update();
+				streamer.Flush();
+				Consume(streamer.GetUploads().size());
+			});
+
+			graphics::texturestreamstats stats = streamer.GetStats();
+			measure.SetMetric("resident_mb", stats.residentBytes / (1024.0 * 1024.0));
+			measure.SetMetric("missing_mips", stats.missingMips);
+			measure.SetMetric("evicted_mips", static_cast<double>(stats.evictedMips));
+			if (stats.residentBytes + stats.loadingBytes > settings.memoryBudget)
+			{
+				measure.Fail("The streamer went over its memory budget.");
+			}
+		}
+	}
+
+	void RegisterTextureBenchmarks(suite& benchmarks)
+	{
+		// Thread counts double up to the hardware threads, which are always included.
+		std::uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		for (std::uint32_t threads = 1; threads == 1 or threads / 2 < hardwareThreads; threads *= 2)
+		{
+			std::uint32_t count = threads < hardwareThreads ? threads : hardwareThreads;
+			std::string suffix = ":1024/threads:" + std::to_string(count);
+			benchmarks.Add("texture/mips" + suffix, [count](runner& measure) { MipChain(measure, count); });
+			benchmarks.Add("texture/cook_bc1" + suffix, [count](runner& measure) { Cook(measure, graphics::textureformat::bc1, count); });
+			benchmarks.Add("texture/cook_bc3" + suffix, [count](runner& measure) { Cook(measure, graphics::textureformat::bc3, count); });
+		}
+
+		benchmarks.Add("texture/stream_fly_through:256", StreamFlyThrough);
+	}
+}